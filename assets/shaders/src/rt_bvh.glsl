@@ -0,0 +1,148 @@
+// No #version here — only in .comp files.
+// Ray queries against the 4-wide BVH built on the CPU by src/rt_bvh.c, for
+// devices without hardware ray tracing. Node and triangle layouts mirror
+// XenoBvhNode / XenoBvhTri in src/rt_bvh.h.
+//
+// Define XENO_BVH_SET, XENO_BVH_NODES_BINDING and XENO_BVH_TRIS_BINDING
+// before including to move the two buffers.
+
+#ifndef XENO_BVH_SET
+#define XENO_BVH_SET 0
+#endif
+#ifndef XENO_BVH_NODES_BINDING
+#define XENO_BVH_NODES_BINDING 0
+#endif
+#ifndef XENO_BVH_TRIS_BINDING
+#define XENO_BVH_TRIS_BINDING 1
+#endif
+
+struct XenoBvhNode {
+    vec4 loX, hiX;      // the four child boxes, one lane per child
+    vec4 loY, hiY;
+    vec4 loZ, hiZ;
+    uvec4 child;        // node index, leaf (bit 31, count - 1 in 30..28, first) or empty
+    uvec4 pad;
+};
+
+struct XenoBvhTri {
+    vec4 v0;            // w: triangle index within its geometry (bits)
+    vec4 e1;            // w: geometry index (bits)
+    vec4 e2;
+};
+
+layout(std430, set = XENO_BVH_SET, binding = XENO_BVH_NODES_BINDING) readonly buffer XenoBvhNodes {
+    XenoBvhNode xenoBvhNodes[];
+};
+layout(std430, set = XENO_BVH_SET, binding = XENO_BVH_TRIS_BINDING) readonly buffer XenoBvhTris {
+    XenoBvhTri xenoBvhTris[];
+};
+
+const uint XENO_BVH_LEAF_BIT = 0x80000000u;
+const uint XENO_BVH_EMPTY = 0xFFFFFFFFu;
+// A level adds at most three entries, so this covers 15 levels; rt_bvh.c
+// warns about deeper trees. A full stack drops subtrees (missed hits).
+const uint XENO_BVH_STACK = 48u;
+const float XENO_BVH_INF = uintBitsToFloat(0x7F800000u);
+
+struct XenoHit {
+    float t;            // tmax on a miss
+    vec2 bary;
+    uint prim;          // XENO_BVH_EMPTY on a miss
+    uint geometry;
+};
+
+// Entry distance of the ray into each of the four child boxes, or INF.
+vec4 xenoBvhSlabs(XenoBvhNode n, vec3 o, vec3 inv, float tmin, float tmax)
+{
+    vec4 t0x = (n.loX - o.x) * inv.x, t1x = (n.hiX - o.x) * inv.x;
+    vec4 t0y = (n.loY - o.y) * inv.y, t1y = (n.hiY - o.y) * inv.y;
+    vec4 t0z = (n.loZ - o.z) * inv.z, t1z = (n.hiZ - o.z) * inv.z;
+    vec4 tn = max(max(min(t0x, t1x), min(t0y, t1y)), max(min(t0z, t1z), vec4(tmin)));
+    vec4 tf = min(min(max(t0x, t1x), max(t0y, t1y)), min(max(t0z, t1z), vec4(tmax)));
+    return mix(vec4(XENO_BVH_INF), tn, lessThanEqual(tn, tf));
+}
+
+// Moller-Trumbore; shortens tmax on a hit.
+bool xenoBvhTriangle(XenoBvhTri tri, vec3 o, vec3 d, float tmin, inout float tmax, out vec2 bary)
+{
+    vec3 p = cross(d, tri.e2.xyz);
+    float det = dot(tri.e1.xyz, p);
+    bary = vec2(0.0);
+    if (abs(det) < 1e-12) return false;
+    float inv = 1.0 / det;
+    vec3 s = o - tri.v0.xyz;
+    vec3 q = cross(s, tri.e1.xyz);
+    float u = dot(s, p) * inv;
+    float v = dot(d, q) * inv;
+    float t = dot(tri.e2.xyz, q) * inv;
+    if (u < 0.0 || v < 0.0 || u + v > 1.0 || t <= tmin || t >= tmax) return false;
+    tmax = t;
+    bary = vec2(u, v);
+    return true;
+}
+
+void xenoBvhOrder(inout float da, inout uint ca, inout float db, inout uint cb)
+{
+    if (da < db) {
+        float t = da; da = db; db = t;
+        uint c = ca; ca = cb; cb = c;
+    }
+}
+
+// anyHit stops at the first intersection, which is all shadow and AO rays
+// need; otherwise the closest one is returned. Children are visited near
+// to far so the closest-hit search can cull most of the tree.
+bool xenoRayQuery(vec3 o, vec3 d, float tmin, float tmax, bool anyHit, out XenoHit hit)
+{
+    // Keep 1/d finite so the slab test never sees 0 * inf.
+    vec3 sd = mix(d, mix(vec3(1e-20), vec3(-1e-20), lessThan(d, vec3(0.0))), lessThan(abs(d), vec3(1e-20)));
+    vec3 inv = 1.0 / sd;
+
+    hit.t = tmax;
+    hit.bary = vec2(0.0);
+    hit.prim = XENO_BVH_EMPTY;
+    hit.geometry = XENO_BVH_EMPTY;
+
+    uint stack[XENO_BVH_STACK];
+    uint sp = 0u;
+    uint node = 0u;
+    for (;;) {
+        XenoBvhNode n = xenoBvhNodes[node];
+        vec4 dist = xenoBvhSlabs(n, o, inv, tmin, hit.t);
+        uvec4 child = n.child;
+
+        // Leaves right away; they can only shorten the ray for the rest.
+        for (int i = 0; i < 4; ++i) {
+            uint c = child[i];
+            if (c == XENO_BVH_EMPTY) { dist[i] = XENO_BVH_INF; continue; }
+            if ((c & XENO_BVH_LEAF_BIT) == 0u || dist[i] >= hit.t) continue;
+            uint first = c & 0x0FFFFFFFu;
+            uint count = ((c >> 28) & 0x7u) + 1u;
+            for (uint k = 0u; k < count; ++k) {
+                XenoBvhTri tri = xenoBvhTris[first + k];
+                vec2 bary;
+                if (xenoBvhTriangle(tri, o, d, tmin, hit.t, bary)) {
+                    hit.bary = bary;
+                    hit.prim = floatBitsToUint(tri.v0.w);
+                    hit.geometry = floatBitsToUint(tri.e1.w);
+                    if (anyHit) return true;
+                }
+            }
+            dist[i] = XENO_BVH_INF;
+        }
+
+        // Far to near onto the stack, so the nearest child pops first.
+        xenoBvhOrder(dist.x, child.x, dist.y, child.y);
+        xenoBvhOrder(dist.z, child.z, dist.w, child.w);
+        xenoBvhOrder(dist.x, child.x, dist.z, child.z);
+        xenoBvhOrder(dist.y, child.y, dist.w, child.w);
+        xenoBvhOrder(dist.y, child.y, dist.z, child.z);
+        for (int i = 0; i < 4; ++i) {
+            if (dist[i] < hit.t && sp < XENO_BVH_STACK) stack[sp++] = child[i];
+        }
+
+        if (sp == 0u) break;
+        node = stack[--sp];
+    }
+    return hit.prim != XENO_BVH_EMPTY;
+}
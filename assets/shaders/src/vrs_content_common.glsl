@@ -0,0 +1,78 @@
+// No #version here — only in .comp files.
+// Content-adaptive shading rate: one workgroup per shading-rate attachment
+// texel. Threads sample the previous frame every 4th pixel in each axis
+// (1/16 of the pixels), reduce luminance and gradient energy in shared
+// memory, and thread 0 writes the rate for the tile.
+//
+// Define XENO_VRS_FETCH(p) to read source pixel p before including, and
+// call vrsContentMain() from main(). The rate attachment is set 0,
+// binding 1.
+layout(local_size_x = 8, local_size_y = 8, local_size_z = 1) in;
+
+layout(set = 0, binding = 1, r8ui) writeonly uniform uimage2D dstRate;
+
+layout(push_constant) uniform Push {
+    uvec2 extent;     // source image size in pixels
+    uvec2 tile;       // attachment texel size in pixels
+    float contrast2;  // normalized gradient below which an axis goes to 2x
+    float contrast4;  // ... and to 4x (contrast4 < contrast2)
+    float darkLum;    // mean luminance below which the tile goes to the maximum rate
+    uint maxLog2;     // coarsest rate per axis as log2 (0, 1 or 2)
+    uint srcIndex;    // heap slot of the source (vrs_content_bindless.comp)
+} pc;
+
+const uint STRIDE = 4u;
+
+shared float sLum[64];
+shared vec4 sAcc[64];   // lum, gx^2, gy^2, unused
+
+void vrsContentMain() {
+    uvec2 t = gl_LocalInvocationID.xy;
+    uint idx = t.y * 8u + t.x;
+    uvec2 active = min(max(pc.tile / STRIDE, uvec2(1u)), uvec2(8u));
+    bool inside = all(lessThan(t, active));
+
+    uvec2 p = gl_WorkGroupID.xy * pc.tile + t * STRIDE + uvec2(STRIDE / 2u);
+    p = min(p, pc.extent - uvec2(1u));
+    float lum = 0.0;
+    if (inside) {
+        vec3 c = XENO_VRS_FETCH(ivec2(p)).rgb;
+        lum = dot(c, vec3(0.2126, 0.7152, 0.0722));
+    }
+    sLum[idx] = lum;
+    barrier();
+
+    float gx = (inside && t.x + 1u < active.x) ? sLum[idx + 1u] - lum : 0.0;
+    float gy = (inside && t.y + 1u < active.y) ? sLum[idx + 8u] - lum : 0.0;
+    sAcc[idx] = vec4(lum, gx * gx, gy * gy, 0.0);
+    barrier();
+
+    for (uint s = 32u; s > 0u; s >>= 1u) {
+        if (idx < s) sAcc[idx] += sAcc[idx + s];
+        barrier();
+    }
+
+    if (idx != 0u) return;
+
+    vec4 sum = sAcc[0];
+    float n = float(active.x * active.y);
+    float nx = float(max((active.x - 1u) * active.y, 1u));
+    float ny = float(max(active.x * (active.y - 1u), 1u));
+    float mean = sum.x / n;
+
+    // Weber-style normalization: the same step is less visible on bright content.
+    float denom = mean + 0.05;
+    float cx = sqrt(sum.y / nx) / denom;
+    float cy = sqrt(sum.z / ny) / denom;
+
+    uint lx = cx < pc.contrast4 ? 2u : (cx < pc.contrast2 ? 1u : 0u);
+    uint ly = cy < pc.contrast4 ? 2u : (cy < pc.contrast2 ? 1u : 0u);
+    if (mean < pc.darkLum) { lx = 2u; ly = 2u; }
+    lx = min(lx, pc.maxLog2);
+    ly = min(ly, pc.maxLog2);
+    // 1x4 / 4x1 are not valid fragment sizes.
+    lx = min(lx, ly + 1u);
+    ly = min(ly, lx + 1u);
+
+    imageStore(dstRate, ivec2(gl_WorkGroupID.xy), uvec4((lx << 2u) | ly, 0u, 0u, 0u));
+}
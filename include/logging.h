@@ -1,12 +1,7 @@
 #ifndef LOGGING_H_
 #define LOGGING_H_
 
-#include <stdio.h>
-
-FILE *xeno_log_stream(void);
-
-#define logging_error(fmt, ...) fprintf(xeno_log_stream(), "[ExynosTools][E] " fmt "\n", ##__VA_ARGS__)
-#define logging_warn(fmt, ...)  fprintf(xeno_log_stream(), "[ExynosTools][W] " fmt "\n", ##__VA_ARGS__)
-#define logging_info(fmt, ...)  fprintf(xeno_log_stream(), "[ExynosTools][I] " fmt "\n", ##__VA_ARGS__)
+/* Legacy include name; logging_error/warn/info and XENO_LOG* come from xeno_log.h. */
+#include "xeno_log.h"
 
 #endif // LOGGING_H_
@@ -8,18 +8,20 @@ extern "C" {
 
 #include <vulkan/vulkan.h>
 #include <stddef.h>
+#include "xeno_mem.h"
+#include "xeno_upload.h"
 
 VkResult rt_create_buffer_with_memory(VkDevice device, VkPhysicalDevice physical,
                                       VkDeviceSize size, VkBufferUsageFlags usage,
                                       VkMemoryPropertyFlags properties,
-                                      VkBuffer *outBuffer, VkDeviceMemory *outMemory);
+                                      VkBuffer *outBuffer, XenoMemAlloc *outAlloc);
 
-void rt_destroy_buffer_with_memory(VkDevice device, VkBuffer buffer, VkDeviceMemory memory);
+void rt_destroy_buffer_with_memory(VkDevice device, VkBuffer buffer, XenoMemAlloc *alloc);
 
-VkResult rt_upload_to_buffer(VkDevice device, VkDeviceMemory memory, VkDeviceSize offset,
-                             const void *data, VkDeviceSize size, VkPhysicalDevice physical);
-
-size_t rt_guess_staging_size(VkDeviceSize requested);
+/* Host-visible allocations are written through their persistent mapping;
+   anything else is queued on `up` and lands at its next xeno_upload_flush. */
+VkResult rt_upload_to_buffer(VkDevice device, XenoUploader *up, VkBuffer buffer, const XenoMemAlloc *alloc,
+                             VkDeviceSize offset, const void *data, VkDeviceSize size);
 
 void rt_log_buffer_address(VkDevice device, VkBuffer buffer);
 
@@ -7,13 +7,48 @@ extern "C" {
 #endif
 
 #include <stdarg.h>
+#include <stdint.h>
+#include <stdatomic.h>
 
 /*
   Logging API:
-  - src/logging.c defines XENO_LOG_IMPLEMENTATION_PRESENT and provides a single non-inline implementation.
+  - src/logging.c provides the asynchronous backend. Targets that link it
+    define XENO_LOG_IMPLEMENTATION_PRESENT (see CMakeLists.txt / meson.build).
   - Other TUs include this header to get inline fallbacks if logging.c is not present.
+
+  Filtering happens in two stages, both before any argument is evaluated:
+  - XENO_LOG_MIN_LEVEL (build time) removes calls below it entirely. Defaults to
+    INFO when NDEBUG is set (Release builds) and DEBUG otherwise.
+  - The runtime level (EXYNOSTOOLS_LOG_LEVEL / EXYNOSTOOLS_DEBUG=1 or the
+    log_level key of performance_mode.conf) is one relaxed atomic load.
 */
 
+#define XENO_LOG_LEVEL_DEBUG 0
+#define XENO_LOG_LEVEL_INFO  1
+#define XENO_LOG_LEVEL_WARN  2
+#define XENO_LOG_LEVEL_ERROR 3
+#define XENO_LOG_LEVEL_OFF   4
+
+#ifndef XENO_LOG_MIN_LEVEL
+#  ifdef NDEBUG
+#    define XENO_LOG_MIN_LEVEL XENO_LOG_LEVEL_INFO
+#  else
+#    define XENO_LOG_MIN_LEVEL XENO_LOG_LEVEL_DEBUG
+#  endif
+#endif
+
+#include <stdio.h>
+
+/* Sink the backend writes to (stderr unless redirected). */
+FILE *xeno_log_stream(void);
+
+/* Per-call-site state for the *_RL macros. Zero-initialised statics. */
+typedef struct XenoLogRateLimit {
+    _Atomic uint64_t window_start_ms;
+    _Atomic uint32_t count;
+    _Atomic uint32_t suppressed;
+} XenoLogRateLimit;
+
 #ifdef XENO_LOG_IMPLEMENTATION_PRESENT
 
 void logging_info(const char *fmt, ...);
@@ -21,9 +56,28 @@ void logging_warn(const char *fmt, ...);
 void logging_error(const char *fmt, ...);
 void logging_debug(const char *fmt, ...);
 
-#else
+/* Block until the writer thread has emitted everything logged so far. */
+void xeno_log_flush(void);
+/* Records currently counted as dropped because a thread's ring was full. */
+unsigned long long xeno_log_dropped_count(void);
 
-#include <stdio.h>
+/* Runtime minimum level; read by the macros with a relaxed load. */
+extern _Atomic int xeno_log_level_g;
+
+void xeno_log_set_level(int level);
+/* Parses "debug" / "info" / "warn" / "error" / "off"; returns -1 if unknown. */
+int xeno_log_parse_level(const char *name);
+
+/* Returns 1 if the call site may log now. *suppressed receives the number of
+   messages dropped during the previous one-second window (reported once). */
+int xeno_log_ratelimit_check(XenoLogRateLimit *rl, uint32_t per_sec, uint32_t *suppressed);
+
+static inline int xeno_log_level_enabled(int level)
+{
+    return level >= atomic_load_explicit(&xeno_log_level_g, memory_order_relaxed);
+}
+
+#else
 
 static inline void xeno_log_vprint(const char *tag, const char *fmt, va_list va)
 {
@@ -49,12 +103,64 @@ static inline void logging_debug(const char *fmt, ...)
     va_list va; va_start(va, fmt); xeno_log_vprint("DEBUG", fmt, va); va_end(va);
 }
 
+static inline void xeno_log_flush(void) { fflush(stderr); }
+
+static inline int xeno_log_level_enabled(int level) { return level >= XENO_LOG_LEVEL_INFO; }
+
+static inline int xeno_log_ratelimit_check(XenoLogRateLimit *rl, uint32_t per_sec, uint32_t *suppressed)
+{
+    (void)rl; (void)per_sec;
+    *suppressed = 0;
+    return 1;
+}
+
 #endif /* XENO_LOG_IMPLEMENTATION_PRESENT */
 
-#define XENO_LOGI(...) logging_info(__VA_ARGS__)
-#define XENO_LOGW(...) logging_warn(__VA_ARGS__)
-#define XENO_LOGE(...) logging_error(__VA_ARGS__)
-#define XENO_LOGD(...) logging_debug(__VA_ARGS__)
+#define XENO_LOG_AT_(level, fn, ...) \
+    do { if (xeno_log_level_enabled(level)) fn(__VA_ARGS__); } while (0)
+
+#define XENO_LOG_RL_AT_(level, fn, per_sec, ...)                                          \
+    do {                                                                                  \
+        if (xeno_log_level_enabled(level)) {                                              \
+            static XenoLogRateLimit xeno_rl_;                                             \
+            uint32_t xeno_rl_suppressed_;                                                 \
+            if (xeno_log_ratelimit_check(&xeno_rl_, (per_sec), &xeno_rl_suppressed_)) {  \
+                if (xeno_rl_suppressed_)                                                  \
+                    fn("%s:%d: suppressed %u messages", __FILE__, __LINE__,               \
+                       (unsigned)xeno_rl_suppressed_);                                    \
+                fn(__VA_ARGS__);                                                          \
+            }                                                                             \
+        }                                                                                 \
+    } while (0)
+
+/* Compiled-out levels keep their arguments type-checked but generate no code. */
+#define XENO_LOG_OFF_(fn, ...) do { if (0) fn(__VA_ARGS__); } while (0)
+
+#if XENO_LOG_MIN_LEVEL <= XENO_LOG_LEVEL_DEBUG
+#define XENO_LOGD(...)            XENO_LOG_AT_(XENO_LOG_LEVEL_DEBUG, logging_debug, __VA_ARGS__)
+#define XENO_LOGD_RL(per_sec, ...) XENO_LOG_RL_AT_(XENO_LOG_LEVEL_DEBUG, logging_debug, per_sec, __VA_ARGS__)
+#else
+#define XENO_LOGD(...)            XENO_LOG_OFF_(logging_debug, __VA_ARGS__)
+#define XENO_LOGD_RL(per_sec, ...) XENO_LOG_OFF_(logging_debug, __VA_ARGS__)
+#endif
+
+#if XENO_LOG_MIN_LEVEL <= XENO_LOG_LEVEL_INFO
+#define XENO_LOGI(...)            XENO_LOG_AT_(XENO_LOG_LEVEL_INFO, logging_info, __VA_ARGS__)
+#define XENO_LOGI_RL(per_sec, ...) XENO_LOG_RL_AT_(XENO_LOG_LEVEL_INFO, logging_info, per_sec, __VA_ARGS__)
+#else
+#define XENO_LOGI(...)            XENO_LOG_OFF_(logging_info, __VA_ARGS__)
+#define XENO_LOGI_RL(per_sec, ...) XENO_LOG_OFF_(logging_info, __VA_ARGS__)
+#endif
+
+#if XENO_LOG_MIN_LEVEL <= XENO_LOG_LEVEL_WARN
+#define XENO_LOGW(...)            XENO_LOG_AT_(XENO_LOG_LEVEL_WARN, logging_warn, __VA_ARGS__)
+#define XENO_LOGW_RL(per_sec, ...) XENO_LOG_RL_AT_(XENO_LOG_LEVEL_WARN, logging_warn, per_sec, __VA_ARGS__)
+#else
+#define XENO_LOGW(...)            XENO_LOG_OFF_(logging_warn, __VA_ARGS__)
+#define XENO_LOGW_RL(per_sec, ...) XENO_LOG_OFF_(logging_warn, __VA_ARGS__)
+#endif
+
+#define XENO_LOGE(...) XENO_LOG_AT_(XENO_LOG_LEVEL_ERROR, logging_error, __VA_ARGS__)
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,104 @@
+// include/xeno_mem.h
+#ifndef XENO_MEM_H
+#define XENO_MEM_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <vulkan/vulkan.h>
+#include <stdint.h>
+
+/*
+  Device-memory sub-allocator shared by every layer subsystem (src/xeno_mem.c).
+
+  One allocator per device, created on first use. Each memory type gets a
+  pool of large VkDeviceMemory blocks carved up with a TLSF allocator;
+  host-visible blocks stay mapped for their whole life. Buffers / linear
+  images and optimal-tiling images come from separate pools whenever the
+  device has a bufferImageGranularity above 1, so they never share a page.
+  Buffers with device-address usage get blocks allocated with
+  VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT. Requests of at least half a block
+  get a dedicated allocation.
+
+  Transient data (staging, per-frame constants) goes into a linear arena:
+  a chain of host-visible buffer pages that is bump-allocated and reset by
+  its owner once the GPU is done with it.
+
+  The allocator is thread-safe; an arena is not (one owner per arena).
+*/
+
+typedef struct XenoMemAllocator XenoMemAllocator;
+typedef struct XenoMemLinear XenoMemLinear;
+
+typedef enum XenoMemKind {
+    XENO_MEM_KIND_LINEAR = 0,   /* buffers and VK_IMAGE_TILING_LINEAR images */
+    XENO_MEM_KIND_OPTIMAL = 1,  /* VK_IMAGE_TILING_OPTIMAL images */
+    XENO_MEM_KIND_ADDRESS = 2,  /* buffers with SHADER_DEVICE_ADDRESS usage */
+} XenoMemKind;
+
+typedef struct XenoMemAlloc {
+    VkDeviceMemory memory;
+    VkDeviceSize offset;
+    VkDeviceSize size;
+    void* mapped;               /* host pointer to offset, NULL unless host-visible */
+    uint32_t type;              /* memory type index */
+    void* block;                /* NULL for dedicated allocations */
+    uint32_t node;
+} XenoMemAlloc;
+
+typedef struct XenoMemSlice {
+    VkBuffer buffer;
+    VkDeviceSize offset;
+    void* mapped;
+} XenoMemSlice;
+
+typedef struct XenoMemStats {
+    uint32_t device_allocations;   /* live VkDeviceMemory objects */
+    uint32_t sub_allocations;
+    VkDeviceSize reserved_bytes;   /* bytes held from the driver */
+    VkDeviceSize used_bytes;
+    VkDeviceSize largest_free;     /* largest free range in any block */
+} XenoMemStats;
+
+/* NULL when the device is not known to the layer. */
+XenoMemAllocator* xeno_mem_allocator(VkDevice device);
+/* Frees every block; called from vkDestroyDevice after all subsystems are gone. */
+void xeno_mem_device_destroy(VkDevice device);
+
+/* `required` must all be present; `preferred` picks among the remaining types. */
+VkResult xeno_mem_alloc(XenoMemAllocator* mem, const VkMemoryRequirements* req,
+                        VkMemoryPropertyFlags required, VkMemoryPropertyFlags preferred,
+                        XenoMemKind kind, XenoMemAlloc* out);
+void xeno_mem_free(XenoMemAllocator* mem, XenoMemAlloc* alloc);
+
+/* Create + allocate + bind. On failure nothing is left behind. */
+VkResult xeno_mem_create_buffer(XenoMemAllocator* mem, VkDeviceSize size, VkBufferUsageFlags usage,
+                                VkMemoryPropertyFlags required, VkMemoryPropertyFlags preferred,
+                                VkBuffer* out_buffer, XenoMemAlloc* out_alloc);
+void xeno_mem_destroy_buffer(XenoMemAllocator* mem, VkBuffer buffer, XenoMemAlloc* alloc);
+
+VkResult xeno_mem_create_image(XenoMemAllocator* mem, const VkImageCreateInfo* ci,
+                               VkMemoryPropertyFlags required, VkImage* out_image, XenoMemAlloc* out_alloc);
+void xeno_mem_destroy_image(XenoMemAllocator* mem, VkImage image, XenoMemAlloc* alloc);
+
+/* Flushes [offset, offset + size) of a host-visible allocation; a no-op on
+   coherent memory. Ranges are widened to nonCoherentAtomSize. */
+VkResult xeno_mem_flush(XenoMemAllocator* mem, const XenoMemAlloc* alloc, VkDeviceSize offset, VkDeviceSize size);
+
+void xeno_mem_get_stats(XenoMemAllocator* mem, XenoMemStats* out);
+
+/* Linear arenas. page_size 0 picks the default (1 MiB). */
+XenoMemLinear* xeno_mem_linear_create(XenoMemAllocator* mem, VkBufferUsageFlags usage, VkDeviceSize page_size);
+void xeno_mem_linear_destroy(XenoMemLinear* arena);
+VkResult xeno_mem_linear_alloc(XenoMemLinear* arena, VkDeviceSize size, VkDeviceSize align, XenoMemSlice* out);
+/* Flushes everything allocated since the last reset (non-coherent memory only). */
+void xeno_mem_linear_flush(XenoMemLinear* arena);
+/* Every slice handed out so far becomes invalid; oversized pages are released. */
+void xeno_mem_linear_reset(XenoMemLinear* arena);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* XENO_MEM_H */
@@ -0,0 +1,91 @@
+// include/xeno_trace.h
+#ifndef XENO_TRACE_H
+#define XENO_TRACE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdatomic.h>
+
+/*
+  Timeline tracing of layer events (src/trace.c).
+
+  Events go into per-thread binary buffers stamped with CLOCK_MONOTONIC and
+  are written as Chrome Trace Event JSON (loadable in chrome://tracing and
+  ui.perfetto.dev) when a capture ends.
+
+  EXYNOSTOOLS_TRACE=1        capture from startup
+  EXYNOSTOOLS_TRACE=signal   SIGUSR2 starts a capture, a second SIGUSR2 ends it early
+  EXYNOSTOOLS_TRACE_SECONDS  capture length (default 10)
+  EXYNOSTOOLS_TRACE_FILE     output path (default <shader_cache_dir>/exynostools-trace-<pid>.json)
+
+  When no capture is running every macro is a single relaxed load and a
+  branch; defining XENO_TRACE_DISABLED removes them at compile time.
+*/
+
+/* Names must be string literals or otherwise outlive the capture. */
+void xeno_trace_record_begin(const char *name);
+void xeno_trace_record_end(const char *name);
+void xeno_trace_record_instant(const char *name);
+void xeno_trace_record_counter(const char *name, int64_t value);
+
+/* Start a capture now / end it and write the file. Safe to call from any thread. */
+void xeno_trace_start(void);
+void xeno_trace_stop_and_flush(void);
+
+extern _Atomic int xeno_trace_active_g;
+
+static inline int xeno_trace_active(void)
+{
+    return atomic_load_explicit(&xeno_trace_active_g, memory_order_relaxed);
+}
+
+typedef struct XenoTraceScope {
+    const char *name;
+    int recorded;
+} XenoTraceScope;
+
+static inline XenoTraceScope xeno_trace_scope_begin(const char *name)
+{
+    XenoTraceScope s = { name, 0 };
+    if (xeno_trace_active()) { xeno_trace_record_begin(name); s.recorded = 1; }
+    return s;
+}
+
+static inline void xeno_trace_scope_end(XenoTraceScope *s)
+{
+    if (s->recorded) xeno_trace_record_end(s->name);
+}
+
+#define XENO_TRACE_CAT2_(a, b) a##b
+#define XENO_TRACE_CAT_(a, b) XENO_TRACE_CAT2_(a, b)
+
+#if defined(XENO_TRACE_DISABLED)
+#define XENO_TRACE_BEGIN(name)          do { } while (0)
+#define XENO_TRACE_END(name)            do { } while (0)
+#define XENO_TRACE_INSTANT(name)        do { } while (0)
+#define XENO_TRACE_COUNTER(name, value) do { } while (0)
+#define XENO_TRACE_SCOPE(name)          do { } while (0)
+#else
+#define XENO_TRACE_BEGIN(name)   do { if (xeno_trace_active()) xeno_trace_record_begin(name); } while (0)
+#define XENO_TRACE_END(name)     do { if (xeno_trace_active()) xeno_trace_record_end(name); } while (0)
+#define XENO_TRACE_INSTANT(name) do { if (xeno_trace_active()) xeno_trace_record_instant(name); } while (0)
+#define XENO_TRACE_COUNTER(name, value) \
+    do { if (xeno_trace_active()) xeno_trace_record_counter((name), (int64_t)(value)); } while (0)
+#if defined(__GNUC__) || defined(__clang__)
+/* Begin now, end automatically when the enclosing block exits. */
+#define XENO_TRACE_SCOPE(name) \
+    XenoTraceScope XENO_TRACE_CAT_(xeno_trace_scope_, __LINE__) \
+        __attribute__((cleanup(xeno_trace_scope_end))) = xeno_trace_scope_begin(name)
+#else
+#define XENO_TRACE_SCOPE(name) XENO_TRACE_INSTANT(name)
+#endif
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* XENO_TRACE_H */
@@ -0,0 +1,61 @@
+// include/xeno_upload.h
+#ifndef XENO_UPLOAD_H
+#define XENO_UPLOAD_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <vulkan/vulkan.h>
+#include <stdint.h>
+
+/*
+  Upload manager for buffers in any memory type (src/xeno_upload.c).
+
+  Writes are packed into persistently mapped staging pages (xeno_mem linear
+  arenas) and recorded as regions; a flush turns all of them into one
+  vkCmdCopyBuffer per staging page / destination pair between two memory
+  barriers, and submits that on the given queue. The leading barrier waits
+  for earlier work on that queue, so destinations it still reads can be
+  rewritten; work on other queues has to be fenced by the caller. Writes
+  to the same destination that are adjacent in both buffers become one
+  region; overlapping writes land in write order.
+
+  A few flushes can be in flight; their staging is reused once the flush's
+  fence has signalled. The staging page size follows the largest flush of
+  a rolling window, so a level load gets big pages and steady-state
+  per-frame updates get small ones, down to upload_page_kb.
+
+  One owner per uploader. The queue is used directly: layer code that
+  flushes on an app queue must drain the async submitter first.
+*/
+
+typedef struct XenoUploader XenoUploader;
+
+/* queue_family is the family of the queue passed to xeno_upload_flush.
+   NULL when the device is not known to the layer. */
+XenoUploader* xeno_upload_create(VkDevice device, uint32_t queue_family);
+/* Waits for every flush in flight. Unflushed writes are dropped. */
+void xeno_upload_destroy(XenoUploader* up);
+
+/* Copies size bytes now; the destination is written at the next flush. */
+VkResult xeno_upload_write(XenoUploader* up, VkBuffer dst, VkDeviceSize dst_offset,
+                           const void* data, VkDeviceSize size);
+/* Same as xeno_upload_write but returns staging memory to fill in place,
+   valid until the next flush. NULL on failure. */
+void* xeno_upload_map(XenoUploader* up, VkBuffer dst, VkDeviceSize dst_offset, VkDeviceSize size);
+
+/* Records and submits all pending writes. Work submitted to the queue
+   afterwards sees the data. A no-op when nothing is pending. */
+VkResult xeno_upload_flush(XenoUploader* up, VkQueue queue);
+/* Blocks until every flush so far has completed on the GPU. */
+void xeno_upload_wait(XenoUploader* up);
+
+/* Current staging page size, derived from the recent upload volume. */
+VkDeviceSize xeno_upload_staging_size(const XenoUploader* up);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* XENO_UPLOAD_H */
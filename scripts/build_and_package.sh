@@ -190,6 +190,28 @@ cat > "${PKG_DIR}/usr/share/exynostools/meta.json" <<'EOF'
 EOF
 echo "✅ meta.json created at ${PKG_DIR}/usr/share/exynostools/meta.json"
 
+# Vulkan layer manifest so the loader can insert the wrapper (VK_INSTANCE_LAYERS=VK_LAYER_EXYNOSTOOLS_xeno)
+mkdir -p "${PKG_DIR}/usr/share/vulkan/explicit_layer.d"
+cat > "${PKG_DIR}/usr/share/vulkan/explicit_layer.d/exynostools_layer.json" <<EOF
+{
+  "file_format_version": "1.2.0",
+  "layer": {
+    "name": "VK_LAYER_EXYNOSTOOLS_xeno",
+    "type": "GLOBAL",
+    "library_path": "../../../../${LIB_DIR_REL}/libxeno_wrapper.so",
+    "api_version": "1.3.0",
+    "implementation_version": "1",
+    "description": "ExynosTools compatibility and performance layer for Xclipse GPUs",
+    "functions": {
+      "vkGetInstanceProcAddr": "xeno_GetInstanceProcAddr",
+      "vkGetDeviceProcAddr": "xeno_GetDeviceProcAddr",
+      "vkNegotiateLoaderLayerInterfaceVersion": "vkNegotiateLoaderLayerInterfaceVersion"
+    }
+  }
+}
+EOF
+echo "✅ layer manifest created at ${PKG_DIR}/usr/share/vulkan/explicit_layer.d/exynostools_layer.json"
+
 # Also copy the user's manifest into the package root for Winlator to read if present
 if [ -f "${ROOT_DIR}/manifests/xclipse-940-manifest.json" ]; then
   mkdir -p "${PKG_DIR}/usr/share/exynostools/manifests"
@@ -20,7 +20,7 @@ for src in "$SH_DIR"/*.{comp,glsl}; do
   name="$(basename "$src")"
   base="${name%%.*}"
   case "$name" in
-    bc_common.glsl|common.glsl|shared.glsl) echo "Skipping include-only: $name"; continue ;;
+    bc_common.glsl|common.glsl|shared.glsl|rt_bvh.glsl|vrs_content_common.glsl) echo "Skipping include-only: $name"; continue ;;
   esac
 
   raw="$TMP_DIR/${base}.spv"
@@ -1,11 +1,505 @@
+// src/app_profile.c
 /*
-  src/app_profile.c
-  Application profile detection stub.
+  Game profile database (see app_profile.h).
+
+  Layout of profiles.db, all offsets relative to the start of the file:
+
+    header | keys[key_count] | profiles[profile_count] |
+    settings[setting_count] | string bytes
+
+  keys is sorted by the FNV-1a hash of the normalized executable name, so
+  a lookup is a binary search plus one string compare to rule out a
+  collision. Strings are NUL-terminated and referenced by offset, which
+  lets the mapped file be used in place.
 */
-#include "logging.h"
+#include "app_profile.h"
+#include "perf_conf.h"
+#include "xeno_log.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <ctype.h>
+#include <time.h>
+#include <pthread.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define XENO_PROFILE_DB_MAGIC    0x42445058u  /* "XPDB" */
+#define XENO_PROFILE_DB_VERSION  1u
+#define XENO_PROFILE_NAME_MAX    128
+#define XENO_PROFILE_MAX_SETTINGS 256
+
+typedef struct XenoProfileDbHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t key_count;
+    uint32_t profile_count;
+    uint32_t setting_count;
+    uint32_t string_bytes;
+    uint64_t stamp;             /* of the profile directory the file was built from */
+    uint64_t checksum;          /* FNV-1a over everything after the header */
+} XenoProfileDbHeader;
+
+typedef struct XenoProfileDbKey {
+    uint64_t hash;
+    uint32_t name;              /* string offset */
+    uint32_t profile;
+} XenoProfileDbKey;
+
+typedef struct XenoProfileDbProfile {
+    uint32_t name;
+    uint32_t first_setting;
+    uint32_t setting_count;
+    uint32_t pad;
+} XenoProfileDbProfile;
+
+typedef struct XenoProfileDbSetting {
+    uint32_t key;
+    uint32_t value;
+} XenoProfileDbSetting;
+
+typedef struct XenoProfileDb {
+    const uint8_t* data;
+    size_t size;
+    int mapped;
+    const XenoProfileDbHeader* header;
+    const XenoProfileDbKey* keys;
+    const XenoProfileDbProfile* profiles;
+    const XenoProfileDbSetting* settings;
+    const char* strings;
+} XenoProfileDb;
+
+static XenoProfileDb g_db;
+static const XenoProfileDbProfile* g_match;
+static char g_exe[XENO_PROFILE_NAME_MAX];   /* normalized */
+static pthread_once_t g_once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t g_mtx = PTHREAD_MUTEX_INITIALIZER;   /* g_cache_dir, g_env_exported */
+static int g_env_exported;
+static char g_cache_dir[512];
+
+static uint64_t fnv1a64(uint64_t h, const void* data, size_t len) {
+    const uint8_t* p = (const uint8_t*)data;
+    for (size_t i = 0; i < len; ++i) {
+        h ^= p[i];
+        h *= 0x100000001b3ull;
+    }
+    return h;
+}
+
+/* Basename of a Unix or Windows path, lowercased, without ".exe". */
+static void normalize_name(const char* in, char* out, size_t cap) {
+    const char* base = in;
+    for (const char* p = in; *p; ++p) {
+        if (*p == '/' || *p == '\\') base = p + 1;
+    }
+    size_t n = 0;
+    while (base[n] && n + 1 < cap) {
+        out[n] = (char)tolower((unsigned char)base[n]);
+        ++n;
+    }
+    out[n] = 0;
+    if (n > 4 && strcmp(out + n - 4, ".exe") == 0) out[n - 4] = 0;
+}
+
+static uint64_t name_hash(const char* normalized) {
+    return fnv1a64(0xcbf29ce484222325ull, normalized, strlen(normalized));
+}
+
+static const char* profile_dir(void) {
+    const char* dir = getenv("EXYNOSTOOLS_PROFILE_DIR");
+    return dir && *dir ? dir : XENO_APP_PROFILE_DIR;
+}
+
+static int is_profile_file(const char* name) {
+    size_t n = strlen(name);
+    return n > 5 && name[0] != '.' && strcmp(name + n - 5, ".conf") == 0;
+}
+
+/* Cheap enough for every launch: one stat per profile, no reads. The sum
+   makes it independent of readdir order. */
+static uint64_t dir_stamp(const char* dir) {
+    DIR* d = opendir(dir);
+    if (!d) return 0;
+    uint64_t stamp = 0x9e3779b97f4a7c15ull;
+    char path[1024];
+    struct dirent* e;
+    while ((e = readdir(d))) {
+        if (!is_profile_file(e->d_name)) continue;
+        struct stat st;
+        snprintf(path, sizeof(path), "%s/%s", dir, e->d_name);
+        if (stat(path, &st) != 0) continue;
+        uint64_t h = fnv1a64(0xcbf29ce484222325ull, e->d_name, strlen(e->d_name));
+        int64_t meta[3] = { (int64_t)st.st_size, (int64_t)st.st_mtim.tv_sec, (int64_t)st.st_mtim.tv_nsec };
+        stamp += fnv1a64(h, meta, sizeof(meta));
+    }
+    closedir(d);
+    return stamp;
+}
+
+/* ---------------------------------------------------------------- */
+/* Building                                                          */
+/* ---------------------------------------------------------------- */
+
+typedef struct XenoProfileBuilder {
+    XenoProfileDbKey* keys;
+    uint32_t key_count, key_cap;
+    XenoProfileDbProfile* profiles;
+    uint32_t profile_count, profile_cap;
+    XenoProfileDbSetting* settings;
+    uint32_t setting_count, setting_cap;
+    char* strings;
+    uint32_t string_bytes, string_cap;
+    int failed;
+} XenoProfileBuilder;
+
+static void* grow(void* items, uint32_t* cap, uint32_t need, size_t item_size, int* failed) {
+    if (need <= *cap) return items;
+    uint32_t n = *cap ? *cap * 2u : 64u;
+    while (n < need) n *= 2u;
+    void* p = realloc(items, (size_t)n * item_size);
+    if (!p) {
+        *failed = 1;
+        return items;
+    }
+    *cap = n;
+    return p;
+}
+
+static uint32_t add_string(XenoProfileBuilder* b, const char* s) {
+    uint32_t len = (uint32_t)strlen(s) + 1u;
+    b->strings = (char*)grow(b->strings, &b->string_cap, b->string_bytes + len, 1, &b->failed);
+    if (b->failed) return 0;
+    uint32_t off = b->string_bytes;
+    memcpy(b->strings + off, s, len);
+    b->string_bytes += len;
+    return off;
+}
+
+static void add_key(XenoProfileBuilder* b, const char* exe, uint32_t profile) {
+    char name[XENO_PROFILE_NAME_MAX];
+    normalize_name(exe, name, sizeof(name));
+    if (!name[0]) return;
+    b->keys = (XenoProfileDbKey*)grow(b->keys, &b->key_cap, b->key_count + 1u, sizeof(*b->keys), &b->failed);
+    if (b->failed) return;
+    b->keys[b->key_count++] = (XenoProfileDbKey){ name_hash(name), add_string(b, name), profile };
+}
+
+static char* trim(char* s) {
+    while (*s == ' ' || *s == '\t') ++s;
+    size_t len = strlen(s);
+    while (len && (s[len-1] == '\n' || s[len-1] == '\r' || s[len-1] == ' ' || s[len-1] == '\t')) s[--len] = 0;
+    return s;
+}
+
+static void parse_profile(XenoProfileBuilder* b, const char* dir, const char* file) {
+    char path[1024];
+    snprintf(path, sizeof(path), "%s/%s", dir, file);
+    FILE* f = fopen(path, "r");
+    if (!f) {
+        XENO_LOGD("app_profile: cannot open %s", path);
+        return;
+    }
+
+    char stem[XENO_PROFILE_NAME_MAX];
+    snprintf(stem, sizeof(stem), "%.*s", (int)(strlen(file) - 5), file);
+    uint32_t index = b->profile_count;
+    b->profiles = (XenoProfileDbProfile*)grow(b->profiles, &b->profile_cap, index + 1u, sizeof(*b->profiles), &b->failed);
+    if (b->failed) {
+        fclose(f);
+        return;
+    }
+    XenoProfileDbProfile p = { .name = add_string(b, stem), .first_setting = b->setting_count };
+    add_key(b, stem, index);
+
+    char line[1024];
+    while (fgets(line, sizeof(line), f) && !b->failed) {
+        char* s = trim(line);
+        if (s[0] == '#' || s[0] == '\0') continue;
+        char* eq = strchr(s, '=');
+        if (!eq || eq == s) continue;
+        *eq = 0;
+        char* key = trim(s);
+        char* val = trim(eq + 1);
+        if (strcmp(key, "exe") == 0) {
+            add_key(b, val, index);
+            continue;
+        }
+        if (p.setting_count == XENO_PROFILE_MAX_SETTINGS) {
+            XENO_LOGW("app_profile: %s has more than %u settings, ignoring the rest", path, XENO_PROFILE_MAX_SETTINGS);
+            break;
+        }
+        b->settings = (XenoProfileDbSetting*)grow(b->settings, &b->setting_cap, b->setting_count + 1u,
+                                                  sizeof(*b->settings), &b->failed);
+        if (b->failed) break;
+        uint32_t k = add_string(b, key);
+        b->settings[b->setting_count++] = (XenoProfileDbSetting){ k, add_string(b, val) };
+        p.setting_count++;
+    }
+    fclose(f);
+    b->profiles[b->profile_count++] = p;
+}
+
+static int key_cmp(const void* a, const void* b) {
+    const XenoProfileDbKey* x = (const XenoProfileDbKey*)a;
+    const XenoProfileDbKey* y = (const XenoProfileDbKey*)b;
+    return x->hash < y->hash ? -1 : x->hash > y->hash;
+}
+
+/* Parses every profile into one malloc'd image in the file layout. */
+static uint8_t* build_db(const char* dir, uint64_t stamp, size_t* out_size) {
+    XenoProfileBuilder b;
+    memset(&b, 0, sizeof(b));
+    add_string(&b, "");
+
+    DIR* d = opendir(dir);
+    if (d) {
+        struct dirent* e;
+        while ((e = readdir(d)) && !b.failed) {
+            if (is_profile_file(e->d_name)) parse_profile(&b, dir, e->d_name);
+        }
+        closedir(d);
+    }
+    /* Stable order, so a name claimed by two profiles always resolves the same way. */
+    if (!b.failed && b.key_count) qsort(b.keys, b.key_count, sizeof(*b.keys), key_cmp);
+
+    uint8_t* image = NULL;
+    size_t size = sizeof(XenoProfileDbHeader) + (size_t)b.key_count * sizeof(XenoProfileDbKey) +
+                  (size_t)b.profile_count * sizeof(XenoProfileDbProfile) +
+                  (size_t)b.setting_count * sizeof(XenoProfileDbSetting) + b.string_bytes;
+    if (!b.failed) image = (uint8_t*)malloc(size);
+    if (image) {
+        XenoProfileDbHeader* h = (XenoProfileDbHeader*)image;
+        memset(h, 0, sizeof(*h));
+        h->magic = XENO_PROFILE_DB_MAGIC;
+        h->version = XENO_PROFILE_DB_VERSION;
+        h->key_count = b.key_count;
+        h->profile_count = b.profile_count;
+        h->setting_count = b.setting_count;
+        h->string_bytes = b.string_bytes;
+        h->stamp = stamp;
+        uint8_t* p = image + sizeof(*h);
+        memcpy(p, b.keys, (size_t)b.key_count * sizeof(*b.keys));
+        p += (size_t)b.key_count * sizeof(*b.keys);
+        memcpy(p, b.profiles, (size_t)b.profile_count * sizeof(*b.profiles));
+        p += (size_t)b.profile_count * sizeof(*b.profiles);
+        memcpy(p, b.settings, (size_t)b.setting_count * sizeof(*b.settings));
+        p += (size_t)b.setting_count * sizeof(*b.settings);
+        memcpy(p, b.strings, b.string_bytes);
+        h->checksum = fnv1a64(0xcbf29ce484222325ull, image + sizeof(*h), size - sizeof(*h));
+        *out_size = size;
+    }
+    free(b.keys);
+    free(b.profiles);
+    free(b.settings);
+    free(b.strings);
+    return image;
+}
+
+/* ---------------------------------------------------------------- */
+/* Database file                                                     */
+/* ---------------------------------------------------------------- */
+
+/* Points the section pointers into data; 0 if it is not a usable image. */
+static int db_bind(XenoProfileDb* db, const uint8_t* data, size_t size, uint64_t stamp) {
+    if (size < sizeof(XenoProfileDbHeader)) return 0;
+    const XenoProfileDbHeader* h = (const XenoProfileDbHeader*)data;
+    if (h->magic != XENO_PROFILE_DB_MAGIC || h->version != XENO_PROFILE_DB_VERSION || h->stamp != stamp) return 0;
+    size_t need = sizeof(*h) + (size_t)h->key_count * sizeof(XenoProfileDbKey) +
+                  (size_t)h->profile_count * sizeof(XenoProfileDbProfile) +
+                  (size_t)h->setting_count * sizeof(XenoProfileDbSetting) + h->string_bytes;
+    if (need != size || !h->string_bytes) return 0;
+    if (fnv1a64(0xcbf29ce484222325ull, data + sizeof(*h), size - sizeof(*h)) != h->checksum) return 0;
+
+    db->data = data;
+    db->size = size;
+    db->header = h;
+    db->keys = (const XenoProfileDbKey*)(data + sizeof(*h));
+    db->profiles = (const XenoProfileDbProfile*)(db->keys + h->key_count);
+    db->settings = (const XenoProfileDbSetting*)(db->profiles + h->profile_count);
+    db->strings = (const char*)(db->settings + h->setting_count);
+    /* Offsets come from disk: every string must end inside the blob. */
+    if (db->strings[h->string_bytes - 1] != 0) return 0;
+    for (uint32_t i = 0; i < h->key_count; ++i) {
+        if (db->keys[i].name >= h->string_bytes || db->keys[i].profile >= h->profile_count) return 0;
+    }
+    for (uint32_t i = 0; i < h->profile_count; ++i) {
+        const XenoProfileDbProfile* p = &db->profiles[i];
+        if (p->name >= h->string_bytes || p->first_setting > h->setting_count ||
+            p->setting_count > h->setting_count - p->first_setting) return 0;
+    }
+    for (uint32_t i = 0; i < h->setting_count; ++i) {
+        if (db->settings[i].key >= h->string_bytes || db->settings[i].value >= h->string_bytes) return 0;
+    }
+    return 1;
+}
+
+static int db_map(XenoProfileDb* db, const char* path, uint64_t stamp) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return 0;
+    struct stat st;
+    void* p = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) p = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) return 0;
+    if (!db_bind(db, (const uint8_t*)p, (size_t)st.st_size, stamp)) {
+        XENO_LOGD("app_profile: ignoring stale or corrupt database %s", path);
+        munmap(p, (size_t)st.st_size);
+        memset(db, 0, sizeof(*db));
+        return 0;
+    }
+    db->mapped = 1;
+    return 1;
+}
+
+static void db_store(const char* path, const uint8_t* image, size_t size) {
+    char tmp[700];
+    snprintf(tmp, sizeof(tmp), "%s.%d.tmp", path, (int)getpid());
+    FILE* f = fopen(tmp, "wb");
+    if (!f) {
+        XENO_LOGD("app_profile: cannot write %s", tmp);
+        return;
+    }
+    int ok = fwrite(image, size, 1, f) == 1;
+    ok = (fclose(f) == 0) && ok;
+    /* rename() keeps concurrent launches from ever seeing a half-written file. */
+    if (!ok || rename(tmp, path) != 0) {
+        unlink(tmp);
+        XENO_LOGD("app_profile: failed to persist database to %s", path);
+    }
+}
+
+static void db_open(void) {
+    const char* dir = profile_dir();
+    uint64_t stamp = dir_stamp(dir);
+    char path[640];
+    pthread_mutex_lock(&g_mtx);
+    snprintf(path, sizeof(path), "%.511s/profiles.db", g_cache_dir);
+    pthread_mutex_unlock(&g_mtx);
+    if (db_map(&g_db, path, stamp)) {
+        XENO_LOGD("app_profile: mapped %s (%u profiles)", path, g_db.header->profile_count);
+        return;
+    }
+
+    size_t size = 0;
+    uint8_t* image = build_db(dir, stamp, &size);
+    if (!image || !db_bind(&g_db, image, size, stamp)) {
+        XENO_LOGW("app_profile: cannot compile profiles from %s", dir);
+        free(image);
+        memset(&g_db, 0, sizeof(g_db));
+        return;
+    }
+    db_store(path, image, size);
+    XENO_LOGI("app_profile: compiled %u profiles from %s", g_db.header->profile_count, dir);
+}
+
+static const XenoProfileDbProfile* db_find(const XenoProfileDb* db, const char* app_name) {
+    if (!db->header || !app_name) return NULL;
+    char name[XENO_PROFILE_NAME_MAX];
+    normalize_name(app_name, name, sizeof(name));
+    uint64_t hash = name_hash(name);
+
+    uint32_t lo = 0, hi = db->header->key_count;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2u;
+        if (db->keys[mid].hash < hash) lo = mid + 1u;
+        else hi = mid;
+    }
+    for (; lo < db->header->key_count && db->keys[lo].hash == hash; ++lo) {
+        if (strcmp(db->strings + db->keys[lo].name, name) == 0) return &db->profiles[db->keys[lo].profile];
+    }
+    return NULL;
+}
+
+/* ---------------------------------------------------------------- */
+/* Matching                                                          */
+/* ---------------------------------------------------------------- */
+
+/* Under Wine argv[0] is the loader; the game is the first .exe argument. */
+static void detect_executable(char* out, size_t cap) {
+    out[0] = 0;
+    FILE* f = fopen("/proc/self/cmdline", "rb");
+    if (!f) return;
+    char buf[4096];
+    size_t n = fread(buf, 1, sizeof(buf) - 1, f);
+    fclose(f);
+    buf[n] = 0;
+    for (size_t off = 0; off < n; off += strlen(buf + off) + 1) {
+        const char* arg = buf + off;
+        size_t len = strlen(arg);
+        int keep = (int)(len < cap ? len : cap - 1);
+        if (off == 0) snprintf(out, cap, "%.*s", keep, arg);
+        if (len > 4 && strcasecmp(arg + len - 4, ".exe") == 0) {
+            snprintf(out, cap, "%.*s", keep, arg);
+            return;
+        }
+    }
+}
+
+static void match_once(void) {
+    db_open();
+    const char* forced = getenv("EXYNOSTOOLS_APP_PROFILE");
+    char exe[512];
+    if (forced && *forced) snprintf(exe, sizeof(exe), "%s", forced);
+    else detect_executable(exe, sizeof(exe));
+    normalize_name(exe, g_exe, sizeof(g_exe));
+    g_match = db_find(&g_db, exe);
+    if (g_match) {
+        XENO_LOGI("app_profile: %s uses profile %s (%u settings)", exe, g_db.strings + g_match->name,
+                  g_match->setting_count);
+    } else {
+        XENO_LOGD("app_profile: no profile for %s", exe[0] ? exe : "(unknown)");
+    }
+}
+
+/* The first caller's cache dir holds the database. */
+static void set_cache_dir(const char* dir) {
+    pthread_mutex_lock(&g_mtx);
+    if (!g_cache_dir[0]) snprintf(g_cache_dir, sizeof(g_cache_dir), "%s", dir);
+    pthread_mutex_unlock(&g_mtx);
+}
+
+void xeno_app_profile_apply(XenoPerfConf* cfg) {
+    set_cache_dir(cfg->shader_cache_dir);
+    pthread_once(&g_once, match_once);
+    if (!g_match) return;
+
+    /* Env settings are exported on the first application only: setenv is
+       not safe against concurrent getenv once other threads are running. */
+    pthread_mutex_lock(&g_mtx);
+    int export_env = !g_env_exported;
+    g_env_exported = 1;
+    pthread_mutex_unlock(&g_mtx);
+
+    for (uint32_t i = 0; i < g_match->setting_count; ++i) {
+        const XenoProfileDbSetting* s = &g_db.settings[g_match->first_setting + i];
+        const char* key = g_db.strings + s->key;
+        const char* val = g_db.strings + s->value;
+        if (xeno_perf_conf_set(cfg, key, val)) continue;
+        if (export_env && isupper((unsigned char)key[0])) setenv(key, val, 0);
+        else if (export_env) XENO_LOGD("app_profile: unknown setting %s", key);
+    }
+}
+
+/* For callers that may run before perf_conf has applied the profile. */
+static void match_with_defaults(void) {
+    XenoPerfConf defaults;
+    xeno_perf_conf_defaults(&defaults);
+    set_cache_dir(defaults.shader_cache_dir);
+    pthread_once(&g_once, match_once);
+}
+
+const char* xeno_app_profile_executable(void) {
+    match_with_defaults();
+    return g_exe;
+}
 
 int app_profile_detect(const char *app_name) {
     if (!app_name) return 0;
-    logging_info("App profile detection: %s", app_name);
-    return 1; // always returns detected for now
+    match_with_defaults();
+    return db_find(&g_db, app_name) != NULL;
 }
@@ -1,6 +1,34 @@
+// src/app_profile.h
 #pragma once
 
-// Load and apply environment variables from a profile file
-// Selects profile based on process name or EXYNOSTOOLS_APP_PROFILE
-void xeno_app_profile_apply(void);
+#include "perf_conf.h"
 
+/*
+  Per-game profiles (app_profile.c).
+
+  The profile directory (EXYNOSTOOLS_PROFILE_DIR, default
+  XENO_APP_PROFILE_DIR) holds one *.conf per game in either format:
+  perf_conf keys (sync_mode=balanced) or env-style lines
+  (EXYNOSTOOLS_VRS_TARGET_FPS=60, DXVK_HUD=fps). A profile matches the
+  executable named like the file (some_game.conf -> some_game.exe) and any
+  name listed in exe= lines; matching ignores case and ".exe".
+
+  The directory is compiled once into a flat database (profiles.db in the
+  shader cache dir) with a sorted 64-bit hash index, and later launches
+  mmap it. The database records a stamp of the directory (names, sizes
+  and mtimes of the profiles) and is rebuilt whenever that changes.
+*/
+
+#define XENO_APP_PROFILE_DIR "/etc/exynostools/profiles"
+
+/* Applies the profile of the running executable (or EXYNOSTOOLS_APP_PROFILE)
+   to cfg. perf_conf settings go to cfg; other env-style settings are
+   exported once without overriding variables already set. */
+void xeno_app_profile_apply(XenoPerfConf* cfg);
+
+/* Name the profile was matched on: lowercased basename without ".exe",
+   empty if unknown. */
+const char* xeno_app_profile_executable(void);
+
+/* Whether a profile exists for app_name (an executable name or path). */
+int app_profile_detect(const char *app_name);
@@ -0,0 +1,453 @@
+// src/autotune.c
+/*
+  Per-executable auto-tuning (see autotune.h).
+
+  Frame intervals go into a fixed histogram with atomic counters, so the
+  present path does one clock read and one increment. The thermal zones are
+  read every XENO_AUTOTUNE_THERMAL_MS by whichever presenting thread wins
+  the slot. Scoring and file I/O only happen at session end.
+*/
+#include "autotune.h"
+#include "app_profile.h"
+#include "perf_conf.h"
+#include "xeno_log.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#define XENO_AUTOTUNE_VERSION 2
+#define XENO_AUTOTUNE_KNOBS 5
+#define XENO_AUTOTUNE_MAX_CHOICES 4
+#define XENO_AUTOTUNE_MAX_RESULTS 64
+#define XENO_AUTOTUNE_BUCKET_US 250u
+#define XENO_AUTOTUNE_BUCKETS 400u                /* 0..100 ms, plus one overflow bucket */
+#define XENO_AUTOTUNE_WARMUP_FRAMES 120u
+#define XENO_AUTOTUNE_PAUSE_US 1000000u           /* longer intervals are loading screens */
+#define XENO_AUTOTUNE_STALL_MS 4.0
+#define XENO_AUTOTUNE_THERMAL_MS 5000u
+#define XENO_AUTOTUNE_THERMAL_ZONES 16
+
+/* ---------------------------------------------------------------- */
+/* Search space                                                      */
+/* ---------------------------------------------------------------- */
+
+enum { KNOB_ASYNC, KNOB_VRS, KNOB_PAGE, KNOB_WORKGROUP, KNOB_SYNC };
+
+typedef struct XenoTuneKnob {
+    const char* name;
+    int count;
+    int values[XENO_AUTOTUNE_MAX_CHOICES];
+} XenoTuneKnob;
+
+/* Choice 0 of every knob is the shipped default. Workgroups are x << 8 | y. */
+static const XenoTuneKnob k_knobs[XENO_AUTOTUNE_KNOBS] = {
+    { "async_submit", 2, { 0, 1 } },
+    { "vrs_target_fps", 4, { 0, 30, 45, 60 } },
+    { "upload_page_kb", 3, { 64, 256, 1024 } },
+    { "bc_workgroup", 3, { 16 << 8 | 8, 8 << 8 | 8, 32 << 8 | 4 } },
+    { "sync_mode", 3, { XENO_SYNC_BALANCED, XENO_SYNC_SAFE, XENO_SYNC_AGGRESSIVE } },
+};
+
+static const char* const k_sync_names[] = { "aggressive", "balanced", "safe" };
+
+typedef struct XenoTuneConfig {
+    uint8_t choice[XENO_AUTOTUNE_KNOBS];
+} XenoTuneConfig;
+
+typedef struct XenoTuneResult {
+    XenoTuneConfig config;
+    float score;                /* mean over sessions, lower is better */
+    uint32_t sessions;
+} XenoTuneResult;
+
+typedef struct XenoTuneState {
+    int knob;                   /* being explored */
+    int pass_changed;           /* best moved during this pass */
+    int converged;
+    XenoTuneConfig best;
+    XenoTuneResult results[XENO_AUTOTUNE_MAX_RESULTS];
+    uint32_t result_count;
+} XenoTuneState;
+
+static pthread_mutex_t g_mtx = PTHREAD_MUTEX_INITIALIZER;
+static int g_planned;
+static XenoTuneState g_state;
+static XenoTuneConfig g_trial;
+static unsigned g_pinned;       /* bit per knob */
+static char g_state_path[640];
+static char g_profile_path[640];
+
+/* Session metrics */
+static _Atomic int g_sessions_open;
+static _Atomic uint64_t g_last_present_us;
+static _Atomic uint32_t g_frames;
+static _Atomic uint32_t g_hist[XENO_AUTOTUNE_BUCKETS + 1u];
+static _Atomic uint64_t g_compile_us;
+static _Atomic uint32_t g_stalls;
+static _Atomic uint64_t g_decode_us;
+static _Atomic uint64_t g_next_thermal_us;
+static _Atomic int g_temp_max_mc;
+static _Atomic int64_t g_temp_sum_mc;
+static _Atomic uint32_t g_temp_samples;
+
+static uint64_t tune_now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ull + (uint64_t)ts.tv_nsec / 1000ull;
+}
+
+static int config_equal(const XenoTuneConfig* a, const XenoTuneConfig* b)
+{
+    return memcmp(a->choice, b->choice, sizeof(a->choice)) == 0;
+}
+
+static XenoTuneResult* find_result(XenoTuneState* s, const XenoTuneConfig* c)
+{
+    for (uint32_t i = 0; i < s->result_count; ++i) {
+        if (config_equal(&s->results[i].config, c)) return &s->results[i];
+    }
+    return NULL;
+}
+
+static int knob_value(int knob, const XenoPerfConf* cfg)
+{
+    switch (knob) {
+    case KNOB_ASYNC: return cfg->async_submit;
+    case KNOB_VRS: return cfg->vrs_target_fps;
+    case KNOB_PAGE: return cfg->upload_page_kb;
+    case KNOB_WORKGROUP: return cfg->bc_local_x << 8 | cfg->bc_local_y;
+    default: return (int)cfg->sync_mode;
+    }
+}
+
+static void set_knob(int knob, int value, XenoPerfConf* cfg)
+{
+    switch (knob) {
+    case KNOB_ASYNC: cfg->async_submit = value; break;
+    case KNOB_VRS: cfg->vrs_target_fps = value; break;
+    case KNOB_PAGE: cfg->upload_page_kb = value; break;
+    case KNOB_WORKGROUP: cfg->bc_local_x = value >> 8; cfg->bc_local_y = value & 0xff; break;
+    default: cfg->sync_mode = value; break;
+    }
+}
+
+/* Coordinate descent: the first configuration without a result, moving
+   to the next knob (and a new pass) as each one is exhausted. */
+static void plan_trial(XenoTuneState* s, XenoTuneConfig* trial)
+{
+    for (int steps = 0; !s->converged && steps < 2 * XENO_AUTOTUNE_KNOBS; ++steps) {
+        int k = s->knob;
+        if (!(g_pinned & (1u << k))) {
+            int best_choice = s->best.choice[k];
+            float best_score = 0.0f;
+            XenoTuneConfig c = s->best;
+            for (int v = 0; v < k_knobs[k].count; ++v) {
+                c.choice[k] = (uint8_t)v;
+                const XenoTuneResult* r = find_result(s, &c);
+                if (!r) {
+                    *trial = c;
+                    return;
+                }
+                if (v == 0 || r->score < best_score) {
+                    best_score = r->score;
+                    best_choice = v;
+                }
+            }
+            if (best_choice != s->best.choice[k]) {
+                s->best.choice[k] = (uint8_t)best_choice;
+                s->pass_changed = 1;
+            }
+        }
+        if (++s->knob == XENO_AUTOTUNE_KNOBS) {
+            s->knob = 0;
+            if (!s->pass_changed) s->converged = 1;
+            s->pass_changed = 0;
+        }
+    }
+    *trial = s->best;
+}
+
+/* ---------------------------------------------------------------- */
+/* Persistence                                                       */
+/* ---------------------------------------------------------------- */
+
+static int parse_config(const char* text, XenoTuneConfig* c)
+{
+    int v[XENO_AUTOTUNE_KNOBS];
+    if (sscanf(text, "%d,%d,%d,%d,%d", &v[0], &v[1], &v[2], &v[3], &v[4]) != XENO_AUTOTUNE_KNOBS) return 0;
+    for (int k = 0; k < XENO_AUTOTUNE_KNOBS; ++k) {
+        if (v[k] < 0 || v[k] >= k_knobs[k].count) return 0;
+        c->choice[k] = (uint8_t)v[k];
+    }
+    return 1;
+}
+
+static void load_state(XenoTuneState* s)
+{
+    memset(s, 0, sizeof(*s));
+    FILE* f = fopen(g_state_path, "r");
+    if (!f) return;
+    char line[256];
+    int version = 0;
+    while (fgets(line, sizeof(line), f)) {
+        char cfg[64];
+        float score;
+        unsigned sessions;
+        if (sscanf(line, "version=%d", &version) == 1) continue;
+        if (version != XENO_AUTOTUNE_VERSION) continue;
+        if (sscanf(line, "knob=%d", &s->knob) == 1) continue;
+        if (sscanf(line, "pass_changed=%d", &s->pass_changed) == 1) continue;
+        if (sscanf(line, "converged=%d", &s->converged) == 1) continue;
+        if (sscanf(line, "best=%63s", cfg) == 1) {
+            parse_config(cfg, &s->best);
+        } else if (sscanf(line, "result=%63s %f %u", cfg, &score, &sessions) == 3 &&
+                   s->result_count < XENO_AUTOTUNE_MAX_RESULTS) {
+            XenoTuneResult* r = &s->results[s->result_count];
+            if (parse_config(cfg, &r->config) && sessions) {
+                r->score = score;
+                r->sessions = sessions;
+                s->result_count++;
+            }
+        }
+    }
+    fclose(f);
+    if (version != XENO_AUTOTUNE_VERSION || s->knob < 0 || s->knob >= XENO_AUTOTUNE_KNOBS) memset(s, 0, sizeof(*s));
+}
+
+static void format_config(const XenoTuneConfig* c, char* out, size_t cap)
+{
+    snprintf(out, cap, "%d,%d,%d,%d,%d", c->choice[0], c->choice[1], c->choice[2], c->choice[3], c->choice[4]);
+}
+
+/* Writes to a temp file and renames, like the caps cache. */
+static FILE* open_replace(const char* path, char* tmp, size_t cap)
+{
+    snprintf(tmp, cap, "%s.%d.tmp", path, (int)getpid());
+    return fopen(tmp, "w");
+}
+
+static void commit_replace(FILE* f, const char* tmp, const char* path)
+{
+    if (fclose(f) != 0 || rename(tmp, path) != 0) {
+        unlink(tmp);
+        XENO_LOGD("autotune: failed to write %s", path);
+    }
+}
+
+static void save_state(const XenoTuneState* s, const char* last)
+{
+    char tmp[700], cfg[64];
+    FILE* f = open_replace(g_state_path, tmp, sizeof(tmp));
+    if (!f) {
+        XENO_LOGD("autotune: cannot write %s", tmp);
+        return;
+    }
+    fprintf(f, "# ExynosTools autotune state, choice indices per knob:");
+    for (int k = 0; k < XENO_AUTOTUNE_KNOBS; ++k) fprintf(f, " %s", k_knobs[k].name);
+    fprintf(f, "\nversion=%d\nknob=%d\npass_changed=%d\nconverged=%d\n", XENO_AUTOTUNE_VERSION, s->knob,
+            s->pass_changed, s->converged);
+    format_config(&s->best, cfg, sizeof(cfg));
+    fprintf(f, "best=%s\n", cfg);
+    for (uint32_t i = 0; i < s->result_count; ++i) {
+        format_config(&s->results[i].config, cfg, sizeof(cfg));
+        fprintf(f, "result=%s %.4f %u\n", cfg, s->results[i].score, s->results[i].sessions);
+    }
+    fprintf(f, "# last session: %s\n", last);
+    commit_replace(f, tmp, g_state_path);
+
+    /* The learned settings as a profile. */
+    f = open_replace(g_profile_path, tmp, sizeof(tmp));
+    if (!f) return;
+    fprintf(f, "# Generated by ExynosTools autotune (%s)\n", s->converged ? "converged" : "still exploring");
+    const XenoTuneResult* best = find_result((XenoTuneState*)s, &s->best);
+    if (best) fprintf(f, "# score %.3f over %u sessions\n", best->score, best->sessions);
+    for (int k = 0; k < XENO_AUTOTUNE_KNOBS; ++k) {
+        if (g_pinned & (1u << k)) continue;
+        int v = k_knobs[k].values[s->best.choice[k]];
+        if (k == KNOB_WORKGROUP) fprintf(f, "bc_workgroup=%dx%d\n", v >> 8, v & 0xff);
+        else if (k == KNOB_SYNC) fprintf(f, "sync_mode=%s\n", k_sync_names[v]);
+        else fprintf(f, "%s=%d\n", k_knobs[k].name, v);
+    }
+    commit_replace(f, tmp, g_profile_path);
+}
+
+/* ---------------------------------------------------------------- */
+/* Planning                                                          */
+/* ---------------------------------------------------------------- */
+
+void xeno_autotune_apply(XenoPerfConf* cfg, const XenoPerfConf* overrides)
+{
+    pthread_mutex_lock(&g_mtx);
+    if (!g_planned) {
+        g_planned = 1;
+        const char* exe = xeno_app_profile_executable();
+        char dir[560];
+        snprintf(dir, sizeof(dir), "%.511s/autotune", cfg->shader_cache_dir);
+        mkdir(dir, 0755);
+        snprintf(g_state_path, sizeof(g_state_path), "%s/%.64s.state", dir, exe[0] ? exe : "unknown");
+        snprintf(g_profile_path, sizeof(g_profile_path), "%s/%.64s.conf", dir, exe[0] ? exe : "unknown");
+        for (int k = 0; k < XENO_AUTOTUNE_KNOBS; ++k) {
+            if (knob_value(k, cfg) != knob_value(k, overrides)) g_pinned |= 1u << k;
+        }
+        load_state(&g_state);
+        plan_trial(&g_state, &g_trial);
+        char c[64];
+        format_config(&g_trial, c, sizeof(c));
+        XENO_LOGI("autotune: %s %s configuration %s", exe[0] ? exe : "unknown",
+                  g_state.converged ? "uses the learned" : "tries", c);
+    }
+    for (int k = 0; k < XENO_AUTOTUNE_KNOBS; ++k) set_knob(k, k_knobs[k].values[g_trial.choice[k]], cfg);
+    pthread_mutex_unlock(&g_mtx);
+}
+
+/* ---------------------------------------------------------------- */
+/* Metrics                                                           */
+/* ---------------------------------------------------------------- */
+
+static int read_temperature_mc(void)
+{
+    int best = 0;
+    char path[64];
+    for (int i = 0; i < XENO_AUTOTUNE_THERMAL_ZONES; ++i) {
+        snprintf(path, sizeof(path), "/sys/class/thermal/thermal_zone%d/temp", i);
+        FILE* f = fopen(path, "r");
+        if (!f) break;
+        int t = 0;
+        if (fscanf(f, "%d", &t) == 1 && t > best) best = t;
+        fclose(f);
+    }
+    return best;
+}
+
+void xeno_autotune_session_begin(void)
+{
+    if (atomic_fetch_add_explicit(&g_sessions_open, 1, memory_order_acq_rel) != 0) return;
+    atomic_store_explicit(&g_last_present_us, 0, memory_order_relaxed);
+    atomic_store_explicit(&g_frames, 0, memory_order_relaxed);
+    for (uint32_t i = 0; i <= XENO_AUTOTUNE_BUCKETS; ++i) atomic_store_explicit(&g_hist[i], 0, memory_order_relaxed);
+    atomic_store_explicit(&g_compile_us, 0, memory_order_relaxed);
+    atomic_store_explicit(&g_stalls, 0, memory_order_relaxed);
+    atomic_store_explicit(&g_decode_us, 0, memory_order_relaxed);
+    atomic_store_explicit(&g_next_thermal_us, 0, memory_order_relaxed);
+    atomic_store_explicit(&g_temp_max_mc, 0, memory_order_relaxed);
+    atomic_store_explicit(&g_temp_sum_mc, 0, memory_order_relaxed);
+    atomic_store_explicit(&g_temp_samples, 0, memory_order_relaxed);
+}
+
+void xeno_autotune_frame(void)
+{
+    if (!atomic_load_explicit(&g_sessions_open, memory_order_relaxed)) return;
+    uint64_t now = tune_now_us();
+    uint64_t prev = atomic_exchange_explicit(&g_last_present_us, now, memory_order_relaxed);
+    uint32_t frame = atomic_fetch_add_explicit(&g_frames, 1u, memory_order_relaxed);
+    if (!prev || frame < XENO_AUTOTUNE_WARMUP_FRAMES || now - prev >= XENO_AUTOTUNE_PAUSE_US) return;
+
+    uint64_t bucket = (now - prev) / XENO_AUTOTUNE_BUCKET_US;
+    if (bucket > XENO_AUTOTUNE_BUCKETS) bucket = XENO_AUTOTUNE_BUCKETS;
+    atomic_fetch_add_explicit(&g_hist[bucket], 1u, memory_order_relaxed);
+
+    uint64_t due = atomic_load_explicit(&g_next_thermal_us, memory_order_relaxed);
+    if (now >= due && atomic_compare_exchange_strong_explicit(&g_next_thermal_us, &due,
+                                                              now + XENO_AUTOTUNE_THERMAL_MS * 1000ull,
+                                                              memory_order_relaxed, memory_order_relaxed)) {
+        int t = read_temperature_mc();
+        if (t <= 0) return;
+        atomic_fetch_add_explicit(&g_temp_sum_mc, t, memory_order_relaxed);
+        atomic_fetch_add_explicit(&g_temp_samples, 1u, memory_order_relaxed);
+        int max = atomic_load_explicit(&g_temp_max_mc, memory_order_relaxed);
+        while (t > max && !atomic_compare_exchange_weak_explicit(&g_temp_max_mc, &max, t, memory_order_relaxed,
+                                                                 memory_order_relaxed)) {
+        }
+    }
+}
+
+void xeno_autotune_pipeline_compiled(double ms)
+{
+    if (!atomic_load_explicit(&g_sessions_open, memory_order_relaxed)) return;
+    atomic_fetch_add_explicit(&g_compile_us, (uint64_t)(ms * 1000.0), memory_order_relaxed);
+    if (ms >= XENO_AUTOTUNE_STALL_MS) atomic_fetch_add_explicit(&g_stalls, 1u, memory_order_relaxed);
+}
+
+void xeno_autotune_decode(double ms)
+{
+    if (!atomic_load_explicit(&g_sessions_open, memory_order_relaxed)) return;
+    atomic_fetch_add_explicit(&g_decode_us, (uint64_t)(ms * 1000.0), memory_order_relaxed);
+}
+
+static float percentile_ms(const uint32_t* hist, uint32_t total, float p)
+{
+    uint32_t want = (uint32_t)(p * (float)total);
+    uint32_t seen = 0;
+    for (uint32_t i = 0; i <= XENO_AUTOTUNE_BUCKETS; ++i) {
+        seen += hist[i];
+        if (seen > want) return (float)((i + 0.5) * XENO_AUTOTUNE_BUCKET_US) / 1000.0f;
+    }
+    return (float)(XENO_AUTOTUNE_BUCKETS * XENO_AUTOTUNE_BUCKET_US) / 1000.0f;
+}
+
+/* Frame pacing dominates: mostly p90, some p99. Compile stalls and decode
+   time are charged per frame, heat above 70 C makes a configuration look
+   slower than it measured, and shading-rate reduction pays a small
+   quality tax so it only wins when it buys real frame time. */
+static float session_score(const uint32_t* hist, uint32_t frames, float* p50, float* p90, float* p99)
+{
+    *p50 = percentile_ms(hist, frames, 0.50f);
+    *p90 = percentile_ms(hist, frames, 0.90f);
+    *p99 = percentile_ms(hist, frames, 0.99f);
+    float score = 0.7f * *p90 + 0.3f * *p99;
+    score += (float)atomic_load_explicit(&g_compile_us, memory_order_relaxed) / 1000.0f / (float)frames;
+    score += (float)atomic_load_explicit(&g_decode_us, memory_order_relaxed) / 1000.0f / (float)frames;
+    uint32_t samples = atomic_load_explicit(&g_temp_samples, memory_order_relaxed);
+    if (samples) {
+        float avg_c = (float)atomic_load_explicit(&g_temp_sum_mc, memory_order_relaxed) / (float)samples / 1000.0f;
+        if (avg_c > 70.0f) score *= 1.0f + 0.01f * (avg_c - 70.0f);
+    }
+    if (k_knobs[KNOB_VRS].values[g_trial.choice[KNOB_VRS]] > 0) score *= 1.03f;
+    return score;
+}
+
+void xeno_autotune_session_end(void)
+{
+    if (atomic_fetch_sub_explicit(&g_sessions_open, 1, memory_order_acq_rel) != 1) return;
+
+    uint32_t hist[XENO_AUTOTUNE_BUCKETS + 1u];
+    uint32_t frames = 0;
+    for (uint32_t i = 0; i <= XENO_AUTOTUNE_BUCKETS; ++i) {
+        hist[i] = atomic_load_explicit(&g_hist[i], memory_order_relaxed);
+        frames += hist[i];
+    }
+    pthread_mutex_lock(&g_mtx);
+    if (!g_planned || frames < XENO_AUTOTUNE_MIN_FRAMES) {
+        pthread_mutex_unlock(&g_mtx);
+        XENO_LOGD("autotune: session of %u frames not counted", frames);
+        return;
+    }
+
+    float p50, p90, p99;
+    float score = session_score(hist, frames, &p50, &p90, &p99);
+    XenoTuneResult* r = find_result(&g_state, &g_trial);
+    if (!r && g_state.result_count < XENO_AUTOTUNE_MAX_RESULTS) {
+        r = &g_state.results[g_state.result_count++];
+        r->config = g_trial;
+    }
+    if (r) {
+        r->score = (r->score * (float)r->sessions + score) / (float)(r->sessions + 1u);
+        if (r->sessions < 8u) r->sessions++;
+    }
+
+    char last[160];
+    snprintf(last, sizeof(last), "frames=%u p50=%.2fms p90=%.2fms p99=%.2fms stalls=%u temp_max=%dC score=%.3f",
+             frames, p50, p90, p99, atomic_load_explicit(&g_stalls, memory_order_relaxed),
+             atomic_load_explicit(&g_temp_max_mc, memory_order_relaxed) / 1000, score);
+    save_state(&g_state, last);
+    pthread_mutex_unlock(&g_mtx);
+    XENO_LOGI("autotune: %s", last);
+}
@@ -0,0 +1,37 @@
+// src/autotune.h
+#pragma once
+
+#include "perf_conf.h"
+
+/*
+  Per-executable auto-tuning (autotune.c), enabled with autotune=1.
+
+  Every session records frame-time percentiles, pipeline-compile stalls,
+  BC decode time and the SoC temperature. The tuner walks a small space of
+  settings (async_submit, vrs_target_fps, upload_page_kb, bc_workgroup,
+  sync_mode) one knob at a time: each launch runs the next untried value of the current
+  knob with every other knob at its best value so far, and once a full pass
+  changes nothing the best configuration is kept for good.
+
+  State lives in <shader_cache_dir>/autotune/<exe>.state; the winning
+  settings are also written to <exe>.conf next to it, in profile format, so
+  they can be copied into profiles/ as they are. Sessions shorter than
+  XENO_AUTOTUNE_MIN_FRAMES frames (launchers, crashes, killed processes)
+  do not count.
+*/
+
+#define XENO_AUTOTUNE_MIN_FRAMES 600u
+
+/* Called by perf_conf: cfg holds the config file only, overrides the same
+   plus profile and env. Writes this launch's trial values into cfg; knobs
+   the overrides change are left to them and not explored. */
+void xeno_autotune_apply(XenoPerfConf* cfg, const XenoPerfConf* overrides);
+
+/* Session brackets, one per device; nested devices share the session. */
+void xeno_autotune_session_begin(void);
+void xeno_autotune_session_end(void);
+
+/* Metric sources. All are cheap no-ops while no session is open. */
+void xeno_autotune_frame(void);
+void xeno_autotune_pipeline_compiled(double ms);
+void xeno_autotune_decode(double ms);
@@ -0,0 +1,875 @@
+// src/barrier_opt.c
+/*
+  Pipeline-barrier relaxation engine (see barrier_opt.h).
+
+  Stages are tracked in units: graphics as a whole (ALL_GRAPHICS), the
+  indirect-argument stage, compute, transfer, acceleration-structure builds
+  and ray tracing. A narrowed source mask is made of those unit bits, so a
+  sync1 call stays expressible in sync1.
+
+  Three sets are kept per command buffer:
+    unsynced   units with work since a barrier last had them in its source
+               scope; a narrowed barrier must keep them.
+    unflushed  units with writes no global memory barrier has made available
+               yet; kept for the same reason, with their access bits.
+    chains     destination scopes of earlier barriers. A barrier with an
+               ALL_COMMANDS source chains with every earlier one; narrowed,
+               it has to keep at least one stage of each scope it used to
+               chain with, or work ordered by that earlier barrier would no
+               longer be ordered before this one's destination.
+*/
+#include "barrier_opt.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define U_GFX VK_PIPELINE_STAGE_2_ALL_GRAPHICS_BIT
+#define U_IND VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT
+#define U_CS VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT
+#define U_XFER VK_PIPELINE_STAGE_2_TRANSFER_BIT
+#define U_AS VK_PIPELINE_STAGE_2_ACCELERATION_STRUCTURE_BUILD_BIT_KHR
+#define U_RT VK_PIPELINE_STAGE_2_RAY_TRACING_SHADER_BIT_KHR
+#define U_ALL (U_GFX | U_IND | U_CS | U_XFER | U_AS | U_RT)
+
+#define STAGES_GFX                                                                                                    \
+    (VK_PIPELINE_STAGE_2_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT |                                   \
+     VK_PIPELINE_STAGE_2_TESSELLATION_CONTROL_SHADER_BIT | VK_PIPELINE_STAGE_2_TESSELLATION_EVALUATION_SHADER_BIT |   \
+     VK_PIPELINE_STAGE_2_GEOMETRY_SHADER_BIT | VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT |                              \
+     VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT |                     \
+     VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_2_ALL_GRAPHICS_BIT |                         \
+     VK_PIPELINE_STAGE_2_INDEX_INPUT_BIT | VK_PIPELINE_STAGE_2_VERTEX_ATTRIBUTE_INPUT_BIT |                           \
+     VK_PIPELINE_STAGE_2_PRE_RASTERIZATION_SHADERS_BIT | VK_PIPELINE_STAGE_2_TRANSFORM_FEEDBACK_BIT_EXT |             \
+     VK_PIPELINE_STAGE_2_CONDITIONAL_RENDERING_BIT_EXT | VK_PIPELINE_STAGE_2_FRAGMENT_DENSITY_PROCESS_BIT_EXT |       \
+     VK_PIPELINE_STAGE_2_FRAGMENT_SHADING_RATE_ATTACHMENT_BIT_KHR | VK_PIPELINE_STAGE_2_TASK_SHADER_BIT_EXT |         \
+     VK_PIPELINE_STAGE_2_MESH_SHADER_BIT_EXT)
+#define STAGES_XFER                                                                                                   \
+    (VK_PIPELINE_STAGE_2_TRANSFER_BIT | VK_PIPELINE_STAGE_2_COPY_BIT | VK_PIPELINE_STAGE_2_RESOLVE_BIT |              \
+     VK_PIPELINE_STAGE_2_BLIT_BIT | VK_PIPELINE_STAGE_2_CLEAR_BIT)
+#define STAGES_KNOWN                                                                                                  \
+    (STAGES_GFX | STAGES_XFER | U_IND | U_CS | U_AS | U_RT | VK_PIPELINE_STAGE_2_TOP_OF_PIPE_BIT |                    \
+     VK_PIPELINE_STAGE_2_BOTTOM_OF_PIPE_BIT | VK_PIPELINE_STAGE_2_HOST_BIT | VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT)
+/* Source bits that mean "everything": what narrowing may rewrite. */
+#define STAGES_META                                                                                                   \
+    (VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT | VK_PIPELINE_STAGE_2_ALL_GRAPHICS_BIT | VK_PIPELINE_STAGE_2_BOTTOM_OF_PIPE_BIT)
+
+#define ACCESS_SHADER_WRITES (VK_ACCESS_2_SHADER_WRITE_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT)
+#define ACCESS_SHADER                                                                                                 \
+    (VK_ACCESS_2_UNIFORM_READ_BIT | VK_ACCESS_2_SHADER_READ_BIT | VK_ACCESS_2_SHADER_SAMPLED_READ_BIT |               \
+     VK_ACCESS_2_SHADER_STORAGE_READ_BIT | ACCESS_SHADER_WRITES | VK_ACCESS_2_ACCELERATION_STRUCTURE_READ_BIT_KHR)
+#define ACCESS_XFER (VK_ACCESS_2_TRANSFER_READ_BIT | VK_ACCESS_2_TRANSFER_WRITE_BIT)
+#define ACCESS_GENERIC (VK_ACCESS_2_MEMORY_READ_BIT | VK_ACCESS_2_MEMORY_WRITE_BIT)
+#define ACCESS_READS                                                                                                  \
+    (VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_2_INDEX_READ_BIT | VK_ACCESS_2_VERTEX_ATTRIBUTE_READ_BIT |     \
+     VK_ACCESS_2_UNIFORM_READ_BIT | VK_ACCESS_2_INPUT_ATTACHMENT_READ_BIT | VK_ACCESS_2_SHADER_READ_BIT |             \
+     VK_ACCESS_2_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT |                          \
+     VK_ACCESS_2_TRANSFER_READ_BIT | VK_ACCESS_2_HOST_READ_BIT | VK_ACCESS_2_MEMORY_READ_BIT |                        \
+     VK_ACCESS_2_SHADER_SAMPLED_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_READ_BIT |                                      \
+     VK_ACCESS_2_ACCELERATION_STRUCTURE_READ_BIT_KHR)
+#define ACCESS_WRITES                                                                                                 \
+    (VK_ACCESS_2_SHADER_WRITE_BIT | VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT |                                          \
+     VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT | VK_ACCESS_2_TRANSFER_WRITE_BIT | VK_ACCESS_2_HOST_WRITE_BIT |   \
+     VK_ACCESS_2_MEMORY_WRITE_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT |                                            \
+     VK_ACCESS_2_ACCELERATION_STRUCTURE_WRITE_BIT_KHR)
+
+/* ---- stage and access algebra --------------------------------------- */
+
+/* Units a stage mask covers; `first` selects source-scope meaning of TOP/BOTTOM. */
+static VkPipelineStageFlags2 stage_units(VkPipelineStageFlags2 m, int first, int* unknown)
+{
+    VkPipelineStageFlags2 u = 0;
+    if (m & VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT) u |= U_ALL;
+    if (m & (first ? VK_PIPELINE_STAGE_2_BOTTOM_OF_PIPE_BIT : VK_PIPELINE_STAGE_2_TOP_OF_PIPE_BIT)) u |= U_ALL;
+    if (m & VK_PIPELINE_STAGE_2_ALL_GRAPHICS_BIT) u |= U_GFX | U_IND;
+    if (m & STAGES_GFX) u |= U_GFX;
+    if (m & U_IND) u |= U_IND;
+    if (m & STAGES_XFER) u |= U_XFER;
+    u |= m & (U_CS | U_AS | U_RT);
+    if (unknown && (m & ~STAGES_KNOWN)) *unknown = 1;
+    return u;
+}
+
+/* Stage bits with meta bits spelled out, for subset tests. */
+static VkPipelineStageFlags2 stage_expand(VkPipelineStageFlags2 m, int first)
+{
+    VkPipelineStageFlags2 r = m;
+    if ((m & VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT) ||
+        (m & (first ? VK_PIPELINE_STAGE_2_BOTTOM_OF_PIPE_BIT : VK_PIPELINE_STAGE_2_TOP_OF_PIPE_BIT))) {
+        r |= STAGES_KNOWN;
+    }
+    if (m & VK_PIPELINE_STAGE_2_ALL_GRAPHICS_BIT) r |= STAGES_GFX | U_IND;
+    if (m & VK_PIPELINE_STAGE_2_TRANSFER_BIT) r |= STAGES_XFER;
+    if (m & VK_PIPELINE_STAGE_2_VERTEX_INPUT_BIT) {
+        r |= VK_PIPELINE_STAGE_2_INDEX_INPUT_BIT | VK_PIPELINE_STAGE_2_VERTEX_ATTRIBUTE_INPUT_BIT;
+    }
+    if (m & VK_PIPELINE_STAGE_2_PRE_RASTERIZATION_SHADERS_BIT) {
+        r |= VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_2_TESSELLATION_CONTROL_SHADER_BIT |
+             VK_PIPELINE_STAGE_2_TESSELLATION_EVALUATION_SHADER_BIT | VK_PIPELINE_STAGE_2_GEOMETRY_SHADER_BIT;
+    }
+    /* TOP in a source scope and BOTTOM in a destination scope are empty. */
+    r &= ~(first ? VK_PIPELINE_STAGE_2_TOP_OF_PIPE_BIT : VK_PIPELINE_STAGE_2_BOTTOM_OF_PIPE_BIT);
+    return r;
+}
+
+static VkAccessFlags2 access_expand(VkAccessFlags2 a)
+{
+    if (a & VK_ACCESS_2_MEMORY_READ_BIT) a |= ACCESS_READS;
+    if (a & VK_ACCESS_2_MEMORY_WRITE_BIT) a |= ACCESS_WRITES;
+    if (a & VK_ACCESS_2_SHADER_READ_BIT) a |= VK_ACCESS_2_SHADER_SAMPLED_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_READ_BIT;
+    if (a & VK_ACCESS_2_SHADER_WRITE_BIT) a |= VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT;
+    return a;
+}
+
+/* Source access bits a stage mask can carry; everything when it has stages
+   this file does not model. */
+static VkAccessFlags2 access_supported(VkPipelineStageFlags2 stages)
+{
+    int unknown = 0;
+    VkPipelineStageFlags2 u = stage_units(stages, 1, &unknown);
+    if (unknown) return ~(VkAccessFlags2)0;
+    VkAccessFlags2 a = ACCESS_GENERIC;
+    if (u & U_GFX) a |= ~(ACCESS_XFER | VK_ACCESS_2_HOST_READ_BIT | VK_ACCESS_2_HOST_WRITE_BIT |
+                          VK_ACCESS_2_ACCELERATION_STRUCTURE_WRITE_BIT_KHR);
+    if (u & U_IND) a |= VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT;
+    if (u & (U_CS | U_RT)) a |= ACCESS_SHADER;
+    if (u & U_RT) a |= VK_ACCESS_2_SHADER_BINDING_TABLE_READ_BIT_KHR;
+    if (u & U_XFER) a |= ACCESS_XFER;
+    if (u & U_AS) {
+        a |= VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_2_SHADER_READ_BIT | ACCESS_XFER |
+             VK_ACCESS_2_ACCELERATION_STRUCTURE_READ_BIT_KHR | VK_ACCESS_2_ACCELERATION_STRUCTURE_WRITE_BIT_KHR;
+    }
+    if (stages & VK_PIPELINE_STAGE_2_HOST_BIT) a |= VK_ACCESS_2_HOST_READ_BIT | VK_ACCESS_2_HOST_WRITE_BIT;
+    return a;
+}
+
+/* Units whose writes a global barrier with this source access makes available. */
+static VkPipelineStageFlags2 flushed_units(VkAccessFlags2 a)
+{
+    if (a & VK_ACCESS_2_MEMORY_WRITE_BIT) return U_ALL;
+    VkPipelineStageFlags2 u = U_IND;
+    if (a & ACCESS_SHADER_WRITES) u |= U_CS | U_RT;
+    if ((a & ACCESS_SHADER_WRITES) && (a & VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT) &&
+        (a & VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT)) {
+        u |= U_GFX;
+    }
+    if (a & VK_ACCESS_2_TRANSFER_WRITE_BIT) u |= U_XFER;
+    if (a & VK_ACCESS_2_ACCELERATION_STRUCTURE_WRITE_BIT_KHR) u |= U_AS;
+    return u;
+}
+
+static VkPipelineStageFlags2 lowest_bit(VkPipelineStageFlags2 m)
+{
+    return m & (~m + 1u);
+}
+
+/* ---- batches -------------------------------------------------------- */
+
+static int grow(void** p, uint32_t* cap, uint32_t need, size_t elem)
+{
+    if (need <= *cap) return 1;
+    uint32_t n = *cap ? *cap : 8u;
+    while (n < need) n *= 2u;
+    void* q = realloc(*p, (size_t)n * elem);
+    if (!q) return 0;
+    *p = q;
+    *cap = n;
+    return 1;
+}
+
+static int batch_reserve(XenoBarrierBatch* b, uint32_t mem, uint32_t buf, uint32_t img)
+{
+    return grow((void**)&b->mem, &b->mem_cap, mem, sizeof(*b->mem)) &&
+           grow((void**)&b->buf, &b->buf_cap, buf, sizeof(*b->buf)) &&
+           grow((void**)&b->img, &b->img_cap, img, sizeof(*b->img));
+}
+
+static void batch_free(XenoBarrierBatch* b)
+{
+    free(b->mem);
+    free(b->buf);
+    free(b->img);
+    memset(b, 0, sizeof(*b));
+}
+
+static int batch_copy(XenoBarrierBatch* dst, const XenoBarrierBatch* src)
+{
+    if (!batch_reserve(dst, src->mem_count, src->buf_count, src->img_count)) return 0;
+    dst->flags = src->flags;
+    dst->sync2 = src->sync2;
+    dst->mem_count = src->mem_count;
+    dst->buf_count = src->buf_count;
+    dst->img_count = src->img_count;
+    if (src->mem_count) memcpy(dst->mem, src->mem, src->mem_count * sizeof(*src->mem));
+    if (src->buf_count) memcpy(dst->buf, src->buf, src->buf_count * sizeof(*src->buf));
+    if (src->img_count) memcpy(dst->img, src->img, src->img_count * sizeof(*src->img));
+    return 1;
+}
+
+static int batch_has_next(const XenoBarrierBatch* b)
+{
+    for (uint32_t i = 0; i < b->mem_count; ++i) if (b->mem[i].pNext) return 1;
+    for (uint32_t i = 0; i < b->buf_count; ++i) if (b->buf[i].pNext) return 1;
+    for (uint32_t i = 0; i < b->img_count; ++i) if (b->img[i].pNext) return 1;
+    return 0;
+}
+
+/* Adds a global barrier, merging with one that has the same stage masks. */
+static void add_global(XenoBarrierBatch* b, VkPipelineStageFlags2 src, VkAccessFlags2 src_access,
+                       VkPipelineStageFlags2 dst, VkAccessFlags2 dst_access)
+{
+    for (uint32_t i = 0; i < b->mem_count; ++i) {
+        VkMemoryBarrier2* m = &b->mem[i];
+        if (m->srcStageMask == src && m->dstStageMask == dst && !m->pNext) {
+            m->srcAccessMask |= src_access;
+            m->dstAccessMask |= dst_access;
+            return;
+        }
+    }
+    /* Room was reserved by the caller. */
+    b->mem[b->mem_count++] = (VkMemoryBarrier2){
+        .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2,
+        .srcStageMask = src, .srcAccessMask = src_access,
+        .dstStageMask = dst, .dstAccessMask = dst_access,
+    };
+}
+
+static int same_family(uint32_t a, uint32_t b)
+{
+    return a == b || a == VK_QUEUE_FAMILY_IGNORED || b == VK_QUEUE_FAMILY_IGNORED;
+}
+
+/* BALANCED: buffer and image barriers that carry no layout or ownership
+   change are plain memory dependencies; fold them into the global barrier
+   and merge global barriers with the same masks. */
+static void fold(XenoBarrierTracker* t, XenoBarrierBatch* b)
+{
+    if (!batch_reserve(b, b->mem_count + b->buf_count + b->img_count, 0, 0)) return;
+
+    uint32_t n = b->mem_count;
+    b->mem_count = 0;
+    for (uint32_t i = 0; i < n; ++i) {
+        VkMemoryBarrier2 m = b->mem[i];
+        if (m.pNext) b->mem[b->mem_count++] = m;
+        else add_global(b, m.srcStageMask, m.srcAccessMask, m.dstStageMask, m.dstAccessMask);
+    }
+
+    uint32_t keep = 0;
+    for (uint32_t i = 0; i < b->buf_count; ++i) {
+        const VkBufferMemoryBarrier2* m = &b->buf[i];
+        if (m->pNext || !same_family(m->srcQueueFamilyIndex, m->dstQueueFamilyIndex)) {
+            b->buf[keep++] = *m;
+            continue;
+        }
+        add_global(b, m->srcStageMask, m->srcAccessMask, m->dstStageMask, m->dstAccessMask);
+        t->stats.folded++;
+    }
+    b->buf_count = keep;
+
+    keep = 0;
+    for (uint32_t i = 0; i < b->img_count; ++i) {
+        const VkImageMemoryBarrier2* m = &b->img[i];
+        if (m->pNext || m->oldLayout != m->newLayout || !same_family(m->srcQueueFamilyIndex, m->dstQueueFamilyIndex)) {
+            b->img[keep++] = *m;
+            continue;
+        }
+        add_global(b, m->srcStageMask, m->srcAccessMask, m->dstStageMask, m->dstAccessMask);
+        t->stats.folded++;
+    }
+    b->img_count = keep;
+
+    /* A global barrier with an empty source scope and no access orders nothing. */
+    keep = 0;
+    for (uint32_t i = 0; i < b->mem_count; ++i) {
+        const VkMemoryBarrier2* m = &b->mem[i];
+        int unknown = 0;
+        VkPipelineStageFlags2 u = stage_units(m->srcStageMask, 1, &unknown);
+        if (!m->pNext && !u && !unknown && !m->srcAccessMask && !m->dstAccessMask) continue;
+        b->mem[keep++] = *m;
+    }
+    b->mem_count = keep;
+}
+
+static int global_covers(const VkMemoryBarrier2* g, const VkMemoryBarrier2* m)
+{
+    return !(stage_expand(m->srcStageMask, 1) & ~stage_expand(g->srcStageMask, 1)) &&
+           !(stage_expand(m->dstStageMask, 0) & ~stage_expand(g->dstStageMask, 0)) &&
+           !(access_expand(m->srcAccessMask) & ~access_expand(g->srcAccessMask)) &&
+           !(access_expand(m->dstAccessMask) & ~access_expand(g->dstAccessMask));
+}
+
+/* Units a scope reaches; every unit when it has stages this file does not model. */
+static VkPipelineStageFlags2 scope_units(VkPipelineStageFlags2 m, int first)
+{
+    int unknown = 0;
+    VkPipelineStageFlags2 u = stage_units(m, first, &unknown);
+    return unknown ? U_ALL : u;
+}
+
+/* The masks every barrier kind starts with, for walking a batch as a whole. */
+typedef struct BarrierMasks {
+    VkPipelineStageFlags2* src;
+    VkAccessFlags2* src_access;
+    VkPipelineStageFlags2* dst;
+    VkAccessFlags2* dst_access;
+} BarrierMasks;
+
+#define MASKS_OF(m) ((BarrierMasks){ &(m)->srcStageMask, &(m)->srcAccessMask, &(m)->dstStageMask, &(m)->dstAccessMask })
+
+static uint32_t batch_count(const XenoBarrierBatch* b)
+{
+    return b->mem_count + b->buf_count + b->img_count;
+}
+
+static BarrierMasks batch_at(const XenoBarrierBatch* b, uint32_t i)
+{
+    if (i < b->mem_count) return MASKS_OF(&b->mem[i]);
+    i -= b->mem_count;
+    if (i < b->buf_count) return MASKS_OF(&b->buf[i]);
+    return MASKS_OF(&b->img[i - b->buf_count]);
+}
+
+/* Call b, recorded right after prev with no work in between, adds nothing:
+   a global barrier of prev covers each of b's, and whatever b would chain
+   with in prev already reaches b's destination. */
+static int covers_call(const XenoBarrierBatch* prev, const XenoBarrierBatch* b)
+{
+    if (b->flags != prev->flags || b->buf_count || b->img_count) return 0;
+    for (uint32_t i = 0; i < b->mem_count; ++i) {
+        const VkMemoryBarrier2* m = &b->mem[i];
+        int covered = 0;
+        for (uint32_t j = 0; j < prev->mem_count && !covered; ++j) {
+            covered = !prev->mem[j].pNext && global_covers(&prev->mem[j], m);
+        }
+        if (!covered) return 0;
+
+        VkPipelineStageFlags2 su = scope_units(m->srcStageMask, 1);
+        VkPipelineStageFlags2 dst = stage_expand(m->dstStageMask, 0);
+        VkAccessFlags2 da = access_expand(m->dstAccessMask);
+        for (uint32_t j = 0, n = batch_count(prev); j < n; ++j) {
+            BarrierMasks a = batch_at(prev, j);
+            if (!(scope_units(*a.dst, 0) & su)) continue;
+            if ((dst & ~stage_expand(*a.dst, 0)) || (da & ~access_expand(*a.dst_access))) return 0;
+        }
+    }
+    return 1;
+}
+
+static int redundant(const XenoBarrierTracker* t, const XenoBarrierBatch* b)
+{
+    return !t->work_since_emit && t->has_last && covers_call(&t->last, b);
+}
+
+/* ---- coalescing ----------------------------------------------------- */
+
+/* x picks up where a left off: same subresource range, no ownership change,
+   and x starts from a's new layout or discards the contents. */
+static int image_continues(const VkImageMemoryBarrier2* a, const VkImageMemoryBarrier2* x)
+{
+    return a->image == x->image && !a->pNext && !x->pNext &&
+           same_family(a->srcQueueFamilyIndex, a->dstQueueFamilyIndex) &&
+           same_family(x->srcQueueFamilyIndex, x->dstQueueFamilyIndex) &&
+           (x->oldLayout == a->newLayout || x->oldLayout == VK_IMAGE_LAYOUT_UNDEFINED) &&
+           !memcmp(&a->subresourceRange, &x->subresourceRange, sizeof(a->subresourceRange));
+}
+
+/* b changes a buffer or image q already changes, and not in a way one
+   transition can express: the two changes would be unordered in one call. */
+static int conflicts(const XenoBarrierBatch* q, const XenoBarrierBatch* b)
+{
+    for (uint32_t i = 0; i < b->buf_count; ++i) {
+        for (uint32_t j = 0; j < q->buf_count; ++j) {
+            if (q->buf[j].buffer == b->buf[i].buffer) return 1;
+        }
+    }
+    for (uint32_t i = 0; i < b->img_count; ++i) {
+        for (uint32_t j = 0; j < q->img_count; ++j) {
+            if (q->img[j].image == b->img[i].image && !image_continues(&q->img[j], &b->img[i])) return 1;
+        }
+    }
+    return 0;
+}
+
+/* A layout or ownership change happens after its barrier's source scope;
+   merged into q it must also wait for what it used to chain with. */
+static void take_sources(const XenoBarrierBatch* q, uint32_t n, VkPipelineStageFlags2* src, VkAccessFlags2* src_access)
+{
+    VkPipelineStageFlags2 su = scope_units(*src, 1);
+    for (uint32_t j = 0; j < n; ++j) {
+        BarrierMasks a = batch_at(q, j);
+        if (!(scope_units(*a.dst, 0) & su)) continue;
+        *src |= *a.src;
+        *src_access |= *a.src_access;
+    }
+}
+
+/* Appends call b to call q, recorded right before it with no work in
+   between. Barriers of one call do not order each other, so the chains
+   between the two are made explicit: a barrier of q whose destination b's
+   source reached also covers b's destination. An image barrier continuing
+   one of q's transitions on the same range becomes a single transition.
+   Returns 0 when b has to stay a call of its own. */
+static int merge_call(XenoBarrierTracker* t, XenoBarrierBatch* q, const XenoBarrierBatch* b)
+{
+    if (q->flags != b->flags || conflicts(q, b)) return 0;
+    if (!batch_reserve(q, q->mem_count + b->mem_count, q->buf_count + b->buf_count, q->img_count + b->img_count)) {
+        return 0;
+    }
+    uint32_t n = batch_count(q);
+
+    /* fold() left only buffer and image barriers with a layout or
+       ownership change. */
+    VkBufferMemoryBarrier2* nb = &q->buf[q->buf_count];
+    VkImageMemoryBarrier2* ni = &q->img[q->img_count];
+    if (b->buf_count) memcpy(nb, b->buf, b->buf_count * sizeof(*nb));
+    if (b->img_count) memcpy(ni, b->img, b->img_count * sizeof(*ni));
+    for (uint32_t i = 0; i < b->buf_count; ++i) take_sources(q, n, &nb[i].srcStageMask, &nb[i].srcAccessMask);
+    for (uint32_t i = 0; i < b->img_count; ++i) take_sources(q, n, &ni[i].srcStageMask, &ni[i].srcAccessMask);
+
+    for (uint32_t j = 0; j < n; ++j) {
+        BarrierMasks a = batch_at(q, j);
+        VkPipelineStageFlags2 au = scope_units(*a.dst, 0), dst = 0;
+        VkAccessFlags2 da = 0;
+        for (uint32_t i = 0, bn = batch_count(b); i < bn; ++i) {
+            BarrierMasks x = batch_at(b, i);
+            if (!(au & scope_units(*x.src, 1))) continue;
+            dst |= *x.dst;
+            da |= *x.dst_access;
+        }
+        *a.dst |= dst;
+        *a.dst_access |= da;
+    }
+
+    for (uint32_t i = 0; i < b->mem_count; ++i) {
+        const VkMemoryBarrier2* m = &b->mem[i];
+        add_global(q, m->srcStageMask, m->srcAccessMask, m->dstStageMask, m->dstAccessMask);
+    }
+    q->buf_count += b->buf_count;
+
+    uint32_t old_img = q->img_count;
+    for (uint32_t i = 0; i < b->img_count; ++i) {
+        VkImageMemoryBarrier2 x = ni[i];
+        VkImageMemoryBarrier2* a = NULL;
+        for (uint32_t j = 0; j < old_img && !a; ++j) {
+            if (image_continues(&q->img[j], &x)) a = &q->img[j];
+        }
+        if (!a) {
+            q->img[q->img_count++] = x;
+            continue;
+        }
+        a->srcStageMask |= x.srcStageMask;
+        a->srcAccessMask |= x.srcAccessMask;
+        a->dstStageMask |= x.dstStageMask;
+        a->dstAccessMask |= x.dstAccessMask;
+        a->newLayout = x.newLayout;
+        t->stats.deduped++;
+    }
+    q->sync2 = q->sync2 || b->sync2;
+    return 1;
+}
+
+/* ---- narrowing ------------------------------------------------------ */
+
+static VkPipelineStageFlags2 narrow_src(const XenoBarrierTracker* t, VkPipelineStageFlags2 src)
+{
+    VkPipelineStageFlags2 meta = src & STAGES_META;
+    if (!meta) return src;
+    VkPipelineStageFlags2 meta_units = stage_units(meta, 1, NULL);
+    VkPipelineStageFlags2 explicit_bits = src & ~STAGES_META;
+    VkPipelineStageFlags2 explicit_units = stage_units(explicit_bits, 1, NULL);
+
+    VkPipelineStageFlags2 need = t->unsynced | t->unflushed;
+    for (uint32_t i = 0; i < t->chain_count; ++i) {
+        VkPipelineStageFlags2 c = t->chains[i];
+        if (c & (need | explicit_units)) continue;
+        /* Keep one stage of the earlier destination scope; the indirect
+           stage is the cheapest one to wait on and sorts first. */
+        VkPipelineStageFlags2 cand = c & meta_units;
+        if (cand) need |= lowest_bit(cand);
+    }
+    need &= meta_units;
+    if (need == meta_units) return src;
+    if (need & U_GFX) need &= ~U_IND;
+    return explicit_bits | need;
+}
+
+#define NARROW_BARRIER(t, m, changed)                                                                                 \
+    do {                                                                                                              \
+        VkPipelineStageFlags2 s_ = narrow_src((t), (m)->srcStageMask);                                                \
+        if (s_ != (m)->srcStageMask) {                                                                                \
+            (m)->srcStageMask = s_;                                                                                   \
+            (m)->srcAccessMask &= s_ ? access_supported(s_) : 0;                                                      \
+            (changed)++;                                                                                              \
+        }                                                                                                             \
+    } while (0)
+
+static void narrow(XenoBarrierTracker* t, XenoBarrierBatch* b)
+{
+    uint64_t changed = 0;
+    for (uint32_t i = 0; i < b->mem_count; ++i) NARROW_BARRIER(t, &b->mem[i], changed);
+    for (uint32_t i = 0; i < b->buf_count; ++i) NARROW_BARRIER(t, &b->buf[i], changed);
+    for (uint32_t i = 0; i < b->img_count; ++i) NARROW_BARRIER(t, &b->img[i], changed);
+    t->stats.narrowed += changed;
+}
+
+/* ---- state ---------------------------------------------------------- */
+
+static void add_chain(XenoBarrierTracker* t, VkPipelineStageFlags2 c)
+{
+    /* Hitting a subset also hits every superset. */
+    for (uint32_t i = 0; i < t->chain_count; ++i) {
+        if (!(t->chains[i] & ~c)) return;
+    }
+    uint32_t keep = 0;
+    for (uint32_t i = 0; i < t->chain_count; ++i) {
+        if (c & ~t->chains[i]) t->chains[keep++] = t->chains[i];
+    }
+    t->chain_count = keep;
+    if (t->chain_count == XENO_BARRIER_CHAINS) {
+        t->opaque = 1;
+        return;
+    }
+    t->chains[t->chain_count++] = c;
+}
+
+static void apply_dependency(XenoBarrierTracker* t, VkPipelineStageFlags2 src, VkPipelineStageFlags2 dst,
+                             VkAccessFlags2 src_access, int global)
+{
+    int unknown_dst = 0;
+    VkPipelineStageFlags2 su = stage_units(src, 1, NULL);
+    VkPipelineStageFlags2 du = stage_units(dst, 0, &unknown_dst);
+
+    if (t->opaque && global && (su == U_ALL) && (src_access & VK_ACCESS_2_MEMORY_WRITE_BIT)) {
+        /* Everything before, known or not, now happens before dst. */
+        t->opaque = 0;
+        t->chain_count = 0;
+    }
+    t->unsynced &= ~su;
+    if (global) t->unflushed &= ~(su & flushed_units(src_access));
+
+    uint32_t keep = 0;
+    for (uint32_t i = 0; i < t->chain_count; ++i) {
+        if (!(t->chains[i] & su)) t->chains[keep++] = t->chains[i];
+    }
+    t->chain_count = keep;
+    if (unknown_dst) t->opaque = 1;
+    else if (du) add_chain(t, du);
+}
+
+static void update_state(XenoBarrierTracker* t, const XenoBarrierBatch* b)
+{
+    for (uint32_t i = 0; i < b->mem_count; ++i) {
+        apply_dependency(t, b->mem[i].srcStageMask, b->mem[i].dstStageMask, b->mem[i].srcAccessMask, 1);
+    }
+    for (uint32_t i = 0; i < b->buf_count; ++i) {
+        apply_dependency(t, b->buf[i].srcStageMask, b->buf[i].dstStageMask, b->buf[i].srcAccessMask, 0);
+    }
+    for (uint32_t i = 0; i < b->img_count; ++i) {
+        apply_dependency(t, b->img[i].srcStageMask, b->img[i].dstStageMask, b->img[i].srcAccessMask, 0);
+    }
+
+    t->work_since_emit = 0;
+    t->ref_count = t->ref_guard = 0;
+    t->refs_overflow = 0;
+
+    /* Transfers after this point need no further ordering against what
+       came before: nothing is left unsynchronized or unflushed, every
+       open chain reaches the transfer stage and transfers can see it all. */
+    t->transfer_clean = 0;
+    if (t->opaque || t->in_pass || t->unsynced || t->unflushed) return;
+    for (uint32_t i = 0; i < t->chain_count; ++i) {
+        if (!(t->chains[i] & U_XFER)) return;
+    }
+    for (uint32_t i = 0; i < b->mem_count; ++i) {
+        const VkMemoryBarrier2* m = &b->mem[i];
+        VkAccessFlags2 da = access_expand(m->dstAccessMask);
+        if ((stage_units(m->dstStageMask, 0, NULL) & U_XFER) &&
+            (da & ACCESS_XFER) == ACCESS_XFER) {
+            t->transfer_clean = 1;
+            return;
+        }
+    }
+}
+
+static void emit(XenoBarrierTracker* t, XenoBarrierBatch* b)
+{
+    /* Redundancy is judged on the call as recorded: the narrowed one is
+       equivalent to it, and a repeat would otherwise narrow to a lone
+       chain stage instead of being dropped. */
+    t->has_last = t->mode != XENO_BARRIER_SAFE && batch_copy(&t->last, b);
+    if (t->mode == XENO_BARRIER_AGGRESSIVE && !t->opaque && !t->in_pass && !batch_has_next(b)) narrow(t, b);
+    t->emit(t->user, b);
+    t->stats.calls_out++;
+    update_state(t, b);
+}
+
+static void emit_pending(XenoBarrierTracker* t)
+{
+    if (!t->has_pending) return;
+    t->has_pending = 0;
+    emit(t, &t->pending);
+}
+
+/* Collapses a global-only batch into the held one. Two calls merged into
+   one lose the chain between them, so the result is a single barrier from
+   every source scope to every destination scope. */
+static int hold(XenoBarrierTracker* t, const XenoBarrierBatch* b)
+{
+    VkPipelineStageFlags2 src = 0, dst = 0;
+    VkAccessFlags2 sa = 0, da = 0;
+    const XenoBarrierBatch* parts[2] = { t->has_pending ? &t->pending : NULL, b };
+    for (int p = 0; p < 2; ++p) {
+        if (!parts[p]) continue;
+        for (uint32_t i = 0; i < parts[p]->mem_count; ++i) {
+            src |= parts[p]->mem[i].srcStageMask;
+            dst |= parts[p]->mem[i].dstStageMask;
+            sa |= parts[p]->mem[i].srcAccessMask;
+            da |= parts[p]->mem[i].dstAccessMask;
+        }
+    }
+    if (!batch_reserve(&t->pending, 1, 0, 0)) return 0;
+    if (t->has_pending) t->stats.deferred++;
+    t->pending.flags = b->flags;
+    t->pending.sync2 = (t->has_pending && t->pending.sync2) || b->sync2;
+    t->pending.mem_count = 0;
+    t->pending.buf_count = t->pending.img_count = 0;
+    add_global(&t->pending, src, sa, dst, da);
+    t->has_pending = 1;
+    t->ref_guard = t->ref_count;
+    return 1;
+}
+
+static int can_hold(const XenoBarrierTracker* t, const XenoBarrierBatch* b)
+{
+    if (t->mode != XENO_BARRIER_AGGRESSIVE || t->opaque || t->in_pass || !t->transfer_clean || t->refs_overflow) return 0;
+    if (!b->mem_count || b->buf_count || b->img_count || batch_has_next(b)) return 0;
+    return !t->has_pending || t->pending.flags == b->flags;
+}
+
+static int refs_overlap(const XenoBarrierRef* a, const XenoBarrierRef* b)
+{
+    return a->handle == b->handle && (a->write || b->write) && a->begin < b->end && b->begin < a->end;
+}
+
+/* Records the queued call: held across the transfer about to be recorded
+   when it can be, otherwise in one call with a held barrier. */
+static void settle(XenoBarrierTracker* t, int transfer)
+{
+    if (!t->has_queued) return;
+    t->has_queued = 0;
+    XenoBarrierBatch* q = &t->queued;
+    if (transfer && can_hold(t, q) && hold(t, q)) return;
+    if (t->has_pending && merge_call(t, &t->pending, q)) {
+        t->stats.deferred++;
+        t->has_pending = 0;
+        emit(t, &t->pending);
+        return;
+    }
+    emit_pending(t);
+    emit(t, q);
+}
+
+/* ---- public --------------------------------------------------------- */
+
+void xeno_barrier_tracker_init(XenoBarrierTracker* t, XenoBarrierEmit emit_fn, void* user)
+{
+    memset(t, 0, sizeof(*t));
+    t->emit = emit_fn;
+    t->user = user;
+    xeno_barrier_begin(t, XENO_BARRIER_SAFE, 0, 0);
+}
+
+void xeno_barrier_tracker_free(XenoBarrierTracker* t)
+{
+    batch_free(&t->in);
+    batch_free(&t->queued);
+    batch_free(&t->last);
+    batch_free(&t->pending);
+}
+
+void xeno_barrier_begin(XenoBarrierTracker* t, int mode, int in_pass, int coalesce)
+{
+    t->mode = mode;
+    t->coalesce = coalesce && mode != XENO_BARRIER_SAFE;
+    t->opaque = 1;              /* earlier submissions are not known */
+    t->in_pass = in_pass;
+    t->unsynced = t->unflushed = U_ALL;
+    t->chain_count = 0;
+    t->work_since_emit = 1;
+    t->has_last = 0;
+    t->transfer_clean = 0;
+    t->ref_count = t->ref_guard = 0;
+    t->refs_overflow = 0;
+    t->has_pending = 0;
+    t->has_queued = 0;
+}
+
+int xeno_barrier_load1(XenoBarrierTracker* t, VkPipelineStageFlags src, VkPipelineStageFlags dst,
+                       VkDependencyFlags flags, uint32_t mem_count, const VkMemoryBarrier* mem,
+                       uint32_t buf_count, const VkBufferMemoryBarrier* buf, uint32_t img_count,
+                       const VkImageMemoryBarrier* img)
+{
+    XenoBarrierBatch* b = &t->in;
+    if (!batch_reserve(b, mem_count, buf_count, img_count)) return 0;
+    b->flags = flags;
+    b->sync2 = 0;
+    b->mem_count = mem_count;
+    b->buf_count = buf_count;
+    b->img_count = img_count;
+    for (uint32_t i = 0; i < mem_count; ++i) {
+        b->mem[i] = (VkMemoryBarrier2){
+            .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2, .pNext = mem[i].pNext,
+            .srcStageMask = src, .srcAccessMask = mem[i].srcAccessMask,
+            .dstStageMask = dst, .dstAccessMask = mem[i].dstAccessMask,
+        };
+    }
+    for (uint32_t i = 0; i < buf_count; ++i) {
+        b->buf[i] = (VkBufferMemoryBarrier2){
+            .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2, .pNext = buf[i].pNext,
+            .srcStageMask = src, .srcAccessMask = buf[i].srcAccessMask,
+            .dstStageMask = dst, .dstAccessMask = buf[i].dstAccessMask,
+            .srcQueueFamilyIndex = buf[i].srcQueueFamilyIndex, .dstQueueFamilyIndex = buf[i].dstQueueFamilyIndex,
+            .buffer = buf[i].buffer, .offset = buf[i].offset, .size = buf[i].size,
+        };
+    }
+    for (uint32_t i = 0; i < img_count; ++i) {
+        b->img[i] = (VkImageMemoryBarrier2){
+            .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2, .pNext = img[i].pNext,
+            .srcStageMask = src, .srcAccessMask = img[i].srcAccessMask,
+            .dstStageMask = dst, .dstAccessMask = img[i].dstAccessMask,
+            .oldLayout = img[i].oldLayout, .newLayout = img[i].newLayout,
+            .srcQueueFamilyIndex = img[i].srcQueueFamilyIndex, .dstQueueFamilyIndex = img[i].dstQueueFamilyIndex,
+            .image = img[i].image, .subresourceRange = img[i].subresourceRange,
+        };
+    }
+    /* A sync1 call with no barriers at all is still an execution dependency. */
+    if (!mem_count && !buf_count && !img_count) {
+        b->mem[0] = (VkMemoryBarrier2){
+            .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2, .srcStageMask = src, .dstStageMask = dst,
+        };
+        b->mem_count = 1;
+    }
+    return 1;
+}
+
+int xeno_barrier_load2(XenoBarrierTracker* t, const VkDependencyInfo* info)
+{
+    XenoBarrierBatch* b = &t->in;
+    if (info->pNext) return 0;
+    if (!batch_reserve(b, info->memoryBarrierCount, info->bufferMemoryBarrierCount, info->imageMemoryBarrierCount)) {
+        return 0;
+    }
+    b->flags = info->dependencyFlags;
+    b->sync2 = 1;
+    b->mem_count = info->memoryBarrierCount;
+    b->buf_count = info->bufferMemoryBarrierCount;
+    b->img_count = info->imageMemoryBarrierCount;
+    if (b->mem_count) memcpy(b->mem, info->pMemoryBarriers, b->mem_count * sizeof(*b->mem));
+    if (b->buf_count) memcpy(b->buf, info->pBufferMemoryBarriers, b->buf_count * sizeof(*b->buf));
+    if (b->img_count) memcpy(b->img, info->pImageMemoryBarriers, b->img_count * sizeof(*b->img));
+    return 1;
+}
+
+void xeno_barrier_record(XenoBarrierTracker* t)
+{
+    XenoBarrierBatch* b = &t->in;
+    t->stats.calls_in++;
+
+    /* Self-dependencies inside a pass and anything carrying extension
+       structures go through untouched; the latter still count as
+       ordering, which only makes the tracker more careful. */
+    if (t->in_pass || t->mode == XENO_BARRIER_SAFE || batch_has_next(b)) {
+        settle(t, 0);
+        emit_pending(t);
+        if (!t->in_pass) {
+            emit(t, b);
+            return;
+        }
+        t->emit(t->user, b);
+        t->stats.calls_out++;
+        return;
+    }
+
+    fold(t, b);
+    if (!b->mem_count && !b->buf_count && !b->img_count) {
+        t->stats.dropped++;
+        return;
+    }
+    if (t->has_queued) {
+        if (covers_call(&t->queued, b)) {
+            t->stats.dropped++;
+            return;
+        }
+        if (merge_call(t, &t->queued, b)) {
+            t->stats.coalesced++;
+            return;
+        }
+        settle(t, 0);
+    }
+    if (!t->has_pending && redundant(t, b)) {
+        t->stats.dropped++;
+        return;
+    }
+    /* Queued calls go out at the next work, pass, event or end. */
+    if (t->coalesce && batch_copy(&t->queued, b)) {
+        t->has_queued = 1;
+        return;
+    }
+    if (can_hold(t, b) && hold(t, b)) return;
+    emit_pending(t);
+    emit(t, b);
+}
+
+void xeno_barrier_work(XenoBarrierTracker* t, VkPipelineStageFlags2 stages, const XenoBarrierRef* refs,
+                       uint32_t ref_count)
+{
+    VkPipelineStageFlags2 u = stage_units(stages, 0, NULL);
+    int transfer = u == U_XFER && refs && ref_count;
+
+    settle(t, transfer);
+    if (t->has_pending) {
+        int conflict = !transfer || t->ref_count + ref_count > XENO_BARRIER_REFS;
+        for (uint32_t i = 0; i < ref_count && !conflict; ++i) {
+            for (uint32_t j = 0; j < t->ref_guard && !conflict; ++j) conflict = refs_overlap(&refs[i], &t->refs[j]);
+        }
+        if (conflict) emit_pending(t);
+    }
+
+    t->unsynced |= u;
+    t->unflushed |= u & ~U_IND;
+    t->work_since_emit = 1;
+    if (!transfer) {
+        t->transfer_clean = 0;
+        return;
+    }
+    if (t->ref_count + ref_count > XENO_BARRIER_REFS) {
+        t->refs_overflow = 1;
+        return;
+    }
+    memcpy(&t->refs[t->ref_count], refs, ref_count * sizeof(*refs));
+    t->ref_count += ref_count;
+}
+
+void xeno_barrier_pass(XenoBarrierTracker* t, int begin)
+{
+    if (begin) {
+        xeno_barrier_work(t, VK_PIPELINE_STAGE_2_ALL_GRAPHICS_BIT, NULL, 0);
+        t->in_pass = 1;
+    } else {
+        t->in_pass = 0;
+    }
+}
+
+void xeno_barrier_opaque(XenoBarrierTracker* t)
+{
+    settle(t, 0);
+    emit_pending(t);
+    t->opaque = 1;
+    t->unsynced = t->unflushed = U_ALL;
+    t->work_since_emit = 1;
+    t->transfer_clean = 0;
+}
+
+void xeno_barrier_flush(XenoBarrierTracker* t)
+{
+    settle(t, 0);
+    emit_pending(t);
+}
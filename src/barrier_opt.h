@@ -0,0 +1,140 @@
+// src/barrier_opt.h
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <stdint.h>
+
+/*
+  Pipeline-barrier relaxation engine (barrier_opt.c), driven by sync_mode.
+
+  Pure logic with no Vulkan calls: the layer feeds one tracker per command
+  buffer with the barriers and the work it records, and the tracker hands
+  back what to actually record through an emit callback. That keeps it
+  testable on recorded barrier streams (tests/barrier_opt_test.c).
+
+  Barriers are kept in synchronization2 form internally; sync1 calls are
+  converted on the way in and back on the way out.
+
+  SAFE        records every barrier as given.
+  BALANCED    folds image barriers without a layout transition and buffer
+              barriers without an ownership transfer into the call's
+              global memory barrier, merges memory barriers with the same
+              stage masks, and drops a call that an identical or broader
+              call right before it (no work in between) already covers.
+              With coalescing on, consecutive calls are queued and go out
+              as one call before the next work, pass, event or end of
+              recording; the chains between them are made explicit, and
+              image barriers that continue a transition on the same
+              subresource range become one transition.
+  AGGRESSIVE  also narrows ALL_COMMANDS / ALL_GRAPHICS in source stage
+              masks to the stages that actually ran since they were last
+              synchronized, keeping each execution-dependency chain intact;
+              and holds a global-only barrier back across following
+              transfers that touch none of the resources written or read
+              before it, so a run of "copy, full barrier, copy, full
+              barrier" pays for one barrier.
+
+  Only destination scopes are never narrowed: the commands after a barrier
+  are not known when it is recorded. Narrowing and deferral rely on seeing
+  every command that does work outside render passes; secondary command
+  buffers and a fresh recording make the tracker conservative until the
+  next full barrier. Deferral assumes transfer targets do not alias each
+  other's memory. Coalescing moves a barrier past whatever is recorded
+  between it and the next one, so it is only for devices where the layer
+  sees every command that does work.
+*/
+
+enum { XENO_BARRIER_SAFE, XENO_BARRIER_BALANCED, XENO_BARRIER_AGGRESSIVE };
+
+#define XENO_BARRIER_CHAINS 8u          /* open dependency chains tracked */
+#define XENO_BARRIER_REFS 32u           /* transfer resources tracked for deferral */
+
+typedef struct XenoBarrierBatch {
+    VkDependencyFlags flags;
+    int sync2;                          /* recorded through vkCmdPipelineBarrier2 */
+    VkMemoryBarrier2* mem;
+    uint32_t mem_count, mem_cap;
+    VkBufferMemoryBarrier2* buf;
+    uint32_t buf_count, buf_cap;
+    VkImageMemoryBarrier2* img;
+    uint32_t img_count, img_cap;
+} XenoBarrierBatch;
+
+/* A resource a transfer command reads or writes; images use the whole range. */
+typedef struct XenoBarrierRef {
+    uint64_t handle;
+    VkDeviceSize begin, end;
+    int write;
+} XenoBarrierRef;
+
+typedef struct XenoBarrierStats {
+    uint64_t calls_in;          /* barrier calls recorded by the app */
+    uint64_t calls_out;         /* barrier calls handed to the driver */
+    uint64_t dropped;           /* calls found redundant */
+    uint64_t deferred;          /* calls merged into a later one across transfers */
+    uint64_t folded;            /* buffer / image barriers folded into a global one */
+    uint64_t narrowed;          /* barriers whose source stages were narrowed */
+    uint64_t coalesced;         /* calls merged into the one queued before them */
+    uint64_t deduped;           /* image barriers merged into an earlier transition */
+} XenoBarrierStats;
+
+typedef void (*XenoBarrierEmit)(void* user, const XenoBarrierBatch* batch);
+
+typedef struct XenoBarrierTracker {
+    int mode;                   /* XENO_BARRIER_*, latched at begin */
+    int coalesce;
+    XenoBarrierEmit emit;
+    void* user;
+
+    int opaque;                 /* unknown prior work: leave barriers as they are */
+    int in_pass;                /* inside a render pass instance */
+    VkPipelineStageFlags2 unsynced;     /* stages with work no barrier has waited on */
+    VkPipelineStageFlags2 unflushed;    /* stages with writes no global barrier made available */
+    VkPipelineStageFlags2 chains[XENO_BARRIER_CHAINS];  /* destination scopes later barriers must chain with */
+    uint32_t chain_count;
+
+    int work_since_emit;
+    int has_last;
+    XenoBarrierBatch last;      /* the last call emitted, as recorded */
+
+    int transfer_clean;         /* everything before is ordered and visible to transfers */
+    XenoBarrierRef refs[XENO_BARRIER_REFS];
+    uint32_t ref_count;
+    uint32_t ref_guard;         /* refs[0, ref_guard) were recorded before the held barrier */
+    int refs_overflow;
+    int has_pending;
+    XenoBarrierBatch pending;
+
+    int has_queued;
+    XenoBarrierBatch queued;    /* calls coalesced so far */
+
+    XenoBarrierBatch in;        /* the call being processed */
+    XenoBarrierStats stats;
+} XenoBarrierTracker;
+
+void xeno_barrier_tracker_init(XenoBarrierTracker* t, XenoBarrierEmit emit, void* user);
+void xeno_barrier_tracker_free(XenoBarrierTracker* t);
+
+/* New recording; in_pass for secondaries that continue a render pass. */
+void xeno_barrier_begin(XenoBarrierTracker* t, int mode, int in_pass, int coalesce);
+
+/* Loads a call into t->in; returns 0 when out of memory (record the call as given). */
+int xeno_barrier_load1(XenoBarrierTracker* t, VkPipelineStageFlags src, VkPipelineStageFlags dst,
+                       VkDependencyFlags flags, uint32_t mem_count, const VkMemoryBarrier* mem,
+                       uint32_t buf_count, const VkBufferMemoryBarrier* buf, uint32_t img_count,
+                       const VkImageMemoryBarrier* img);
+int xeno_barrier_load2(XenoBarrierTracker* t, const VkDependencyInfo* info);
+
+/* Processes t->in; whatever is to be recorded goes through the emit callback. */
+void xeno_barrier_record(XenoBarrierTracker* t);
+
+/* Before a command that does work in `stages`. Transfers pass the
+   resources they touch so a held barrier can stay held; other work
+   passes none. Emits a held barrier first when needed. */
+void xeno_barrier_work(XenoBarrierTracker* t, VkPipelineStageFlags2 stages, const XenoBarrierRef* refs,
+                       uint32_t ref_count);
+void xeno_barrier_pass(XenoBarrierTracker* t, int begin);
+/* Secondary command buffers: their contents are not seen. */
+void xeno_barrier_opaque(XenoBarrierTracker* t);
+/* Emits queued and held barriers (end of recording, events). */
+void xeno_barrier_flush(XenoBarrierTracker* t);
@@ -18,6 +18,7 @@
 #include <stdint.h>
 #include <stddef.h>
 #include <stdatomic.h>
+#include <time.h>
 
 #include <vulkan/vulkan.h>
 
@@ -63,6 +64,10 @@ typedef enum VkImageBCFormat {
 #include "xeno_bc.h"
 #include "logging.h"
 #include "xeno_log.h"
+#include "xeno_trace.h"
+#include "xeno_mem.h"
+#include "perf_conf.h"
+#include "autotune.h"
 
 #define XCLIPSE_LOCAL_X 16u
 #define XCLIPSE_LOCAL_Y 8u
@@ -84,24 +89,51 @@ struct XenoBCContext {
     VkPipeline pipelines[7];
 
     VkBuffer stagingBuffer;
-    VkDeviceMemory stagingMemory;
+    XenoMemAlloc stagingAlloc;
     size_t stagingSize;
     _Atomic size_t staging_head;
 
     VkPhysicalDeviceProperties physProps;
+    uint32_t localX, localY;    /* specialized workgroup shape */
 };
 
 /* Forward declarations */
 static VkResult create_descriptor_layouts(VkDevice dev, VkDescriptorSetLayout *outDsl, VkPipelineLayout *outPl);
 static VkResult create_descriptor_pool(VkDevice dev, VkDescriptorPool *outPool);
 static VkResult create_shader_module(VkDevice dev, const uint32_t *words, size_t size, VkShaderModule *outModule);
-static VkResult create_compute_pipeline(VkDevice dev, VkPipelineLayout layout, VkShaderModule module, VkPipeline *outPipeline);
-static VkResult init_staging_pool(VkDevice device, VkPhysicalDevice physical, VkBuffer *outBuf, VkDeviceMemory *outMem, size_t pool_size);
+static VkResult create_compute_pipeline(VkDevice dev, VkPipelineLayout layout, VkShaderModule module,
+                                        uint32_t local_x, uint32_t local_y, VkPipeline *outPipeline);
+static VkResult init_staging_pool(VkDevice device, VkBuffer *outBuf, XenoMemAlloc *outAlloc, size_t pool_size);
+
+static inline double bc_now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1000.0 + (double)ts.tv_nsec / 1e6;
+}
+
+/* bc_workgroup from perf_conf when the device can run it, else 16x8. */
+static void pick_local_size(const VkPhysicalDeviceProperties *props, uint32_t *local_x, uint32_t *local_y)
+{
+    const XenoPerfConf *conf = xeno_perf_conf_active();
+    uint32_t x = conf->bc_local_x > 0 ? (uint32_t)conf->bc_local_x : XCLIPSE_LOCAL_X;
+    uint32_t y = conf->bc_local_y > 0 ? (uint32_t)conf->bc_local_y : XCLIPSE_LOCAL_Y;
+    if (props && (x > props->limits.maxComputeWorkGroupSize[0] || y > props->limits.maxComputeWorkGroupSize[1] ||
+                  x * y > props->limits.maxComputeWorkGroupInvocations)) {
+        XENO_LOGW("bc: workgroup %ux%u exceeds device limits, using %ux%u", x, y, XCLIPSE_LOCAL_X, XCLIPSE_LOCAL_Y);
+        x = XCLIPSE_LOCAL_X;
+        y = XCLIPSE_LOCAL_Y;
+    }
+    *local_x = x;
+    *local_y = y;
+}
 
 void xeno_bc_get_optimal_local_size(uint32_t *local_x, uint32_t *local_y)
 {
-    if (local_x) *local_x = XCLIPSE_LOCAL_X;
-    if (local_y) *local_y = XCLIPSE_LOCAL_Y;
+    uint32_t x, y;
+    pick_local_size(NULL, &x, &y);
+    if (local_x) *local_x = x;
+    if (local_y) *local_y = y;
 }
 
 /* Provide concise mapping from format enum to index */
@@ -123,6 +155,7 @@ static inline int bc_format_index(VkImageBCFormat f)
    The pipeline creation here treats missing modules/pipelines as hard errors (non-fallback). */
 VkResult xeno_bc_create_context(VkDevice device, VkPhysicalDevice physical, VkQueue queue, struct XenoBCContext **out_ctx)
 {
+    XENO_TRACE_SCOPE("bc.create_context");
     if (!device || !physical || !queue || !out_ctx) return VK_ERROR_INITIALIZATION_FAILED;
 
     struct XenoBCContext *ctx = calloc(1, sizeof(*ctx));
@@ -135,6 +168,7 @@ VkResult xeno_bc_create_context(VkDevice device, VkPhysicalDevice physical, VkQu
     atomic_store(&ctx->staging_head, 0);
 
     vkGetPhysicalDeviceProperties(physical, &ctx->physProps);
+    pick_local_size(&ctx->physProps, &ctx->localX, &ctx->localY);
 
     VkResult r = create_descriptor_layouts(device, &ctx->descriptorSetLayout, &ctx->pipelineLayout);
     if (r != VK_SUCCESS) goto fail;
@@ -178,11 +212,12 @@ VkResult xeno_bc_create_context(VkDevice device, VkPhysicalDevice physical, VkQu
         }
         r = create_shader_module(device, words[i], sizes[i], &ctx->modules[i]);
         if (r != VK_SUCCESS) { logging_error("vkCreateShaderModule failed for bc %d: %d", i, (int)r); goto fail; }
-        r = create_compute_pipeline(device, ctx->pipelineLayout, ctx->modules[i], &ctx->pipelines[i]);
+        r = create_compute_pipeline(device, ctx->pipelineLayout, ctx->modules[i], ctx->localX, ctx->localY,
+                                    &ctx->pipelines[i]);
         if (r != VK_SUCCESS) { logging_error("vkCreateComputePipelines failed for bc %d: %d", i, (int)r); goto fail; }
     }
 
-    r = init_staging_pool(device, physical, &ctx->stagingBuffer, &ctx->stagingMemory, ctx->stagingSize);
+    r = init_staging_pool(device, &ctx->stagingBuffer, &ctx->stagingAlloc, ctx->stagingSize);
     if (r != VK_SUCCESS) { logging_error("init_staging_pool failed: %d", (int)r); goto fail; }
 
     *out_ctx = ctx;
@@ -196,8 +231,7 @@ fail:
         if (ctx->descriptorPool) vkDestroyDescriptorPool(device, ctx->descriptorPool, NULL);
         if (ctx->pipelineLayout) vkDestroyPipelineLayout(device, ctx->pipelineLayout, NULL);
         if (ctx->descriptorSetLayout) vkDestroyDescriptorSetLayout(device, ctx->descriptorSetLayout, NULL);
-        if (ctx->stagingMemory) vkFreeMemory(device, ctx->stagingMemory, NULL);
-        if (ctx->stagingBuffer) vkDestroyBuffer(device, ctx->stagingBuffer, NULL);
+        xeno_mem_destroy_buffer(xeno_mem_allocator(device), ctx->stagingBuffer, &ctx->stagingAlloc);
         free(ctx);
     }
     return r;
@@ -214,8 +248,7 @@ void xeno_bc_destroy_context(struct XenoBCContext *ctx)
     if (ctx->descriptorPool) vkDestroyDescriptorPool(dev, ctx->descriptorPool, NULL);
     if (ctx->pipelineLayout) vkDestroyPipelineLayout(dev, ctx->pipelineLayout, NULL);
     if (ctx->descriptorSetLayout) vkDestroyDescriptorSetLayout(dev, ctx->descriptorSetLayout, NULL);
-    if (ctx->stagingMemory) vkFreeMemory(dev, ctx->stagingMemory, NULL);
-    if (ctx->stagingBuffer) vkDestroyBuffer(dev, ctx->stagingBuffer, NULL);
+    xeno_mem_destroy_buffer(xeno_mem_allocator(dev), ctx->stagingBuffer, &ctx->stagingAlloc);
     free(ctx);
     logging_info("xeno_bc_destroy_context: cleaned up");
 }
@@ -223,7 +256,9 @@ void xeno_bc_destroy_context(struct XenoBCContext *ctx)
 /* Record a decode dispatch into provided command buffer. Non-fallback: uses pipeline for format index. */
 VkResult xeno_bc_decode_image(VkCommandBuffer cmd, struct XenoBCContext *ctx, const void *host_data, size_t host_size, VkBuffer src_buffer, VkImageView dst_view, VkImageBCFormat format, VkExtent3D extent)
 {
+    XENO_TRACE_SCOPE("bc.decode_image");
     if (!cmd || !ctx) return VK_ERROR_INITIALIZATION_FAILED;
+    double t0 = bc_now_ms();
 
     int idx = bc_format_index(format);
     if (idx < 0) { logging_error("Unsupported BC format %d", (int)format); return VK_ERROR_FORMAT_NOT_SUPPORTED; }
@@ -256,11 +291,9 @@ VkResult xeno_bc_decode_image(VkCommandBuffer cmd, struct XenoBCContext *ctx, co
             atomic_store(&ctx->staging_head, 0);
             head = 0;
         }
-        void *mapped = NULL;
-        r = vkMapMemory(ctx->device, ctx->stagingMemory, head, alloc, 0, &mapped);
-        if (r != VK_SUCCESS) { logging_error("vkMapMemory failed: %d", (int)r); vkFreeDescriptorSets(ctx->device, ctx->descriptorPool, 1, &descSet); return r; }
-        memcpy(mapped, host_data, host_size);
-        vkUnmapMemory(ctx->device, ctx->stagingMemory);
+        /* The pool is coherent and stays mapped. */
+        memcpy((char *)ctx->stagingAlloc.mapped + head, host_data, host_size);
+        XENO_TRACE_COUNTER("bc.staged_bytes", host_size);
 
         dbi.buffer = ctx->stagingBuffer;
         dbi.offset = head;
@@ -310,14 +343,16 @@ VkResult xeno_bc_decode_image(VkCommandBuffer cmd, struct XenoBCContext *ctx, co
     push[3] = extent.height;
     vkCmdPushConstants(cmd, ctx->pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(push), push);
 
-    uint32_t gx = (extent.width + XCLIPSE_LOCAL_X - 1) / XCLIPSE_LOCAL_X;
-    uint32_t gy = (extent.height + XCLIPSE_LOCAL_Y - 1) / XCLIPSE_LOCAL_Y;
+    uint32_t gx = (extent.width + ctx->localX - 1) / ctx->localX;
+    uint32_t gy = (extent.height + ctx->localY - 1) / ctx->localY;
     uint32_t gz = extent.depth ? extent.depth : 1;
     vkCmdDispatch(cmd, gx, gy, gz);
 
     /* Free descriptor set (using FREE_DESCRIPTOR_SET pool) */
     vkFreeDescriptorSets(ctx->device, ctx->descriptorPool, 1, &descSet);
 
+    /* Host-side cost (staging copy and recording) for the tuner. */
+    xeno_autotune_decode(bc_now_ms() - t0);
     return VK_SUCCESS;
 }
 
@@ -383,7 +418,8 @@ static VkResult create_shader_module(VkDevice dev, const uint32_t *words, size_t
     return vkCreateShaderModule(dev, &smci, NULL, outModule);
 }
 
-static VkResult create_compute_pipeline(VkDevice dev, VkPipelineLayout layout, VkShaderModule module, VkPipeline *outPipeline)
+static VkResult create_compute_pipeline(VkDevice dev, VkPipelineLayout layout, VkShaderModule module,
+                                        uint32_t local_x, uint32_t local_y, VkPipeline *outPipeline)
 {
     VkSpecializationMapEntry mapEntries[2];
     mapEntries[0].constantID = 0;
@@ -393,7 +429,7 @@ static VkResult create_compute_pipeline(VkDevice dev, VkPipelineLayout layout, V
     mapEntries[1].offset = sizeof(uint32_t);
     mapEntries[1].size = sizeof(uint32_t);
 
-    uint32_t specData[2] = { XCLIPSE_LOCAL_X, XCLIPSE_LOCAL_Y };
+    uint32_t specData[2] = { local_x, local_y };
     VkSpecializationInfo spec = { .mapEntryCount = 2, .pMapEntries = mapEntries, .dataSize = sizeof(specData), .pData = specData };
 
     VkPipelineShaderStageCreateInfo stage = {
@@ -409,39 +445,15 @@ static VkResult create_compute_pipeline(VkDevice dev, VkPipelineLayout layout, V
         .stage = stage,
         .layout = layout
     };
+    XENO_TRACE_SCOPE("vkCreateComputePipelines");
     return vkCreateComputePipelines(dev, VK_NULL_HANDLE, 1, &cpci, NULL, outPipeline);
 }
 
-static VkResult init_staging_pool(VkDevice device, VkPhysicalDevice physical, VkBuffer *outBuf, VkDeviceMemory *outMem, size_t pool_size)
+static VkResult init_staging_pool(VkDevice device, VkBuffer *outBuf, XenoMemAlloc *outAlloc, size_t pool_size)
 {
-    VkBufferCreateInfo bci = { .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO, .size = pool_size, .usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, .sharingMode = VK_SHARING_MODE_EXCLUSIVE };
-    VkResult r = vkCreateBuffer(device, &bci, NULL, outBuf);
-    if (r != VK_SUCCESS) return r;
-
-    VkMemoryRequirements mr;
-    vkGetBufferMemoryRequirements(device, *outBuf, &mr);
-
-    VkPhysicalDeviceMemoryProperties pr;
-    vkGetPhysicalDeviceMemoryProperties(physical, &pr);
-
-    uint32_t mem_idx = UINT32_MAX;
-    for (uint32_t i = 0; i < pr.memoryTypeCount; ++i) {
-        uint32_t mask = (1u << i);
-        if ((mr.memoryTypeBits & mask) == 0) continue;
-        VkMemoryPropertyFlags props = pr.memoryTypes[i].propertyFlags;
-        if ((props & (VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT)) == (VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT)) {
-            mem_idx = i;
-            break;
-        }
-    }
-    if (mem_idx == UINT32_MAX) { vkDestroyBuffer(device, *outBuf, NULL); return VK_ERROR_MEMORY_MAP_FAILED; }
-
-    VkMemoryAllocateInfo mai = { .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO, .allocationSize = mr.size, .memoryTypeIndex = mem_idx };
-    r = vkAllocateMemory(device, &mai, NULL, outMem);
-    if (r != VK_SUCCESS) { vkDestroyBuffer(device, *outBuf, NULL); return r; }
-
-    r = vkBindBufferMemory(device, *outBuf, *outMem, 0);
-    if (r != VK_SUCCESS) { vkFreeMemory(device, *outMem, NULL); vkDestroyBuffer(device, *outBuf, NULL); return r; }
-
-    return VK_SUCCESS;
+    XenoMemAllocator *mem = xeno_mem_allocator(device);
+    if (!mem) return VK_ERROR_INITIALIZATION_FAILED;
+    return xeno_mem_create_buffer(mem, pool_size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                                  VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, 0,
+                                  outBuf, outAlloc);
 }
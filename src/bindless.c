@@ -0,0 +1,293 @@
+// src/bindless.c
+/*
+  Bindless texture heap (see bindless.h).
+
+  Slots [0, top) have been handed out at least once; everything above top
+  is fresh. Freed slots wait in a FIFO, stamped with the frame they were
+  freed in, and move to the free stack once they are old enough. Both
+  hold at most capacity entries, so they are allocated up front. One
+  mutex guards the lists and the descriptor writes.
+*/
+#include "bindless.h"
+#include "perf_conf.h"
+#include "xeno_log.h"
+#include "xeno_trace.h"
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#define XENO_BINDLESS_STAGES (VK_SHADER_STAGE_COMPUTE_BIT | VK_SHADER_STAGE_FRAGMENT_BIT)
+
+typedef struct Retired {
+    uint32_t slot;
+    uint64_t frame;
+} Retired;
+
+struct XenoBindless {
+    pthread_mutex_t mtx;
+    VkDescriptorSetLayout layout;
+    VkDescriptorPool pool;
+    VkDescriptorSet set;
+    uint32_t capacity;
+    uint32_t top;
+    uint32_t* free_slots;       /* stack */
+    uint32_t free_count;
+    Retired* retired;           /* ring, oldest at head */
+    uint32_t retired_head, retired_count;
+    uint64_t frame;
+    uint32_t peak;              /* most slots in use at once */
+    uint64_t full;              /* allocations refused */
+};
+
+/* ---- device creation ---- */
+
+static const VkBaseInStructure* find_struct(const void* chain, VkStructureType type)
+{
+    const VkBaseInStructure* s = (const VkBaseInStructure*)chain;
+    while (s && s->sType != type) s = s->pNext;
+    return s;
+}
+
+static uint32_t min_u32(uint32_t a, uint32_t b)
+{
+    return a < b ? a : b;
+}
+
+static int app_enabled(const VkDeviceCreateInfo* ci, const char* name)
+{
+    for (uint32_t i = 0; i < ci->enabledExtensionCount; ++i) {
+        if (strcmp(ci->ppEnabledExtensionNames[i], name) == 0) return 1;
+    }
+    return 0;
+}
+
+static int driver_has(const XenoInstanceDispatch* inst, VkPhysicalDevice physical, const char* name)
+{
+    uint32_t n = 0;
+    if (!inst->EnumerateDeviceExtensionProperties ||
+        inst->EnumerateDeviceExtensionProperties(physical, NULL, &n, NULL) != VK_SUCCESS || !n) return 0;
+    VkExtensionProperties* props = (VkExtensionProperties*)malloc(n * sizeof(*props));
+    int found = 0;
+    if (props && inst->EnumerateDeviceExtensionProperties(physical, NULL, &n, props) >= VK_SUCCESS) {
+        for (uint32_t i = 0; i < n && !found; ++i) found = strcmp(props[i].extensionName, name) == 0;
+    }
+    free(props);
+    return found;
+}
+
+uint32_t xeno_bindless_device_supported(const XenoInstanceDispatch* inst, VkPhysicalDevice physical,
+                                        const VkDeviceCreateInfo* app_ci,
+                                        VkPhysicalDeviceDescriptorIndexingFeatures* add, const char** add_ext)
+{
+    memset(add, 0, sizeof(*add));
+    *add_ext = NULL;
+    int slots = xeno_perf_conf_active()->bindless_slots;
+    if (slots <= 0 || !inst->GetPhysicalDeviceProperties || !inst->GetPhysicalDeviceProperties2 ||
+        !inst->GetPhysicalDeviceFeatures2) return 0;
+
+    /* The device gets the lower of the two versions. Below 1.2 the feature
+       struct is only valid with the extension, which needs 1.1 for
+       maintenance3. */
+    VkPhysicalDeviceProperties props;
+    inst->GetPhysicalDeviceProperties(physical, &props);
+    uint32_t version = inst->api_version ? inst->api_version : VK_API_VERSION_1_0;
+    if (props.apiVersion < version) version = props.apiVersion;
+    const char* ext = NULL;
+    if (version < VK_API_VERSION_1_2 && !app_enabled(app_ci, VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME)) {
+        if (version < VK_API_VERSION_1_1 || !driver_has(inst, physical, VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME))
+            return 0;
+        ext = VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME;
+    }
+
+    /* The app's feature structs are const: with one of them chained, the
+       heap only exists if the app enabled what it needs itself. */
+    const VkBaseInStructure* s = find_struct(app_ci->pNext, VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES);
+    if (s) {
+        const VkPhysicalDeviceVulkan12Features* f = (const VkPhysicalDeviceVulkan12Features*)s;
+        if (!f->descriptorBindingSampledImageUpdateAfterBind || !f->descriptorBindingPartiallyBound ||
+            !f->runtimeDescriptorArray) return 0;
+    } else if ((s = find_struct(app_ci->pNext, VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES))) {
+        const VkPhysicalDeviceDescriptorIndexingFeatures* f = (const VkPhysicalDeviceDescriptorIndexingFeatures*)s;
+        if (!f->descriptorBindingSampledImageUpdateAfterBind || !f->descriptorBindingPartiallyBound ||
+            !f->runtimeDescriptorArray) return 0;
+    } else {
+        /* The driver's own answer; the snapshot in caps_cache.c is patched. */
+        VkPhysicalDeviceDescriptorIndexingFeatures di = {
+            .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES,
+        };
+        VkPhysicalDeviceFeatures2 f2 = { .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2, .pNext = &di };
+        inst->GetPhysicalDeviceFeatures2(physical, &f2);
+        if (!di.descriptorBindingSampledImageUpdateAfterBind || !di.descriptorBindingPartiallyBound ||
+            !di.runtimeDescriptorArray) return 0;
+        add->sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES;
+        add->descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+        add->descriptorBindingPartiallyBound = VK_TRUE;
+        add->runtimeDescriptorArray = VK_TRUE;
+    }
+
+    VkPhysicalDeviceDescriptorIndexingProperties dp = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_PROPERTIES,
+    };
+    VkPhysicalDeviceProperties2 p2 = { .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2, .pNext = &dp };
+    inst->GetPhysicalDeviceProperties2(physical, &p2);
+    /* Half of every limit stays with the app, whose pools count too. */
+    uint32_t n = (uint32_t)slots;
+    n = min_u32(n, dp.maxUpdateAfterBindDescriptorsInAllPools / 2u);
+    n = min_u32(n, dp.maxPerStageDescriptorUpdateAfterBindSamplers / 2u);
+    n = min_u32(n, dp.maxPerStageDescriptorUpdateAfterBindSampledImages / 2u);
+    n = min_u32(n, dp.maxPerStageUpdateAfterBindResources / 2u);
+    n = min_u32(n, dp.maxDescriptorSetUpdateAfterBindSamplers / 2u);
+    n = min_u32(n, dp.maxDescriptorSetUpdateAfterBindSampledImages / 2u);
+    if (!n) add->sType = 0;
+    else *add_ext = ext;
+    return n;
+}
+
+static VkResult create_set(XenoDeviceDispatch* d, XenoBindless* b)
+{
+    VkDescriptorBindingFlags flags = VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT |
+                                     VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT;
+    VkDescriptorSetLayoutBindingFlagsCreateInfo bf = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO,
+        .bindingCount = 1, .pBindingFlags = &flags,
+    };
+    VkDescriptorSetLayoutBinding binding = {
+        .binding = 0, .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+        .descriptorCount = b->capacity, .stageFlags = XENO_BINDLESS_STAGES,
+    };
+    VkDescriptorSetLayoutCreateInfo lci = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO, .pNext = &bf,
+        .flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT,
+        .bindingCount = 1, .pBindings = &binding,
+    };
+    VkResult r = d->CreateDescriptorSetLayout(d->device, &lci, NULL, &b->layout);
+    if (r != VK_SUCCESS) return r;
+
+    VkDescriptorPoolSize size = { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, b->capacity };
+    VkDescriptorPoolCreateInfo pci = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+        .flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT,
+        .maxSets = 1, .poolSizeCount = 1, .pPoolSizes = &size,
+    };
+    r = d->CreateDescriptorPool(d->device, &pci, NULL, &b->pool);
+    if (r != VK_SUCCESS) return r;
+
+    VkDescriptorSetAllocateInfo dsai = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+        .descriptorPool = b->pool, .descriptorSetCount = 1, .pSetLayouts = &b->layout,
+    };
+    return d->AllocateDescriptorSets(d->device, &dsai, &b->set);
+}
+
+static void heap_free(XenoDeviceDispatch* d, XenoBindless* b)
+{
+    /* The set goes with its pool. */
+    if (b->pool) d->DestroyDescriptorPool(d->device, b->pool, NULL);
+    if (b->layout) d->DestroyDescriptorSetLayout(d->device, b->layout, NULL);
+    pthread_mutex_destroy(&b->mtx);
+    free(b->free_slots);
+    free(b->retired);
+    free(b);
+}
+
+void xeno_bindless_device_init(XenoDeviceDispatch* d, uint32_t slots)
+{
+    if (!slots) return;
+    XenoBindless* b = (XenoBindless*)calloc(1, sizeof(*b));
+    if (!b) return;
+    pthread_mutex_init(&b->mtx, NULL);
+    b->capacity = slots;
+    b->frame = 1;
+    b->free_slots = (uint32_t*)malloc(sizeof(*b->free_slots) * slots);
+    b->retired = (Retired*)malloc(sizeof(*b->retired) * slots);
+    VkResult r = b->free_slots && b->retired ? create_set(d, b) : VK_ERROR_OUT_OF_HOST_MEMORY;
+    if (r != VK_SUCCESS) {
+        XENO_LOGW("bindless: heap unavailable (%d)", r);
+        heap_free(d, b);
+        return;
+    }
+    d->bindless = b;
+    XENO_LOGI("bindless: %u-slot texture heap", slots);
+}
+
+void xeno_bindless_device_destroy(XenoDeviceDispatch* d)
+{
+    XenoBindless* b = d->bindless;
+    if (!b) return;
+    d->bindless = NULL;
+    XENO_LOGI("bindless: %u of %u slots used at peak, %llu allocations refused", b->peak, b->capacity,
+              (unsigned long long)b->full);
+    heap_free(d, b);
+}
+
+/* ---- slots ---- */
+
+uint32_t xeno_bindless_alloc(XenoDeviceDispatch* d, VkImageView view, VkSampler sampler, VkImageLayout layout)
+{
+    XenoBindless* b = d->bindless;
+    if (!b) return XENO_BINDLESS_NONE;
+    pthread_mutex_lock(&b->mtx);
+    uint32_t slot = XENO_BINDLESS_NONE;
+    if (b->free_count) slot = b->free_slots[--b->free_count];
+    else if (b->top < b->capacity) slot = b->top++;
+    if (slot == XENO_BINDLESS_NONE) {
+        b->full++;
+        pthread_mutex_unlock(&b->mtx);
+        XENO_LOGW_RL(1, "bindless: all %u slots taken", b->capacity);
+        return XENO_BINDLESS_NONE;
+    }
+    uint32_t used = b->top - b->free_count - b->retired_count;
+    if (used > b->peak) b->peak = used;
+    VkDescriptorImageInfo ii = { sampler, view, layout };
+    VkWriteDescriptorSet w = {
+        .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET, .dstSet = b->set, .dstBinding = 0,
+        .dstArrayElement = slot, .descriptorCount = 1,
+        .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, .pImageInfo = &ii,
+    };
+    d->UpdateDescriptorSets(d->device, 1, &w, 0, NULL);
+    pthread_mutex_unlock(&b->mtx);
+    XENO_TRACE_COUNTER("bindless.slots", (int64_t)used);
+    return slot;
+}
+
+void xeno_bindless_free(XenoDeviceDispatch* d, uint32_t index)
+{
+    XenoBindless* b = d->bindless;
+    if (!b || index >= b->capacity) return;
+    pthread_mutex_lock(&b->mtx);
+    /* The descriptor stays as written; partially bound lets nothing read
+       it until the slot is written again. */
+    if (b->retired_count < b->capacity) {
+        Retired* r = &b->retired[(b->retired_head + b->retired_count++) % b->capacity];
+        r->slot = index;
+        r->frame = b->frame;
+    }
+    pthread_mutex_unlock(&b->mtx);
+}
+
+VkDescriptorSetLayout xeno_bindless_layout(const XenoDeviceDispatch* d)
+{
+    return d->bindless ? d->bindless->layout : VK_NULL_HANDLE;
+}
+
+void xeno_bindless_bind(const XenoDeviceDispatch* d, VkCommandBuffer cmd, VkPipelineBindPoint bind_point,
+                        VkPipelineLayout layout, uint32_t set)
+{
+    if (d->bindless) d->CmdBindDescriptorSets(cmd, bind_point, layout, set, 1, &d->bindless->set, 0, NULL);
+}
+
+void xeno_bindless_frame(XenoDeviceDispatch* d)
+{
+    XenoBindless* b = d->bindless;
+    if (!b) return;
+    pthread_mutex_lock(&b->mtx);
+    b->frame++;
+    while (b->retired_count && b->frame - b->retired[b->retired_head].frame >= XENO_BINDLESS_RETIRE_FRAMES) {
+        b->free_slots[b->free_count++] = b->retired[b->retired_head].slot;
+        b->retired_head = (b->retired_head + 1u) % b->capacity;
+        b->retired_count--;
+    }
+    pthread_mutex_unlock(&b->mtx);
+}
@@ -0,0 +1,64 @@
+// src/bindless.h
+#pragma once
+
+#include <stdint.h>
+#include <vulkan/vulkan.h>
+#include "xeno_dispatch.h"
+
+/*
+  Bindless texture heap (bindless.c).
+
+  One descriptor set per device, created once: binding 0 is an
+  UPDATE_AFTER_BIND | PARTIALLY_BOUND array of combined image samplers
+  with perf_conf bindless_slots entries (capped by the driver's
+  update-after-bind limits). Layer-owned textures take a slot when they
+  are created and keep its index for their lifetime; layer passes bind the
+  set once and pick the texture with a push constant instead of
+  allocating, writing and binding a set per texture.
+
+  Shaders declare the heap as
+
+      layout(set = N, binding = 0) uniform sampler2D xenoHeap[];
+
+  with GL_EXT_nonuniform_qualifier, and add xeno_bindless_layout() at set
+  N of their pipeline layout.
+
+  Slots come from a free list. A freed slot may still be read by frames in
+  flight, so it only becomes reusable XENO_BINDLESS_RETIRE_FRAMES presents
+  later. Writes to slots nothing in flight reads are allowed while the set
+  is bound (update-after-bind), so allocation never waits on the GPU.
+*/
+
+#define XENO_BINDLESS_NONE UINT32_MAX
+#define XENO_BINDLESS_RETIRE_FRAMES 4u
+
+typedef struct XenoBindless XenoBindless;
+
+/* vkCreateDevice, before the device exists: the heap size the device can
+   have, 0 = none. When the app chains no descriptor-indexing features,
+   *add is filled with the ones the heap needs and must be chained into
+   the create info (add->sType is 0 otherwise). Below Vulkan 1.2 (the
+   lower of the app's and the device's version) they come from
+   VK_EXT_descriptor_indexing: *add_ext is then that name if the app did
+   not enable it, to be added to the enabled extensions. */
+uint32_t xeno_bindless_device_supported(const XenoInstanceDispatch* inst, VkPhysicalDevice physical,
+                                        const VkDeviceCreateInfo* app_ci,
+                                        VkPhysicalDeviceDescriptorIndexingFeatures* add, const char** add_ext);
+/* Sets d->bindless; stays NULL if the set cannot be created. */
+void xeno_bindless_device_init(XenoDeviceDispatch* d, uint32_t slots);
+/* The device is idle. */
+void xeno_bindless_device_destroy(XenoDeviceDispatch* d);
+
+/* Writes the texture into a free slot and returns its index, or
+   XENO_BINDLESS_NONE without a heap or with every slot taken. */
+uint32_t xeno_bindless_alloc(XenoDeviceDispatch* d, VkImageView view, VkSampler sampler, VkImageLayout layout);
+/* The slot is reused once frames recorded before this call are done. */
+void xeno_bindless_free(XenoDeviceDispatch* d, uint32_t index);
+
+/* For pipeline layouts; VK_NULL_HANDLE without a heap. */
+VkDescriptorSetLayout xeno_bindless_layout(const XenoDeviceDispatch* d);
+void xeno_bindless_bind(const XenoDeviceDispatch* d, VkCommandBuffer cmd, VkPipelineBindPoint bind_point,
+                        VkPipelineLayout layout, uint32_t set);
+
+/* Per present: retired slots age towards reuse. */
+void xeno_bindless_frame(XenoDeviceDispatch* d);
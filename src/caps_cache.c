@@ -0,0 +1,373 @@
+// src/caps_cache.c
+/*
+  Physical-device capability snapshots (see caps_cache.h).
+
+  DXVK/VKD3D enumerate extensions and query features many times during
+  startup; each of those used to reach the driver twice. The first query
+  for a device now builds a snapshot and every later one is a table scan
+  plus a memcpy. What goes to disk is the raw driver data (extensions and
+  unpatched features), so changing the virtual-extension list or the
+  feature patches never needs a cache invalidation: both are reapplied on
+  load.
+*/
+#include "caps_cache.h"
+#include "perf_conf.h"
+#include "xeno_log.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#define XENO_CAPS_MAX_DEVICES   16
+#define XENO_CAPS_FILE_MAGIC    0x50414358u  /* "XCAP" */
+#define XENO_CAPS_FILE_VERSION  1u
+
+typedef struct XenoCapsFileHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t features_size;     /* sizeof(XenoCapsFeatures) of the writer */
+    uint32_t ext_size;          /* sizeof(VkExtensionProperties) of the writer */
+    uint32_t vendor_id;
+    uint32_t device_id;
+    uint32_t driver_version;
+    uint32_t ext_count;
+    uint8_t  uuid[VK_UUID_SIZE];
+    uint64_t checksum;          /* FNV-1a over everything after the header */
+} XenoCapsFileHeader;
+
+/* Extensions we advertise on top of the driver's. */
+static const char* const k_virtual_exts[] = {
+    VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME,
+    VK_EXT_ROBUSTNESS_2_EXTENSION_NAME,
+    VK_KHR_SHADER_FLOAT16_INT8_EXTENSION_NAME,
+    // Consider advertising dynamic rendering if DXVK needs it and it is safe to emulate
+    VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME,
+    // Additional compatibility extensions
+    VK_EXT_CUSTOM_BORDER_COLOR_EXTENSION_NAME,
+    VK_EXT_PRIMITIVE_TOPOLOGY_LIST_RESTART_EXTENSION_NAME,
+};
+#define XENO_CAPS_VIRTUAL_COUNT (sizeof(k_virtual_exts) / sizeof(k_virtual_exts[0]))
+
+static _Atomic(XenoCapsSnapshot*) g_snapshots[XENO_CAPS_MAX_DEVICES];
+static pthread_mutex_t g_build_mtx = PTHREAD_MUTEX_INITIALIZER;
+static char g_cache_dir[512];
+
+void xeno_caps_set_cache_dir(const char* dir) {
+    pthread_mutex_lock(&g_build_mtx);
+    snprintf(g_cache_dir, sizeof(g_cache_dir), "%s", dir ? dir : "");
+    pthread_mutex_unlock(&g_build_mtx);
+}
+
+static const char* caps_cache_dir(void) {
+    if (!g_cache_dir[0]) {
+        XenoPerfConf defaults;
+        xeno_perf_conf_defaults(&defaults);
+        snprintf(g_cache_dir, sizeof(g_cache_dir), "%s", defaults.shader_cache_dir);
+    }
+    return g_cache_dir;
+}
+
+static uint64_t fnv1a64(uint64_t h, const void* data, size_t len) {
+    const uint8_t* p = (const uint8_t*)data;
+    for (size_t i = 0; i < len; ++i) {
+        h ^= p[i];
+        h *= 0x100000001b3ull;
+    }
+    return h;
+}
+
+static void caps_file_path(char* out, size_t cap, const VkPhysicalDeviceProperties* props) {
+    char uuid[2 * VK_UUID_SIZE + 1];
+    for (unsigned i = 0; i < VK_UUID_SIZE; ++i) snprintf(uuid + 2 * i, 3, "%02x", props->pipelineCacheUUID[i]);
+    snprintf(out, cap, "%.511s/caps-%s-%08x.bin", caps_cache_dir(), uuid, props->driverVersion);
+}
+
+/* ---------------------------------------------------------------- */
+/* Driver probing                                                    */
+/* ---------------------------------------------------------------- */
+
+static int ext_in_list(const char* name, const VkExtensionProperties* props, uint32_t count) {
+    for (uint32_t i = 0; i < count; ++i) {
+        if (strcmp(props[i].extensionName, name) == 0) return 1;
+    }
+    return 0;
+}
+
+static VkExtensionProperties* query_driver_extensions(VkPhysicalDevice phys,
+                                                      PFN_vkEnumerateDeviceExtensionProperties enum_ext,
+                                                      uint32_t* out_count) {
+    /* The count can change between the two calls on some drivers; retry on VK_INCOMPLETE. */
+    for (int attempt = 0; attempt < 4; ++attempt) {
+        uint32_t count = 0;
+        if (enum_ext(phys, NULL, &count, NULL) != VK_SUCCESS) return NULL;
+        VkExtensionProperties* props = (VkExtensionProperties*)calloc(count ? count : 1, sizeof(*props));
+        if (!props) return NULL;
+        VkResult r = enum_ext(phys, NULL, &count, props);
+        if (r == VK_SUCCESS) {
+            *out_count = count;
+            return props;
+        }
+        free(props);
+        if (r != VK_INCOMPLETE) return NULL;
+    }
+    return NULL;
+}
+
+/* Chains only the structs the driver can legally fill; the rest stay zero
+   and get their values from the patch step. */
+static void query_driver_features(VkPhysicalDevice phys, PFN_vkGetPhysicalDeviceFeatures2 get_features2,
+                                  const VkExtensionProperties* exts, uint32_t ext_count,
+                                  XenoCapsFeatures* out) {
+    memset(out, 0, sizeof(*out));
+    out->descriptor_indexing.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES;
+    out->robustness2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ROBUSTNESS_2_FEATURES_EXT;
+    out->float16_int8.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FLOAT16_INT8_FEATURES_KHR;
+    out->dynamic_rendering.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DYNAMIC_RENDERING_FEATURES;
+    out->custom_border_color.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_CUSTOM_BORDER_COLOR_FEATURES_EXT;
+    out->topology_list_restart.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRIMITIVE_TOPOLOGY_LIST_RESTART_FEATURES_EXT;
+
+    if (!get_features2) return;
+
+    struct { const char* ext; VkBaseOutStructure* s; } chain[] = {
+        { VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME,             (VkBaseOutStructure*)&out->descriptor_indexing },
+        { VK_EXT_ROBUSTNESS_2_EXTENSION_NAME,                    (VkBaseOutStructure*)&out->robustness2 },
+        { VK_KHR_SHADER_FLOAT16_INT8_EXTENSION_NAME,             (VkBaseOutStructure*)&out->float16_int8 },
+        { VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME,               (VkBaseOutStructure*)&out->dynamic_rendering },
+        { VK_EXT_CUSTOM_BORDER_COLOR_EXTENSION_NAME,             (VkBaseOutStructure*)&out->custom_border_color },
+        { VK_EXT_PRIMITIVE_TOPOLOGY_LIST_RESTART_EXTENSION_NAME, (VkBaseOutStructure*)&out->topology_list_restart },
+    };
+
+    VkPhysicalDeviceFeatures2 f2;
+    memset(&f2, 0, sizeof(f2));
+    f2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    VkBaseOutStructure* tail = (VkBaseOutStructure*)&f2;
+    for (size_t i = 0; i < sizeof(chain) / sizeof(chain[0]); ++i) {
+        if (!ext_in_list(chain[i].ext, exts, ext_count)) continue;
+        tail->pNext = chain[i].s;
+        tail = chain[i].s;
+    }
+    get_features2(phys, &f2);
+    out->core = f2.features;
+
+    for (size_t i = 0; i < sizeof(chain) / sizeof(chain[0]); ++i) chain[i].s->pNext = NULL;
+}
+
+static void patch_features(XenoCapsFeatures* f) {
+    // enable conservative subset by default
+    f->descriptor_indexing.shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
+    f->descriptor_indexing.descriptorBindingPartiallyBound = VK_TRUE;
+    f->descriptor_indexing.runtimeDescriptorArray = VK_TRUE;
+    f->robustness2.robustBufferAccess2 = VK_TRUE;
+    f->robustness2.robustImageAccess2 = VK_TRUE;
+    f->float16_int8.shaderFloat16 = VK_TRUE;
+    f->float16_int8.shaderInt8 = VK_TRUE;
+    f->dynamic_rendering.dynamicRendering = VK_TRUE;
+    f->custom_border_color.customBorderColors = VK_TRUE;
+    f->custom_border_color.customBorderColorWithoutFormat = VK_TRUE;
+    f->topology_list_restart.primitiveTopologyListRestart = VK_TRUE;
+    f->topology_list_restart.primitiveTopologyPatchListRestart = VK_TRUE;
+}
+
+/* ---------------------------------------------------------------- */
+/* Persistence                                                       */
+/* ---------------------------------------------------------------- */
+
+static int caps_load(const VkPhysicalDeviceProperties* props, VkExtensionProperties** out_exts,
+                     uint32_t* out_count, XenoCapsFeatures* out_features) {
+    char path[640];
+    caps_file_path(path, sizeof(path), props);
+    FILE* f = fopen(path, "rb");
+    if (!f) return 0;
+
+    XenoCapsFileHeader h;
+    int ok = fread(&h, sizeof(h), 1, f) == 1 &&
+             h.magic == XENO_CAPS_FILE_MAGIC && h.version == XENO_CAPS_FILE_VERSION &&
+             h.features_size == sizeof(XenoCapsFeatures) &&
+             h.ext_size == sizeof(VkExtensionProperties) &&
+             h.vendor_id == props->vendorID && h.device_id == props->deviceID &&
+             h.driver_version == props->driverVersion &&
+             memcmp(h.uuid, props->pipelineCacheUUID, VK_UUID_SIZE) == 0 &&
+             h.ext_count <= 4096;
+    VkExtensionProperties* exts = NULL;
+    if (ok) {
+        exts = (VkExtensionProperties*)calloc(h.ext_count ? h.ext_count : 1, sizeof(*exts));
+        ok = exts &&
+             fread(exts, sizeof(*exts), h.ext_count, f) == h.ext_count &&
+             fread(out_features, sizeof(*out_features), 1, f) == 1;
+    }
+    fclose(f);
+    if (ok) {
+        uint64_t sum = fnv1a64(0xcbf29ce484222325ull, exts, sizeof(*exts) * h.ext_count);
+        sum = fnv1a64(sum, out_features, sizeof(*out_features));
+        ok = sum == h.checksum;
+    }
+    if (!ok) {
+        XENO_LOGD("caps: ignoring stale or corrupt snapshot %s", path);
+        free(exts);
+        return 0;
+    }
+    for (uint32_t i = 0; i < h.ext_count; ++i) exts[i].extensionName[VK_MAX_EXTENSION_NAME_SIZE - 1] = '\0';
+    *out_exts = exts;
+    *out_count = h.ext_count;
+    return 1;
+}
+
+static void caps_store(const VkPhysicalDeviceProperties* props, const VkExtensionProperties* exts,
+                       uint32_t count, const XenoCapsFeatures* features) {
+    char path[640], tmp[660];
+    caps_file_path(path, sizeof(path), props);
+    snprintf(tmp, sizeof(tmp), "%s.%d.tmp", path, (int)getpid());
+
+    XenoCapsFileHeader h;
+    memset(&h, 0, sizeof(h));
+    h.magic = XENO_CAPS_FILE_MAGIC;
+    h.version = XENO_CAPS_FILE_VERSION;
+    h.features_size = sizeof(XenoCapsFeatures);
+    h.ext_size = sizeof(VkExtensionProperties);
+    h.vendor_id = props->vendorID;
+    h.device_id = props->deviceID;
+    h.driver_version = props->driverVersion;
+    h.ext_count = count;
+    memcpy(h.uuid, props->pipelineCacheUUID, VK_UUID_SIZE);
+    h.checksum = fnv1a64(0xcbf29ce484222325ull, exts, sizeof(*exts) * count);
+    h.checksum = fnv1a64(h.checksum, features, sizeof(*features));
+
+    FILE* f = fopen(tmp, "wb");
+    if (!f) {
+        XENO_LOGD("caps: cannot write %s", tmp);
+        return;
+    }
+    int ok = fwrite(&h, sizeof(h), 1, f) == 1 &&
+             fwrite(exts, sizeof(*exts), count, f) == count &&
+             fwrite(features, sizeof(*features), 1, f) == 1;
+    ok = (fclose(f) == 0) && ok;
+    /* rename() keeps concurrent launches from ever seeing a half-written file. */
+    if (!ok || rename(tmp, path) != 0) {
+        unlink(tmp);
+        XENO_LOGD("caps: failed to persist snapshot to %s", path);
+        return;
+    }
+    XENO_LOGD("caps: snapshot saved to %s", path);
+}
+
+/* ---------------------------------------------------------------- */
+/* Snapshot table                                                    */
+/* ---------------------------------------------------------------- */
+
+static const VkExtensionProperties* g_sort_exts;
+
+static int cmp_ext_index(const void* a, const void* b) {
+    return strcmp(g_sort_exts[*(const uint32_t*)a].extensionName,
+                  g_sort_exts[*(const uint32_t*)b].extensionName);
+}
+
+/* Takes ownership of driver_exts. Called with g_build_mtx held. */
+static XenoCapsSnapshot* caps_finish(VkPhysicalDevice phys, VkExtensionProperties* driver_exts,
+                                     uint32_t driver_count, const XenoCapsFeatures* raw, int from_disk) {
+    XenoCapsSnapshot* s = (XenoCapsSnapshot*)calloc(1, sizeof(*s));
+    VkExtensionProperties* exts = (VkExtensionProperties*)realloc(
+        driver_exts, sizeof(*exts) * (driver_count + XENO_CAPS_VIRTUAL_COUNT));
+    uint32_t* sorted = (uint32_t*)malloc(sizeof(uint32_t) * (driver_count + XENO_CAPS_VIRTUAL_COUNT));
+    if (!s || !exts || !sorted) {
+        free(s);
+        free(exts ? exts : driver_exts);
+        free(sorted);
+        return NULL;
+    }
+
+    uint32_t count = driver_count;
+    for (size_t i = 0; i < XENO_CAPS_VIRTUAL_COUNT; ++i) {
+        if (ext_in_list(k_virtual_exts[i], exts, driver_count)) continue;
+        memset(&exts[count], 0, sizeof(exts[count]));
+        snprintf(exts[count].extensionName, VK_MAX_EXTENSION_NAME_SIZE, "%s", k_virtual_exts[i]);
+        exts[count].specVersion = 1;
+        ++count;
+    }
+    for (uint32_t i = 0; i < count; ++i) sorted[i] = i;
+    g_sort_exts = exts;
+    qsort(sorted, count, sizeof(uint32_t), cmp_ext_index);
+    g_sort_exts = NULL;
+
+    s->phys = phys;
+    s->driver_ext_count = driver_count;
+    s->ext_count = count;
+    s->exts = exts;
+    s->sorted = sorted;
+    s->features = *raw;
+    patch_features(&s->features);
+    s->from_disk = from_disk;
+    return s;
+}
+
+static XenoCapsSnapshot* caps_lookup(VkPhysicalDevice phys) {
+    for (int i = 0; i < XENO_CAPS_MAX_DEVICES; ++i) {
+        XenoCapsSnapshot* s = atomic_load_explicit(&g_snapshots[i], memory_order_acquire);
+        if (!s) return NULL;
+        if (s->phys == phys) return s;
+    }
+    return NULL;
+}
+
+const XenoCapsSnapshot* xeno_caps_get(VkPhysicalDevice phys, const XenoCapsProcs* procs) {
+    XenoCapsSnapshot* s = caps_lookup(phys);
+    if (s) return s;
+
+    pthread_mutex_lock(&g_build_mtx);
+    s = caps_lookup(phys);
+    if (s) {
+        pthread_mutex_unlock(&g_build_mtx);
+        return s;
+    }
+
+    VkPhysicalDeviceProperties props;
+    int have_props = procs->get_properties != NULL;
+    if (have_props) procs->get_properties(phys, &props);
+
+    VkExtensionProperties* exts = NULL;
+    uint32_t count = 0;
+    XenoCapsFeatures raw;
+    int from_disk = have_props && caps_load(&props, &exts, &count, &raw);
+    if (!from_disk) {
+        exts = query_driver_extensions(phys, procs->enumerate_extensions, &count);
+        if (!exts) {
+            pthread_mutex_unlock(&g_build_mtx);
+            XENO_LOGE("caps: extension enumeration failed");
+            return NULL;
+        }
+        query_driver_features(phys, procs->get_features2, exts, count, &raw);
+        if (have_props) caps_store(&props, exts, count, &raw);
+    }
+
+    s = caps_finish(phys, exts, count, &raw, from_disk);
+    if (s) {
+        int slot = 0;
+        while (slot < XENO_CAPS_MAX_DEVICES && atomic_load_explicit(&g_snapshots[slot], memory_order_relaxed)) ++slot;
+        if (slot < XENO_CAPS_MAX_DEVICES) {
+            atomic_store_explicit(&g_snapshots[slot], s, memory_order_release);
+        } else {
+            /* Not expected in practice; the snapshot is still returned, just not cached. */
+            XENO_LOGW_RL(1, "caps: snapshot table full, not caching device %p", (void*)phys);
+        }
+        XENO_LOGI("caps: %s snapshot for device %p (%u driver + %u virtual extensions)",
+                  from_disk ? "loaded" : "built", (void*)phys, s->driver_ext_count,
+                  s->ext_count - s->driver_ext_count);
+    }
+    pthread_mutex_unlock(&g_build_mtx);
+    return s;
+}
+
+int xeno_caps_has_extension(const XenoCapsSnapshot* snap, const char* name) {
+    uint32_t lo = 0, hi = snap->ext_count;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        int c = strcmp(snap->exts[snap->sorted[mid]].extensionName, name);
+        if (c == 0) return 1;
+        if (c < 0) lo = mid + 1;
+        else hi = mid;
+    }
+    return 0;
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+/*
+  Per-physical-device capability snapshot (src/caps_cache.c).
+
+  Built on the first query for a VkPhysicalDevice and served from memory
+  afterwards: the driver's extensions merged with our virtual ones, a
+  name-sorted index for lookups, and the feature structs we patch with the
+  patched values already applied. Snapshots are also written to
+  shader_cache_dir keyed by pipelineCacheUUID + driverVersion so the next
+  launch skips the driver probing altogether.
+*/
+
+/* Real (next-in-chain) entrypoints used to build a snapshot. get_properties
+   may be NULL, in which case the snapshot is kept in memory only. */
+typedef struct XenoCapsProcs {
+    PFN_vkEnumerateDeviceExtensionProperties enumerate_extensions;
+    PFN_vkGetPhysicalDeviceFeatures2 get_features2;
+    PFN_vkGetPhysicalDeviceProperties get_properties;
+} XenoCapsProcs;
+
+/* Feature structs we report, stored with pNext == NULL. */
+typedef struct XenoCapsFeatures {
+    VkPhysicalDeviceFeatures core;
+    VkPhysicalDeviceDescriptorIndexingFeatures descriptor_indexing;
+    VkPhysicalDeviceRobustness2FeaturesEXT robustness2;
+    VkPhysicalDeviceFloat16Int8FeaturesKHR float16_int8;
+    VkPhysicalDeviceDynamicRenderingFeatures dynamic_rendering;
+    VkPhysicalDeviceCustomBorderColorFeaturesEXT custom_border_color;
+    VkPhysicalDevicePrimitiveTopologyListRestartFeaturesEXT topology_list_restart;
+} XenoCapsFeatures;
+
+typedef struct XenoCapsSnapshot {
+    VkPhysicalDevice phys;
+    uint32_t driver_ext_count;      /* exts[0..driver_ext_count) come from the driver */
+    uint32_t ext_count;             /* followed by our virtual additions */
+    VkExtensionProperties* exts;
+    uint32_t* sorted;               /* indices into exts ordered by extensionName */
+    XenoCapsFeatures features;      /* patched */
+    int from_disk;
+} XenoCapsSnapshot;
+
+/* Returns the snapshot for phys, building (or loading) it on first use.
+   NULL only on allocation failure. The snapshot lives until process exit. */
+const XenoCapsSnapshot* xeno_caps_get(VkPhysicalDevice phys, const XenoCapsProcs* procs);
+
+/* O(log n) lookup in the merged extension list. */
+int xeno_caps_has_extension(const XenoCapsSnapshot* snap, const char* name);
+
+/* Directory used for persisted snapshots; defaults to the perf_conf default
+   shader_cache_dir. Call before the first xeno_caps_get() to take effect. */
+void xeno_caps_set_cache_dir(const char* dir);
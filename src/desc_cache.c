@@ -0,0 +1,882 @@
+// src/desc_cache.c
+/*
+  Descriptor-set content cache (see desc_cache.h).
+
+  A cached layout numbers its descriptors in binding order, which is also
+  the order writes roll over from one binding into the next. Contents are
+  three words per descriptor (sampler, view, layout / buffer, offset,
+  range / texel buffer view) plus a mask of the descriptors written, and
+  are keyed by their hash in a table per layout.
+
+  Set states: fresh (allocated, nothing written yet), an alias of an
+  entry, or written (the app's own from then on, never looked at again).
+  Sets of cached layouts are listed per pool so resets find them.
+
+  Generations: a 4096-bit filter holds every handle that entries created
+  since the last bump refer to. Destroying a handle that is in it bumps
+  the generation and clears it; entries of older generations leave their
+  table when next found or swept, and are freed once no alias is left.
+
+  Tables work as in rp_cache.c. One mutex guards everything; binds take it
+  only while some alias exists.
+*/
+#include "desc_cache.h"
+#include "perf_conf.h"
+#include "xeno_log.h"
+#include "xeno_trace.h"
+
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#define XENO_DC_MIN_SLOTS 64u
+#define XENO_DC_POOL_SETS 32u           /* layer-owned sets per descriptor pool */
+#define XENO_DC_SWEEP_FRAMES 64u
+#define XENO_DC_FILTER_BITS 4096u
+
+typedef struct EntryMap {
+    uint64_t** slots;
+    uint32_t cap;                           /* power of two */
+    uint32_t count;
+} EntryMap;
+
+typedef struct Binding {
+    uint32_t binding;
+    uint32_t count;
+    uint32_t first;                         /* index of its first descriptor */
+    VkDescriptorType type;
+    int immutable;                          /* samplers come from the layout */
+} Binding;
+
+typedef struct Layout {
+    uint64_t handle;
+    uint32_t refs;                          /* table, sets, entries, templates */
+    struct Layout* next;                    /* every layout alive */
+    uint32_t binding_count;
+    Binding bindings[XENO_DESC_MAX_DESCRIPTORS];
+    uint32_t descriptors;
+    uint8_t binding_of[XENO_DESC_MAX_DESCRIPTORS];
+    VkDescriptorPoolSize sizes[11];         /* per XENO_DC_POOL_SETS sets */
+    uint32_t size_count;
+    VkDescriptorPool* pools;                /* for the layer-owned sets */
+    uint32_t pool_count;
+    EntryMap entries;
+} Layout;
+
+typedef struct Entry {
+    uint64_t key;                           /* content hash, never 0 */
+    Layout* layout;
+    uint64_t generation;
+    uint64_t last_frame;
+    int listed;                             /* in layout->entries */
+    uint32_t refs;                          /* aliases */
+    VkDescriptorSet set;                    /* layer-owned copy, VK_NULL_HANDLE = seen once */
+    VkDescriptorPool pool;
+    uint64_t written;                       /* mask of descriptors */
+    uint64_t words[];
+} Entry;
+
+typedef struct Pool Pool;
+
+typedef struct Set {
+    uint64_t handle;
+    Layout* layout;
+    Pool* pool;
+    struct Set *prev, *next;                /* in pool->sets */
+    Entry* alias;
+    int written;
+} Set;
+
+struct Pool {
+    uint64_t handle;
+    Set* sets;
+};
+
+typedef struct Template {
+    uint64_t handle;
+    Layout* layout;
+    uint32_t count;
+    VkDescriptorUpdateTemplateEntry entries[];
+} Template;
+
+struct XenoDescCache {
+    pthread_mutex_t mtx;
+    EntryMap layouts, sets, pools, templates;
+    Layout* all;
+    uint32_t entry_count;
+    uint64_t generation;
+    uint64_t filter[XENO_DC_FILTER_BITS / 64u];
+    uint64_t frame;
+    atomic_uint aliases;
+    uint64_t skipped, copies, materialized, generations;
+};
+
+static uint32_t handle_slot(uint64_t handle, uint32_t mask)
+{
+    return (uint32_t)((handle * 0x9E3779B97F4A7C15ull) >> 32) & mask;
+}
+
+/* ---- tables (caller holds mtx) ------------------------------------ */
+
+static int entries_grow(EntryMap* m)
+{
+    uint32_t cap = m->cap ? m->cap * 2u : XENO_DC_MIN_SLOTS;
+    uint64_t** slots = (uint64_t**)calloc(cap, sizeof(*slots));
+    if (!slots) return 0;
+    for (uint32_t i = 0; i < m->cap; ++i) {
+        if (!m->slots[i]) continue;
+        uint32_t j = handle_slot(*m->slots[i], cap - 1u);
+        while (slots[j]) j = (j + 1u) & (cap - 1u);
+        slots[j] = m->slots[i];
+    }
+    free(m->slots);
+    m->slots = slots;
+    m->cap = cap;
+    return 1;
+}
+
+static void* entries_find(const EntryMap* m, uint64_t handle)
+{
+    if (!m->cap || !handle) return NULL;
+    uint32_t mask = m->cap - 1u;
+    for (uint32_t i = handle_slot(handle, mask); m->slots[i]; i = (i + 1u) & mask) {
+        if (*m->slots[i] == handle) return m->slots[i];
+    }
+    return NULL;
+}
+
+static void entries_remove_at(EntryMap* m, uint32_t i)
+{
+    uint32_t mask = m->cap - 1u;
+    m->slots[i] = NULL;
+    m->count--;
+    for (uint32_t j = (i + 1u) & mask; m->slots[j]; j = (j + 1u) & mask) {
+        uint32_t home = handle_slot(*m->slots[j], mask);
+        if (((j - home) & mask) >= ((j - i) & mask)) {
+            m->slots[i] = m->slots[j];
+            m->slots[j] = NULL;
+            i = j;
+        }
+    }
+}
+
+/* Unlinks the entry for handle and returns it. */
+static void* entries_take(EntryMap* m, uint64_t handle)
+{
+    if (!m->cap || !handle) return NULL;
+    uint32_t mask = m->cap - 1u;
+    uint32_t i = handle_slot(handle, mask);
+    while (m->slots[i] && *m->slots[i] != handle) i = (i + 1u) & mask;
+    uint64_t* e = m->slots[i];
+    if (e) entries_remove_at(m, i);
+    return e;
+}
+
+static int entries_insert(EntryMap* m, uint64_t* e)
+{
+    if ((m->count + 1u) * 2u > m->cap && !entries_grow(m)) return 0;
+    uint32_t mask = m->cap - 1u;
+    uint32_t i = handle_slot(*e, mask);
+    while (m->slots[i]) i = (i + 1u) & mask;
+    m->slots[i] = e;
+    m->count++;
+    return 1;
+}
+
+/* ---- layouts, entries and sets (caller holds mtx) ----------------- */
+
+static void layout_unref(XenoDeviceDispatch* d, XenoDescCache* c, Layout* l)
+{
+    if (--l->refs) return;
+    for (Layout** p = &c->all; *p; p = &(*p)->next) {
+        if (*p == l) {
+            *p = l->next;
+            break;
+        }
+    }
+    /* Its layer-owned sets go with the pools. */
+    for (uint32_t i = 0; i < l->pool_count; ++i) d->DestroyDescriptorPool(d->device, l->pools[i], NULL);
+    free(l->pools);
+    free(l->entries.slots);
+    free(l);
+}
+
+static void entry_free(XenoDeviceDispatch* d, XenoDescCache* c, Entry* e)
+{
+    if (e->set) d->FreeDescriptorSets(d->device, e->pool, 1, &e->set);
+    c->entry_count--;
+    layout_unref(d, c, e->layout);
+    free(e);
+}
+
+/* Out of the table: no longer matched, freed with its last alias. */
+static void entry_unlist(XenoDeviceDispatch* d, XenoDescCache* c, Entry* e)
+{
+    if (e->listed) entries_take(&e->layout->entries, e->key);
+    e->listed = 0;
+    if (!e->refs) entry_free(d, c, e);
+}
+
+static void unalias(XenoDeviceDispatch* d, XenoDescCache* c, Set* s)
+{
+    Entry* e = s->alias;
+    if (!e) return;
+    s->alias = NULL;
+    atomic_fetch_sub_explicit(&c->aliases, 1u, memory_order_relaxed);
+    if (!--e->refs && !e->listed) entry_free(d, c, e);
+}
+
+static void write_contents(XenoDeviceDispatch* d, const Layout* l, VkDescriptorSet set, const Entry* e)
+{
+    VkWriteDescriptorSet w[XENO_DESC_MAX_DESCRIPTORS];
+    VkDescriptorImageInfo ii[XENO_DESC_MAX_DESCRIPTORS];
+    VkDescriptorBufferInfo bi[XENO_DESC_MAX_DESCRIPTORS];
+    VkBufferView tv[XENO_DESC_MAX_DESCRIPTORS];
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < l->descriptors; ++i) {
+        if (!(e->written >> i & 1u)) continue;
+        const Binding* b = &l->bindings[l->binding_of[i]];
+        const uint64_t* v = &e->words[i * 3u];
+        ii[i] = (VkDescriptorImageInfo){ (VkSampler)v[0], (VkImageView)v[1], (VkImageLayout)v[2] };
+        bi[i] = (VkDescriptorBufferInfo){ (VkBuffer)v[0], v[1], v[2] };
+        tv[i] = (VkBufferView)v[0];
+        /* Runs of consecutive descriptors of one binding are one write. */
+        if (n && w[n - 1].dstBinding == b->binding &&
+            w[n - 1].dstArrayElement + w[n - 1].descriptorCount == i - b->first) {
+            w[n - 1].descriptorCount++;
+            continue;
+        }
+        w[n++] = (VkWriteDescriptorSet){
+            .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET, .dstSet = set, .dstBinding = b->binding,
+            .dstArrayElement = i - b->first, .descriptorCount = 1, .descriptorType = b->type,
+            .pImageInfo = &ii[i], .pBufferInfo = &bi[i], .pTexelBufferView = &tv[i],
+        };
+    }
+    if (n) d->UpdateDescriptorSets(d->device, n, w, 0, NULL);
+}
+
+/* The app's set gets the contents it stands for, and is its own again. */
+static void materialize(XenoDeviceDispatch* d, XenoDescCache* c, Set* s)
+{
+    write_contents(d, s->layout, (VkDescriptorSet)s->handle, s->alias);
+    unalias(d, c, s);
+    s->written = 1;
+    c->materialized++;
+}
+
+/* Anything but a first write: the set is the app's from now on. */
+static void set_taken(XenoDeviceDispatch* d, XenoDescCache* c, Set* s)
+{
+    if (!s || s->written) return;
+    if (s->alias) materialize(d, c, s);
+    s->written = 1;
+}
+
+static void set_release(XenoDeviceDispatch* d, XenoDescCache* c, Set* s)
+{
+    if (s->prev) s->prev->next = s->next;
+    else s->pool->sets = s->next;
+    if (s->next) s->next->prev = s->prev;
+    unalias(d, c, s);
+    entries_take(&c->sets, s->handle);
+    layout_unref(d, c, s->layout);
+    free(s);
+}
+
+static int create_pool(XenoDeviceDispatch* d, Layout* l)
+{
+    VkDescriptorPool* pools = (VkDescriptorPool*)realloc(l->pools, sizeof(*pools) * (l->pool_count + 1u));
+    if (!pools) return 0;
+    l->pools = pools;
+    VkDescriptorPoolCreateInfo pci = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+        .flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT,
+        .maxSets = XENO_DC_POOL_SETS, .poolSizeCount = l->size_count, .pPoolSizes = l->sizes,
+    };
+    if (d->CreateDescriptorPool(d->device, &pci, NULL, &l->pools[l->pool_count]) != VK_SUCCESS) return 0;
+    l->pool_count++;
+    return 1;
+}
+
+/* Seen a second time: the contents get a set of their own. */
+static int make_set(XenoDeviceDispatch* d, Entry* e)
+{
+    Layout* l = e->layout;
+    VkDescriptorSetLayout layout = (VkDescriptorSetLayout)l->handle;
+    if (!l->handle) return 0;               /* the app destroyed the layout */
+    VkDescriptorSetAllocateInfo ai = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO, .descriptorSetCount = 1, .pSetLayouts = &layout,
+    };
+    VkResult r = VK_ERROR_OUT_OF_POOL_MEMORY;
+    if (l->pool_count) {
+        ai.descriptorPool = l->pools[l->pool_count - 1u];
+        r = d->AllocateDescriptorSets(d->device, &ai, &e->set);
+    }
+    if (r != VK_SUCCESS && create_pool(d, l)) {
+        ai.descriptorPool = l->pools[l->pool_count - 1u];
+        r = d->AllocateDescriptorSets(d->device, &ai, &e->set);
+    }
+    if (r != VK_SUCCESS) {
+        e->set = VK_NULL_HANDLE;
+        return 0;
+    }
+    e->pool = ai.descriptorPool;
+    write_contents(d, l, e->set, e);
+    return 1;
+}
+
+static void filter_add(XenoDescCache* c, uint64_t handle)
+{
+    if (!handle) return;
+    uint32_t bit = handle_slot(handle, XENO_DC_FILTER_BITS - 1u);
+    c->filter[bit / 64u] |= 1ull << (bit % 64u);
+}
+
+/* ---- capturing contents ------------------------------------------- */
+
+static const Binding* find_binding(const Layout* l, uint32_t binding)
+{
+    for (uint32_t i = 0; i < l->binding_count; ++i) {
+        if (l->bindings[i].binding == binding) return &l->bindings[i];
+    }
+    return NULL;
+}
+
+/* Stores descriptor `i` of the layout from an info of the API; 0 if the
+   type does not match. */
+static int capture_one(const Layout* l, uint32_t i, VkDescriptorType type, const void* info, uint64_t* words,
+                       uint64_t* written)
+{
+    if (i >= l->descriptors) return 0;
+    const Binding* b = &l->bindings[l->binding_of[i]];
+    if (b->type != type) return 0;
+    uint64_t* v = &words[i * 3u];
+    switch (type) {
+    case VK_DESCRIPTOR_TYPE_SAMPLER:
+    case VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER:
+    case VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE:
+    case VK_DESCRIPTOR_TYPE_STORAGE_IMAGE:
+    case VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT: {
+        const VkDescriptorImageInfo* ii = (const VkDescriptorImageInfo*)info;
+        int sampler = type == VK_DESCRIPTOR_TYPE_SAMPLER || type == VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        v[0] = sampler && !b->immutable ? (uint64_t)ii->sampler : 0;
+        v[1] = type != VK_DESCRIPTOR_TYPE_SAMPLER ? (uint64_t)ii->imageView : 0;
+        v[2] = type != VK_DESCRIPTOR_TYPE_SAMPLER ? (uint64_t)ii->imageLayout : 0;
+        break;
+    }
+    case VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER:
+    case VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER:
+        v[0] = (uint64_t)*(const VkBufferView*)info;
+        v[1] = v[2] = 0;
+        break;
+    default: {
+        const VkDescriptorBufferInfo* bi = (const VkDescriptorBufferInfo*)info;
+        v[0] = (uint64_t)bi->buffer;
+        v[1] = bi->offset;
+        v[2] = bi->range;
+        break;
+    }
+    }
+    *written |= 1ull << i;
+    return 1;
+}
+
+static int capture_write(const Layout* l, const VkWriteDescriptorSet* w, uint64_t* words, uint64_t* written)
+{
+    const Binding* b = find_binding(l, w->dstBinding);
+    if (w->pNext || !b || w->dstArrayElement >= b->count) return 0;
+    uint32_t first = b->first + w->dstArrayElement;
+    for (uint32_t i = 0; i < w->descriptorCount; ++i) {
+        const void* info;
+        switch (w->descriptorType) {
+        case VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER:
+        case VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER: info = &w->pTexelBufferView[i]; break;
+        case VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER:
+        case VK_DESCRIPTOR_TYPE_STORAGE_BUFFER:
+        case VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC:
+        case VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC: info = &w->pBufferInfo[i]; break;
+        default: info = &w->pImageInfo[i]; break;
+        }
+        if (!capture_one(l, first + i, w->descriptorType, info, words, written)) return 0;
+    }
+    return 1;
+}
+
+static int capture_template(const Layout* l, const Template* t, const void* data, uint64_t* words,
+                            uint64_t* written)
+{
+    for (uint32_t k = 0; k < t->count; ++k) {
+        const VkDescriptorUpdateTemplateEntry* te = &t->entries[k];
+        const Binding* b = find_binding(l, te->dstBinding);
+        if (!b || te->dstArrayElement >= b->count) return 0;
+        uint32_t first = b->first + te->dstArrayElement;
+        for (uint32_t i = 0; i < te->descriptorCount; ++i) {
+            const void* info = (const char*)data + te->offset + te->stride * i;
+            if (!capture_one(l, first + i, te->descriptorType, info, words, written)) return 0;
+        }
+    }
+    return 1;
+}
+
+static uint64_t contents_hash(const Layout* l, const uint64_t* words, uint64_t written)
+{
+    uint64_t h = written * 0x9E3779B97F4A7C15ull;
+    for (uint32_t i = 0; i < l->descriptors; ++i) {
+        if (!(written >> i & 1u)) continue;
+        for (uint32_t k = 0; k < 3u; ++k) {
+            h ^= words[i * 3u + k];
+            h *= 0x100000001B3ull;
+            h ^= h >> 29;
+        }
+    }
+    return h | 1u;
+}
+
+/* First write of a fresh set: returns 1 when the set became an alias and
+   the write must not reach the driver. */
+static int first_write(XenoDeviceDispatch* d, XenoDescCache* c, Set* s, const uint64_t* words, uint64_t written)
+{
+    Layout* l = s->layout;
+    s->written = 1;
+    if (!written) return 0;
+    uint64_t key = contents_hash(l, words, written);
+    Entry* e = (Entry*)entries_find(&l->entries, key);
+    if (e && e->generation != c->generation) {
+        entry_unlist(d, c, e);
+        e = NULL;
+    }
+    if (e) {
+        if (e->written != written || memcmp(e->words, words, sizeof(*words) * 3u * l->descriptors) != 0) return 0;
+        e->last_frame = c->frame;
+        if (!e->set && !make_set(d, e)) return 0;
+        s->written = 0;
+        s->alias = e;
+        e->refs++;
+        atomic_fetch_add_explicit(&c->aliases, 1u, memory_order_relaxed);
+        c->skipped++;
+        return 1;
+    }
+    if (c->entry_count >= XENO_DESC_MAX_ENTRIES) return 0;
+    e = (Entry*)calloc(1, sizeof(*e) + sizeof(*words) * 3u * l->descriptors);
+    if (!e) return 0;
+    e->key = key;
+    e->layout = l;
+    e->generation = c->generation;
+    e->last_frame = c->frame;
+    e->written = written;
+    memcpy(e->words, words, sizeof(*words) * 3u * l->descriptors);
+    if (!entries_insert(&l->entries, &e->key)) {
+        free(e);
+        return 0;
+    }
+    e->listed = 1;
+    l->refs++;
+    c->entry_count++;
+    for (uint32_t i = 0; i < l->descriptors; ++i) {
+        if (!(written >> i & 1u)) continue;
+        filter_add(c, words[i * 3u]);
+        if (l->bindings[l->binding_of[i]].type <= VK_DESCRIPTOR_TYPE_STORAGE_IMAGE ||
+            l->bindings[l->binding_of[i]].type == VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT) {
+            filter_add(c, words[i * 3u + 1u]);
+        }
+    }
+    return 0;
+}
+
+/* ---- device ------------------------------------------------------- */
+
+void xeno_desc_device_init(XenoDeviceDispatch* d, const VkDeviceCreateInfo* ci)
+{
+    if (!xeno_perf_conf_active()->descriptor_reuse) return;
+    for (uint32_t i = 0; i < ci->enabledExtensionCount; ++i) {
+        if (strcmp(ci->ppEnabledExtensionNames[i], "VK_KHR_maintenance6") == 0) {
+            XENO_LOGI("desc: VK_KHR_maintenance6 enabled, descriptor sets are not cached");
+            return;
+        }
+    }
+    XenoDescCache* c = (XenoDescCache*)calloc(1, sizeof(*c));
+    if (!c) {
+        XENO_LOGW("desc: out of memory, descriptor sets are not cached");
+        return;
+    }
+    pthread_mutex_init(&c->mtx, NULL);
+    c->frame = 1;
+    d->desc = c;
+}
+
+void xeno_desc_device_destroy(XenoDeviceDispatch* d)
+{
+    XenoDescCache* c = d->desc;
+    if (!c) return;
+    d->desc = NULL;
+    XENO_LOGI("desc: %llu set writes skipped, %llu sets materialized, %u contents cached, %llu generations",
+              (unsigned long long)c->skipped, (unsigned long long)c->materialized, c->entry_count,
+              (unsigned long long)c->generations);
+    for (uint32_t i = 0; i < c->sets.cap; ++i) {
+        Set* s = (Set*)c->sets.slots[i];
+        if (!s) continue;
+        /* Entries already out of their table live only through aliases. */
+        if (s->alias && !--s->alias->refs && !s->alias->listed) free(s->alias);
+        free(s);
+    }
+    for (uint32_t i = 0; i < c->pools.cap; ++i) free(c->pools.slots[i]);
+    for (uint32_t i = 0; i < c->templates.cap; ++i) free(c->templates.slots[i]);
+    while (c->all) {
+        Layout* l = c->all;
+        c->all = l->next;
+        for (uint32_t i = 0; i < l->entries.cap; ++i) free(l->entries.slots[i]);
+        for (uint32_t i = 0; i < l->pool_count; ++i) d->DestroyDescriptorPool(d->device, l->pools[i], NULL);
+        free(l->pools);
+        free(l->entries.slots);
+        free(l);
+    }
+    free(c->sets.slots);
+    free(c->pools.slots);
+    free(c->templates.slots);
+    free(c->layouts.slots);
+    pthread_mutex_destroy(&c->mtx);
+    free(c);
+}
+
+static int cacheable_type(VkDescriptorType type)
+{
+    return type >= VK_DESCRIPTOR_TYPE_SAMPLER && type <= VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+}
+
+void xeno_desc_layout_created(XenoDeviceDispatch* d, VkDescriptorSetLayout layout,
+                              const VkDescriptorSetLayoutCreateInfo* ci)
+{
+    XenoDescCache* c = d->desc;
+    if (!c || ci->flags || ci->pNext || !ci->bindingCount || ci->bindingCount > XENO_DESC_MAX_DESCRIPTORS) return;
+    Layout* l = (Layout*)calloc(1, sizeof(*l));
+    if (!l) return;
+    l->handle = (uint64_t)layout;
+    l->refs = 1;
+    /* In binding order; insertion sort, counts are small. */
+    for (uint32_t i = 0; i < ci->bindingCount; ++i) {
+        const VkDescriptorSetLayoutBinding* src = &ci->pBindings[i];
+        if (!cacheable_type(src->descriptorType) || l->descriptors + src->descriptorCount > XENO_DESC_MAX_DESCRIPTORS) {
+            free(l);
+            return;
+        }
+        if (!src->descriptorCount) continue;
+        uint32_t j = l->binding_count++;
+        while (j && l->bindings[j - 1u].binding > src->binding) {
+            l->bindings[j] = l->bindings[j - 1u];
+            --j;
+        }
+        l->bindings[j] = (Binding){
+            .binding = src->binding, .count = src->descriptorCount, .type = src->descriptorType,
+            .immutable = src->pImmutableSamplers != NULL,
+        };
+        l->descriptors += src->descriptorCount;
+    }
+    if (!l->descriptors) {
+        free(l);
+        return;
+    }
+    uint32_t first = 0;
+    for (uint32_t i = 0; i < l->binding_count; ++i) {
+        Binding* b = &l->bindings[i];
+        b->first = first;
+        for (uint32_t k = 0; k < b->count; ++k) l->binding_of[first + k] = (uint8_t)i;
+        first += b->count;
+        uint32_t s = 0;
+        while (s < l->size_count && l->sizes[s].type != b->type) ++s;
+        if (s == l->size_count) l->sizes[l->size_count++] = (VkDescriptorPoolSize){ b->type, 0 };
+        l->sizes[s].descriptorCount += b->count * XENO_DC_POOL_SETS;
+    }
+
+    pthread_mutex_lock(&c->mtx);
+    Layout* old = (Layout*)entries_take(&c->layouts, l->handle);   /* handle reused without a destroy we saw */
+    if (old) {
+        old->handle = 0;
+        layout_unref(d, c, old);
+    }
+    if (entries_insert(&c->layouts, &l->handle)) {
+        l->next = c->all;
+        c->all = l;
+    } else {
+        free(l);
+    }
+    pthread_mutex_unlock(&c->mtx);
+}
+
+void xeno_desc_layout_destroyed(XenoDeviceDispatch* d, VkDescriptorSetLayout layout)
+{
+    XenoDescCache* c = d->desc;
+    if (!c) return;
+    pthread_mutex_lock(&c->mtx);
+    Layout* l = (Layout*)entries_take(&c->layouts, (uint64_t)layout);
+    if (l) {
+        /* Sets keep working; no new layer-owned ones can be made. */
+        l->handle = 0;
+        layout_unref(d, c, l);
+    }
+    pthread_mutex_unlock(&c->mtx);
+}
+
+void xeno_desc_template_created(XenoDeviceDispatch* d, VkDescriptorUpdateTemplate tmpl,
+                                const VkDescriptorUpdateTemplateCreateInfo* ci)
+{
+    XenoDescCache* c = d->desc;
+    if (!c || ci->templateType != VK_DESCRIPTOR_UPDATE_TEMPLATE_TYPE_DESCRIPTOR_SET) return;
+    pthread_mutex_lock(&c->mtx);
+    Layout* l = (Layout*)entries_find(&c->layouts, (uint64_t)ci->descriptorSetLayout);
+    Template* t = l ? (Template*)malloc(sizeof(*t) + sizeof(*t->entries) * ci->descriptorUpdateEntryCount) : NULL;
+    if (t) {
+        t->handle = (uint64_t)tmpl;
+        t->layout = l;
+        t->count = ci->descriptorUpdateEntryCount;
+        memcpy(t->entries, ci->pDescriptorUpdateEntries, sizeof(*t->entries) * t->count);
+        free(entries_take(&c->templates, t->handle));
+        if (entries_insert(&c->templates, &t->handle)) l->refs++;
+        else free(t);
+    }
+    pthread_mutex_unlock(&c->mtx);
+}
+
+void xeno_desc_template_destroyed(XenoDeviceDispatch* d, VkDescriptorUpdateTemplate tmpl)
+{
+    XenoDescCache* c = d->desc;
+    if (!c) return;
+    pthread_mutex_lock(&c->mtx);
+    Template* t = (Template*)entries_take(&c->templates, (uint64_t)tmpl);
+    if (t) {
+        layout_unref(d, c, t->layout);
+        free(t);
+    }
+    pthread_mutex_unlock(&c->mtx);
+}
+
+/* ---- sets --------------------------------------------------------- */
+
+void xeno_desc_sets_allocated(XenoDeviceDispatch* d, const VkDescriptorSetAllocateInfo* info,
+                              const VkDescriptorSet* sets)
+{
+    XenoDescCache* c = d->desc;
+    if (!c || info->pNext) return;
+    pthread_mutex_lock(&c->mtx);
+    Pool* pool = (Pool*)entries_find(&c->pools, (uint64_t)info->descriptorPool);
+    for (uint32_t i = 0; i < info->descriptorSetCount; ++i) {
+        Layout* l = (Layout*)entries_find(&c->layouts, (uint64_t)info->pSetLayouts[i]);
+        if (!l) continue;
+        if (!pool) {
+            pool = (Pool*)calloc(1, sizeof(*pool));
+            if (!pool) break;
+            pool->handle = (uint64_t)info->descriptorPool;
+            if (!entries_insert(&c->pools, &pool->handle)) {
+                free(pool);
+                pool = NULL;
+                break;
+            }
+        }
+        Set* s = (Set*)calloc(1, sizeof(*s));
+        if (!s) break;
+        s->handle = (uint64_t)sets[i];
+        Set* old = (Set*)entries_find(&c->sets, s->handle);
+        if (old) set_release(d, c, old);
+        if (!entries_insert(&c->sets, &s->handle)) {
+            free(s);
+            break;
+        }
+        s->layout = l;
+        l->refs++;
+        s->pool = pool;
+        s->next = pool->sets;
+        if (s->next) s->next->prev = s;
+        pool->sets = s;
+    }
+    pthread_mutex_unlock(&c->mtx);
+}
+
+void xeno_desc_sets_freed(XenoDeviceDispatch* d, uint32_t count, const VkDescriptorSet* sets)
+{
+    XenoDescCache* c = d->desc;
+    if (!c) return;
+    pthread_mutex_lock(&c->mtx);
+    for (uint32_t i = 0; i < count; ++i) {
+        Set* s = (Set*)entries_find(&c->sets, (uint64_t)sets[i]);
+        if (s) set_release(d, c, s);
+    }
+    pthread_mutex_unlock(&c->mtx);
+}
+
+void xeno_desc_pool_reset(XenoDeviceDispatch* d, VkDescriptorPool pool, int destroyed)
+{
+    XenoDescCache* c = d->desc;
+    if (!c) return;
+    pthread_mutex_lock(&c->mtx);
+    Pool* p = (Pool*)(destroyed ? entries_take(&c->pools, (uint64_t)pool) : entries_find(&c->pools, (uint64_t)pool));
+    if (p) {
+        while (p->sets) set_release(d, c, p->sets);
+        if (destroyed) free(p);
+    }
+    pthread_mutex_unlock(&c->mtx);
+}
+
+void xeno_desc_object_destroyed(XenoDeviceDispatch* d, uint64_t handle)
+{
+    XenoDescCache* c = d->desc;
+    if (!c || !handle) return;
+    uint32_t bit = handle_slot(handle, XENO_DC_FILTER_BITS - 1u);
+    pthread_mutex_lock(&c->mtx);
+    if (c->filter[bit / 64u] >> (bit % 64u) & 1u) {
+        c->generation++;
+        c->generations++;
+        memset(c->filter, 0, sizeof(c->filter));
+    }
+    pthread_mutex_unlock(&c->mtx);
+}
+
+/* ---- updates ------------------------------------------------------ */
+
+void xeno_desc_update(XenoDeviceDispatch* d, uint32_t write_count, const VkWriteDescriptorSet* writes,
+                      uint32_t copy_count, const VkCopyDescriptorSet* copies)
+{
+    XenoDescCache* c = d->desc;
+    if (!c || !write_count) {
+        if (c) {
+            pthread_mutex_lock(&c->mtx);
+            for (uint32_t i = 0; i < copy_count; ++i) {
+                set_taken(d, c, (Set*)entries_find(&c->sets, (uint64_t)copies[i].srcSet));
+                set_taken(d, c, (Set*)entries_find(&c->sets, (uint64_t)copies[i].dstSet));
+            }
+            pthread_mutex_unlock(&c->mtx);
+        }
+        d->UpdateDescriptorSets(d->device, write_count, writes, copy_count, copies);
+        return;
+    }
+
+    uint8_t small[XENO_DESC_MAX_DESCRIPTORS];
+    uint8_t* drop = write_count <= XENO_DESC_MAX_DESCRIPTORS ? small : (uint8_t*)malloc(write_count);
+    if (!drop) {
+        d->UpdateDescriptorSets(d->device, write_count, writes, copy_count, copies);
+        return;
+    }
+    memset(drop, 0, write_count);
+    uint32_t dropped = 0;
+
+    pthread_mutex_lock(&c->mtx);
+    /* Copies happen after the writes, so their sets must be real. */
+    for (uint32_t i = 0; i < copy_count; ++i) {
+        set_taken(d, c, (Set*)entries_find(&c->sets, (uint64_t)copies[i].srcSet));
+        set_taken(d, c, (Set*)entries_find(&c->sets, (uint64_t)copies[i].dstSet));
+    }
+    for (uint32_t i = 0; i < write_count; ++i) {
+        if (drop[i]) continue;
+        Set* s = (Set*)entries_find(&c->sets, (uint64_t)writes[i].dstSet);
+        if (!s || s->written) continue;
+        if (s->alias) {
+            set_taken(d, c, s);
+            continue;
+        }
+        /* Every write of this call to a fresh set is its first write. */
+        uint64_t words[XENO_DESC_MAX_DESCRIPTORS * 3u] = { 0 };
+        uint64_t written = 0;
+        int ok = 1;
+        for (uint32_t k = i; k < write_count && ok; ++k) {
+            if (writes[k].dstSet == writes[i].dstSet) ok = capture_write(s->layout, &writes[k], words, &written);
+        }
+        if (!ok || !first_write(d, c, s, words, written)) {
+            s->written = 1;
+            continue;
+        }
+        for (uint32_t k = i; k < write_count; ++k) {
+            if (writes[k].dstSet == writes[i].dstSet) {
+                drop[k] = 1;
+                dropped++;
+            }
+        }
+    }
+    pthread_mutex_unlock(&c->mtx);
+
+    if (!dropped) {
+        d->UpdateDescriptorSets(d->device, write_count, writes, copy_count, copies);
+    } else if (dropped < write_count || copy_count) {
+        VkWriteDescriptorSet kept[XENO_DESC_MAX_DESCRIPTORS];
+        VkWriteDescriptorSet* w = write_count <= XENO_DESC_MAX_DESCRIPTORS
+                                      ? kept : (VkWriteDescriptorSet*)malloc(sizeof(*w) * write_count);
+        if (w) {
+            uint32_t n = 0;
+            for (uint32_t i = 0; i < write_count; ++i) {
+                if (!drop[i]) w[n++] = writes[i];
+            }
+            d->UpdateDescriptorSets(d->device, n, w, copy_count, copies);
+            if (w != kept) free(w);
+        }
+    }
+    XENO_TRACE_COUNTER("desc.skipped", (int64_t)c->skipped);
+    if (drop != small) free(drop);
+}
+
+void xeno_desc_update_with_template(XenoDeviceDispatch* d, VkDescriptorSet set, VkDescriptorUpdateTemplate tmpl,
+                                    const void* data)
+{
+    XenoDescCache* c = d->desc;
+    int skip = 0;
+    if (c) {
+        pthread_mutex_lock(&c->mtx);
+        Set* s = (Set*)entries_find(&c->sets, (uint64_t)set);
+        const Template* t = s && !s->written && !s->alias ? (const Template*)entries_find(&c->templates, (uint64_t)tmpl)
+                                                          : NULL;
+        uint64_t words[XENO_DESC_MAX_DESCRIPTORS * 3u] = { 0 };
+        uint64_t written = 0;
+        if (t && capture_template(s->layout, t, data, words, &written)) skip = first_write(d, c, s, words, written);
+        else set_taken(d, c, s);
+        pthread_mutex_unlock(&c->mtx);
+    }
+    if (!skip) d->UpdateDescriptorSetWithTemplate(d->device, set, tmpl, data);
+}
+
+const VkDescriptorSet* xeno_desc_bind(XenoDeviceDispatch* d, uint32_t count, const VkDescriptorSet* sets,
+                                      VkDescriptorSet* out)
+{
+    XenoDescCache* c = d->desc;
+    if (!c || !atomic_load_explicit(&c->aliases, memory_order_relaxed)) return sets;
+    const VkDescriptorSet* result = sets;
+    pthread_mutex_lock(&c->mtx);
+    for (uint32_t i = 0; i < count; ++i) {
+        Set* s = (Set*)entries_find(&c->sets, (uint64_t)sets[i]);
+        if (!s || !s->alias) continue;
+        if (count > XENO_DESC_MAX_BIND) {
+            set_taken(d, c, s);
+            continue;
+        }
+        if (result == sets) {
+            memcpy(out, sets, sizeof(*sets) * count);
+            result = out;
+        }
+        out[i] = s->alias->set;
+    }
+    pthread_mutex_unlock(&c->mtx);
+    return result;
+}
+
+void xeno_desc_frame(XenoDeviceDispatch* d)
+{
+    XenoDescCache* c = d->desc;
+    if (!c) return;
+    pthread_mutex_lock(&c->mtx);
+    if (++c->frame % XENO_DC_SWEEP_FRAMES == 0) {
+        for (Layout* l = c->all; l;) {
+            l->refs++;                      /* its last entry may hold the last reference */
+            for (uint32_t i = 0; i < l->entries.cap;) {
+                Entry* e = (Entry*)l->entries.slots[i];
+                if (!e || (e->generation == c->generation && e->last_frame + XENO_DESC_IDLE_FRAMES > c->frame)) {
+                    ++i;
+                    continue;
+                }
+                /* Removing shifts a later entry into slot i; look at it again. */
+                entries_remove_at(&l->entries, i);
+                e->listed = 0;
+                if (!e->refs) entry_free(d, c, e);
+            }
+            Layout* next = l->next;
+            layout_unref(d, c, l);
+            l = next;
+        }
+    }
+    pthread_mutex_unlock(&c->mtx);
+}
@@ -0,0 +1,73 @@
+// src/desc_cache.h
+#pragma once
+
+#include <stdint.h>
+#include <vulkan/vulkan.h>
+#include "xeno_dispatch.h"
+
+/*
+  Descriptor-set content cache (desc_cache.c).
+
+  Translation layers write the same descriptors into freshly allocated
+  sets every frame. The first writes into a fresh set are hashed; when a
+  set with the same layout and contents was written before, the writes
+  are dropped and the app's set becomes an alias of a layer-owned set
+  holding those contents, which vkCmdBindDescriptorSets binds instead.
+  The layer-owned set is written once, the second time some contents are
+  seen; contents seen only once cost nothing but the hash.
+
+  An alias never reaches the driver with its own handle, so it is safe to
+  write it for real whenever the app does anything else with it: more
+  writes, copies, or a bind too large to rewrite. That write of the cached
+  contents is called materializing; afterwards the set is the app's
+  again.
+
+  Only layouts without flags or pNext, of at most XENO_DESC_MAX_DESCRIPTORS
+  plain descriptors (no inline uniform blocks or acceleration structures),
+  are cached. Destroying a view, buffer, buffer view or sampler that cached
+  contents may refer to starts a new generation: older contents are no
+  longer matched, so a recycled handle never hits them. Devices with
+  VK_KHR_maintenance6 get no cache (vkCmdBindDescriptorSets2 is not
+  intercepted).
+*/
+
+#define XENO_DESC_MAX_DESCRIPTORS 64u   /* per cached layout */
+#define XENO_DESC_MAX_BIND 32u          /* sets per vkCmdBindDescriptorSets rewritten */
+#define XENO_DESC_MAX_ENTRIES 8192u     /* cached contents per device */
+#define XENO_DESC_IDLE_FRAMES 256u      /* unused contents are dropped after this many presents */
+
+typedef struct XenoDescCache XenoDescCache;
+
+/* Sets d->desc unless perf_conf descriptor_reuse=0. */
+void xeno_desc_device_init(XenoDeviceDispatch* d, const VkDeviceCreateInfo* ci);
+/* Logs the savings and frees the layer-owned sets; the device is idle. */
+void xeno_desc_device_destroy(XenoDeviceDispatch* d);
+
+void xeno_desc_layout_created(XenoDeviceDispatch* d, VkDescriptorSetLayout layout,
+                              const VkDescriptorSetLayoutCreateInfo* ci);
+void xeno_desc_layout_destroyed(XenoDeviceDispatch* d, VkDescriptorSetLayout layout);
+void xeno_desc_template_created(XenoDeviceDispatch* d, VkDescriptorUpdateTemplate tmpl,
+                                const VkDescriptorUpdateTemplateCreateInfo* ci);
+void xeno_desc_template_destroyed(XenoDeviceDispatch* d, VkDescriptorUpdateTemplate tmpl);
+
+void xeno_desc_sets_allocated(XenoDeviceDispatch* d, const VkDescriptorSetAllocateInfo* info,
+                              const VkDescriptorSet* sets);
+void xeno_desc_sets_freed(XenoDeviceDispatch* d, uint32_t count, const VkDescriptorSet* sets);
+/* vkResetDescriptorPool and vkDestroyDescriptorPool. */
+void xeno_desc_pool_reset(XenoDeviceDispatch* d, VkDescriptorPool pool, int destroyed);
+/* A view, buffer, buffer view or sampler is about to be destroyed. */
+void xeno_desc_object_destroyed(XenoDeviceDispatch* d, uint64_t handle);
+
+/* Record the update on the driver, minus writes the cache takes over. */
+void xeno_desc_update(XenoDeviceDispatch* d, uint32_t write_count, const VkWriteDescriptorSet* writes,
+                      uint32_t copy_count, const VkCopyDescriptorSet* copies);
+void xeno_desc_update_with_template(XenoDeviceDispatch* d, VkDescriptorSet set, VkDescriptorUpdateTemplate tmpl,
+                                    const void* data);
+
+/* The sets to bind: `sets` itself, or `out` (room for XENO_DESC_MAX_BIND)
+   with aliases replaced by the sets they stand for. */
+const VkDescriptorSet* xeno_desc_bind(XenoDeviceDispatch* d, uint32_t count, const VkDescriptorSet* sets,
+                                      VkDescriptorSet* out);
+
+/* Per present: drops contents nothing has used for a while. */
+void xeno_desc_frame(XenoDeviceDispatch* d);
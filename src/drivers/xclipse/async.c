@@ -1,18 +1,472 @@
 /*
   src/drivers/xclipse/async.c
-  Async helpers for Xclipse 940.
+  Submit workers for Xclipse 940 (see async.h).
+
+  Each queue owns a bounded ring with one sequence number per slot:
+  producers claim a position with a CAS on tail and publish it by bumping
+  the slot's sequence, the worker is the only consumer. Ring positions
+  double as tickets between queues. An item that waits on semaphores
+  records every other queue's tail when it is pushed and is not handed to
+  the driver before those queues have retired that far, so a binary
+  semaphore's signal always reaches the driver before its wait even though
+  each queue has its own thread.
+
+  The worker only ever blocks on the host side (empty ring, cross-queue
+  order), so a batch waiting for a host-signalled timeline semaphore
+  cannot stall a drain.
 */
-#include "logging.h"
+#include <vulkan/vulkan.h>
+#include "xeno_log.h"
+#include "xeno_trace.h"
+#include "xeno_dispatch.h"
+#include "async.h"
+#include "vrs_content.h"
+
 #include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <semaphore.h>
+
+#define XENO_ASYNC_RING 64u
+#define XENO_ASYNC_MAX_QUEUES 16u
+#define XENO_ASYNC_MAX_COALESCE 16u
+
+enum { XENO_ASYNC_SUBMIT, XENO_ASYNC_PRESENT };
+
+/* One malloc: the header, then every array the driver call points into. */
+typedef struct XenoAsyncItem {
+    int kind;
+    uint32_t submit_count;
+    VkSubmitInfo* submits;
+    VkFence fence;
+    VkPresentInfoKHR present;
+    uint32_t dep_count;                       /* 0 = no semaphore waits */
+    uint64_t deps[XENO_ASYNC_MAX_QUEUES];     /* other queues' tails at push time */
+} XenoAsyncItem;
+
+typedef struct XenoAsyncSlot {
+    _Atomic uint64_t seq;
+    XenoAsyncItem* item;
+} XenoAsyncSlot;
+
+typedef struct XenoAsyncQueue {
+    XenoAsyncDevice* dev;
+    VkQueue queue;
+    uint32_t index;
+    XenoAsyncSlot slots[XENO_ASYNC_RING];
+    _Atomic uint64_t tail;
+    _Atomic uint64_t retired;     /* positions below this have reached the driver */
+    sem_t wake;
+    pthread_t thread;
+    _Atomic int stop;
+    _Atomic int submit_status;    /* deferred results, see async.h */
+    _Atomic int present_status;
+
+    /* Worker only. */
+    uint64_t head;
+    VkSubmitInfo* scratch;
+    uint32_t scratch_cap;
+} XenoAsyncQueue;
 
-static _Atomic int async_counter = 0;
+struct XenoAsyncDevice {
+    XenoDeviceDispatch* d;
+    pthread_mutex_t mtx;          /* queue registration and progress waits */
+    pthread_cond_t progress;
+    _Atomic int waiters;
+    XenoAsyncQueue* queues[XENO_ASYNC_MAX_QUEUES];
+    _Atomic uint32_t queue_count;
+};
+
+/* ---- progress waits ------------------------------------------------ */
+
+typedef int (*XenoAsyncPred)(XenoAsyncQueue* q, const void* arg);
+
+/* Waiters register before testing the predicate and workers retire before
+   testing for waiters (both seq_cst), so a wakeup cannot be lost. */
+static void wait_progress(XenoAsyncQueue* q, XenoAsyncPred pred, const void* arg)
+{
+    XenoAsyncDevice* a = q->dev;
+    if (pred(q, arg)) return;
+    XENO_TRACE_SCOPE("async.wait");
+    pthread_mutex_lock(&a->mtx);
+    atomic_fetch_add(&a->waiters, 1);
+    while (!pred(q, arg)) pthread_cond_wait(&a->progress, &a->mtx);
+    atomic_fetch_sub(&a->waiters, 1);
+    pthread_mutex_unlock(&a->mtx);
+}
+
+static void notify_progress(XenoAsyncDevice* a)
+{
+    if (atomic_load(&a->waiters) == 0) return;
+    pthread_mutex_lock(&a->mtx);
+    pthread_cond_broadcast(&a->progress);
+    pthread_mutex_unlock(&a->mtx);
+}
+
+static int ring_has_room(XenoAsyncQueue* q, const void* arg)
+{
+    (void)arg;
+    uint64_t pos = atomic_load(&q->tail);
+    return atomic_load_explicit(&q->slots[pos % XENO_ASYNC_RING].seq, memory_order_acquire) >= pos;
+}
+
+static int retired_to(XenoAsyncQueue* q, const void* arg)
+{
+    return atomic_load(&q->retired) >= *(const uint64_t*)arg;
+}
+
+static int deps_ready(XenoAsyncQueue* q, const void* arg)
+{
+    const XenoAsyncItem* it = (const XenoAsyncItem*)arg;
+    for (uint32_t i = 0; i < it->dep_count; ++i) {
+        if (i == q->index) continue;
+        if (atomic_load(&q->dev->queues[i]->retired) < it->deps[i]) return 0;
+    }
+    return 1;
+}
+
+static void drain_queue(XenoAsyncQueue* q)
+{
+    uint64_t target = atomic_load(&q->tail);
+    wait_progress(q, retired_to, &target);
+}
+
+/* ---- ring ---------------------------------------------------------- */
+
+static void ring_push(XenoAsyncQueue* q, XenoAsyncItem* it)
+{
+    for (;;) {
+        uint64_t pos = atomic_load_explicit(&q->tail, memory_order_relaxed);
+        XenoAsyncSlot* s = &q->slots[pos % XENO_ASYNC_RING];
+        uint64_t seq = atomic_load_explicit(&s->seq, memory_order_acquire);
+        if (seq == pos) {
+            if (atomic_compare_exchange_weak(&q->tail, &pos, pos + 1)) {
+                s->item = it;
+                atomic_store_explicit(&s->seq, pos + 1, memory_order_release);
+                sem_post(&q->wake);
+                return;
+            }
+        } else if (seq < pos) {
+            /* Full: the worker has not released this slot from the previous lap. */
+            wait_progress(q, ring_has_room, NULL);
+        }
+    }
+}
+
+/* Worker side: the item `offset` places past head, if it is published. */
+static XenoAsyncItem* ring_peek(XenoAsyncQueue* q, uint32_t offset)
+{
+    if (offset >= XENO_ASYNC_RING) return NULL;
+    uint64_t pos = q->head + offset;
+    XenoAsyncSlot* s = &q->slots[pos % XENO_ASYNC_RING];
+    return atomic_load_explicit(&s->seq, memory_order_acquire) == pos + 1 ? s->item : NULL;
+}
+
+static void ring_release(XenoAsyncQueue* q, uint32_t n)
+{
+    for (uint32_t i = 0; i < n; ++i) {
+        uint64_t pos = q->head + i;
+        XenoAsyncSlot* s = &q->slots[pos % XENO_ASYNC_RING];
+        free(s->item);
+        s->item = NULL;
+        atomic_store_explicit(&s->seq, pos + XENO_ASYNC_RING, memory_order_release);
+    }
+    q->head += n;
+    atomic_store(&q->retired, q->head);
+    notify_progress(q->dev);
+}
+
+/* ---- argument copies ----------------------------------------------- */
+
+static size_t align8(size_t v)
+{
+    return (v + 7u) & ~(size_t)7u;
+}
+
+static void* blob_copy(char** cur, const void* src, size_t size)
+{
+    void* dst = *cur;
+    if (size) memcpy(dst, src, size);
+    *cur += align8(size);
+    return dst;
+}
+
+/* NULL when the submit carries a pNext struct we do not know how to copy. */
+static XenoAsyncItem* copy_submit(uint32_t count, const VkSubmitInfo* submits, VkFence fence, int* waits)
+{
+    size_t bytes = align8(sizeof(XenoAsyncItem)) + align8(sizeof(VkSubmitInfo) * count);
+    for (uint32_t i = 0; i < count; ++i) {
+        const VkSubmitInfo* s = &submits[i];
+        const VkBaseInStructure* p = (const VkBaseInStructure*)s->pNext;
+        if (p) {
+            if (p->sType != VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO || p->pNext) return NULL;
+            const VkTimelineSemaphoreSubmitInfo* t = (const VkTimelineSemaphoreSubmitInfo*)p;
+            bytes += align8(sizeof(*t)) + align8(sizeof(uint64_t) * t->waitSemaphoreValueCount) +
+                     align8(sizeof(uint64_t) * t->signalSemaphoreValueCount);
+        }
+        bytes += align8(sizeof(VkSemaphore) * s->waitSemaphoreCount) +
+                 align8(sizeof(VkPipelineStageFlags) * s->waitSemaphoreCount) +
+                 align8(sizeof(VkCommandBuffer) * s->commandBufferCount) +
+                 align8(sizeof(VkSemaphore) * s->signalSemaphoreCount);
+        *waits |= s->waitSemaphoreCount != 0;
+    }
+
+    XenoAsyncItem* it = (XenoAsyncItem*)malloc(bytes);
+    if (!it) return NULL;
+    memset(it, 0, sizeof(*it));
+    char* cur = (char*)it + align8(sizeof(*it));
+    it->kind = XENO_ASYNC_SUBMIT;
+    it->fence = fence;
+    it->submit_count = count;
+    it->submits = (VkSubmitInfo*)blob_copy(&cur, submits, sizeof(VkSubmitInfo) * count);
+    for (uint32_t i = 0; i < count; ++i) {
+        VkSubmitInfo* s = &it->submits[i];
+        s->pWaitSemaphores = blob_copy(&cur, s->pWaitSemaphores, sizeof(VkSemaphore) * s->waitSemaphoreCount);
+        s->pWaitDstStageMask = blob_copy(&cur, s->pWaitDstStageMask, sizeof(VkPipelineStageFlags) * s->waitSemaphoreCount);
+        s->pCommandBuffers = blob_copy(&cur, s->pCommandBuffers, sizeof(VkCommandBuffer) * s->commandBufferCount);
+        s->pSignalSemaphores = blob_copy(&cur, s->pSignalSemaphores, sizeof(VkSemaphore) * s->signalSemaphoreCount);
+        if (s->pNext) {
+            VkTimelineSemaphoreSubmitInfo* t = blob_copy(&cur, s->pNext, sizeof(*t));
+            t->pWaitSemaphoreValues = blob_copy(&cur, t->pWaitSemaphoreValues, sizeof(uint64_t) * t->waitSemaphoreValueCount);
+            t->pSignalSemaphoreValues = blob_copy(&cur, t->pSignalSemaphoreValues, sizeof(uint64_t) * t->signalSemaphoreValueCount);
+            s->pNext = t;
+        }
+    }
+    return it;
+}
+
+/* NULL for present extensions (pNext) and per-swapchain results, which
+   need the call to happen before we return. */
+static XenoAsyncItem* copy_present(const VkPresentInfoKHR* info)
+{
+    if (info->pNext || info->pResults) return NULL;
+    size_t bytes = align8(sizeof(XenoAsyncItem)) + align8(sizeof(VkSemaphore) * info->waitSemaphoreCount) +
+                   align8(sizeof(VkSwapchainKHR) * info->swapchainCount) + align8(sizeof(uint32_t) * info->swapchainCount);
+    XenoAsyncItem* it = (XenoAsyncItem*)malloc(bytes);
+    if (!it) return NULL;
+    memset(it, 0, sizeof(*it));
+    char* cur = (char*)it + align8(sizeof(*it));
+    it->kind = XENO_ASYNC_PRESENT;
+    it->present = *info;
+    it->present.pWaitSemaphores = blob_copy(&cur, info->pWaitSemaphores, sizeof(VkSemaphore) * info->waitSemaphoreCount);
+    it->present.pSwapchains = blob_copy(&cur, info->pSwapchains, sizeof(VkSwapchainKHR) * info->swapchainCount);
+    it->present.pImageIndices = blob_copy(&cur, info->pImageIndices, sizeof(uint32_t) * info->swapchainCount);
+    return it;
+}
+
+static void snapshot_deps(XenoAsyncQueue* q, XenoAsyncItem* it)
+{
+    XenoAsyncDevice* a = q->dev;
+    uint32_t n = atomic_load_explicit(&a->queue_count, memory_order_acquire);
+    for (uint32_t i = 0; i < n; ++i) {
+        it->deps[i] = i == q->index ? 0 : atomic_load(&a->queues[i]->tail);
+    }
+    it->dep_count = n;
+}
+
+/* ---- worker -------------------------------------------------------- */
+
+static VkResult present_now(XenoDeviceDispatch* d, VkQueue queue, const VkPresentInfoKHR* info)
+{
+    VkPresentInfoKHR pi = *info;
+    xclipse_vrs_content_present(d, queue, &pi);
+    return d->QueuePresentKHR(queue, &pi);
+}
+
+static int ensure_scratch(XenoAsyncQueue* q, uint32_t count)
+{
+    if (count <= q->scratch_cap) return 1;
+    uint32_t cap = q->scratch_cap ? q->scratch_cap : 16u;
+    while (cap < count) cap *= 2u;
+    VkSubmitInfo* s = (VkSubmitInfo*)realloc(q->scratch, sizeof(*s) * cap);
+    if (!s) return 0;
+    q->scratch = s;
+    q->scratch_cap = cap;
+    return 1;
+}
+
+/* One driver call for the n items at head; only the last may carry a fence. */
+static void submit_batch(XenoAsyncQueue* q, uint32_t n, uint32_t total)
+{
+    XenoDeviceDispatch* d = q->dev->d;
+    XENO_TRACE_SCOPE("async.submit");
+    const VkSubmitInfo* infos = ring_peek(q, 0)->submits;
+    if (n > 1) {
+        uint32_t at = 0;
+        for (uint32_t i = 0; i < n; ++i) {
+            const XenoAsyncItem* it = ring_peek(q, i);
+            memcpy(q->scratch + at, it->submits, sizeof(VkSubmitInfo) * it->submit_count);
+            at += it->submit_count;
+        }
+        infos = q->scratch;
+    }
+
+    VkFence fence = ring_peek(q, n - 1u)->fence;
+    VkResult res = VK_SUCCESS;
+    if (total || fence) res = d->QueueSubmit(q->queue, total, infos, fence);
+    if (res != VK_SUCCESS) {
+        XENO_LOGE("async: vkQueueSubmit of %u batches failed: %d", total, res);
+        atomic_store(&q->submit_status, res);
+    }
+    if (n > 1) XENO_LOGD_RL(1, "async: coalesced %u submits into one call", n);
+    ring_release(q, n);
+    XENO_TRACE_COUNTER("queue.submits_queued", (int64_t)(atomic_load(&q->tail) - q->head));
+}
+
+static void* worker_main(void* arg)
+{
+    XenoAsyncQueue* q = (XenoAsyncQueue*)arg;
+    for (;;) {
+        XenoAsyncItem* it = ring_peek(q, 0);
+        if (!it) {
+            if (atomic_load(&q->stop)) break;
+            /* Tokens can outnumber items after a coalesced batch; an extra wakeup is harmless. */
+            sem_wait(&q->wake);
+            continue;
+        }
+        wait_progress(q, deps_ready, it);
+
+        if (it->kind == XENO_ASYNC_PRESENT) {
+            XENO_TRACE_SCOPE("async.present");
+            VkResult res = present_now(q->dev->d, q->queue, &it->present);
+            if (res != VK_SUCCESS) atomic_store(&q->present_status, res);
+            ring_release(q, 1);
+            continue;
+        }
+
+        /* Merge the run of published submits behind this one until a fence,
+           a present or a not-yet-satisfied cross-queue wait. */
+        uint32_t n = 1, total = it->submit_count;
+        while (!it->fence && n < XENO_ASYNC_MAX_COALESCE) {
+            XenoAsyncItem* next = ring_peek(q, n);
+            if (!next || next->kind != XENO_ASYNC_SUBMIT || !deps_ready(q, next)) break;
+            if (!ensure_scratch(q, total + next->submit_count)) break;
+            total += next->submit_count;
+            it = next;
+            n++;
+        }
+        submit_batch(q, n, total);
+    }
+    return NULL;
+}
+
+/* ---- public -------------------------------------------------------- */
+
+static XenoAsyncQueue* find_queue(XenoAsyncDevice* a, VkQueue queue)
+{
+    uint32_t n = atomic_load_explicit(&a->queue_count, memory_order_acquire);
+    for (uint32_t i = 0; i < n; ++i) {
+        if (a->queues[i]->queue == queue) return a->queues[i];
+    }
+    return NULL;
+}
+
+void xclipse_async_device_init(XenoDeviceDispatch* d)
+{
+    XenoAsyncDevice* a = (XenoAsyncDevice*)calloc(1, sizeof(*a));
+    if (!a) return;
+    a->d = d;
+    pthread_mutex_init(&a->mtx, NULL);
+    pthread_cond_init(&a->progress, NULL);
+    d->async = a;
+    XENO_LOGI("async: queue submission moved to worker threads");
+}
+
+void xclipse_async_device_destroy(XenoDeviceDispatch* d)
+{
+    XenoAsyncDevice* a = d->async;
+    if (!a) return;
+    uint32_t n = atomic_load(&a->queue_count);
+    for (uint32_t i = 0; i < n; ++i) {
+        XenoAsyncQueue* q = a->queues[i];
+        /* The worker empties its ring before it looks at stop. */
+        atomic_store(&q->stop, 1);
+        sem_post(&q->wake);
+        pthread_join(q->thread, NULL);
+        sem_destroy(&q->wake);
+        free(q->scratch);
+        free(q);
+    }
+    pthread_cond_destroy(&a->progress);
+    pthread_mutex_destroy(&a->mtx);
+    free(a);
+    d->async = NULL;
+}
+
+void xclipse_async_track_queue(XenoDeviceDispatch* d, VkQueue queue)
+{
+    XenoAsyncDevice* a = d ? d->async : NULL;
+    if (!a || !queue) return;
+    pthread_mutex_lock(&a->mtx);
+    uint32_t n = atomic_load(&a->queue_count);
+    if (find_queue(a, queue)) goto out;
+    if (n == XENO_ASYNC_MAX_QUEUES) {
+        XENO_LOGW("async: more than %u queues, %p stays synchronous", XENO_ASYNC_MAX_QUEUES, (void*)queue);
+        goto out;
+    }
+    XenoAsyncQueue* q = (XenoAsyncQueue*)calloc(1, sizeof(*q));
+    if (!q) goto out;
+    q->dev = a;
+    q->queue = queue;
+    q->index = n;
+    for (uint32_t i = 0; i < XENO_ASYNC_RING; ++i) atomic_init(&q->slots[i].seq, i);
+    sem_init(&q->wake, 0, 0);
+    if (pthread_create(&q->thread, NULL, worker_main, q) != 0) {
+        XENO_LOGW("async: cannot start submit worker, queue %p stays synchronous", (void*)queue);
+        sem_destroy(&q->wake);
+        free(q);
+        goto out;
+    }
+    a->queues[n] = q;
+    atomic_store_explicit(&a->queue_count, n + 1u, memory_order_release);
+    XENO_LOGI("async: submit worker started for queue %p", (void*)queue);
+out:
+    pthread_mutex_unlock(&a->mtx);
+}
+
+VkResult xclipse_async_queue_submit(XenoDeviceDispatch* d, VkQueue queue, uint32_t count,
+                                    const VkSubmitInfo* submits, VkFence fence)
+{
+    XenoAsyncQueue* q = find_queue(d->async, queue);
+    if (q) {
+        int waits = 0;
+        XenoAsyncItem* it = copy_submit(count, submits, fence, &waits);
+        if (it) {
+            if (waits) snapshot_deps(q, it);
+            ring_push(q, it);
+            return (VkResult)atomic_exchange(&q->submit_status, VK_SUCCESS);
+        }
+        /* Submits we cannot copy still have to stay in queue order. */
+        drain_queue(q);
+    }
+    return d->QueueSubmit(queue, count, submits, fence);
+}
 
-void async_submit_begin(void) {
-    atomic_fetch_add(&async_counter, 1);
-    logging_info("Async submit begin (counter=%d)", async_counter);
+VkResult xclipse_async_queue_present(XenoDeviceDispatch* d, VkQueue queue, const VkPresentInfoKHR* info)
+{
+    XenoAsyncQueue* q = find_queue(d->async, queue);
+    if (q) {
+        XenoAsyncItem* it = copy_present(info);
+        if (it) {
+            if (info->waitSemaphoreCount) snapshot_deps(q, it);
+            ring_push(q, it);
+            return (VkResult)atomic_exchange(&q->present_status, VK_SUCCESS);
+        }
+        drain_queue(q);
+    }
+    return present_now(d, queue, info);
 }
 
-void async_submit_end(void) {
-    atomic_fetch_sub(&async_counter, 1);
-    logging_info("Async submit end (counter=%d)", async_counter);
+void xclipse_async_drain(XenoDeviceDispatch* d, VkQueue queue)
+{
+    XenoAsyncDevice* a = d ? d->async : NULL;
+    if (!a) return;
+    if (queue) {
+        XenoAsyncQueue* q = find_queue(a, queue);
+        if (q) drain_queue(q);
+        return;
+    }
+    uint32_t n = atomic_load_explicit(&a->queue_count, memory_order_acquire);
+    for (uint32_t i = 0; i < n; ++i) drain_queue(a->queues[i]);
 }
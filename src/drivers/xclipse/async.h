@@ -0,0 +1,41 @@
+// src/drivers/xclipse/async.h
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include "xeno_dispatch.h"
+
+/*
+  Asynchronous queue submission (async.c).
+
+  Every queue the app fetches gets a submit worker. vkQueueSubmit and
+  vkQueuePresentKHR deep-copy their arguments into the queue's bounded
+  lock-free MPSC ring and return; the worker makes the driver calls,
+  merging runs of adjacent submits into one vkQueueSubmit.
+
+  The workers create no fences or semaphores of their own, so there is no
+  pool to recycle: the app's fences and semaphores reach the driver
+  unchanged, and cross-queue order is kept with ring positions on the host.
+
+  Results arrive one call late: a failed submit or a non-VK_SUCCESS
+  present result is returned by the next submit/present on that queue.
+  Anything that waits on or synchronizes with the queue from the host
+  must call xclipse_async_drain first so the driver has seen the work.
+*/
+
+typedef struct XenoAsyncDevice XenoAsyncDevice;
+
+/* Sets d->async; called once the device dispatch table exists. */
+void xclipse_async_device_init(XenoDeviceDispatch* d);
+/* Drains and joins all workers. */
+void xclipse_async_device_destroy(XenoDeviceDispatch* d);
+
+void xclipse_async_track_queue(XenoDeviceDispatch* d, VkQueue queue);
+
+VkResult xclipse_async_queue_submit(XenoDeviceDispatch* d, VkQueue queue, uint32_t count,
+                                    const VkSubmitInfo* submits, VkFence fence);
+/* Includes the content-adaptive VRS pass (vrs_content.h) when it is on. */
+VkResult xclipse_async_queue_present(XenoDeviceDispatch* d, VkQueue queue, const VkPresentInfoKHR* info);
+
+/* Blocks until every call pushed so far has reached the driver.
+   queue == VK_NULL_HANDLE drains all queues of the device. */
+void xclipse_async_drain(XenoDeviceDispatch* d, VkQueue queue);
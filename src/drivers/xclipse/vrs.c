@@ -1,6 +1,17 @@
 // src/drivers/xclipse/vrs.c
 #include <vulkan/vulkan.h>
 #include "xeno_log.h"
+#include "xeno_trace.h"
+#include "xeno_dispatch.h"
+#include "vrs.h"
+#include "vrs_controller.h"
+#include "vrs_content.h"
+#include "perf_conf.h"
+
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
 
 /* Map VkFragmentShadingRateNV enum to conservative VkExtent2D */
 static VkExtent2D xclipse_vrs_nv_to_extent(VkFragmentShadingRateNV rate)
@@ -21,20 +32,328 @@ void xclipse_vrs_set_rate(VkCommandBuffer cmd, VkFragmentShadingRateNV rate)
 {
     if (cmd == VK_NULL_HANDLE) return;
 
-    PFN_vkCmdSetFragmentShadingRateKHR fnKHR =
-        (PFN_vkCmdSetFragmentShadingRateKHR)vkGetDeviceProcAddr(VK_NULL_HANDLE, "vkCmdSetFragmentShadingRateKHR");
-    if (fnKHR) {
+    const XenoDeviceDispatch *d = xeno_device_dispatch(cmd);
+    if (!d) {
+        XENO_LOGW_RL(1, "xclipse_vrs_set_rate: command buffer %p has no dispatch table", (void*)cmd);
+        return;
+    }
+
+    /* Keep the pipeline rate; primitive and attachment rates do not override it. */
+    static const VkFragmentShadingRateCombinerOpKHR keep[2] = {
+        VK_FRAGMENT_SHADING_RATE_COMBINER_OP_KEEP_KHR,
+        VK_FRAGMENT_SHADING_RATE_COMBINER_OP_KEEP_KHR,
+    };
+
+    if (d->CmdSetFragmentShadingRateKHR) {
         VkExtent2D ext = xclipse_vrs_nv_to_extent(rate);
-        fnKHR(cmd, &ext, NULL);
+        d->CmdSetFragmentShadingRateKHR(cmd, &ext, keep);
         return;
     }
 
-    PFN_vkCmdSetFragmentShadingRateEnumNV fnEnumNV =
-        (PFN_vkCmdSetFragmentShadingRateEnumNV)vkGetDeviceProcAddr(VK_NULL_HANDLE, "vkCmdSetFragmentShadingRateEnumNV");
-    if (fnEnumNV) {
-        fnEnumNV(cmd, rate, NULL);
+    if (d->CmdSetFragmentShadingRateEnumNV) {
+        d->CmdSetFragmentShadingRateEnumNV(cmd, rate, keep);
+        return;
+    }
+
+    XENO_LOGI_RL(1, "xclipse_vrs_set_rate: no VRS entrypoint available on device");
+}
+
+/* ---------------------------------------------------------------- */
+/* Adaptive rate                                                     */
+/* ---------------------------------------------------------------- */
+
+/* Frames in flight we can time; a frame's queries are read back this many
+   presents later, by which point the GPU has normally finished it. */
+#define XENO_VRS_FRAMES 4u
+#define XENO_VRS_PASSES_PER_FRAME 64u
+#define XENO_VRS_QUERIES_PER_FRAME (2u * XENO_VRS_PASSES_PER_FRAME)
+
+struct XenoVrsDevice {
+    VkQueryPool pool;
+    float ms_per_tick;
+    _Atomic uint32_t frame;                       /* frames presented so far */
+    _Atomic uint32_t used[XENO_VRS_FRAMES];       /* queries handed out per ring slot */
+    _Atomic int level;                            /* applied at the next pass begin */
+    int timed;                                    /* controller active, passes carry timestamps */
+    VkFragmentShadingRateCombinerOpKHR ops[2];    /* pipeline x primitive, result x attachment */
+    pthread_mutex_t mtx;                          /* controller + readback */
+    XenoVrsController ctl;
+    uint64_t results[XENO_VRS_QUERIES_PER_FRAME * 2u];   /* value, availability */
+    int conf_listener;                            /* perf_conf subscription */
+};
+
+/* Begin timestamps waiting for their pass to end. Command buffers are
+   externally synchronized, so one recording thread owns each entry. */
+#define XENO_VRS_OPEN_PASSES 8
+static _Thread_local struct { VkCommandBuffer cmd; VkQueryPool pool; uint32_t query; } t_open[XENO_VRS_OPEN_PASSES];
+
+static int chain_has_feature(const void* chain, VkStructureType type, size_t offset)
+{
+    for (const VkBaseInStructure* s = (const VkBaseInStructure*)chain; s; s = s->pNext) {
+        if (s->sType == type) return *(const VkBool32*)((const char*)s + offset) != VK_FALSE;
+    }
+    return 0;
+}
+
+int xclipse_vrs_device_supported(const XenoInstanceDispatch* inst, VkPhysicalDevice physical,
+                                 const VkDeviceCreateInfo* app_ci, VkBool32* attachment)
+{
+    *attachment = VK_FALSE;
+    if (!inst->GetPhysicalDeviceProperties || !inst->GetPhysicalDeviceFeatures2 ||
+        !inst->EnumerateDeviceExtensionProperties) return 0;
+
+    VkPhysicalDeviceProperties props;
+    inst->GetPhysicalDeviceProperties(physical, &props);
+    if (props.apiVersion < VK_API_VERSION_1_2 || !props.limits.timestampComputeAndGraphics) return 0;
+
+    /* The NV shading-rate image and fragment density maps cannot be combined
+       with pipeline rates; leave such apps alone. */
+    if (chain_has_feature(app_ci->pNext, VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SHADING_RATE_IMAGE_FEATURES_NV,
+                          offsetof(VkPhysicalDeviceShadingRateImageFeaturesNV, shadingRateImage)) ||
+        chain_has_feature(app_ci->pNext, VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FRAGMENT_DENSITY_MAP_FEATURES_EXT,
+                          offsetof(VkPhysicalDeviceFragmentDensityMapFeaturesEXT, fragmentDensityMap))) {
+        XENO_LOGI("vrs: app uses a conflicting shading-rate feature, adaptive rate disabled");
+        return 0;
+    }
+
+    uint32_t count = 0;
+    if (inst->EnumerateDeviceExtensionProperties(physical, NULL, &count, NULL) != VK_SUCCESS || !count) return 0;
+    VkExtensionProperties* exts = (VkExtensionProperties*)malloc(sizeof(*exts) * count);
+    if (!exts) return 0;
+    int has_ext = 0;
+    if (inst->EnumerateDeviceExtensionProperties(physical, NULL, &count, exts) >= VK_SUCCESS) {
+        for (uint32_t i = 0; i < count && !has_ext; ++i) {
+            has_ext = strcmp(exts[i].extensionName, VK_KHR_FRAGMENT_SHADING_RATE_EXTENSION_NAME) == 0;
+        }
+    }
+    free(exts);
+    if (!has_ext) return 0;
+
+    VkPhysicalDeviceFragmentShadingRateFeaturesKHR fsr = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FRAGMENT_SHADING_RATE_FEATURES_KHR,
+    };
+    VkPhysicalDeviceFeatures2 f2 = { .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2, .pNext = &fsr };
+    inst->GetPhysicalDeviceFeatures2(physical, &f2);
+    *attachment = fsr.attachmentFragmentShadingRate;
+    return fsr.pipelineFragmentShadingRate == VK_TRUE;
+}
+
+/* perf_conf reload: retarget the controller. The query pool only exists
+   if the device started with a target, so that still needs a restart. */
+static void vrs_conf_changed(const XenoPerfConf* prev, const XenoPerfConf* next, void* user)
+{
+    XenoVrsDevice* v = (XenoVrsDevice*)user;
+    if (prev->vrs_target_fps == next->vrs_target_fps && prev->vrs_max_rate == next->vrs_max_rate) return;
+    if (!v->timed) {
+        XENO_LOGW("vrs: frame-time controller was off at device creation, new target applies after a restart");
         return;
     }
+    XenoVrsControllerConfig cfg;
+    xeno_vrs_controller_config_defaults(&cfg, next->vrs_target_fps, next->vrs_max_rate);
+    pthread_mutex_lock(&v->mtx);
+    xeno_vrs_controller_init(&v->ctl, &cfg);
+    atomic_store_explicit(&v->level, 0, memory_order_relaxed);
+    pthread_mutex_unlock(&v->mtx);
+    XENO_LOGI("vrs: retargeted to %d fps, max rate %d", next->vrs_target_fps, next->vrs_max_rate);
+}
 
-    XENO_LOGI("xclipse_vrs_set_rate: no VRS entrypoint available on device");
+void xclipse_vrs_device_init(XenoDeviceDispatch* d, int target_fps, int max_rate, int content)
+{
+    if ((target_fps <= 0 && !content) || !d->instance || !d->CmdSetFragmentShadingRateKHR) return;
+    if (target_fps > 0 && (!d->CreateQueryPool || !d->GetQueryPoolResults || !d->CmdResetQueryPool ||
+                           !d->CmdWriteTimestamp)) target_fps = 0;
+
+    XenoVrsDevice* v = (XenoVrsDevice*)calloc(1, sizeof(*v));
+    if (!v) return;
+    v->ops[0] = VK_FRAGMENT_SHADING_RATE_COMBINER_OP_KEEP_KHR;
+    v->ops[1] = VK_FRAGMENT_SHADING_RATE_COMBINER_OP_KEEP_KHR;
+
+    XenoVrsControllerConfig cfg;
+    xeno_vrs_controller_config_defaults(&cfg, target_fps, max_rate);
+    xeno_vrs_controller_init(&v->ctl, &cfg);
+    pthread_mutex_init(&v->mtx, NULL);
+    d->vrs = v;
+
+    if (content) xclipse_vrs_content_create(d, max_rate, &v->ops[1]);
+    if (target_fps <= 0) return;
+
+    VkPhysicalDeviceProperties props;
+    d->instance->GetPhysicalDeviceProperties(d->physical, &props);
+    v->ms_per_tick = props.limits.timestampPeriod * 1e-6f;
+
+    VkQueryPoolCreateInfo qci = {
+        .sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+        .queryType = VK_QUERY_TYPE_TIMESTAMP,
+        .queryCount = XENO_VRS_FRAMES * XENO_VRS_QUERIES_PER_FRAME,
+    };
+    if (d->CreateQueryPool(d->device, &qci, NULL, &v->pool) != VK_SUCCESS) {
+        XENO_LOGW("vrs: timestamp query pool creation failed, frame-time controller disabled");
+        return;
+    }
+    v->timed = 1;
+    v->conf_listener = xeno_perf_conf_subscribe(vrs_conf_changed, v);
+    XENO_LOGI("vrs: adaptive shading rate on (target %d fps, max %dx%d)", target_fps,
+              cfg.max_level >= 4 ? 4 : (cfg.max_level >= 2 ? 2 : 1),
+              cfg.max_level >= 4 ? 4 : (cfg.max_level >= 2 ? 2 : 1));
+}
+
+void xclipse_vrs_device_destroy(XenoDeviceDispatch* d)
+{
+    XenoVrsDevice* v = d->vrs;
+    if (!v) return;
+    xeno_perf_conf_unsubscribe(v->conf_listener);
+    xclipse_vrs_content_destroy(d);
+    d->vrs = NULL;
+    if (v->pool && d->DestroyQueryPool) d->DestroyQueryPool(d->device, v->pool, NULL);
+    pthread_mutex_destroy(&v->mtx);
+    free(v);
+}
+
+void xclipse_vrs_apply(XenoDeviceDispatch* d, VkCommandBuffer cmd)
+{
+    XenoVrsDevice* v = d->vrs;
+    if (!v) return;
+    VkExtent2D size;
+    xeno_vrs_level_size(atomic_load_explicit(&v->level, memory_order_relaxed), &size.width, &size.height);
+    d->CmdSetFragmentShadingRateKHR(cmd, &size, v->ops);
+}
+
+void xclipse_vrs_pass_begin(XenoDeviceDispatch* d, VkCommandBuffer cmd, int timed)
+{
+    XenoVrsDevice* v = d->vrs;
+    if (!v) return;
+
+    /* Set outside the pass: dynamic state carries into every subpass,
+       including ones entered after a secondary-contents subpass. */
+    xclipse_vrs_apply(d, cmd);
+    if (!timed || !v->timed) return;
+
+    int slot = -1;
+    for (int i = 0; i < XENO_VRS_OPEN_PASSES; ++i) {
+        if (t_open[i].cmd == cmd || (slot < 0 && t_open[i].cmd == VK_NULL_HANDLE)) slot = i;
+    }
+    if (slot < 0) return;
+
+    uint32_t ring = atomic_load_explicit(&v->frame, memory_order_relaxed) % XENO_VRS_FRAMES;
+    uint32_t idx = atomic_fetch_add_explicit(&v->used[ring], 2u, memory_order_relaxed);
+    if (idx + 2u > XENO_VRS_QUERIES_PER_FRAME) return;   /* pass budget for this frame spent */
+
+    uint32_t q = ring * XENO_VRS_QUERIES_PER_FRAME + idx;
+    d->CmdResetQueryPool(cmd, v->pool, q, 2u);
+    d->CmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, v->pool, q);
+    t_open[slot].cmd = cmd;
+    t_open[slot].pool = v->pool;
+    t_open[slot].query = q + 1u;
+}
+
+void xclipse_vrs_pass_end(XenoDeviceDispatch* d, VkCommandBuffer cmd)
+{
+    XenoVrsDevice* v = d->vrs;
+    if (!v) return;
+    for (int i = 0; i < XENO_VRS_OPEN_PASSES; ++i) {
+        if (t_open[i].cmd != cmd) continue;
+        if (t_open[i].pool == v->pool) {
+            d->CmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, v->pool, t_open[i].query);
+        }
+        t_open[i].cmd = VK_NULL_HANDLE;
+        return;
+    }
+}
+
+void xclipse_vrs_frame_end(XenoDeviceDispatch* d)
+{
+    XenoVrsDevice* v = d->vrs;
+    if (!v || !v->timed) return;
+
+    pthread_mutex_lock(&v->mtx);
+    /* The slot the next frame records into is the oldest one in the ring. */
+    uint32_t next = atomic_load_explicit(&v->frame, memory_order_relaxed) + 1u;
+    uint32_t ring = next % XENO_VRS_FRAMES;
+    uint32_t used = atomic_load_explicit(&v->used[ring], memory_order_relaxed);
+    if (used > XENO_VRS_QUERIES_PER_FRAME) used = XENO_VRS_QUERIES_PER_FRAME;
+
+    float gpu_ms = 0.0f;
+    if (used) {
+        VkResult r = d->GetQueryPoolResults(d->device, v->pool, ring * XENO_VRS_QUERIES_PER_FRAME, used,
+                                            sizeof(uint64_t) * 2u * used, v->results, sizeof(uint64_t) * 2u,
+                                            VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+        if (r == VK_SUCCESS || r == VK_NOT_READY) {
+            uint64_t ticks = 0;
+            int complete = 1;
+            for (uint32_t i = 0; i + 1u < used; i += 2u) {
+                const uint64_t* b = &v->results[i * 2u];
+                const uint64_t* e = &v->results[i * 2u + 2u];
+                if (!b[1] || !e[1]) { complete = 0; break; }   /* still running or never submitted */
+                if (e[0] > b[0]) ticks += e[0] - b[0];
+            }
+            if (complete) gpu_ms = (float)ticks * v->ms_per_tick;
+        }
+    }
+    atomic_store_explicit(&v->used[ring], 0u, memory_order_relaxed);
+    atomic_store_explicit(&v->frame, next, memory_order_relaxed);
+
+    int prev = atomic_load_explicit(&v->level, memory_order_relaxed);
+    int level = xeno_vrs_controller_update(&v->ctl, gpu_ms);
+    atomic_store_explicit(&v->level, level, memory_order_relaxed);
+    pthread_mutex_unlock(&v->mtx);
+
+    XENO_TRACE_COUNTER("vrs.level", level);
+    if (level != prev) {
+        uint32_t w, h;
+        xeno_vrs_level_size(level, &w, &h);
+        XENO_LOGD("vrs: gpu %.2f ms (avg %.2f) -> rate %ux%u", gpu_ms, v->ctl.avg_ms, w, h);
+    }
+}
+
+VkResult xclipse_vrs_create_graphics_pipelines(XenoDeviceDispatch* d, VkPipelineCache cache, uint32_t count,
+                                               const VkGraphicsPipelineCreateInfo* infos,
+                                               const VkAllocationCallbacks* alloc, VkPipeline* pipelines)
+{
+    if (!d->vrs || !count) return d->CreateGraphicsPipelines(d->device, cache, count, infos, alloc, pipelines);
+
+    /* One copy of each create info plus a dynamic-state block with room for
+       the extra entry; the app's arrays are never modified. */
+    VkGraphicsPipelineCreateInfo* ci = (VkGraphicsPipelineCreateInfo*)malloc(sizeof(*ci) * count);
+    VkPipelineDynamicStateCreateInfo* dyn = (VkPipelineDynamicStateCreateInfo*)calloc(count, sizeof(*dyn));
+    VkDynamicState** states = (VkDynamicState**)calloc(count, sizeof(*states));
+    VkResult res = VK_ERROR_OUT_OF_HOST_MEMORY;
+    if (!ci || !dyn || !states) goto out;
+
+    for (uint32_t i = 0; i < count; ++i) {
+        ci[i] = infos[i];
+        /* Pipeline libraries get the state from the linked pipeline. */
+        if (infos[i].flags & VK_PIPELINE_CREATE_LIBRARY_BIT_KHR) continue;
+        /* Dynamic-rendering pipelines must opt in to the content attachment. */
+        if (d->vrs_content && infos[i].renderPass == VK_NULL_HANDLE) {
+            ci[i].flags |= VK_PIPELINE_CREATE_RENDERING_FRAGMENT_SHADING_RATE_ATTACHMENT_BIT_KHR;
+        }
+
+        const VkPipelineDynamicStateCreateInfo* src = (const VkPipelineDynamicStateCreateInfo*)infos[i].pDynamicState;
+        uint32_t n = src ? src->dynamicStateCount : 0;
+        int present = 0;
+        for (uint32_t s = 0; s < n && !present; ++s) {
+            present = src->pDynamicStates[s] == VK_DYNAMIC_STATE_FRAGMENT_SHADING_RATE_KHR;
+        }
+        if (present) continue;
+
+        states[i] = (VkDynamicState*)malloc(sizeof(VkDynamicState) * (n + 1u));
+        if (!states[i]) goto out;
+        if (n) memcpy(states[i], src->pDynamicStates, sizeof(VkDynamicState) * n);
+        states[i][n] = VK_DYNAMIC_STATE_FRAGMENT_SHADING_RATE_KHR;
+        if (src) dyn[i] = *src;
+        else dyn[i].sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+        dyn[i].dynamicStateCount = n + 1u;
+        dyn[i].pDynamicStates = states[i];
+        ci[i].pDynamicState = &dyn[i];
+    }
+    res = d->CreateGraphicsPipelines(d->device, cache, count, ci, alloc, pipelines);
+
+out:
+    if (states) {
+        for (uint32_t i = 0; i < count; ++i) free(states[i]);
+    }
+    free(states);
+    free(dyn);
+    free(ci);
+    return res;
 }
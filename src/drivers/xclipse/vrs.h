@@ -0,0 +1,51 @@
+// src/drivers/xclipse/vrs.h
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include "xeno_dispatch.h"
+
+/*
+  Adaptive pipeline shading rate (vrs.c).
+
+  Each render pass is bracketed with GPU timestamps; at vkQueuePresentKHR
+  the layer reads back the passes of the oldest frame still in the ring,
+  feeds their summed GPU time to the controller (vrs_controller.h) and
+  applies the resulting rate with vkCmdSetFragmentShadingRateKHR at every
+  following render-pass begin. Graphics pipelines get the fragment shading
+  rate dynamic state injected so the rate takes effect.
+*/
+
+typedef struct XenoVrsDevice XenoVrsDevice;
+
+/* Fixed rate on an explicit command buffer (legacy entrypoint). */
+void xclipse_vrs_set_rate(VkCommandBuffer cmd, VkFragmentShadingRateNV rate);
+
+/* Whether the device can run the controller: KHR extension with pipeline
+   rates, Vulkan 1.2, and no conflicting shading-rate feature requested in
+   the app's create chain. *attachment reports attachment-rate support for
+   the content-adaptive pass (vrs_content.h). */
+int xclipse_vrs_device_supported(const XenoInstanceDispatch* inst, VkPhysicalDevice physical,
+                                 const VkDeviceCreateInfo* app_ci, VkBool32* attachment);
+
+/* Called once the device dispatch table exists; sets d->vrs on success.
+   content requests the content-adaptive attachment as well; target_fps 0
+   leaves the frame-time controller off. */
+void xclipse_vrs_device_init(XenoDeviceDispatch* d, int target_fps, int max_rate, int content);
+void xclipse_vrs_device_destroy(XenoDeviceDispatch* d);
+
+/* Records the current rate into cmd (secondaries continuing a pass). */
+void xclipse_vrs_apply(XenoDeviceDispatch* d, VkCommandBuffer cmd);
+
+/* Render-pass brackets: pass_begin before the driver's begin (sets the
+   rate and, if timed, the start timestamp), pass_end after the driver's end.
+   Suspending/resuming dynamic-rendering passes must not be timed. */
+void xclipse_vrs_pass_begin(XenoDeviceDispatch* d, VkCommandBuffer cmd, int timed);
+void xclipse_vrs_pass_end(XenoDeviceDispatch* d, VkCommandBuffer cmd);
+
+/* Frame boundary: consumes the oldest timed frame and updates the rate. */
+void xclipse_vrs_frame_end(XenoDeviceDispatch* d);
+
+/* vkCreateGraphicsPipelines with VK_DYNAMIC_STATE_FRAGMENT_SHADING_RATE_KHR added. */
+VkResult xclipse_vrs_create_graphics_pipelines(XenoDeviceDispatch* d, VkPipelineCache cache, uint32_t count,
+                                               const VkGraphicsPipelineCreateInfo* infos,
+                                               const VkAllocationCallbacks* alloc, VkPipeline* pipelines);
@@ -0,0 +1,582 @@
+// src/drivers/xclipse/vrs_content.c
+#include <vulkan/vulkan.h>
+#include "xeno_log.h"
+#include "xeno_trace.h"
+#include "xeno_dispatch.h"
+#include "xeno_mem.h"
+#include "bindless.h"
+#include "vrs_content.h"
+
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+extern const uint32_t vrs_content_shader_spv[];
+extern const size_t vrs_content_shader_spv_len;
+extern const uint32_t vrs_content_bindless_shader_spv[];
+extern const size_t vrs_content_bindless_shader_spv_len;
+
+#define XENO_VRS_CONTENT_FRAMES 4u
+#define XENO_VRS_CONTENT_MAX_IMAGES 8u
+#define XENO_VRS_CONTENT_MAX_QUEUES 16u
+#define XENO_VRS_CONTENT_TILE 16u
+
+/* Shader thresholds (normalized gradient / luminance); see vrs_content.comp. */
+#define XENO_VRS_CONTRAST_2X 0.12f
+#define XENO_VRS_CONTRAST_4X 0.04f
+#define XENO_VRS_DARK_LUM 0.03f
+
+typedef struct XenoVrsContentPush {
+    uint32_t extent[2];
+    uint32_t tile[2];
+    float contrast2;
+    float contrast4;
+    float dark_lum;
+    uint32_t max_log2;
+    uint32_t src_index;
+} XenoVrsContentPush;
+
+typedef struct XenoVrsContentFrame {
+    VkCommandBuffer cmd;
+    VkFence fence;
+    VkSemaphore done;
+} XenoVrsContentFrame;
+
+struct XenoVrsContent {
+    pthread_mutex_t mtx;
+    VkExtent2D texel;
+    uint32_t max_log2;
+    VkSampler sampler;
+    VkDescriptorSetLayout dsl;
+    VkPipelineLayout layout;
+    VkPipeline pipeline;
+    VkDescriptorPool dpool;
+    int bindless;                /* sources come from the texture heap, set 0 holds only the attachment */
+
+    /* Created on the first present, for that queue's family. */
+    uint32_t family;
+    int failed;
+    VkCommandPool cpool;
+    XenoVrsContentFrame frames[XENO_VRS_CONTENT_FRAMES];
+    uint32_t frame;
+
+    struct { VkQueue queue; uint32_t family; int graphics; } queues[XENO_VRS_CONTENT_MAX_QUEUES];
+    uint32_t queue_count;
+    int queues_overflowed;       /* a queue was not tracked, its capabilities are unknown */
+
+    /* Tracked swapchain: the most recently created sampleable one. */
+    VkSwapchainKHR swapchain;
+    VkExtent2D extent;
+    uint32_t image_count;
+    VkImage images[XENO_VRS_CONTENT_MAX_IMAGES];
+    VkImageView views[XENO_VRS_CONTENT_MAX_IMAGES];
+    VkDescriptorSet sets[XENO_VRS_CONTENT_MAX_IMAGES];   /* bindless: sets[0] only */
+    uint32_t slots[XENO_VRS_CONTENT_MAX_IMAGES];         /* bindless: heap slots of views */
+    VkImage rate_image;
+    XenoMemAlloc rate_alloc;
+    VkImageView rate_view;
+    VkExtent2D rate_extent;
+    int rate_initialized;        /* layout is GENERAL */
+    _Atomic int ready;           /* attachment holds a valid analysis */
+};
+
+static uint32_t pow2_clamp(uint32_t v, uint32_t lo, uint32_t hi)
+{
+    if (v < lo) v = lo;
+    if (v > hi) v = hi;
+    uint32_t p = 1u;
+    while (p * 2u <= v) p *= 2u;
+    return p;
+}
+
+static VkResult create_pipeline(XenoDeviceDispatch* d, XenoVrsContent* c)
+{
+    VkSamplerCreateInfo sci = {
+        .sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,
+        .magFilter = VK_FILTER_NEAREST,
+        .minFilter = VK_FILTER_NEAREST,
+        .addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+        .addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+        .addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+    };
+    VkResult r = d->CreateSampler(d->device, &sci, NULL, &c->sampler);
+    if (r != VK_SUCCESS) return r;
+
+    VkDescriptorSetLayoutBinding b[2] = {
+        { .binding = 0, .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, .descriptorCount = 1,
+          .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT, .pImmutableSamplers = &c->sampler },
+        { .binding = 1, .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, .descriptorCount = 1,
+          .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT },
+    };
+    /* With the heap the sources are bound once for the whole swapchain,
+       at set 1; set 0 keeps only the attachment. */
+    c->bindless = xeno_bindless_layout(d) != VK_NULL_HANDLE && vrs_content_bindless_shader_spv_len != 0;
+    VkDescriptorSetLayoutCreateInfo dci = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+        .bindingCount = c->bindless ? 1 : 2, .pBindings = c->bindless ? &b[1] : b,
+    };
+    r = d->CreateDescriptorSetLayout(d->device, &dci, NULL, &c->dsl);
+    if (r != VK_SUCCESS) return r;
+
+    VkDescriptorSetLayout set_layouts[2] = { c->dsl, xeno_bindless_layout(d) };
+    VkPushConstantRange pcr = { VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(XenoVrsContentPush) };
+    VkPipelineLayoutCreateInfo lci = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+        .setLayoutCount = c->bindless ? 2 : 1, .pSetLayouts = set_layouts,
+        .pushConstantRangeCount = 1, .pPushConstantRanges = &pcr,
+    };
+    r = d->CreatePipelineLayout(d->device, &lci, NULL, &c->layout);
+    if (r != VK_SUCCESS) return r;
+
+    VkDescriptorPoolSize sizes[2] = {
+        { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, XENO_VRS_CONTENT_MAX_IMAGES },
+        { VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, XENO_VRS_CONTENT_MAX_IMAGES },
+    };
+    VkDescriptorPoolCreateInfo pci = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+        .flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT,
+        .maxSets = XENO_VRS_CONTENT_MAX_IMAGES, .poolSizeCount = 2, .pPoolSizes = sizes,
+    };
+    r = d->CreateDescriptorPool(d->device, &pci, NULL, &c->dpool);
+    if (r != VK_SUCCESS) return r;
+
+    if (vrs_content_shader_spv_len == 0) return VK_ERROR_INITIALIZATION_FAILED;
+    VkShaderModuleCreateInfo smci = {
+        .sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
+        .codeSize = c->bindless ? vrs_content_bindless_shader_spv_len : vrs_content_shader_spv_len,
+        .pCode = c->bindless ? vrs_content_bindless_shader_spv : vrs_content_shader_spv,
+    };
+    VkShaderModule module;
+    r = d->CreateShaderModule(d->device, &smci, NULL, &module);
+    if (r != VK_SUCCESS) return r;
+    VkComputePipelineCreateInfo cpci = {
+        .sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+        .stage = { .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+                   .stage = VK_SHADER_STAGE_COMPUTE_BIT, .module = module, .pName = "main" },
+        .layout = c->layout,
+    };
+    r = d->CreateComputePipelines(d->device, VK_NULL_HANDLE, 1, &cpci, NULL, &c->pipeline);
+    d->DestroyShaderModule(d->device, module, NULL);
+    return r;
+}
+
+int xclipse_vrs_content_create(XenoDeviceDispatch* d, int max_rate, VkFragmentShadingRateCombinerOpKHR* attachment_op)
+{
+    if (!d->instance || !d->instance->GetPhysicalDeviceProperties2 || !d->CreateSwapchainKHR) return 0;
+
+    VkPhysicalDeviceFragmentShadingRatePropertiesKHR fsr = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FRAGMENT_SHADING_RATE_PROPERTIES_KHR,
+    };
+    VkPhysicalDeviceProperties2 p2 = { .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2, .pNext = &fsr };
+    d->instance->GetPhysicalDeviceProperties2(d->physical, &p2);
+    if (!fsr.maxFragmentShadingRateAttachmentTexelSize.width) return 0;
+
+    XenoVrsContent* c = (XenoVrsContent*)calloc(1, sizeof(*c));
+    if (!c) return 0;
+    c->texel.width = pow2_clamp(XENO_VRS_CONTENT_TILE, fsr.minFragmentShadingRateAttachmentTexelSize.width,
+                                fsr.maxFragmentShadingRateAttachmentTexelSize.width);
+    c->texel.height = pow2_clamp(XENO_VRS_CONTENT_TILE, fsr.minFragmentShadingRateAttachmentTexelSize.height,
+                                 fsr.maxFragmentShadingRateAttachmentTexelSize.height);
+    c->max_log2 = max_rate >= 4 ? 2u : (max_rate >= 2 ? 1u : 0u);
+    c->family = UINT32_MAX;
+    for (uint32_t i = 0; i < XENO_VRS_CONTENT_MAX_IMAGES; ++i) c->slots[i] = XENO_BINDLESS_NONE;
+    pthread_mutex_init(&c->mtx, NULL);
+
+    VkResult r = create_pipeline(d, c);
+    if (r != VK_SUCCESS) {
+        XENO_LOGW("vrs: content pass unavailable (%d)", r);
+        d->vrs_content = c;
+        xclipse_vrs_content_destroy(d);
+        return 0;
+    }
+
+    /* MAX keeps the coarser of the controller's rate and the content rate;
+       without non-trivial combiners the attachment simply wins. */
+    *attachment_op = fsr.fragmentShadingRateNonTrivialCombinerOps ? VK_FRAGMENT_SHADING_RATE_COMBINER_OP_MAX_KHR
+                                                                  : VK_FRAGMENT_SHADING_RATE_COMBINER_OP_REPLACE_KHR;
+    d->vrs_content = c;
+    XENO_LOGI("vrs: content-adaptive attachment on (%ux%u texels)", c->texel.width, c->texel.height);
+    return 1;
+}
+
+static void wait_frames(XenoDeviceDispatch* d, XenoVrsContent* c)
+{
+    for (uint32_t i = 0; i < XENO_VRS_CONTENT_FRAMES; ++i) {
+        if (c->frames[i].fence) d->WaitForFences(d->device, 1, &c->frames[i].fence, VK_TRUE, UINT64_MAX);
+    }
+}
+
+static void release_swapchain(XenoDeviceDispatch* d, XenoVrsContent* c)
+{
+    atomic_store(&c->ready, 0);
+    if (c->swapchain == VK_NULL_HANDLE) return;
+    /* Command buffers the app recorded against the old attachment may still
+       be executing; swapchain recreation is rare, so just drain the device. */
+    d->DeviceWaitIdle(d->device);
+    for (uint32_t i = 0; i < c->image_count; ++i) {
+        if (c->sets[i]) d->FreeDescriptorSets(d->device, c->dpool, 1, &c->sets[i]);
+        if (c->slots[i] != XENO_BINDLESS_NONE) xeno_bindless_free(d, c->slots[i]);
+        if (c->views[i]) d->DestroyImageView(d->device, c->views[i], NULL);
+        c->slots[i] = XENO_BINDLESS_NONE;
+    }
+    if (c->rate_view) d->DestroyImageView(d->device, c->rate_view, NULL);
+    xeno_mem_destroy_image(xeno_mem_allocator(d->device), c->rate_image, &c->rate_alloc);
+    memset(c->images, 0, sizeof(c->images));
+    memset(c->views, 0, sizeof(c->views));
+    memset(c->sets, 0, sizeof(c->sets));
+    c->rate_view = VK_NULL_HANDLE;
+    c->rate_image = VK_NULL_HANDLE;
+    c->rate_initialized = 0;
+    c->image_count = 0;
+    c->swapchain = VK_NULL_HANDLE;
+}
+
+void xclipse_vrs_content_destroy(XenoDeviceDispatch* d)
+{
+    XenoVrsContent* c = d->vrs_content;
+    if (!c) return;
+    d->vrs_content = NULL;
+    release_swapchain(d, c);
+    wait_frames(d, c);
+    for (uint32_t i = 0; i < XENO_VRS_CONTENT_FRAMES; ++i) {
+        if (c->frames[i].fence) d->DestroyFence(d->device, c->frames[i].fence, NULL);
+        if (c->frames[i].done) d->DestroySemaphore(d->device, c->frames[i].done, NULL);
+    }
+    if (c->cpool) d->DestroyCommandPool(d->device, c->cpool, NULL);
+    if (c->pipeline) d->DestroyPipeline(d->device, c->pipeline, NULL);
+    if (c->dpool) d->DestroyDescriptorPool(d->device, c->dpool, NULL);
+    if (c->layout) d->DestroyPipelineLayout(d->device, c->layout, NULL);
+    if (c->dsl) d->DestroyDescriptorSetLayout(d->device, c->dsl, NULL);
+    if (c->sampler) d->DestroySampler(d->device, c->sampler, NULL);
+    pthread_mutex_destroy(&c->mtx);
+    free(c);
+}
+
+static VkQueueFlags family_flags(XenoDeviceDispatch* d, uint32_t family)
+{
+    uint32_t n = 0;
+    d->instance->GetPhysicalDeviceQueueFamilyProperties(d->physical, &n, NULL);
+    VkQueueFamilyProperties props[16];
+    if (n > 16) n = 16;
+    d->instance->GetPhysicalDeviceQueueFamilyProperties(d->physical, &n, props);
+    return family < n ? props[family].queueFlags : 0;
+}
+
+/* The attachment is only ordered against work on the queue that writes
+   it, so that queue has to be the only one main passes can run on. */
+static int sole_graphics_queue(const XenoVrsContent* c, VkQueue queue)
+{
+    if (c->queues_overflowed) return 0;
+    for (uint32_t i = 0; i < c->queue_count; ++i) {
+        if (c->queues[i].graphics && c->queues[i].queue != queue) return 0;
+    }
+    return 1;
+}
+
+void xclipse_vrs_content_track_queue(XenoDeviceDispatch* d, VkQueue queue, uint32_t family)
+{
+    XenoVrsContent* c = d->vrs_content;
+    if (!c || !queue) return;
+    int graphics = (family_flags(d, family) & VK_QUEUE_GRAPHICS_BIT) != 0;
+    pthread_mutex_lock(&c->mtx);
+    uint32_t i = 0;
+    while (i < c->queue_count && c->queues[i].queue != queue) ++i;
+    if (i < XENO_VRS_CONTENT_MAX_QUEUES) {
+        c->queues[i].queue = queue;
+        c->queues[i].family = family;
+        c->queues[i].graphics = graphics;
+        if (i == c->queue_count) c->queue_count++;
+    } else {
+        c->queues_overflowed = 1;
+    }
+    /* A second graphics queue: stop attaching an analysis it cannot see. */
+    if (graphics && !sole_graphics_queue(c, queue)) {
+        atomic_store_explicit(&c->ready, 0, memory_order_release);
+    }
+    pthread_mutex_unlock(&c->mtx);
+}
+
+void xclipse_vrs_content_adjust_swapchain(XenoDeviceDispatch* d, VkSwapchainCreateInfoKHR* ci)
+{
+    if (!d->vrs_content || (ci->imageUsage & VK_IMAGE_USAGE_SAMPLED_BIT)) return;
+    const XenoInstanceDispatch* inst = d->instance;
+    if (!inst->GetPhysicalDeviceSurfaceCapabilitiesKHR) return;
+    VkSurfaceCapabilitiesKHR caps;
+    if (inst->GetPhysicalDeviceSurfaceCapabilitiesKHR(d->physical, ci->surface, &caps) != VK_SUCCESS) return;
+    if (caps.supportedUsageFlags & VK_IMAGE_USAGE_SAMPLED_BIT) ci->imageUsage |= VK_IMAGE_USAGE_SAMPLED_BIT;
+}
+
+static VkResult create_rate_image(XenoDeviceDispatch* d, XenoVrsContent* c)
+{
+    c->rate_extent.width = (c->extent.width + c->texel.width - 1u) / c->texel.width;
+    c->rate_extent.height = (c->extent.height + c->texel.height - 1u) / c->texel.height;
+    VkImageCreateInfo ici = {
+        .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+        .imageType = VK_IMAGE_TYPE_2D,
+        .format = VK_FORMAT_R8_UINT,
+        .extent = { c->rate_extent.width, c->rate_extent.height, 1u },
+        .mipLevels = 1, .arrayLayers = 1,
+        .samples = VK_SAMPLE_COUNT_1_BIT,
+        .tiling = VK_IMAGE_TILING_OPTIMAL,
+        .usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_FRAGMENT_SHADING_RATE_ATTACHMENT_BIT_KHR,
+        .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+        .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+    };
+    VkResult r = xeno_mem_create_image(xeno_mem_allocator(d->device), &ici, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                                       &c->rate_image, &c->rate_alloc);
+    if (r != VK_SUCCESS) return r;
+
+    VkImageViewCreateInfo vci = {
+        .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+        .image = c->rate_image, .viewType = VK_IMAGE_VIEW_TYPE_2D, .format = VK_FORMAT_R8_UINT,
+        .subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 },
+    };
+    return d->CreateImageView(d->device, &vci, NULL, &c->rate_view);
+}
+
+void xclipse_vrs_content_swapchain_created(XenoDeviceDispatch* d, VkSwapchainKHR swapchain,
+                                           const VkSwapchainCreateInfoKHR* ci)
+{
+    XenoVrsContent* c = d->vrs_content;
+    if (!c || !(ci->imageUsage & VK_IMAGE_USAGE_SAMPLED_BIT) || ci->imageArrayLayers != 1) return;
+
+    pthread_mutex_lock(&c->mtx);
+    wait_frames(d, c);
+    release_swapchain(d, c);
+
+    uint32_t count = 0;
+    VkResult r = d->GetSwapchainImagesKHR(d->device, swapchain, &count, NULL);
+    if (r != VK_SUCCESS || count == 0 || count > XENO_VRS_CONTENT_MAX_IMAGES) {
+        XENO_LOGW("vrs: swapchain with %u images not analysed", count);
+        pthread_mutex_unlock(&c->mtx);
+        return;
+    }
+    c->swapchain = swapchain;
+    c->extent = ci->imageExtent;
+    c->image_count = count;
+    r = d->GetSwapchainImagesKHR(d->device, swapchain, &count, c->images);
+    if (r == VK_SUCCESS) r = create_rate_image(d, c);
+
+    VkDescriptorSetLayout layouts[XENO_VRS_CONTENT_MAX_IMAGES];
+    for (uint32_t i = 0; i < count; ++i) layouts[i] = c->dsl;
+    VkDescriptorSetAllocateInfo dsai = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+        .descriptorPool = c->dpool, .descriptorSetCount = c->bindless ? 1u : count, .pSetLayouts = layouts,
+    };
+    if (r == VK_SUCCESS) {
+        r = d->AllocateDescriptorSets(d->device, &dsai, c->sets);
+        if (r != VK_SUCCESS) memset(c->sets, 0, sizeof(c->sets));
+    }
+
+    for (uint32_t i = 0; i < count && r == VK_SUCCESS; ++i) {
+        VkImageViewCreateInfo vci = {
+            .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+            .image = c->images[i], .viewType = VK_IMAGE_VIEW_TYPE_2D, .format = ci->imageFormat,
+            .subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 },
+        };
+        r = d->CreateImageView(d->device, &vci, NULL, &c->views[i]);
+        if (r != VK_SUCCESS) break;
+        VkDescriptorImageInfo src = { VK_NULL_HANDLE, c->views[i], VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+        VkDescriptorImageInfo dst = { VK_NULL_HANDLE, c->rate_view, VK_IMAGE_LAYOUT_GENERAL };
+        VkWriteDescriptorSet w[2] = {
+            { .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET, .dstSet = c->sets[i], .dstBinding = 1,
+              .descriptorCount = 1, .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, .pImageInfo = &dst },
+            { .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET, .dstSet = c->sets[i], .dstBinding = 0,
+              .descriptorCount = 1, .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, .pImageInfo = &src },
+        };
+        if (!c->bindless) {
+            d->UpdateDescriptorSets(d->device, 2, w, 0, NULL);
+            continue;
+        }
+        if (i == 0) d->UpdateDescriptorSets(d->device, 1, w, 0, NULL);
+        c->slots[i] = xeno_bindless_alloc(d, c->views[i], c->sampler, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+        if (c->slots[i] == XENO_BINDLESS_NONE) r = VK_ERROR_OUT_OF_POOL_MEMORY;
+    }
+
+    if (r != VK_SUCCESS) {
+        XENO_LOGW("vrs: content resources for swapchain failed (%d)", r);
+        release_swapchain(d, c);
+    }
+    pthread_mutex_unlock(&c->mtx);
+}
+
+void xclipse_vrs_content_swapchain_destroyed(XenoDeviceDispatch* d, VkSwapchainKHR swapchain)
+{
+    XenoVrsContent* c = d->vrs_content;
+    if (!c || swapchain == VK_NULL_HANDLE) return;
+    pthread_mutex_lock(&c->mtx);
+    if (c->swapchain == swapchain) {
+        wait_frames(d, c);
+        release_swapchain(d, c);
+    }
+    pthread_mutex_unlock(&c->mtx);
+}
+
+static VkResult create_frames(XenoDeviceDispatch* d, XenoVrsContent* c, uint32_t family)
+{
+    VkCommandPoolCreateInfo pci = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+        .flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
+        .queueFamilyIndex = family,
+    };
+    VkResult r = d->CreateCommandPool(d->device, &pci, NULL, &c->cpool);
+    if (r != VK_SUCCESS) return r;
+    VkCommandBufferAllocateInfo cai = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+        .commandPool = c->cpool, .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY, .commandBufferCount = 1,
+    };
+    VkFenceCreateInfo fci = { .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO, .flags = VK_FENCE_CREATE_SIGNALED_BIT };
+    VkSemaphoreCreateInfo sci = { .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO };
+    for (uint32_t i = 0; i < XENO_VRS_CONTENT_FRAMES && r == VK_SUCCESS; ++i) {
+        r = d->AllocateCommandBuffers(d->device, &cai, &c->frames[i].cmd);
+        /* Command buffers allocated below the loader need their dispatch
+           pointer set before use. */
+        if (r == VK_SUCCESS) {
+            if (d->SetDeviceLoaderData) r = d->SetDeviceLoaderData(d->device, c->frames[i].cmd);
+            else *(void**)c->frames[i].cmd = *(void**)d->device;
+        }
+        if (r == VK_SUCCESS) r = d->CreateFence(d->device, &fci, NULL, &c->frames[i].fence);
+        if (r == VK_SUCCESS) r = d->CreateSemaphore(d->device, &sci, NULL, &c->frames[i].done);
+    }
+    c->family = family;
+    return r;
+}
+
+static void record(XenoDeviceDispatch* d, XenoVrsContent* c, VkCommandBuffer cmd, uint32_t image_index)
+{
+    VkImageMemoryBarrier pre[2] = {
+        { .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+          .srcAccessMask = 0, .dstAccessMask = VK_ACCESS_SHADER_READ_BIT,
+          .oldLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, .newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+          .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED, .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+          .image = c->images[image_index], .subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 } },
+        /* Previous frame's passes read the attachment; only an execution
+           dependency is needed before overwriting it. */
+        { .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+          .srcAccessMask = 0, .dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+          .oldLayout = c->rate_initialized ? VK_IMAGE_LAYOUT_GENERAL : VK_IMAGE_LAYOUT_UNDEFINED,
+          .newLayout = VK_IMAGE_LAYOUT_GENERAL,
+          .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED, .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+          .image = c->rate_image, .subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 } },
+    };
+    d->CmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADING_RATE_ATTACHMENT_BIT_KHR,
+                          VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, NULL, 0, NULL, 2, pre);
+
+    XenoVrsContentPush push = {
+        { c->extent.width, c->extent.height },
+        { c->texel.width, c->texel.height },
+        XENO_VRS_CONTRAST_2X, XENO_VRS_CONTRAST_4X, XENO_VRS_DARK_LUM, c->max_log2, c->slots[image_index],
+    };
+    d->CmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, c->pipeline);
+    d->CmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, c->layout, 0, 1,
+                             &c->sets[c->bindless ? 0u : image_index], 0, NULL);
+    if (c->bindless) xeno_bindless_bind(d, cmd, VK_PIPELINE_BIND_POINT_COMPUTE, c->layout, 1);
+    d->CmdPushConstants(cmd, c->layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(push), &push);
+    d->CmdDispatch(cmd, c->rate_extent.width, c->rate_extent.height, 1);
+
+    VkImageMemoryBarrier post[2] = {
+        { .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+          .srcAccessMask = 0, .dstAccessMask = 0,
+          .oldLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, .newLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+          .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED, .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+          .image = c->images[image_index], .subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 } },
+        { .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+          .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+          .dstAccessMask = VK_ACCESS_FRAGMENT_SHADING_RATE_ATTACHMENT_READ_BIT_KHR,
+          .oldLayout = VK_IMAGE_LAYOUT_GENERAL, .newLayout = VK_IMAGE_LAYOUT_GENERAL,
+          .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED, .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+          .image = c->rate_image, .subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 } },
+    };
+    d->CmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                          VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADING_RATE_ATTACHMENT_BIT_KHR,
+                          0, 0, NULL, 0, NULL, 2, post);
+    c->rate_initialized = 1;
+}
+
+void xclipse_vrs_content_present(XenoDeviceDispatch* d, VkQueue queue, VkPresentInfoKHR* info)
+{
+    XenoVrsContent* c = d->vrs_content;
+    if (!c || info->swapchainCount != 1) return;
+
+    pthread_mutex_lock(&c->mtx);
+    if (info->pSwapchains[0] != c->swapchain || info->pImageIndices[0] >= c->image_count) goto out;
+
+    uint32_t family = UINT32_MAX;
+    for (uint32_t i = 0; i < c->queue_count; ++i) {
+        if (c->queues[i].queue == queue) family = c->queues[i].family;
+    }
+    if (family == UINT32_MAX) goto out;
+    if (c->failed || !sole_graphics_queue(c, queue)) goto out;
+    if (c->family == UINT32_MAX) {
+        if (!(family_flags(d, family) & VK_QUEUE_COMPUTE_BIT)) goto out;
+        if (create_frames(d, c, family) != VK_SUCCESS) {
+            XENO_LOGW("vrs: content pass command resources failed, disabling");
+            c->failed = 1;
+            goto out;
+        }
+    }
+    if (family != c->family) goto out;
+
+    /* Never block the present: skip the analysis if the slot is still busy. */
+    XenoVrsContentFrame* f = &c->frames[c->frame % XENO_VRS_CONTENT_FRAMES];
+    if (d->WaitForFences(d->device, 1, &f->fence, VK_TRUE, 0) != VK_SUCCESS) goto out;
+
+    XENO_TRACE_SCOPE("vrs.content");
+    VkCommandBufferBeginInfo bi = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO, .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+    };
+    if (d->BeginCommandBuffer(f->cmd, &bi) != VK_SUCCESS) goto out;
+    record(d, c, f->cmd, info->pImageIndices[0]);
+    if (d->EndCommandBuffer(f->cmd) != VK_SUCCESS) goto out;
+
+    VkPipelineStageFlags stages[8];
+    uint32_t waits = info->waitSemaphoreCount;
+    if (waits > 8) goto out;
+    for (uint32_t i = 0; i < waits; ++i) stages[i] = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+    VkSubmitInfo si = {
+        .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+        .waitSemaphoreCount = waits, .pWaitSemaphores = info->pWaitSemaphores, .pWaitDstStageMask = stages,
+        .commandBufferCount = 1, .pCommandBuffers = &f->cmd,
+        .signalSemaphoreCount = 1, .pSignalSemaphores = &f->done,
+    };
+    d->ResetFences(d->device, 1, &f->fence);
+    if (d->QueueSubmit(queue, 1, &si, f->fence) != VK_SUCCESS) {
+        XENO_LOGW_RL(1, "vrs: content pass submit failed");
+        goto out;
+    }
+    info->waitSemaphoreCount = 1;
+    info->pWaitSemaphores = &f->done;
+    c->frame++;
+    atomic_store_explicit(&c->ready, 1, memory_order_release);
+
+out:
+    pthread_mutex_unlock(&c->mtx);
+}
+
+int xclipse_vrs_content_attach(XenoDeviceDispatch* d, const VkRenderingInfo* in, VkRenderingInfo* out,
+                               VkRenderingFragmentShadingRateAttachmentInfoKHR* storage)
+{
+    XenoVrsContent* c = d->vrs_content;
+    if (!c || !atomic_load_explicit(&c->ready, memory_order_acquire)) return 0;
+
+    /* Main pass heuristic: single-view color pass over the whole swapchain. */
+    if (in->colorAttachmentCount == 0 || in->layerCount != 1 || in->viewMask != 0) return 0;
+    if (in->renderArea.offset.x != 0 || in->renderArea.offset.y != 0 ||
+        in->renderArea.extent.width != c->extent.width || in->renderArea.extent.height != c->extent.height) return 0;
+    for (const VkBaseInStructure* s = (const VkBaseInStructure*)in->pNext; s; s = s->pNext) {
+        if (s->sType == VK_STRUCTURE_TYPE_RENDERING_FRAGMENT_SHADING_RATE_ATTACHMENT_INFO_KHR ||
+            s->sType == VK_STRUCTURE_TYPE_RENDERING_FRAGMENT_DENSITY_MAP_ATTACHMENT_INFO_EXT) return 0;
+    }
+
+    *storage = (VkRenderingFragmentShadingRateAttachmentInfoKHR){
+        .sType = VK_STRUCTURE_TYPE_RENDERING_FRAGMENT_SHADING_RATE_ATTACHMENT_INFO_KHR,
+        .pNext = in->pNext,
+        .imageView = c->rate_view,
+        .imageLayout = VK_IMAGE_LAYOUT_GENERAL,
+        .shadingRateAttachmentTexelSize = c->texel,
+    };
+    *out = *in;
+    out->pNext = storage;
+    return 1;
+}
@@ -0,0 +1,49 @@
+// src/drivers/xclipse/vrs_content.h
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include "xeno_dispatch.h"
+
+/*
+  Content-adaptive shading-rate attachment (vrs_content.c).
+
+  At every present the swapchain image that is about to go out is analysed
+  by a compute pass (assets/shaders/src/vrs_content.comp) into an R8_UINT
+  VK_KHR_fragment_shading_rate attachment; flat and dark tiles get coarse
+  rates, edges and text keep 1x1. The next frame's main pass (the
+  dynamic-rendering pass that covers the whole swapchain extent) gets the
+  attachment chained in, combined with the pipeline rate from vrs.c. With
+  the texture heap (bindless.h) the pass reads swapchain images by heap
+  slot (vrs_content_bindless.comp) and binds the same two sets for every
+  image.
+
+  The pass runs on the present queue ahead of the present itself: it waits
+  for the app's present semaphores and the present waits for it instead.
+  The attachment is ordered against the next frame only by pipeline
+  barriers, so the design assumes main passes run on the present queue:
+  the pass is skipped, and nothing is attached, unless that queue is the
+  only graphics-capable queue the app has fetched.
+*/
+
+typedef struct XenoVrsContent XenoVrsContent;
+
+/* Sets d->vrs_content when the device supports attachment rates. The
+   returned combiner op is what vrs.c should use for the attachment. */
+int xclipse_vrs_content_create(XenoDeviceDispatch* d, int max_rate, VkFragmentShadingRateCombinerOpKHR* attachment_op);
+void xclipse_vrs_content_destroy(XenoDeviceDispatch* d);
+
+void xclipse_vrs_content_track_queue(XenoDeviceDispatch* d, VkQueue queue, uint32_t family);
+
+/* Swapchain images have to be sampleable for the analysis pass. */
+void xclipse_vrs_content_adjust_swapchain(XenoDeviceDispatch* d, VkSwapchainCreateInfoKHR* ci);
+void xclipse_vrs_content_swapchain_created(XenoDeviceDispatch* d, VkSwapchainKHR swapchain,
+                                           const VkSwapchainCreateInfoKHR* ci);
+void xclipse_vrs_content_swapchain_destroyed(XenoDeviceDispatch* d, VkSwapchainKHR swapchain);
+
+/* Records and submits the analysis for the presented image; on success the
+   present's wait semaphores are replaced by the pass's signal semaphore. */
+void xclipse_vrs_content_present(XenoDeviceDispatch* d, VkQueue queue, VkPresentInfoKHR* info);
+
+/* Chains the attachment into a main pass; returns 1 if `out` should be used. */
+int xclipse_vrs_content_attach(XenoDeviceDispatch* d, const VkRenderingInfo* in, VkRenderingInfo* out,
+                               VkRenderingFragmentShadingRateAttachmentInfoKHR* storage);
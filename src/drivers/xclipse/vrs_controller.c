@@ -0,0 +1,67 @@
+// src/drivers/xclipse/vrs_controller.c
+#include "vrs_controller.h"
+
+static const uint32_t k_level_size[XENO_VRS_LEVEL_COUNT][2] = {
+    { 1u, 1u }, { 2u, 1u }, { 2u, 2u }, { 4u, 2u }, { 4u, 4u },
+};
+
+void xeno_vrs_controller_config_defaults(XenoVrsControllerConfig* cfg, int target_fps, int max_rate)
+{
+    cfg->target_frame_ms = target_fps > 0 ? 1000.0f / (float)target_fps : 0.0f;
+    cfg->coarsen_margin = 0.05f;
+    cfg->refine_margin = 0.20f;
+    cfg->smoothing = 0.15f;
+    cfg->hold_frames = 20u;
+    cfg->max_level = max_rate >= 4 ? 4 : (max_rate >= 2 ? 2 : 0);
+}
+
+void xeno_vrs_controller_init(XenoVrsController* c, const XenoVrsControllerConfig* cfg)
+{
+    c->cfg = *cfg;
+    if (c->cfg.max_level < 0) c->cfg.max_level = 0;
+    if (c->cfg.max_level >= XENO_VRS_LEVEL_COUNT) c->cfg.max_level = XENO_VRS_LEVEL_COUNT - 1;
+    if (!(c->cfg.smoothing > 0.0f && c->cfg.smoothing <= 1.0f)) c->cfg.smoothing = 0.15f;
+    c->avg_ms = 0.0f;
+    c->level = 0;
+    c->over_frames = 0;
+    c->under_frames = 0;
+    c->samples = 0;
+}
+
+int xeno_vrs_controller_update(XenoVrsController* c, float gpu_frame_ms)
+{
+    if (c->cfg.target_frame_ms <= 0.0f || c->cfg.max_level == 0) return c->level = 0;
+    if (!(gpu_frame_ms > 0.0f)) return c->level;   /* lost/invalid sample */
+
+    c->avg_ms = c->samples++ ? c->avg_ms + c->cfg.smoothing * (gpu_frame_ms - c->avg_ms) : gpu_frame_ms;
+
+    const float hi = c->cfg.target_frame_ms * (1.0f + c->cfg.coarsen_margin);
+    const float lo = c->cfg.target_frame_ms * (1.0f - c->cfg.refine_margin);
+
+    if (c->avg_ms > hi) {
+        c->under_frames = 0;
+        if (++c->over_frames >= c->cfg.hold_frames && c->level < c->cfg.max_level) {
+            c->level++;
+            c->over_frames = 0;
+        }
+    } else if (c->avg_ms < lo) {
+        c->over_frames = 0;
+        if (++c->under_frames >= 2u * c->cfg.hold_frames && c->level > 0) {
+            c->level--;
+            c->under_frames = 0;
+        }
+    } else {
+        /* Inside the dead band: hold the current rate. */
+        c->over_frames = 0;
+        c->under_frames = 0;
+    }
+    return c->level;
+}
+
+void xeno_vrs_level_size(int level, uint32_t* width, uint32_t* height)
+{
+    if (level < 0) level = 0;
+    if (level >= XENO_VRS_LEVEL_COUNT) level = XENO_VRS_LEVEL_COUNT - 1;
+    *width = k_level_size[level][0];
+    *height = k_level_size[level][1];
+}
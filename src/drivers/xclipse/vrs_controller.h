@@ -0,0 +1,50 @@
+// src/drivers/xclipse/vrs_controller.h
+#pragma once
+
+#include <stdint.h>
+
+/*
+  Frame-time driven shading-rate controller.
+
+  Pure logic with no Vulkan calls, so it can be driven from a recorded or
+  simulated timing trace (tests/vrs_controller_test.c). The layer feeds it
+  the measured GPU time once per frame and applies the returned level at
+  render-pass begin (see vrs.c).
+
+  The rate walks a ladder 1x1 -> 2x1 -> 2x2 -> 4x2 -> 4x4. The measurement
+  is smoothed with an EMA; the controller coarsens only once the average has
+  been over budget for hold_frames frames and refines only after it has
+  been well under budget for twice that long, so it never oscillates
+  between two neighbouring rates.
+*/
+
+#define XENO_VRS_LEVEL_COUNT 5
+
+typedef struct XenoVrsControllerConfig {
+    float target_frame_ms;   /* <= 0 disables the controller (level stays 0) */
+    float coarsen_margin;    /* coarsen when avg > target * (1 + margin) */
+    float refine_margin;     /* refine when avg < target * (1 - margin) */
+    float smoothing;         /* EMA weight of the newest sample, (0, 1] */
+    uint32_t hold_frames;    /* frames a condition must persist before stepping */
+    int max_level;           /* highest ladder index allowed, 0..XENO_VRS_LEVEL_COUNT-1 */
+} XenoVrsControllerConfig;
+
+typedef struct XenoVrsController {
+    XenoVrsControllerConfig cfg;
+    float avg_ms;
+    int level;
+    uint32_t over_frames;
+    uint32_t under_frames;
+    uint32_t samples;
+} XenoVrsController;
+
+/* Defaults for a target fps; max_rate is the coarsest per-axis rate (1, 2 or 4). */
+void xeno_vrs_controller_config_defaults(XenoVrsControllerConfig* cfg, int target_fps, int max_rate);
+
+void xeno_vrs_controller_init(XenoVrsController* c, const XenoVrsControllerConfig* cfg);
+
+/* Feeds one frame's GPU time; returns the level to use from now on. */
+int xeno_vrs_controller_update(XenoVrsController* c, float gpu_frame_ms);
+
+/* Fragment size for a ladder level. */
+void xeno_vrs_level_size(int level, uint32_t* width, uint32_t* height);
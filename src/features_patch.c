@@ -1,100 +1,76 @@
 #include "logging.h"
 #include "features_patch.h"
 
+#include <stddef.h>
 #include <string.h>
 
-static int ext_present(const char* name, const VkExtensionProperties* props, uint32_t count) {
-    for (uint32_t i = 0; i < count; ++i) {
-        if (strcmp(props[i].extensionName, name) == 0) return 1;
+VkResult xeno_patch_extensions(VkPhysicalDevice phys,
+                               const XenoCapsProcs* procs,
+                               const char* pLayerName,
+                               uint32_t* pPropertyCount,
+                               VkExtensionProperties* pProperties) {
+    (void)pLayerName;
+    const XenoCapsSnapshot* caps = xeno_caps_get(phys, procs);
+    if (!caps) return VK_ERROR_OUT_OF_HOST_MEMORY;
+
+    if (!pProperties) {
+        *pPropertyCount = caps->ext_count;
+        return VK_SUCCESS;
     }
-    return 0;
+    uint32_t n = *pPropertyCount < caps->ext_count ? *pPropertyCount : caps->ext_count;
+    memcpy(pProperties, caps->exts, sizeof(VkExtensionProperties) * n);
+    *pPropertyCount = n;
+    return n < caps->ext_count ? VK_INCOMPLETE : VK_SUCCESS;
 }
 
-void xeno_patch_extensions(VkPhysicalDevice phys,
-                           PFN_vkEnumerateDeviceExtensionProperties real_enum_ext,
-                           const char* pLayerName,
-                           uint32_t* pPropertyCount,
-                           VkExtensionProperties* pProperties) {
-    (void)phys; (void)pLayerName;
-    // Query real
-    uint32_t count = 0;
-    real_enum_ext(phys, NULL, &count, NULL);
-    VkExtensionProperties stackprops[128];
-    VkExtensionProperties* props = stackprops;
-    if (count > 128) props = (VkExtensionProperties*)malloc(sizeof(VkExtensionProperties) * count);
-    real_enum_ext(phys, NULL, &count, props);
+/* Copies a snapshot struct into the caller's, keeping the caller's sType/pNext. */
+static void copy_body(VkBaseOutStructure* dst, const void* src, size_t size) {
+    memcpy((char*)dst + sizeof(VkBaseOutStructure),
+           (const char*)src + sizeof(VkBaseOutStructure),
+           size - sizeof(VkBaseOutStructure));
+}
 
-    // Candidate virtual extensions
-    const char* virt_exts[] = {
-        VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME,
-        VK_EXT_ROBUSTNESS_2_EXTENSION_NAME,
-        VK_KHR_SHADER_FLOAT16_INT8_EXTENSION_NAME,
-        // Consider advertising dynamic rendering if DXVK needs it and it is safe to emulate
-        VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME,
-        // Additional compatibility extensions
-        VK_EXT_CUSTOM_BORDER_COLOR_EXTENSION_NAME,
-        VK_EXT_PRIMITIVE_TOPOLOGY_LIST_RESTART_EXTENSION_NAME,
-    };
-    VkExtensionProperties added[8];
-    uint32_t add_count = 0;
-    for (size_t i = 0; i < sizeof(virt_exts)/sizeof(virt_exts[0]); ++i) {
-        if (!ext_present(virt_exts[i], props, count)) {
-            strncpy(added[add_count].extensionName, virt_exts[i], VK_MAX_EXTENSION_NAME_SIZE);
-            added[add_count].specVersion = 1;
-            add_count++;
-        }
+static int fill_known(VkBaseOutStructure* p, const XenoCapsFeatures* f) {
+    switch (p->sType) {
+    case VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES:
+        copy_body(p, &f->descriptor_indexing, sizeof(f->descriptor_indexing));
+        return 1;
+    case VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ROBUSTNESS_2_FEATURES_EXT:
+        copy_body(p, &f->robustness2, sizeof(f->robustness2));
+        return 1;
+    case VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FLOAT16_INT8_FEATURES_KHR:
+        copy_body(p, &f->float16_int8, sizeof(f->float16_int8));
+        return 1;
+    case VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DYNAMIC_RENDERING_FEATURES:
+        copy_body(p, &f->dynamic_rendering, sizeof(f->dynamic_rendering));
+        return 1;
+    case VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_CUSTOM_BORDER_COLOR_FEATURES_EXT:
+        copy_body(p, &f->custom_border_color, sizeof(f->custom_border_color));
+        return 1;
+    case VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRIMITIVE_TOPOLOGY_LIST_RESTART_FEATURES_EXT:
+        copy_body(p, &f->topology_list_restart, sizeof(f->topology_list_restart));
+        return 1;
+    default:
+        return 0;
     }
-
-    if (!pProperties) {
-        *pPropertyCount = count + add_count;
-    } else {
-        uint32_t cap = *pPropertyCount;
-        uint32_t out = 0;
-        for (; out < count && out < cap; ++out) pProperties[out] = props[out];
-        for (uint32_t i = 0; i < add_count && out < cap; ++i) pProperties[out++] = added[i];
-        if (*pPropertyCount < count + add_count) {
-            return; // VK_INCOMPLETE by caller
-        }
-        *pPropertyCount = count + add_count;
-    }
-
-    if (props != stackprops) free(props);
 }
 
 void xeno_patch_features2(VkPhysicalDevice phys,
-                          PFN_vkGetPhysicalDeviceFeatures2 real_get_features2,
+                          const XenoCapsProcs* procs,
                           VkPhysicalDeviceFeatures2* pFeatures2) {
-    real_get_features2(phys, pFeatures2);
+    const XenoCapsSnapshot* caps = xeno_caps_get(phys, procs);
+    if (!caps) {
+        procs->get_features2(phys, pFeatures2);
+        return;
+    }
 
-    VkBaseOutStructure* p = (VkBaseOutStructure*)pFeatures2->pNext;
-    while (p) {
-        if (p->sType == VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES) {
-            VkPhysicalDeviceDescriptorIndexingFeatures* f = (VkPhysicalDeviceDescriptorIndexingFeatures*)p;
-            // enable conservative subset by default
-            f->shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
-            f->descriptorBindingPartiallyBound = VK_TRUE;
-            f->runtimeDescriptorArray = VK_TRUE;
-        } else if (p->sType == VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ROBUSTNESS_2_FEATURES_EXT) {
-            VkPhysicalDeviceRobustness2FeaturesEXT* f = (VkPhysicalDeviceRobustness2FeaturesEXT*)p;
-            f->robustBufferAccess2 = VK_TRUE;
-            f->robustImageAccess2 = VK_TRUE;
-        } else if (p->sType == VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FLOAT16_INT8_FEATURES_KHR) {
-            VkPhysicalDeviceFloat16Int8FeaturesKHR* f = (VkPhysicalDeviceFloat16Int8FeaturesKHR*)p;
-            f->shaderFloat16 = VK_TRUE;
-            f->shaderInt8 = VK_TRUE;
-        } else if (p->sType == VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DYNAMIC_RENDERING_FEATURES) {
-            VkPhysicalDeviceDynamicRenderingFeatures* f = (VkPhysicalDeviceDynamicRenderingFeatures*)p;
-            f->dynamicRendering = VK_TRUE;
-        } else if (p->sType == VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_CUSTOM_BORDER_COLOR_FEATURES_EXT) {
-            VkPhysicalDeviceCustomBorderColorFeaturesEXT* f = (VkPhysicalDeviceCustomBorderColorFeaturesEXT*)p;
-            f->customBorderColors = VK_TRUE;
-            f->customBorderColorWithoutFormat = VK_TRUE;
-        } else if (p->sType == VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRIMITIVE_TOPOLOGY_LIST_RESTART_FEATURES_EXT) {
-            VkPhysicalDevicePrimitiveTopologyListRestartFeaturesEXT* f = (VkPhysicalDevicePrimitiveTopologyListRestartFeaturesEXT*)p;
-            f->primitiveTopologyListRestart = VK_TRUE;
-            f->primitiveTopologyPatchListRestart = VK_TRUE;
+    // Structs we don't track still have to come from the driver.
+    for (VkBaseOutStructure* p = (VkBaseOutStructure*)pFeatures2->pNext; p; p = p->pNext) {
+        if (!fill_known(p, &caps->features)) {
+            procs->get_features2(phys, pFeatures2);
+            for (p = (VkBaseOutStructure*)pFeatures2->pNext; p; p = p->pNext) fill_known(p, &caps->features);
+            break;
         }
-        p = p->pNext;
     }
+    pFeatures2->features = caps->features.core;
 }
-
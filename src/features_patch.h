@@ -2,13 +2,17 @@
 
 #include <vulkan/vulkan.h>
 
-void xeno_patch_extensions(VkPhysicalDevice phys,
-                           PFN_vkEnumerateDeviceExtensionProperties real_enum_ext,
-                           const char* pLayerName,
-                           uint32_t* pPropertyCount,
-                           VkExtensionProperties* pProperties);
+#include "caps_cache.h"
+
+/* Both are served from the per-device capability snapshot; the driver is
+   only reached on the first call for a device (or for feature structs the
+   snapshot does not track). */
+VkResult xeno_patch_extensions(VkPhysicalDevice phys,
+                               const XenoCapsProcs* procs,
+                               const char* pLayerName,
+                               uint32_t* pPropertyCount,
+                               VkExtensionProperties* pProperties);
 
 void xeno_patch_features2(VkPhysicalDevice phys,
-                          PFN_vkGetPhysicalDeviceFeatures2 real_get_features2,
+                          const XenoCapsProcs* procs,
                           VkPhysicalDeviceFeatures2* pFeatures2);
-
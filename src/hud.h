@@ -2,6 +2,7 @@
 
 #include <vulkan/vulkan.h>
 #include <stdint.h>
+#include "xeno_mem.h"
 
 typedef struct XenoHUDContext {
     VkDevice device;
@@ -13,12 +14,12 @@ typedef struct XenoHUDContext {
     VkDescriptorPool descriptorPool;
     VkSampler fontSampler;
     VkImage fontImage;
-    VkDeviceMemory fontImageMemory;
+    XenoMemAlloc fontImageAlloc;
     VkImageView fontImageView;
     VkBuffer vertexBuffer;
-    VkDeviceMemory vertexBufferMemory;
+    XenoMemAlloc vertexBufferAlloc;
     VkBuffer indexBuffer;
-    VkDeviceMemory indexBufferMemory;
+    XenoMemAlloc indexBufferAlloc;
     uint32_t swapchainImageCount;
     VkFramebuffer* framebuffers;
     int initialized;
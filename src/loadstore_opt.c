@@ -0,0 +1,1314 @@
+// src/loadstore_opt.c
+/*
+  Attachment load/store-op optimizer (see loadstore_opt.h).
+
+  Ops are decided per aspect: color or depth, and stencil. Every render
+  pass instance is planned against the state as it was before it began,
+  then the ops actually recorded are committed back: loads mark the image
+  as read, DONT_CARE stores add the view to the command buffer's
+  discarded list and any other store takes it out again.
+
+  A variant render pass is created from a copy of the app's create info
+  with only the attachment ops changed. The copy includes the pNext
+  chains; render passes with a structure copy_chain() does not know are
+  left alone. Variants are keyed by four masks of attachments whose
+  load, stencil load, store and stencil store were dropped.
+
+  Continuing a render pass instance (pass_fusion) compares shapes: the
+  words of a render pass's create info that the two passes must agree on,
+  serialized once at creation. Load ops, store ops and initial layouts
+  are left out; fuse() checks those per instance.
+
+  Tables work as in rp_cache.c. One mutex guards them, the variants and
+  the discarded views of every command buffer.
+*/
+#include "loadstore_opt.h"
+#include "xeno_cmd.h"
+#include "perf_conf.h"
+#include "xeno_log.h"
+#include "xeno_trace.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#define XENO_LS_MIN_SLOTS 64u
+#define XENO_LS_MAX_PASS_ATTACHMENTS 64u        /* variant masks are 64-bit */
+#define XENO_LS_MAX_SHAPE 1024u                 /* words; larger render passes are never continued */
+
+/* Masks of a variant, by index. */
+enum { MASK_LOAD, MASK_STENCIL_LOAD, MASK_STORE, MASK_STENCIL_STORE };
+
+/* Usage that lets something other than a render pass load read an image. */
+#define READ_USAGE (VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT | \
+                    VK_IMAGE_USAGE_TRANSFER_SRC_BIT)
+
+/* Accesses draws of one subpass already see in rasterization order; an
+   external dependency on nothing else is met by continuing the instance. */
+#define ATTACHMENT_ACCESS (VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | \
+                           VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT)
+
+/* An image or an image view. */
+typedef struct Object {
+    uint64_t handle;                        /* 0 = empty slot */
+    uint64_t image;                         /* views: their image */
+    VkFormat format;
+    VkSampleCountFlagBits samples;
+    uint32_t mip, base_layer, layer_count;  /* views */
+    VkImageUsageFlags usage;                /* images */
+    uint32_t layers;                        /* images: arrayLayers */
+    uint64_t first_frame;                   /* images: first frame a render pass used it, 0 = not yet */
+    int loaded;                             /* images: a render pass loaded it */
+    int dropped;                            /* images: learn dropped a store */
+} Object;
+
+typedef struct ObjectMap {
+    Object* slots;
+    uint32_t cap;                           /* power of two */
+    uint32_t count;
+} ObjectMap;
+
+/* Heap entries that start with their handle. */
+typedef struct EntryMap {
+    uint64_t** slots;
+    uint32_t cap;                           /* power of two */
+    uint32_t count;
+} EntryMap;
+
+typedef struct Framebuffer {
+    uint64_t handle;
+    uint32_t layers;
+    uint32_t view_count;                    /* 0 = imageless */
+    VkImageView views[];
+} Framebuffer;
+
+typedef struct Variant {
+    uint64_t mask[4];
+    VkRenderPass rp;
+} Variant;
+
+typedef struct RenderPass {
+    uint64_t handle;
+    int v2;                                 /* created with vkCreateRenderPass2 */
+    int multiview;
+    VkRenderPassCreateInfo ci;
+    VkRenderPassCreateInfo2 ci2;
+    void** allocs;                          /* everything the copied create info points to */
+    uint32_t alloc_count, alloc_cap;
+    const uint32_t* shape;                  /* NULL = instances are never continued */
+    uint32_t shape_len;
+    uint32_t variant_count;
+    Variant variants[XENO_LOADSTORE_MAX_VARIANTS];
+} RenderPass;
+
+struct XenoLoadStore {
+    pthread_mutex_t mtx;
+    ObjectMap images, views;
+    EntryMap framebuffers, passes;
+    uint64_t frame;                         /* presents so far + 1 */
+    uint64_t frame_bytes;                   /* saved since the last present */
+    uint64_t saved_bytes, loads_dropped, stores_dropped, variants_created, variants_full, fused;
+};
+
+/* One attachment of a render pass instance. Index 0 of the op arrays is
+   the color or depth aspect, 1 the stencil aspect. */
+typedef struct Attachment {
+    const Object* view;                     /* NULL = not planned */
+    Object* image;                          /* NULL = image not created through the layer */
+    VkFormat format;
+    VkSampleCountFlagBits samples;
+    uint32_t used;                          /* bit k: aspect k is attached */
+    int fixed;                              /* dynamic-rendering resolve target: written, ops not ours */
+    VkAttachmentLoadOp load[2];
+    VkAttachmentStoreOp store[2];
+    int undefined[2];                       /* starts from VK_IMAGE_LAYOUT_UNDEFINED */
+} Attachment;
+
+static uint32_t handle_slot(uint64_t handle, uint32_t mask)
+{
+    return (uint32_t)((handle * 0x9E3779B97F4A7C15ull) >> 32) & mask;
+}
+
+static const VkBaseInStructure* find_struct(const void* chain, VkStructureType type)
+{
+    const VkBaseInStructure* s = (const VkBaseInStructure*)chain;
+    while (s && s->sType != type) s = s->pNext;
+    return s;
+}
+
+/* ---- tables (caller holds mtx) ------------------------------------ */
+
+static int objects_grow(ObjectMap* m)
+{
+    uint32_t cap = m->cap ? m->cap * 2u : XENO_LS_MIN_SLOTS;
+    Object* slots = (Object*)calloc(cap, sizeof(*slots));
+    if (!slots) return 0;
+    for (uint32_t i = 0; i < m->cap; ++i) {
+        if (!m->slots[i].handle) continue;
+        uint32_t j = handle_slot(m->slots[i].handle, cap - 1u);
+        while (slots[j].handle) j = (j + 1u) & (cap - 1u);
+        slots[j] = m->slots[i];
+    }
+    free(m->slots);
+    m->slots = slots;
+    m->cap = cap;
+    return 1;
+}
+
+static Object* objects_find(const ObjectMap* m, uint64_t handle)
+{
+    if (!m->cap || !handle) return NULL;
+    uint32_t mask = m->cap - 1u;
+    for (uint32_t i = handle_slot(handle, mask); m->slots[i].handle; i = (i + 1u) & mask) {
+        if (m->slots[i].handle == handle) return &m->slots[i];
+    }
+    return NULL;
+}
+
+static void objects_remove(ObjectMap* m, uint64_t handle)
+{
+    Object* o = objects_find(m, handle);
+    if (!o) return;
+    uint32_t mask = m->cap - 1u;
+    uint32_t i = (uint32_t)(o - m->slots);
+    m->slots[i].handle = 0;
+    m->count--;
+    for (uint32_t j = (i + 1u) & mask; m->slots[j].handle; j = (j + 1u) & mask) {
+        uint32_t home = handle_slot(m->slots[j].handle, mask);
+        if (((j - home) & mask) >= ((j - i) & mask)) {
+            m->slots[i] = m->slots[j];
+            m->slots[j].handle = 0;
+            i = j;
+        }
+    }
+}
+
+static void objects_put(ObjectMap* m, const Object* o)
+{
+    objects_remove(m, o->handle);           /* handle reused without a destroy we saw */
+    if ((m->count + 1u) * 2u > m->cap && !objects_grow(m)) return;
+    uint32_t mask = m->cap - 1u;
+    uint32_t i = handle_slot(o->handle, mask);
+    while (m->slots[i].handle) i = (i + 1u) & mask;
+    m->slots[i] = *o;
+    m->count++;
+}
+
+static int entries_grow(EntryMap* m)
+{
+    uint32_t cap = m->cap ? m->cap * 2u : XENO_LS_MIN_SLOTS;
+    uint64_t** slots = (uint64_t**)calloc(cap, sizeof(*slots));
+    if (!slots) return 0;
+    for (uint32_t i = 0; i < m->cap; ++i) {
+        if (!m->slots[i]) continue;
+        uint32_t j = handle_slot(*m->slots[i], cap - 1u);
+        while (slots[j]) j = (j + 1u) & (cap - 1u);
+        slots[j] = m->slots[i];
+    }
+    free(m->slots);
+    m->slots = slots;
+    m->cap = cap;
+    return 1;
+}
+
+static void* entries_find(const EntryMap* m, uint64_t handle)
+{
+    if (!m->cap || !handle) return NULL;
+    uint32_t mask = m->cap - 1u;
+    for (uint32_t i = handle_slot(handle, mask); m->slots[i]; i = (i + 1u) & mask) {
+        if (*m->slots[i] == handle) return m->slots[i];
+    }
+    return NULL;
+}
+
+/* Unlinks the entry for handle and returns it. */
+static void* entries_take(EntryMap* m, uint64_t handle)
+{
+    if (!m->cap || !handle) return NULL;
+    uint32_t mask = m->cap - 1u;
+    uint32_t i = handle_slot(handle, mask);
+    while (m->slots[i] && *m->slots[i] != handle) i = (i + 1u) & mask;
+    uint64_t* e = m->slots[i];
+    if (!e) return NULL;
+    m->slots[i] = NULL;
+    m->count--;
+    for (uint32_t j = (i + 1u) & mask; m->slots[j]; j = (j + 1u) & mask) {
+        uint32_t home = handle_slot(*m->slots[j], mask);
+        if (((j - home) & mask) >= ((j - i) & mask)) {
+            m->slots[i] = m->slots[j];
+            m->slots[j] = NULL;
+            i = j;
+        }
+    }
+    return e;
+}
+
+static int entries_insert(EntryMap* m, uint64_t* e)
+{
+    if ((m->count + 1u) * 2u > m->cap && !entries_grow(m)) return 0;
+    uint32_t mask = m->cap - 1u;
+    uint32_t i = handle_slot(*e, mask);
+    while (m->slots[i]) i = (i + 1u) & mask;
+    m->slots[i] = e;
+    m->count++;
+    return 1;
+}
+
+/* ---- render pass copies -------------------------------------------- */
+
+static void* dup(RenderPass* rp, int* failed, const void* src, size_t size)
+{
+    if (!src || !size || *failed) return NULL;
+    if (rp->alloc_count == rp->alloc_cap) {
+        uint32_t cap = rp->alloc_cap ? rp->alloc_cap * 2u : 16u;
+        void** allocs = (void**)realloc(rp->allocs, cap * sizeof(*allocs));
+        if (!allocs) {
+            *failed = 1;
+            return NULL;
+        }
+        rp->allocs = allocs;
+        rp->alloc_cap = cap;
+    }
+    void* p = malloc(size);
+    if (!p) {
+        *failed = 1;
+        return NULL;
+    }
+    memcpy(p, src, size);
+    rp->allocs[rp->alloc_count++] = p;
+    return p;
+}
+
+static const void* copy_chain(RenderPass* rp, int* failed, const void* chain);
+
+static const VkAttachmentReference2* copy_refs2(RenderPass* rp, int* failed, const VkAttachmentReference2* refs,
+                                                uint32_t count)
+{
+    VkAttachmentReference2* r = (VkAttachmentReference2*)dup(rp, failed, refs, count * sizeof(*r));
+    for (uint32_t i = 0; r && i < count; ++i) r[i].pNext = copy_chain(rp, failed, r[i].pNext);
+    return r;
+}
+
+/* Copies a pNext chain of the structures render pass creation takes;
+   anything else fails the copy. */
+static const void* copy_chain(RenderPass* rp, int* failed, const void* chain)
+{
+    const void* head = NULL;
+    VkBaseOutStructure* prev = NULL;
+    for (const VkBaseInStructure* s = (const VkBaseInStructure*)chain; s && !*failed; s = s->pNext) {
+        void* copy = NULL;
+        switch (s->sType) {
+        case VK_STRUCTURE_TYPE_ATTACHMENT_DESCRIPTION_STENCIL_LAYOUT:
+            copy = dup(rp, failed, s, sizeof(VkAttachmentDescriptionStencilLayout));
+            break;
+        case VK_STRUCTURE_TYPE_ATTACHMENT_REFERENCE_STENCIL_LAYOUT:
+            copy = dup(rp, failed, s, sizeof(VkAttachmentReferenceStencilLayout));
+            break;
+        case VK_STRUCTURE_TYPE_MEMORY_BARRIER_2:
+            copy = dup(rp, failed, s, sizeof(VkMemoryBarrier2));
+            break;
+        case VK_STRUCTURE_TYPE_RENDER_PASS_MULTIVIEW_CREATE_INFO: {
+            VkRenderPassMultiviewCreateInfo* m =
+                (VkRenderPassMultiviewCreateInfo*)dup(rp, failed, s, sizeof(VkRenderPassMultiviewCreateInfo));
+            if (!m) break;
+            m->pViewMasks = (const uint32_t*)dup(rp, failed, m->pViewMasks, m->subpassCount * sizeof(uint32_t));
+            m->pViewOffsets = (const int32_t*)dup(rp, failed, m->pViewOffsets, m->dependencyCount * sizeof(int32_t));
+            m->pCorrelationMasks =
+                (const uint32_t*)dup(rp, failed, m->pCorrelationMasks, m->correlationMaskCount * sizeof(uint32_t));
+            for (uint32_t i = 0; i < m->subpassCount && m->pViewMasks; ++i) rp->multiview |= m->pViewMasks[i] != 0;
+            copy = m;
+            break;
+        }
+        case VK_STRUCTURE_TYPE_RENDER_PASS_INPUT_ATTACHMENT_ASPECT_CREATE_INFO: {
+            VkRenderPassInputAttachmentAspectCreateInfo* a = (VkRenderPassInputAttachmentAspectCreateInfo*)dup(
+                rp, failed, s, sizeof(VkRenderPassInputAttachmentAspectCreateInfo));
+            if (!a) break;
+            a->pAspectReferences = (const VkInputAttachmentAspectReference*)dup(
+                rp, failed, a->pAspectReferences, a->aspectReferenceCount * sizeof(VkInputAttachmentAspectReference));
+            copy = a;
+            break;
+        }
+        case VK_STRUCTURE_TYPE_SUBPASS_DESCRIPTION_DEPTH_STENCIL_RESOLVE: {
+            VkSubpassDescriptionDepthStencilResolve* r = (VkSubpassDescriptionDepthStencilResolve*)dup(
+                rp, failed, s, sizeof(VkSubpassDescriptionDepthStencilResolve));
+            if (!r) break;
+            r->pDepthStencilResolveAttachment = copy_refs2(rp, failed, r->pDepthStencilResolveAttachment, 1);
+            copy = r;
+            break;
+        }
+        case VK_STRUCTURE_TYPE_FRAGMENT_SHADING_RATE_ATTACHMENT_INFO_KHR: {
+            VkFragmentShadingRateAttachmentInfoKHR* f = (VkFragmentShadingRateAttachmentInfoKHR*)dup(
+                rp, failed, s, sizeof(VkFragmentShadingRateAttachmentInfoKHR));
+            if (!f) break;
+            f->pFragmentShadingRateAttachment = copy_refs2(rp, failed, f->pFragmentShadingRateAttachment, 1);
+            copy = f;
+            break;
+        }
+        default:
+            *failed = 1;
+            break;
+        }
+        if (!copy) break;
+        ((VkBaseOutStructure*)copy)->pNext = NULL;
+        if (prev) prev->pNext = (VkBaseOutStructure*)copy;
+        else head = copy;
+        prev = (VkBaseOutStructure*)copy;
+    }
+    return head;
+}
+
+static int copy_render_pass(RenderPass* rp, const VkRenderPassCreateInfo* ci)
+{
+    int failed = 0;
+    rp->ci = *ci;
+    rp->ci.pNext = copy_chain(rp, &failed, ci->pNext);
+    rp->ci.pAttachments = (const VkAttachmentDescription*)dup(rp, &failed, ci->pAttachments,
+                                                              ci->attachmentCount * sizeof(VkAttachmentDescription));
+    VkSubpassDescription* subs =
+        (VkSubpassDescription*)dup(rp, &failed, ci->pSubpasses, ci->subpassCount * sizeof(VkSubpassDescription));
+    for (uint32_t i = 0; subs && i < ci->subpassCount; ++i) {
+        VkSubpassDescription* s = &subs[i];
+        s->pInputAttachments = (const VkAttachmentReference*)dup(
+            rp, &failed, s->pInputAttachments, s->inputAttachmentCount * sizeof(VkAttachmentReference));
+        s->pColorAttachments = (const VkAttachmentReference*)dup(
+            rp, &failed, s->pColorAttachments, s->colorAttachmentCount * sizeof(VkAttachmentReference));
+        s->pResolveAttachments = (const VkAttachmentReference*)dup(
+            rp, &failed, s->pResolveAttachments, s->colorAttachmentCount * sizeof(VkAttachmentReference));
+        s->pDepthStencilAttachment =
+            (const VkAttachmentReference*)dup(rp, &failed, s->pDepthStencilAttachment, sizeof(VkAttachmentReference));
+        s->pPreserveAttachments = (const uint32_t*)dup(rp, &failed, s->pPreserveAttachments,
+                                                       s->preserveAttachmentCount * sizeof(uint32_t));
+    }
+    rp->ci.pSubpasses = subs;
+    rp->ci.pDependencies = (const VkSubpassDependency*)dup(rp, &failed, ci->pDependencies,
+                                                           ci->dependencyCount * sizeof(VkSubpassDependency));
+    return !failed;
+}
+
+static int copy_render_pass2(RenderPass* rp, const VkRenderPassCreateInfo2* ci)
+{
+    int failed = 0;
+    rp->v2 = 1;
+    rp->ci2 = *ci;
+    rp->ci2.pNext = copy_chain(rp, &failed, ci->pNext);
+    VkAttachmentDescription2* att = (VkAttachmentDescription2*)dup(
+        rp, &failed, ci->pAttachments, ci->attachmentCount * sizeof(VkAttachmentDescription2));
+    for (uint32_t i = 0; att && i < ci->attachmentCount; ++i) att[i].pNext = copy_chain(rp, &failed, att[i].pNext);
+    rp->ci2.pAttachments = att;
+    VkSubpassDescription2* subs =
+        (VkSubpassDescription2*)dup(rp, &failed, ci->pSubpasses, ci->subpassCount * sizeof(VkSubpassDescription2));
+    for (uint32_t i = 0; subs && i < ci->subpassCount; ++i) {
+        VkSubpassDescription2* s = &subs[i];
+        s->pNext = copy_chain(rp, &failed, s->pNext);
+        s->pInputAttachments = copy_refs2(rp, &failed, s->pInputAttachments, s->inputAttachmentCount);
+        s->pColorAttachments = copy_refs2(rp, &failed, s->pColorAttachments, s->colorAttachmentCount);
+        s->pResolveAttachments = copy_refs2(rp, &failed, s->pResolveAttachments, s->colorAttachmentCount);
+        s->pDepthStencilAttachment = copy_refs2(rp, &failed, s->pDepthStencilAttachment, 1);
+        s->pPreserveAttachments = (const uint32_t*)dup(rp, &failed, s->pPreserveAttachments,
+                                                       s->preserveAttachmentCount * sizeof(uint32_t));
+        rp->multiview |= s->viewMask != 0;
+    }
+    rp->ci2.pSubpasses = subs;
+    VkSubpassDependency2* deps = (VkSubpassDependency2*)dup(rp, &failed, ci->pDependencies,
+                                                            ci->dependencyCount * sizeof(VkSubpassDependency2));
+    for (uint32_t i = 0; deps && i < ci->dependencyCount; ++i) deps[i].pNext = copy_chain(rp, &failed, deps[i].pNext);
+    rp->ci2.pDependencies = deps;
+    rp->ci2.pCorrelatedViewMasks = (const uint32_t*)dup(rp, &failed, ci->pCorrelatedViewMasks,
+                                                        ci->correlatedViewMaskCount * sizeof(uint32_t));
+    return !failed;
+}
+
+/* ---- shapes -------------------------------------------------------- */
+
+typedef struct Shape {
+    uint32_t words[XENO_LS_MAX_SHAPE];
+    uint32_t len;
+} Shape;
+
+static void put(Shape* s, uint32_t w)
+{
+    if (s->len < XENO_LS_MAX_SHAPE) s->words[s->len] = w;
+    s->len++;
+}
+
+static void put_ref(Shape* s, const VkAttachmentReference* r)
+{
+    put(s, r ? r->attachment : VK_ATTACHMENT_UNUSED);
+    put(s, r ? (uint32_t)r->layout : 0u);
+}
+
+static void put_ref2(Shape* s, const VkAttachmentReference2* r)
+{
+    const VkAttachmentReferenceStencilLayout* sl = r ? (const VkAttachmentReferenceStencilLayout*)find_struct(
+        r->pNext, VK_STRUCTURE_TYPE_ATTACHMENT_REFERENCE_STENCIL_LAYOUT) : NULL;
+    put(s, r ? r->attachment : VK_ATTACHMENT_UNUSED);
+    put(s, r ? (uint32_t)r->layout : 0u);
+    put(s, r ? r->aspectMask : 0u);
+    put(s, sl ? (uint32_t)sl->stencilLayout : 0u);
+}
+
+/* External dependencies that order more than attachment accesses stand
+   for work between the instances; render passes with one are never
+   continued. */
+static int external_ok(uint32_t src, uint32_t dst, VkAccessFlags src_access, VkAccessFlags dst_access)
+{
+    return (src != VK_SUBPASS_EXTERNAL && dst != VK_SUBPASS_EXTERNAL) || !((src_access | dst_access) & ~ATTACHMENT_ACCESS);
+}
+
+/* Returns 0 when instances of rp can never be continued: more than one
+   subpass, multiview, input attachments or a chain on the subpass or a
+   dependency. */
+static int shape_of(const RenderPass* rp, Shape* s)
+{
+    s->len = 0;
+    if (rp->multiview) return 0;
+    if (rp->v2) {
+        const VkRenderPassCreateInfo2* ci = &rp->ci2;
+        const VkSubpassDescription2* sp = ci->pSubpasses;
+        if (ci->subpassCount != 1 || sp->pNext || sp->inputAttachmentCount) return 0;
+        put(s, 2u);
+        put(s, ci->flags);
+        put(s, ci->attachmentCount);
+        for (uint32_t i = 0; i < ci->attachmentCount; ++i) {
+            const VkAttachmentDescription2* a = &ci->pAttachments[i];
+            const VkAttachmentDescriptionStencilLayout* sl = (const VkAttachmentDescriptionStencilLayout*)find_struct(
+                a->pNext, VK_STRUCTURE_TYPE_ATTACHMENT_DESCRIPTION_STENCIL_LAYOUT);
+            put(s, a->flags);
+            put(s, (uint32_t)a->format);
+            put(s, (uint32_t)a->samples);
+            put(s, (uint32_t)a->finalLayout);
+            put(s, sl ? (uint32_t)sl->stencilFinalLayout : 0u);
+        }
+        put(s, sp->flags);
+        put(s, (uint32_t)sp->pipelineBindPoint);
+        put(s, sp->colorAttachmentCount);
+        for (uint32_t j = 0; j < sp->colorAttachmentCount; ++j) {
+            put_ref2(s, &sp->pColorAttachments[j]);
+            put_ref2(s, sp->pResolveAttachments ? &sp->pResolveAttachments[j] : NULL);
+        }
+        put_ref2(s, sp->pDepthStencilAttachment);
+        put(s, sp->preserveAttachmentCount);
+        for (uint32_t j = 0; j < sp->preserveAttachmentCount; ++j) put(s, sp->pPreserveAttachments[j]);
+        put(s, ci->dependencyCount);
+        for (uint32_t j = 0; j < ci->dependencyCount; ++j) {
+            const VkSubpassDependency2* d = &ci->pDependencies[j];
+            if (d->pNext || !external_ok(d->srcSubpass, d->dstSubpass, d->srcAccessMask, d->dstAccessMask)) return 0;
+            put(s, d->srcSubpass);
+            put(s, d->dstSubpass);
+            put(s, d->srcStageMask);
+            put(s, d->dstStageMask);
+            put(s, d->srcAccessMask);
+            put(s, d->dstAccessMask);
+            put(s, d->dependencyFlags);
+        }
+    } else {
+        const VkRenderPassCreateInfo* ci = &rp->ci;
+        const VkSubpassDescription* sp = ci->pSubpasses;
+        if (ci->subpassCount != 1 || sp->inputAttachmentCount) return 0;
+        put(s, 1u);
+        put(s, ci->flags);
+        put(s, ci->attachmentCount);
+        for (uint32_t i = 0; i < ci->attachmentCount; ++i) {
+            const VkAttachmentDescription* a = &ci->pAttachments[i];
+            put(s, a->flags);
+            put(s, (uint32_t)a->format);
+            put(s, (uint32_t)a->samples);
+            put(s, (uint32_t)a->finalLayout);
+        }
+        put(s, sp->flags);
+        put(s, (uint32_t)sp->pipelineBindPoint);
+        put(s, sp->colorAttachmentCount);
+        for (uint32_t j = 0; j < sp->colorAttachmentCount; ++j) {
+            put_ref(s, &sp->pColorAttachments[j]);
+            put_ref(s, sp->pResolveAttachments ? &sp->pResolveAttachments[j] : NULL);
+        }
+        put_ref(s, sp->pDepthStencilAttachment);
+        put(s, sp->preserveAttachmentCount);
+        for (uint32_t j = 0; j < sp->preserveAttachmentCount; ++j) put(s, sp->pPreserveAttachments[j]);
+        put(s, ci->dependencyCount);
+        for (uint32_t j = 0; j < ci->dependencyCount; ++j) {
+            const VkSubpassDependency* d = &ci->pDependencies[j];
+            if (!external_ok(d->srcSubpass, d->dstSubpass, d->srcAccessMask, d->dstAccessMask)) return 0;
+            put(s, d->srcSubpass);
+            put(s, d->dstSubpass);
+            put(s, d->srcStageMask);
+            put(s, d->dstStageMask);
+            put(s, d->srcAccessMask);
+            put(s, d->dstAccessMask);
+            put(s, d->dependencyFlags);
+        }
+    }
+    return s->len <= XENO_LS_MAX_SHAPE;
+}
+
+static void render_pass_free(const XenoDeviceDispatch* d, RenderPass* rp)
+{
+    for (uint32_t i = 0; i < rp->variant_count; ++i) d->DestroyRenderPass(d->device, rp->variants[i].rp, NULL);
+    for (uint32_t i = 0; i < rp->alloc_count; ++i) free(rp->allocs[i]);
+    free(rp->allocs);
+    free(rp);
+}
+
+static VkAttachmentLoadOp masked_load(VkAttachmentLoadOp op, const uint64_t* mask, int which, uint32_t i)
+{
+    return (mask[which] >> i) & 1u ? VK_ATTACHMENT_LOAD_OP_DONT_CARE : op;
+}
+
+static VkAttachmentStoreOp masked_store(VkAttachmentStoreOp op, const uint64_t* mask, int which, uint32_t i)
+{
+    return (mask[which] >> i) & 1u ? VK_ATTACHMENT_STORE_OP_DONT_CARE : op;
+}
+
+/* Caller holds mtx. VK_NULL_HANDLE when the variant cannot be had. */
+static VkRenderPass get_variant(XenoLoadStore* ls, const XenoDeviceDispatch* d, RenderPass* rp, const uint64_t* mask)
+{
+    for (uint32_t i = 0; i < rp->variant_count; ++i) {
+        if (memcmp(rp->variants[i].mask, mask, sizeof(rp->variants[i].mask)) == 0) return rp->variants[i].rp;
+    }
+    if (rp->variant_count == XENO_LOADSTORE_MAX_VARIANTS) {
+        ls->variants_full++;
+        return VK_NULL_HANDLE;
+    }
+    VkRenderPass out = VK_NULL_HANDLE;
+    VkResult res;
+    if (rp->v2) {
+        VkAttachmentDescription2 att[XENO_LS_MAX_PASS_ATTACHMENTS];
+        VkRenderPassCreateInfo2 ci = rp->ci2;
+        for (uint32_t i = 0; i < ci.attachmentCount; ++i) {
+            att[i] = ci.pAttachments[i];
+            att[i].loadOp = masked_load(att[i].loadOp, mask, MASK_LOAD, i);
+            att[i].stencilLoadOp = masked_load(att[i].stencilLoadOp, mask, MASK_STENCIL_LOAD, i);
+            att[i].storeOp = masked_store(att[i].storeOp, mask, MASK_STORE, i);
+            att[i].stencilStoreOp = masked_store(att[i].stencilStoreOp, mask, MASK_STENCIL_STORE, i);
+        }
+        ci.pAttachments = att;
+        res = d->CreateRenderPass2 ? d->CreateRenderPass2(d->device, &ci, NULL, &out) : VK_ERROR_FEATURE_NOT_PRESENT;
+    } else {
+        VkAttachmentDescription att[XENO_LS_MAX_PASS_ATTACHMENTS];
+        VkRenderPassCreateInfo ci = rp->ci;
+        for (uint32_t i = 0; i < ci.attachmentCount; ++i) {
+            att[i] = ci.pAttachments[i];
+            att[i].loadOp = masked_load(att[i].loadOp, mask, MASK_LOAD, i);
+            att[i].stencilLoadOp = masked_load(att[i].stencilLoadOp, mask, MASK_STENCIL_LOAD, i);
+            att[i].storeOp = masked_store(att[i].storeOp, mask, MASK_STORE, i);
+            att[i].stencilStoreOp = masked_store(att[i].stencilStoreOp, mask, MASK_STENCIL_STORE, i);
+        }
+        ci.pAttachments = att;
+        res = d->CreateRenderPass(d->device, &ci, NULL, &out);
+    }
+    if (res != VK_SUCCESS) {
+        XENO_LOGW_RL(1, "loadstore: variant render pass not created: %d", res);
+        return VK_NULL_HANDLE;
+    }
+    Variant* v = &rp->variants[rp->variant_count++];
+    memcpy(v->mask, mask, sizeof(v->mask));
+    v->rp = out;
+    ls->variants_created++;
+    XENO_TRACE_COUNTER("loadstore.variants", ls->variants_created);
+    return out;
+}
+
+/* ---- planning (caller holds mtx) ----------------------------------- */
+
+static int has_depth(VkFormat f)
+{
+    return f == VK_FORMAT_D16_UNORM || f == VK_FORMAT_X8_D24_UNORM_PACK32 || f == VK_FORMAT_D32_SFLOAT ||
+           f == VK_FORMAT_D16_UNORM_S8_UINT || f == VK_FORMAT_D24_UNORM_S8_UINT || f == VK_FORMAT_D32_SFLOAT_S8_UINT;
+}
+
+static int has_stencil(VkFormat f)
+{
+    return f == VK_FORMAT_S8_UINT || f == VK_FORMAT_D16_UNORM_S8_UINT || f == VK_FORMAT_D24_UNORM_S8_UINT ||
+           f == VK_FORMAT_D32_SFLOAT_S8_UINT;
+}
+
+/* Aspects a format's attachment ops cover, as `used` bits. */
+static uint32_t format_aspects(VkFormat f)
+{
+    if (f == VK_FORMAT_S8_UINT) return 2u;
+    return has_stencil(f) ? 3u : 1u;
+}
+
+static VkImageAspectFlags aspect_bit(VkFormat f, int k)
+{
+    if (k) return VK_IMAGE_ASPECT_STENCIL_BIT;
+    return has_depth(f) ? VK_IMAGE_ASPECT_DEPTH_BIT : VK_IMAGE_ASPECT_COLOR_BIT;
+}
+
+/* Bytes per sample of one aspect; formats not listed count as 4. */
+static uint32_t aspect_bytes(VkFormat f, int k)
+{
+    if (k) return 1u;
+    switch (f) {
+    case VK_FORMAT_R8_UNORM:
+    case VK_FORMAT_R8_UINT:
+        return 1u;
+    case VK_FORMAT_R5G6B5_UNORM_PACK16:
+    case VK_FORMAT_R8G8_UNORM:
+    case VK_FORMAT_R16_SFLOAT:
+    case VK_FORMAT_D16_UNORM:
+    case VK_FORMAT_D16_UNORM_S8_UINT:
+        return 2u;
+    case VK_FORMAT_D24_UNORM_S8_UINT:
+        return 3u;
+    case VK_FORMAT_R16G16B16A16_SFLOAT:
+    case VK_FORMAT_R32G32_SFLOAT:
+        return 8u;
+    case VK_FORMAT_R32G32B32_SFLOAT:
+        return 12u;
+    case VK_FORMAT_R32G32B32A32_SFLOAT:
+        return 16u;
+    default:
+        return 4u;
+    }
+}
+
+static int rect_contains(const VkRect2D* outer, const VkRect2D* inner)
+{
+    return inner->offset.x >= outer->offset.x && inner->offset.y >= outer->offset.y &&
+           (int64_t)inner->offset.x + inner->extent.width <= (int64_t)outer->offset.x + outer->extent.width &&
+           (int64_t)inner->offset.y + inner->extent.height <= (int64_t)outer->offset.y + outer->extent.height;
+}
+
+/* The aspect of the view was discarded over at least area. */
+static int discarded(const XenoLoadStoreCmd* c, const Object* view, VkImageAspectFlags aspect, const VkRect2D* area)
+{
+    for (uint32_t i = 0; i < c->count; ++i) {
+        const XenoLoadStoreView* e = &c->discarded[i];
+        if (e->image == view->image && e->mip == view->mip && (e->aspects & aspect) &&
+            e->base_layer <= view->base_layer &&
+            (uint64_t)view->base_layer + view->layer_count <= (uint64_t)e->base_layer + e->layer_count &&
+            rect_contains(&e->area, area)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* The aspect was stored over `layers` layers of the view (0 = layers not
+   known) without keeping its contents. */
+static void discard(XenoLoadStoreCmd* c, const Object* view, VkImageAspectFlags aspect, const VkRect2D* area,
+                    uint32_t layers)
+{
+    if (!layers) return;
+    uint32_t count = layers < view->layer_count ? layers : view->layer_count;
+    for (uint32_t i = 0; i < c->count; ++i) {
+        XenoLoadStoreView* e = &c->discarded[i];
+        if (e->image == view->image && e->mip == view->mip && e->base_layer == view->base_layer &&
+            e->layer_count == count && memcmp(&e->area, area, sizeof(*area)) == 0) {
+            e->aspects |= aspect;
+            return;
+        }
+    }
+    if (c->count == XENO_LOADSTORE_MAX_DISCARDED) return;
+    c->discarded[c->count++] = (XenoLoadStoreView){
+        .image = view->image, .aspects = aspect,
+        .mip = view->mip, .base_layer = view->base_layer, .layer_count = count,
+        .area = *area,
+    };
+}
+
+/* The aspect of the view now has contents someone may load. */
+static void defined(XenoLoadStoreCmd* c, const Object* view, VkImageAspectFlags aspect)
+{
+    for (uint32_t i = 0; i < c->count;) {
+        XenoLoadStoreView* e = &c->discarded[i];
+        if (e->image == view->image && e->mip == view->mip &&
+            (uint64_t)e->base_layer < (uint64_t)view->base_layer + view->layer_count &&
+            (uint64_t)view->base_layer < (uint64_t)e->base_layer + e->layer_count) {
+            e->aspects &= ~aspect;
+        }
+        if (!e->aspects) c->discarded[i] = c->discarded[--c->count];
+        else ++i;
+    }
+}
+
+/* Fills mask with the ops that can be dropped. A discarded view only
+   counts while the layer sees every command: work it does not intercept
+   may have written the view since. */
+static void plan(const XenoLoadStore* ls, const XenoCmdState* s, const Attachment* att, uint32_t count,
+                 const VkRect2D* area, VkRenderingFlags flags, int learn, uint64_t* mask)
+{
+    const XenoLoadStoreCmd* c = s->barrier.coalesce ? &s->loadstore : NULL;
+    memset(mask, 0, 4u * sizeof(*mask));
+    for (uint32_t i = 0; i < count; ++i) {
+        const Attachment* a = &att[i];
+        if (!a->view || a->fixed) continue;
+        int storage = !a->image || (a->image->usage & VK_IMAGE_USAGE_STORAGE_BIT);
+        int attachment_only = a->image && !(a->image->usage & READ_USAGE) && !a->image->loaded &&
+                              a->image->first_frame && ls->frame - a->image->first_frame >= XENO_LOADSTORE_LEARN_FRAMES;
+        for (int k = 0; k < 2; ++k) {
+            if (!(a->used & (1u << k))) continue;
+            int load = a->load[k] == VK_ATTACHMENT_LOAD_OP_LOAD && !(flags & VK_RENDERING_RESUMING_BIT);
+            if (load && (a->undefined[k] || (!storage && c && discarded(c, a->view, aspect_bit(a->format, k), area)))) {
+                mask[k ? MASK_STENCIL_LOAD : MASK_LOAD] |= 1ull << i;
+                load = 0;
+            }
+            if (learn && attachment_only && !load && a->store[k] == VK_ATTACHMENT_STORE_OP_STORE &&
+                !(flags & VK_RENDERING_SUSPENDING_BIT)) {
+                mask[k ? MASK_STENCIL_STORE : MASK_STORE] |= 1ull << i;
+            }
+        }
+    }
+}
+
+/* Records what the instance does with the ops in mask applied. Loads
+   before stores: an attachment's store must not hide another's load. */
+static void commit(XenoLoadStore* ls, XenoLoadStoreCmd* c, Attachment* att, uint32_t count, const VkRect2D* area,
+                   uint32_t layers, uint32_t saved_layers, VkRenderingFlags flags, const uint64_t* mask)
+{
+    uint64_t pixels = (uint64_t)area->extent.width * area->extent.height * (saved_layers ? saved_layers : 1u);
+    for (uint32_t i = 0; i < count; ++i) {
+        Attachment* a = &att[i];
+        if (!a->view || a->fixed) continue;
+        if (a->image && !a->image->first_frame) a->image->first_frame = ls->frame;
+        for (int k = 0; k < 2; ++k) {
+            if (!(a->used & (1u << k))) continue;
+            uint64_t bytes = pixels * aspect_bytes(a->format, k) * (a->samples ? (uint32_t)a->samples : 1u);
+            if ((mask[k ? MASK_STENCIL_LOAD : MASK_LOAD] >> i) & 1u) {
+                ls->loads_dropped++;
+                ls->frame_bytes += bytes;
+            } else if (a->load[k] == VK_ATTACHMENT_LOAD_OP_LOAD && !(flags & VK_RENDERING_RESUMING_BIT) && a->image &&
+                       !a->image->loaded) {
+                a->image->loaded = 1;
+                if (a->image->dropped) {
+                    XENO_LOGW_RL(1, "loadstore: image 0x%llx loaded after its stores were dropped, "
+                                    "one frame may show stale contents", (unsigned long long)a->image->handle);
+                }
+            }
+            if ((mask[k ? MASK_STENCIL_STORE : MASK_STORE] >> i) & 1u) {
+                ls->stores_dropped++;
+                ls->frame_bytes += bytes;
+                a->image->dropped = 1;
+            }
+        }
+    }
+    for (uint32_t i = 0; i < count; ++i) {
+        const Attachment* a = &att[i];
+        if (!a->view) continue;
+        for (int k = 0; k < 2; ++k) {
+            if (!(a->used & (1u << k))) continue;
+            VkImageAspectFlags bit = aspect_bit(a->format, k);
+            int dropped = (mask[k ? MASK_STENCIL_STORE : MASK_STORE] >> i) & 1u;
+            if (!a->fixed && !(flags & VK_RENDERING_SUSPENDING_BIT) &&
+                (dropped || a->store[k] == VK_ATTACHMENT_STORE_OP_DONT_CARE)) {
+                discard(c, a->view, bit, area, layers);
+            } else {
+                defined(c, a->view, bit);
+            }
+        }
+    }
+}
+
+static int learning(void)
+{
+    return xeno_perf_conf_active()->loadstore_opt == XENO_LOADSTORE_LEARN;
+}
+
+static int enabled(void)
+{
+    return xeno_perf_conf_active()->loadstore_opt != XENO_LOADSTORE_OFF;
+}
+
+static int any(const uint64_t* mask)
+{
+    return (mask[0] | mask[1] | mask[2] | mask[3]) != 0;
+}
+
+/* ---- public ------------------------------------------------------- */
+
+void xeno_loadstore_device_init(XenoDeviceDispatch* d)
+{
+    if (!enabled() || !d->CreateRenderPass || !d->DestroyRenderPass) return;
+    XenoLoadStore* ls = (XenoLoadStore*)calloc(1, sizeof(*ls));
+    if (!ls) {
+        XENO_LOGW("loadstore: out of memory, attachment ops are recorded as given");
+        return;
+    }
+    pthread_mutex_init(&ls->mtx, NULL);
+    ls->frame = 1;
+    d->loadstore = ls;
+}
+
+void xeno_loadstore_device_destroy(XenoDeviceDispatch* d)
+{
+    XenoLoadStore* ls = d->loadstore;
+    if (!ls) return;
+    d->loadstore = NULL;
+    for (uint32_t i = 0; i < ls->passes.cap; ++i) {
+        if (ls->passes.slots[i]) render_pass_free(d, (RenderPass*)ls->passes.slots[i]);
+    }
+    for (uint32_t i = 0; i < ls->framebuffers.cap; ++i) free(ls->framebuffers.slots[i]);
+    uint64_t saved = ls->saved_bytes + ls->frame_bytes;
+    XENO_LOGI("loadstore: %llu loads and %llu stores dropped, %llu render passes continued, %.1f MB not moved "
+              "(%.1f KB per frame), %llu variant render passes, %llu instances over the variant limit",
+              (unsigned long long)ls->loads_dropped, (unsigned long long)ls->stores_dropped,
+              (unsigned long long)ls->fused, (double)saved / (1024.0 * 1024.0),
+              (double)saved / 1024.0 / (double)ls->frame, (unsigned long long)ls->variants_created,
+              (unsigned long long)ls->variants_full);
+    free(ls->passes.slots);
+    free(ls->framebuffers.slots);
+    free(ls->images.slots);
+    free(ls->views.slots);
+    pthread_mutex_destroy(&ls->mtx);
+    free(ls);
+}
+
+void xeno_loadstore_image_created(XenoDeviceDispatch* d, VkImage image, const VkImageCreateInfo* ci)
+{
+    XenoLoadStore* ls = d->loadstore;
+    if (!ls || !image) return;
+    Object o = {
+        .handle = (uint64_t)image, .image = (uint64_t)image,
+        .format = ci->format, .samples = ci->samples,
+        .usage = ci->usage, .layers = ci->arrayLayers,
+    };
+    pthread_mutex_lock(&ls->mtx);
+    objects_put(&ls->images, &o);
+    pthread_mutex_unlock(&ls->mtx);
+}
+
+void xeno_loadstore_image_destroyed(XenoDeviceDispatch* d, VkImage image)
+{
+    XenoLoadStore* ls = d->loadstore;
+    if (!ls || !image) return;
+    pthread_mutex_lock(&ls->mtx);
+    objects_remove(&ls->images, (uint64_t)image);
+    pthread_mutex_unlock(&ls->mtx);
+}
+
+void xeno_loadstore_view_created(XenoDeviceDispatch* d, VkImageView view, const VkImageViewCreateInfo* ci)
+{
+    XenoLoadStore* ls = d->loadstore;
+    if (!ls || !view) return;
+    const VkImageSubresourceRange* r = &ci->subresourceRange;
+    Object o = {
+        .handle = (uint64_t)view, .image = (uint64_t)ci->image,
+        .format = ci->format, .samples = VK_SAMPLE_COUNT_1_BIT,
+        .mip = r->baseMipLevel, .base_layer = r->baseArrayLayer, .layer_count = r->layerCount,
+    };
+    pthread_mutex_lock(&ls->mtx);
+    const Object* image = objects_find(&ls->images, (uint64_t)ci->image);
+    if (image) o.samples = image->samples;
+    if (r->layerCount == VK_REMAINING_ARRAY_LAYERS) {
+        o.layer_count = image && image->layers > r->baseArrayLayer ? image->layers - r->baseArrayLayer
+                                                                   : UINT32_MAX - r->baseArrayLayer;
+    }
+    objects_put(&ls->views, &o);
+    pthread_mutex_unlock(&ls->mtx);
+}
+
+void xeno_loadstore_view_destroyed(XenoDeviceDispatch* d, VkImageView view)
+{
+    XenoLoadStore* ls = d->loadstore;
+    if (!ls || !view) return;
+    pthread_mutex_lock(&ls->mtx);
+    objects_remove(&ls->views, (uint64_t)view);
+    pthread_mutex_unlock(&ls->mtx);
+}
+
+void xeno_loadstore_framebuffer_created(XenoDeviceDispatch* d, VkFramebuffer fb, const VkFramebufferCreateInfo* ci)
+{
+    XenoLoadStore* ls = d->loadstore;
+    if (!ls || !fb) return;
+    uint32_t count = (ci->flags & VK_FRAMEBUFFER_CREATE_IMAGELESS_BIT) ? 0u : ci->attachmentCount;
+    Framebuffer* f = (Framebuffer*)malloc(sizeof(*f) + count * sizeof(VkImageView));
+    if (!f) return;
+    f->handle = (uint64_t)fb;
+    f->layers = ci->layers;
+    f->view_count = count;
+    if (count) memcpy(f->views, ci->pAttachments, count * sizeof(VkImageView));
+    pthread_mutex_lock(&ls->mtx);
+    free(entries_take(&ls->framebuffers, f->handle));
+    if (!entries_insert(&ls->framebuffers, &f->handle)) free(f);
+    pthread_mutex_unlock(&ls->mtx);
+}
+
+void xeno_loadstore_framebuffer_destroyed(XenoDeviceDispatch* d, VkFramebuffer fb)
+{
+    XenoLoadStore* ls = d->loadstore;
+    if (!ls || !fb) return;
+    pthread_mutex_lock(&ls->mtx);
+    free(entries_take(&ls->framebuffers, (uint64_t)fb));
+    pthread_mutex_unlock(&ls->mtx);
+}
+
+static void render_pass_add(XenoDeviceDispatch* d, RenderPass* rp, int copied)
+{
+    XenoLoadStore* ls = d->loadstore;
+    if (!copied) {
+        XENO_LOGD("loadstore: render pass 0x%llx has create info the layer does not copy, ops left as given",
+                  (unsigned long long)rp->handle);
+        render_pass_free(d, rp);
+        return;
+    }
+    Shape* shape = (Shape*)malloc(sizeof(*shape));
+    if (shape && shape_of(rp, shape)) {
+        int failed = 0;
+        rp->shape = (const uint32_t*)dup(rp, &failed, shape->words, shape->len * sizeof(uint32_t));
+        rp->shape_len = rp->shape ? shape->len : 0u;
+    }
+    free(shape);
+    pthread_mutex_lock(&ls->mtx);
+    RenderPass* old = (RenderPass*)entries_take(&ls->passes, rp->handle);
+    if (old) render_pass_free(d, old);
+    if (!entries_insert(&ls->passes, &rp->handle)) render_pass_free(d, rp);
+    pthread_mutex_unlock(&ls->mtx);
+}
+
+void xeno_loadstore_render_pass_created(XenoDeviceDispatch* d, VkRenderPass rp, const VkRenderPassCreateInfo* ci)
+{
+    if (!d->loadstore || !rp || ci->attachmentCount > XENO_LS_MAX_PASS_ATTACHMENTS) return;
+    RenderPass* p = (RenderPass*)calloc(1, sizeof(*p));
+    if (!p) return;
+    p->handle = (uint64_t)rp;
+    render_pass_add(d, p, copy_render_pass(p, ci));
+}
+
+void xeno_loadstore_render_pass2_created(XenoDeviceDispatch* d, VkRenderPass rp, const VkRenderPassCreateInfo2* ci)
+{
+    if (!d->loadstore || !rp || ci->attachmentCount > XENO_LS_MAX_PASS_ATTACHMENTS) return;
+    RenderPass* p = (RenderPass*)calloc(1, sizeof(*p));
+    if (!p) return;
+    p->handle = (uint64_t)rp;
+    render_pass_add(d, p, copy_render_pass2(p, ci));
+}
+
+void xeno_loadstore_render_pass_destroyed(XenoDeviceDispatch* d, VkRenderPass rp)
+{
+    XenoLoadStore* ls = d->loadstore;
+    if (!ls || !rp) return;
+    pthread_mutex_lock(&ls->mtx);
+    RenderPass* p = (RenderPass*)entries_take(&ls->passes, (uint64_t)rp);
+    pthread_mutex_unlock(&ls->mtx);
+    if (p) render_pass_free(d, p);
+}
+
+/* Caller holds mtx. Fills a from the attachment's description and the
+   view bound to it; a->view stays NULL when the view is not known, the
+   description's part is filled either way. */
+static void pass_attachment(XenoLoadStore* ls, const RenderPass* rp, uint32_t i, VkImageView view, Attachment* a)
+{
+    memset(a, 0, sizeof(*a));
+    VkFormat format;
+    VkSampleCountFlagBits samples;
+    VkImageLayout initial, stencil_initial;
+    if (rp->v2) {
+        const VkAttachmentDescription2* x = &rp->ci2.pAttachments[i];
+        const VkAttachmentDescriptionStencilLayout* sl = (const VkAttachmentDescriptionStencilLayout*)find_struct(
+            x->pNext, VK_STRUCTURE_TYPE_ATTACHMENT_DESCRIPTION_STENCIL_LAYOUT);
+        format = x->format;
+        samples = x->samples;
+        a->load[0] = x->loadOp;
+        a->load[1] = x->stencilLoadOp;
+        a->store[0] = x->storeOp;
+        a->store[1] = x->stencilStoreOp;
+        initial = x->initialLayout;
+        stencil_initial = sl ? sl->stencilInitialLayout : initial;
+    } else {
+        const VkAttachmentDescription* x = &rp->ci.pAttachments[i];
+        format = x->format;
+        samples = x->samples;
+        a->load[0] = x->loadOp;
+        a->load[1] = x->stencilLoadOp;
+        a->store[0] = x->storeOp;
+        a->store[1] = x->stencilStoreOp;
+        initial = stencil_initial = x->initialLayout;
+    }
+    a->format = format;
+    a->samples = samples;
+    a->used = format_aspects(format);
+    a->view = objects_find(&ls->views, (uint64_t)view);
+    if (!a->view) return;
+    a->image = objects_find(&ls->images, a->view->image);
+    a->undefined[0] = initial == VK_IMAGE_LAYOUT_UNDEFINED;
+    a->undefined[1] = stencil_initial == VK_IMAGE_LAYOUT_UNDEFINED;
+}
+
+static int fusing(void)
+{
+    const XenoPerfConf* cfg = xeno_perf_conf_active();
+    return cfg->loadstore_opt != XENO_LOADSTORE_OFF && cfg->pass_fusion;
+}
+
+/* Subpass 0 color attachment index of attachment i, XENO_LS_DEPTH_STENCIL
+   for its depth/stencil attachment, UINT32_MAX when it is neither. */
+#define XENO_LS_DEPTH_STENCIL (UINT32_MAX - 1u)
+
+static uint32_t subpass_slot(const RenderPass* rp, uint32_t i)
+{
+    if (rp->v2) {
+        const VkSubpassDescription2* sp = rp->ci2.pSubpasses;
+        for (uint32_t j = 0; j < sp->colorAttachmentCount; ++j) {
+            if (sp->pColorAttachments[j].attachment == i) return j;
+        }
+        if (sp->pDepthStencilAttachment && sp->pDepthStencilAttachment->attachment == i) return XENO_LS_DEPTH_STENCIL;
+    } else {
+        const VkSubpassDescription* sp = rp->ci.pSubpasses;
+        for (uint32_t j = 0; j < sp->colorAttachmentCount; ++j) {
+            if (sp->pColorAttachments[j].attachment == i) return j;
+        }
+        if (sp->pDepthStencilAttachment && sp->pDepthStencilAttachment->attachment == i) return XENO_LS_DEPTH_STENCIL;
+    }
+    return UINT32_MAX;
+}
+
+/* Caller holds mtx. Whether info can continue the instance c holds open:
+   same framebuffer, area and contents, a render pass of the same shape,
+   and every store info asks for already recorded. Its LOAD_OP_CLEAR
+   attachments become *clear_count entries of clears for
+   vkCmdClearAttachments over rect. */
+static int fuse(XenoLoadStore* ls, XenoLoadStoreCmd* c, const VkRenderPassBeginInfo* info,
+                const VkSubpassBeginInfo* sub, VkClearAttachment* clears, uint32_t* clear_count, VkClearRect* rect)
+{
+    if (info->framebuffer != c->framebuffer || sub->contents != c->contents || info->pNext || sub->pNext ||
+        memcmp(&info->renderArea, &c->area, sizeof(c->area)) != 0) {
+        return 0;
+    }
+    const RenderPass* held = (const RenderPass*)entries_find(&ls->passes, (uint64_t)c->pass);
+    const RenderPass* rp = (const RenderPass*)entries_find(&ls->passes, (uint64_t)info->renderPass);
+    const Framebuffer* fb = (const Framebuffer*)entries_find(&ls->framebuffers, (uint64_t)info->framebuffer);
+    if (!held || !rp || !fb || !rp->shape || rp->shape_len != held->shape_len ||
+        memcmp(rp->shape, held->shape, rp->shape_len * sizeof(uint32_t)) != 0) {
+        return 0;
+    }
+    uint32_t count = rp->v2 ? rp->ci2.attachmentCount : rp->ci.attachmentCount;
+    uint64_t pixels = (uint64_t)info->renderArea.extent.width * info->renderArea.extent.height * fb->layers;
+    uint64_t bytes = 0;
+    *clear_count = 0;
+    for (uint32_t i = 0; i < count; ++i) {
+        Attachment a, h;
+        pass_attachment(ls, rp, i, fb->views[i], &a);
+        pass_attachment(ls, held, i, fb->views[i], &h);
+        VkClearAttachment* clear = NULL;
+        for (int k = 0; k < 2; ++k) {
+            if (!(a.used & (1u << k))) continue;
+            VkAttachmentStoreOp recorded = masked_store(h.store[k], c->mask, k ? MASK_STENCIL_STORE : MASK_STORE, i);
+            if (a.store[k] != VK_ATTACHMENT_STORE_OP_DONT_CARE && a.store[k] != recorded) return 0;
+            uint64_t aspect = pixels * aspect_bytes(a.format, k) * (a.samples ? (uint32_t)a.samples : 1u);
+            if (a.store[k] == VK_ATTACHMENT_STORE_OP_STORE) bytes += aspect;
+            if (a.load[k] == VK_ATTACHMENT_LOAD_OP_LOAD) bytes += aspect;
+            if (a.load[k] != VK_ATTACHMENT_LOAD_OP_CLEAR) continue;
+            /* Only inline contents may record vkCmdClearAttachments. */
+            uint32_t slot = subpass_slot(rp, i);
+            if (slot == UINT32_MAX || sub->contents != VK_SUBPASS_CONTENTS_INLINE || i >= info->clearValueCount) {
+                return 0;
+            }
+            if (!clear) {
+                clear = &clears[(*clear_count)++];
+                *clear = (VkClearAttachment){
+                    .colorAttachment = slot == XENO_LS_DEPTH_STENCIL ? 0u : slot,
+                    .clearValue = info->pClearValues[i],
+                };
+            }
+            clear->aspectMask |= aspect_bit(a.format, k);
+        }
+    }
+    /* A load that stayed on tile still counts as one for learn: the next
+       instance may not be continued. */
+    for (uint32_t i = 0; i < count; ++i) {
+        Attachment a;
+        pass_attachment(ls, rp, i, fb->views[i], &a);
+        for (int k = 0; k < 2; ++k) {
+            if (a.image && (a.used & (1u << k)) && a.load[k] == VK_ATTACHMENT_LOAD_OP_LOAD) a.image->loaded = 1;
+        }
+    }
+    *rect = (VkClearRect){ .rect = info->renderArea, .baseArrayLayer = 0, .layerCount = fb->layers };
+    ls->fused++;
+    ls->frame_bytes += bytes;
+    return 1;
+}
+
+int xeno_loadstore_begin_render_pass(XenoDeviceDispatch* d, VkCommandBuffer cmd, const VkRenderPassBeginInfo* info,
+                                     const VkSubpassBeginInfo* sub, VkRenderPassBeginInfo* out)
+{
+    XenoLoadStore* ls = d->loadstore;
+    if (!ls || !enabled()) return 0;
+    XenoCmdState* s = xeno_cmd_state(d, cmd);
+    if (!s) return 0;
+    XenoLoadStoreCmd* c = &s->loadstore;
+    int learn = learning();
+    Attachment att[XENO_LS_MAX_PASS_ATTACHMENTS];
+    uint64_t mask[4];
+    VkRenderPass variant = VK_NULL_HANDLE;
+
+    pthread_mutex_lock(&ls->mtx);
+    if (c->held) {
+        VkClearAttachment clears[XENO_LS_MAX_PASS_ATTACHMENTS];
+        uint32_t clear_count;
+        VkClearRect rect;
+        if (fuse(ls, c, info, sub, clears, &clear_count, &rect)) {
+            c->held = 0;
+            XENO_TRACE_COUNTER("loadstore.fused", ls->fused);
+            pthread_mutex_unlock(&ls->mtx);
+            if (clear_count) d->CmdClearAttachments(cmd, clear_count, clears, 1, &rect);
+            return XENO_LOADSTORE_FUSED;
+        }
+    }
+    c->pass = VK_NULL_HANDLE;
+    RenderPass* rp = (RenderPass*)entries_find(&ls->passes, (uint64_t)info->renderPass);
+    const Framebuffer* fb = (const Framebuffer*)entries_find(&ls->framebuffers, (uint64_t)info->framebuffer);
+    const VkImageView* views = fb ? fb->views : NULL;
+    uint32_t count = rp ? (rp->v2 ? rp->ci2.attachmentCount : rp->ci.attachmentCount) : 0;
+    if (fb && !fb->view_count) {
+        const VkRenderPassAttachmentBeginInfo* b = (const VkRenderPassAttachmentBeginInfo*)find_struct(
+            info->pNext, VK_STRUCTURE_TYPE_RENDER_PASS_ATTACHMENT_BEGIN_INFO);
+        views = b && b->attachmentCount == count ? b->pAttachments : NULL;
+    } else if (fb && fb->view_count != count) {
+        views = NULL;
+    }
+    if (!rp || !views) {
+        pthread_mutex_unlock(&ls->mtx);
+        return 0;
+    }
+    for (uint32_t i = 0; i < count; ++i) pass_attachment(ls, rp, i, views[i], &att[i]);
+    plan(ls, s, att, count, &info->renderArea, 0, learn, mask);
+    if (any(mask)) {
+        variant = get_variant(ls, d, rp, mask);
+        if (!variant) memset(mask, 0, sizeof(mask));
+    }
+    /* Multiview renders the views its masks name, not a layer range. */
+    commit(ls, c, att, count, &info->renderArea, rp->multiview ? 0u : fb->layers, fb->layers, 0, mask);
+    if (rp->shape && fb->view_count && !info->pNext && !sub->pNext) {
+        c->pass = info->renderPass;
+        c->framebuffer = info->framebuffer;
+        c->area = info->renderArea;
+        c->contents = sub->contents;
+        memcpy(c->mask, mask, sizeof(c->mask));
+    }
+    pthread_mutex_unlock(&ls->mtx);
+
+    if (!variant) return 0;
+    *out = *info;
+    out->renderPass = variant;
+    return 1;
+}
+
+int xeno_loadstore_end_render_pass(XenoDeviceDispatch* d, VkCommandBuffer cmd, const VkSubpassEndInfo* end)
+{
+    XenoCmdState* s = d->loadstore ? xeno_cmd_state(d, cmd) : NULL;
+    if (!s) return 0;
+    XenoLoadStoreCmd* c = &s->loadstore;
+    /* Work the layer does not see could land inside the held instance. */
+    if (!c->pass || !fusing() || !s->barrier.coalesce || (end && end->pNext)) {
+        c->pass = VK_NULL_HANDLE;
+        return 0;
+    }
+    c->held = end ? 2 : 1;
+    return 1;
+}
+
+void xeno_loadstore_release(const XenoDeviceDispatch* d, VkCommandBuffer cmd, XenoLoadStoreCmd* c)
+{
+    int held = c->held;
+    c->held = 0;
+    if (held == 2) {
+        VkSubpassEndInfo end = { .sType = VK_STRUCTURE_TYPE_SUBPASS_END_INFO };
+        d->CmdEndRenderPass2(cmd, &end);
+    } else if (held) {
+        d->CmdEndRenderPass(cmd);
+    }
+}
+
+/* Caller holds mtx. */
+static void rendering_attachment(XenoLoadStore* ls, VkImageView view, Attachment* a)
+{
+    memset(a, 0, sizeof(*a));
+    a->view = objects_find(&ls->views, (uint64_t)view);
+    if (!a->view) return;
+    a->image = objects_find(&ls->images, a->view->image);
+    a->format = a->view->format;
+    a->samples = a->view->samples;
+}
+
+int xeno_loadstore_begin_rendering(XenoDeviceDispatch* d, VkCommandBuffer cmd, const VkRenderingInfo* info,
+                                   VkRenderingInfo* out, VkRenderingAttachmentInfo* att)
+{
+    XenoLoadStore* ls = d->loadstore;
+    uint32_t n = info->colorAttachmentCount;
+    if (!ls || n + 2u > XENO_LOADSTORE_MAX_ATTACHMENTS || !enabled()) return 0;
+    XenoCmdState* s = xeno_cmd_state(d, cmd);
+    if (!s) return 0;
+    int learn = learning();
+    /* Colors, depth/stencil, then resolve targets. */
+    Attachment a[2u * XENO_LOADSTORE_MAX_ATTACHMENTS];
+    uint32_t count = n + 1u;
+    uint64_t mask[4];
+    const VkRenderingAttachmentInfo* da = info->pDepthAttachment && info->pDepthAttachment->imageView
+                                              ? info->pDepthAttachment : NULL;
+    const VkRenderingAttachmentInfo* sa = info->pStencilAttachment && info->pStencilAttachment->imageView
+                                              ? info->pStencilAttachment : NULL;
+
+    pthread_mutex_lock(&ls->mtx);
+    for (uint32_t i = 0; i < n; ++i) {
+        const VkRenderingAttachmentInfo* c = &info->pColorAttachments[i];
+        rendering_attachment(ls, c->imageView, &a[i]);
+        a[i].used = 1u;
+        a[i].load[0] = c->loadOp;
+        a[i].store[0] = c->storeOp;
+        if (c->imageView && c->resolveMode != VK_RESOLVE_MODE_NONE && c->resolveImageView) {
+            rendering_attachment(ls, c->resolveImageView, &a[count]);
+            a[count].used = 1u;
+            a[count++].fixed = 1;
+        }
+    }
+    rendering_attachment(ls, da ? da->imageView : sa ? sa->imageView : VK_NULL_HANDLE, &a[n]);
+    if (da) {
+        a[n].used |= 1u;
+        a[n].load[0] = da->loadOp;
+        a[n].store[0] = da->storeOp;
+    }
+    if (sa) {
+        a[n].used |= 2u;
+        a[n].load[1] = sa->loadOp;
+        a[n].store[1] = sa->storeOp;
+    }
+    a[n].used &= format_aspects(a[n].format);
+    int dr = da && da->resolveMode != VK_RESOLVE_MODE_NONE && da->resolveImageView;
+    int sr = sa && sa->resolveMode != VK_RESOLVE_MODE_NONE && sa->resolveImageView;
+    if (dr || sr) {
+        rendering_attachment(ls, dr ? da->resolveImageView : sa->resolveImageView, &a[count]);
+        a[count].used = (dr ? 1u : 0u) | (sr ? 2u : 0u);
+        a[count++].fixed = 1;
+    }
+    plan(ls, s, a, count, &info->renderArea, info->flags, learn, mask);
+    uint32_t layers = info->viewMask ? 0u : info->layerCount;
+    uint32_t saved_layers = info->viewMask ? (uint32_t)__builtin_popcount(info->viewMask) : info->layerCount;
+    commit(ls, &s->loadstore, a, count, &info->renderArea, layers, saved_layers, info->flags, mask);
+    pthread_mutex_unlock(&ls->mtx);
+
+    if (!any(mask)) return 0;
+    *out = *info;
+    for (uint32_t i = 0; i < n; ++i) {
+        att[i] = info->pColorAttachments[i];
+        att[i].loadOp = masked_load(att[i].loadOp, mask, MASK_LOAD, i);
+        att[i].storeOp = masked_store(att[i].storeOp, mask, MASK_STORE, i);
+    }
+    out->pColorAttachments = att;
+    if (da) {
+        att[n] = *info->pDepthAttachment;
+        att[n].loadOp = masked_load(att[n].loadOp, mask, MASK_LOAD, n);
+        att[n].storeOp = masked_store(att[n].storeOp, mask, MASK_STORE, n);
+        out->pDepthAttachment = &att[n];
+    }
+    if (sa) {
+        att[n + 1u] = *info->pStencilAttachment;
+        att[n + 1u].loadOp = masked_load(att[n + 1u].loadOp, mask, MASK_STENCIL_LOAD, n);
+        att[n + 1u].storeOp = masked_store(att[n + 1u].storeOp, mask, MASK_STENCIL_STORE, n);
+        out->pStencilAttachment = &att[n + 1u];
+    }
+    return 1;
+}
+
+void xeno_loadstore_frame(XenoDeviceDispatch* d)
+{
+    XenoLoadStore* ls = d->loadstore;
+    if (!ls) return;
+    pthread_mutex_lock(&ls->mtx);
+    XENO_TRACE_COUNTER("loadstore.saved_kb", ls->frame_bytes / 1024u);
+    ls->saved_bytes += ls->frame_bytes;
+    ls->frame_bytes = 0;
+    ls->frame++;
+    pthread_mutex_unlock(&ls->mtx);
+}
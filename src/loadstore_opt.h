@@ -0,0 +1,119 @@
+// src/loadstore_opt.h
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include "xeno_dispatch.h"
+
+/*
+  Attachment load/store-op optimizer (loadstore_opt.c).
+
+  On a tiler every LOAD_OP_LOAD reads the attachment from memory into tile
+  memory and every STORE_OP_STORE writes it back. Render pass instances
+  begun through the layer have their ops rewritten to DONT_CARE where
+  that provably changes nothing, and, with perf_conf loadstore_opt=learn,
+  where usage so far says nothing will read the result:
+
+  - A load is dropped when the contents are undefined anyway: the render
+    pass starts from VK_IMAGE_LAYOUT_UNDEFINED, or the same command buffer
+    already discarded that view (store DONT_CARE) over at least the same
+    area with nothing but render passes recorded in between. The latter
+    needs the layer to see every command, as for pass fusion: not with
+    extensions whose work it does not intercept (xeno_cmd.c).
+
+  - learn: a store is dropped for images that can only be read by loading
+    them in a later render pass (no sampled, storage, input attachment or
+    transfer-source usage) when no render pass has loaded them in the
+    XENO_LOADSTORE_LEARN_FRAMES presents since they were first used. An
+    image that is loaded after all stops being optimized for good; that
+    one load sees undefined contents, which is why learn is not the
+    default.
+
+  vkCmdBeginRenderPass(2) switches to a cached variant of the app's render
+  pass that differs only in those ops, which keeps it compatible with the
+  app's framebuffers and pipelines. vkCmdBeginRendering gets rewritten
+  attachment infos. Bytes not moved are estimated per frame from the render
+  area, format size and sample count.
+
+  With perf_conf pass_fusion on (the default), vkCmdEndRenderPass(2) of a
+  single-subpass instance is held back. When the next command is a begin
+  on the same framebuffer and area with a render pass of the same shape,
+  drawing continues in the open instance: the tile is neither stored nor
+  loaded in between, and LOAD_OP_CLEAR attachments become
+  vkCmdClearAttachments. Only if the stores already recorded cover every
+  store the new pass asks for. Anything else recorded first releases the
+  held end (xeno_cmd.c), so a held end is always recorded before work,
+  barriers, queries or vkCmdEndCommandBuffer.
+*/
+
+#define XENO_LOADSTORE_LEARN_FRAMES 8u
+#define XENO_LOADSTORE_MAX_DISCARDED 8u     /* discarded views remembered per command buffer */
+#define XENO_LOADSTORE_MAX_VARIANTS 8u      /* variant render passes per app render pass */
+#define XENO_LOADSTORE_MAX_ATTACHMENTS 10u  /* dynamic rendering: 8 colors, depth, stencil */
+
+/* xeno_loadstore_begin_render_pass(): the held instance goes on, record nothing. */
+#define XENO_LOADSTORE_FUSED 2
+
+/* A view whose contents a command buffer discarded. */
+typedef struct XenoLoadStoreView {
+    uint64_t image;
+    VkImageAspectFlags aspects;
+    uint32_t mip, base_layer, layer_count;
+    VkRect2D area;
+} XenoLoadStoreView;
+
+typedef struct XenoLoadStore XenoLoadStore;
+
+/* Per-command-buffer part, kept in XenoCmdState. */
+typedef struct XenoLoadStoreCmd {
+    uint32_t count;
+    XenoLoadStoreView discarded[XENO_LOADSTORE_MAX_DISCARDED];
+    /* The last render pass instance, if another may continue it. */
+    VkRenderPass pass;                  /* app's render pass, VK_NULL_HANDLE = may not */
+    VkFramebuffer framebuffer;
+    VkRect2D area;
+    VkSubpassContents contents;
+    uint64_t mask[4];                   /* ops its variant dropped */
+    int held;                           /* end not recorded: 1 = vkCmdEndRenderPass, 2 = vkCmdEndRenderPass2 */
+} XenoLoadStoreCmd;
+
+/* Sets d->loadstore unless perf_conf loadstore_opt=off. */
+void xeno_loadstore_device_init(XenoDeviceDispatch* d);
+/* Logs the savings and destroys every variant; the device is idle. */
+void xeno_loadstore_device_destroy(XenoDeviceDispatch* d);
+
+void xeno_loadstore_image_created(XenoDeviceDispatch* d, VkImage image, const VkImageCreateInfo* ci);
+void xeno_loadstore_image_destroyed(XenoDeviceDispatch* d, VkImage image);
+void xeno_loadstore_view_created(XenoDeviceDispatch* d, VkImageView view, const VkImageViewCreateInfo* ci);
+void xeno_loadstore_view_destroyed(XenoDeviceDispatch* d, VkImageView view);
+void xeno_loadstore_framebuffer_created(XenoDeviceDispatch* d, VkFramebuffer fb, const VkFramebufferCreateInfo* ci);
+void xeno_loadstore_framebuffer_destroyed(XenoDeviceDispatch* d, VkFramebuffer fb);
+void xeno_loadstore_render_pass_created(XenoDeviceDispatch* d, VkRenderPass rp, const VkRenderPassCreateInfo* ci);
+void xeno_loadstore_render_pass2_created(XenoDeviceDispatch* d, VkRenderPass rp, const VkRenderPassCreateInfo2* ci);
+/* Call before the driver destroys rp: its variants go with it. */
+void xeno_loadstore_render_pass_destroyed(XenoDeviceDispatch* d, VkRenderPass rp);
+
+/* Fills *out with info switched to a variant render pass and returns 1,
+   returns 0 when info is recorded as is, or XENO_LOADSTORE_FUSED when the
+   held instance continues instead (its clears are recorded already).
+   vkCmdBeginRenderPass passes a VkSubpassBeginInfo made from contents. */
+int xeno_loadstore_begin_render_pass(XenoDeviceDispatch* d, VkCommandBuffer cmd, const VkRenderPassBeginInfo* info,
+                                     const VkSubpassBeginInfo* sub, VkRenderPassBeginInfo* out);
+/* Returns 1 when the end is held back and must not be recorded; end is
+   NULL for vkCmdEndRenderPass. */
+int xeno_loadstore_end_render_pass(XenoDeviceDispatch* d, VkCommandBuffer cmd, const VkSubpassEndInfo* end);
+/* Records the held end, if any. Through xeno_cmd.c, which also tells the
+   barrier tracker the instance is over. */
+void xeno_loadstore_release(const XenoDeviceDispatch* d, VkCommandBuffer cmd, XenoLoadStoreCmd* c);
+/* Same for dynamic rendering; att must have room for
+   XENO_LOADSTORE_MAX_ATTACHMENTS rewritten attachment infos. */
+int xeno_loadstore_begin_rendering(XenoDeviceDispatch* d, VkCommandBuffer cmd, const VkRenderingInfo* info,
+                                   VkRenderingInfo* out, VkRenderingAttachmentInfo* att);
+
+/* Work outside render passes may write anything: forget discarded views. */
+static inline void xeno_loadstore_cmd_reset(XenoLoadStoreCmd* c)
+{
+    c->count = 0;
+}
+
+/* Per present: publishes the frame's savings and advances learning. */
+void xeno_loadstore_frame(XenoDeviceDispatch* d);
@@ -1,10 +1,121 @@
 // src/logging.c
+/*
+  Asynchronous logging backend.
+
+  The calling thread never formats or writes: logging_*() packs a binary
+  record (level, tick counter, format pointer, raw arguments, copied string
+  arguments) into a per-thread single-producer ring and returns. A background
+  thread drains every ring, formats the records and writes them in batches
+  with one write() per batch. When a ring is full the record is dropped and
+  counted; the writer reports the count on the next line it emits.
+
+  EXYNOSTOOLS_LOG_SYNC=1 restores the old behaviour (format and write on the
+  calling thread), which is also used if the writer thread cannot be started.
+*/
+#ifndef XENO_LOG_IMPLEMENTATION_PRESENT
 #define XENO_LOG_IMPLEMENTATION_PRESENT
+#endif
 #include "xeno_log.h"
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <stdarg.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdatomic.h>
 #include <time.h>
+#include <errno.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#define XENO_LOG_RING_SLOTS   512u            /* per thread, power of two */
+#define XENO_LOG_MAX_ARGS     8
+#define XENO_LOG_STR_BYTES    168
+#define XENO_LOG_BATCH_BYTES  (16u * 1024u)
+#define XENO_LOG_IDLE_NS      2000000L         /* writer poll interval when idle */
+#define XENO_LOG_FLUSH_NS     500000000L       /* longest xeno_log_flush waits on the writer */
+
+enum {
+    XENO_ARG_I64 = 0,
+    XENO_ARG_U64,
+    XENO_ARG_F64,
+    XENO_ARG_STR,   /* args[i] is an offset into rec->str */
+    XENO_ARG_PTR,
+    XENO_ARG_CHAR,
+    XENO_ARG_STAR   /* '*' width/precision, int */
+};
+
+#define XENO_LOG_REC_PREFORMATTED 0x1u
+
+typedef struct XenoLogRecord {
+    uint64_t ticks;
+    const char *fmt;
+    uint8_t level;
+    uint8_t nargs;
+    uint8_t flags;
+    uint8_t kinds[XENO_LOG_MAX_ARGS];
+    uint64_t args[XENO_LOG_MAX_ARGS];
+    char str[XENO_LOG_STR_BYTES];
+} XenoLogRecord;
+
+typedef struct XenoLogRing {
+    _Alignas(64) _Atomic uint32_t head;       /* written by the owning thread */
+    _Alignas(64) _Atomic uint32_t tail;       /* written by the writer thread */
+    _Alignas(64) _Atomic uint64_t dropped;
+    _Atomic int owned;
+    struct XenoLogRing *next;
+    XenoLogRecord slots[XENO_LOG_RING_SLOTS];
+} XenoLogRing;
+
+static _Atomic(XenoLogRing *) g_rings = NULL;
+static _Thread_local XenoLogRing *t_ring = NULL;
+
+static pthread_once_t g_once = PTHREAD_ONCE_INIT;
+static pthread_key_t g_ring_key;
+static pthread_t g_writer;
+static pthread_mutex_t g_wake_mtx = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t g_wake_cv = PTHREAD_COND_INITIALIZER;
+static _Atomic int g_async = 0;
+static _Atomic int g_stop = 0;
+static _Atomic int g_writer_running = 0;
+static pthread_mutex_t g_inline_mtx = PTHREAD_MUTEX_INITIALIZER;
+
+static uint64_t g_tick_base;
+static uint64_t g_tick_hz;
+static struct timespec g_wall_base;
+
+static const char *const g_level_tags[] = { "DEBUG", "INFO", "WARN", "ERROR" };
+
+_Atomic int xeno_log_level_g = XENO_LOG_LEVEL_INFO;
+
+static inline uint64_t xeno_log_ticks(void)
+{
+#if defined(__aarch64__)
+    uint64_t v;
+    __asm__ volatile("mrs %0, cntvct_el0" : "=r"(v));
+    return v;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+static uint64_t xeno_log_tick_hz(void)
+{
+#if defined(__aarch64__)
+    uint64_t f;
+    __asm__ volatile("mrs %0, cntfrq_el0" : "=r"(f));
+    return f ? f : 1000000000ull;
+#else
+    return 1000000000ull;
+#endif
+}
+
+/* ------------------------------------------------------------------------- */
+/* Synchronous path (EXYNOSTOOLS_LOG_SYNC=1 or writer thread unavailable)    */
+/* ------------------------------------------------------------------------- */
 
 static void xeno_log_vprint_impl(const char *tag, const char *fmt, va_list va)
 {
@@ -18,27 +129,578 @@ static void xeno_log_vprint_impl(const char *tag, const char *fmt, va_list va)
     char ts[32] = {0};
     if (strftime(ts, sizeof(ts), "%Y-%m-%d %H:%M:%S", &tm) == 0) ts[0] = '\0';
 
-    if (tag && tag[0]) fprintf(stderr, "%s [%s] ", ts, tag);
-    else fprintf(stderr, "%s ", ts);
+    FILE *out = xeno_log_stream();
+    if (tag && tag[0]) fprintf(out, "%s [%s] ", ts, tag);
+    else fprintf(out, "%s ", ts);
+
+    if (fmt) vfprintf(out, fmt, va);
+    fprintf(out, "\n");
+    fflush(out);
+}
+
+/* ------------------------------------------------------------------------- */
+/* Producer side                                                             */
+/* ------------------------------------------------------------------------- */
+
+/* Walk the printf conversion specifiers of fmt and copy the arguments into
+   rec. Returns 0 when a specifier cannot be captured (caller preformats). */
+static int xeno_log_pack(XenoLogRecord *rec, const char *fmt, va_list va)
+{
+    uint32_t n = 0;
+    size_t str_used = 0;
+
+    for (const char *p = fmt; *p; ++p) {
+        if (*p != '%') continue;
+        ++p;
+        if (*p == '%') continue;
+        while (*p && strchr("-+ #0'", *p)) ++p;
+        if (*p == '*') {
+            if (n >= XENO_LOG_MAX_ARGS) return 0;
+            rec->kinds[n] = XENO_ARG_STAR;
+            rec->args[n++] = (uint64_t)(int64_t)va_arg(va, int);
+            ++p;
+        } else {
+            while (*p >= '0' && *p <= '9') ++p;
+        }
+        if (*p == '.') {
+            ++p;
+            if (*p == '*') {
+                if (n >= XENO_LOG_MAX_ARGS) return 0;
+                rec->kinds[n] = XENO_ARG_STAR;
+                rec->args[n++] = (uint64_t)(int64_t)va_arg(va, int);
+                ++p;
+            } else {
+                while (*p >= '0' && *p <= '9') ++p;
+            }
+        }
+
+        /* length: 0 none, 1 hh, 2 h, 3 l, 4 ll/j/q, 5 z, 6 t, 7 L */
+        int len = 0;
+        if (p[0] == 'h' && p[1] == 'h') { len = 1; p += 2; }
+        else if (p[0] == 'h') { len = 2; ++p; }
+        else if (p[0] == 'l' && p[1] == 'l') { len = 4; p += 2; }
+        else if (p[0] == 'l') { len = 3; ++p; }
+        else if (p[0] == 'j' || p[0] == 'q') { len = 4; ++p; }
+        else if (p[0] == 'z') { len = 5; ++p; }
+        else if (p[0] == 't') { len = 6; ++p; }
+        else if (p[0] == 'L') { len = 7; ++p; }
+
+        if (!*p) return 0;
+        if (n >= XENO_LOG_MAX_ARGS) return 0;
+
+        switch (*p) {
+        case 'd': case 'i': {
+            int64_t v;
+            switch (len) {
+            case 1: v = (signed char)va_arg(va, int); break;
+            case 2: v = (short)va_arg(va, int); break;
+            case 3: v = va_arg(va, long); break;
+            case 4: v = va_arg(va, long long); break;
+            case 5: v = (int64_t)va_arg(va, size_t); break;
+            case 6: v = va_arg(va, ptrdiff_t); break;
+            default: v = va_arg(va, int); break;
+            }
+            rec->kinds[n] = XENO_ARG_I64;
+            rec->args[n++] = (uint64_t)v;
+            break;
+        }
+        case 'u': case 'o': case 'x': case 'X': {
+            uint64_t v;
+            switch (len) {
+            case 1: v = (unsigned char)va_arg(va, unsigned int); break;
+            case 2: v = (unsigned short)va_arg(va, unsigned int); break;
+            case 3: v = va_arg(va, unsigned long); break;
+            case 4: v = va_arg(va, unsigned long long); break;
+            case 5: v = va_arg(va, size_t); break;
+            case 6: v = (uint64_t)va_arg(va, ptrdiff_t); break;
+            default: v = va_arg(va, unsigned int); break;
+            }
+            rec->kinds[n] = XENO_ARG_U64;
+            rec->args[n++] = v;
+            break;
+        }
+        case 'c':
+            if (len == 3) return 0;
+            rec->kinds[n] = XENO_ARG_CHAR;
+            rec->args[n++] = (uint64_t)(int64_t)va_arg(va, int);
+            break;
+        case 'f': case 'F': case 'e': case 'E':
+        case 'g': case 'G': case 'a': case 'A': {
+            if (len == 7) return 0;
+            double d = va_arg(va, double);
+            rec->kinds[n] = XENO_ARG_F64;
+            memcpy(&rec->args[n++], &d, sizeof(d));
+            break;
+        }
+        case 'p':
+            rec->kinds[n] = XENO_ARG_PTR;
+            rec->args[n++] = (uint64_t)(uintptr_t)va_arg(va, void *);
+            break;
+        case 's': {
+            if (len == 3) return 0;
+            const char *s = va_arg(va, const char *);
+            if (!s) s = "(null)";
+            size_t room = sizeof(rec->str) - str_used;
+            if (room == 0) return 0;
+            size_t sl = strnlen(s, room - 1);
+            memcpy(rec->str + str_used, s, sl);
+            rec->str[str_used + sl] = '\0';
+            rec->kinds[n] = XENO_ARG_STR;
+            rec->args[n++] = (uint64_t)str_used;
+            str_used += sl + 1;
+            break;
+        }
+        default:
+            /* %n, wide strings and unknown conversions */
+            return 0;
+        }
+    }
+    rec->nargs = (uint8_t)n;
+    return 1;
+}
+
+static void xeno_log_ring_release(void *p)
+{
+    XenoLogRing *ring = (XenoLogRing *)p;
+    if (ring) atomic_store_explicit(&ring->owned, 0, memory_order_release);
+}
+
+static XenoLogRing *xeno_log_ring_acquire(void)
+{
+    /* Reuse a ring left behind by an exited thread before allocating. */
+    for (XenoLogRing *r = atomic_load_explicit(&g_rings, memory_order_acquire); r; r = r->next) {
+        int expected = 0;
+        if (atomic_compare_exchange_strong_explicit(&r->owned, &expected, 1,
+                                                    memory_order_acq_rel, memory_order_relaxed)) {
+            pthread_setspecific(g_ring_key, r);
+            return r;
+        }
+    }
+
+    XenoLogRing *ring = (XenoLogRing *)calloc(1, sizeof(*ring));
+    if (!ring) return NULL;
+    atomic_store_explicit(&ring->owned, 1, memory_order_relaxed);
+    XenoLogRing *head = atomic_load_explicit(&g_rings, memory_order_relaxed);
+    do {
+        ring->next = head;
+    } while (!atomic_compare_exchange_weak_explicit(&g_rings, &head, ring,
+                                                    memory_order_release, memory_order_relaxed));
+    pthread_setspecific(g_ring_key, ring);
+    return ring;
+}
+
+static void xeno_log_push(int level, const char *fmt, va_list va)
+{
+    XenoLogRing *ring = t_ring;
+    if (!ring) {
+        ring = t_ring = xeno_log_ring_acquire();
+        if (!ring) return;
+    }
+
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    if (head - tail >= XENO_LOG_RING_SLOTS) {
+        atomic_fetch_add_explicit(&ring->dropped, 1, memory_order_relaxed);
+        return;
+    }
 
-    if (fmt) vfprintf(stderr, fmt, va);
-    fprintf(stderr, "\n");
-    fflush(stderr);
+    XenoLogRecord *rec = &ring->slots[head & (XENO_LOG_RING_SLOTS - 1u)];
+    rec->ticks = xeno_log_ticks();
+    rec->fmt = fmt;
+    rec->level = (uint8_t)level;
+    rec->flags = 0;
+
+    va_list cp;
+    va_copy(cp, va);
+    int packed = fmt ? xeno_log_pack(rec, fmt, cp) : 0;
+    va_end(cp);
+    if (!packed) {
+        /* Rare path: arguments we cannot capture raw are formatted here. */
+        rec->flags = XENO_LOG_REC_PREFORMATTED;
+        rec->nargs = 0;
+        if (fmt) vsnprintf(rec->str, sizeof(rec->str), fmt, va);
+        else rec->str[0] = '\0';
+    }
+
+    atomic_store_explicit(&ring->head, head + 1u, memory_order_release);
+
+    if (level >= XENO_LOG_LEVEL_ERROR) pthread_cond_signal(&g_wake_cv);
+}
+
+/* ------------------------------------------------------------------------- */
+/* Writer side                                                               */
+/* ------------------------------------------------------------------------- */
+
+typedef struct XenoLogBatch {
+    char buf[XENO_LOG_BATCH_BYTES];
+    size_t len;
+    time_t last_sec;
+    char sec_text[24];
+} XenoLogBatch;
+
+static void batch_flush(XenoLogBatch *b)
+{
+    if (!b->len) return;
+    int fd = fileno(xeno_log_stream());
+    size_t off = 0;
+    while (off < b->len) {
+        ssize_t w = write(fd, b->buf + off, b->len - off);
+        if (w < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        off += (size_t)w;
+    }
+    b->len = 0;
+}
+
+static void batch_reserve(XenoLogBatch *b, size_t need)
+{
+    if (b->len + need > sizeof(b->buf)) batch_flush(b);
+}
+
+static void batch_appendf(XenoLogBatch *b, const char *fmt, ...)
+{
+    batch_reserve(b, 256);
+    va_list va;
+    va_start(va, fmt);
+    int w = vsnprintf(b->buf + b->len, sizeof(b->buf) - b->len, fmt, va);
+    va_end(va);
+    if (w > 0) {
+        size_t room = sizeof(b->buf) - b->len;
+        b->len += ((size_t)w < room) ? (size_t)w : room - 1;
+    }
+}
+
+static void batch_append(XenoLogBatch *b, const char *s, size_t n)
+{
+    while (n) {
+        if (b->len == sizeof(b->buf)) batch_flush(b);
+        size_t room = sizeof(b->buf) - b->len;
+        size_t c = n < room ? n : room;
+        memcpy(b->buf + b->len, s, c);
+        b->len += c;
+        s += c;
+        n -= c;
+    }
+}
+
+#define XENO_LOG_EMIT(...) w = snprintf(out, cap, __VA_ARGS__)
+
+/* Format one conversion with its captured argument(s). spec has the length
+   modifier already normalised for the captured kind. */
+static int format_spec(char *out, size_t cap, const char *spec, const int *stars, int nstar,
+                       const XenoLogRecord *rec, uint32_t ai)
+{
+    int w = 0;
+    uint8_t kind = rec->kinds[ai];
+    uint64_t v = rec->args[ai];
+    double d;
+
+    switch (kind) {
+    case XENO_ARG_I64:
+        if (nstar == 0) XENO_LOG_EMIT(spec, (long long)v);
+        else if (nstar == 1) XENO_LOG_EMIT(spec, stars[0], (long long)v);
+        else XENO_LOG_EMIT(spec, stars[0], stars[1], (long long)v);
+        break;
+    case XENO_ARG_U64:
+        if (nstar == 0) XENO_LOG_EMIT(spec, (unsigned long long)v);
+        else if (nstar == 1) XENO_LOG_EMIT(spec, stars[0], (unsigned long long)v);
+        else XENO_LOG_EMIT(spec, stars[0], stars[1], (unsigned long long)v);
+        break;
+    case XENO_ARG_F64:
+        memcpy(&d, &v, sizeof(d));
+        if (nstar == 0) XENO_LOG_EMIT(spec, d);
+        else if (nstar == 1) XENO_LOG_EMIT(spec, stars[0], d);
+        else XENO_LOG_EMIT(spec, stars[0], stars[1], d);
+        break;
+    case XENO_ARG_STR:
+        if (nstar == 0) XENO_LOG_EMIT(spec, rec->str + v);
+        else if (nstar == 1) XENO_LOG_EMIT(spec, stars[0], rec->str + v);
+        else XENO_LOG_EMIT(spec, stars[0], stars[1], rec->str + v);
+        break;
+    case XENO_ARG_PTR:
+        if (nstar == 0) XENO_LOG_EMIT(spec, (void *)(uintptr_t)v);
+        else if (nstar == 1) XENO_LOG_EMIT(spec, stars[0], (void *)(uintptr_t)v);
+        else XENO_LOG_EMIT(spec, stars[0], stars[1], (void *)(uintptr_t)v);
+        break;
+    case XENO_ARG_CHAR:
+        if (nstar == 0) XENO_LOG_EMIT(spec, (int)v);
+        else if (nstar == 1) XENO_LOG_EMIT(spec, stars[0], (int)v);
+        else XENO_LOG_EMIT(spec, stars[0], stars[1], (int)v);
+        break;
+    default:
+        break;
+    }
+    return w;
+}
+
+#undef XENO_LOG_EMIT
+
+static void format_record(XenoLogBatch *b, const XenoLogRecord *rec)
+{
+    /* Timestamp: tick delta from the init-time wall clock sample. */
+    uint64_t dt = rec->ticks - g_tick_base;
+    uint64_t sec = dt / g_tick_hz;
+    uint64_t ms = ((dt % g_tick_hz) * 1000ull) / g_tick_hz + (uint64_t)g_wall_base.tv_nsec / 1000000ull;
+    time_t wall = g_wall_base.tv_sec + (time_t)sec + (time_t)(ms / 1000ull);
+    ms %= 1000ull;
+    if (wall != b->last_sec) {
+        struct tm tm;
+        localtime_r(&wall, &tm);
+        if (strftime(b->sec_text, sizeof(b->sec_text), "%Y-%m-%d %H:%M:%S", &tm) == 0) b->sec_text[0] = '\0';
+        b->last_sec = wall;
+    }
+    const char *tag = rec->level < 4 ? g_level_tags[rec->level] : "LOG";
+    batch_appendf(b, "%s.%03u [%s] ", b->sec_text, (unsigned)ms, tag);
+
+    if (rec->flags & XENO_LOG_REC_PREFORMATTED) {
+        batch_append(b, rec->str, strnlen(rec->str, sizeof(rec->str)));
+        batch_append(b, "\n", 1);
+        return;
+    }
+
+    const char *p = rec->fmt;
+    uint32_t ai = 0;
+    while (*p) {
+        const char *lit = p;
+        while (*p && *p != '%') ++p;
+        if (p > lit) batch_append(b, lit, (size_t)(p - lit));
+        if (!*p) break;
+        if (p[1] == '%') { batch_append(b, "%", 1); p += 2; continue; }
+
+        /* Rebuild the specifier with a normalised length modifier. */
+        char spec[32];
+        size_t sl = 0;
+        int stars[2];
+        int nstar = 0;
+        spec[sl++] = *p++;
+        while (*p && strchr("-+ #0'", *p) && sl < 16) spec[sl++] = *p++;
+        if (*p == '*') { spec[sl++] = *p++; if (ai < rec->nargs) stars[nstar++] = (int)(int64_t)rec->args[ai++]; }
+        else while (*p >= '0' && *p <= '9' && sl < 20) spec[sl++] = *p++;
+        if (*p == '.') {
+            spec[sl++] = *p++;
+            if (*p == '*') { spec[sl++] = *p++; if (ai < rec->nargs) stars[nstar++] = (int)(int64_t)rec->args[ai++]; }
+            else while (*p >= '0' && *p <= '9' && sl < 26) spec[sl++] = *p++;
+        }
+        while (*p && strchr("hljzqtL", *p)) ++p;
+        if (!*p || ai >= rec->nargs) break;
+        char conv = *p++;
+        if (rec->kinds[ai] == XENO_ARG_I64 || rec->kinds[ai] == XENO_ARG_U64) {
+            spec[sl++] = 'l';
+            spec[sl++] = 'l';
+        }
+        spec[sl++] = conv;
+        spec[sl] = '\0';
+
+        batch_reserve(b, 256);
+        int w = format_spec(b->buf + b->len, sizeof(b->buf) - b->len, spec, stars, nstar, rec, ai++);
+        if (w > 0) {
+            size_t room = sizeof(b->buf) - b->len;
+            b->len += (size_t)w < room ? (size_t)w : room - 1;
+        }
+    }
+    batch_append(b, "\n", 1);
+}
+
+/* Drain every ring once. Returns number of records written. */
+static size_t xeno_log_drain(XenoLogBatch *b)
+{
+    size_t total = 0;
+    for (XenoLogRing *r = atomic_load_explicit(&g_rings, memory_order_acquire); r; r = r->next) {
+        uint64_t dropped = atomic_exchange_explicit(&r->dropped, 0, memory_order_relaxed);
+        if (dropped) {
+            batch_appendf(b, "[WARN] logging: ring overflow, dropped %llu messages\n",
+                          (unsigned long long)dropped);
+        }
+        uint32_t tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+        uint32_t head = atomic_load_explicit(&r->head, memory_order_acquire);
+        while (tail != head) {
+            format_record(b, &r->slots[tail & (XENO_LOG_RING_SLOTS - 1u)]);
+            ++tail;
+            ++total;
+            /* Release slots as we go so producers are not starved by a long drain. */
+            if ((tail & 31u) == 0) atomic_store_explicit(&r->tail, tail, memory_order_release);
+        }
+        atomic_store_explicit(&r->tail, tail, memory_order_release);
+    }
+    return total;
+}
+
+static void *xeno_log_writer_main(void *arg)
+{
+    (void)arg;
+    static XenoLogBatch batch;
+    for (;;) {
+        int stopping = atomic_load_explicit(&g_stop, memory_order_acquire);
+        size_t n = xeno_log_drain(&batch);
+        batch_flush(&batch);
+        if (stopping) break;
+        if (n == 0) {
+            struct timespec until;
+            clock_gettime(CLOCK_REALTIME, &until);
+            until.tv_nsec += XENO_LOG_IDLE_NS;
+            if (until.tv_nsec >= 1000000000L) { until.tv_sec += 1; until.tv_nsec -= 1000000000L; }
+            pthread_mutex_lock(&g_wake_mtx);
+            pthread_cond_timedwait(&g_wake_cv, &g_wake_mtx, &until);
+            pthread_mutex_unlock(&g_wake_mtx);
+        }
+    }
+    atomic_store_explicit(&g_writer_running, 0, memory_order_release);
+    return NULL;
+}
+
+/* The writer does not exist in a forked child: the child logs synchronously
+   and leaves whatever the parent had queued to the parent's writer. */
+static void xeno_log_atfork_child(void)
+{
+    atomic_store_explicit(&g_writer_running, 0, memory_order_relaxed);
+    atomic_store_explicit(&g_async, 0, memory_order_relaxed);
+}
+
+static void xeno_log_init_once(void)
+{
+    g_tick_hz = xeno_log_tick_hz();
+    g_tick_base = xeno_log_ticks();
+    clock_gettime(CLOCK_REALTIME, &g_wall_base);
+
+    const char *sync = getenv("EXYNOSTOOLS_LOG_SYNC");
+    if (sync && *sync == '1') return;
+    if (pthread_key_create(&g_ring_key, xeno_log_ring_release) != 0) return;
+    atomic_store_explicit(&g_writer_running, 1, memory_order_relaxed);
+    if (pthread_create(&g_writer, NULL, xeno_log_writer_main, NULL) != 0) {
+        atomic_store_explicit(&g_writer_running, 0, memory_order_relaxed);
+        return;
+    }
+    pthread_atfork(NULL, NULL, xeno_log_atfork_child);
+    atomic_store_explicit(&g_async, 1, memory_order_release);
+}
+
+static void xeno_log_dispatch(int level, const char *fmt, va_list va)
+{
+    if (!xeno_log_level_enabled(level)) return;
+    pthread_once(&g_once, xeno_log_init_once);
+    if (atomic_load_explicit(&g_async, memory_order_acquire)) {
+        xeno_log_push(level, fmt, va);
+    } else {
+        xeno_log_vprint_impl(g_level_tags[level], fmt, va);
+    }
+}
+
+void xeno_log_flush(void)
+{
+    if (!atomic_load_explicit(&g_async, memory_order_acquire)) return;
+    /* Wait until the writer has caught up with everything published so far,
+       but never past XENO_LOG_FLUSH_NS. */
+    struct timespec start, now;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (XenoLogRing *r = atomic_load_explicit(&g_rings, memory_order_acquire); r; r = r->next) {
+        uint32_t head = atomic_load_explicit(&r->head, memory_order_acquire);
+        while ((int32_t)(head - atomic_load_explicit(&r->tail, memory_order_acquire)) > 0) {
+            if (!atomic_load_explicit(&g_writer_running, memory_order_acquire)) {
+                /* The writer has exited (teardown ordering): it is no
+                   longer a consumer, so drain here instead. */
+                static XenoLogBatch batch;
+                pthread_mutex_lock(&g_inline_mtx);
+                xeno_log_drain(&batch);
+                batch_flush(&batch);
+                pthread_mutex_unlock(&g_inline_mtx);
+                return;
+            }
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            if ((now.tv_sec - start.tv_sec) * 1000000000L + (now.tv_nsec - start.tv_nsec) >= XENO_LOG_FLUSH_NS) return;
+            pthread_cond_signal(&g_wake_cv);
+            struct timespec ts = { 0, 200000L };
+            nanosleep(&ts, NULL);
+        }
+    }
+}
+
+unsigned long long xeno_log_dropped_count(void)
+{
+    unsigned long long n = 0;
+    for (XenoLogRing *r = atomic_load_explicit(&g_rings, memory_order_acquire); r; r = r->next) {
+        n += atomic_load_explicit(&r->dropped, memory_order_relaxed);
+    }
+    return n;
+}
+
+/* ------------------------------------------------------------------------- */
+/* Level filtering and rate limiting                                         */
+/* ------------------------------------------------------------------------- */
+
+int xeno_log_parse_level(const char *name)
+{
+    if (!name || !*name) return -1;
+    if (strcmp(name, "debug") == 0 || strcmp(name, "0") == 0) return XENO_LOG_LEVEL_DEBUG;
+    if (strcmp(name, "info") == 0 || strcmp(name, "1") == 0) return XENO_LOG_LEVEL_INFO;
+    if (strcmp(name, "warn") == 0 || strcmp(name, "2") == 0) return XENO_LOG_LEVEL_WARN;
+    if (strcmp(name, "error") == 0 || strcmp(name, "3") == 0) return XENO_LOG_LEVEL_ERROR;
+    if (strcmp(name, "off") == 0 || strcmp(name, "4") == 0) return XENO_LOG_LEVEL_OFF;
+    return -1;
+}
+
+void xeno_log_set_level(int level)
+{
+    if (level < XENO_LOG_LEVEL_DEBUG) level = XENO_LOG_LEVEL_DEBUG;
+    if (level > XENO_LOG_LEVEL_OFF) level = XENO_LOG_LEVEL_OFF;
+    atomic_store_explicit(&xeno_log_level_g, level, memory_order_relaxed);
+}
+
+__attribute__((constructor))
+static void xeno_log_level_from_env(void)
+{
+    const char *dbg = getenv("EXYNOSTOOLS_DEBUG");
+    if (dbg && *dbg == '1') xeno_log_set_level(XENO_LOG_LEVEL_DEBUG);
+    int lvl = xeno_log_parse_level(getenv("EXYNOSTOOLS_LOG_LEVEL"));
+    if (lvl >= 0) xeno_log_set_level(lvl);
+}
+
+int xeno_log_ratelimit_check(XenoLogRateLimit *rl, uint32_t per_sec, uint32_t *suppressed)
+{
+    struct timespec ts;
+#ifdef CLOCK_MONOTONIC_COARSE
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+#else
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+#endif
+    uint64_t now = (uint64_t)ts.tv_sec * 1000ull + (uint64_t)ts.tv_nsec / 1000000ull;
+
+    *suppressed = 0;
+    uint64_t start = atomic_load_explicit(&rl->window_start_ms, memory_order_relaxed);
+    if (now - start >= 1000ull &&
+        atomic_compare_exchange_strong_explicit(&rl->window_start_ms, &start, now,
+                                                memory_order_relaxed, memory_order_relaxed)) {
+        *suppressed = atomic_exchange_explicit(&rl->suppressed, 0, memory_order_relaxed);
+        atomic_store_explicit(&rl->count, 0, memory_order_relaxed);
+    }
+    if (atomic_fetch_add_explicit(&rl->count, 1, memory_order_relaxed) < per_sec) return 1;
+    atomic_fetch_add_explicit(&rl->suppressed, 1, memory_order_relaxed);
+    return 0;
+}
+
+__attribute__((destructor))
+static void xeno_log_shutdown(void)
+{
+    if (!atomic_exchange_explicit(&g_async, 0, memory_order_acq_rel)) return;
+    atomic_store_explicit(&g_stop, 1, memory_order_release);
+    pthread_cond_signal(&g_wake_cv);
+    pthread_join(g_writer, NULL);
 }
 
 void logging_info(const char *fmt, ...)
 {
-    va_list va; va_start(va, fmt); xeno_log_vprint_impl("INFO", fmt, va); va_end(va);
+    va_list va; va_start(va, fmt); xeno_log_dispatch(XENO_LOG_LEVEL_INFO, fmt, va); va_end(va);
 }
 void logging_warn(const char *fmt, ...)
 {
-    va_list va; va_start(va, fmt); xeno_log_vprint_impl("WARN", fmt, va); va_end(va);
+    va_list va; va_start(va, fmt); xeno_log_dispatch(XENO_LOG_LEVEL_WARN, fmt, va); va_end(va);
 }
 void logging_error(const char *fmt, ...)
 {
-    va_list va; va_start(va, fmt); xeno_log_vprint_impl("ERROR", fmt, va); va_end(va);
+    va_list va; va_start(va, fmt); xeno_log_dispatch(XENO_LOG_LEVEL_ERROR, fmt, va); va_end(va);
 }
 void logging_debug(const char *fmt, ...)
 {
-    va_list va; va_start(va, fmt); xeno_log_vprint_impl("DEBUG", fmt, va); va_end(va);
+    va_list va; va_start(va, fmt); xeno_log_dispatch(XENO_LOG_LEVEL_DEBUG, fmt, va); va_end(va);
 }
@@ -1,15 +1,39 @@
 #include "logging.h"
 #include "perf_conf.h"
+#include "app_profile.h"
+#include "autotune.h"
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <pthread.h>
+#ifdef __linux__
+#include <poll.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#endif
 
 void xeno_perf_conf_defaults(XenoPerfConf* cfg) {
     memset(cfg, 0, sizeof(*cfg));
     strncpy(cfg->shader_cache_dir, "/storage/emulated/0/Android/data/com.winlator/files/cache/exynostools", sizeof(cfg->shader_cache_dir)-1);
     cfg->pipeline_cache_mb = 64;
-    cfg->sync_mode = XENO_SYNC_AGGRESSIVE;
+    cfg->sync_mode = XENO_SYNC_BALANCED;
     cfg->validation = XENO_VALIDATION_MINIMAL;
+    cfg->log_level = -1;
+    cfg->vrs_target_fps = 0;
+    cfg->vrs_max_rate = 2;
+    cfg->hot_reload = 1;
+    cfg->upload_page_kb = 64;
+    cfg->bc_local_x = 16;
+    cfg->bc_local_y = 8;
+    cfg->loadstore_opt = XENO_LOADSTORE_SAFE;
+    cfg->pass_fusion = 1;
+    cfg->bindless_slots = 4096;
+    cfg->descriptor_reuse = 1;
+    cfg->shader_dedupe = 1;
 }
 
 static void trim(char* s) {
@@ -18,6 +42,85 @@ static void trim(char* s) {
     while (len && (s[len-1] == '\n' || s[len-1] == '\r' || s[len-1] == ' ' || s[len-1] == '\t')) s[--len] = 0;
 }
 
+/* Env names accepted in place of the file keys (game profiles use them). */
+static const struct { const char* env; const char* key; } k_env_keys[] = {
+    { "EXYNOSTOOLS_VRS_TARGET_FPS", "vrs_target_fps" },
+    { "EXYNOSTOOLS_VRS_MAX_RATE", "vrs_max_rate" },
+    { "EXYNOSTOOLS_VRS_CONTENT", "vrs_content" },
+    { "EXYNOSTOOLS_ENABLE_ASYNC", "async_submit" },
+    { "EXYNOSTOOLS_PERF_CONF_WATCH", "hot_reload" },
+    { "EXYNOSTOOLS_AUTOTUNE", "autotune" },
+    { "EXYNOSTOOLS_DYNAMIC_RENDERING", "dynamic_rendering" },
+    { "EXYNOSTOOLS_LOADSTORE_OPT", "loadstore_opt" },
+    { "EXYNOSTOOLS_PASS_FUSION", "pass_fusion" },
+    { "EXYNOSTOOLS_BINDLESS_SLOTS", "bindless_slots" },
+    { "EXYNOSTOOLS_DESCRIPTOR_REUSE", "descriptor_reuse" },
+    { "EXYNOSTOOLS_SHADER_FP16", "shader_fp16" },
+    { "EXYNOSTOOLS_SHADER_DEDUPE", "shader_dedupe" },
+};
+#define XENO_PERF_CONF_ENV_KEYS (sizeof(k_env_keys) / sizeof(k_env_keys[0]))
+
+int xeno_perf_conf_set(XenoPerfConf* cfg, const char* key, const char* val) {
+    for (size_t i = 0; i < XENO_PERF_CONF_ENV_KEYS; ++i) {
+        if (strcmp(key, k_env_keys[i].env) == 0) key = k_env_keys[i].key;
+    }
+    if (strcmp(key, "shader_cache_dir") == 0) {
+        strncpy(cfg->shader_cache_dir, val, sizeof(cfg->shader_cache_dir)-1);
+    } else if (strcmp(key, "pipeline_cache_mb") == 0) {
+        cfg->pipeline_cache_mb = atoi(val);
+    } else if (strcmp(key, "sync_mode") == 0) {
+        if (strcmp(val, "aggressive") == 0) cfg->sync_mode = XENO_SYNC_AGGRESSIVE;
+        else if (strcmp(val, "balanced") == 0) cfg->sync_mode = XENO_SYNC_BALANCED;
+        else cfg->sync_mode = XENO_SYNC_SAFE;
+    } else if (strcmp(key, "validation") == 0) {
+        if (strcmp(val, "off") == 0) cfg->validation = XENO_VALIDATION_OFF;
+        else cfg->validation = XENO_VALIDATION_MINIMAL;
+    } else if (strcmp(key, "log_level") == 0) {
+        cfg->log_level = xeno_log_parse_level(val);
+    } else if (strcmp(key, "vrs_target_fps") == 0) {
+        cfg->vrs_target_fps = atoi(val);
+    } else if (strcmp(key, "vrs_max_rate") == 0) {
+        cfg->vrs_max_rate = atoi(val); /* "4" or "4x4" */
+    } else if (strcmp(key, "vrs_content") == 0) {
+        cfg->vrs_content = atoi(val);
+    } else if (strcmp(key, "async_submit") == 0) {
+        cfg->async_submit = atoi(val);
+    } else if (strcmp(key, "hot_reload") == 0) {
+        cfg->hot_reload = atoi(val);
+    } else if (strcmp(key, "upload_page_kb") == 0) {
+        cfg->upload_page_kb = atoi(val);
+    } else if (strcmp(key, "bc_workgroup") == 0) {
+        int x = 0, y = 0;
+        if (sscanf(val, "%dx%d", &x, &y) == 2 && x > 0 && y > 0) {
+            cfg->bc_local_x = x;
+            cfg->bc_local_y = y;
+        }
+    } else if (strcmp(key, "autotune") == 0) {
+        cfg->autotune = atoi(val);
+    } else if (strcmp(key, "dynamic_rendering") == 0) {
+        if (strcmp(val, "emulate") == 0) cfg->dynamic_rendering = XENO_DYNRENDER_EMULATE;
+        else if (strcmp(val, "native") == 0) cfg->dynamic_rendering = XENO_DYNRENDER_NATIVE;
+        else cfg->dynamic_rendering = XENO_DYNRENDER_AUTO;
+    } else if (strcmp(key, "loadstore_opt") == 0) {
+        if (strcmp(val, "off") == 0) cfg->loadstore_opt = XENO_LOADSTORE_OFF;
+        else if (strcmp(val, "learn") == 0) cfg->loadstore_opt = XENO_LOADSTORE_LEARN;
+        else cfg->loadstore_opt = XENO_LOADSTORE_SAFE;
+    } else if (strcmp(key, "pass_fusion") == 0) {
+        cfg->pass_fusion = atoi(val);
+    } else if (strcmp(key, "bindless_slots") == 0) {
+        cfg->bindless_slots = atoi(val);
+    } else if (strcmp(key, "descriptor_reuse") == 0) {
+        cfg->descriptor_reuse = atoi(val);
+    } else if (strcmp(key, "shader_fp16") == 0) {
+        cfg->shader_fp16 = atoi(val);
+    } else if (strcmp(key, "shader_dedupe") == 0) {
+        cfg->shader_dedupe = atoi(val);
+    } else {
+        return 0;
+    }
+    return 1;
+}
+
 void xeno_perf_conf_load(const char* path, XenoPerfConf* cfg) {
     xeno_perf_conf_defaults(cfg);
     FILE* f = fopen(path, "r");
@@ -30,22 +133,234 @@ void xeno_perf_conf_load(const char* path, XenoPerfConf* cfg) {
         trim(line);
         if (line[0] == '#' || line[0] == '\0') continue;
         char key[256], val[768];
-        if (sscanf(line, "%255[^=]=%767[^\n]", key, val) == 2) {
-            if (strcmp(key, "shader_cache_dir") == 0) {
-                strncpy(cfg->shader_cache_dir, val, sizeof(cfg->shader_cache_dir)-1);
-            } else if (strcmp(key, "pipeline_cache_mb") == 0) {
-                cfg->pipeline_cache_mb = atoi(val);
-            } else if (strcmp(key, "sync_mode") == 0) {
-                if (strcmp(val, "aggressive") == 0) cfg->sync_mode = XENO_SYNC_AGGRESSIVE;
-                else if (strcmp(val, "balanced") == 0) cfg->sync_mode = XENO_SYNC_BALANCED;
-                else cfg->sync_mode = XENO_SYNC_SAFE;
-            } else if (strcmp(key, "validation") == 0) {
-                if (strcmp(val, "off") == 0) cfg->validation = XENO_VALIDATION_OFF;
-                else cfg->validation = XENO_VALIDATION_MINIMAL;
-            }
-        }
+        if (sscanf(line, "%255[^=]=%767[^\n]", key, val) == 2) xeno_perf_conf_set(cfg, key, val);
     }
     fclose(f);
+    /* EXYNOSTOOLS_LOG_LEVEL wins over the file so a single run can be made verbose. */
+    if (cfg->log_level >= 0 && !getenv("EXYNOSTOOLS_LOG_LEVEL")) xeno_log_set_level(cfg->log_level);
     XENO_LOGI("perf_conf: loaded from %s (cache_dir=%s, pcache=%dMB)", path, cfg->shader_cache_dir, cfg->pipeline_cache_mb);
 }
 
+
+/* ---------------------------------------------------------------- */
+/* Active snapshot                                                   */
+/* ---------------------------------------------------------------- */
+
+#define XENO_PERF_CONF_LISTENERS 16
+#define XENO_PERF_CONF_DEBOUNCE_MS 100
+#define XENO_PERF_CONF_POLL_MS 250
+
+/* Replaced snapshots stay allocated: readers may hold one for as long as
+   they like, and only an edit of the file replaces one. */
+typedef struct XenoPerfConfRetired {
+    XenoPerfConf* conf;
+    struct XenoPerfConfRetired* next;
+} XenoPerfConfRetired;
+
+typedef struct XenoPerfConfListenerSlot {
+    XenoPerfConfListener fn;
+    void* user;
+    int handle;
+} XenoPerfConfListenerSlot;
+
+static _Atomic(XenoPerfConf*) g_active = NULL;
+static XenoPerfConf g_fallback;     /* published if the first snapshot cannot be allocated */
+static pthread_once_t g_active_once = PTHREAD_ONCE_INIT;
+static char g_path[512];
+
+/* Serializes reloads, the retired list and listener calls. */
+static pthread_mutex_t g_reload_mtx = PTHREAD_MUTEX_INITIALIZER;
+static XenoPerfConfRetired* g_retired;
+static XenoPerfConfListenerSlot g_listeners[XENO_PERF_CONF_LISTENERS];
+static int g_next_handle = 1;
+
+static pthread_once_t g_watch_once = PTHREAD_ONCE_INIT;
+static pthread_t g_watcher;
+static int g_watcher_running;
+static _Atomic int g_watch_stop = 0;
+
+static uint64_t conf_now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000ull + (uint64_t)ts.tv_nsec / 1000000ull;
+}
+
+/* The matched game profile, then the environment for one-off runs. */
+static void apply_overrides(XenoPerfConf* cfg) {
+    xeno_app_profile_apply(cfg);
+    for (size_t i = 0; i < XENO_PERF_CONF_ENV_KEYS; ++i) {
+        const char* v = getenv(k_env_keys[i].env);
+        if (v && *v) xeno_perf_conf_set(cfg, k_env_keys[i].key, v);
+    }
+}
+
+static XenoPerfConf* build_snapshot(void) {
+    XenoPerfConf* cfg = (XenoPerfConf*)malloc(sizeof(*cfg));
+    if (!cfg) return NULL;
+    xeno_perf_conf_load(g_path, cfg);
+
+    /* Tuned values sit between the file and the overrides, so a profile or
+       env var always wins; the tuner skips the knobs those pin. */
+    XenoPerfConf final = *cfg;
+    apply_overrides(&final);
+    if (final.autotune) {
+        xeno_autotune_apply(cfg, &final);
+        apply_overrides(cfg);
+    } else {
+        *cfg = final;
+    }
+    return cfg;
+}
+
+static void load_active(void) {
+    const char* path = getenv("EXYNOSTOOLS_PERF_CONF");
+    strncpy(g_path, path && *path ? path : XENO_PERF_CONF_DEFAULT_PATH, sizeof(g_path) - 1);
+    XenoPerfConf* cfg = build_snapshot();
+    if (!cfg) {
+        xeno_perf_conf_defaults(&g_fallback);
+        cfg = &g_fallback;
+    }
+    atomic_store_explicit(&g_active, cfg, memory_order_release);
+}
+
+const XenoPerfConf* xeno_perf_conf_active(void) {
+    XenoPerfConf* cfg = atomic_load_explicit(&g_active, memory_order_acquire);
+    if (cfg) return cfg;
+    pthread_once(&g_active_once, load_active);
+    return atomic_load_explicit(&g_active, memory_order_acquire);
+}
+
+int xeno_perf_conf_reload(void) {
+    xeno_perf_conf_active();
+    XenoPerfConf* next = build_snapshot();
+    XenoPerfConfRetired* retired = (XenoPerfConfRetired*)malloc(sizeof(*retired));
+    if (!next || !retired) {
+        XENO_LOGW("perf_conf: reload failed, keeping the current settings");
+        free(next);
+        free(retired);
+        return 0;
+    }
+
+    pthread_mutex_lock(&g_reload_mtx);
+    const XenoPerfConf* prev = atomic_load_explicit(&g_active, memory_order_relaxed);
+    /* Both come from xeno_perf_conf_load, which clears the padding too. */
+    if (memcmp(prev, next, sizeof(*next)) == 0) {
+        pthread_mutex_unlock(&g_reload_mtx);
+        free(next);
+        free(retired);
+        return 0;
+    }
+    atomic_store_explicit(&g_active, next, memory_order_release);
+    retired->conf = (XenoPerfConf*)prev;
+    retired->next = g_retired;
+    g_retired = retired;
+
+    XENO_LOGI("perf_conf: reloaded %s (sync_mode=%d, vrs_target_fps=%d, vrs_max_rate=%d)", g_path,
+              (int)next->sync_mode, next->vrs_target_fps, next->vrs_max_rate);
+    for (int i = 0; i < XENO_PERF_CONF_LISTENERS; ++i) {
+        if (g_listeners[i].fn) g_listeners[i].fn(prev, next, g_listeners[i].user);
+    }
+    pthread_mutex_unlock(&g_reload_mtx);
+    return 1;
+}
+
+int xeno_perf_conf_subscribe(XenoPerfConfListener fn, void* user) {
+    if (!fn) return 0;
+    int handle = 0;
+    pthread_mutex_lock(&g_reload_mtx);
+    for (int i = 0; i < XENO_PERF_CONF_LISTENERS; ++i) {
+        if (g_listeners[i].fn) continue;
+        handle = g_next_handle++;
+        g_listeners[i] = (XenoPerfConfListenerSlot){ fn, user, handle };
+        break;
+    }
+    pthread_mutex_unlock(&g_reload_mtx);
+    if (!handle) XENO_LOGW("perf_conf: no free listener slot, changes will need a restart");
+    return handle;
+}
+
+void xeno_perf_conf_unsubscribe(int handle) {
+    if (handle <= 0) return;
+    pthread_mutex_lock(&g_reload_mtx);
+    for (int i = 0; i < XENO_PERF_CONF_LISTENERS; ++i) {
+        if (g_listeners[i].handle == handle) memset(&g_listeners[i], 0, sizeof(g_listeners[i]));
+    }
+    pthread_mutex_unlock(&g_reload_mtx);
+}
+
+/* ---------------------------------------------------------------- */
+/* Watcher                                                           */
+/* ---------------------------------------------------------------- */
+
+#ifdef __linux__
+/* Watches the directory rather than the file: editors and package scripts
+   usually write a temporary file and rename it over the old one. */
+static void* watch_main(void* arg) {
+    int fd = (int)(intptr_t)arg;
+    const char* slash = strrchr(g_path, '/');
+    const char* name = slash ? slash + 1 : g_path;
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    uint64_t due = 0;
+
+    while (!atomic_load_explicit(&g_watch_stop, memory_order_relaxed)) {
+        struct pollfd pfd = { .fd = fd, .events = POLLIN };
+        int timeout = due ? XENO_PERF_CONF_DEBOUNCE_MS : XENO_PERF_CONF_POLL_MS;
+        if (poll(&pfd, 1, timeout) > 0 && (pfd.revents & POLLIN)) {
+            ssize_t n = read(fd, buf, sizeof(buf));
+            for (ssize_t off = 0; n > 0 && off < n;) {
+                const struct inotify_event* ev = (const struct inotify_event*)(buf + off);
+                if (ev->len && strcmp(ev->name, name) == 0) due = conf_now_ms() + XENO_PERF_CONF_DEBOUNCE_MS;
+                off += (ssize_t)(sizeof(*ev) + ev->len);
+            }
+        }
+        /* A burst of writes is one reload, once the file has settled. */
+        if (due && conf_now_ms() >= due) {
+            due = 0;
+            xeno_perf_conf_reload();
+        }
+    }
+    close(fd);
+    return NULL;
+}
+#endif
+
+static void watch_start_once(void) {
+    xeno_perf_conf_active();
+#ifdef __linux__
+    char dir[sizeof(g_path)];
+    strncpy(dir, g_path, sizeof(dir) - 1);
+    dir[sizeof(dir) - 1] = 0;
+    char* slash = strrchr(dir, '/');
+    if (slash == dir) slash[1] = 0;
+    else if (slash) *slash = 0;
+    else strcpy(dir, ".");
+
+    int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fd < 0 || inotify_add_watch(fd, dir, IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_DELETE) < 0) {
+        XENO_LOGW("perf_conf: cannot watch %s, edits need a restart", dir);
+        if (fd >= 0) close(fd);
+        return;
+    }
+    if (pthread_create(&g_watcher, NULL, watch_main, (void*)(intptr_t)fd) != 0) {
+        XENO_LOGW("perf_conf: watcher thread unavailable, edits need a restart");
+        close(fd);
+        return;
+    }
+    g_watcher_running = 1;
+    XENO_LOGI("perf_conf: watching %s for changes", g_path);
+#else
+    XENO_LOGD("perf_conf: no inotify on this platform, edits need a restart");
+#endif
+}
+
+void xeno_perf_conf_watch_start(void) {
+    pthread_once(&g_watch_once, watch_start_once);
+}
+
+__attribute__((destructor))
+static void xeno_perf_conf_shutdown(void) {
+    if (!g_watcher_running) return;
+    atomic_store_explicit(&g_watch_stop, 1, memory_order_relaxed);
+    pthread_join(g_watcher, NULL);
+    g_watcher_running = 0;
+}
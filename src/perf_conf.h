@@ -5,8 +5,61 @@ typedef struct XenoPerfConf {
     int pipeline_cache_mb;
     enum { XENO_SYNC_AGGRESSIVE, XENO_SYNC_BALANCED, XENO_SYNC_SAFE } sync_mode;
     enum { XENO_VALIDATION_OFF, XENO_VALIDATION_MINIMAL } validation;
+    int log_level; /* XENO_LOG_LEVEL_*, -1 keeps the env/default level */
+    int vrs_target_fps; /* adaptive shading rate target, 0 = off */
+    int vrs_max_rate;   /* coarsest rate per axis the controller may pick: 1, 2 or 4 */
+    int vrs_content;    /* content-adaptive shading-rate attachment, 0 = off */
+    int async_submit;   /* queue submission on worker threads, 0 = off */
+    int hot_reload;     /* watch the file and apply edits while running, 0 = off */
+    int upload_page_kb; /* smallest staging page of each upload manager */
+    int bc_local_x;     /* BC decode workgroup shape, "bc_workgroup=16x8" */
+    int bc_local_y;
+    int autotune;       /* per-executable exploration of the settings above (autotune.h), 0 = off */
+    /* vkCmdBeginRendering: native when the driver has it, otherwise over
+       cached render passes (rp_cache.h); emulate also replaces the driver's */
+    enum { XENO_DYNRENDER_AUTO, XENO_DYNRENDER_EMULATE, XENO_DYNRENDER_NATIVE } dynamic_rendering;
+    /* attachment load/store ops dropped to DONT_CARE (loadstore_opt.h):
+       safe only where provable, learn also stores nothing has read back */
+    enum { XENO_LOADSTORE_OFF, XENO_LOADSTORE_SAFE, XENO_LOADSTORE_LEARN } loadstore_opt;
+    int pass_fusion;    /* continue back-to-back render passes as one (loadstore_opt.h), 0 = off */
+    int bindless_slots; /* texture heap size for layer passes (bindless.h), 0 = off */
+    int descriptor_reuse; /* alias descriptor sets with identical contents (desc_cache.h), 0 = off */
+    int shader_fp16;    /* relax fragment-shader arithmetic to half precision (spirv_opt.h), 0 = off */
+    int shader_dedupe;  /* share identical shader modules, load replacements (shader_cache.h), 0 = off */
 } XenoPerfConf;
 
+#define XENO_PERF_CONF_DEFAULT_PATH "/etc/exynostools/performance_mode.conf"
+
 void xeno_perf_conf_defaults(XenoPerfConf* cfg);
 void xeno_perf_conf_load(const char* path, XenoPerfConf* cfg);
+/* Applies one setting by file key (sync_mode) or env name
+   (EXYNOSTOOLS_VRS_TARGET_FPS); 0 if the key is not a perf_conf setting. */
+int xeno_perf_conf_set(XenoPerfConf* cfg, const char* key, const char* val);
+
+/* Process-wide configuration, loaded on first use from EXYNOSTOOLS_PERF_CONF
+   (or XENO_PERF_CONF_DEFAULT_PATH) with EXYNOSTOOLS_* overrides applied.
+
+   The result is an immutable snapshot; a reload publishes a new one with a
+   single pointer swap, so this is one atomic load after the first call.
+   Replaced snapshots are never freed, so a pointer stays valid for the
+   life of the process; fetch it again to see later edits. */
+const XenoPerfConf* xeno_perf_conf_active(void);
+
+/* Re-reads the file; when anything changed, publishes the new snapshot and
+   runs the listeners. Returns 1 if a new snapshot was published. */
+int xeno_perf_conf_reload(void);
+
+/* Starts the inotify watcher thread (once per process; no-op when the
+   platform has no inotify). Edits are applied about 100 ms after the file
+   is written or replaced. */
+void xeno_perf_conf_watch_start(void);
+
+/* Called on the thread that published `next`, after the swap, one
+   listener at a time. Listeners must not (un)subscribe from the callback. */
+typedef void (*XenoPerfConfListener)(const XenoPerfConf* prev, const XenoPerfConf* next, void* user);
+
+/* Returns a handle for unsubscribe, 0 on failure. Once unsubscribe returns
+   the listener is not running and will not be called again. */
+int xeno_perf_conf_subscribe(XenoPerfConfListener fn, void* user);
+void xeno_perf_conf_unsubscribe(int handle);
 
@@ -0,0 +1,962 @@
+// src/rp_cache.c
+/*
+  Dynamic-rendering emulation (see rp_cache.h).
+
+  A vkCmdBeginRendering instance becomes a render pass with one subpass.
+  Its attachments are the color attachments, then their resolve
+  attachments, then the depth/stencil attachment and its resolve, in that
+  order, with null views left VK_ATTACHMENT_UNUSED. Every attachment's
+  initial, subpass and final layout is the layout the app gave, so the
+  render pass never transitions anything itself. Suspending instances
+  store and resuming ones load, which keeps their contents across the
+  split. An aspect of a depth/stencil view the app did not attach is
+  loaded and stored so it is left as it was.
+
+  One-subpass render passes are compatible whenever their attachment
+  formats and sample counts match, so the pass built from a pipeline's
+  VkPipelineRenderingCreateInfo also works with every matching instance.
+
+  Cache tables hold pointers to heap entries; removal shifts the probe
+  chain back, as in xeno_cmd.c. One mutex guards everything; it is held
+  across render pass and framebuffer creation on a miss, which is rare
+  once the app has drawn a few frames.
+*/
+#include "rp_cache.h"
+#include "xeno_cmd.h"
+#include "perf_conf.h"
+#include "xeno_log.h"
+#include "xeno_trace.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#define XENO_RP_MIN_SLOTS 64u
+#define XENO_RP_MAX_ATTACHMENTS (2u * XENO_RP_MAX_COLOR + 2u)
+
+/* Everything about one attachment the render pass depends on. Keys are
+   memset before they are filled, so padding hashes and compares as 0. */
+typedef struct RpAttachment {
+    VkFormat format;                        /* VK_FORMAT_UNDEFINED = unused */
+    VkSampleCountFlagBits samples;
+    VkAttachmentLoadOp load, stencil_load;
+    VkAttachmentStoreOp store, stencil_store;
+    VkImageLayout layout, stencil_layout;
+    VkFormat resolve_format;
+    VkResolveModeFlagBits resolve_mode, stencil_resolve_mode;
+    VkImageLayout resolve_layout, stencil_resolve_layout;
+} RpAttachment;
+
+typedef struct RpKey {
+    uint32_t view_mask;
+    uint32_t color_count;
+    RpAttachment color[XENO_RP_MAX_COLOR];
+    RpAttachment depth;                     /* depth and stencil aspects of one view */
+} RpKey;
+
+typedef struct FbKey {
+    VkRenderPass rp;
+    uint32_t width, height, layers;
+    uint32_t view_count;
+    VkImageView views[XENO_RP_MAX_ATTACHMENTS];
+} FbKey;
+
+typedef struct CacheEntry {
+    uint64_t hash;
+    uint64_t last_frame;                    /* frame of the last lookup */
+    VkRenderPass rp;
+    VkFramebuffer fb;                       /* framebuffer entries only */
+    union {
+        RpKey rp;
+        FbKey fb;
+    } key;
+} CacheEntry;
+
+typedef struct EntryTable {
+    CacheEntry** slots;
+    uint32_t cap;                           /* power of two */
+    uint32_t count;
+} EntryTable;
+
+/* What an image or view contributes to keys; width 0 = unknown size. */
+typedef struct ObjectInfo {
+    uint64_t handle;                        /* 0 = empty slot */
+    VkFormat format;
+    VkSampleCountFlagBits samples;
+    uint32_t width, height;
+} ObjectInfo;
+
+typedef struct ObjectMap {
+    ObjectInfo* slots;
+    uint32_t cap;                           /* power of two */
+    uint32_t count;
+} ObjectMap;
+
+struct XenoRpCache {
+    pthread_mutex_t mtx;
+    ObjectMap images, views;
+    EntryTable passes, framebuffers;
+    uint64_t frame;                         /* presents so far + 1 */
+    uint64_t pinned;                        /* oldest rp_frame submitted since the last sweep */
+    int rp2;                                /* vkCreateRenderPass2 available */
+    uint64_t hits, passes_created, framebuffers_created, evicted;
+};
+
+static uint64_t key_hash(const void* key, size_t size)
+{
+    const unsigned char* p = (const unsigned char*)key;
+    uint64_t h = 0x9E3779B97F4A7C15ull ^ size;
+    size_t i = 0;
+    for (; i + 8u <= size; i += 8u) {
+        uint64_t w;
+        memcpy(&w, p + i, 8u);
+        h = (h ^ w) * 0xFF51AFD7ED558CCDull;
+        h ^= h >> 32;
+    }
+    if (i < size) {
+        uint64_t w = 0;
+        memcpy(&w, p + i, size - i);
+        h = (h ^ w) * 0xFF51AFD7ED558CCDull;
+    }
+    return h ^ (h >> 29);
+}
+
+static uint32_t handle_slot(uint64_t handle, uint32_t mask)
+{
+    return (uint32_t)((handle * 0x9E3779B97F4A7C15ull) >> 32) & mask;
+}
+
+/* ---- tables (caller holds mtx) ------------------------------------ */
+
+static int entries_grow(EntryTable* t)
+{
+    uint32_t cap = t->cap ? t->cap * 2u : XENO_RP_MIN_SLOTS;
+    CacheEntry** slots = (CacheEntry**)calloc(cap, sizeof(*slots));
+    if (!slots) return 0;
+    for (uint32_t i = 0; i < t->cap; ++i) {
+        CacheEntry* e = t->slots[i];
+        if (!e) continue;
+        uint32_t j = (uint32_t)e->hash & (cap - 1u);
+        while (slots[j]) j = (j + 1u) & (cap - 1u);
+        slots[j] = e;
+    }
+    free(t->slots);
+    t->slots = slots;
+    t->cap = cap;
+    return 1;
+}
+
+static CacheEntry* entries_find(const EntryTable* t, uint64_t hash, const void* key, size_t size)
+{
+    if (!t->cap) return NULL;
+    uint32_t mask = t->cap - 1u;
+    for (uint32_t i = (uint32_t)hash & mask; t->slots[i]; i = (i + 1u) & mask) {
+        const CacheEntry* e = t->slots[i];
+        if (e->hash == hash && memcmp(&e->key, key, size) == 0) return t->slots[i];
+    }
+    return NULL;
+}
+
+static int entries_insert(EntryTable* t, CacheEntry* e)
+{
+    /* Load factor <= 1/2. */
+    if ((t->count + 1u) * 2u > t->cap && !entries_grow(t)) return 0;
+    uint32_t mask = t->cap - 1u;
+    uint32_t i = (uint32_t)e->hash & mask;
+    while (t->slots[i]) i = (i + 1u) & mask;
+    t->slots[i] = e;
+    t->count++;
+    return 1;
+}
+
+/* Unlinks slot i without freeing the entry. */
+static void entries_remove_at(EntryTable* t, uint32_t i)
+{
+    uint32_t mask = t->cap - 1u;
+    t->slots[i] = NULL;
+    t->count--;
+    for (uint32_t j = (i + 1u) & mask; t->slots[j]; j = (j + 1u) & mask) {
+        uint32_t home = (uint32_t)t->slots[j]->hash & mask;
+        if (((j - home) & mask) >= ((j - i) & mask)) {
+            t->slots[i] = t->slots[j];
+            t->slots[j] = NULL;
+            i = j;
+        }
+    }
+}
+
+static int objects_grow(ObjectMap* m)
+{
+    uint32_t cap = m->cap ? m->cap * 2u : XENO_RP_MIN_SLOTS;
+    ObjectInfo* slots = (ObjectInfo*)calloc(cap, sizeof(*slots));
+    if (!slots) return 0;
+    for (uint32_t i = 0; i < m->cap; ++i) {
+        if (!m->slots[i].handle) continue;
+        uint32_t j = handle_slot(m->slots[i].handle, cap - 1u);
+        while (slots[j].handle) j = (j + 1u) & (cap - 1u);
+        slots[j] = m->slots[i];
+    }
+    free(m->slots);
+    m->slots = slots;
+    m->cap = cap;
+    return 1;
+}
+
+static uint32_t objects_find(const ObjectMap* m, uint64_t handle)
+{
+    if (!m->cap || !handle) return UINT32_MAX;
+    uint32_t mask = m->cap - 1u;
+    for (uint32_t i = handle_slot(handle, mask); m->slots[i].handle; i = (i + 1u) & mask) {
+        if (m->slots[i].handle == handle) return i;
+    }
+    return UINT32_MAX;
+}
+
+static void objects_remove(ObjectMap* m, uint64_t handle)
+{
+    uint32_t i = objects_find(m, handle);
+    if (i == UINT32_MAX) return;
+    uint32_t mask = m->cap - 1u;
+    m->slots[i].handle = 0;
+    m->count--;
+    for (uint32_t j = (i + 1u) & mask; m->slots[j].handle; j = (j + 1u) & mask) {
+        uint32_t home = handle_slot(m->slots[j].handle, mask);
+        if (((j - home) & mask) >= ((j - i) & mask)) {
+            m->slots[i] = m->slots[j];
+            m->slots[j].handle = 0;
+            i = j;
+        }
+    }
+}
+
+static void objects_put(ObjectMap* m, const ObjectInfo* info)
+{
+    objects_remove(m, info->handle);        /* handle reused without a destroy we saw */
+    if ((m->count + 1u) * 2u > m->cap && !objects_grow(m)) return;
+    uint32_t mask = m->cap - 1u;
+    uint32_t i = handle_slot(info->handle, mask);
+    while (m->slots[i].handle) i = (i + 1u) & mask;
+    m->slots[i] = *info;
+    m->count++;
+}
+
+/* ---- render passes and framebuffers (caller holds mtx) ------------- */
+
+static VkAttachmentDescription2 attachment(VkFormat format, VkSampleCountFlagBits samples, VkAttachmentLoadOp load,
+                                           VkAttachmentStoreOp store, VkAttachmentLoadOp stencil_load,
+                                           VkAttachmentStoreOp stencil_store, VkImageLayout layout)
+{
+    VkAttachmentDescription2 a = {
+        .sType = VK_STRUCTURE_TYPE_ATTACHMENT_DESCRIPTION_2,
+        .format = format, .samples = samples,
+        .loadOp = load, .storeOp = store, .stencilLoadOp = stencil_load, .stencilStoreOp = stencil_store,
+        .initialLayout = layout, .finalLayout = layout,
+    };
+    return a;
+}
+
+static VkAttachmentReference2 reference(uint32_t index, VkImageLayout layout)
+{
+    VkAttachmentReference2 r = {
+        .sType = VK_STRUCTURE_TYPE_ATTACHMENT_REFERENCE_2,
+        .attachment = index,
+        .layout = index == VK_ATTACHMENT_UNUSED ? VK_IMAGE_LAYOUT_UNDEFINED : layout,
+    };
+    return r;
+}
+
+/* Without vkCreateRenderPass2 the same description goes through the
+   original entrypoint; depth/stencil resolves and separate stencil
+   layouts need extensions that depend on it, so they never get here. */
+static VkResult create_render_pass1(const XenoDeviceDispatch* d, const VkRenderPassCreateInfo2* ci2, VkRenderPass* out)
+{
+    const VkSubpassDescription2* sub2 = ci2->pSubpasses;
+    VkAttachmentDescription att[XENO_RP_MAX_ATTACHMENTS];
+    VkAttachmentReference color[XENO_RP_MAX_COLOR], resolve[XENO_RP_MAX_COLOR], ds;
+    for (uint32_t i = 0; i < ci2->attachmentCount; ++i) {
+        const VkAttachmentDescription2* a = &ci2->pAttachments[i];
+        att[i] = (VkAttachmentDescription){
+            .format = a->format, .samples = a->samples,
+            .loadOp = a->loadOp, .storeOp = a->storeOp,
+            .stencilLoadOp = a->stencilLoadOp, .stencilStoreOp = a->stencilStoreOp,
+            .initialLayout = a->initialLayout, .finalLayout = a->finalLayout,
+        };
+    }
+    for (uint32_t i = 0; i < sub2->colorAttachmentCount; ++i) {
+        color[i] = (VkAttachmentReference){ sub2->pColorAttachments[i].attachment, sub2->pColorAttachments[i].layout };
+        if (sub2->pResolveAttachments) {
+            resolve[i] = (VkAttachmentReference){ sub2->pResolveAttachments[i].attachment,
+                                                  sub2->pResolveAttachments[i].layout };
+        }
+    }
+    if (sub2->pDepthStencilAttachment) {
+        ds = (VkAttachmentReference){ sub2->pDepthStencilAttachment->attachment, sub2->pDepthStencilAttachment->layout };
+    }
+    VkSubpassDescription sub = {
+        .pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS,
+        .colorAttachmentCount = sub2->colorAttachmentCount,
+        .pColorAttachments = color,
+        .pResolveAttachments = sub2->pResolveAttachments ? resolve : NULL,
+        .pDepthStencilAttachment = sub2->pDepthStencilAttachment ? &ds : NULL,
+    };
+    VkRenderPassMultiviewCreateInfo multiview = {
+        .sType = VK_STRUCTURE_TYPE_RENDER_PASS_MULTIVIEW_CREATE_INFO,
+        .subpassCount = 1, .pViewMasks = &sub2->viewMask,
+    };
+    VkRenderPassCreateInfo ci = {
+        .sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO,
+        .pNext = sub2->viewMask ? &multiview : NULL,
+        .attachmentCount = ci2->attachmentCount, .pAttachments = att,
+        .subpassCount = 1, .pSubpasses = &sub,
+    };
+    return d->CreateRenderPass(d->device, &ci, NULL, out);
+}
+
+static VkResult create_render_pass(const XenoRpCache* c, const XenoDeviceDispatch* d, const RpKey* k,
+                                   VkRenderPass* out)
+{
+    VkAttachmentDescription2 att[XENO_RP_MAX_ATTACHMENTS];
+    VkAttachmentReference2 color[XENO_RP_MAX_COLOR], resolve[XENO_RP_MAX_COLOR], ds, ds_resolve;
+    VkAttachmentDescriptionStencilLayout att_stencil[2];
+    VkAttachmentReferenceStencilLayout ref_stencil;
+    VkSubpassDescriptionDepthStencilResolve dsr;
+    uint32_t n = 0;
+    int any_resolve = 0;
+
+    for (uint32_t i = 0; i < k->color_count; ++i) {
+        const RpAttachment* a = &k->color[i];
+        color[i] = reference(VK_ATTACHMENT_UNUSED, VK_IMAGE_LAYOUT_UNDEFINED);
+        if (!a->format) continue;
+        att[n] = attachment(a->format, a->samples, a->load, a->store, VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+                            VK_ATTACHMENT_STORE_OP_DONT_CARE, a->layout);
+        color[i] = reference(n++, a->layout);
+    }
+    for (uint32_t i = 0; i < k->color_count; ++i) {
+        const RpAttachment* a = &k->color[i];
+        resolve[i] = reference(VK_ATTACHMENT_UNUSED, VK_IMAGE_LAYOUT_UNDEFINED);
+        if (!a->resolve_mode) continue;
+        att[n] = attachment(a->resolve_format, VK_SAMPLE_COUNT_1_BIT, VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+                            VK_ATTACHMENT_STORE_OP_STORE, VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+                            VK_ATTACHMENT_STORE_OP_DONT_CARE, a->resolve_layout);
+        resolve[i] = reference(n++, a->resolve_layout);
+        any_resolve = 1;
+    }
+
+    VkSubpassDescription2 sub = {
+        .sType = VK_STRUCTURE_TYPE_SUBPASS_DESCRIPTION_2,
+        .pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS,
+        .viewMask = k->view_mask,
+        .colorAttachmentCount = k->color_count,
+        .pColorAttachments = color,
+        .pResolveAttachments = any_resolve ? resolve : NULL,
+    };
+    const RpAttachment* z = &k->depth;
+    int separate = 0;
+    if (z->format) {
+        att[n] = attachment(z->format, z->samples, z->load, z->store, z->stencil_load, z->stencil_store, z->layout);
+        ds = reference(n, z->layout);
+        if (z->stencil_layout != z->layout) {
+            att_stencil[0] = (VkAttachmentDescriptionStencilLayout){
+                .sType = VK_STRUCTURE_TYPE_ATTACHMENT_DESCRIPTION_STENCIL_LAYOUT,
+                .stencilInitialLayout = z->stencil_layout, .stencilFinalLayout = z->stencil_layout,
+            };
+            ref_stencil = (VkAttachmentReferenceStencilLayout){
+                .sType = VK_STRUCTURE_TYPE_ATTACHMENT_REFERENCE_STENCIL_LAYOUT, .stencilLayout = z->stencil_layout,
+            };
+            att[n].pNext = &att_stencil[0];
+            ds.pNext = &ref_stencil;
+            separate = 1;
+        }
+        sub.pDepthStencilAttachment = &ds;
+        n++;
+        if (z->resolve_mode || z->stencil_resolve_mode) {
+            /* An aspect that is not resolved keeps what the resolve image had. */
+            att[n] = attachment(z->resolve_format, VK_SAMPLE_COUNT_1_BIT,
+                                z->resolve_mode ? VK_ATTACHMENT_LOAD_OP_DONT_CARE : VK_ATTACHMENT_LOAD_OP_LOAD,
+                                VK_ATTACHMENT_STORE_OP_STORE,
+                                z->stencil_resolve_mode ? VK_ATTACHMENT_LOAD_OP_DONT_CARE : VK_ATTACHMENT_LOAD_OP_LOAD,
+                                VK_ATTACHMENT_STORE_OP_STORE, z->resolve_layout);
+            if (z->stencil_resolve_layout != z->resolve_layout) {
+                att_stencil[1] = (VkAttachmentDescriptionStencilLayout){
+                    .sType = VK_STRUCTURE_TYPE_ATTACHMENT_DESCRIPTION_STENCIL_LAYOUT,
+                    .stencilInitialLayout = z->stencil_resolve_layout,
+                    .stencilFinalLayout = z->stencil_resolve_layout,
+                };
+                att[n].pNext = &att_stencil[1];
+            }
+            ds_resolve = reference(n++, z->resolve_layout);
+            dsr = (VkSubpassDescriptionDepthStencilResolve){
+                .sType = VK_STRUCTURE_TYPE_SUBPASS_DESCRIPTION_DEPTH_STENCIL_RESOLVE,
+                .depthResolveMode = z->resolve_mode,
+                .stencilResolveMode = z->stencil_resolve_mode,
+                .pDepthStencilResolveAttachment = &ds_resolve,
+            };
+            sub.pNext = &dsr;
+            separate = 1;
+        }
+    }
+
+    VkRenderPassCreateInfo2 ci = {
+        .sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO_2,
+        .attachmentCount = n, .pAttachments = att,
+        .subpassCount = 1, .pSubpasses = &sub,
+    };
+    if (c->rp2) return d->CreateRenderPass2(d->device, &ci, NULL, out);
+    if (separate) return VK_ERROR_FEATURE_NOT_PRESENT;
+    return create_render_pass1(d, &ci, out);
+}
+
+static VkRenderPass get_render_pass(XenoRpCache* c, const XenoDeviceDispatch* d, const RpKey* k)
+{
+    uint64_t hash = key_hash(k, sizeof(*k));
+    CacheEntry* e = entries_find(&c->passes, hash, k, sizeof(*k));
+    if (e) {
+        e->last_frame = c->frame;
+        c->hits++;
+        return e->rp;
+    }
+    e = (CacheEntry*)calloc(1, sizeof(*e));
+    if (!e) return VK_NULL_HANDLE;
+    VkResult res = create_render_pass(c, d, k, &e->rp);
+    if (res != VK_SUCCESS) {
+        XENO_LOGW_RL(1, "rp: render pass for %u color attachments not created: %d", k->color_count, res);
+        free(e);
+        return VK_NULL_HANDLE;
+    }
+    e->hash = hash;
+    e->last_frame = c->frame;
+    e->key.rp = *k;
+    if (!entries_insert(&c->passes, e)) {
+        d->DestroyRenderPass(d->device, e->rp, NULL);
+        free(e);
+        return VK_NULL_HANDLE;
+    }
+    c->passes_created++;
+    return e->rp;
+}
+
+static VkFramebuffer get_framebuffer(XenoRpCache* c, const XenoDeviceDispatch* d, const FbKey* k)
+{
+    uint64_t hash = key_hash(k, sizeof(*k));
+    CacheEntry* e = entries_find(&c->framebuffers, hash, k, sizeof(*k));
+    if (e) {
+        e->last_frame = c->frame;
+        c->hits++;
+        return e->fb;
+    }
+    e = (CacheEntry*)calloc(1, sizeof(*e));
+    if (!e) return VK_NULL_HANDLE;
+    VkFramebufferCreateInfo ci = {
+        .sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO,
+        .renderPass = k->rp,
+        .attachmentCount = k->view_count, .pAttachments = k->views,
+        .width = k->width, .height = k->height, .layers = k->layers,
+    };
+    VkResult res = d->CreateFramebuffer(d->device, &ci, NULL, &e->fb);
+    if (res != VK_SUCCESS) {
+        XENO_LOGW_RL(1, "rp: %ux%u framebuffer not created: %d", k->width, k->height, res);
+        free(e);
+        return VK_NULL_HANDLE;
+    }
+    e->hash = hash;
+    e->last_frame = c->frame;
+    e->rp = k->rp;
+    e->key.fb = *k;
+    if (!entries_insert(&c->framebuffers, e)) {
+        d->DestroyFramebuffer(d->device, e->fb, NULL);
+        free(e);
+        return VK_NULL_HANDLE;
+    }
+    c->framebuffers_created++;
+    return e->fb;
+}
+
+static void entry_destroy(const XenoDeviceDispatch* d, CacheEntry* e)
+{
+    if (e->fb) d->DestroyFramebuffer(d->device, e->fb, NULL);
+    else d->DestroyRenderPass(d->device, e->rp, NULL);
+    free(e);
+}
+
+/* Command buffers in flight may use anything looked up since the oldest
+   frame one of them was recorded in. A render pass is looked up with each
+   of its framebuffers, so it never goes idle before them. */
+static void sweep(XenoRpCache* c, const XenoDeviceDispatch* d)
+{
+    uint64_t limit = c->frame > XENO_RP_IDLE_FRAMES ? c->frame - XENO_RP_IDLE_FRAMES : 0;
+    if (c->pinned < limit) limit = c->pinned;
+    c->pinned = UINT64_MAX;
+    EntryTable* tables[2] = { &c->framebuffers, &c->passes };
+    for (int t = 0; t < 2; ++t) {
+        for (uint32_t i = 0; i < tables[t]->cap;) {
+            CacheEntry* e = tables[t]->slots[i];
+            /* A removal may shift a later entry into i; look at it again. */
+            if (e && e->last_frame < limit) {
+                entries_remove_at(tables[t], i);
+                entry_destroy(d, e);
+                c->evicted++;
+            } else {
+                ++i;
+            }
+        }
+    }
+    XENO_TRACE_COUNTER("rp.render_passes", c->passes.count);
+    XENO_TRACE_COUNTER("rp.framebuffers", c->framebuffers.count);
+}
+
+/* ---- keys ---------------------------------------------------------- */
+
+static VkAttachmentLoadOp load_op(VkAttachmentLoadOp op, VkRenderingFlags flags)
+{
+    return (flags & VK_RENDERING_RESUMING_BIT) ? VK_ATTACHMENT_LOAD_OP_LOAD : op;
+}
+
+static VkAttachmentStoreOp store_op(VkAttachmentStoreOp op, VkRenderingFlags flags)
+{
+    return (flags & VK_RENDERING_SUSPENDING_BIT) ? VK_ATTACHMENT_STORE_OP_STORE : op;
+}
+
+static const ObjectInfo* view_info(const XenoRpCache* c, VkImageView view)
+{
+    uint32_t i = objects_find(&c->views, (uint64_t)view);
+    return i == UINT32_MAX ? NULL : &c->views.slots[i];
+}
+
+/* Adds a view to the framebuffer key, narrowing its size to the view's. */
+static void add_view(FbKey* f, const ObjectInfo* v, VkImageView view)
+{
+    f->views[f->view_count++] = view;
+    if (v->width && v->width < f->width) f->width = v->width;
+    if (v->height && v->height < f->height) f->height = v->height;
+}
+
+/* Caller holds mtx. 0 when an attachment's view is unknown or there are
+   too many color attachments. */
+static int rendering_key(const XenoRpCache* c, const VkRenderingInfo* info, RpKey* k, FbKey* f,
+                         VkClearValue* clears)
+{
+    memset(k, 0, sizeof(*k));
+    memset(f, 0, sizeof(*f));
+    if (info->colorAttachmentCount > XENO_RP_MAX_COLOR) return 0;
+    k->view_mask = info->viewMask;
+    k->color_count = info->colorAttachmentCount;
+    f->width = f->height = UINT32_MAX;
+
+    for (uint32_t i = 0; i < info->colorAttachmentCount; ++i) {
+        const VkRenderingAttachmentInfo* a = &info->pColorAttachments[i];
+        if (!a->imageView) continue;
+        const ObjectInfo* v = view_info(c, a->imageView);
+        if (!v) return 0;
+        RpAttachment* x = &k->color[i];
+        x->format = v->format;
+        x->samples = v->samples;
+        x->load = load_op(a->loadOp, info->flags);
+        x->store = store_op(a->storeOp, info->flags);
+        x->stencil_load = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+        x->stencil_store = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        x->layout = a->imageLayout;
+        clears[f->view_count] = a->clearValue;
+        add_view(f, v, a->imageView);
+    }
+    for (uint32_t i = 0; i < info->colorAttachmentCount; ++i) {
+        const VkRenderingAttachmentInfo* a = &info->pColorAttachments[i];
+        if (!a->imageView || a->resolveMode == VK_RESOLVE_MODE_NONE || !a->resolveImageView) continue;
+        const ObjectInfo* v = view_info(c, a->resolveImageView);
+        if (!v) return 0;
+        RpAttachment* x = &k->color[i];
+        x->resolve_format = v->format;
+        x->resolve_mode = (VkResolveModeFlagBits)a->resolveMode;
+        x->resolve_layout = a->resolveImageLayout;
+        memset(&clears[f->view_count], 0, sizeof(clears[0]));
+        add_view(f, v, a->resolveImageView);
+    }
+
+    const VkRenderingAttachmentInfo* da = info->pDepthAttachment && info->pDepthAttachment->imageView
+                                              ? info->pDepthAttachment : NULL;
+    const VkRenderingAttachmentInfo* sa = info->pStencilAttachment && info->pStencilAttachment->imageView
+                                              ? info->pStencilAttachment : NULL;
+    if (da || sa) {
+        const VkRenderingAttachmentInfo* a = da ? da : sa;
+        const ObjectInfo* v = view_info(c, a->imageView);
+        if (!v) return 0;
+        RpAttachment* x = &k->depth;
+        x->format = v->format;
+        x->samples = v->samples;
+        x->load = da ? load_op(da->loadOp, info->flags) : VK_ATTACHMENT_LOAD_OP_LOAD;
+        x->store = da ? store_op(da->storeOp, info->flags) : VK_ATTACHMENT_STORE_OP_STORE;
+        x->stencil_load = sa ? load_op(sa->loadOp, info->flags) : VK_ATTACHMENT_LOAD_OP_LOAD;
+        x->stencil_store = sa ? store_op(sa->storeOp, info->flags) : VK_ATTACHMENT_STORE_OP_STORE;
+        x->layout = a->imageLayout;
+        x->stencil_layout = sa ? sa->imageLayout : x->layout;
+        memset(&clears[f->view_count], 0, sizeof(clears[0]));
+        if (da) clears[f->view_count].depthStencil.depth = da->clearValue.depthStencil.depth;
+        if (sa) clears[f->view_count].depthStencil.stencil = sa->clearValue.depthStencil.stencil;
+        add_view(f, v, a->imageView);
+
+        int dr = da && da->resolveMode != VK_RESOLVE_MODE_NONE && da->resolveImageView;
+        int sr = sa && sa->resolveMode != VK_RESOLVE_MODE_NONE && sa->resolveImageView;
+        if (dr || sr) {
+            VkImageView rview = dr ? da->resolveImageView : sa->resolveImageView;
+            const ObjectInfo* rv = view_info(c, rview);
+            if (!rv) return 0;
+            x->resolve_format = rv->format;
+            x->resolve_mode = dr ? (VkResolveModeFlagBits)da->resolveMode : VK_RESOLVE_MODE_NONE;
+            x->stencil_resolve_mode = sr ? (VkResolveModeFlagBits)sa->resolveMode : VK_RESOLVE_MODE_NONE;
+            x->resolve_layout = dr ? da->resolveImageLayout : sa->resolveImageLayout;
+            x->stencil_resolve_layout = sr ? sa->resolveImageLayout : x->resolve_layout;
+            memset(&clears[f->view_count], 0, sizeof(clears[0]));
+            add_view(f, rv, rview);
+        }
+    }
+
+    /* Views of images we did not see created (swapchain images) have no
+       size; the render area then has to do. */
+    if (f->width == UINT32_MAX) f->width = (uint32_t)info->renderArea.offset.x + info->renderArea.extent.width;
+    if (f->height == UINT32_MAX) f->height = (uint32_t)info->renderArea.offset.y + info->renderArea.extent.height;
+    f->layers = info->viewMask || !info->layerCount ? 1u : info->layerCount;
+    return 1;
+}
+
+/* The render pass pipelines and secondaries are made compatible with:
+   formats and sample counts are all that matters. */
+static int format_key(RpKey* k, uint32_t view_mask, uint32_t count, const VkFormat* formats, VkFormat depth,
+                      VkFormat stencil, VkSampleCountFlagBits samples)
+{
+    memset(k, 0, sizeof(*k));
+    if (count > XENO_RP_MAX_COLOR) return 0;
+    k->view_mask = view_mask;
+    k->color_count = count;
+    if (!samples) samples = VK_SAMPLE_COUNT_1_BIT;
+    for (uint32_t i = 0; i < count; ++i) {
+        if (!formats || formats[i] == VK_FORMAT_UNDEFINED) continue;
+        RpAttachment* x = &k->color[i];
+        x->format = formats[i];
+        x->samples = samples;
+        x->load = x->stencil_load = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+        x->store = x->stencil_store = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        x->layout = x->stencil_layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    }
+    VkFormat ds = depth ? depth : stencil;
+    if (ds) {
+        RpAttachment* x = &k->depth;
+        x->format = ds;
+        x->samples = samples;
+        x->load = x->stencil_load = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+        x->store = x->stencil_store = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        x->layout = x->stencil_layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+    }
+    return 1;
+}
+
+static const VkBaseInStructure* find_struct(const void* chain, VkStructureType type)
+{
+    const VkBaseInStructure* s = (const VkBaseInStructure*)chain;
+    while (s && s->sType != type) s = s->pNext;
+    return s;
+}
+
+/* ---- public ------------------------------------------------------- */
+
+static int app_enabled(const VkDeviceCreateInfo* ci)
+{
+    for (uint32_t i = 0; i < ci->enabledExtensionCount; ++i) {
+        if (strcmp(ci->ppEnabledExtensionNames[i], VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME) == 0) return 1;
+    }
+    for (const VkBaseInStructure* p = (const VkBaseInStructure*)ci->pNext; p; p = p->pNext) {
+        if (p->sType == VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DYNAMIC_RENDERING_FEATURES &&
+            ((const VkPhysicalDeviceDynamicRenderingFeatures*)p)->dynamicRendering) {
+            return 1;
+        }
+        if (p->sType == VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES &&
+            ((const VkPhysicalDeviceVulkan13Features*)p)->dynamicRendering) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+void xeno_rp_device_init(XenoDeviceDispatch* d, const VkDeviceCreateInfo* ci, int native)
+{
+    int mode = xeno_perf_conf_active()->dynamic_rendering;
+    if (mode == XENO_DYNRENDER_NATIVE || (mode == XENO_DYNRENDER_AUTO && native) || !app_enabled(ci)) return;
+    if (!d->CreateRenderPass || !d->DestroyRenderPass || !d->CreateFramebuffer || !d->DestroyFramebuffer ||
+        !d->CmdBeginRenderPass || !d->CmdEndRenderPass) {
+        return;
+    }
+    XenoRpCache* c = (XenoRpCache*)calloc(1, sizeof(*c));
+    if (!c) {
+        XENO_LOGW("rp: out of memory, dynamic rendering is not emulated");
+        return;
+    }
+    pthread_mutex_init(&c->mtx, NULL);
+    c->frame = 1;
+    c->pinned = UINT64_MAX;
+    c->rp2 = d->CreateRenderPass2 != NULL;
+    d->rp = c;
+    XENO_LOGI("rp: dynamic rendering recorded as render passes%s", native ? " (driver implementation bypassed)" : "");
+}
+
+void xeno_rp_device_destroy(XenoDeviceDispatch* d)
+{
+    XenoRpCache* c = d->rp;
+    if (!c) return;
+    d->rp = NULL;
+    EntryTable* tables[2] = { &c->framebuffers, &c->passes };
+    for (int t = 0; t < 2; ++t) {
+        for (uint32_t i = 0; i < tables[t]->cap; ++i) {
+            if (tables[t]->slots[i]) entry_destroy(d, tables[t]->slots[i]);
+        }
+        free(tables[t]->slots);
+    }
+    XENO_LOGI("rp: %llu render passes and %llu framebuffers created, %llu cache hits, %llu evicted",
+              (unsigned long long)c->passes_created, (unsigned long long)c->framebuffers_created,
+              (unsigned long long)c->hits, (unsigned long long)c->evicted);
+    free(c->images.slots);
+    free(c->views.slots);
+    pthread_mutex_destroy(&c->mtx);
+    free(c);
+}
+
+void xeno_rp_image_created(XenoDeviceDispatch* d, VkImage image, const VkImageCreateInfo* ci)
+{
+    XenoRpCache* c = d->rp;
+    if (!c || !image) return;
+    ObjectInfo info = {
+        .handle = (uint64_t)image, .format = ci->format, .samples = ci->samples,
+        .width = ci->extent.width, .height = ci->extent.height,
+    };
+    pthread_mutex_lock(&c->mtx);
+    objects_put(&c->images, &info);
+    pthread_mutex_unlock(&c->mtx);
+}
+
+void xeno_rp_image_destroyed(XenoDeviceDispatch* d, VkImage image)
+{
+    XenoRpCache* c = d->rp;
+    if (!c || !image) return;
+    pthread_mutex_lock(&c->mtx);
+    objects_remove(&c->images, (uint64_t)image);
+    pthread_mutex_unlock(&c->mtx);
+}
+
+void xeno_rp_view_created(XenoDeviceDispatch* d, VkImageView view, const VkImageViewCreateInfo* ci)
+{
+    XenoRpCache* c = d->rp;
+    if (!c || !view) return;
+    ObjectInfo info = { .handle = (uint64_t)view, .format = ci->format, .samples = VK_SAMPLE_COUNT_1_BIT };
+    pthread_mutex_lock(&c->mtx);
+    uint32_t i = objects_find(&c->images, (uint64_t)ci->image);
+    if (i != UINT32_MAX) {
+        const ObjectInfo* image = &c->images.slots[i];
+        uint32_t mip = ci->subresourceRange.baseMipLevel;
+        info.samples = image->samples;
+        info.width = mip < 32u && image->width >> mip ? image->width >> mip : 1u;
+        info.height = mip < 32u && image->height >> mip ? image->height >> mip : 1u;
+    }
+    objects_put(&c->views, &info);
+    pthread_mutex_unlock(&c->mtx);
+}
+
+void xeno_rp_view_destroyed(XenoDeviceDispatch* d, VkImageView view)
+{
+    XenoRpCache* c = d->rp;
+    if (!c || !view) return;
+    pthread_mutex_lock(&c->mtx);
+    if (objects_find(&c->views, (uint64_t)view) != UINT32_MAX) {
+        EntryTable* t = &c->framebuffers;
+        for (uint32_t i = 0; i < t->cap;) {
+            CacheEntry* e = t->slots[i];
+            int uses = 0;
+            for (uint32_t v = 0; e && v < e->key.fb.view_count && !uses; ++v) uses = e->key.fb.views[v] == view;
+            if (uses) {
+                entries_remove_at(t, i);
+                entry_destroy(d, e);
+                c->evicted++;
+            } else {
+                ++i;
+            }
+        }
+        objects_remove(&c->views, (uint64_t)view);
+    }
+    pthread_mutex_unlock(&c->mtx);
+}
+
+VkGraphicsPipelineCreateInfo* xeno_rp_patch_pipelines(XenoDeviceDispatch* d, uint32_t count,
+                                                      const VkGraphicsPipelineCreateInfo* infos)
+{
+    XenoRpCache* c = d->rp;
+    if (!c) return NULL;
+    VkGraphicsPipelineCreateInfo* out = NULL;
+    for (uint32_t i = 0; i < count; ++i) {
+        if (infos[i].renderPass) continue;
+        const VkPipelineRenderingCreateInfo* r = (const VkPipelineRenderingCreateInfo*)find_struct(
+            infos[i].pNext, VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO);
+        VkSampleCountFlagBits samples =
+            infos[i].pMultisampleState ? infos[i].pMultisampleState->rasterizationSamples : VK_SAMPLE_COUNT_1_BIT;
+        RpKey k;
+        if (!format_key(&k, r ? r->viewMask : 0, r ? r->colorAttachmentCount : 0, r ? r->pColorAttachmentFormats : NULL,
+                        r ? r->depthAttachmentFormat : VK_FORMAT_UNDEFINED,
+                        r ? r->stencilAttachmentFormat : VK_FORMAT_UNDEFINED, samples)) {
+            continue;
+        }
+        pthread_mutex_lock(&c->mtx);
+        VkRenderPass rp = get_render_pass(c, d, &k);
+        pthread_mutex_unlock(&c->mtx);
+        if (!rp) continue;
+        if (!out) {
+            out = (VkGraphicsPipelineCreateInfo*)malloc(sizeof(*out) * count);
+            if (!out) return NULL;
+            memcpy(out, infos, sizeof(*out) * count);
+        }
+        out[i].renderPass = rp;
+        out[i].subpass = 0;
+    }
+    return out;
+}
+
+int xeno_rp_begin_command_buffer(XenoDeviceDispatch* d, VkCommandBuffer cmd, const VkCommandBufferBeginInfo* info,
+                                 VkCommandBufferBeginInfo* out, VkCommandBufferInheritanceInfo* inh)
+{
+    XenoRpCache* c = d->rp;
+    if (!c) return 0;
+    XenoCmdState* s = xeno_cmd_state(d, cmd);
+    if (s) {
+        s->rp_open = 0;
+        s->rp_frame = 0;
+    }
+    const VkCommandBufferInheritanceInfo* in = info->pInheritanceInfo;
+    if (!(info->flags & VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT) || !in || in->renderPass) return 0;
+    const VkCommandBufferInheritanceRenderingInfo* r = (const VkCommandBufferInheritanceRenderingInfo*)find_struct(
+        in->pNext, VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_RENDERING_INFO);
+    RpKey k;
+    if (!r || !format_key(&k, r->viewMask, r->colorAttachmentCount, r->pColorAttachmentFormats,
+                          r->depthAttachmentFormat, r->stencilAttachmentFormat, r->rasterizationSamples)) {
+        return 0;
+    }
+    pthread_mutex_lock(&c->mtx);
+    VkRenderPass rp = get_render_pass(c, d, &k);
+    uint64_t frame = c->frame;
+    pthread_mutex_unlock(&c->mtx);
+    if (!rp) return 0;
+    if (s) s->rp_frame = frame;
+    *inh = *in;
+    inh->renderPass = rp;
+    inh->subpass = 0;
+    inh->framebuffer = VK_NULL_HANDLE;
+    *out = *info;
+    out->pInheritanceInfo = inh;
+    return 1;
+}
+
+int xeno_rp_begin_rendering(XenoDeviceDispatch* d, VkCommandBuffer cmd, const VkRenderingInfo* info)
+{
+    XenoRpCache* c = d->rp;
+    if (!c) return 0;
+    XenoCmdState* s = xeno_cmd_state(d, cmd);
+    RpKey k;
+    FbKey f;
+    VkClearValue clears[XENO_RP_MAX_ATTACHMENTS];
+    VkFramebuffer fb = VK_NULL_HANDLE;
+    pthread_mutex_lock(&c->mtx);
+    uint64_t frame = c->frame;
+    if (s && rendering_key(c, info, &k, &f, clears)) {
+        f.rp = get_render_pass(c, d, &k);
+        if (f.rp) fb = get_framebuffer(c, d, &f);
+    }
+    pthread_mutex_unlock(&c->mtx);
+    if (!fb) {
+        if (d->CmdBeginRendering) {
+            XENO_LOGW_RL(1, "rp: vkCmdBeginRendering with %u color attachments passed to the driver",
+                         info->colorAttachmentCount);
+            return 0;
+        }
+        XENO_LOGW_RL(1, "rp: vkCmdBeginRendering with %u color attachments cannot be emulated, dropped",
+                     info->colorAttachmentCount);
+        return 1;
+    }
+    VkRenderPassBeginInfo begin = {
+        .sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,
+        .renderPass = f.rp, .framebuffer = fb,
+        .renderArea = info->renderArea,
+        .clearValueCount = f.view_count, .pClearValues = clears,
+    };
+    d->CmdBeginRenderPass(cmd, &begin,
+                          (info->flags & VK_RENDERING_CONTENTS_SECONDARY_COMMAND_BUFFERS_BIT)
+                              ? VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS
+                              : VK_SUBPASS_CONTENTS_INLINE);
+    s->rp_open = 1;
+    if (!s->rp_frame) s->rp_frame = frame;
+    return 1;
+}
+
+int xeno_rp_end_rendering(XenoDeviceDispatch* d, VkCommandBuffer cmd)
+{
+    if (!d->rp) return 0;
+    XenoCmdState* s = xeno_cmd_state(d, cmd);
+    if (s && s->rp_open) {
+        s->rp_open = 0;
+        d->CmdEndRenderPass(cmd);
+        return 1;
+    }
+    return !d->CmdEndRendering;     /* its begin was dropped */
+}
+
+void xeno_rp_execute_commands(XenoDeviceDispatch* d, VkCommandBuffer cmd, uint32_t count,
+                              const VkCommandBuffer* secondaries)
+{
+    if (!d->rp) return;
+    XenoCmdState* s = xeno_cmd_state(d, cmd);
+    if (!s) return;
+    uint64_t oldest = s->rp_frame;
+    for (uint32_t i = 0; i < count; ++i) {
+        const XenoCmdState* sec = xeno_cmd_state(d, secondaries[i]);
+        if (sec && sec->rp_frame && (!oldest || sec->rp_frame < oldest)) oldest = sec->rp_frame;
+    }
+    s->rp_frame = oldest;
+}
+
+static void pin(XenoRpCache* c, uint64_t oldest)
+{
+    if (!oldest) return;
+    pthread_mutex_lock(&c->mtx);
+    if (oldest < c->pinned) c->pinned = oldest;
+    pthread_mutex_unlock(&c->mtx);
+}
+
+void xeno_rp_submitted(XenoDeviceDispatch* d, uint32_t count, const VkSubmitInfo* submits)
+{
+    XenoRpCache* c = d->rp;
+    if (!c) return;
+    uint64_t oldest = 0;
+    for (uint32_t i = 0; i < count; ++i) {
+        for (uint32_t j = 0; j < submits[i].commandBufferCount; ++j) {
+            const XenoCmdState* s = xeno_cmd_state(d, submits[i].pCommandBuffers[j]);
+            if (s && s->rp_frame && (!oldest || s->rp_frame < oldest)) oldest = s->rp_frame;
+        }
+    }
+    pin(c, oldest);
+}
+
+void xeno_rp_submitted2(XenoDeviceDispatch* d, uint32_t count, const VkSubmitInfo2* submits)
+{
+    XenoRpCache* c = d->rp;
+    if (!c) return;
+    uint64_t oldest = 0;
+    for (uint32_t i = 0; i < count; ++i) {
+        for (uint32_t j = 0; j < submits[i].commandBufferInfoCount; ++j) {
+            const XenoCmdState* s = xeno_cmd_state(d, submits[i].pCommandBufferInfos[j].commandBuffer);
+            if (s && s->rp_frame && (!oldest || s->rp_frame < oldest)) oldest = s->rp_frame;
+        }
+    }
+    pin(c, oldest);
+}
+
+void xeno_rp_frame(XenoDeviceDispatch* d)
+{
+    XenoRpCache* c = d->rp;
+    if (!c) return;
+    pthread_mutex_lock(&c->mtx);
+    if (++c->frame % XENO_RP_SWEEP_FRAMES == 0) sweep(c, d);
+    pthread_mutex_unlock(&c->mtx);
+}
@@ -0,0 +1,69 @@
+// src/rp_cache.h
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include "xeno_dispatch.h"
+
+/*
+  Dynamic-rendering emulation over cached render passes (rp_cache.c).
+
+  The layer advertises VK_KHR_dynamic_rendering on every device. When the
+  driver does not implement it, or perf_conf says dynamic_rendering=emulate
+  because its implementation is slow, vkCmdBeginRendering / EndRendering
+  are recorded as a one-subpass vkCmdBeginRenderPass / EndRenderPass, and
+  pipelines and render-pass-continuing secondaries set up for dynamic
+  rendering get a compatible render pass.
+
+  One VkRenderPass per unique attachment setup (formats, sample counts,
+  load/store ops, layouts) and one VkFramebuffer per render pass, set of
+  image views and size are created once and looked up by a hash of that
+  key in open-addressing tables. Entries no command buffer recorded or
+  submitted for XENO_RP_IDLE_FRAMES presents are destroyed; framebuffers
+  also go with the first of their image views.
+
+  Attachment formats and sample counts are not in VkRenderingInfo, so the
+  images and views the app creates are tracked while emulation is on.
+*/
+
+#define XENO_RP_MAX_COLOR 8u            /* color attachments an emulated instance may have */
+#define XENO_RP_IDLE_FRAMES 600u        /* presents an unused entry survives */
+#define XENO_RP_SWEEP_FRAMES 60u        /* presents between eviction sweeps */
+
+typedef struct XenoRpCache XenoRpCache;
+
+/* Sets d->rp when the app enabled dynamic rendering and the layer records
+   it; `native` says whether the driver implements it. */
+void xeno_rp_device_init(XenoDeviceDispatch* d, const VkDeviceCreateInfo* ci, int native);
+/* Destroys every cached render pass and framebuffer; the device is idle. */
+void xeno_rp_device_destroy(XenoDeviceDispatch* d);
+
+void xeno_rp_image_created(XenoDeviceDispatch* d, VkImage image, const VkImageCreateInfo* ci);
+void xeno_rp_image_destroyed(XenoDeviceDispatch* d, VkImage image);
+void xeno_rp_view_created(XenoDeviceDispatch* d, VkImageView view, const VkImageViewCreateInfo* ci);
+/* Call before the view is destroyed: framebuffers using it go first. */
+void xeno_rp_view_destroyed(XenoDeviceDispatch* d, VkImageView view);
+
+/* Returns a malloc'd copy of infos with a compatible render pass filled in
+   for pipelines created for dynamic rendering; NULL when nothing changed. */
+VkGraphicsPipelineCreateInfo* xeno_rp_patch_pipelines(XenoDeviceDispatch* d, uint32_t count,
+                                                      const VkGraphicsPipelineCreateInfo* infos);
+
+/* Every vkBeginCommandBuffer. A render-pass-continuing secondary begun for
+   dynamic rendering inherits a compatible render pass instead: *out and
+   *inh receive the rewritten begin info and the return is 1. */
+int xeno_rp_begin_command_buffer(XenoDeviceDispatch* d, VkCommandBuffer cmd, const VkCommandBufferBeginInfo* info,
+                                 VkCommandBufferBeginInfo* out, VkCommandBufferInheritanceInfo* inh);
+
+/* Return 0 when the caller records the driver's command itself. */
+int xeno_rp_begin_rendering(XenoDeviceDispatch* d, VkCommandBuffer cmd, const VkRenderingInfo* info);
+int xeno_rp_end_rendering(XenoDeviceDispatch* d, VkCommandBuffer cmd);
+
+/* Command buffers that reach a queue, directly or through a primary, keep
+   the entries they recorded alive. */
+void xeno_rp_execute_commands(XenoDeviceDispatch* d, VkCommandBuffer cmd, uint32_t count,
+                              const VkCommandBuffer* secondaries);
+void xeno_rp_submitted(XenoDeviceDispatch* d, uint32_t count, const VkSubmitInfo* submits);
+void xeno_rp_submitted2(XenoDeviceDispatch* d, uint32_t count, const VkSubmitInfo2* submits);
+
+/* Per present: advances the frame counter and evicts idle entries. */
+void xeno_rp_frame(XenoDeviceDispatch* d);
@@ -0,0 +1,762 @@
+// src/rt_accel.c
+#include "rt_accel.h"
+#include "xeno_dispatch.h"
+#include "xeno_mem.h"
+#include "xeno_log.h"
+#include "xeno_trace.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define XENO_ACCEL_SLOTS 3u
+#define XENO_ACCEL_QUERIES 128u     /* compaction queries per slot */
+#define XENO_ACCEL_SCRATCH_STEP (64ull << 10)
+
+enum { AS_IDLE = 0, AS_UPDATE = 1, AS_BUILD = 2 };
+
+typedef struct XenoAccelGarbage {
+    VkAccelerationStructureKHR handle;
+    VkBuffer buffer;
+    XenoMemAlloc alloc;
+} XenoAccelGarbage;
+
+typedef struct XenoAccelGarbageList {
+    XenoAccelGarbage* items;
+    uint32_t count;
+    uint32_t cap;
+} XenoAccelGarbageList;
+
+struct XenoAS {
+    XenoAS* prev;
+    XenoAS* next;
+    VkAccelerationStructureKHR handle;
+    VkBuffer buffer;
+    XenoMemAlloc alloc;
+    VkDeviceAddress address;
+    VkDeviceSize size;
+    VkDeviceSize full_size;     /* before compaction */
+    VkAccelerationStructureTypeKHR type;
+    VkBuildAccelerationStructureFlagsKHR build_flags;
+    VkAccelerationStructureGeometryKHR* geometries;
+    VkAccelerationStructureBuildRangeInfoKHR* ranges;
+    uint32_t* max_primitives;
+    /* As of the last full build; an update has to match them. */
+    VkAccelerationStructureGeometryKHR* built_geometries;
+    uint32_t* built_primitives;
+    uint32_t count;
+    VkDeviceSize build_scratch;
+    VkDeviceSize update_scratch;
+    uint32_t refits;
+    int queued;
+    int built;
+    int compacted;
+};
+
+typedef struct XenoAccelSlot {
+    VkCommandBuffer cmd;
+    VkFence fence;
+    int submitted;
+    XenoAS* compact[XENO_ACCEL_QUERIES];   /* NULL once rebuilt or released */
+    uint32_t compact_count;
+    XenoAccelGarbageList retire;
+} XenoAccelSlot;
+
+typedef struct XenoAccelJob {
+    XenoAS* as;
+    VkDeviceSize size;
+} XenoAccelJob;
+
+/* A BLAS already moved to compacted storage, waiting for its copy. */
+typedef struct XenoAccelCopy {
+    XenoAS* as;
+    VkAccelerationStructureKHR src;
+} XenoAccelCopy;
+
+struct XenoAccel {
+    XenoDeviceDispatch* d;
+    XenoMemAllocator* mem;
+    VkCommandPool pool;
+    VkQueryPool queries;
+    XenoAccelSlot slots[XENO_ACCEL_SLOTS];
+    uint32_t cur;
+    VkDeviceSize scratch_align;
+
+    VkBuffer scratch;
+    XenoMemAlloc scratch_alloc;
+    VkDeviceSize scratch_size;
+    VkDeviceAddress scratch_address;
+
+    XenoAS* all;
+    XenoAS** queued;
+    uint32_t queued_count;
+    uint32_t queued_cap;
+    XenoAccelJob* jobs;             /* compacted sizes known, not yet prepared */
+    uint32_t job_count;
+    uint32_t job_cap;
+    XenoAccelCopy* copies;          /* prepared, recorded by the next flush */
+    uint32_t copy_count;
+    uint32_t copy_cap;
+    XenoAccelGarbageList deferred;  /* retired with the next flush */
+
+    VkAccelerationStructureBuildGeometryInfoKHR* infos;
+    const VkAccelerationStructureBuildRangeInfoKHR** range_ptrs;
+    uint32_t info_cap;
+
+    uint32_t generation;
+    XenoAccelStats stats;
+};
+
+static VkDeviceSize align_up(VkDeviceSize v, VkDeviceSize a)
+{
+    return (v + a - 1u) / a * a;
+}
+
+static int grow(void** items, uint32_t* cap, uint32_t need, size_t elem)
+{
+    if (need <= *cap) return 1;
+    uint32_t n = *cap ? *cap : 16u;
+    while (n < need) n *= 2u;
+    void* p = realloc(*items, elem * n);
+    if (!p) return 0;
+    *items = p;
+    *cap = n;
+    return 1;
+}
+
+/* ---- storage ------------------------------------------------------- */
+
+static void garbage_push(XenoAccelGarbageList* l, VkAccelerationStructureKHR handle, VkBuffer buffer,
+                         const XenoMemAlloc* alloc)
+{
+    if (!grow((void**)&l->items, &l->cap, l->count + 1u, sizeof(*l->items))) {
+        XENO_LOGE("accel: out of memory, leaking a structure");
+        return;
+    }
+    l->items[l->count++] = (XenoAccelGarbage){ handle, buffer, *alloc };
+}
+
+static void garbage_free(XenoAccel* a, XenoAccelGarbageList* l)
+{
+    XenoDeviceDispatch* d = a->d;
+    for (uint32_t i = 0; i < l->count; ++i) {
+        XenoAccelGarbage* g = &l->items[i];
+        if (g->handle) d->DestroyAccelerationStructureKHR(d->device, g->handle, NULL);
+        xeno_mem_destroy_buffer(a->mem, g->buffer, &g->alloc);
+    }
+    l->count = 0;
+}
+
+static VkResult storage_create(XenoAccel* a, XenoAS* as, VkDeviceSize size)
+{
+    XenoDeviceDispatch* d = a->d;
+    VkResult r = xeno_mem_create_buffer(a->mem, size,
+                                        VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_STORAGE_BIT_KHR |
+                                            VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+                                        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0, &as->buffer, &as->alloc);
+    if (r != VK_SUCCESS) return r;
+    VkAccelerationStructureCreateInfoKHR ci = {
+        .sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_CREATE_INFO_KHR,
+        .buffer = as->buffer,
+        .size = size,
+        .type = as->type,
+    };
+    r = d->CreateAccelerationStructureKHR(d->device, &ci, NULL, &as->handle);
+    if (r != VK_SUCCESS) {
+        xeno_mem_destroy_buffer(a->mem, as->buffer, &as->alloc);
+        as->buffer = VK_NULL_HANDLE;
+        return r;
+    }
+    VkAccelerationStructureDeviceAddressInfoKHR ai = {
+        .sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_DEVICE_ADDRESS_INFO_KHR,
+        .accelerationStructure = as->handle,
+    };
+    as->address = d->GetAccelerationStructureDeviceAddressKHR(d->device, &ai);
+    as->size = size;
+    return VK_SUCCESS;
+}
+
+/* Current storage goes to the deferred list; the struct keeps its identity. */
+static void storage_retire(XenoAccel* a, XenoAS* as)
+{
+    if (as->handle || as->buffer) garbage_push(&a->deferred, as->handle, as->buffer, &as->alloc);
+    as->handle = VK_NULL_HANDLE;
+    as->buffer = VK_NULL_HANDLE;
+    memset(&as->alloc, 0, sizeof(as->alloc));
+}
+
+static void query_sizes(XenoAccel* a, XenoAS* as)
+{
+    VkAccelerationStructureBuildGeometryInfoKHR bi = {
+        .sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_GEOMETRY_INFO_KHR,
+        .type = as->type,
+        .flags = as->build_flags,
+        .mode = VK_BUILD_ACCELERATION_STRUCTURE_MODE_BUILD_KHR,
+        .geometryCount = as->count,
+        .pGeometries = as->geometries,
+    };
+    VkAccelerationStructureBuildSizesInfoKHR si = { .sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_SIZES_INFO_KHR };
+    a->d->GetAccelerationStructureBuildSizesKHR(a->d->device, VK_ACCELERATION_STRUCTURE_BUILD_TYPE_DEVICE_KHR, &bi,
+                                                as->max_primitives, &si);
+    as->full_size = si.accelerationStructureSize;
+    as->build_scratch = si.buildScratchSize;
+    as->update_scratch = si.updateScratchSize;
+}
+
+/* ---- queueing ------------------------------------------------------ */
+
+static void forget_compaction(XenoAccel* a, XenoAS* as)
+{
+    for (uint32_t s = 0; s < XENO_ACCEL_SLOTS; ++s) {
+        for (uint32_t i = 0; i < a->slots[s].compact_count; ++i) {
+            if (a->slots[s].compact[i] == as) a->slots[s].compact[i] = NULL;
+        }
+    }
+    for (uint32_t i = 0; i < a->job_count; ++i) {
+        if (a->jobs[i].as == as) a->jobs[i].as = NULL;
+    }
+    /* Its compacted storage is never filled in; a rebuild replaces it. */
+    for (uint32_t i = 0; i < a->copy_count; ++i) {
+        if (a->copies[i].as == as) a->copies[i].as = NULL;
+    }
+}
+
+static VkResult enqueue(XenoAccel* a, XenoAS* as, int mode)
+{
+    if (!as->queued) {
+        if (!grow((void**)&a->queued, &a->queued_cap, a->queued_count + 1u, sizeof(*a->queued))) {
+            return VK_ERROR_OUT_OF_HOST_MEMORY;
+        }
+        a->queued[a->queued_count++] = as;
+    }
+    if (mode > as->queued) as->queued = mode;
+    return VK_SUCCESS;
+}
+
+static XenoAS* as_create(XenoAccel* a, VkAccelerationStructureTypeKHR type, const VkAccelerationStructureGeometryKHR* geometries,
+                         const VkAccelerationStructureBuildRangeInfoKHR* ranges, uint32_t count, uint32_t flags)
+{
+    XenoAS* as = (XenoAS*)calloc(1, sizeof(*as));
+    if (!as) return NULL;
+    as->geometries = (VkAccelerationStructureGeometryKHR*)calloc(count, sizeof(*as->geometries));
+    as->ranges = (VkAccelerationStructureBuildRangeInfoKHR*)calloc(count, sizeof(*as->ranges));
+    as->max_primitives = (uint32_t*)calloc(count, sizeof(*as->max_primitives));
+    as->built_geometries = (VkAccelerationStructureGeometryKHR*)calloc(count, sizeof(*as->built_geometries));
+    as->built_primitives = (uint32_t*)calloc(count, sizeof(*as->built_primitives));
+    if (!as->geometries || !as->ranges || !as->max_primitives || !as->built_geometries || !as->built_primitives) goto fail;
+
+    as->type = type;
+    as->count = count;
+    for (uint32_t i = 0; i < count; ++i) {
+        as->geometries[i] = geometries[i];
+        as->geometries[i].pNext = NULL;
+        as->geometries[i].geometry.triangles.pNext = NULL;   /* same offset in every union member */
+        as->ranges[i] = ranges[i];
+        as->max_primitives[i] = ranges[i].primitiveCount;
+    }
+    as->build_flags = (flags & XENO_ACCEL_FAST_BUILD) ? VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_BUILD_BIT_KHR
+                                                      : VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR;
+    if (flags & XENO_ACCEL_DYNAMIC) as->build_flags |= VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_UPDATE_BIT_KHR;
+    else if (type == VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR) as->build_flags |= VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_COMPACTION_BIT_KHR;
+
+    query_sizes(a, as);
+    if (storage_create(a, as, as->full_size) != VK_SUCCESS || enqueue(a, as, AS_BUILD) != VK_SUCCESS) {
+        storage_retire(a, as);
+        goto fail;
+    }
+    as->next = a->all;
+    if (a->all) a->all->prev = as;
+    a->all = as;
+    return as;
+
+fail:
+    XENO_LOGE("accel: cannot create %s", type == VK_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL_KHR ? "TLAS" : "BLAS");
+    free(as->geometries);
+    free(as->ranges);
+    free(as->max_primitives);
+    free(as->built_geometries);
+    free(as->built_primitives);
+    free(as);
+    return NULL;
+}
+
+XenoAS* xeno_accel_blas(XenoAccel* accel, const VkAccelerationStructureGeometryKHR* geometries,
+                        const VkAccelerationStructureBuildRangeInfoKHR* ranges, uint32_t count, uint32_t flags)
+{
+    if (!accel || !count) return NULL;
+    return as_create(accel, VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR, geometries, ranges, count, flags);
+}
+
+XenoAS* xeno_accel_tlas(XenoAccel* accel, VkDeviceAddress instances, uint32_t max_instances, uint32_t flags)
+{
+    if (!accel) return NULL;
+    VkAccelerationStructureGeometryKHR g = {
+        .sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_KHR,
+        .geometryType = VK_GEOMETRY_TYPE_INSTANCES_KHR,
+        .geometry.instances = {
+            .sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_INSTANCES_DATA_KHR,
+            .data.deviceAddress = instances,
+        },
+    };
+    VkAccelerationStructureBuildRangeInfoKHR range = { .primitiveCount = max_instances };
+    return as_create(accel, VK_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL_KHR, &g, &range, 1u, flags);
+}
+
+/* An update may only change the data behind the geometries: primitive
+   counts and everything else describing them must be as last built. */
+static int update_compatible(const XenoAS* as)
+{
+    for (uint32_t i = 0; i < as->count; ++i) {
+        const VkAccelerationStructureGeometryKHR* g = &as->geometries[i];
+        const VkAccelerationStructureGeometryKHR* b = &as->built_geometries[i];
+        if (as->ranges[i].primitiveCount != as->built_primitives[i]) return 0;
+        if (g->geometryType != b->geometryType || g->flags != b->flags) return 0;
+        if (g->geometryType == VK_GEOMETRY_TYPE_TRIANGLES_KHR) {
+            const VkAccelerationStructureGeometryTrianglesDataKHR* t = &g->geometry.triangles;
+            const VkAccelerationStructureGeometryTrianglesDataKHR* u = &b->geometry.triangles;
+            if (t->vertexFormat != u->vertexFormat || t->maxVertex != u->maxVertex || t->indexType != u->indexType ||
+                !t->transformData.deviceAddress != !u->transformData.deviceAddress) {
+                return 0;
+            }
+        } else if (g->geometryType == VK_GEOMETRY_TYPE_INSTANCES_KHR &&
+                   g->geometry.instances.arrayOfPointers != b->geometry.instances.arrayOfPointers) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static VkResult requeue(XenoAccel* a, XenoAS* as)
+{
+    forget_compaction(a, as);
+    int refit = (as->build_flags & VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_UPDATE_BIT_KHR) && as->built &&
+                as->refits < XENO_ACCEL_REFIT_LIMIT && update_compatible(as);
+    if (!refit && as->compacted) {
+        /* A compacted structure is too small to rebuild into. */
+        storage_retire(a, as);
+        VkResult r = storage_create(a, as, as->full_size);
+        if (r != VK_SUCCESS) return r;
+        as->compacted = 0;
+        a->generation++;
+    }
+    return enqueue(a, as, refit ? AS_UPDATE : AS_BUILD);
+}
+
+VkResult xeno_accel_update_blas(XenoAccel* accel, XenoAS* as, const VkAccelerationStructureGeometryKHR* geometries,
+                                const VkAccelerationStructureBuildRangeInfoKHR* ranges)
+{
+    for (uint32_t i = 0; i < as->count; ++i) {
+        if (ranges && ranges[i].primitiveCount > as->max_primitives[i]) return VK_ERROR_INITIALIZATION_FAILED;
+    }
+    for (uint32_t i = 0; i < as->count; ++i) {
+        if (geometries) {
+            as->geometries[i] = geometries[i];
+            as->geometries[i].pNext = NULL;
+            as->geometries[i].geometry.triangles.pNext = NULL;
+        }
+        if (ranges) as->ranges[i] = ranges[i];
+    }
+    return requeue(accel, as);
+}
+
+VkResult xeno_accel_update_tlas(XenoAccel* accel, XenoAS* as, VkDeviceAddress instances, uint32_t count)
+{
+    if (count > as->max_primitives[0]) return VK_ERROR_INITIALIZATION_FAILED;
+    as->geometries[0].geometry.instances.data.deviceAddress = instances;
+    as->ranges[0].primitiveCount = count;
+    return requeue(accel, as);
+}
+
+void xeno_accel_release(XenoAccel* accel, XenoAS* as)
+{
+    if (!accel || !as) return;
+    forget_compaction(accel, as);
+    for (uint32_t i = 0; i < accel->queued_count; ++i) {
+        if (accel->queued[i] == as) {
+            accel->queued[i] = accel->queued[--accel->queued_count];
+            break;
+        }
+    }
+    storage_retire(accel, as);
+    if (as->prev) as->prev->next = as->next;
+    else accel->all = as->next;
+    if (as->next) as->next->prev = as->prev;
+    free(as->geometries);
+    free(as->ranges);
+    free(as->max_primitives);
+    free(as->built_geometries);
+    free(as->built_primitives);
+    free(as);
+}
+
+VkAccelerationStructureKHR xeno_accel_handle(const XenoAS* as)
+{
+    return as ? as->handle : VK_NULL_HANDLE;
+}
+
+VkDeviceAddress xeno_accel_address(const XenoAS* as)
+{
+    return as ? as->address : 0;
+}
+
+uint32_t xeno_accel_generation(const XenoAccel* accel)
+{
+    return accel->generation;
+}
+
+void xeno_accel_get_stats(const XenoAccel* accel, XenoAccelStats* out)
+{
+    *out = accel->stats;
+}
+
+/* ---- lifetime ------------------------------------------------------ */
+
+XenoAccel* xeno_accel_create(VkDevice device, uint32_t queue_family)
+{
+    XenoDeviceDispatch* d = xeno_device_dispatch(device);
+    XenoMemAllocator* mem = xeno_mem_allocator(device);
+    if (!d || !mem || !d->instance || !d->CreateAccelerationStructureKHR || !d->CmdBuildAccelerationStructuresKHR ||
+        !d->GetBufferDeviceAddress) {
+        XENO_LOGI("accel: VK_KHR_acceleration_structure not enabled on device %p", (void*)device);
+        return NULL;
+    }
+    XenoAccel* a = (XenoAccel*)calloc(1, sizeof(*a));
+    if (!a) return NULL;
+    a->d = d;
+    a->mem = mem;
+
+    VkPhysicalDeviceAccelerationStructurePropertiesKHR asp = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ACCELERATION_STRUCTURE_PROPERTIES_KHR,
+    };
+    VkPhysicalDeviceProperties2 p2 = { .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2, .pNext = &asp };
+    d->instance->GetPhysicalDeviceProperties2(d->physical, &p2);
+    a->scratch_align = asp.minAccelerationStructureScratchOffsetAlignment ? asp.minAccelerationStructureScratchOffsetAlignment : 256u;
+
+    VkCommandPoolCreateInfo pci = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+        .flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
+        .queueFamilyIndex = queue_family,
+    };
+    VkResult r = d->CreateCommandPool(d->device, &pci, NULL, &a->pool);
+    VkQueryPoolCreateInfo qci = {
+        .sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+        .queryType = VK_QUERY_TYPE_ACCELERATION_STRUCTURE_COMPACTED_SIZE_KHR,
+        .queryCount = XENO_ACCEL_SLOTS * XENO_ACCEL_QUERIES,
+    };
+    if (r == VK_SUCCESS) r = d->CreateQueryPool(d->device, &qci, NULL, &a->queries);
+    VkCommandBufferAllocateInfo cai = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+        .commandPool = a->pool, .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY, .commandBufferCount = 1,
+    };
+    VkFenceCreateInfo fci = { .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO };
+    for (uint32_t i = 0; i < XENO_ACCEL_SLOTS && r == VK_SUCCESS; ++i) {
+        XenoAccelSlot* s = &a->slots[i];
+        r = d->AllocateCommandBuffers(d->device, &cai, &s->cmd);
+        if (r == VK_SUCCESS) {
+            if (d->SetDeviceLoaderData) r = d->SetDeviceLoaderData(d->device, s->cmd);
+            else *(void**)s->cmd = *(void**)d->device;
+        }
+        if (r == VK_SUCCESS) r = d->CreateFence(d->device, &fci, NULL, &s->fence);
+    }
+    if (r != VK_SUCCESS) {
+        XENO_LOGE("accel: setup failed: %d", r);
+        xeno_accel_destroy(a);
+        return NULL;
+    }
+    return a;
+}
+
+/* The slot's flush has completed: collect compacted sizes and free what
+   was retired with it. */
+static void slot_complete(XenoAccel* a, XenoAccelSlot* s, uint32_t index)
+{
+    XenoDeviceDispatch* d = a->d;
+    if (s->compact_count) {
+        uint64_t sizes[XENO_ACCEL_QUERIES];
+        VkResult r = d->GetQueryPoolResults(d->device, a->queries, index * XENO_ACCEL_QUERIES, s->compact_count,
+                                            sizeof(sizes), sizes, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+        for (uint32_t i = 0; r == VK_SUCCESS && i < s->compact_count; ++i) {
+            XenoAS* as = s->compact[i];
+            if (!as || !sizes[i] || sizes[i] >= as->size) continue;
+            if (!grow((void**)&a->jobs, &a->job_cap, a->job_count + 1u, sizeof(*a->jobs))) break;
+            a->jobs[a->job_count++] = (XenoAccelJob){ as, sizes[i] };
+        }
+        s->compact_count = 0;
+    }
+    garbage_free(a, &s->retire);
+    d->ResetFences(d->device, 1, &s->fence);
+    s->submitted = 0;
+}
+
+void xeno_accel_destroy(XenoAccel* a)
+{
+    if (!a) return;
+    XenoDeviceDispatch* d = a->d;
+    for (uint32_t i = 0; i < XENO_ACCEL_SLOTS; ++i) {
+        XenoAccelSlot* s = &a->slots[i];
+        if (s->submitted) d->WaitForFences(d->device, 1, &s->fence, VK_TRUE, UINT64_MAX);
+        garbage_free(a, &s->retire);
+        free(s->retire.items);
+        if (s->fence) d->DestroyFence(d->device, s->fence, NULL);
+    }
+    while (a->all) xeno_accel_release(a, a->all);
+    garbage_free(a, &a->deferred);
+    free(a->deferred.items);
+    xeno_mem_destroy_buffer(a->mem, a->scratch, &a->scratch_alloc);
+    if (a->queries) d->DestroyQueryPool(d->device, a->queries, NULL);
+    if (a->pool) d->DestroyCommandPool(d->device, a->pool, NULL);
+    free(a->queued);
+    free(a->jobs);
+    free(a->copies);
+    free(a->infos);
+    free((void*)a->range_ptrs);
+    free(a);
+}
+
+/* ---- flush --------------------------------------------------------- */
+
+static VkResult scratch_reserve(XenoAccel* a, XenoAccelSlot* s, VkDeviceSize need)
+{
+    need += a->scratch_align;    /* room to align the base address */
+    if (need <= a->scratch_size) return VK_SUCCESS;
+    XenoDeviceDispatch* d = a->d;
+    /* Earlier flushes that used the old buffer are ahead of this one on the queue. */
+    if (a->scratch) garbage_push(&s->retire, VK_NULL_HANDLE, a->scratch, &a->scratch_alloc);
+    a->scratch = VK_NULL_HANDLE;
+    a->scratch_size = 0;
+    VkDeviceSize size = align_up(need, XENO_ACCEL_SCRATCH_STEP);
+    VkResult r = xeno_mem_create_buffer(a->mem, size,
+                                        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+                                        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0, &a->scratch, &a->scratch_alloc);
+    if (r != VK_SUCCESS) return r;
+    VkBufferDeviceAddressInfo ai = { .sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO, .buffer = a->scratch };
+    a->scratch_address = align_up(d->GetBufferDeviceAddress(d->device, &ai), a->scratch_align);
+    a->scratch_size = size;
+    a->stats.scratch_bytes = size;
+    return VK_SUCCESS;
+}
+
+static int reserve_infos(XenoAccel* a, uint32_t n)
+{
+    if (n <= a->info_cap) return 1;
+    uint32_t cap = a->info_cap ? a->info_cap * 2u : 16u;
+    while (cap < n) cap *= 2u;
+    VkAccelerationStructureBuildGeometryInfoKHR* infos =
+        (VkAccelerationStructureBuildGeometryInfoKHR*)realloc(a->infos, sizeof(*infos) * cap);
+    if (!infos) return 0;
+    a->infos = infos;
+    const VkAccelerationStructureBuildRangeInfoKHR** ranges =
+        (const VkAccelerationStructureBuildRangeInfoKHR**)realloc((void*)a->range_ptrs, sizeof(*ranges) * cap);
+    if (!ranges) return 0;
+    a->range_ptrs = ranges;
+    a->info_cap = cap;
+    return 1;
+}
+
+static void barrier(XenoDeviceDispatch* d, VkCommandBuffer cmd, VkPipelineStageFlags src_stage, VkAccessFlags src,
+                    VkPipelineStageFlags dst_stage, VkAccessFlags dst)
+{
+    VkMemoryBarrier mb = { .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER, .srcAccessMask = src, .dstAccessMask = dst };
+    d->CmdPipelineBarrier(cmd, src_stage, dst_stage, 0, 1, &mb, 0, NULL, 0, NULL);
+}
+
+/* Returns how many copies were recorded. */
+static uint32_t record_compactions(XenoAccel* a, VkCommandBuffer cmd)
+{
+    XenoDeviceDispatch* d = a->d;
+    uint32_t copies = 0;
+    for (uint32_t i = 0; i < a->copy_count; ++i) {
+        if (!a->copies[i].as) continue;
+        VkCopyAccelerationStructureInfoKHR ci = {
+            .sType = VK_STRUCTURE_TYPE_COPY_ACCELERATION_STRUCTURE_INFO_KHR,
+            .src = a->copies[i].src,
+            .dst = a->copies[i].as->handle,
+            .mode = VK_COPY_ACCELERATION_STRUCTURE_MODE_COMPACT_KHR,
+        };
+        d->CmdCopyAccelerationStructureKHR(cmd, &ci);
+        copies++;
+    }
+    return copies;
+}
+
+/* Fills infos from `first` on for every queued structure of `type`, with
+   scratch ranges from offset 0; returns the count and the scratch it needs. */
+static uint32_t gather(XenoAccel* a, VkAccelerationStructureTypeKHR type, uint32_t first, VkDeviceSize* scratch)
+{
+    uint32_t n = first;
+    VkDeviceSize offset = 0;
+    for (uint32_t i = 0; i < a->queued_count; ++i) {
+        XenoAS* as = a->queued[i];
+        if (as->type != type) continue;
+        int update = as->queued == AS_UPDATE;
+        a->infos[n] = (VkAccelerationStructureBuildGeometryInfoKHR){
+            .sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_GEOMETRY_INFO_KHR,
+            .type = as->type,
+            .flags = as->build_flags,
+            .mode = update ? VK_BUILD_ACCELERATION_STRUCTURE_MODE_UPDATE_KHR : VK_BUILD_ACCELERATION_STRUCTURE_MODE_BUILD_KHR,
+            .srcAccelerationStructure = update ? as->handle : VK_NULL_HANDLE,
+            .dstAccelerationStructure = as->handle,
+            .geometryCount = as->count,
+            .pGeometries = as->geometries,
+            .scratchData.deviceAddress = offset,    /* rebased once the buffer is known */
+        };
+        a->range_ptrs[n] = as->ranges;
+        offset = align_up(offset + (update ? as->update_scratch : as->build_scratch), a->scratch_align);
+        n++;
+    }
+    *scratch = offset;
+    return n - first;
+}
+
+static void finish_builds(XenoAccel* a, XenoAccelSlot* s, uint32_t first, uint32_t n)
+{
+    for (uint32_t i = first; i < first + n; ++i) {
+        a->infos[i].scratchData.deviceAddress += a->scratch_address;
+    }
+    a->d->CmdBuildAccelerationStructuresKHR(s->cmd, n, a->infos + first, a->range_ptrs + first);
+    for (uint32_t i = 0; i < a->queued_count; ++i) {
+        XenoAS* as = a->queued[i];
+        if (as->type != a->infos[first].type) continue;
+        if (as->queued == AS_UPDATE) {
+            as->refits++;
+            a->stats.refits++;
+        } else {
+            as->refits = 0;
+            a->stats.builds++;
+            memcpy(as->built_geometries, as->geometries, sizeof(*as->geometries) * as->count);
+            for (uint32_t g = 0; g < as->count; ++g) as->built_primitives[g] = as->ranges[g].primitiveCount;
+            if ((as->build_flags & VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_COMPACTION_BIT_KHR) &&
+                s->compact_count < XENO_ACCEL_QUERIES) {
+                s->compact[s->compact_count++] = as;
+            }
+        }
+        as->built = 1;
+    }
+}
+
+/* Collects finished flushes; wait_current blocks on the slot about to be reused. */
+static void harvest(XenoAccel* a, int wait_current)
+{
+    XenoDeviceDispatch* d = a->d;
+    for (uint32_t i = 0; i < XENO_ACCEL_SLOTS; ++i) {
+        XenoAccelSlot* s = &a->slots[i];
+        if (!s->submitted) continue;
+        if (i == a->cur && wait_current) d->WaitForFences(d->device, 1, &s->fence, VK_TRUE, UINT64_MAX);
+        else if (d->GetFenceStatus(d->device, s->fence) != VK_SUCCESS) continue;
+        slot_complete(a, s, i);
+    }
+}
+
+void xeno_accel_wait(XenoAccel* a)
+{
+    if (!a) return;
+    XenoDeviceDispatch* d = a->d;
+    for (uint32_t i = 0; i < XENO_ACCEL_SLOTS; ++i) {
+        XenoAccelSlot* s = &a->slots[i];
+        if (!s->submitted) continue;
+        d->WaitForFences(d->device, 1, &s->fence, VK_TRUE, UINT64_MAX);
+        slot_complete(a, s, i);
+    }
+}
+
+uint32_t xeno_accel_prepare(XenoAccel* a)
+{
+    harvest(a, 0);
+    for (uint32_t i = 0; i < a->job_count; ++i) {
+        XenoAS* as = a->jobs[i].as;
+        if (!as || as->queued) continue;
+        if (!grow((void**)&a->copies, &a->copy_cap, a->copy_count + 1u, sizeof(*a->copies))) break;
+        XenoAS tmp = { .type = as->type };
+        if (storage_create(a, &tmp, a->jobs[i].size) != VK_SUCCESS) continue;
+        a->stats.compactions++;
+        a->stats.bytes_saved += as->size - tmp.size;
+        XENO_LOGD("accel: compacting BLAS %llu -> %llu bytes", (unsigned long long)as->size, (unsigned long long)tmp.size);
+        /* The old storage is the copy's source; it dies with the flush that copies. */
+        a->copies[a->copy_count++] = (XenoAccelCopy){ as, as->handle };
+        storage_retire(a, as);
+        as->handle = tmp.handle;
+        as->buffer = tmp.buffer;
+        as->alloc = tmp.alloc;
+        as->address = tmp.address;
+        as->size = tmp.size;
+        as->compacted = 1;
+        a->generation++;
+    }
+    a->job_count = 0;
+    return a->generation;
+}
+
+VkResult xeno_accel_flush(XenoAccel* a, VkQueue queue)
+{
+    XenoDeviceDispatch* d = a->d;
+    /* Harvest finished flushes first; the current slot is about to be reused. */
+    harvest(a, 1);
+    if (!a->queued_count && !a->copy_count) return VK_SUCCESS;
+    XENO_TRACE_SCOPE("accel.flush");
+
+    XenoAccelSlot* s = &a->slots[a->cur];
+    if (!reserve_infos(a, a->queued_count)) return VK_ERROR_OUT_OF_HOST_MEMORY;
+    /* Whatever was retired since the last flush dies with this one. */
+    for (uint32_t i = 0; i < a->deferred.count; ++i) {
+        const XenoAccelGarbage* g = &a->deferred.items[i];
+        garbage_push(&s->retire, g->handle, g->buffer, &g->alloc);
+    }
+    a->deferred.count = 0;
+
+    VkCommandBufferBeginInfo bi = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+        .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+    };
+    VkResult r = d->BeginCommandBuffer(s->cmd, &bi);
+    if (r != VK_SUCCESS) return r;
+    /* Earlier traces and builds may still read the structures and scratch we overwrite. */
+    barrier(d, s->cmd, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT,
+            VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR,
+            VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_KHR | VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR);
+    uint32_t copies = record_compactions(a, s->cmd);
+
+    /* BLASes first, TLASes behind them; both batches reuse the scratch from 0. */
+    VkDeviceSize blas_scratch, tlas_scratch;
+    uint32_t nb = gather(a, VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR, 0, &blas_scratch);
+    uint32_t nt = gather(a, VK_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL_KHR, nb, &tlas_scratch);
+    r = scratch_reserve(a, s, blas_scratch > tlas_scratch ? blas_scratch : tlas_scratch);
+    if (r != VK_SUCCESS) {
+        d->EndCommandBuffer(s->cmd);
+        return r;
+    }
+
+    if (nb) finish_builds(a, s, 0, nb);
+    /* The size queries and TLAS builds read what the copies and BLAS builds wrote. */
+    if (nb || copies) {
+        barrier(d, s->cmd, VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR,
+                VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR, VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR,
+                VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_KHR | VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR);
+    }
+    if (s->compact_count) {
+        VkAccelerationStructureKHR handles[XENO_ACCEL_QUERIES];
+        for (uint32_t i = 0; i < s->compact_count; ++i) handles[i] = s->compact[i]->handle;
+        uint32_t first = a->cur * XENO_ACCEL_QUERIES;
+        d->CmdResetQueryPool(s->cmd, a->queries, first, s->compact_count);
+        d->CmdWriteAccelerationStructuresPropertiesKHR(s->cmd, s->compact_count, handles,
+                                                       VK_QUERY_TYPE_ACCELERATION_STRUCTURE_COMPACTED_SIZE_KHR,
+                                                       a->queries, first);
+    }
+    if (nt) finish_builds(a, s, nb, nt);
+    barrier(d, s->cmd, VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR,
+            VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_ACCESS_MEMORY_READ_BIT);
+    r = d->EndCommandBuffer(s->cmd);
+    if (r != VK_SUCCESS) return r;
+
+    VkSubmitInfo si = { .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO, .commandBufferCount = 1, .pCommandBuffers = &s->cmd };
+    r = d->QueueSubmit(queue, 1, &si, s->fence);
+    if (r != VK_SUCCESS) {
+        XENO_LOGE("accel: submit failed: %d", r);
+        return r;
+    }
+    s->submitted = 1;
+    XENO_TRACE_COUNTER("accel.builds", nb + nt);
+    for (uint32_t i = 0; i < a->queued_count; ++i) a->queued[i]->queued = AS_IDLE;
+    a->queued_count = 0;
+    a->copy_count = 0;
+    a->cur = (a->cur + 1u) % XENO_ACCEL_SLOTS;
+    return VK_SUCCESS;
+}
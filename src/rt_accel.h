@@ -0,0 +1,84 @@
+// src/rt_accel.h
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <stdint.h>
+
+/*
+  Acceleration-structure manager for the RT path (rt_accel.c).
+
+  Creating or updating a BLAS/TLAS only queues it; xeno_accel_flush
+  records every queued BLAS into one vkCmdBuildAccelerationStructuresKHR
+  call, then every queued TLAS into a second one, all sharing a single
+  scratch buffer sized for the batch, and submits that on the given queue.
+
+  Static BLASes are built with ALLOW_COMPACTION and their compacted size
+  is queried. Once the build's fence has signalled, xeno_accel_prepare
+  moves them to right-sized storage and the next flush copies them there,
+  freeing the original once it has completed. A compaction changes the
+  BLAS's device address, and so does rebuilding a compacted BLAS:
+  xeno_accel_generation then changes, and TLAS instance data has to be
+  rewritten and the TLAS updated in that flush. Preparing before writing
+  instance data keeps addresses fixed until the flush; flush alone never
+  moves a BLAS.
+
+  Dynamic structures are built with ALLOW_UPDATE, and updates refit them
+  in place; after XENO_ACCEL_REFIT_LIMIT refits the next update does a
+  full rebuild so trace quality does not decay.
+
+  Structures that are released, replaced or compacted away stay alive
+  until a later flush has completed, so work the app submitted in between
+  can still use them. One owner per manager.
+*/
+
+#define XENO_ACCEL_DYNAMIC 0x1u     /* refit on update, no compaction */
+#define XENO_ACCEL_FAST_BUILD 0x2u  /* PREFER_FAST_BUILD instead of PREFER_FAST_TRACE */
+#define XENO_ACCEL_REFIT_LIMIT 32u
+
+typedef struct XenoAccel XenoAccel;
+typedef struct XenoAS XenoAS;
+
+typedef struct XenoAccelStats {
+    uint32_t builds;
+    uint32_t refits;
+    uint32_t compactions;
+    VkDeviceSize bytes_saved;      /* by compaction */
+    VkDeviceSize scratch_bytes;
+} XenoAccelStats;
+
+/* NULL when the device has no VK_KHR_acceleration_structure entrypoints. */
+XenoAccel* xeno_accel_create(VkDevice device, uint32_t queue_family);
+void xeno_accel_destroy(XenoAccel* accel);
+
+/* Geometry is copied (pNext chains are dropped); the buffers it points at
+   must stay valid until the flush that builds it. */
+XenoAS* xeno_accel_blas(XenoAccel* accel, const VkAccelerationStructureGeometryKHR* geometries,
+                        const VkAccelerationStructureBuildRangeInfoKHR* ranges, uint32_t count, uint32_t flags);
+/* instances: device address of `max_instances` VkAccelerationStructureInstanceKHR. */
+XenoAS* xeno_accel_tlas(XenoAccel* accel, VkDeviceAddress instances, uint32_t max_instances, uint32_t flags);
+
+/* New vertex/instance data for an existing structure; primitive counts
+   must not exceed the ones it was created with. NULL geometries keeps the
+   previous ones (only the data behind them changed). A dynamic structure
+   is refitted only when primitive counts and geometry descriptions match
+   its last full build; anything else rebuilds it. */
+VkResult xeno_accel_update_blas(XenoAccel* accel, XenoAS* as, const VkAccelerationStructureGeometryKHR* geometries,
+                                const VkAccelerationStructureBuildRangeInfoKHR* ranges);
+VkResult xeno_accel_update_tlas(XenoAccel* accel, XenoAS* as, VkDeviceAddress instances, uint32_t count);
+
+void xeno_accel_release(XenoAccel* accel, XenoAS* as);
+
+VkAccelerationStructureKHR xeno_accel_handle(const XenoAS* as);
+VkDeviceAddress xeno_accel_address(const XenoAS* as);
+
+/* Moves BLASes whose compacted size is known to their new storage and
+   returns the generation; addresses stay as they are until the next
+   prepare or BLAS update. */
+uint32_t xeno_accel_prepare(XenoAccel* accel);
+/* Records and submits queued builds and prepared compactions. */
+VkResult xeno_accel_flush(XenoAccel* accel, VkQueue queue);
+/* Blocks until every flush so far has completed on the GPU. */
+void xeno_accel_wait(XenoAccel* accel);
+/* Bumped whenever a BLAS moved to a new address. */
+uint32_t xeno_accel_generation(const XenoAccel* accel);
+void xeno_accel_get_stats(const XenoAccel* accel, XenoAccelStats* out);
@@ -0,0 +1,681 @@
+// src/rt_bvh.c
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "rt_bvh.h"
+#include "xeno_log.h"
+#include "xeno_trace.h"
+
+/* Subtrees with at least this many triangles go to the worker pool. */
+#define XENO_BVH_TASK_MIN 4096u
+#define XENO_BVH_MAX_THREADS 8u
+#define XENO_BVH_STACK 64u
+/* Binary depth limit. The collapse descends at least two binary levels
+   per wide node, so this keeps the 4-wide tree within XENO_BVH_GPU_DEPTH. */
+#define XENO_BVH_BUILD_DEPTH (2u * XENO_BVH_GPU_DEPTH)
+
+/* SAH constants, in units of one triangle test. */
+#define XENO_BVH_COST_TRAVERSE 1.0f
+#define XENO_BVH_COST_INTERSECT 1.0f
+
+/* ---- 4-wide float helpers ------------------------------------------------ */
+
+#if defined(__ARM_NEON) || defined(__aarch64__)
+#include <arm_neon.h>
+typedef float32x4_t v4;
+static inline v4 v4_load(const float* p) { return vld1q_f32(p); }
+static inline void v4_store(float* p, v4 a) { vst1q_f32(p, a); }
+static inline v4 v4_set1(float f) { return vdupq_n_f32(f); }
+static inline v4 v4_min(v4 a, v4 b) { return vminq_f32(a, b); }
+static inline v4 v4_max(v4 a, v4 b) { return vmaxq_f32(a, b); }
+static inline v4 v4_add(v4 a, v4 b) { return vaddq_f32(a, b); }
+static inline v4 v4_sub(v4 a, v4 b) { return vsubq_f32(a, b); }
+static inline v4 v4_mul(v4 a, v4 b) { return vmulq_f32(a, b); }
+static inline void v4_trunc(v4 a, int32_t* out) { vst1q_s32(out, vcvtq_s32_f32(a)); }
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+typedef __m128 v4;
+static inline v4 v4_load(const float* p) { return _mm_loadu_ps(p); }
+static inline void v4_store(float* p, v4 a) { _mm_storeu_ps(p, a); }
+static inline v4 v4_set1(float f) { return _mm_set1_ps(f); }
+static inline v4 v4_min(v4 a, v4 b) { return _mm_min_ps(a, b); }
+static inline v4 v4_max(v4 a, v4 b) { return _mm_max_ps(a, b); }
+static inline v4 v4_add(v4 a, v4 b) { return _mm_add_ps(a, b); }
+static inline v4 v4_sub(v4 a, v4 b) { return _mm_sub_ps(a, b); }
+static inline v4 v4_mul(v4 a, v4 b) { return _mm_mul_ps(a, b); }
+static inline void v4_trunc(v4 a, int32_t* out) { _mm_storeu_si128((__m128i*)out, _mm_cvttps_epi32(a)); }
+#else
+typedef struct { float f[4]; } v4;
+static inline v4 v4_load(const float* p) { v4 r; memcpy(r.f, p, sizeof(r.f)); return r; }
+static inline void v4_store(float* p, v4 a) { memcpy(p, a.f, sizeof(a.f)); }
+static inline v4 v4_set1(float f) { v4 r = {{ f, f, f, f }}; return r; }
+#define XENO_V4_OP(name, expr) \
+    static inline v4 name(v4 a, v4 b) { v4 r; for (int i = 0; i < 4; ++i) r.f[i] = (expr); return r; }
+XENO_V4_OP(v4_min, a.f[i] < b.f[i] ? a.f[i] : b.f[i])
+XENO_V4_OP(v4_max, a.f[i] > b.f[i] ? a.f[i] : b.f[i])
+XENO_V4_OP(v4_add, a.f[i] + b.f[i])
+XENO_V4_OP(v4_sub, a.f[i] - b.f[i])
+XENO_V4_OP(v4_mul, a.f[i] * b.f[i])
+#undef XENO_V4_OP
+static inline void v4_trunc(v4 a, int32_t* out) { for (int i = 0; i < 4; ++i) out[i] = (int32_t)a.f[i]; }
+#endif
+
+/* ---- build state --------------------------------------------------------- */
+
+typedef struct BvhBox {
+    float lo[4];
+    float hi[4];
+} BvhBox;
+
+typedef struct BvhBuildNode {
+    BvhBox box;
+    uint32_t first;     /* leaf: first triangle; internal: left child, right is first + 1 */
+    uint32_t count;     /* 0 for internal nodes */
+} BvhBuildNode;
+
+typedef struct BvhTask {
+    uint32_t node;
+    uint32_t begin;
+    uint32_t end;
+    uint32_t depth;     /* of node, the root is 1 */
+} BvhTask;
+
+typedef struct BvhBuild {
+    BvhBox* prims;              /* triangle boxes, partitioned in place */
+    uint32_t* ids;              /* global triangle index, permuted with prims */
+    BvhBuildNode* nodes;
+    _Atomic uint32_t node_count;
+    uint32_t threads;
+
+    pthread_mutex_t mtx;
+    pthread_cond_t cv;
+    BvhTask* tasks;
+    uint32_t task_count;
+    uint32_t task_cap;
+    uint32_t pending;           /* queued + running tasks */
+} BvhBuild;
+
+struct XenoBvh {
+    uint32_t threads;
+    XenoBvhNode* nodes;
+    uint32_t node_count;
+    uint32_t node_cap;
+    XenoBvhTri* tris;
+    uint32_t tri_count;
+    uint32_t tri_cap;
+    XenoBvhStats stats;
+};
+
+static void* bvh_alloc(size_t count, size_t size)
+{
+    void* p = NULL;
+    if (count == 0) count = 1;
+    if (posix_memalign(&p, 64, count * size) != 0) return NULL;
+    return p;
+}
+
+static inline void box_empty(BvhBox* b)
+{
+    v4_store(b->lo, v4_set1(INFINITY));
+    v4_store(b->hi, v4_set1(-INFINITY));
+}
+
+static inline void box_grow(BvhBox* b, const BvhBox* o)
+{
+    v4_store(b->lo, v4_min(v4_load(b->lo), v4_load(o->lo)));
+    v4_store(b->hi, v4_max(v4_load(b->hi), v4_load(o->hi)));
+}
+
+static inline float box_half_area(const BvhBox* b)
+{
+    float e[4];
+    v4_store(e, v4_sub(v4_load(b->hi), v4_load(b->lo)));
+    return e[0] * e[1] + e[1] * e[2] + e[2] * e[0];
+}
+
+/* Returns 0 if the task could not be queued; the caller then keeps it. */
+static int push_task(BvhBuild* b, BvhTask t)
+{
+    pthread_mutex_lock(&b->mtx);
+    if (b->task_count == b->task_cap) {
+        uint32_t cap = b->task_cap ? b->task_cap * 2u : 32u;
+        BvhTask* tasks = (BvhTask*)realloc(b->tasks, cap * sizeof(*tasks));
+        if (!tasks) {
+            pthread_mutex_unlock(&b->mtx);
+            return 0;
+        }
+        b->tasks = tasks;
+        b->task_cap = cap;
+    }
+    b->tasks[b->task_count++] = t;
+    b->pending++;
+    pthread_cond_signal(&b->cv);
+    pthread_mutex_unlock(&b->mtx);
+    return 1;
+}
+
+static void make_children(BvhBuild* b, uint32_t ni, const BvhBox* left, const BvhBox* right)
+{
+    uint32_t l = atomic_fetch_add_explicit(&b->node_count, 2u, memory_order_relaxed);
+    b->nodes[l].box = *left;
+    b->nodes[l + 1u].box = *right;
+    b->nodes[ni].first = l;
+    b->nodes[ni].count = 0;
+}
+
+/* Levels of halving until count fits in a leaf. */
+static uint32_t levels_needed(uint32_t count)
+{
+    uint32_t levels = 0;
+    for (; count > XENO_BVH_LEAF_MAX; count = (count + 1u) / 2u) levels++;
+    return levels;
+}
+
+/* Splits [begin, end) in the middle of its current order. */
+static void count_split(BvhBuild* b, uint32_t ni, uint32_t begin, uint32_t end, uint32_t* mid)
+{
+    BvhBox lbox, rbox;
+    *mid = begin + (end - begin) / 2u;
+    box_empty(&lbox);
+    box_empty(&rbox);
+    for (uint32_t i = begin; i < *mid; ++i) box_grow(&lbox, &b->prims[i]);
+    for (uint32_t i = *mid; i < end; ++i) box_grow(&rbox, &b->prims[i]);
+    make_children(b, ni, &lbox, &rbox);
+}
+
+/* Turns node ni into a leaf (returns 0) or splits [begin, end) at *mid
+   and creates its two children (returns 1). */
+static int split_node(BvhBuild* b, uint32_t ni, uint32_t begin, uint32_t end, uint32_t depth, uint32_t* mid)
+{
+    BvhBuildNode* n = &b->nodes[ni];
+    uint32_t count = end - begin;
+    n->first = begin;
+    n->count = count;
+    if (count <= 1u) return 0;
+
+    /* A lopsided SAH split could push the subtree past the depth limit;
+       from here on only halving splits are guaranteed to fit. */
+    if (depth + 1u + levels_needed(count - 1u) > XENO_BVH_BUILD_DEPTH) {
+        if (count <= XENO_BVH_LEAF_MAX) return 0;
+        count_split(b, ni, begin, end, mid);
+        return 1;
+    }
+
+    /* Centroid bounds, kept doubled (lo + hi) throughout. */
+    v4 cmin = v4_set1(INFINITY), cmax = v4_set1(-INFINITY);
+    for (uint32_t i = begin; i < end; ++i) {
+        v4 c = v4_add(v4_load(b->prims[i].lo), v4_load(b->prims[i].hi));
+        cmin = v4_min(cmin, c);
+        cmax = v4_max(cmax, c);
+    }
+    float ext[4], scale[4], origin[4];
+    v4_store(ext, v4_sub(cmax, cmin));
+    v4_store(origin, cmin);
+    /* Small nodes use fewer bins; the sweep then costs about as much as the binning. */
+    const uint32_t nbins = count < XENO_BVH_BINS ? (count < 4u ? 4u : count) : XENO_BVH_BINS;
+    int splittable = 0;
+    for (int a = 0; a < 3; ++a) {
+        scale[a] = ext[a] > 0.0f ? (float)nbins * 0.99999f / ext[a] : 0.0f;
+        splittable |= ext[a] > 0.0f;
+    }
+    scale[3] = 0.0f;
+
+    if (!splittable) {
+        /* Every centroid coincides: only a count split makes progress. */
+        if (count <= XENO_BVH_LEAF_MAX) return 0;
+        count_split(b, ni, begin, end, mid);
+        return 1;
+    }
+
+    /* One pass bins every triangle on all three axes. */
+    BvhBox bins[3][XENO_BVH_BINS];
+    uint32_t counts[3][XENO_BVH_BINS];
+    for (int a = 0; a < 3; ++a)
+        for (uint32_t s = 0; s < nbins; ++s) box_empty(&bins[a][s]);
+    memset(counts, 0, sizeof(counts));
+
+    const v4 vscale = v4_load(scale);
+    const v4 vzero = v4_set1(0.0f), vlast = v4_set1((float)(nbins - 1u));
+    for (uint32_t i = begin; i < end; ++i) {
+        const BvhBox* p = &b->prims[i];
+        v4 c = v4_add(v4_load(p->lo), v4_load(p->hi));
+        v4 f = v4_min(v4_max(v4_mul(v4_sub(c, cmin), vscale), vzero), vlast);
+        int32_t k[4];
+        v4_trunc(f, k);
+        for (int a = 0; a < 3; ++a) {
+            box_grow(&bins[a][k[a]], p);
+            counts[a][k[a]]++;
+        }
+    }
+
+    /* Sweep: right-to-left prefix areas, then evaluate left-to-right. */
+    float best = INFINITY;
+    int best_axis = -1;
+    uint32_t best_split = 0;
+    for (int a = 0; a < 3; ++a) {
+        if (ext[a] <= 0.0f) continue;
+        float rarea[XENO_BVH_BINS];
+        uint32_t rcount[XENO_BVH_BINS];
+        BvhBox acc;
+        box_empty(&acc);
+        uint32_t nacc = 0;
+        for (uint32_t s = nbins - 1u; s > 0; --s) {
+            box_grow(&acc, &bins[a][s]);
+            nacc += counts[a][s];
+            rarea[s] = nacc ? box_half_area(&acc) : 0.0f;
+            rcount[s] = nacc;
+        }
+        box_empty(&acc);
+        nacc = 0;
+        for (uint32_t s = 1; s < nbins; ++s) {
+            box_grow(&acc, &bins[a][s - 1u]);
+            nacc += counts[a][s - 1u];
+            if (!nacc || !rcount[s]) continue;
+            float cost = box_half_area(&acc) * (float)nacc + rarea[s] * (float)rcount[s];
+            if (cost < best) {
+                best = cost;
+                best_axis = a;
+                best_split = s;
+            }
+        }
+    }
+
+    float parent = box_half_area(&n->box);
+    float split_cost = XENO_BVH_COST_TRAVERSE
+                     + XENO_BVH_COST_INTERSECT * (parent > 0.0f ? best / parent : (float)count);
+    if (count <= XENO_BVH_LEAF_MAX && (best_axis < 0 || XENO_BVH_COST_INTERSECT * (float)count <= split_cost))
+        return 0;
+
+    if (best_axis < 0) {
+        count_split(b, ni, begin, end, mid);
+        return 1;
+    }
+
+    const int a = best_axis;
+    const float o = origin[a], sc = scale[a];
+    uint32_t i = begin, j = end;
+    while (i < j) {
+        float c = b->prims[i].lo[a] + b->prims[i].hi[a];
+        float f = (c - o) * sc;
+        uint32_t k = f <= 0.0f ? 0u : (f >= (float)(nbins - 1u) ? nbins - 1u : (uint32_t)f);
+        if (k < best_split) {
+            ++i;
+        } else {
+            --j;
+            BvhBox tb = b->prims[i]; b->prims[i] = b->prims[j]; b->prims[j] = tb;
+            uint32_t ti = b->ids[i]; b->ids[i] = b->ids[j]; b->ids[j] = ti;
+        }
+    }
+    *mid = i;
+    BvhBox lbox, rbox;
+    box_empty(&lbox);
+    box_empty(&rbox);
+    for (uint32_t s = 0; s < best_split; ++s) box_grow(&lbox, &bins[a][s]);
+    for (uint32_t s = best_split; s < nbins; ++s) box_grow(&rbox, &bins[a][s]);
+    make_children(b, ni, &lbox, &rbox);
+    return 1;
+}
+
+static void build_subtree(BvhBuild* b, BvhTask root)
+{
+    BvhTask stack[XENO_BVH_STACK];
+    uint32_t sp = 0;
+    stack[sp++] = root;
+    while (sp) {
+        BvhTask t = stack[--sp];
+        uint32_t mid;
+        if (!split_node(b, t.node, t.begin, t.end, t.depth, &mid)) continue;
+
+        uint32_t l = b->nodes[t.node].first;
+        BvhTask left = { l, t.begin, mid, t.depth + 1u }, right = { l + 1u, mid, t.end, t.depth + 1u };
+        int left_big = mid - t.begin >= t.end - mid;
+        BvhTask big = left_big ? left : right, small = left_big ? right : left;
+        /* The smaller side is processed next, which bounds the stack at log2(n). */
+        if (b->threads <= 1u || big.end - big.begin < XENO_BVH_TASK_MIN || !push_task(b, big))
+            stack[sp++] = big;
+        stack[sp++] = small;
+    }
+}
+
+static void* bvh_worker(void* arg)
+{
+    BvhBuild* b = (BvhBuild*)arg;
+    pthread_mutex_lock(&b->mtx);
+    for (;;) {
+        while (!b->task_count && b->pending) pthread_cond_wait(&b->cv, &b->mtx);
+        if (!b->task_count) break;
+        BvhTask t = b->tasks[--b->task_count];
+        pthread_mutex_unlock(&b->mtx);
+        build_subtree(b, t);
+        pthread_mutex_lock(&b->mtx);
+        if (--b->pending == 0) pthread_cond_broadcast(&b->cv);
+    }
+    pthread_mutex_unlock(&b->mtx);
+    return NULL;
+}
+
+/* ---- input --------------------------------------------------------------- */
+
+static inline const float* vertex_at(const XenoBvhGeometry* g, uint32_t v)
+{
+    return (const float*)((const char*)g->vertices + (size_t)v * g->vertex_stride);
+}
+
+static int triangle_vertices(const XenoBvhGeometry* g, uint32_t t, float out[3][3])
+{
+    uint32_t idx[3] = { t * 3u, t * 3u + 1u, t * 3u + 2u };
+    if (g->indices) {
+        idx[0] = g->indices[idx[0]];
+        idx[1] = g->indices[idx[1]];
+        idx[2] = g->indices[idx[2]];
+    }
+    for (int k = 0; k < 3; ++k) {
+        if (idx[k] >= g->vertex_count) return 0;
+        memcpy(out[k], vertex_at(g, idx[k]), 3u * sizeof(float));
+        if (!isfinite(out[k][0]) || !isfinite(out[k][1]) || !isfinite(out[k][2])) return 0;
+    }
+    return 1;
+}
+
+/* ---- 4-wide collapse ----------------------------------------------------- */
+
+typedef struct BvhCollapse {
+    uint32_t bin;
+    uint32_t wide;
+    uint32_t depth;
+} BvhCollapse;
+
+static void set_child_box(XenoBvhNode* w, uint32_t s, const BvhBox* box)
+{
+    w->lo_x[s] = box->lo[0]; w->hi_x[s] = box->hi[0];
+    w->lo_y[s] = box->lo[1]; w->hi_y[s] = box->hi[1];
+    w->lo_z[s] = box->lo[2]; w->hi_z[s] = box->hi[2];
+}
+
+static VkResult collapse(XenoBvh* bvh, const BvhBuildNode* bn, uint32_t bin_count)
+{
+    /* Every wide node stands for a distinct internal binary node. */
+    uint32_t cap = bin_count / 2u + 1u;
+    if (cap > bvh->node_cap) {
+        XenoBvhNode* nodes = (XenoBvhNode*)bvh_alloc(cap, sizeof(*nodes));
+        if (!nodes) return VK_ERROR_OUT_OF_HOST_MEMORY;
+        free(bvh->nodes);
+        bvh->nodes = nodes;
+        bvh->node_cap = cap;
+    }
+    BvhCollapse* work = (BvhCollapse*)malloc(cap * sizeof(*work));
+    if (!work) return VK_ERROR_OUT_OF_HOST_MEMORY;
+
+    uint32_t wide_count = 1, top = 0, leaves = 0, depth = 0;
+    work[top++] = (BvhCollapse){ 0, 0, 1 };
+    while (top) {
+        BvhCollapse c = work[--top];
+        if (c.depth > depth) depth = c.depth;
+
+        /* Open internal children until there are four: the shallowest
+           first, so every path drops at least two binary levels, then the
+           largest. */
+        uint32_t kids[XENO_BVH_WIDTH], level[XENO_BVH_WIDTH];
+        uint32_t n = 0;
+        if (bn[c.bin].count) {
+            kids[n++] = c.bin;
+        } else {
+            kids[n] = bn[c.bin].first;
+            level[n++] = 1;
+            kids[n] = bn[c.bin].first + 1u;
+            level[n++] = 1;
+            while (n < XENO_BVH_WIDTH) {
+                int pick = -1;
+                float area = -1.0f;
+                for (uint32_t i = 0; i < n; ++i) {
+                    if (bn[kids[i]].count) continue;
+                    float a = box_half_area(&bn[kids[i]].box);
+                    if (pick < 0 || level[i] < level[pick] || (level[i] == level[pick] && a > area)) {
+                        area = a;
+                        pick = (int)i;
+                    }
+                }
+                if (pick < 0) break;
+                uint32_t opened = kids[pick];
+                kids[pick] = bn[opened].first;
+                level[pick]++;
+                kids[n] = bn[opened].first + 1u;
+                level[n++] = level[pick];
+            }
+        }
+
+        XenoBvhNode* w = &bvh->nodes[c.wide];
+        memset(w, 0, sizeof(*w));
+        for (uint32_t s = 0; s < XENO_BVH_WIDTH; ++s) {
+            if (s >= n) {
+                w->child[s] = XENO_BVH_EMPTY;
+                continue;
+            }
+            const BvhBuildNode* k = &bn[kids[s]];
+            set_child_box(w, s, &k->box);
+            if (k->count) {
+                w->child[s] = XENO_BVH_LEAF(k->first, k->count);
+                leaves++;
+            } else {
+                w->child[s] = wide_count;
+                work[top++] = (BvhCollapse){ kids[s], wide_count++, c.depth + 1u };
+            }
+        }
+    }
+    free(work);
+
+    bvh->node_count = wide_count;
+    bvh->stats.nodes = wide_count;
+    bvh->stats.leaves = leaves;
+    bvh->stats.depth = depth;
+    return VK_SUCCESS;
+}
+
+/* ---- public -------------------------------------------------------------- */
+
+XenoBvh* xeno_bvh_create(uint32_t threads)
+{
+    XenoBvh* bvh = (XenoBvh*)calloc(1, sizeof(*bvh));
+    if (!bvh) return NULL;
+    if (!threads) {
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = online > 0 ? (uint32_t)online : 1u;
+    }
+    bvh->threads = threads > XENO_BVH_MAX_THREADS ? XENO_BVH_MAX_THREADS : threads;
+    return bvh;
+}
+
+void xeno_bvh_destroy(XenoBvh* bvh)
+{
+    if (!bvh) return;
+    free(bvh->nodes);
+    free(bvh->tris);
+    free(bvh);
+}
+
+static double now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1000.0 + (double)ts.tv_nsec / 1.0e6;
+}
+
+VkResult xeno_bvh_build(XenoBvh* bvh, const XenoBvhGeometry* geometries, uint32_t count)
+{
+    if (!bvh || (count && !geometries)) return VK_ERROR_INITIALIZATION_FAILED;
+    XENO_TRACE_SCOPE("bvh.build");
+    double t0 = now_ms();
+
+    uint64_t total = 0;
+    for (uint32_t g = 0; g < count; ++g) total += geometries[g].triangle_count;
+    if (total > XENO_BVH_MAX_TRIANGLES) {
+        XENO_LOGE("rt_bvh: %llu triangles exceed the %u limit", (unsigned long long)total, XENO_BVH_MAX_TRIANGLES);
+        return VK_ERROR_INITIALIZATION_FAILED;
+    }
+
+    BvhBuild b = { 0 };
+    b.prims = (BvhBox*)bvh_alloc((size_t)total, sizeof(*b.prims));
+    b.ids = (uint32_t*)malloc((size_t)(total ? total : 1u) * sizeof(*b.ids));
+    b.nodes = (BvhBuildNode*)bvh_alloc((size_t)total * 2u, sizeof(*b.nodes));
+    uint32_t* firsts = (uint32_t*)malloc((size_t)(count ? count : 1u) * sizeof(*firsts));
+    VkResult res = VK_ERROR_OUT_OF_HOST_MEMORY;
+    if (!b.prims || !b.ids || !b.nodes || !firsts) goto out;
+
+    /* Triangle boxes; the ids index geometry g's triangles from firsts[g]. */
+    uint32_t n = 0, dropped = 0, first = 0;
+    BvhBox root;
+    box_empty(&root);
+    for (uint32_t g = 0; g < count; ++g) {
+        const XenoBvhGeometry* geo = &geometries[g];
+        firsts[g] = first;
+        for (uint32_t t = 0; t < geo->triangle_count; ++t) {
+            float v[3][3];
+            if (!geo->vertices || !triangle_vertices(geo, t, v)) {
+                dropped++;
+                continue;
+            }
+            float p0[4] = { v[0][0], v[0][1], v[0][2], 0.0f };
+            float p1[4] = { v[1][0], v[1][1], v[1][2], 0.0f };
+            float p2[4] = { v[2][0], v[2][1], v[2][2], 0.0f };
+            v4 a = v4_load(p0), c1 = v4_load(p1), c2 = v4_load(p2);
+            BvhBox* p = &b.prims[n];
+            v4_store(p->lo, v4_min(a, v4_min(c1, c2)));
+            v4_store(p->hi, v4_max(a, v4_max(c1, c2)));
+            box_grow(&root, p);
+            b.ids[n++] = first + t;
+        }
+        first += geo->triangle_count;
+    }
+    if (dropped) XENO_LOGW("rt_bvh: dropped %u invalid triangles", dropped);
+
+    uint32_t tcap = n ? n : 1u;
+    if (tcap > bvh->tri_cap) {
+        XenoBvhTri* tris = (XenoBvhTri*)bvh_alloc(tcap, sizeof(*tris));
+        if (!tris) goto out;
+        free(bvh->tris);
+        bvh->tris = tris;
+        bvh->tri_cap = tcap;
+    }
+
+    /* Root node; an empty scene becomes a root with no children. */
+    b.nodes[0].box = root;
+    atomic_init(&b.node_count, 1u);
+    b.threads = n >= 2u * XENO_BVH_TASK_MIN ? bvh->threads : 1u;
+    if (n) {
+        BvhTask top = { 0, 0, n, 1u };
+        if (b.threads > 1u) {
+            pthread_mutex_init(&b.mtx, NULL);
+            pthread_cond_init(&b.cv, NULL);
+            b.tasks = (BvhTask*)malloc(32u * sizeof(*b.tasks));
+            b.task_cap = b.tasks ? 32u : 0u;
+            if (b.tasks) {
+                b.tasks[b.task_count++] = top;
+                b.pending = 1;
+                pthread_t workers[XENO_BVH_MAX_THREADS];
+                uint32_t started = 0;
+                for (uint32_t i = 1; i < b.threads; ++i)
+                    if (pthread_create(&workers[started], NULL, bvh_worker, &b) == 0) started++;
+                bvh_worker(&b);
+                for (uint32_t i = 0; i < started; ++i) pthread_join(workers[i], NULL);
+                b.threads = started + 1u;
+            } else {
+                b.threads = 1u;
+                build_subtree(&b, top);
+            }
+            free(b.tasks);
+            pthread_cond_destroy(&b.cv);
+            pthread_mutex_destroy(&b.mtx);
+        } else {
+            build_subtree(&b, top);
+        }
+    }
+    uint32_t bin_count = atomic_load(&b.node_count);
+
+    if (n) {
+        res = collapse(bvh, b.nodes, bin_count);
+        if (res != VK_SUCCESS) goto out;
+    } else {
+        if (!bvh->node_cap) {
+            bvh->nodes = (XenoBvhNode*)bvh_alloc(1, sizeof(*bvh->nodes));
+            if (!bvh->nodes) goto out;
+            bvh->node_cap = 1;
+        }
+        memset(bvh->nodes, 0, sizeof(*bvh->nodes));
+        for (uint32_t s = 0; s < XENO_BVH_WIDTH; ++s) bvh->nodes[0].child[s] = XENO_BVH_EMPTY;
+        bvh->node_count = 1;
+        bvh->stats.nodes = 1;
+        bvh->stats.leaves = 0;
+        bvh->stats.depth = 1;
+    }
+
+    /* Triangles in leaf order, as vertex + edges. */
+    for (uint32_t i = 0; i < n; ++i) {
+        uint32_t id = b.ids[i];
+        /* Last geometry starting at or before id; empty ones are skipped over. */
+        uint32_t lo = 0, hi = count;
+        while (hi - lo > 1u) {
+            uint32_t m = (lo + hi) / 2u;
+            if (firsts[m] <= id) lo = m; else hi = m;
+        }
+        uint32_t prim = id - firsts[lo];
+        float v[3][3];
+        triangle_vertices(&geometries[lo], prim, v);
+        XenoBvhTri* t = &bvh->tris[i];
+        for (int k = 0; k < 3; ++k) {
+            t->v0[k] = v[0][k];
+            t->e1[k] = v[1][k] - v[0][k];
+            t->e2[k] = v[2][k] - v[0][k];
+        }
+        memcpy(&t->v0[3], &prim, sizeof(prim));
+        memcpy(&t->e1[3], &lo, sizeof(lo));
+        t->e2[3] = 0.0f;
+    }
+    bvh->tri_count = n;
+
+    float sah = 0.0f, root_area = box_half_area(&root);
+    for (uint32_t i = 0; n && i < bin_count; ++i) {
+        const BvhBuildNode* bn = &b.nodes[i];
+        float a = box_half_area(&bn->box);
+        sah += bn->count ? a * (float)bn->count * XENO_BVH_COST_INTERSECT : a * XENO_BVH_COST_TRAVERSE;
+    }
+    bvh->stats.triangles = n;
+    bvh->stats.threads = b.threads;
+    bvh->stats.sah_cost = root_area > 0.0f ? sah / root_area : 0.0f;
+    bvh->stats.build_ms = now_ms() - t0;
+    XENO_LOGI("rt_bvh: %u triangles -> %u nodes, depth %u, SAH %.1f, %.1f ms on %u threads",
+              n, bvh->stats.nodes, bvh->stats.depth, bvh->stats.sah_cost, bvh->stats.build_ms, b.threads);
+    res = VK_SUCCESS;
+
+out:
+    free(firsts);
+    free(b.nodes);
+    free(b.ids);
+    free(b.prims);
+    if (res != VK_SUCCESS) XENO_LOGE("rt_bvh: build failed: %d", res);
+    return res;
+}
+
+const XenoBvhNode* xeno_bvh_nodes(const XenoBvh* bvh, uint32_t* count)
+{
+    if (count) *count = bvh ? bvh->node_count : 0u;
+    return bvh ? bvh->nodes : NULL;
+}
+
+const XenoBvhTri* xeno_bvh_triangles(const XenoBvh* bvh, uint32_t* count)
+{
+    if (count) *count = bvh ? bvh->tri_count : 0u;
+    return bvh ? bvh->tris : NULL;
+}
+
+void xeno_bvh_get_stats(const XenoBvh* bvh, XenoBvhStats* out)
+{
+    if (!out) return;
+    memset(out, 0, sizeof(*out));
+    if (bvh) *out = bvh->stats;
+}
@@ -0,0 +1,82 @@
+// src/rt_bvh.h
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <stdint.h>
+
+/*
+  CPU BVH builder for the compute ray-query fallback (rt_bvh.c).
+
+  Used when the device has no hardware ray tracing. Triangles are binned
+  on all three axes at once with 4-wide SIMD (NEON on arm64, SSE2 on x86,
+  scalar otherwise) and split with a 16-bin surface-area heuristic. Large
+  subtrees are handed to worker threads. The binary tree is then collapsed
+  into a 4-wide BVH whose nodes are 128 bytes: the four child boxes in SoA
+  form followed by the child links. Triangles are reordered so every leaf
+  is a contiguous run and stored as vertex + two edges, ready for the
+  intersection test.
+
+  XenoBvhNode and XenoBvhTri are the std430 layouts that
+  assets/shaders/src/rt_bvh.glsl traverses; keep both sides in sync.
+*/
+
+#define XENO_BVH_WIDTH 4u
+#define XENO_BVH_BINS 16u
+#define XENO_BVH_LEAF_MAX 8u
+#define XENO_BVH_MAX_TRIANGLES (1u << 28)
+#define XENO_BVH_GPU_DEPTH 15u    /* deepest tree rt_bvh.glsl traverses without dropping nodes; builds stay within it */
+
+/* child[] encoding: node index, leaf, or unused slot. */
+#define XENO_BVH_LEAF_BIT 0x80000000u
+#define XENO_BVH_EMPTY 0xFFFFFFFFu
+#define XENO_BVH_LEAF(first, count) (XENO_BVH_LEAF_BIT | (((count) - 1u) << 28) | (first))
+#define XENO_BVH_LEAF_FIRST(c) ((c) & 0x0FFFFFFFu)
+#define XENO_BVH_LEAF_COUNT(c) ((((c) >> 28) & 0x7u) + 1u)
+
+typedef struct XenoBvhGeometry {
+    const float* vertices;      /* xyz at vertex_stride bytes apart, world space */
+    uint32_t vertex_stride;
+    uint32_t vertex_count;
+    const uint32_t* indices;    /* 3 per triangle; NULL for a plain triangle list */
+    uint32_t triangle_count;
+} XenoBvhGeometry;
+
+typedef struct XenoBvhNode {
+    float lo_x[4], hi_x[4];
+    float lo_y[4], hi_y[4];
+    float lo_z[4], hi_z[4];
+    uint32_t child[4];
+    uint32_t pad[4];
+} XenoBvhNode;
+
+/* v0[3] holds the triangle index within its geometry, e1[3] the geometry
+   index, both as raw bits. */
+typedef struct XenoBvhTri {
+    float v0[4];
+    float e1[4];
+    float e2[4];
+} XenoBvhTri;
+
+typedef struct XenoBvhStats {
+    uint32_t triangles;         /* after dropping degenerate / non-finite ones */
+    uint32_t nodes;
+    uint32_t leaves;
+    uint32_t depth;             /* of the 4-wide tree */
+    uint32_t threads;
+    float sah_cost;             /* of the binary tree, relative to the root box */
+    double build_ms;
+} XenoBvhStats;
+
+typedef struct XenoBvh XenoBvh;
+
+/* threads 0 uses every online core, up to 8. */
+XenoBvh* xeno_bvh_create(uint32_t threads);
+void xeno_bvh_destroy(XenoBvh* bvh);
+
+/* Replaces the previous tree. Geometry is only read during the call. */
+VkResult xeno_bvh_build(XenoBvh* bvh, const XenoBvhGeometry* geometries, uint32_t count);
+
+/* Valid until the next build. Node 0 is the root. */
+const XenoBvhNode* xeno_bvh_nodes(const XenoBvh* bvh, uint32_t* count);
+const XenoBvhTri* xeno_bvh_triangles(const XenoBvh* bvh, uint32_t* count);
+void xeno_bvh_get_stats(const XenoBvh* bvh, XenoBvhStats* out);
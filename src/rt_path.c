@@ -7,11 +7,31 @@
 
 #include "rt_path.h"
 #include "xeno_log.h"
+#include "xeno_dispatch.h"
+#include "xeno_cmd.h"
+#include "xeno_mem.h"
+#include "xeno_upload.h"
+#include "xeno_trace.h"
+#include "rt_bvh.h"
+#include "rt_sbt.h"
+
+extern const uint32_t rt_bvh_query_shader_spv[];
+extern const size_t rt_bvh_query_shader_spv_len;
+
+/* rt_bvh_query.comp: local_size_x, and the x group count every device supports. */
+#define XENO_RT_QUERY_GROUP 64u
+#define XENO_RT_QUERY_MAX_GROUPS_X 65535u
+
+typedef struct XenoRtQueryPush {
+    uint32_t count;
+    uint32_t flags;
+} XenoRtQueryPush;
 
 static VkDeviceAddress get_buffer_device_address_internal(VkDevice device, VkBuffer buffer)
 {
     if (device == VK_NULL_HANDLE || buffer == VK_NULL_HANDLE) return (VkDeviceAddress)0;
-    PFN_vkGetBufferDeviceAddress fn = (PFN_vkGetBufferDeviceAddress)vkGetDeviceProcAddr(device, "vkGetBufferDeviceAddress");
+    const XenoDeviceDispatch *d = xeno_device_dispatch(device);
+    PFN_vkGetBufferDeviceAddress fn = d ? d->GetBufferDeviceAddress : NULL;
     if (!fn) {
         XENO_LOGD("rt_path: vkGetBufferDeviceAddress not available");
         return (VkDeviceAddress)0;
@@ -28,111 +48,363 @@ static VkDeviceAddress get_buffer_device_address_internal(VkDevice device, VkBuf
 VkResult rt_create_buffer_with_memory(VkDevice device, VkPhysicalDevice physical,
                                       VkDeviceSize size, VkBufferUsageFlags usage,
                                       VkMemoryPropertyFlags properties,
-                                      VkBuffer *outBuffer, VkDeviceMemory *outMemory)
+                                      VkBuffer *outBuffer, XenoMemAlloc *outAlloc)
 {
-    if (!device || !outBuffer || !outMemory) return VK_ERROR_INITIALIZATION_FAILED;
+    (void)physical;
+    if (!device || !outBuffer || !outAlloc) return VK_ERROR_INITIALIZATION_FAILED;
 
-    VkBufferCreateInfo bci = {
-        .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
-        .pNext = NULL,
-        .flags = 0,
-        .size = size,
-        .usage = usage,
-        .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
-        .queueFamilyIndexCount = 0,
-        .pQueueFamilyIndices = NULL
-    };
+    XenoMemAllocator *mem = xeno_mem_allocator(device);
+    if (!mem) {
+        XENO_LOGE("rt_path: no allocator for device %p", (void*)device);
+        return VK_ERROR_INITIALIZATION_FAILED;
+    }
 
-    VkResult res = vkCreateBuffer(device, &bci, NULL, outBuffer);
+    VkResult res = xeno_mem_create_buffer(mem, size, usage, properties, 0, outBuffer, outAlloc);
     if (res != VK_SUCCESS) {
-        XENO_LOGE("rt_path: vkCreateBuffer failed: %d", res);
-        return res;
+        XENO_LOGE("rt_path: buffer of %llu bytes failed: %d", (unsigned long long)size, res);
     }
+    return res;
+}
 
-    VkMemoryRequirements mr;
-    vkGetBufferMemoryRequirements(device, *outBuffer, &mr);
-
-    VkPhysicalDeviceMemoryProperties memProps;
-    vkGetPhysicalDeviceMemoryProperties(physical, &memProps);
+void rt_destroy_buffer_with_memory(VkDevice device, VkBuffer buffer, XenoMemAlloc *alloc)
+{
+    if (device == VK_NULL_HANDLE) return;
+    xeno_mem_destroy_buffer(xeno_mem_allocator(device), buffer, alloc);
+}
 
-    uint32_t memIndex = UINT32_MAX;
-    for (uint32_t i = 0; i < memProps.memoryTypeCount; ++i) {
-        const uint32_t mask = 1u << i;
-        if ((mr.memoryTypeBits & mask) &&
-            ((memProps.memoryTypes[i].propertyFlags & properties) == properties)) {
-            memIndex = i;
-            break;
-        }
+VkResult rt_upload_to_buffer(VkDevice device, XenoUploader *up, VkBuffer buffer, const XenoMemAlloc *alloc,
+                             VkDeviceSize offset, const void *data, VkDeviceSize size)
+{
+    if (!device || !alloc || !data || size == 0) return VK_ERROR_INITIALIZATION_FAILED;
+    if (offset + size > alloc->size) {
+        XENO_LOGE("rt_path: upload of %llu bytes at %llu overruns the buffer",
+                  (unsigned long long)size, (unsigned long long)offset);
+        return VK_ERROR_INITIALIZATION_FAILED;
     }
 
-    if (memIndex == UINT32_MAX) {
-        XENO_LOGE("rt_path: no suitable memory type found");
-        vkDestroyBuffer(device, *outBuffer, NULL);
+    /* Host-visible allocations stay mapped; only non-coherent ones need a flush. */
+    if (alloc->mapped) {
+        memcpy((char*)alloc->mapped + offset, data, (size_t)size);
+        return xeno_mem_flush(xeno_mem_allocator(device), alloc, offset, size);
+    }
+    if (!up) {
+        XENO_LOGE("rt_path: device-local upload without an uploader");
         return VK_ERROR_MEMORY_MAP_FAILED;
     }
+    return xeno_upload_write(up, buffer, offset, data, size);
+}
 
-    VkMemoryAllocateInfo mai = {
-        .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
-        .pNext = NULL,
-        .allocationSize = mr.size,
-        .memoryTypeIndex = memIndex
+void rt_log_buffer_address(VkDevice device, VkBuffer buffer)
+{
+    VkDeviceAddress addr = get_buffer_device_address_internal(device, buffer);
+    XENO_LOGD("rt_path: buffer %p device address = 0x%016llx", (void*)buffer, (unsigned long long)addr);
+}
+
+static VkResult create_query_pipeline(const XenoDeviceDispatch* d, XenoRT* rt)
+{
+    VkDescriptorSetLayoutBinding b[2] = {
+        { .binding = 0, .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, .descriptorCount = 1,
+          .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT },
+        { .binding = 1, .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, .descriptorCount = 1,
+          .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT },
+    };
+    VkDescriptorSetLayoutCreateInfo dci = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO, .bindingCount = 2, .pBindings = b,
     };
+    /* Both sets hold two storage buffers: nodes/triangles and rays/hits. */
+    VkResult r = d->CreateDescriptorSetLayout(d->device, &dci, NULL, &rt->queryBvhLayout);
+    if (r != VK_SUCCESS) return r;
+    r = d->CreateDescriptorSetLayout(d->device, &dci, NULL, &rt->queryRayLayout);
+    if (r != VK_SUCCESS) return r;
 
-    res = vkAllocateMemory(device, &mai, NULL, outMemory);
-    if (res != VK_SUCCESS) {
-        XENO_LOGE("rt_path: vkAllocateMemory failed: %d", res);
-        vkDestroyBuffer(device, *outBuffer, NULL);
-        return res;
+    VkDescriptorSetLayout layouts[2] = { rt->queryBvhLayout, rt->queryRayLayout };
+    VkPushConstantRange pcr = { VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(XenoRtQueryPush) };
+    VkPipelineLayoutCreateInfo lci = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+        .setLayoutCount = 2, .pSetLayouts = layouts,
+        .pushConstantRangeCount = 1, .pPushConstantRanges = &pcr,
+    };
+    r = d->CreatePipelineLayout(d->device, &lci, NULL, &rt->queryLayout);
+    if (r != VK_SUCCESS) return r;
+
+    VkDescriptorPoolSize size = { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2 };
+    VkDescriptorPoolCreateInfo pci = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO, .maxSets = 1, .poolSizeCount = 1, .pPoolSizes = &size,
+    };
+    r = d->CreateDescriptorPool(d->device, &pci, NULL, &rt->queryPool);
+    if (r != VK_SUCCESS) return r;
+    VkDescriptorSetAllocateInfo dsai = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+        .descriptorPool = rt->queryPool, .descriptorSetCount = 1, .pSetLayouts = &rt->queryBvhLayout,
+    };
+    r = d->AllocateDescriptorSets(d->device, &dsai, &rt->queryBvhSet);
+    if (r != VK_SUCCESS) return r;
+
+    if (rt_bvh_query_shader_spv_len == 0) return VK_ERROR_INITIALIZATION_FAILED;
+    VkShaderModuleCreateInfo smci = {
+        .sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
+        .codeSize = rt_bvh_query_shader_spv_len, .pCode = rt_bvh_query_shader_spv,
+    };
+    VkShaderModule module;
+    r = d->CreateShaderModule(d->device, &smci, NULL, &module);
+    if (r != VK_SUCCESS) return r;
+    VkComputePipelineCreateInfo cpci = {
+        .sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+        .stage = { .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+                   .stage = VK_SHADER_STAGE_COMPUTE_BIT, .module = module, .pName = "main" },
+        .layout = rt->queryLayout,
+    };
+    r = d->CreateComputePipelines(d->device, VK_NULL_HANDLE, 1, &cpci, NULL, &rt->queryPipeline);
+    d->DestroyShaderModule(d->device, module, NULL);
+    return r;
+}
+
+VkResult xeno_rt_init(VkDevice device, VkPhysicalDevice phys, VkQueue queue, uint32_t queue_family, XenoRT* out)
+{
+    (void)phys;
+    if (!device || !queue || !out) return VK_ERROR_INITIALIZATION_FAILED;
+    memset(out, 0, sizeof(*out));
+    out->queue = queue;
+    out->upload = xeno_upload_create(device, queue_family);
+    if (!out->upload) return VK_ERROR_INITIALIZATION_FAILED;
+    out->accel = xeno_accel_create(device, queue_family);
+    if (out->accel) {
+        out->ready = 1;
+        XENO_LOGI("rt_path: hardware acceleration structures enabled");
+        return VK_SUCCESS;
     }
 
-    res = vkBindBufferMemory(device, *outBuffer, *outMemory, 0);
+    const XenoDeviceDispatch *d = xeno_device_dispatch(device);
+    out->bvh = d ? xeno_bvh_create(0) : NULL;
+    VkResult res = out->bvh ? create_query_pipeline(d, out) : VK_ERROR_OUT_OF_HOST_MEMORY;
     if (res != VK_SUCCESS) {
-        XENO_LOGE("rt_path: vkBindBufferMemory failed: %d", res);
-        vkFreeMemory(device, *outMemory, NULL);
-        vkDestroyBuffer(device, *outBuffer, NULL);
-        return res;
+        XENO_LOGW("rt_path: compute ray-query fallback unavailable (%d)", res);
+        xeno_rt_destroy(device, out);
+        return VK_ERROR_FEATURE_NOT_PRESENT;
     }
+    out->fallback = 1;
+    XENO_LOGI("rt_path: no hardware ray tracing, using compute ray queries");
+    return VK_SUCCESS;
+}
 
+void xeno_rt_destroy(VkDevice device, XenoRT* rt)
+{
+    if (!device || !rt) return;
+    /* Releases every structure, including the TLAS. */
+    xeno_accel_destroy(rt->accel);
+    /* Waits for SBT and BVH uploads still in flight. */
+    xeno_upload_destroy(rt->upload);
+    xeno_sbt_destroy(rt->sbt);
+    xeno_bvh_destroy(rt->bvh);
+    rt_destroy_buffer_with_memory(device, rt->instanceBuffer, &rt->instanceAlloc);
+    free(rt->instances);
+    rt_destroy_buffer_with_memory(device, rt->bvhNodes, &rt->bvhNodesAlloc);
+    rt_destroy_buffer_with_memory(device, rt->bvhTris, &rt->bvhTrisAlloc);
+    const XenoDeviceDispatch *d = xeno_device_dispatch(device);
+    if (d) {
+        if (rt->queryPipeline) d->DestroyPipeline(device, rt->queryPipeline, NULL);
+        if (rt->queryPool) d->DestroyDescriptorPool(device, rt->queryPool, NULL);
+        if (rt->queryLayout) d->DestroyPipelineLayout(device, rt->queryLayout, NULL);
+        if (rt->queryRayLayout) d->DestroyDescriptorSetLayout(device, rt->queryRayLayout, NULL);
+        if (rt->queryBvhLayout) d->DestroyDescriptorSetLayout(device, rt->queryBvhLayout, NULL);
+    }
+    memset(rt, 0, sizeof(*rt));
+}
+
+VkResult xeno_rt_set_pipeline(VkDevice device, XenoRT* rt, VkPipeline pipeline, VkPipelineLayout layout,
+                              uint32_t group_count, const XenoSbtDesc* desc)
+{
+    if (!device || !rt || !rt->ready) return VK_ERROR_FEATURE_NOT_PRESENT;
+    XenoSbt *sbt = xeno_sbt_create(device, pipeline, group_count, desc);
+    if (!sbt) return VK_ERROR_INITIALIZATION_FAILED;
+    xeno_sbt_destroy(rt->sbt);
+    rt->sbt = sbt;
+    rt->rtPipeline = pipeline;
+    rt->rtLayout = layout;
     return VK_SUCCESS;
 }
 
-void rt_destroy_buffer_with_memory(VkDevice device, VkBuffer buffer, VkDeviceMemory memory)
+/* Grows to 1.5x the request so a slightly larger scene does not reallocate. */
+static VkResult ensure_buffer(VkDevice device, VkBufferUsageFlags usage, VkBuffer *buffer, XenoMemAlloc *alloc,
+                              VkDeviceSize *capacity, VkDeviceSize size, int *recreated)
 {
-    if (device == VK_NULL_HANDLE) return;
-    if (buffer != VK_NULL_HANDLE) vkDestroyBuffer(device, buffer, NULL);
-    if (memory != VK_NULL_HANDLE) vkFreeMemory(device, memory, NULL);
+    if (*buffer && *capacity >= size) return VK_SUCCESS;
+    rt_destroy_buffer_with_memory(device, *buffer, alloc);
+    *buffer = VK_NULL_HANDLE;
+    *capacity = 0;
+    *recreated = 1;
+    VkDeviceSize want = size + size / 2u;
+    VkResult res = rt_create_buffer_with_memory(device, VK_NULL_HANDLE, want, usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, buffer, alloc);
+    if (res == VK_SUCCESS) *capacity = want;
+    return res;
 }
 
-VkResult rt_upload_to_buffer(VkDevice device, VkDeviceMemory memory, VkDeviceSize offset, const void *data, VkDeviceSize size, VkPhysicalDevice physical)
+/* Through the uploader even when the buffer is mapped: a TLAS build still
+   in flight may be reading it. */
+static VkResult write_instances(const XenoDeviceDispatch* d, XenoRT* rt)
 {
-    (void)physical;
-    if (!device || memory == VK_NULL_HANDLE || !data || size == 0) return VK_ERROR_INITIALIZATION_FAILED;
+    VkDeviceSize bytes = (VkDeviceSize)rt->instanceCount * sizeof(VkAccelerationStructureInstanceKHR);
+    VkAccelerationStructureInstanceKHR* out = NULL;
+    if (bytes) {
+        out = (VkAccelerationStructureInstanceKHR*)xeno_upload_map(rt->upload, rt->instanceBuffer, 0, bytes);
+        if (!out) return VK_ERROR_OUT_OF_DEVICE_MEMORY;
+    }
+    for (uint32_t i = 0; i < rt->instanceCount; ++i) {
+        const XenoRtInstance* in = &rt->instances[i];
+        out[i] = (VkAccelerationStructureInstanceKHR){
+            .transform = in->transform,
+            .instanceCustomIndex = in->custom_index & 0xffffffu,
+            .mask = in->mask & 0xffu,
+            .instanceShaderBindingTableRecordOffset = in->sbt_offset & 0xffffffu,
+            .flags = in->flags & 0xffu,
+            .accelerationStructureReference = xeno_accel_address(in->blas),
+        };
+    }
+    VkDeviceAddress address = get_buffer_device_address_internal(d->device, rt->instanceBuffer);
+    return xeno_accel_update_tlas(rt->accel, rt->tlas, address, rt->instanceCount);
+}
 
-    void *mapped = NULL;
-    VkResult res = vkMapMemory(device, memory, offset, size, 0, &mapped);
-    if (res != VK_SUCCESS) {
-        XENO_LOGE("rt_path: vkMapMemory failed: %d", res);
-        return res;
+VkResult xeno_rt_set_instances(VkDevice device, XenoRT* rt, const XenoRtInstance* instances, uint32_t count)
+{
+    if (!device || !rt || !rt->ready || (count && !instances)) return VK_ERROR_FEATURE_NOT_PRESENT;
+    if (count > rt->instanceCap) {
+        XenoRtInstance* list = (XenoRtInstance*)realloc(rt->instances, sizeof(*list) * count);
+        if (!list) return VK_ERROR_OUT_OF_HOST_MEMORY;
+        rt->instances = list;
+        rt->instanceCap = count;
     }
+    if (count) memcpy(rt->instances, instances, sizeof(*instances) * count);
+    rt->instanceCount = count;
+    rt->instancesDirty = 1;
 
-    memcpy(mapped, data, (size_t)size);
-    vkUnmapMemory(device, memory);
+    /* Outgrown: builds in flight still read the old instance buffer, the
+       old TLAS storage is deferred by the accel itself. */
+    VkDeviceSize bytes = (VkDeviceSize)(count ? count : 1u) * sizeof(VkAccelerationStructureInstanceKHR);
+    if (rt->tlas && bytes <= rt->instanceSize) return VK_SUCCESS;
+    if (rt->instanceBuffer) xeno_accel_wait(rt->accel);
+    xeno_accel_release(rt->accel, rt->tlas);
+    rt->tlas = NULL;
+    int recreated = 0;
+    VkResult res = ensure_buffer(device,
+                                 VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR |
+                                     VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+                                 &rt->instanceBuffer, &rt->instanceAlloc, &rt->instanceSize, bytes, &recreated);
+    if (res != VK_SUCCESS) return res;
+    uint32_t max = (uint32_t)(rt->instanceSize / sizeof(VkAccelerationStructureInstanceKHR));
+    rt->tlas = xeno_accel_tlas(rt->accel, get_buffer_device_address_internal(device, rt->instanceBuffer), max,
+                               XENO_ACCEL_DYNAMIC);
+    return rt->tlas ? VK_SUCCESS : VK_ERROR_OUT_OF_DEVICE_MEMORY;
+}
+
+VkResult xeno_rt_dispatch(VkCommandBuffer cmd, XenoRT* rt, uint32_t width, uint32_t height)
+{
+    if (!cmd || !rt || !rt->ready) return VK_ERROR_INITIALIZATION_FAILED;
+    const XenoDeviceDispatch *d = xeno_device_dispatch(cmd);
+    if (!d || !d->CmdTraceRaysKHR || !rt->rtPipeline || !rt->sbt) {
+        XENO_LOGW_RL(1, "rt_path: dispatch without pipeline or shader binding table");
+        return VK_ERROR_INITIALIZATION_FAILED;
+    }
 
+    /* BLASes due for compaction move first, so the instance data written
+       below has the addresses the TLAS build will see. */
+    uint32_t generation = xeno_accel_prepare(rt->accel);
+    VkResult res = VK_SUCCESS;
+    if (rt->tlas && (rt->instancesDirty || generation != rt->instanceGeneration)) {
+        res = write_instances(d, rt);
+        if (res != VK_SUCCESS) return res;
+        rt->instanceGeneration = generation;
+        rt->instancesDirty = 0;
+    }
+
+    /* Changed SBT records, instance data and pending builds are submitted
+       ahead of the command buffer being recorded. */
+    res = xeno_sbt_upload(rt->sbt, rt->upload);
+    if (res == VK_SUCCESS) res = xeno_upload_flush(rt->upload, rt->queue);
+    if (res == VK_SUCCESS) res = xeno_accel_flush(rt->accel, rt->queue);
+    if (res != VK_SUCCESS) return res;
+    /* Changes went to another copy of the table. */
+    xeno_sbt_regions(rt->sbt, &rt->rgenRegion, &rt->missRegion, &rt->hitRegion, &rt->callRegion);
+
+    xeno_cmd_work(d, cmd, VK_PIPELINE_STAGE_2_RAY_TRACING_SHADER_BIT_KHR, NULL, 0);
+    d->CmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR, rt->rtPipeline);
+    d->CmdTraceRaysKHR(cmd, &rt->rgenRegion, &rt->missRegion, &rt->hitRegion, &rt->callRegion, width, height, 1);
     return VK_SUCCESS;
 }
 
-size_t rt_guess_staging_size(VkDeviceSize requested)
+VkResult xeno_rt_build_scene(VkDevice device, XenoRT* rt, const XenoBvhGeometry* geometries, uint32_t count)
 {
-    const size_t MIN = 64u * 1024u;
-    const size_t MAX = 64u * 1024u * 1024u;
-    size_t s = (size_t)requested;
-    if (s < MIN) s = MIN;
-    if (s > MAX) s = MAX;
-    return s;
+    if (!device || !rt || !rt->fallback) return VK_ERROR_FEATURE_NOT_PRESENT;
+    const XenoDeviceDispatch *d = xeno_device_dispatch(device);
+    if (!d) return VK_ERROR_INITIALIZATION_FAILED;
+    XENO_TRACE_SCOPE("rt.build_scene");
+
+    VkResult res = xeno_bvh_build(rt->bvh, geometries, count);
+    if (res != VK_SUCCESS) return res;
+    uint32_t node_count, tri_count;
+    const XenoBvhNode *nodes = xeno_bvh_nodes(rt->bvh, &node_count);
+    const XenoBvhTri *tris = xeno_bvh_triangles(rt->bvh, &tri_count);
+    VkDeviceSize node_bytes = (VkDeviceSize)node_count * sizeof(XenoBvhNode);
+    VkDeviceSize tri_bytes = (VkDeviceSize)(tri_count ? tri_count : 1u) * sizeof(XenoBvhTri);
+
+    /* Writes still queued for buffers about to be replaced must land first. */
+    if (node_bytes > rt->bvhNodesSize || tri_bytes > rt->bvhTrisSize) {
+        res = xeno_upload_flush(rt->upload, rt->queue);
+        if (res != VK_SUCCESS) return res;
+        xeno_upload_wait(rt->upload);
+    }
+    int recreated = 0;
+    res = ensure_buffer(device, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, &rt->bvhNodes, &rt->bvhNodesAlloc,
+                        &rt->bvhNodesSize, node_bytes, &recreated);
+    if (res == VK_SUCCESS)
+        res = ensure_buffer(device, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, &rt->bvhTris, &rt->bvhTrisAlloc,
+                            &rt->bvhTrisSize, tri_bytes, &recreated);
+    if (res != VK_SUCCESS) return res;
+
+    if (recreated) {
+        VkDescriptorBufferInfo infos[2] = {
+            { rt->bvhNodes, 0, VK_WHOLE_SIZE },
+            { rt->bvhTris, 0, VK_WHOLE_SIZE },
+        };
+        VkWriteDescriptorSet w[2];
+        for (uint32_t i = 0; i < 2; ++i) {
+            w[i] = (VkWriteDescriptorSet){
+                .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET, .dstSet = rt->queryBvhSet, .dstBinding = i,
+                .descriptorCount = 1, .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, .pBufferInfo = &infos[i],
+            };
+        }
+        d->UpdateDescriptorSets(device, 2, w, 0, NULL);
+    }
+
+    res = rt_upload_to_buffer(device, rt->upload, rt->bvhNodes, &rt->bvhNodesAlloc, 0, nodes, node_bytes);
+    if (res == VK_SUCCESS && tri_count)
+        res = rt_upload_to_buffer(device, rt->upload, rt->bvhTris, &rt->bvhTrisAlloc, 0, tris,
+                                  (VkDeviceSize)tri_count * sizeof(XenoBvhTri));
+    return res;
 }
 
-void rt_log_buffer_address(VkDevice device, VkBuffer buffer)
+VkResult xeno_rt_query(VkCommandBuffer cmd, XenoRT* rt, VkDescriptorSet rays, uint32_t count, uint32_t flags)
 {
-    VkDeviceAddress addr = get_buffer_device_address_internal(device, buffer);
-    XENO_LOGD("rt_path: buffer %p device address = 0x%016llx", (void*)buffer, (unsigned long long)addr);
+    if (!cmd || !rt || !rt->fallback || !rays) return VK_ERROR_INITIALIZATION_FAILED;
+    const XenoDeviceDispatch *d = xeno_device_dispatch(cmd);
+    if (!d || !rt->bvhNodes) {
+        XENO_LOGW_RL(1, "rt_path: ray query before a scene was built");
+        return VK_ERROR_INITIALIZATION_FAILED;
+    }
+    if (!count) return VK_SUCCESS;
+
+    /* The BVH upload is submitted ahead of the command buffer being recorded. */
+    VkResult res = xeno_upload_flush(rt->upload, rt->queue);
+    if (res != VK_SUCCESS) return res;
+
+    VkDescriptorSet sets[2] = { rt->queryBvhSet, rays };
+    XenoRtQueryPush pc = { count, flags };
+    uint32_t groups = (count + XENO_RT_QUERY_GROUP - 1u) / XENO_RT_QUERY_GROUP;
+    uint32_t gx = groups < XENO_RT_QUERY_MAX_GROUPS_X ? groups : XENO_RT_QUERY_MAX_GROUPS_X;
+    d->CmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, rt->queryPipeline);
+    d->CmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, rt->queryLayout, 0, 2, sets, 0, NULL);
+    d->CmdPushConstants(cmd, rt->queryLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(pc), &pc);
+    xeno_cmd_work(d, cmd, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, NULL, 0);
+    d->CmdDispatch(cmd, gx, (groups + gx - 1u) / gx, 1);
+    return VK_SUCCESS;
 }
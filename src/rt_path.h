@@ -2,28 +2,110 @@
 #define RT_PATH_H
 
 #include <vulkan/vulkan.h>
+#include "xeno_mem.h"
+#include "xeno_upload.h"
+#include "rt_accel.h"
+#include "rt_bvh.h"
+#include "rt_sbt.h"
+
+/* Ray-query fallback (xeno_rt_query): std430 layouts of rt_bvh_query.comp. */
+typedef struct XenoRtRay {
+    float origin[3];
+    float tmin;
+    float dir[3];
+    float tmax;
+} XenoRtRay;
+
+typedef struct XenoRtHit {
+    float t;                    /* tmax on a miss */
+    uint32_t prim;              /* XENO_BVH_EMPTY on a miss */
+    uint32_t geometry;
+    uint32_t bary;              /* unorm16x2 */
+} XenoRtHit;
+
+#define XENO_RT_QUERY_ANY_HIT 0x1u   /* shadows, AO: stop at the first hit */
+
+/* One TLAS instance (xeno_rt_set_instances); the BLAS is referenced by
+   handle and its device address written when the TLAS is built. */
+typedef struct XenoRtInstance {
+    XenoAS* blas;               /* from xeno_accel_blas(rt->accel, ...) */
+    VkTransformMatrixKHR transform;
+    uint32_t custom_index;      /* 24 bits */
+    uint32_t mask;              /* 8 bits */
+    uint32_t sbt_offset;        /* 24 bits */
+    VkGeometryInstanceFlagsKHR flags;
+} XenoRtInstance;
 
 typedef struct {
     VkPipeline rtPipeline;
     VkPipelineLayout rtLayout;
 
-    VkBuffer sbtBuffer;
-    VkDeviceMemory sbtMemory;
+    XenoSbt* sbt;               /* records for rtPipeline; hit records can change per frame */
     VkStridedDeviceAddressRegionKHR rgenRegion;
     VkStridedDeviceAddressRegionKHR missRegion;
     VkStridedDeviceAddressRegionKHR hitRegion;
     VkStridedDeviceAddressRegionKHR callRegion;
 
-    VkAccelerationStructureKHR tlas;
-    VkAccelerationStructureKHR blas;
-    VkBuffer asScratch;
-    VkDeviceMemory asScratchMem;
+    XenoAccel* accel;           /* BLAS/TLAS builds, shared scratch, compaction */
+    XenoAS* tlas;               /* built from `instances` */
+    XenoRtInstance* instances;
+    uint32_t instanceCount;
+    uint32_t instanceCap;
+    VkBuffer instanceBuffer;    /* VkAccelerationStructureInstanceKHR, rewritten before builds */
+    XenoMemAlloc instanceAlloc;
+    VkDeviceSize instanceSize;
+    uint32_t instanceGeneration;    /* xeno_accel_generation the buffer was written for */
+    int instancesDirty;
+    VkQueue queue;              /* builds and uploads are submitted here */
+    XenoUploader* upload;       /* SBT records, fallback BVH */
 
-    int ready;
+    int ready;                  /* hardware acceleration structures available */
+
+    /* Compute fallback when `ready` is 0: a CPU-built BVH (rt_bvh.c) in two
+       storage buffers, traversed by rt_bvh_query.comp. */
+    XenoBvh* bvh;
+    VkBuffer bvhNodes;
+    XenoMemAlloc bvhNodesAlloc;
+    VkDeviceSize bvhNodesSize;
+    VkBuffer bvhTris;
+    XenoMemAlloc bvhTrisAlloc;
+    VkDeviceSize bvhTrisSize;
+    VkDescriptorSetLayout queryBvhLayout;   /* set 0: nodes, triangles */
+    VkDescriptorSetLayout queryRayLayout;   /* set 1: rays, hits; sets come from the caller */
+    VkPipelineLayout queryLayout;
+    VkPipeline queryPipeline;
+    VkDescriptorPool queryPool;
+    VkDescriptorSet queryBvhSet;
+    int fallback;
 } XenoRT;
 
-VkResult xeno_rt_init(VkDevice device, VkPhysicalDevice phys, XenoRT* out);
+/* queue/queue_family: where acceleration-structure builds and BVH uploads
+   run. Sets up the compute fallback when the device has no hardware RT;
+   fails only if neither path is available. */
+VkResult xeno_rt_init(VkDevice device, VkPhysicalDevice phys, VkQueue queue, uint32_t queue_family, XenoRT* out);
 void     xeno_rt_destroy(VkDevice device, XenoRT* rt);
 VkResult xeno_rt_dispatch(VkCommandBuffer cmd, XenoRT* rt, uint32_t width, uint32_t height);
 
+/* Hardware only: makes `pipeline` the one xeno_rt_dispatch traces with and
+   builds its shader binding table. Traces recorded with the previous
+   pipeline must have completed. */
+VkResult xeno_rt_set_pipeline(VkDevice device, XenoRT* rt, VkPipeline pipeline, VkPipelineLayout layout,
+                              uint32_t group_count, const XenoSbtDesc* desc);
+
+/* Hardware only: the instances rt->tlas is built from, copied. Their
+   BLAS addresses are resolved at each xeno_rt_dispatch, after any
+   compaction or rebuild that moved a BLAS, so the TLAS never points at
+   retired storage; BLASes must stay alive while listed. rt->tlas is
+   replaced when count outgrows it: take xeno_accel_handle(rt->tlas) for
+   descriptors after the call. */
+VkResult xeno_rt_set_instances(VkDevice device, XenoRT* rt, const XenoRtInstance* instances, uint32_t count);
+
+/* Fallback only: builds the scene BVH on the CPU and queues its upload.
+   Queries recorded against the previous scene must have completed. */
+VkResult xeno_rt_build_scene(VkDevice device, XenoRT* rt, const XenoBvhGeometry* geometries, uint32_t count);
+/* Fallback only: one thread per XenoRtRay in `rays`, a set allocated with
+   queryRayLayout (binding 0 rays, binding 1 XenoRtHit results). The caller
+   adds the barrier between this dispatch and whatever reads the hits. */
+VkResult xeno_rt_query(VkCommandBuffer cmd, XenoRT* rt, VkDescriptorSet rays, uint32_t count, uint32_t flags);
+
 #endif
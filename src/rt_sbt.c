@@ -0,0 +1,356 @@
+// src/rt_sbt.c
+#include "rt_sbt.h"
+#include "xeno_dispatch.h"
+#include "xeno_mem.h"
+#include "xeno_log.h"
+#include "xeno_trace.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/* Copies of the table in the buffer; each upload with changes writes the
+   next one, so traces still reading the others see whole records. */
+#define XENO_SBT_COPIES 4u
+
+typedef struct XenoSbtRetired {
+    VkBuffer buffer;
+    XenoMemAlloc alloc;
+} XenoSbtRetired;
+
+struct XenoSbt {
+    XenoDeviceDispatch* d;
+    XenoMemAllocator* mem;
+    uint32_t handle_size;
+    uint32_t handle_align;
+    uint32_t base_align;
+    uint32_t group_count;
+    uint8_t* handles;               /* group_count * handle_size */
+
+    uint32_t data_size[XENO_SBT_REGIONS];
+    uint32_t stride[XENO_SBT_REGIONS];
+    uint32_t count[XENO_SBT_REGIONS];
+    uint32_t capacity[XENO_SBT_REGIONS];
+    VkDeviceSize offset[XENO_SBT_REGIONS];
+
+    /* CPU copy; slot i of region r is at offset[r] + i * stride[r]. */
+    uint8_t* table;
+    VkDeviceSize table_size;
+    uint8_t* dirty[XENO_SBT_REGIONS];
+    uint32_t dirty_count;
+    int full_upload;                /* buffer has to be (re)created */
+    uint32_t* stamp[XENO_SBT_REGIONS];      /* upload that last changed each record */
+    uint32_t serial;                        /* uploads with changes so far */
+    uint32_t copy_serial[XENO_SBT_COPIES];  /* upload each copy is current for */
+    uint32_t cur;                           /* copy the regions point at */
+
+    VkBuffer buffer;                /* XENO_SBT_COPIES tables of table_size */
+    XenoMemAlloc alloc;
+    VkDeviceSize buffer_offset;     /* first table, aligned to base_align */
+    VkDeviceAddress address;        /* of the first table */
+    XenoSbtRetired* retired;
+    uint32_t retired_count;
+
+    XenoSbtStats stats;
+};
+
+static VkDeviceSize align_up(VkDeviceSize v, VkDeviceSize a)
+{
+    return (v + a - 1u) / a * a;
+}
+
+/* Raygen, miss and callable first; hit last so it can grow in place. */
+static void layout(XenoSbt* s)
+{
+    static const XenoSbtRegion order[XENO_SBT_REGIONS] = {
+        XENO_SBT_RAYGEN, XENO_SBT_MISS, XENO_SBT_CALLABLE, XENO_SBT_HIT,
+    };
+    VkDeviceSize off = 0;
+    for (uint32_t i = 0; i < XENO_SBT_REGIONS; ++i) {
+        XenoSbtRegion r = order[i];
+        s->offset[r] = off;
+        off = align_up(off + (VkDeviceSize)s->stride[r] * s->capacity[r], s->base_align);
+    }
+    s->table_size = off;
+}
+
+static void write_record(XenoSbt* s, XenoSbtRegion r, uint32_t index, const XenoSbtRecord* rec)
+{
+    uint8_t* dst = s->table + s->offset[r] + (VkDeviceSize)index * s->stride[r];
+    memcpy(dst, s->handles + (size_t)rec->group * s->handle_size, s->handle_size);
+    uint32_t n = rec->data ? rec->data_size : 0u;
+    if (n) memcpy(dst + s->handle_size, rec->data, n);
+    memset(dst + s->handle_size + n, 0, s->stride[r] - s->handle_size - n);
+    if (!s->dirty[r][index]) {
+        s->dirty[r][index] = 1;
+        s->dirty_count++;
+    }
+}
+
+static int valid_record(const XenoSbt* s, XenoSbtRegion r, const XenoSbtRecord* rec)
+{
+    if (rec->group >= s->group_count) {
+        XENO_LOGE("sbt: group %u out of range (%u groups)", rec->group, s->group_count);
+        return 0;
+    }
+    if (rec->data && rec->data_size > s->data_size[r]) {
+        XENO_LOGE("sbt: %u bytes of record data, region %d reserves %u", rec->data_size, (int)r, s->data_size[r]);
+        return 0;
+    }
+    return 1;
+}
+
+XenoSbt* xeno_sbt_create(VkDevice device, VkPipeline pipeline, uint32_t group_count, const XenoSbtDesc* desc)
+{
+    XenoDeviceDispatch* d = xeno_device_dispatch(device);
+    XenoMemAllocator* mem = xeno_mem_allocator(device);
+    if (!d || !mem || !d->instance || !d->GetRayTracingShaderGroupHandlesKHR || !d->GetBufferDeviceAddress) {
+        XENO_LOGI("sbt: VK_KHR_ray_tracing_pipeline not enabled on device %p", (void*)device);
+        return NULL;
+    }
+    if (!pipeline || !group_count || !desc || desc->counts[XENO_SBT_RAYGEN] != 1u) {
+        XENO_LOGE("sbt: a table needs a pipeline and exactly one raygen record");
+        return NULL;
+    }
+
+    VkPhysicalDeviceRayTracingPipelinePropertiesKHR rtp = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_RAY_TRACING_PIPELINE_PROPERTIES_KHR,
+    };
+    VkPhysicalDeviceProperties2 p2 = { .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2, .pNext = &rtp };
+    d->instance->GetPhysicalDeviceProperties2(d->physical, &p2);
+    if (!rtp.shaderGroupHandleSize) return NULL;
+
+    XenoSbt* s = (XenoSbt*)calloc(1, sizeof(*s));
+    if (!s) return NULL;
+    s->d = d;
+    s->mem = mem;
+    s->handle_size = rtp.shaderGroupHandleSize;
+    s->handle_align = rtp.shaderGroupHandleAlignment ? rtp.shaderGroupHandleAlignment : rtp.shaderGroupHandleSize;
+    s->base_align = rtp.shaderGroupBaseAlignment ? rtp.shaderGroupBaseAlignment : 64u;
+    s->group_count = group_count;
+    s->handles = (uint8_t*)malloc((size_t)group_count * s->handle_size);
+    VkResult r = s->handles ? VK_SUCCESS : VK_ERROR_OUT_OF_HOST_MEMORY;
+    if (r == VK_SUCCESS)
+        r = d->GetRayTracingShaderGroupHandlesKHR(d->device, pipeline, 0, group_count,
+                                                  (size_t)group_count * s->handle_size, s->handles);
+
+    for (uint32_t g = 0; g < XENO_SBT_REGIONS && r == VK_SUCCESS; ++g) {
+        uint32_t need = desc->data_size[g];
+        for (uint32_t i = 0; i < desc->counts[g]; ++i) {
+            const XenoSbtRecord* rec = &desc->records[g][i];
+            if (rec->data && rec->data_size > need) need = rec->data_size;
+        }
+        s->data_size[g] = need;
+        s->stride[g] = (uint32_t)align_up(s->handle_size + need, s->handle_align);
+        s->count[g] = desc->counts[g];
+        s->capacity[g] = desc->counts[g];
+        if (rtp.maxShaderGroupStride && s->stride[g] > rtp.maxShaderGroupStride) {
+            XENO_LOGE("sbt: stride %u exceeds the device limit %u", s->stride[g], rtp.maxShaderGroupStride);
+            r = VK_ERROR_INITIALIZATION_FAILED;
+        }
+    }
+    if (desc->hit_capacity > s->capacity[XENO_SBT_HIT]) s->capacity[XENO_SBT_HIT] = desc->hit_capacity;
+
+    if (r == VK_SUCCESS) {
+        layout(s);
+        s->table = (uint8_t*)calloc(1, (size_t)s->table_size);
+        for (uint32_t g = 0; g < XENO_SBT_REGIONS; ++g) {
+            s->dirty[g] = (uint8_t*)calloc(s->capacity[g] ? s->capacity[g] : 1u, 1);
+            s->stamp[g] = (uint32_t*)calloc(s->capacity[g] ? s->capacity[g] : 1u, sizeof(uint32_t));
+            if (!s->dirty[g] || !s->stamp[g]) r = VK_ERROR_OUT_OF_HOST_MEMORY;
+        }
+        if (!s->table) r = VK_ERROR_OUT_OF_HOST_MEMORY;
+    }
+    for (uint32_t g = 0; g < XENO_SBT_REGIONS && r == VK_SUCCESS; ++g) {
+        for (uint32_t i = 0; i < desc->counts[g]; ++i) {
+            if (!valid_record(s, (XenoSbtRegion)g, &desc->records[g][i])) {
+                r = VK_ERROR_INITIALIZATION_FAILED;
+                break;
+            }
+            write_record(s, (XenoSbtRegion)g, i, &desc->records[g][i]);
+        }
+    }
+    if (r != VK_SUCCESS) {
+        XENO_LOGE("sbt: setup failed: %d", r);
+        xeno_sbt_destroy(s);
+        return NULL;
+    }
+    s->full_upload = 1;
+    s->stats.table_bytes = s->table_size;
+    XENO_LOGD("sbt: %u groups, strides %u/%u/%u/%u, %llu bytes", group_count, s->stride[0], s->stride[1],
+              s->stride[2], s->stride[3], (unsigned long long)s->table_size);
+    return s;
+}
+
+void xeno_sbt_destroy(XenoSbt* s)
+{
+    if (!s) return;
+    for (uint32_t i = 0; i < s->retired_count; ++i)
+        xeno_mem_destroy_buffer(s->mem, s->retired[i].buffer, &s->retired[i].alloc);
+    free(s->retired);
+    xeno_mem_destroy_buffer(s->mem, s->buffer, &s->alloc);
+    for (uint32_t g = 0; g < XENO_SBT_REGIONS; ++g) {
+        free(s->dirty[g]);
+        free(s->stamp[g]);
+    }
+    free(s->table);
+    free(s->handles);
+    free(s);
+}
+
+VkResult xeno_sbt_set_record(XenoSbt* s, XenoSbtRegion region, uint32_t index, const XenoSbtRecord* record)
+{
+    if (!s || (uint32_t)region >= XENO_SBT_REGIONS || !record) return VK_ERROR_INITIALIZATION_FAILED;
+    if (index >= s->count[region]) {
+        XENO_LOGE("sbt: record %u past the end of region %d (%u)", index, (int)region, s->count[region]);
+        return VK_ERROR_INITIALIZATION_FAILED;
+    }
+    if (!valid_record(s, region, record)) return VK_ERROR_INITIALIZATION_FAILED;
+    write_record(s, region, index, record);
+    return VK_SUCCESS;
+}
+
+VkResult xeno_sbt_set_hit_count(XenoSbt* s, uint32_t count)
+{
+    if (!s) return VK_ERROR_INITIALIZATION_FAILED;
+    if (count > s->capacity[XENO_SBT_HIT]) {
+        uint32_t cap = s->capacity[XENO_SBT_HIT] ? s->capacity[XENO_SBT_HIT] * 2u : 16u;
+        if (cap < count) cap = count;
+        uint8_t* dirty = (uint8_t*)realloc(s->dirty[XENO_SBT_HIT], cap);
+        if (!dirty) return VK_ERROR_OUT_OF_HOST_MEMORY;
+        s->dirty[XENO_SBT_HIT] = dirty;
+        uint32_t* stamp = (uint32_t*)realloc(s->stamp[XENO_SBT_HIT], cap * sizeof(*stamp));
+        if (!stamp) return VK_ERROR_OUT_OF_HOST_MEMORY;
+        s->stamp[XENO_SBT_HIT] = stamp;
+        memset(stamp + s->capacity[XENO_SBT_HIT], 0, (cap - s->capacity[XENO_SBT_HIT]) * sizeof(*stamp));
+        VkDeviceSize old_size = s->table_size;
+        uint32_t old_cap = s->capacity[XENO_SBT_HIT];
+        s->capacity[XENO_SBT_HIT] = cap;
+        layout(s);
+        uint8_t* table = (uint8_t*)realloc(s->table, (size_t)s->table_size);
+        if (!table) {
+            s->capacity[XENO_SBT_HIT] = old_cap;
+            layout(s);
+            return VK_ERROR_OUT_OF_HOST_MEMORY;
+        }
+        s->table = table;
+        memset(s->table + old_size, 0, (size_t)(s->table_size - old_size));
+        memset(dirty + s->count[XENO_SBT_HIT], 0, cap - s->count[XENO_SBT_HIT]);
+        s->full_upload = 1;
+        s->stats.table_bytes = s->table_size;
+    }
+    /* Records dropped off the end need no upload. */
+    for (uint32_t i = count; i < s->count[XENO_SBT_HIT]; ++i) {
+        if (s->dirty[XENO_SBT_HIT][i]) {
+            s->dirty[XENO_SBT_HIT][i] = 0;
+            s->dirty_count--;
+        }
+    }
+    s->count[XENO_SBT_HIT] = count;
+    return VK_SUCCESS;
+}
+
+/* offset is within the table; copy picks which of the buffer's tables. */
+static VkResult write_range(XenoSbt* s, XenoUploader* up, uint32_t copy, VkDeviceSize offset, VkDeviceSize size)
+{
+    VkDeviceSize dst = s->buffer_offset + (VkDeviceSize)copy * s->table_size + offset;
+    s->stats.uploaded_bytes += size;
+    if (s->alloc.mapped) {
+        memcpy((uint8_t*)s->alloc.mapped + dst, s->table + offset, (size_t)size);
+        return xeno_mem_flush(s->mem, &s->alloc, dst, size);
+    }
+    return xeno_upload_write(up, s->buffer, dst, s->table + offset, size);
+}
+
+static VkResult create_buffer(XenoSbt* s)
+{
+    if (s->buffer) {
+        XenoSbtRetired* items = (XenoSbtRetired*)realloc(s->retired, (s->retired_count + 1u) * sizeof(*items));
+        if (!items) return VK_ERROR_OUT_OF_HOST_MEMORY;
+        s->retired = items;
+        s->retired[s->retired_count++] = (XenoSbtRetired){ s->buffer, s->alloc };
+        s->buffer = VK_NULL_HANDLE;
+        memset(&s->alloc, 0, sizeof(s->alloc));
+        s->stats.reallocations++;
+    }
+
+    /* Buffer alignment need not cover shaderGroupBaseAlignment: pad the start. */
+    VkResult r = xeno_mem_create_buffer(s->mem, s->table_size * XENO_SBT_COPIES + s->base_align,
+                                        VK_BUFFER_USAGE_SHADER_BINDING_TABLE_BIT_KHR |
+                                        VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0, &s->buffer, &s->alloc);
+    if (r != VK_SUCCESS) return r;
+    VkBufferDeviceAddressInfo info = { .sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO, .buffer = s->buffer };
+    VkDeviceAddress base = s->d->GetBufferDeviceAddress(s->d->device, &info);
+    s->address = align_up(base, s->base_align);
+    s->buffer_offset = s->address - base;
+    return VK_SUCCESS;
+}
+
+VkResult xeno_sbt_upload(XenoSbt* s, XenoUploader* up)
+{
+    if (!s) return VK_ERROR_INITIALIZATION_FAILED;
+    if (!s->full_upload && !s->dirty_count) return VK_SUCCESS;
+    XENO_TRACE_SCOPE("sbt.upload");
+
+    /* A new buffer holds nothing yet: every record is due in every copy. */
+    const uint32_t serial = s->serial + 1u;
+    if (s->full_upload) {
+        VkResult r = create_buffer(s);
+        if (r != VK_SUCCESS) {
+            XENO_LOGE("sbt: buffer of %llu bytes failed: %d", (unsigned long long)s->table_size, r);
+            return r;
+        }
+        memset(s->copy_serial, 0, sizeof(s->copy_serial));
+    }
+    for (uint32_t g = 0; g < XENO_SBT_REGIONS; ++g) {
+        for (uint32_t i = 0; i < s->count[g]; ++i) {
+            if (s->full_upload || s->dirty[g][i]) s->stamp[g][i] = serial;
+            s->dirty[g][i] = 0;
+        }
+    }
+    s->dirty_count = 0;
+    s->full_upload = 0;
+
+    /* The next copy was current XENO_SBT_COPIES uploads ago; it gets every
+       record changed since, one write per run. */
+    const uint32_t copy = serial % XENO_SBT_COPIES;
+    for (uint32_t g = 0; g < XENO_SBT_REGIONS; ++g) {
+        uint32_t i = 0;
+        while (i < s->count[g]) {
+            if (s->stamp[g][i] <= s->copy_serial[copy]) { ++i; continue; }
+            uint32_t first = i;
+            while (i < s->count[g] && s->stamp[g][i] > s->copy_serial[copy]) ++i;
+            VkResult r = write_range(s, up, copy, s->offset[g] + (VkDeviceSize)first * s->stride[g],
+                                     (VkDeviceSize)(i - first) * s->stride[g]);
+            if (r != VK_SUCCESS) {
+                XENO_LOGE("sbt: upload failed: %d", r);
+                return r;
+            }
+        }
+    }
+    s->copy_serial[copy] = serial;
+    s->cur = copy;
+    s->serial = serial;
+    s->stats.uploads++;
+    return VK_SUCCESS;
+}
+
+void xeno_sbt_regions(const XenoSbt* s, VkStridedDeviceAddressRegionKHR* raygen, VkStridedDeviceAddressRegionKHR* miss,
+                      VkStridedDeviceAddressRegionKHR* hit, VkStridedDeviceAddressRegionKHR* callable)
+{
+    VkStridedDeviceAddressRegionKHR* out[XENO_SBT_REGIONS] = { raygen, miss, hit, callable };
+    for (uint32_t g = 0; g < XENO_SBT_REGIONS; ++g) {
+        if (!out[g]) continue;
+        memset(out[g], 0, sizeof(*out[g]));
+        if (!s || !s->buffer || !s->count[g]) continue;
+        out[g]->deviceAddress = s->address + (VkDeviceSize)s->cur * s->table_size + s->offset[g];
+        out[g]->stride = s->stride[g];
+        /* The raygen region is a single record whose size equals its stride. */
+        out[g]->size = (VkDeviceSize)s->stride[g] * (g == XENO_SBT_RAYGEN ? 1u : s->count[g]);
+    }
+}
+
+void xeno_sbt_get_stats(const XenoSbt* s, XenoSbtStats* out)
+{
+    *out = s->stats;
+}
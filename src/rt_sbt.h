@@ -0,0 +1,81 @@
+// src/rt_sbt.h
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <stdint.h>
+#include "xeno_upload.h"
+
+/*
+  Shader binding table builder for the RT path (rt_sbt.c).
+
+  Group handles are fetched once per pipeline. Records (handle followed by
+  inline shaderRecordEXT data) go into one device-local buffer: a region's
+  stride is the handle plus its largest record data, rounded up to
+  shaderGroupHandleAlignment; regions start on shaderGroupBaseAlignment,
+  and the hit region comes last with room for hit_capacity records.
+
+  A CPU copy of the table is kept. Setting a record only marks it dirty,
+  and xeno_sbt_upload sends the changed records through the upload manager
+  (which merges neighbours), so a dynamic scene re-uploads the hit records
+  that changed instead of the whole table. The buffer holds four copies of
+  the table and an upload with changes writes the next one, never the
+  copy earlier traces point at: traces recorded against a copy must have
+  completed four such uploads later (one per frame: four frames in
+  flight). A copy gets every record changed since it was last current.
+  Growing the hit region past its capacity doubles the buffer and
+  re-uploads everything. Replaced buffers are kept until xeno_sbt_destroy,
+  since traces may still read them; doubling bounds them to the live size.
+
+  One owner per table.
+*/
+
+typedef enum XenoSbtRegion {
+    XENO_SBT_RAYGEN = 0,
+    XENO_SBT_MISS = 1,
+    XENO_SBT_HIT = 2,
+    XENO_SBT_CALLABLE = 3,
+    XENO_SBT_REGIONS = 4,
+} XenoSbtRegion;
+
+typedef struct XenoSbtRecord {
+    uint32_t group;             /* shader group index in the pipeline */
+    const void* data;           /* inline record data, NULL for none */
+    uint32_t data_size;
+} XenoSbtRecord;
+
+typedef struct XenoSbtDesc {
+    const XenoSbtRecord* records[XENO_SBT_REGIONS];
+    uint32_t counts[XENO_SBT_REGIONS];      /* raygen: 1 */
+    /* Record data reserved per region; 0 uses the largest record given. */
+    uint32_t data_size[XENO_SBT_REGIONS];
+    uint32_t hit_capacity;                  /* hit records to leave room for */
+} XenoSbtDesc;
+
+typedef struct XenoSbtStats {
+    VkDeviceSize table_bytes;
+    VkDeviceSize uploaded_bytes;            /* in total, across uploads */
+    uint32_t uploads;
+    uint32_t reallocations;
+} XenoSbtStats;
+
+typedef struct XenoSbt XenoSbt;
+
+/* NULL when the device has no VK_KHR_ray_tracing_pipeline entrypoints or
+   the records do not fit the device's limits. */
+XenoSbt* xeno_sbt_create(VkDevice device, VkPipeline pipeline, uint32_t group_count, const XenoSbtDesc* desc);
+void xeno_sbt_destroy(XenoSbt* sbt);
+
+/* Rewrites one record; data_size may not exceed the region's reservation. */
+VkResult xeno_sbt_set_record(XenoSbt* sbt, XenoSbtRegion region, uint32_t index, const XenoSbtRecord* record);
+/* Resizes the hit region. Records past the old count must be set before
+   the next trace. */
+VkResult xeno_sbt_set_hit_count(XenoSbt* sbt, uint32_t count);
+
+/* Queues every dirty record on `up`; they land at its next flush. */
+VkResult xeno_sbt_upload(XenoSbt* sbt, XenoUploader* up);
+
+/* For vkCmdTraceRaysKHR; valid after the first upload, and they move with
+   every upload that had changes. */
+void xeno_sbt_regions(const XenoSbt* sbt, VkStridedDeviceAddressRegionKHR* raygen, VkStridedDeviceAddressRegionKHR* miss,
+                      VkStridedDeviceAddressRegionKHR* hit, VkStridedDeviceAddressRegionKHR* callable);
+void xeno_sbt_get_stats(const XenoSbt* sbt, XenoSbtStats* out);
@@ -0,0 +1,412 @@
+// src/shader_cache.c
+/*
+  Shader module sharing and replacement (see shader_cache.h).
+
+  Shared modules are listed twice: by driver handle, for destroys, and by
+  the first half of their hash, for creates; a create matches only with
+  the second half and the size equal too. A hash half already in the table
+  keeps a later module with the same half out of it (it is still counted,
+  just never shared), so keys stay unique.
+
+  The driver call happens outside the mutex. Two threads creating the same
+  code at once both reach the driver; the second module is kept unshared.
+
+  Tables work as in rp_cache.c.
+*/
+#include "shader_cache.h"
+#include "spirv.h"
+#include "spirv_opt.h"
+#include "perf_conf.h"
+#include "xeno_log.h"
+#include "xeno_trace.h"
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define XENO_SHADER_MIN_SLOTS 64u
+
+typedef struct EntryMap {
+    uint64_t** slots;
+    uint32_t cap;                           /* power of two */
+    uint32_t count;
+} EntryMap;
+
+typedef struct Module {
+    uint64_t handle;                        /* key in by_handle */
+    uint64_t hash[2];                       /* hash[0] is the key in by_hash */
+    uint64_t size;
+    uint32_t refs;
+    int shared;                             /* in by_hash */
+} Module;
+
+struct XenoShaderCache {
+    pthread_mutex_t mtx;
+    EntryMap by_handle, by_hash;
+    uint64_t (*replacements)[2];            /* sorted */
+    char replace_dir[600];
+    XenoShaderStats stats;
+};
+
+static uint32_t handle_slot(uint64_t handle, uint32_t mask)
+{
+    return (uint32_t)((handle * 0x9E3779B97F4A7C15ull) >> 32) & mask;
+}
+
+/* ---- tables (caller holds mtx) ------------------------------------ */
+
+static int entries_grow(EntryMap* m)
+{
+    uint32_t cap = m->cap ? m->cap * 2u : XENO_SHADER_MIN_SLOTS;
+    uint64_t** slots = (uint64_t**)calloc(cap, sizeof(*slots));
+    if (!slots) return 0;
+    for (uint32_t i = 0; i < m->cap; ++i) {
+        if (!m->slots[i]) continue;
+        uint32_t j = handle_slot(*m->slots[i], cap - 1u);
+        while (slots[j]) j = (j + 1u) & (cap - 1u);
+        slots[j] = m->slots[i];
+    }
+    free(m->slots);
+    m->slots = slots;
+    m->cap = cap;
+    return 1;
+}
+
+static uint64_t* entries_find(const EntryMap* m, uint64_t key)
+{
+    if (!m->cap || !key) return NULL;
+    uint32_t mask = m->cap - 1u;
+    for (uint32_t i = handle_slot(key, mask); m->slots[i]; i = (i + 1u) & mask) {
+        if (*m->slots[i] == key) return m->slots[i];
+    }
+    return NULL;
+}
+
+/* Unlinks the entry for key (backward-shift deletion) and returns it. */
+static uint64_t* entries_take(EntryMap* m, uint64_t key)
+{
+    if (!m->cap || !key) return NULL;
+    uint32_t mask = m->cap - 1u;
+    uint32_t i = handle_slot(key, mask);
+    while (m->slots[i] && *m->slots[i] != key) i = (i + 1u) & mask;
+    uint64_t* e = m->slots[i];
+    if (!e) return NULL;
+    m->slots[i] = NULL;
+    m->count--;
+    for (uint32_t j = (i + 1u) & mask; m->slots[j]; j = (j + 1u) & mask) {
+        uint32_t home = handle_slot(*m->slots[j], mask);
+        if (((j - home) & mask) >= ((j - i) & mask)) {
+            m->slots[i] = m->slots[j];
+            m->slots[j] = NULL;
+            i = j;
+        }
+    }
+    return e;
+}
+
+static int entries_insert(EntryMap* m, uint64_t* e)
+{
+    if ((m->count + 1u) * 2u > m->cap && !entries_grow(m)) return 0;
+    uint32_t mask = m->cap - 1u;
+    uint32_t i = handle_slot(*e, mask);
+    while (m->slots[i]) i = (i + 1u) & mask;
+    m->slots[i] = e;
+    m->count++;
+    return 1;
+}
+
+static Module* module_of_hash(uint64_t* key)
+{
+    return key ? (Module*)((char*)key - offsetof(Module, hash)) : NULL;
+}
+
+/* ---- hashing ------------------------------------------------------ */
+
+static uint64_t rotl64(uint64_t x, int r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+static uint64_t fmix64(uint64_t k)
+{
+    k ^= k >> 33;
+    k *= 0xff51afd7ed558ccdull;
+    k ^= k >> 33;
+    k *= 0xc4ceb9fe1a85ec53ull;
+    k ^= k >> 33;
+    return k;
+}
+
+/* MurmurHash3_x64_128, seed 0. */
+void xeno_shader_hash(const void* code, size_t size, uint64_t out[2])
+{
+    const uint64_t c1 = 0x87c37b91114253d5ull, c2 = 0x4cf5ad432745937full;
+    const uint8_t* p = (const uint8_t*)code;
+    uint64_t h1 = 0, h2 = 0;
+    size_t blocks = size / 16u;
+    for (size_t i = 0; i < blocks; ++i) {
+        uint64_t k1, k2;
+        memcpy(&k1, p + i * 16u, 8);
+        memcpy(&k2, p + i * 16u + 8u, 8);
+        k1 *= c1;
+        k1 = rotl64(k1, 31);
+        k1 *= c2;
+        h1 ^= k1;
+        h1 = rotl64(h1, 27) + h2;
+        h1 = h1 * 5u + 0x52dce729u;
+        k2 *= c2;
+        k2 = rotl64(k2, 33);
+        k2 *= c1;
+        h2 ^= k2;
+        h2 = rotl64(h2, 31) + h1;
+        h2 = h2 * 5u + 0x38495ab5u;
+    }
+    const uint8_t* tail = p + blocks * 16u;
+    size_t rest = size & 15u;
+    uint64_t k1 = 0, k2 = 0;
+    for (size_t i = 0; i < rest; ++i) {
+        if (i < 8u) k1 ^= (uint64_t)tail[i] << (8u * i);
+        else k2 ^= (uint64_t)tail[i] << (8u * (i - 8u));
+    }
+    if (rest > 8u) {
+        k2 *= c2;
+        k2 = rotl64(k2, 33);
+        k2 *= c1;
+        h2 ^= k2;
+    }
+    if (rest) {
+        k1 *= c1;
+        k1 = rotl64(k1, 31);
+        k1 *= c2;
+        h1 ^= k1;
+    }
+    h1 ^= size;
+    h2 ^= size;
+    h1 += h2;
+    h2 += h1;
+    h1 = fmix64(h1);
+    h2 = fmix64(h2);
+    h1 += h2;
+    h2 += h1;
+    out[0] = h1;
+    out[1] = h2;
+}
+
+/* ---- replacements ------------------------------------------------- */
+
+static int cmp_hash(const void* a, const void* b)
+{
+    const uint64_t* x = (const uint64_t*)a;
+    const uint64_t* y = (const uint64_t*)b;
+    if (x[0] != y[0]) return x[0] < y[0] ? -1 : 1;
+    return x[1] < y[1] ? -1 : x[1] > y[1];
+}
+
+static int parse_hex64(const char* s, uint64_t* out)
+{
+    uint64_t v = 0;
+    for (int i = 0; i < 16; ++i) {
+        char ch = s[i];
+        uint64_t digit;
+        if (ch >= '0' && ch <= '9') digit = (uint64_t)(ch - '0');
+        else if (ch >= 'a' && ch <= 'f') digit = (uint64_t)(ch - 'a' + 10);
+        else return 0;
+        v = v << 4 | digit;
+    }
+    *out = v;
+    return 1;
+}
+
+static void index_replacements(XenoShaderCache* c)
+{
+    DIR* dir = opendir(c->replace_dir);
+    if (!dir) return;
+    uint32_t cap = 0;
+    for (struct dirent* e; (e = readdir(dir));) {
+        uint64_t h[2];
+        if (strlen(e->d_name) != 36u || strcmp(e->d_name + 32, ".spv") != 0) continue;
+        if (!parse_hex64(e->d_name, &h[0]) || !parse_hex64(e->d_name + 16, &h[1])) continue;
+        if (c->stats.replacements == cap) {
+            uint32_t grown = cap ? cap * 2u : 16u;
+            uint64_t (*r)[2] = (uint64_t(*)[2])realloc(c->replacements, sizeof(*r) * grown);
+            if (!r) break;
+            c->replacements = r;
+            cap = grown;
+        }
+        c->replacements[c->stats.replacements][0] = h[0];
+        c->replacements[c->stats.replacements][1] = h[1];
+        c->stats.replacements++;
+    }
+    closedir(dir);
+    if (c->stats.replacements) qsort(c->replacements, c->stats.replacements, sizeof(*c->replacements), cmp_hash);
+}
+
+/* The replacement for hash mapped read-only, NULL without a usable one. */
+static void* map_replacement(const XenoShaderCache* c, const uint64_t hash[2], size_t* size)
+{
+    if (!c->stats.replacements ||
+        !bsearch(hash, c->replacements, c->stats.replacements, sizeof(*c->replacements), cmp_hash)) {
+        return NULL;
+    }
+    char path[680];
+    snprintf(path, sizeof(path), "%s/%016llx%016llx.spv", c->replace_dir, (unsigned long long)hash[0],
+             (unsigned long long)hash[1]);
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return NULL;
+    struct stat st;
+    void* p = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) p = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) return NULL;
+    XenoSpirvModule m;
+    if (!xeno_spirv_parse((const uint32_t*)p, (size_t)st.st_size, &m)) {
+        XENO_LOGW_RL(1, "shader: %s is not valid SPIR-V, using the app's module", path);
+        munmap(p, (size_t)st.st_size);
+        return NULL;
+    }
+    *size = (size_t)st.st_size;
+    return p;
+}
+
+/* ---- device ------------------------------------------------------- */
+
+void xeno_shader_device_init(XenoDeviceDispatch* d)
+{
+    const XenoPerfConf* conf = xeno_perf_conf_active();
+    if (!conf->shader_dedupe) return;
+    XenoShaderCache* c = (XenoShaderCache*)calloc(1, sizeof(*c));
+    if (!c) {
+        XENO_LOGW("shader: out of memory, modules are not shared");
+        return;
+    }
+    pthread_mutex_init(&c->mtx, NULL);
+    snprintf(c->replace_dir, sizeof(c->replace_dir), "%.511s/%s", conf->shader_cache_dir, XENO_SHADER_REPLACE_DIR);
+    index_replacements(c);
+    if (c->stats.replacements) XENO_LOGI("shader: %u replacements in %s", c->stats.replacements, c->replace_dir);
+    d->shaders = c;
+}
+
+void xeno_shader_device_destroy(XenoDeviceDispatch* d)
+{
+    XenoShaderCache* c = d->shaders;
+    if (!c) return;
+    d->shaders = NULL;
+    XENO_LOGI("shader: %llu modules shared, %llu created, %llu replaced",
+              (unsigned long long)c->stats.hits, (unsigned long long)c->stats.misses,
+              (unsigned long long)c->stats.replaced);
+    for (uint32_t i = 0; i < c->by_handle.cap; ++i) free(c->by_handle.slots[i]);
+    free(c->by_handle.slots);
+    free(c->by_hash.slots);
+    free(c->replacements);
+    pthread_mutex_destroy(&c->mtx);
+    free(c);
+}
+
+/* ---- modules ------------------------------------------------------ */
+
+static void trace_stats(const XenoShaderStats* s)
+{
+    XENO_TRACE_COUNTER("shader.hits", s->hits);
+    XENO_TRACE_COUNTER("shader.misses", s->misses);
+    XENO_TRACE_COUNTER("shader.replaced", s->replaced);
+}
+
+VkResult xeno_shader_create(XenoDeviceDispatch* d, const VkShaderModuleCreateInfo* ci,
+                            const VkAllocationCallbacks* allocator, VkShaderModule* out)
+{
+    XenoShaderCache* c = d->shaders;
+    uint64_t hash[2] = { 0, 0 };
+    int shareable = c && !ci->flags && !ci->pNext && !allocator;
+    XenoShaderStats stats;
+    if (c) {
+        xeno_shader_hash(ci->pCode, ci->codeSize, hash);
+        pthread_mutex_lock(&c->mtx);
+        Module* m = shareable ? module_of_hash(entries_find(&c->by_hash, hash[0])) : NULL;
+        if (m && m->hash[1] == hash[1] && m->size == ci->codeSize) {
+            m->refs++;
+            c->stats.hits++;
+            stats = c->stats;
+            *out = (VkShaderModule)m->handle;
+            pthread_mutex_unlock(&c->mtx);
+            trace_stats(&stats);
+            return VK_SUCCESS;
+        }
+        pthread_mutex_unlock(&c->mtx);
+    }
+
+    VkShaderModuleCreateInfo info = *ci;
+    size_t mapped_size = 0, relaxed_size = 0;
+    void* mapped = c ? map_replacement(c, hash, &mapped_size) : NULL;
+    uint32_t* relaxed = mapped ? NULL : xeno_spirv_opt_module(ci->pCode, ci->codeSize, &relaxed_size);
+    if (mapped) {
+        info.codeSize = mapped_size;
+        info.pCode = (const uint32_t*)mapped;
+    } else if (relaxed) {
+        info.codeSize = relaxed_size;
+        info.pCode = relaxed;
+    }
+    VkResult res = d->CreateShaderModule(d->device, &info, allocator, out);
+    free(relaxed);
+    if (mapped) munmap(mapped, mapped_size);
+    if (!c) return res;
+
+    pthread_mutex_lock(&c->mtx);
+    c->stats.misses++;
+    if (mapped) c->stats.replaced++;
+    Module* m = res == VK_SUCCESS && shareable ? (Module*)calloc(1, sizeof(*m)) : NULL;
+    if (m) {
+        m->handle = (uint64_t)*out;
+        m->hash[0] = hash[0];
+        m->hash[1] = hash[1];
+        m->size = ci->codeSize;
+        m->refs = 1;
+        if (entries_insert(&c->by_handle, &m->handle)) {
+            m->shared = !entries_find(&c->by_hash, hash[0]) && entries_insert(&c->by_hash, &m->hash[0]);
+            c->stats.live++;
+        } else {
+            free(m);                        /* never shared, destroyed as is */
+        }
+    }
+    stats = c->stats;
+    pthread_mutex_unlock(&c->mtx);
+    trace_stats(&stats);
+    return res;
+}
+
+void xeno_shader_destroy(XenoDeviceDispatch* d, VkShaderModule module, const VkAllocationCallbacks* allocator)
+{
+    XenoShaderCache* c = d->shaders;
+    if (c && module) {
+        pthread_mutex_lock(&c->mtx);
+        Module* m = (Module*)entries_find(&c->by_handle, (uint64_t)module);
+        if (m && --m->refs) {
+            pthread_mutex_unlock(&c->mtx);
+            return;
+        }
+        if (m) {
+            entries_take(&c->by_handle, m->handle);
+            if (m->shared) entries_take(&c->by_hash, m->hash[0]);
+            c->stats.live--;
+            free(m);
+        }
+        pthread_mutex_unlock(&c->mtx);
+    }
+    d->DestroyShaderModule(d->device, module, allocator);
+}
+
+void xeno_shader_get_stats(const XenoDeviceDispatch* d, XenoShaderStats* out)
+{
+    XenoShaderCache* c = d->shaders;
+    memset(out, 0, sizeof(*out));
+    if (!c) return;
+    pthread_mutex_lock(&c->mtx);
+    *out = c->stats;
+    pthread_mutex_unlock(&c->mtx);
+}
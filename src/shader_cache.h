@@ -0,0 +1,54 @@
+// src/shader_cache.h
+#pragma once
+
+#include <stdint.h>
+#include <vulkan/vulkan.h>
+#include "xeno_dispatch.h"
+
+/*
+  Shader module sharing and replacement (shader_cache.c).
+
+  vkCreateShaderModule hashes the app's SPIR-V (128-bit MurmurHash3).
+  When a module with the same code is alive on the device, the app gets
+  that module back with one more reference instead of a new one;
+  vkDestroyShaderModule drops a reference and the driver's module goes
+  with the last. Only modules created without flags, pNext or allocation
+  callbacks are shared.
+
+  Replacements: <shader_cache_dir>/replace/<hash>.spv, hash being the
+  original's xeno_shader_hash() as 32 lowercase hex digits (out[0] first),
+  is mapped and created instead of the app's code. The directory is indexed
+  once per device, so a module without a replacement costs no file
+  system access. Replacements are taken as they are; the app's own code
+  goes through the fp16 pass (spirv_opt.h) when that is on.
+
+  perf_conf shader_dedupe=0 turns both off.
+*/
+
+#define XENO_SHADER_REPLACE_DIR "replace"
+
+typedef struct XenoShaderCache XenoShaderCache;
+
+typedef struct XenoShaderStats {
+    uint64_t hits;              /* creates answered with a live module */
+    uint64_t misses;            /* creates that reached the driver */
+    uint64_t replaced;          /* misses created from a replacement */
+    uint32_t live;              /* shareable driver modules alive */
+    uint32_t replacements;      /* files in the replacement index */
+} XenoShaderStats;
+
+/* Sets d->shaders unless perf_conf shader_dedupe=0. */
+void xeno_shader_device_init(XenoDeviceDispatch* d);
+/* Logs the counters; the app destroyed its modules (or leaks them). */
+void xeno_shader_device_destroy(XenoDeviceDispatch* d);
+
+/* vkCreateShaderModule / vkDestroyShaderModule, recorded on the driver. */
+VkResult xeno_shader_create(XenoDeviceDispatch* d, const VkShaderModuleCreateInfo* ci,
+                            const VkAllocationCallbacks* allocator, VkShaderModule* out);
+void xeno_shader_destroy(XenoDeviceDispatch* d, VkShaderModule module, const VkAllocationCallbacks* allocator);
+
+/* Zeroes without a cache. */
+void xeno_shader_get_stats(const XenoDeviceDispatch* d, XenoShaderStats* out);
+
+/* The hash replacements are named by. */
+void xeno_shader_hash(const void* code, size_t size, uint64_t out[2]);
@@ -0,0 +1,46 @@
+// src/spirv.c
+/*
+  SPIR-V module walker (see spirv.h).
+
+  One pass over the words; the only instructions looked into are
+  OpEntryPoint, for the stages, and OpFunction, for where the function
+  section starts. Everything else is checked for its length alone, which
+  is what the walk and the layer's rewrites rely on.
+*/
+#include "spirv.h"
+#include "xeno_wrapper.h"
+
+int xeno_spirv_parse(const uint32_t* words, size_t byte_len, XenoSpirvModule* out)
+{
+    if (!words || byte_len % 4u || byte_len < XENO_SPIRV_HEADER_WORDS * 4u || byte_len / 4u > UINT32_MAX) return 0;
+    uint32_t count = (uint32_t)(byte_len / 4u);
+    uint32_t version = words[1];
+    if (words[0] != XENO_SPIRV_MAGIC || (version & 0xffff00ffu) != 0x00010000u) return 0;
+    if (!words[3] || words[3] > XENO_SPIRV_MAX_BOUND || words[4]) return 0;
+
+    XenoSpirvModule m = {
+        .words = words, .word_count = count, .version = version, .bound = words[3], .first_function = count,
+    };
+    for (uint32_t at = XENO_SPIRV_HEADER_WORDS; at < count;) {
+        uint32_t len = words[at] >> 16;
+        if (!len || len > count - at) return 0;
+        uint32_t op = words[at] & 0xffffu;
+        if (op == XENO_SPV_OP_ENTRY_POINT) {
+            if (len < 4u) return 0;
+            uint32_t model = words[at + 1u];
+            m.stages |= 1u << (model < 31u ? model : 31u);
+        } else if (op == XENO_SPV_OP_FUNCTION && m.first_function == count) {
+            m.first_function = at;
+        }
+        m.instructions++;
+        at += len;
+    }
+    *out = m;
+    return 1;
+}
+
+VkResult xeno_wrapper_validate_spirv(const uint32_t* words, uint32_t byte_len)
+{
+    XenoSpirvModule m;
+    return xeno_spirv_parse(words, byte_len, &m) ? VK_SUCCESS : VK_ERROR_INVALID_SHADER_NV;
+}
@@ -0,0 +1,99 @@
+// src/spirv.h
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+  SPIR-V module walker (spirv.c).
+
+  xeno_spirv_parse() checks a module once: header, version, id bound and
+  that every instruction's word count keeps it inside the module. After
+  that, instructions can be walked in place without further checks:
+
+      for (uint32_t at = XENO_SPIRV_HEADER_WORDS; at < m.word_count; at += xeno_spirv_length(&m, at))
+
+  Nothing is allocated or copied. Byte-swapped modules are legal SPIR-V
+  but nothing produces them in practice; they are reported as not
+  parseable rather than walked.
+*/
+
+#define XENO_SPIRV_MAGIC 0x07230203u
+#define XENO_SPIRV_HEADER_WORDS 5u
+#define XENO_SPIRV_MAX_BOUND 0x400000u  /* the universal limit on ids */
+
+/* Opcodes and operands the layer looks at. */
+enum {
+    XENO_SPV_OP_SOURCE_CONTINUED = 2,
+    XENO_SPV_OP_SOURCE = 3,
+    XENO_SPV_OP_SOURCE_EXTENSION = 4,
+    XENO_SPV_OP_NAME = 5,
+    XENO_SPV_OP_MEMBER_NAME = 6,
+    XENO_SPV_OP_STRING = 7,
+    XENO_SPV_OP_LINE = 8,
+    XENO_SPV_OP_EXTENSION = 10,
+    XENO_SPV_OP_EXT_INST_IMPORT = 11,
+    XENO_SPV_OP_EXT_INST = 12,
+    XENO_SPV_OP_MEMORY_MODEL = 14,
+    XENO_SPV_OP_ENTRY_POINT = 15,
+    XENO_SPV_OP_EXECUTION_MODE = 16,
+    XENO_SPV_OP_CAPABILITY = 17,
+    XENO_SPV_OP_TYPE_FLOAT = 22,
+    XENO_SPV_OP_TYPE_VECTOR = 23,
+    XENO_SPV_OP_TYPE_POINTER = 32,
+    XENO_SPV_OP_FUNCTION = 54,
+    XENO_SPV_OP_VARIABLE = 59,
+    XENO_SPV_OP_STORE = 62,
+    XENO_SPV_OP_DECORATE = 71,
+    XENO_SPV_OP_MEMBER_DECORATE = 72,
+    XENO_SPV_OP_DECORATION_GROUP = 73,
+    XENO_SPV_OP_GROUP_DECORATE = 74,
+    XENO_SPV_OP_GROUP_MEMBER_DECORATE = 75,
+    XENO_SPV_OP_VECTOR_SHUFFLE = 79,
+    XENO_SPV_OP_COMPOSITE_CONSTRUCT = 80,
+    XENO_SPV_OP_COMPOSITE_EXTRACT = 81,
+    XENO_SPV_OP_COMPOSITE_INSERT = 82,
+    XENO_SPV_OP_COPY_OBJECT = 83,
+    XENO_SPV_OP_F_NEGATE = 127,
+    XENO_SPV_OP_F_ADD = 129,
+    XENO_SPV_OP_F_SUB = 131,
+    XENO_SPV_OP_F_MUL = 133,
+    XENO_SPV_OP_F_DIV = 136,
+    XENO_SPV_OP_F_REM = 140,
+    XENO_SPV_OP_F_MOD = 141,
+    XENO_SPV_OP_VECTOR_TIMES_SCALAR = 142,
+    XENO_SPV_OP_DOT = 148,
+    XENO_SPV_OP_SELECT = 169,
+    XENO_SPV_OP_NO_LINE = 317,
+    XENO_SPV_OP_MODULE_PROCESSED = 330,
+    XENO_SPV_OP_EXECUTION_MODE_ID = 331,
+    XENO_SPV_OP_DECORATE_ID = 332,
+    XENO_SPV_OP_DECORATE_STRING = 5632,
+    XENO_SPV_OP_MEMBER_DECORATE_STRING = 5633,
+
+    XENO_SPV_DECORATION_RELAXED_PRECISION = 0,
+    XENO_SPV_DECORATION_BUILT_IN = 11,
+    XENO_SPV_DECORATION_NO_CONTRACTION = 42,
+
+    XENO_SPV_STORAGE_OUTPUT = 3,
+    XENO_SPV_STORAGE_FUNCTION = 7,
+
+    XENO_SPV_MODEL_FRAGMENT = 4,
+};
+
+typedef struct XenoSpirvModule {
+    const uint32_t* words;
+    uint32_t word_count;
+    uint32_t version;           /* 0x00MMmm00 as in the header */
+    uint32_t bound;             /* every id is below this */
+    uint32_t instructions;
+    uint32_t stages;            /* 1 << execution model of each entry point; bit 31 for models >= 31 */
+    uint32_t first_function;    /* word offset of the first OpFunction, word_count without one */
+} XenoSpirvModule;
+
+/* 1 and *out filled when the module is well formed as far as the walk
+   goes, 0 otherwise. */
+int xeno_spirv_parse(const uint32_t* words, size_t byte_len, XenoSpirvModule* out);
+
+static inline uint32_t xeno_spirv_opcode(const XenoSpirvModule* m, uint32_t at) { return m->words[at] & 0xffffu; }
+static inline uint32_t xeno_spirv_length(const XenoSpirvModule* m, uint32_t at) { return m->words[at] >> 16; }
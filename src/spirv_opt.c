@@ -0,0 +1,385 @@
+// src/spirv_opt.c
+/*
+  Fragment-shader precision pass (see spirv_opt.h).
+
+  Eligibility is a greatest fixpoint over one flag array indexed by id.
+  Every float32 result of the arithmetic below starts out eligible; a
+  sweep then clears every id used by anything other than an eligible
+  instruction or a store into a color output. Clearing a result makes its
+  own operands ineligible in turn, so sweeps repeat until nothing
+  changes. They run over the function section backwards, uses before
+  definitions, which settles everything but loops through phis (and phis
+  are never eligible) in the first sweep; the second one confirms.
+
+  Operands of instructions that are not eligible are taken as every word
+  below the id bound, literals included. A literal that happens to equal
+  an id costs that id its relaxation, never correctness.
+
+  Cache files hold a header and the rewritten words; out_bytes 0 records
+  a module the pass leaves alone. The key is a 64-bit hash plus the size
+  of the original, written atomically with rename() like caps_cache.c.
+*/
+#include "spirv_opt.h"
+#include "spirv.h"
+#include "perf_conf.h"
+#include "xeno_log.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#define XENO_SPIRV_CACHE_MAGIC 0x56505358u  /* "XSPV" */
+
+enum {
+    ID_FLOAT = 1u << 0,         /* float32 scalar or vector type */
+    ID_OUT_FLOAT_PTR = 1u << 1, /* pointer to one in the Output storage class */
+    ID_COLOR = 1u << 2,         /* color output variable */
+    ID_BUILT_IN = 1u << 3,
+    ID_RELAXED = 1u << 4,       /* decorated RelaxedPrecision by the app */
+    ID_PRECISE = 1u << 5,       /* NoContraction: left alone */
+    ID_ELIGIBLE = 1u << 6,
+    ID_FUNC_VAR = 1u << 7,
+    ID_USED = 1u << 8,          /* referenced by more than names and decorations */
+};
+
+typedef struct XenoSpirvCacheHeader {
+    uint32_t magic;
+    uint32_t version;           /* XENO_SPIRV_OPT_VERSION */
+    uint64_t key;
+    uint64_t in_bytes;
+    uint64_t out_bytes;         /* 0 = unchanged */
+    uint64_t checksum;          /* of the words that follow */
+} XenoSpirvCacheHeader;
+
+/* ---- the pass ----------------------------------------------------- */
+
+static int glsl_relaxable(uint32_t inst)
+{
+    switch (inst) {
+    case 1: case 2: case 3: case 4: case 6:             /* Round RoundEven Trunc FAbs FSign */
+    case 8: case 9: case 10:                            /* Floor Ceil Fract */
+    case 13: case 14: case 26: case 27: case 28:        /* Sin Cos Pow Exp Log */
+    case 29: case 30: case 31: case 32:                 /* Exp2 Log2 Sqrt InverseSqrt */
+    case 37: case 40: case 43: case 46:                 /* FMin FMax FClamp FMix */
+    case 48: case 49: case 50:                          /* Step SmoothStep Fma */
+    case 66: case 67: case 68: case 69: case 71:        /* Length Distance Cross Normalize Reflect */
+    case 79: case 80: case 81:                          /* NMin NMax NClamp */
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+/* Float arithmetic (or moves of its results) worth running at half precision. */
+static int relaxable(const uint32_t* w, uint32_t glsl)
+{
+    switch (w[0] & 0xffffu) {
+    case XENO_SPV_OP_F_NEGATE:
+    case XENO_SPV_OP_F_ADD:
+    case XENO_SPV_OP_F_SUB:
+    case XENO_SPV_OP_F_MUL:
+    case XENO_SPV_OP_F_DIV:
+    case XENO_SPV_OP_F_REM:
+    case XENO_SPV_OP_F_MOD:
+    case XENO_SPV_OP_VECTOR_TIMES_SCALAR:
+    case XENO_SPV_OP_DOT:
+    case XENO_SPV_OP_SELECT:
+    case XENO_SPV_OP_VECTOR_SHUFFLE:
+    case XENO_SPV_OP_COMPOSITE_CONSTRUCT:
+    case XENO_SPV_OP_COMPOSITE_EXTRACT:
+    case XENO_SPV_OP_COMPOSITE_INSERT:
+    case XENO_SPV_OP_COPY_OBJECT:
+        return (w[0] >> 16) >= 3u;
+    case XENO_SPV_OP_EXT_INST:
+        return (w[0] >> 16) >= 5u && glsl && w[3] == glsl && glsl_relaxable(w[4]);
+    default:
+        return 0;
+    }
+}
+
+static int debug_op(uint32_t op, int keep_strings)
+{
+    switch (op) {
+    case XENO_SPV_OP_NAME:
+    case XENO_SPV_OP_MEMBER_NAME:
+    case XENO_SPV_OP_MODULE_PROCESSED:
+        return 1;
+    case XENO_SPV_OP_SOURCE_CONTINUED:
+    case XENO_SPV_OP_SOURCE:
+    case XENO_SPV_OP_SOURCE_EXTENSION:
+    case XENO_SPV_OP_STRING:
+    case XENO_SPV_OP_LINE:
+    case XENO_SPV_OP_NO_LINE:
+        return !keep_strings;   /* NonSemantic debug info refers to the strings */
+    default:
+        return 0;
+    }
+}
+
+/* Instructions that precede the types; new decorations go after them. */
+static int preamble_op(uint32_t op)
+{
+    switch (op) {
+    case XENO_SPV_OP_CAPABILITY:
+    case XENO_SPV_OP_EXTENSION:
+    case XENO_SPV_OP_EXT_INST_IMPORT:
+    case XENO_SPV_OP_MEMORY_MODEL:
+    case XENO_SPV_OP_ENTRY_POINT:
+    case XENO_SPV_OP_EXECUTION_MODE:
+    case XENO_SPV_OP_EXECUTION_MODE_ID:
+    case XENO_SPV_OP_SOURCE_CONTINUED:
+    case XENO_SPV_OP_SOURCE:
+    case XENO_SPV_OP_SOURCE_EXTENSION:
+    case XENO_SPV_OP_NAME:
+    case XENO_SPV_OP_MEMBER_NAME:
+    case XENO_SPV_OP_STRING:
+    case XENO_SPV_OP_MODULE_PROCESSED:
+    case XENO_SPV_OP_DECORATE:
+    case XENO_SPV_OP_MEMBER_DECORATE:
+    case XENO_SPV_OP_DECORATION_GROUP:
+    case XENO_SPV_OP_GROUP_DECORATE:
+    case XENO_SPV_OP_GROUP_MEMBER_DECORATE:
+    case XENO_SPV_OP_DECORATE_ID:
+    case XENO_SPV_OP_DECORATE_STRING:
+    case XENO_SPV_OP_MEMBER_DECORATE_STRING:
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+static int decorates(uint32_t op)
+{
+    return op == XENO_SPV_OP_DECORATE || op == XENO_SPV_OP_DECORATE_ID || op == XENO_SPV_OP_DECORATE_STRING;
+}
+
+/* Whether the instruction at `at` goes; flags must be final. */
+static int strip(const XenoSpirvModule* m, uint32_t at, const uint16_t* flags, int keep_strings)
+{
+    const uint32_t* w = &m->words[at];
+    uint32_t op = w[0] & 0xffffu;
+    if (debug_op(op, keep_strings)) return 1;
+    if (op == XENO_SPV_OP_VARIABLE && (w[0] >> 16) >= 4u && w[2] < m->bound) return (flags[w[2]] & (ID_FUNC_VAR | ID_USED)) == ID_FUNC_VAR;
+    if (decorates(op) && (w[0] >> 16) >= 3u && w[1] < m->bound) return (flags[w[1]] & (ID_FUNC_VAR | ID_USED)) == ID_FUNC_VAR;
+    return 0;
+}
+
+uint32_t* xeno_spirv_relax(const uint32_t* words, size_t byte_len, size_t* out_bytes, XenoSpirvOptStats* stats)
+{
+    XenoSpirvModule m;
+    if (!xeno_spirv_parse(words, byte_len, &m) || m.stages != 1u << XENO_SPV_MODEL_FRAGMENT) return NULL;
+    uint16_t* flags = (uint16_t*)calloc(m.bound, sizeof(*flags));
+    uint32_t* order = (uint32_t*)malloc(sizeof(*order) * m.instructions);
+    if (!flags || !order) {
+        free(flags);
+        free(order);
+        return NULL;
+    }
+
+    /* Types, outputs, decorations and candidates, in module order (every
+       id is declared before anything that names it, bar forward pointers). */
+    uint32_t glsl = 0, body = 0;
+    int keep_strings = 0;
+    for (uint32_t at = XENO_SPIRV_HEADER_WORDS; at < m.word_count; at += xeno_spirv_length(&m, at)) {
+        const uint32_t* w = &words[at];
+        uint32_t op = w[0] & 0xffffu, len = w[0] >> 16;
+        if (at >= m.first_function) order[body++] = at;
+        /* Anything naming an id uses it, except names and decorations. */
+        if (op != XENO_SPV_OP_NAME && op != XENO_SPV_OP_MEMBER_NAME && !decorates(op)) {
+            for (uint32_t k = 1; k < len; ++k) {
+                if (w[k] < m.bound && !(op == XENO_SPV_OP_VARIABLE && k == 2u)) flags[w[k]] |= ID_USED;
+            }
+        }
+        switch (op) {
+        case XENO_SPV_OP_EXT_INST_IMPORT:
+            if (len >= 3u && w[1] < m.bound) {
+                const char* name = (const char*)&w[2];
+                if (!memchr(name, 0, (len - 2u) * 4u)) break;
+                if (strcmp(name, "GLSL.std.450") == 0) glsl = w[1];
+                else if (strncmp(name, "NonSemantic.", 12) == 0) keep_strings = 1;
+            }
+            break;
+        case XENO_SPV_OP_DECORATE:
+            if (len >= 3u && w[1] < m.bound) {
+                if (w[2] == XENO_SPV_DECORATION_RELAXED_PRECISION) flags[w[1]] |= ID_RELAXED;
+                else if (w[2] == XENO_SPV_DECORATION_BUILT_IN) flags[w[1]] |= ID_BUILT_IN;
+                else if (w[2] == XENO_SPV_DECORATION_NO_CONTRACTION) flags[w[1]] |= ID_PRECISE;
+            }
+            break;
+        case XENO_SPV_OP_TYPE_FLOAT:
+            if (len >= 3u && w[1] < m.bound && w[2] == 32u) flags[w[1]] |= ID_FLOAT;
+            break;
+        case XENO_SPV_OP_TYPE_VECTOR:
+            if (len >= 4u && w[1] < m.bound && w[2] < m.bound && (flags[w[2]] & ID_FLOAT)) flags[w[1]] |= ID_FLOAT;
+            break;
+        case XENO_SPV_OP_TYPE_POINTER:
+            if (len >= 4u && w[1] < m.bound && w[2] == XENO_SPV_STORAGE_OUTPUT && w[3] < m.bound &&
+                (flags[w[3]] & ID_FLOAT)) {
+                flags[w[1]] |= ID_OUT_FLOAT_PTR;
+            }
+            break;
+        case XENO_SPV_OP_VARIABLE:
+            if (len >= 4u && w[1] < m.bound && w[2] < m.bound) {
+                if ((flags[w[1]] & ID_OUT_FLOAT_PTR) && !(flags[w[2]] & ID_BUILT_IN)) flags[w[2]] |= ID_COLOR;
+                if (w[3] == XENO_SPV_STORAGE_FUNCTION) flags[w[2]] |= ID_FUNC_VAR;
+            }
+            break;
+        default:
+            if (len >= 3u && w[1] < m.bound && w[2] < m.bound && (flags[w[1]] & ID_FLOAT) &&
+                !(flags[w[2]] & ID_PRECISE) && relaxable(w, glsl)) {
+                flags[w[2]] |= ID_ELIGIBLE;
+            }
+            break;
+        }
+    }
+
+    for (int changed = 1; changed;) {
+        changed = 0;
+        for (uint32_t i = body; i-- > 0;) {
+            const uint32_t* w = &words[order[i]];
+            uint32_t op = w[0] & 0xffffu, len = w[0] >> 16;
+            if (relaxable(w, glsl) && w[2] < m.bound && (flags[w[2]] & ID_ELIGIBLE)) continue;
+            uint32_t k = 1;
+            if (op == XENO_SPV_OP_STORE && len >= 3u && w[1] < m.bound && (flags[w[1]] & ID_COLOR)) k = 3;
+            for (; k < len; ++k) {
+                if (w[k] < m.bound && (flags[w[k]] & ID_ELIGIBLE)) {
+                    flags[w[k]] &= (uint16_t)~ID_ELIGIBLE;
+                    changed = 1;
+                }
+            }
+        }
+    }
+    free(order);
+
+    uint32_t relaxed = 0, stripped = 0, dropped_words = 0, insert_at = 0;
+    for (uint32_t id = 1; id < m.bound; ++id) {
+        if ((flags[id] & (ID_ELIGIBLE | ID_RELAXED)) == ID_ELIGIBLE) relaxed++;
+    }
+    for (uint32_t at = XENO_SPIRV_HEADER_WORDS; at < m.word_count; at += xeno_spirv_length(&m, at)) {
+        if (!insert_at && !preamble_op(xeno_spirv_opcode(&m, at))) insert_at = at;
+        if (strip(&m, at, flags, keep_strings)) {
+            stripped++;
+            dropped_words += xeno_spirv_length(&m, at);
+        }
+    }
+    if ((!relaxed && !stripped) || !insert_at) {
+        free(flags);
+        return NULL;
+    }
+
+    uint32_t count = m.word_count - dropped_words + 3u * relaxed;
+    uint32_t* out = (uint32_t*)malloc(sizeof(*out) * count);
+    if (!out) {
+        free(flags);
+        return NULL;
+    }
+    memcpy(out, words, sizeof(*out) * XENO_SPIRV_HEADER_WORDS);
+    uint32_t n = XENO_SPIRV_HEADER_WORDS;
+    for (uint32_t at = XENO_SPIRV_HEADER_WORDS; at < m.word_count; at += xeno_spirv_length(&m, at)) {
+        if (at == insert_at) {
+            for (uint32_t id = 1; id < m.bound; ++id) {
+                if ((flags[id] & (ID_ELIGIBLE | ID_RELAXED)) != ID_ELIGIBLE) continue;
+                out[n++] = 3u << 16 | XENO_SPV_OP_DECORATE;
+                out[n++] = id;
+                out[n++] = XENO_SPV_DECORATION_RELAXED_PRECISION;
+            }
+        }
+        if (strip(&m, at, flags, keep_strings)) continue;
+        memcpy(&out[n], &words[at], sizeof(*out) * xeno_spirv_length(&m, at));
+        n += xeno_spirv_length(&m, at);
+    }
+    free(flags);
+    *out_bytes = sizeof(*out) * n;
+    if (stats) {
+        stats->relaxed = relaxed;
+        stats->stripped = stripped;
+    }
+    return out;
+}
+
+/* ---- disk cache --------------------------------------------------- */
+
+static uint64_t hash_words(const uint32_t* words, size_t count)
+{
+    uint64_t h = 0xcbf29ce484222325ull;
+    for (size_t i = 0; i < count; ++i) {
+        h ^= words[i];
+        h *= 0x100000001b3ull;
+        h ^= h >> 32;
+    }
+    return h;
+}
+
+static void cache_path(char* out, size_t cap, uint64_t key)
+{
+    snprintf(out, cap, "%.511s/spirv/%016llx.spv", xeno_perf_conf_active()->shader_cache_dir, (unsigned long long)key);
+}
+
+/* 1 when the cache knows the module: *out is its rewrite, or NULL when
+   the pass leaves it alone. */
+static int cache_load(uint64_t key, size_t in_bytes, uint32_t** out, size_t* out_bytes)
+{
+    char path[640];
+    cache_path(path, sizeof(path), key);
+    FILE* f = fopen(path, "rb");
+    if (!f) return 0;
+    XenoSpirvCacheHeader h;
+    int ok = fread(&h, sizeof(h), 1, f) == 1 && h.magic == XENO_SPIRV_CACHE_MAGIC &&
+             h.version == XENO_SPIRV_OPT_VERSION && h.key == key && h.in_bytes == in_bytes &&
+             h.out_bytes % 4u == 0 && h.out_bytes <= in_bytes * 2u;
+    uint32_t* words = NULL;
+    if (ok && h.out_bytes) {
+        words = (uint32_t*)malloc(h.out_bytes);
+        ok = words && fread(words, h.out_bytes, 1, f) == 1 && hash_words(words, h.out_bytes / 4u) == h.checksum;
+    }
+    fclose(f);
+    if (!ok) {
+        XENO_LOGD("spirv: ignoring stale or corrupt %s", path);
+        free(words);
+        return 0;
+    }
+    *out = words;
+    *out_bytes = h.out_bytes;
+    return 1;
+}
+
+static void cache_store(uint64_t key, size_t in_bytes, const uint32_t* words, size_t out_bytes)
+{
+    char path[640], tmp[660];
+    snprintf(path, sizeof(path), "%.511s/spirv", xeno_perf_conf_active()->shader_cache_dir);
+    mkdir(path, 0755);
+    cache_path(path, sizeof(path), key);
+    snprintf(tmp, sizeof(tmp), "%s.%d.tmp", path, (int)getpid());
+
+    XenoSpirvCacheHeader h = {
+        .magic = XENO_SPIRV_CACHE_MAGIC, .version = XENO_SPIRV_OPT_VERSION, .key = key, .in_bytes = in_bytes,
+        .out_bytes = out_bytes, .checksum = words ? hash_words(words, out_bytes / 4u) : 0,
+    };
+    FILE* f = fopen(tmp, "wb");
+    if (!f) {
+        XENO_LOGD("spirv: cannot write %s", tmp);
+        return;
+    }
+    int ok = fwrite(&h, sizeof(h), 1, f) == 1 && (!out_bytes || fwrite(words, out_bytes, 1, f) == 1);
+    ok = (fclose(f) == 0) && ok;
+    if (!ok || rename(tmp, path) != 0) unlink(tmp);
+}
+
+uint32_t* xeno_spirv_opt_module(const uint32_t* code, size_t code_size, size_t* out_bytes)
+{
+    if (!xeno_perf_conf_active()->shader_fp16 || !code || code_size % 4u) return NULL;
+    uint64_t key = hash_words(code, code_size / 4u);
+    uint32_t* out = NULL;
+    if (cache_load(key, code_size, &out, out_bytes)) return out;
+
+    XenoSpirvOptStats stats = { 0 };
+    out = xeno_spirv_relax(code, code_size, out_bytes, &stats);
+    cache_store(key, code_size, out, out ? *out_bytes : 0);
+    if (out) {
+        XENO_LOGD("spirv: module %016llx: %u results relaxed, %u instructions stripped", (unsigned long long)key,
+                  stats.relaxed, stats.stripped);
+    }
+    return out;
+}
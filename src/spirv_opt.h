@@ -0,0 +1,44 @@
+// src/spirv_opt.h
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+  Fragment-shader precision pass (spirv_opt.c).
+
+  With perf_conf shader_fp16=1 (normally set from a game profile), app
+  modules whose entry points are all fragment shaders are rewritten on
+  their way to vkCreateShaderModule:
+
+  - float arithmetic whose results only reach color outputs, directly or
+    through more such arithmetic, is decorated RelaxedPrecision so the
+    compiler may run it at half precision, which has about twice the ALU
+    rate on Xclipse;
+  - OpName, OpLine, OpSource and the other debug instructions are dropped,
+    as are function-scope variables nothing refers to.
+
+  A value keeps full precision as soon as anything else uses it: texture
+  coordinates, comparisons, branches, phis, calls, stores to anything but
+  a color output. Depth and other built-in outputs are never relaxed.
+
+  Results are cached in <shader_cache_dir>/spirv keyed by a hash of the
+  original module, so later launches skip the pass; modules the pass
+  leaves alone are cached as such.
+*/
+
+#define XENO_SPIRV_OPT_VERSION 1u   /* bump when the pass output changes */
+
+typedef struct XenoSpirvOptStats {
+    uint32_t relaxed;           /* results decorated */
+    uint32_t stripped;          /* instructions removed */
+} XenoSpirvOptStats;
+
+/* The pass alone: a malloc'd rewrite of the module and its size, or NULL
+   when the module is malformed, not fragment-only or left unchanged. */
+uint32_t* xeno_spirv_relax(const uint32_t* words, size_t byte_len, size_t* out_bytes, XenoSpirvOptStats* stats);
+
+/* vkCreateShaderModule: the code to create instead of the app's (free()
+   it afterwards), or NULL to create the app's as is. Consults and fills
+   the disk cache; NULL without shader_fp16. */
+uint32_t* xeno_spirv_opt_module(const uint32_t* code, size_t code_size, size_t* out_bytes);
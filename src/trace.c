@@ -0,0 +1,299 @@
+// src/trace.c
+/*
+  Timeline tracing backend (see include/xeno_trace.h).
+
+  Each thread appends fixed-size events to its own buffer; the buffer wraps,
+  so a capture always holds the most recent events of every thread. Buffers
+  of exited threads are handed to the next new thread, so worker churn does
+  not grow the set (events keep the tid of the thread that wrote them). A small
+  control thread (started only when EXYNOSTOOLS_TRACE is set) handles the
+  SIGUSR2 trigger and the capture timeout, and writes the JSON file off the
+  render threads.
+*/
+#include "xeno_trace.h"
+#include "xeno_log.h"
+#include "perf_conf.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#define XENO_TRACE_EVENTS_PER_THREAD (1u << 16)   /* 64K events of 32 bytes, 2 MB per thread */
+#define XENO_TRACE_DEFAULT_SECONDS   10
+#define XENO_TRACE_POLL_NS           50000000L    /* control thread tick */
+
+typedef struct XenoTraceEvent {
+    uint64_t ts_ns;
+    const char *name;
+    int64_t value;
+    int32_t tid;
+    char phase;             /* 'B', 'E', 'i', 'C' */
+} XenoTraceEvent;
+
+typedef struct XenoTraceBuffer {
+    _Atomic uint64_t count;  /* total events written; index = count % capacity */
+    uint64_t capture_start;  /* count at the start of the current capture */
+    _Atomic int writing;     /* owner is between its active check and publishing */
+    _Atomic int owned;       /* cleared when the owning thread exits */
+    int tid;
+    struct XenoTraceBuffer *next;
+    XenoTraceEvent events[XENO_TRACE_EVENTS_PER_THREAD];
+} XenoTraceBuffer;
+
+_Atomic int xeno_trace_active_g = 0;
+
+static _Atomic(XenoTraceBuffer *) g_buffers = NULL;
+static _Thread_local XenoTraceBuffer *t_buffer = NULL;
+static pthread_once_t g_key_once = PTHREAD_ONCE_INIT;
+static pthread_key_t g_buffer_key;
+static int g_key_ok = 0;
+
+static _Atomic int g_signal_toggle = 0;
+static _Atomic int g_control_stop = 0;
+static int g_control_running = 0;
+static pthread_t g_control;
+static _Atomic uint64_t g_capture_start_ns = 0;
+static pthread_mutex_t g_flush_mtx = PTHREAD_MUTEX_INITIALIZER;
+static int g_capture_seconds = XENO_TRACE_DEFAULT_SECONDS;
+static char g_out_path[600];
+
+static inline uint64_t trace_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static void trace_buffer_release(void *p)
+{
+    XenoTraceBuffer *b = (XenoTraceBuffer *)p;
+    if (b) atomic_store_explicit(&b->owned, 0, memory_order_release);
+}
+
+static void trace_key_init(void)
+{
+    g_key_ok = pthread_key_create(&g_buffer_key, trace_buffer_release) == 0;
+}
+
+static XenoTraceBuffer *trace_thread_buffer(void)
+{
+    XenoTraceBuffer *b = t_buffer;
+    if (b) return b;
+
+    /* Without the key an exited thread's buffer would never be handed back,
+       so it must not be taken either; every thread then gets its own. */
+    pthread_once(&g_key_once, trace_key_init);
+    const int tid = (int)syscall(SYS_gettid);
+    if (g_key_ok) {
+        for (b = atomic_load_explicit(&g_buffers, memory_order_acquire); b; b = b->next) {
+            int expected = 0;
+            if (atomic_compare_exchange_strong_explicit(&b->owned, &expected, 1,
+                                                        memory_order_acq_rel, memory_order_relaxed)) {
+                b->tid = tid;
+                pthread_setspecific(g_buffer_key, b);
+                return t_buffer = b;
+            }
+        }
+    }
+
+    b = (XenoTraceBuffer *)calloc(1, sizeof(*b));
+    if (!b) return NULL;
+    b->tid = tid;
+    atomic_store_explicit(&b->owned, 1, memory_order_relaxed);
+    XenoTraceBuffer *head = atomic_load_explicit(&g_buffers, memory_order_relaxed);
+    do {
+        b->next = head;
+    } while (!atomic_compare_exchange_weak_explicit(&g_buffers, &head, b,
+                                                    memory_order_release, memory_order_relaxed));
+    if (g_key_ok) pthread_setspecific(g_buffer_key, b);
+    return t_buffer = b;
+}
+
+static void trace_push(char phase, const char *name, int64_t value)
+{
+    XenoTraceBuffer *b = trace_thread_buffer();
+    if (!b) return;
+    /* Raise writing before re-checking active: the flush clears active
+       before it waits on writing, so one of the two always sees the other. */
+    atomic_store_explicit(&b->writing, 1, memory_order_seq_cst);
+    if (!atomic_load_explicit(&xeno_trace_active_g, memory_order_seq_cst)) {
+        atomic_store_explicit(&b->writing, 0, memory_order_release);
+        return;
+    }
+    uint64_t n = atomic_load_explicit(&b->count, memory_order_relaxed);
+    XenoTraceEvent *e = &b->events[n & (XENO_TRACE_EVENTS_PER_THREAD - 1u)];
+    e->ts_ns = trace_now_ns();
+    e->name = name;
+    e->value = value;
+    e->tid = b->tid;
+    e->phase = phase;
+    atomic_store_explicit(&b->count, n + 1u, memory_order_release);
+    atomic_store_explicit(&b->writing, 0, memory_order_release);
+}
+
+void xeno_trace_record_begin(const char *name)   { trace_push('B', name, 0); }
+void xeno_trace_record_end(const char *name)     { trace_push('E', name, 0); }
+void xeno_trace_record_instant(const char *name) { trace_push('i', name, 0); }
+void xeno_trace_record_counter(const char *name, int64_t value) { trace_push('C', name, value); }
+
+void xeno_trace_start(void)
+{
+    pthread_mutex_lock(&g_flush_mtx);
+    if (!atomic_load_explicit(&xeno_trace_active_g, memory_order_relaxed)) {
+        for (XenoTraceBuffer *b = atomic_load_explicit(&g_buffers, memory_order_acquire); b; b = b->next) {
+            b->capture_start = atomic_load_explicit(&b->count, memory_order_acquire);
+        }
+        atomic_store_explicit(&g_capture_start_ns, trace_now_ns(), memory_order_relaxed);
+        atomic_store_explicit(&xeno_trace_active_g, 1, memory_order_release);
+        XENO_LOGI("trace: capture started (%d s)", g_capture_seconds);
+    }
+    pthread_mutex_unlock(&g_flush_mtx);
+}
+
+static void trace_resolve_path(void)
+{
+    if (g_out_path[0]) return;
+    const char *path = getenv("EXYNOSTOOLS_TRACE_FILE");
+    if (path && *path) {
+        snprintf(g_out_path, sizeof(g_out_path), "%s", path);
+    } else {
+        XenoPerfConf defaults;
+        xeno_perf_conf_defaults(&defaults);
+        snprintf(g_out_path, sizeof(g_out_path), "%.511s/exynostools-trace-%d.json",
+                 defaults.shader_cache_dir, (int)getpid());
+    }
+}
+
+static void json_write_name(FILE *f, const char *s)
+{
+    fputc('"', f);
+    for (; s && *s; ++s) {
+        if (*s == '"' || *s == '\\') fputc('\\', f);
+        if ((unsigned char)*s >= 0x20) fputc(*s, f);
+    }
+    fputc('"', f);
+}
+
+void xeno_trace_stop_and_flush(void)
+{
+    pthread_mutex_lock(&g_flush_mtx);
+    if (!atomic_exchange_explicit(&xeno_trace_active_g, 0, memory_order_seq_cst)) {
+        pthread_mutex_unlock(&g_flush_mtx);
+        return;
+    }
+    /* Producers that passed the active check finish their event; any later
+       push sees active cleared and drops out. */
+    for (XenoTraceBuffer *b = atomic_load_explicit(&g_buffers, memory_order_acquire); b; b = b->next) {
+        while (atomic_load_explicit(&b->writing, memory_order_seq_cst)) sched_yield();
+    }
+
+    trace_resolve_path();
+    FILE *f = fopen(g_out_path, "w");
+    if (!f) {
+        XENO_LOGW("trace: cannot open %s", g_out_path);
+        pthread_mutex_unlock(&g_flush_mtx);
+        return;
+    }
+
+    const int pid = (int)getpid();
+    size_t written = 0;
+    fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    fprintf(f, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":0,\"args\":{\"name\":\"ExynosTools\"}}", pid);
+    for (XenoTraceBuffer *b = atomic_load_explicit(&g_buffers, memory_order_acquire); b; b = b->next) {
+        uint64_t end = atomic_load_explicit(&b->count, memory_order_acquire);
+        uint64_t begin = b->capture_start;
+        if (end - begin > XENO_TRACE_EVENTS_PER_THREAD) begin = end - XENO_TRACE_EVENTS_PER_THREAD;
+        for (uint64_t i = begin; i < end; ++i) {
+            const XenoTraceEvent *e = &b->events[i & (XENO_TRACE_EVENTS_PER_THREAD - 1u)];
+            fputs(",\n{\"name\":", f);
+            json_write_name(f, e->name);
+            fprintf(f, ",\"ph\":\"%c\",\"ts\":%llu.%03u,\"pid\":%d,\"tid\":%d",
+                    e->phase, (unsigned long long)(e->ts_ns / 1000ull), (unsigned)(e->ts_ns % 1000ull),
+                    pid, e->tid);
+            if (e->phase == 'C') fprintf(f, ",\"args\":{\"value\":%lld}", (long long)e->value);
+            else if (e->phase == 'i') fputs(",\"s\":\"t\"", f);
+            fputc('}', f);
+            ++written;
+        }
+        b->capture_start = end;
+    }
+    fprintf(f, "\n]}\n");
+    fclose(f);
+    XENO_LOGI("trace: wrote %zu events to %s", written, g_out_path);
+    pthread_mutex_unlock(&g_flush_mtx);
+}
+
+static void trace_sigusr2(int sig)
+{
+    (void)sig;
+    atomic_store_explicit(&g_signal_toggle, 1, memory_order_relaxed);
+}
+
+static void *trace_control_main(void *arg)
+{
+    (void)arg;
+    while (!atomic_load_explicit(&g_control_stop, memory_order_relaxed)) {
+        struct timespec tick = { 0, XENO_TRACE_POLL_NS };
+        nanosleep(&tick, NULL);
+
+        int toggled = atomic_exchange_explicit(&g_signal_toggle, 0, memory_order_relaxed);
+        int active = atomic_load_explicit(&xeno_trace_active_g, memory_order_relaxed);
+        if (toggled && !active) {
+            xeno_trace_start();
+        } else if (active) {
+            uint64_t started = atomic_load_explicit(&g_capture_start_ns, memory_order_relaxed);
+            if (toggled || trace_now_ns() - started >= (uint64_t)g_capture_seconds * 1000000000ull) {
+                xeno_trace_stop_and_flush();
+            }
+        }
+    }
+    return NULL;
+}
+
+__attribute__((constructor))
+static void xeno_trace_init_from_env(void)
+{
+    const char *mode = getenv("EXYNOSTOOLS_TRACE");
+    if (!mode || !*mode || *mode == '0') return;
+
+    const char *secs = getenv("EXYNOSTOOLS_TRACE_SECONDS");
+    if (secs && atoi(secs) > 0) g_capture_seconds = atoi(secs);
+
+    trace_resolve_path();
+
+    if (strcmp(mode, "signal") == 0) {
+        struct sigaction sa;
+        memset(&sa, 0, sizeof(sa));
+        sa.sa_handler = trace_sigusr2;
+        sigemptyset(&sa.sa_mask);
+        sa.sa_flags = SA_RESTART;
+        sigaction(SIGUSR2, &sa, NULL);
+    } else {
+        xeno_trace_start();
+    }
+
+    if (pthread_create(&g_control, NULL, trace_control_main, NULL) == 0) {
+        g_control_running = 1;
+    } else {
+        XENO_LOGW("trace: control thread unavailable, capture is flushed at exit only");
+    }
+}
+
+__attribute__((destructor))
+static void xeno_trace_shutdown(void)
+{
+    if (g_control_running) {
+        atomic_store_explicit(&g_control_stop, 1, memory_order_relaxed);
+        pthread_join(g_control, NULL);
+        g_control_running = 0;
+    }
+    xeno_trace_stop_and_flush();
+}
@@ -0,0 +1,466 @@
+// src/xeno_cmd.c
+/*
+  Command-buffer state registry (see xeno_cmd.h).
+
+  States live in an open-addressing table per device, keyed by the
+  command-buffer handle and guarded by a mutex; removal shifts the probe
+  chain back so there are no tombstones. Only allocation, free and cache
+  misses take the lock.
+*/
+#include "xeno_cmd.h"
+#include "perf_conf.h"
+#include "xeno_log.h"
+#include "xeno_trace.h"
+
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#define XENO_CMD_MIN_SLOTS 64u
+#define XENO_CMD_SYNC1_CHUNK 32u
+
+struct XenoCmdTable {
+    pthread_mutex_t mtx;
+    XenoCmdState** slots;
+    uint32_t cap;               /* power of two */
+    uint32_t count;
+    int max_mode;               /* strongest XENO_BARRIER_* this device allows */
+    int coalesce;               /* the layer sees every command doing work */
+    int sync2;                  /* synchronization2 enabled: emit through vkCmdPipelineBarrier2 */
+    _Atomic uint64_t calls_in, calls_out, dropped, deferred, folded, narrowed, coalesced, deduped;
+};
+
+/* Bumped after a state goes away or a handle gets a new one; thread
+   caches filled before that then miss. */
+static _Atomic uint64_t g_cmd_epoch = 1;
+static _Thread_local struct { VkCommandBuffer cmd; XenoCmdState* state; uint64_t epoch; } t_last;
+
+/* Extensions whose vkCmd* do work outside render passes the layer does
+   not intercept; narrowing, deferral and coalescing would not see it. */
+static const char* const k_unseen_work_exts[] = {
+    "VK_NV_device_generated_commands",
+    "VK_EXT_device_generated_commands",
+    "VK_NV_device_generated_commands_compute",
+    "VK_EXT_opacity_micromap",
+    "VK_NV_copy_memory_indirect",
+    "VK_KHR_copy_memory_indirect",
+    "VK_NV_memory_decompression",
+    "VK_KHR_video_decode_queue",
+    "VK_KHR_video_encode_queue",
+    "VK_HUAWEI_subpass_shading",
+    "VK_HUAWEI_cluster_culling_shader",
+    "VK_AMDX_shader_enqueue",
+    "VK_NVX_binary_import",
+    "VK_AMD_buffer_marker",
+    "VK_NV_optical_flow",
+    "VK_ARM_tensors",
+    "VK_ARM_data_graph",
+    "VK_NV_ray_tracing",
+    "VK_NV_cluster_acceleration_structure",
+    "VK_NV_partitioned_acceleration_structure",
+    "VK_NV_cooperative_vector",
+    "VK_NV_cuda_kernel_launch",
+};
+
+static uint32_t cmd_hash(VkCommandBuffer cmd, uint32_t mask)
+{
+    return (uint32_t)(((uint64_t)(uintptr_t)cmd * 0x9E3779B97F4A7C15ull) >> 32) & mask;
+}
+
+/* ---- sync_mode -> driver ------------------------------------------ */
+
+static VkPipelineStageFlags sync1_stages(VkPipelineStageFlags2 m, VkPipelineStageFlags none)
+{
+    VkPipelineStageFlags s = (VkPipelineStageFlags)(m & 0xFFFFFFFFull);
+    return s ? s : none;
+}
+
+/* sync1 calls have one pair of stage masks; a union of the rewritten
+   per-barrier masks is never weaker. Large calls go out in chunks, which
+   only adds ordering between them. */
+static void emit_sync1(XenoCmdState* s, const XenoBarrierBatch* b)
+{
+    VkPipelineStageFlags2 src = 0, dst = 0;
+    VkMemoryBarrier mem = { .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER };
+    for (uint32_t i = 0; i < b->mem_count; ++i) {
+        src |= b->mem[i].srcStageMask;
+        dst |= b->mem[i].dstStageMask;
+        mem.srcAccessMask |= (VkAccessFlags)b->mem[i].srcAccessMask;
+        mem.dstAccessMask |= (VkAccessFlags)b->mem[i].dstAccessMask;
+    }
+    for (uint32_t i = 0; i < b->buf_count; ++i) {
+        src |= b->buf[i].srcStageMask;
+        dst |= b->buf[i].dstStageMask;
+    }
+    for (uint32_t i = 0; i < b->img_count; ++i) {
+        src |= b->img[i].srcStageMask;
+        dst |= b->img[i].dstStageMask;
+    }
+    VkPipelineStageFlags src1 = sync1_stages(src, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT);
+    VkPipelineStageFlags dst1 = sync1_stages(dst, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT);
+
+    VkBufferMemoryBarrier buf[XENO_CMD_SYNC1_CHUNK];
+    VkImageMemoryBarrier img[XENO_CMD_SYNC1_CHUNK];
+    uint32_t bi = 0, ii = 0;
+    int first = 1;
+    do {
+        uint32_t nb = 0, ni = 0;
+        for (; bi < b->buf_count && nb < XENO_CMD_SYNC1_CHUNK; ++bi, ++nb) {
+            const VkBufferMemoryBarrier2* x = &b->buf[bi];
+            buf[nb] = (VkBufferMemoryBarrier){
+                .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER, .pNext = x->pNext,
+                .srcAccessMask = (VkAccessFlags)x->srcAccessMask, .dstAccessMask = (VkAccessFlags)x->dstAccessMask,
+                .srcQueueFamilyIndex = x->srcQueueFamilyIndex, .dstQueueFamilyIndex = x->dstQueueFamilyIndex,
+                .buffer = x->buffer, .offset = x->offset, .size = x->size,
+            };
+        }
+        for (; ii < b->img_count && ni < XENO_CMD_SYNC1_CHUNK; ++ii, ++ni) {
+            const VkImageMemoryBarrier2* x = &b->img[ii];
+            img[ni] = (VkImageMemoryBarrier){
+                .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER, .pNext = x->pNext,
+                .srcAccessMask = (VkAccessFlags)x->srcAccessMask, .dstAccessMask = (VkAccessFlags)x->dstAccessMask,
+                .oldLayout = x->oldLayout, .newLayout = x->newLayout,
+                .srcQueueFamilyIndex = x->srcQueueFamilyIndex, .dstQueueFamilyIndex = x->dstQueueFamilyIndex,
+                .image = x->image, .subresourceRange = x->subresourceRange,
+            };
+        }
+        uint32_t nm = first && b->mem_count ? 1u : 0u;
+        s->d->CmdPipelineBarrier(s->cmd, src1, dst1, b->flags, nm, &mem, nb, buf, ni, img);
+        first = 0;
+    } while (bi < b->buf_count || ii < b->img_count);
+}
+
+static void emit_batch(void* user, const XenoBarrierBatch* b)
+{
+    XenoCmdState* s = (XenoCmdState*)user;
+    if (!(b->sync2 || s->d->cmds->sync2) || !s->d->CmdPipelineBarrier2) {
+        emit_sync1(s, b);
+        return;
+    }
+    VkDependencyInfo info = {
+        .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
+        .dependencyFlags = b->flags,
+        .memoryBarrierCount = b->mem_count, .pMemoryBarriers = b->mem,
+        .bufferMemoryBarrierCount = b->buf_count, .pBufferMemoryBarriers = b->buf,
+        .imageMemoryBarrierCount = b->img_count, .pImageMemoryBarriers = b->img,
+    };
+    s->d->CmdPipelineBarrier2(s->cmd, &info);
+}
+
+/* Folds a tracker's counters into the device totals. */
+static void collect_stats(XenoCmdTable* tab, XenoCmdState* s)
+{
+    XenoBarrierStats* st = &s->barrier.stats;
+    if (!st->calls_in) return;
+    atomic_fetch_add_explicit(&tab->calls_in, st->calls_in, memory_order_relaxed);
+    atomic_fetch_add_explicit(&tab->calls_out, st->calls_out, memory_order_relaxed);
+    atomic_fetch_add_explicit(&tab->dropped, st->dropped, memory_order_relaxed);
+    atomic_fetch_add_explicit(&tab->deferred, st->deferred, memory_order_relaxed);
+    atomic_fetch_add_explicit(&tab->folded, st->folded, memory_order_relaxed);
+    atomic_fetch_add_explicit(&tab->narrowed, st->narrowed, memory_order_relaxed);
+    atomic_fetch_add_explicit(&tab->coalesced, st->coalesced, memory_order_relaxed);
+    atomic_fetch_add_explicit(&tab->deduped, st->deduped, memory_order_relaxed);
+    memset(st, 0, sizeof(*st));
+}
+
+static void state_free(XenoCmdTable* tab, XenoCmdState* s)
+{
+    collect_stats(tab, s);
+    xeno_barrier_tracker_free(&s->barrier);
+    free(s);
+}
+
+/* ---- table (caller holds mtx) ------------------------------------- */
+
+static int table_grow(XenoCmdTable* tab)
+{
+    uint32_t cap = tab->cap ? tab->cap * 2u : XENO_CMD_MIN_SLOTS;
+    XenoCmdState** slots = (XenoCmdState**)calloc(cap, sizeof(*slots));
+    if (!slots) return 0;
+    for (uint32_t i = 0; i < tab->cap; ++i) {
+        XenoCmdState* s = tab->slots[i];
+        if (!s) continue;
+        uint32_t j = cmd_hash(s->cmd, cap - 1u);
+        while (slots[j]) j = (j + 1u) & (cap - 1u);
+        slots[j] = s;
+    }
+    free(tab->slots);
+    tab->slots = slots;
+    tab->cap = cap;
+    return 1;
+}
+
+static uint32_t table_find(const XenoCmdTable* tab, VkCommandBuffer cmd)
+{
+    if (!tab->cap) return UINT32_MAX;
+    uint32_t mask = tab->cap - 1u;
+    for (uint32_t i = cmd_hash(cmd, mask);; i = (i + 1u) & mask) {
+        if (!tab->slots[i]) return UINT32_MAX;
+        if (tab->slots[i]->cmd == cmd) return i;
+    }
+}
+
+/* Backward-shift deletion keeps every probe chain unbroken. */
+static void table_remove_at(XenoCmdTable* tab, uint32_t i)
+{
+    uint32_t mask = tab->cap - 1u;
+    state_free(tab, tab->slots[i]);
+    tab->slots[i] = NULL;
+    tab->count--;
+    for (uint32_t j = (i + 1u) & mask; tab->slots[j]; j = (j + 1u) & mask) {
+        uint32_t home = cmd_hash(tab->slots[j]->cmd, mask);
+        /* Move j into the hole unless its home lies cyclically in (i, j]. */
+        if (((j - home) & mask) >= ((j - i) & mask)) {
+            tab->slots[i] = tab->slots[j];
+            tab->slots[j] = NULL;
+            i = j;
+        }
+    }
+}
+
+/* Records the render pass end loadstore_opt.c held back, if any. */
+static void release(const XenoDeviceDispatch* d, XenoCmdState* s)
+{
+    if (!s->loadstore.held) return;
+    xeno_loadstore_release(d, s->cmd, &s->loadstore);
+    if (s->barrier.mode != XENO_BARRIER_SAFE) xeno_barrier_pass(&s->barrier, 0);
+}
+
+/* ---- public ------------------------------------------------------- */
+
+/* Merged sync1 calls lose per-barrier stage masks; with synchronization2
+   on, every batch goes out through vkCmdPipelineBarrier2 instead. */
+static int sync2_enabled(const VkDeviceCreateInfo* ci)
+{
+    for (const VkBaseInStructure* p = (const VkBaseInStructure*)ci->pNext; p; p = p->pNext) {
+        if (p->sType == VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SYNCHRONIZATION_2_FEATURES &&
+            ((const VkPhysicalDeviceSynchronization2Features*)p)->synchronization2) {
+            return 1;
+        }
+        if (p->sType == VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES &&
+            ((const VkPhysicalDeviceVulkan13Features*)p)->synchronization2) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+void xeno_cmd_device_init(XenoDeviceDispatch* d, const VkDeviceCreateInfo* ci)
+{
+    XenoCmdTable* tab = (XenoCmdTable*)calloc(1, sizeof(*tab));
+    if (!tab) {
+        XENO_LOGW("cmd: out of memory, barriers are recorded as given");
+        return;
+    }
+    pthread_mutex_init(&tab->mtx, NULL);
+    tab->max_mode = XENO_BARRIER_AGGRESSIVE;
+    tab->coalesce = 1;
+    tab->sync2 = sync2_enabled(ci);
+    for (uint32_t i = 0; i < ci->enabledExtensionCount; ++i) {
+        for (size_t e = 0; e < sizeof(k_unseen_work_exts) / sizeof(k_unseen_work_exts[0]); ++e) {
+            if (strcmp(ci->ppEnabledExtensionNames[i], k_unseen_work_exts[e]) != 0) continue;
+            if (tab->max_mode == XENO_BARRIER_AGGRESSIVE) {
+                XENO_LOGI("cmd: %s enabled, sync_mode capped at balanced", k_unseen_work_exts[e]);
+            }
+            tab->max_mode = XENO_BARRIER_BALANCED;
+            tab->coalesce = 0;
+        }
+    }
+    d->cmds = tab;
+}
+
+void xeno_cmd_device_destroy(XenoDeviceDispatch* d)
+{
+    XenoCmdTable* tab = d->cmds;
+    if (!tab) return;
+    d->cmds = NULL;
+    for (uint32_t i = 0; i < tab->cap; ++i) {
+        if (tab->slots[i]) state_free(tab, tab->slots[i]);
+    }
+    atomic_fetch_add_explicit(&g_cmd_epoch, 1u, memory_order_release);
+    uint64_t in = atomic_load_explicit(&tab->calls_in, memory_order_relaxed);
+    if (in) {
+        XENO_LOGI("cmd: %llu barrier calls recorded as %llu (%llu dropped, %llu deferred, %llu coalesced, "
+                  "%llu narrowed, %llu barriers folded, %llu transitions merged)",
+                  (unsigned long long)in, (unsigned long long)atomic_load(&tab->calls_out),
+                  (unsigned long long)atomic_load(&tab->dropped), (unsigned long long)atomic_load(&tab->deferred),
+                  (unsigned long long)atomic_load(&tab->coalesced), (unsigned long long)atomic_load(&tab->narrowed),
+                  (unsigned long long)atomic_load(&tab->folded), (unsigned long long)atomic_load(&tab->deduped));
+    }
+    free(tab->slots);
+    pthread_mutex_destroy(&tab->mtx);
+    free(tab);
+}
+
+void xeno_cmd_allocated(XenoDeviceDispatch* d, const VkCommandBufferAllocateInfo* info, const VkCommandBuffer* cmds)
+{
+    XenoCmdTable* tab = d->cmds;
+    if (!tab) return;
+    pthread_mutex_lock(&tab->mtx);
+    for (uint32_t n = 0; n < info->commandBufferCount; ++n) {
+        /* Load factor <= 1/2. */
+        if ((tab->count + 1u) * 2u > tab->cap && !table_grow(tab)) break;
+        XenoCmdState* s = (XenoCmdState*)calloc(1, sizeof(*s));
+        if (!s) break;
+        s->cmd = cmds[n];
+        s->pool = info->commandPool;
+        s->d = d;
+        s->secondary = info->level == VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+        xeno_barrier_tracker_init(&s->barrier, emit_batch, s);
+
+        uint32_t i = table_find(tab, cmds[n]);
+        if (i != UINT32_MAX) {
+            table_remove_at(tab, i);    /* handle reused without a free we saw */
+        }
+        uint32_t mask = tab->cap - 1u;
+        for (i = cmd_hash(cmds[n], mask); tab->slots[i]; i = (i + 1u) & mask) {}
+        tab->slots[i] = s;
+        tab->count++;
+    }
+    pthread_mutex_unlock(&tab->mtx);
+    atomic_fetch_add_explicit(&g_cmd_epoch, 1u, memory_order_release);
+}
+
+void xeno_cmd_freed(XenoDeviceDispatch* d, uint32_t count, const VkCommandBuffer* cmds)
+{
+    XenoCmdTable* tab = d->cmds;
+    if (!tab) return;
+    pthread_mutex_lock(&tab->mtx);
+    for (uint32_t n = 0; n < count; ++n) {
+        if (!cmds[n]) continue;
+        uint32_t i = table_find(tab, cmds[n]);
+        if (i != UINT32_MAX) table_remove_at(tab, i);
+    }
+    pthread_mutex_unlock(&tab->mtx);
+    atomic_fetch_add_explicit(&g_cmd_epoch, 1u, memory_order_release);
+}
+
+void xeno_cmd_pool_destroyed(XenoDeviceDispatch* d, VkCommandPool pool)
+{
+    XenoCmdTable* tab = d->cmds;
+    if (!tab || !pool) return;
+    pthread_mutex_lock(&tab->mtx);
+    for (uint32_t i = 0; i < tab->cap;) {
+        /* A removal may shift a later entry into i; look at it again. */
+        if (tab->slots[i] && tab->slots[i]->pool == pool) table_remove_at(tab, i);
+        else ++i;
+    }
+    pthread_mutex_unlock(&tab->mtx);
+    atomic_fetch_add_explicit(&g_cmd_epoch, 1u, memory_order_release);
+}
+
+XenoCmdState* xeno_cmd_state(const XenoDeviceDispatch* d, VkCommandBuffer cmd)
+{
+    uint64_t epoch = atomic_load_explicit(&g_cmd_epoch, memory_order_acquire);
+    if (t_last.cmd == cmd && t_last.epoch == epoch) return t_last.state;
+
+    XenoCmdTable* tab = d ? d->cmds : NULL;
+    if (!tab) return NULL;
+    pthread_mutex_lock(&tab->mtx);
+    uint32_t i = table_find(tab, cmd);
+    XenoCmdState* s = i == UINT32_MAX ? NULL : tab->slots[i];
+    pthread_mutex_unlock(&tab->mtx);
+    t_last.cmd = cmd;
+    t_last.state = s;
+    t_last.epoch = epoch;
+    return s;
+}
+
+void xeno_cmd_begin(XenoDeviceDispatch* d, VkCommandBuffer cmd, const VkCommandBufferBeginInfo* info)
+{
+    XenoCmdState* s = xeno_cmd_state(d, cmd);
+    if (!s) return;
+    memset(&s->loadstore, 0, sizeof(s->loadstore));
+    int mode;
+    switch (xeno_perf_conf_active()->sync_mode) {
+    case XENO_SYNC_AGGRESSIVE: mode = XENO_BARRIER_AGGRESSIVE; break;
+    case XENO_SYNC_BALANCED: mode = XENO_BARRIER_BALANCED; break;
+    default: mode = XENO_BARRIER_SAFE; break;
+    }
+    if (mode > d->cmds->max_mode) mode = d->cmds->max_mode;
+    int in_pass = s->secondary && (info->flags & VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT);
+    xeno_barrier_begin(&s->barrier, mode, in_pass, d->cmds->coalesce);
+}
+
+void xeno_cmd_end(XenoDeviceDispatch* d, VkCommandBuffer cmd)
+{
+    XenoCmdState* s = xeno_cmd_state(d, cmd);
+    if (!s) return;
+    release(d, s);
+    xeno_barrier_flush(&s->barrier);
+    collect_stats(d->cmds, s);
+    XENO_TRACE_COUNTER("barrier.dropped", atomic_load_explicit(&d->cmds->dropped, memory_order_relaxed));
+    XENO_TRACE_COUNTER("barrier.narrowed", atomic_load_explicit(&d->cmds->narrowed, memory_order_relaxed));
+    XENO_TRACE_COUNTER("barrier.coalesced", atomic_load_explicit(&d->cmds->coalesced, memory_order_relaxed));
+}
+
+void xeno_cmd_pipeline_barrier(XenoDeviceDispatch* d, VkCommandBuffer cmd, VkPipelineStageFlags src,
+                               VkPipelineStageFlags dst, VkDependencyFlags flags, uint32_t mem_count,
+                               const VkMemoryBarrier* mem, uint32_t buf_count, const VkBufferMemoryBarrier* buf,
+                               uint32_t img_count, const VkImageMemoryBarrier* img)
+{
+    XenoCmdState* s = xeno_cmd_state(d, cmd);
+    if (s) release(d, s);
+    if (!s || s->barrier.mode == XENO_BARRIER_SAFE ||
+        !xeno_barrier_load1(&s->barrier, src, dst, flags, mem_count, mem, buf_count, buf, img_count, img)) {
+        if (s) xeno_barrier_flush(&s->barrier);
+        d->CmdPipelineBarrier(cmd, src, dst, flags, mem_count, mem, buf_count, buf, img_count, img);
+        return;
+    }
+    xeno_barrier_record(&s->barrier);
+}
+
+void xeno_cmd_pipeline_barrier2(XenoDeviceDispatch* d, VkCommandBuffer cmd, const VkDependencyInfo* info)
+{
+    XenoCmdState* s = xeno_cmd_state(d, cmd);
+    if (s) release(d, s);
+    if (!s || s->barrier.mode == XENO_BARRIER_SAFE || !xeno_barrier_load2(&s->barrier, info)) {
+        if (s) xeno_barrier_flush(&s->barrier);
+        d->CmdPipelineBarrier2(cmd, info);
+        return;
+    }
+    xeno_barrier_record(&s->barrier);
+}
+
+void xeno_cmd_work(const XenoDeviceDispatch* d, VkCommandBuffer cmd, VkPipelineStageFlags2 stages,
+                   const XenoBarrierRef* refs, uint32_t ref_count)
+{
+    XenoCmdState* s = xeno_cmd_state(d, cmd);
+    if (!s) return;
+    release(d, s);
+    xeno_loadstore_cmd_reset(&s->loadstore);
+    if (s->barrier.mode != XENO_BARRIER_SAFE) xeno_barrier_work(&s->barrier, stages, refs, ref_count);
+}
+
+void xeno_cmd_pass(const XenoDeviceDispatch* d, VkCommandBuffer cmd, int begin)
+{
+    XenoCmdState* s = xeno_cmd_state(d, cmd);
+    if (!s) return;
+    if (begin) release(d, s);
+    if (s->barrier.mode != XENO_BARRIER_SAFE) xeno_barrier_pass(&s->barrier, begin);
+}
+
+void xeno_cmd_opaque(const XenoDeviceDispatch* d, VkCommandBuffer cmd)
+{
+    XenoCmdState* s = xeno_cmd_state(d, cmd);
+    if (!s) return;
+    release(d, s);
+    xeno_loadstore_cmd_reset(&s->loadstore);
+    if (s->barrier.mode != XENO_BARRIER_SAFE) xeno_barrier_opaque(&s->barrier);
+}
+
+void xeno_cmd_flush(const XenoDeviceDispatch* d, VkCommandBuffer cmd)
+{
+    XenoCmdState* s = xeno_cmd_state(d, cmd);
+    if (!s) return;
+    release(d, s);
+    xeno_loadstore_cmd_reset(&s->loadstore);
+    xeno_barrier_flush(&s->barrier);
+}
+
+void xeno_cmd_release(const XenoDeviceDispatch* d, VkCommandBuffer cmd)
+{
+    XenoCmdState* s = xeno_cmd_state(d, cmd);
+    if (s) release(d, s);
+}
@@ -0,0 +1,89 @@
+// src/xeno_cmd.h
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include "xeno_dispatch.h"
+#include "barrier_opt.h"
+#include "loadstore_opt.h"
+
+/*
+  Per-command-buffer state (xeno_cmd.c).
+
+  Every command buffer the app allocates through the layer gets a state
+  record, found by handle from any intercepted vkCmd*. Lookups go through a
+  one-entry thread-local cache first: a command buffer is recorded by one
+  thread at a time, so consecutive commands almost always hit it. Frees and
+  pool destruction bump a global epoch that invalidates every cache.
+
+  Command buffers the layer allocates for itself (d->AllocateCommandBuffers)
+  have no state and every helper below is a no-op for them.
+
+  The state is the barrier tracker (barrier_opt.h), what rp_cache.c
+  needs to close emulated render passes and keep them alive, and the
+  views loadstore_opt.c saw discarded and the render pass end it holds
+  back. Work recorded outside render passes has to be reported through
+  xeno_cmd_work(), including work the layer records into app command
+  buffers, or AGGRESSIVE narrowing and dropped loads would miss it and
+  it would land inside a held render pass. Every helper below except
+  xeno_cmd_pass(cmd, 0) records a held end first.
+*/
+
+typedef struct XenoCmdTable XenoCmdTable;
+
+typedef struct XenoCmdState {
+    VkCommandBuffer cmd;
+    VkCommandPool pool;
+    XenoDeviceDispatch* d;
+    int secondary;
+    XenoBarrierTracker barrier;
+    int rp_open;                /* inside a vkCmdBeginRendering recorded as a render pass (rp_cache.c) */
+    uint64_t rp_frame;          /* oldest frame of a cached render pass recorded, 0 = none */
+    XenoLoadStoreCmd loadstore; /* discarded views and the held render pass end */
+} XenoCmdState;
+
+/* Sets d->cmds; enabled extensions decide the strongest sync_mode allowed. */
+void xeno_cmd_device_init(XenoDeviceDispatch* d, const VkDeviceCreateInfo* ci);
+/* Logs barrier totals and frees every remaining state. */
+void xeno_cmd_device_destroy(XenoDeviceDispatch* d);
+
+void xeno_cmd_allocated(XenoDeviceDispatch* d, const VkCommandBufferAllocateInfo* info, const VkCommandBuffer* cmds);
+void xeno_cmd_freed(XenoDeviceDispatch* d, uint32_t count, const VkCommandBuffer* cmds);
+void xeno_cmd_pool_destroyed(XenoDeviceDispatch* d, VkCommandPool pool);
+
+/* NULL for command buffers the layer does not track. */
+XenoCmdState* xeno_cmd_state(const XenoDeviceDispatch* d, VkCommandBuffer cmd);
+
+/* Recording brackets: begin latches sync_mode, end emits a held barrier. */
+void xeno_cmd_begin(XenoDeviceDispatch* d, VkCommandBuffer cmd, const VkCommandBufferBeginInfo* info);
+void xeno_cmd_end(XenoDeviceDispatch* d, VkCommandBuffer cmd);
+
+/* vkCmdPipelineBarrier / vkCmdPipelineBarrier2, rewritten per sync_mode. */
+void xeno_cmd_pipeline_barrier(XenoDeviceDispatch* d, VkCommandBuffer cmd, VkPipelineStageFlags src,
+                               VkPipelineStageFlags dst, VkDependencyFlags flags, uint32_t mem_count,
+                               const VkMemoryBarrier* mem, uint32_t buf_count, const VkBufferMemoryBarrier* buf,
+                               uint32_t img_count, const VkImageMemoryBarrier* img);
+void xeno_cmd_pipeline_barrier2(XenoDeviceDispatch* d, VkCommandBuffer cmd, const VkDependencyInfo* info);
+
+/* Call before recording the command; see barrier_opt.h. */
+void xeno_cmd_work(const XenoDeviceDispatch* d, VkCommandBuffer cmd, VkPipelineStageFlags2 stages,
+                   const XenoBarrierRef* refs, uint32_t ref_count);
+void xeno_cmd_pass(const XenoDeviceDispatch* d, VkCommandBuffer cmd, int begin);
+void xeno_cmd_opaque(const XenoDeviceDispatch* d, VkCommandBuffer cmd);
+void xeno_cmd_flush(const XenoDeviceDispatch* d, VkCommandBuffer cmd);
+/* Before commands that must not go inside a render pass the app has
+   ended but that do no work the tracker needs to see (queries). */
+void xeno_cmd_release(const XenoDeviceDispatch* d, VkCommandBuffer cmd);
+
+/* Transfer refs. */
+static inline XenoBarrierRef xeno_cmd_buffer_ref(VkBuffer buffer, VkDeviceSize offset, VkDeviceSize size, int write)
+{
+    XenoBarrierRef r = { (uint64_t)buffer, offset,
+                         size == VK_WHOLE_SIZE || offset + size < offset ? ~(VkDeviceSize)0 : offset + size, write };
+    return r;
+}
+
+static inline XenoBarrierRef xeno_cmd_image_ref(VkImage image, int write)
+{
+    XenoBarrierRef r = { (uint64_t)image, 0, ~(VkDeviceSize)0, write };
+    return r;
+}
@@ -0,0 +1,121 @@
+// src/xeno_dispatch.c
+/*
+  Dispatch-table registry (see xeno_dispatch.h).
+
+  The map is open addressing with linear probing. Readers never lock:
+  they load the slot key (acquire) and then the value. Writers only run
+  at create/destroy time and serialize on a mutex. A removed entry keeps
+  its key and gets a NULL value, so probe chains for other keys stay
+  intact; the slot is reused when the same key comes back (the loader
+  recycles its dispatch allocations) or when a new key lands on it.
+*/
+#include "xeno_dispatch.h"
+#include "xeno_log.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <pthread.h>
+
+XenoDispatchSlot xeno_dispatch_slots_g[XENO_DISPATCH_MAP_CAPACITY];
+static pthread_mutex_t g_dispatch_mtx = PTHREAD_MUTEX_INITIALIZER;
+
+static int dispatch_map_put(uintptr_t key, void* value)
+{
+    pthread_mutex_lock(&g_dispatch_mtx);
+    uint32_t i = xeno_dispatch_hash(key);
+    XenoDispatchSlot* reuse = NULL;
+    XenoDispatchSlot* slot = NULL;
+    for (uint32_t n = 0; n < XENO_DISPATCH_MAP_CAPACITY; ++n) {
+        XenoDispatchSlot* s = &xeno_dispatch_slots_g[i];
+        uintptr_t k = atomic_load_explicit(&s->key, memory_order_relaxed);
+        if (k == key) { slot = s; break; }
+        if (k == 0) { slot = reuse ? reuse : s; break; }
+        if (!reuse && !atomic_load_explicit(&s->value, memory_order_relaxed)) reuse = s;
+        i = (i + 1u) & (XENO_DISPATCH_MAP_CAPACITY - 1u);
+    }
+    if (!slot) slot = reuse;
+    if (slot) {
+        /* Clear first so a reader that matches the new key never sees the old value. */
+        atomic_store_explicit(&slot->value, NULL, memory_order_relaxed);
+        atomic_store_explicit(&slot->key, key, memory_order_release);
+        atomic_store_explicit(&slot->value, value, memory_order_release);
+    }
+    pthread_mutex_unlock(&g_dispatch_mtx);
+    return slot != NULL;
+}
+
+static void* dispatch_map_take(uintptr_t key)
+{
+    pthread_mutex_lock(&g_dispatch_mtx);
+    void* old = NULL;
+    uint32_t i = xeno_dispatch_hash(key);
+    for (uint32_t n = 0; n < XENO_DISPATCH_MAP_CAPACITY; ++n) {
+        XenoDispatchSlot* s = &xeno_dispatch_slots_g[i];
+        uintptr_t k = atomic_load_explicit(&s->key, memory_order_relaxed);
+        if (k == key) {
+            old = atomic_exchange_explicit(&s->value, NULL, memory_order_acq_rel);
+            break;
+        }
+        if (k == 0) break;
+        i = (i + 1u) & (XENO_DISPATCH_MAP_CAPACITY - 1u);
+    }
+    pthread_mutex_unlock(&g_dispatch_mtx);
+    return old;
+}
+
+/* Core name first, then the KHR alias for entrypoints promoted to core
+   (e.g. vkGetBufferDeviceAddress on 1.1 drivers). */
+#define XENO_RESOLVE_(getter, handle, table, name)                                         \
+    do {                                                                                   \
+        (table)->name = (PFN_vk##name)getter((handle), "vk" #name);                        \
+        if (!(table)->name) (table)->name = (PFN_vk##name)getter((handle), "vk" #name "KHR"); \
+    } while (0);
+
+XenoInstanceDispatch* xeno_dispatch_instance_create(VkInstance instance, PFN_vkGetInstanceProcAddr gipa)
+{
+    XenoInstanceDispatch* d = (XenoInstanceDispatch*)calloc(1, sizeof(*d));
+    if (!d) return NULL;
+    d->instance = instance;
+    d->GetInstanceProcAddr = gipa;
+    d->GetDeviceProcAddr = (PFN_vkGetDeviceProcAddr)gipa(instance, "vkGetDeviceProcAddr");
+#define X(name) XENO_RESOLVE_(gipa, instance, d, name)
+    XENO_INSTANCE_FUNCS(X)
+#undef X
+    if (!dispatch_map_put(xeno_dispatch_key(instance), d)) {
+        XENO_LOGE("dispatch: map full, cannot register instance %p", (void*)instance);
+        free(d);
+        return NULL;
+    }
+    return d;
+}
+
+void xeno_dispatch_instance_destroy(VkInstance instance)
+{
+    free(dispatch_map_take(xeno_dispatch_key(instance)));
+}
+
+XenoDeviceDispatch* xeno_dispatch_device_create(VkDevice device, VkPhysicalDevice physical,
+                                                PFN_vkGetDeviceProcAddr gdpa)
+{
+    XenoDeviceDispatch* d = (XenoDeviceDispatch*)calloc(1, sizeof(*d));
+    if (!d) return NULL;
+    d->device = device;
+    d->physical = physical;
+    d->instance = xeno_instance_dispatch(physical);
+    d->GetDeviceProcAddr = gdpa;
+#define X(name) XENO_RESOLVE_(gdpa, device, d, name)
+    XENO_DEVICE_FUNCS(X)
+#undef X
+    if (!dispatch_map_put(xeno_dispatch_key(device), d)) {
+        XENO_LOGE("dispatch: map full, cannot register device %p", (void*)device);
+        free(d);
+        return NULL;
+    }
+    return d;
+}
+
+void xeno_dispatch_device_destroy(VkDevice device)
+{
+    free(dispatch_map_take(xeno_dispatch_key(device)));
+}
@@ -0,0 +1,251 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdatomic.h>
+#include <vulkan/vulkan.h>
+#include <vulkan/vk_layer.h>
+
+/*
+  Layer dispatch tables (src/xeno_dispatch.c).
+
+  Every next-in-chain entrypoint the layer calls is resolved once, at
+  vkCreateInstance / vkCreateDevice, into a table. Tables live in a
+  lock-free map keyed by the dispatchable handle's loader key (the first
+  pointer-sized word of every VkInstance/VkPhysicalDevice and
+  VkDevice/VkQueue/VkCommandBuffer), so any intercepted command finds its
+  table with one hash probe and then makes a single indirect call.
+
+  To call a new entrypoint, add it to the list below; the field is named
+  after the command without the "vk" prefix.
+*/
+
+#define XENO_INSTANCE_FUNCS(X) \
+    X(DestroyInstance) \
+    X(EnumeratePhysicalDevices) \
+    X(EnumerateDeviceExtensionProperties) \
+    X(GetPhysicalDeviceFeatures2) \
+    X(GetPhysicalDeviceProperties) \
+    X(GetPhysicalDeviceProperties2) \
+    X(GetPhysicalDeviceMemoryProperties) \
+    X(GetPhysicalDeviceQueueFamilyProperties) \
+    X(GetPhysicalDeviceSurfaceCapabilitiesKHR) \
+    X(CreateDevice)
+
+#define XENO_DEVICE_FUNCS(X) \
+    X(DestroyDevice) \
+    X(GetDeviceQueue) \
+    X(GetDeviceQueue2) \
+    X(DeviceWaitIdle) \
+    X(QueueSubmit) \
+    X(QueueSubmit2) \
+    X(QueueBindSparse) \
+    X(QueueWaitIdle) \
+    X(QueuePresentKHR) \
+    X(CreateSwapchainKHR) \
+    X(DestroySwapchainKHR) \
+    X(GetSwapchainImagesKHR) \
+    X(AllocateMemory) \
+    X(FreeMemory) \
+    X(MapMemory) \
+    X(UnmapMemory) \
+    X(FlushMappedMemoryRanges) \
+    X(BindBufferMemory) \
+    X(BindImageMemory) \
+    X(GetImageMemoryRequirements) \
+    X(CreateImage) \
+    X(DestroyImage) \
+    X(CreateImageView) \
+    X(DestroyImageView) \
+    X(CreateSampler) \
+    X(DestroySampler) \
+    X(GetBufferMemoryRequirements) \
+    X(GetBufferDeviceAddress) \
+    X(CreateBuffer) \
+    X(DestroyBuffer) \
+    X(DestroyBufferView) \
+    X(CreateShaderModule) \
+    X(DestroyShaderModule) \
+    X(CreateComputePipelines) \
+    X(DestroyPipeline) \
+    X(CreatePipelineLayout) \
+    X(DestroyPipelineLayout) \
+    X(CreateDescriptorSetLayout) \
+    X(DestroyDescriptorSetLayout) \
+    X(CreateDescriptorPool) \
+    X(DestroyDescriptorPool) \
+    X(AllocateDescriptorSets) \
+    X(FreeDescriptorSets) \
+    X(ResetDescriptorPool) \
+    X(UpdateDescriptorSets) \
+    X(CreateDescriptorUpdateTemplate) \
+    X(DestroyDescriptorUpdateTemplate) \
+    X(UpdateDescriptorSetWithTemplate) \
+    X(CreateFence) \
+    X(DestroyFence) \
+    X(WaitForFences) \
+    X(GetFenceStatus) \
+    X(ResetFences) \
+    X(CreateSemaphore) \
+    X(DestroySemaphore) \
+    X(CreateCommandPool) \
+    X(DestroyCommandPool) \
+    X(AllocateCommandBuffers) \
+    X(FreeCommandBuffers) \
+    X(BeginCommandBuffer) \
+    X(EndCommandBuffer) \
+    X(CmdBindPipeline) \
+    X(CmdBindDescriptorSets) \
+    X(CmdPushConstants) \
+    X(CmdDispatch) \
+    X(CmdDispatchIndirect) \
+    X(CmdDispatchBase) \
+    X(CmdCopyBuffer) \
+    X(CmdCopyImage) \
+    X(CmdCopyBufferToImage) \
+    X(CmdCopyImageToBuffer) \
+    X(CmdBlitImage) \
+    X(CmdResolveImage) \
+    X(CmdFillBuffer) \
+    X(CmdUpdateBuffer) \
+    X(CmdClearColorImage) \
+    X(CmdClearDepthStencilImage) \
+    X(CmdCopyQueryPoolResults) \
+    X(CmdCopyBuffer2) \
+    X(CmdCopyImage2) \
+    X(CmdCopyBufferToImage2) \
+    X(CmdCopyImageToBuffer2) \
+    X(CmdBlitImage2) \
+    X(CmdResolveImage2) \
+    X(CmdPipelineBarrier) \
+    X(CmdPipelineBarrier2) \
+    X(CmdSetEvent) \
+    X(CmdSetEvent2) \
+    X(CmdResetEvent) \
+    X(CmdResetEvent2) \
+    X(CmdWaitEvents) \
+    X(CmdWaitEvents2) \
+    X(CmdExecuteCommands) \
+    X(CreateRenderPass) \
+    X(CreateRenderPass2) \
+    X(DestroyRenderPass) \
+    X(CreateFramebuffer) \
+    X(DestroyFramebuffer) \
+    X(CmdBeginRenderPass) \
+    X(CmdEndRenderPass) \
+    X(CmdBeginRenderPass2) \
+    X(CmdEndRenderPass2) \
+    X(CmdBeginRendering) \
+    X(CmdEndRendering) \
+    X(CmdClearAttachments) \
+    X(CreateGraphicsPipelines) \
+    X(CreateQueryPool) \
+    X(DestroyQueryPool) \
+    X(GetQueryPoolResults) \
+    X(CmdResetQueryPool) \
+    X(CmdWriteTimestamp) \
+    X(CmdWriteTimestamp2) \
+    X(CmdBeginQuery) \
+    X(CmdEndQuery) \
+    X(CmdBeginConditionalRenderingEXT) \
+    X(CmdEndConditionalRenderingEXT) \
+    X(CmdSetFragmentShadingRateKHR) \
+    X(CmdSetFragmentShadingRateEnumNV) \
+    X(CreateAccelerationStructureKHR) \
+    X(DestroyAccelerationStructureKHR) \
+    X(GetAccelerationStructureBuildSizesKHR) \
+    X(GetAccelerationStructureDeviceAddressKHR) \
+    X(CmdBuildAccelerationStructuresKHR) \
+    X(CmdCopyAccelerationStructureKHR) \
+    X(CmdWriteAccelerationStructuresPropertiesKHR) \
+    X(CmdTraceRaysKHR) \
+    X(CmdTraceRaysIndirectKHR) \
+    X(CmdTraceRaysIndirect2KHR) \
+    X(CmdBuildAccelerationStructuresIndirectKHR) \
+    X(CmdCopyAccelerationStructureToMemoryKHR) \
+    X(CmdCopyMemoryToAccelerationStructureKHR) \
+    X(GetRayTracingShaderGroupHandlesKHR)
+
+#define XENO_DISPATCH_FIELD_(name) PFN_vk##name name;
+
+typedef struct XenoInstanceDispatch {
+    VkInstance instance;
+    PFN_vkGetInstanceProcAddr GetInstanceProcAddr;
+    PFN_vkGetDeviceProcAddr GetDeviceProcAddr;
+    uint32_t api_version;       /* VkApplicationInfo::apiVersion, 0 when the app gave none */
+    XENO_INSTANCE_FUNCS(XENO_DISPATCH_FIELD_)
+} XenoInstanceDispatch;
+
+typedef struct XenoDeviceDispatch {
+    VkDevice device;
+    VkPhysicalDevice physical;
+    const XenoInstanceDispatch* instance;   /* may be NULL for devices adopted from outside the layer */
+    PFN_vkGetDeviceProcAddr GetDeviceProcAddr;
+    PFN_vkSetDeviceLoaderData SetDeviceLoaderData;   /* for dispatchable objects the layer creates */
+    struct XenoVrsDevice* vrs;              /* adaptive shading rate state, NULL when off */
+    struct XenoVrsContent* vrs_content;     /* content-adaptive attachment, NULL when off */
+    struct XenoAsyncDevice* async;          /* submit workers, NULL when submission is synchronous */
+    _Atomic(struct XenoMemAllocator*) mem;  /* created on first xeno_mem_allocator() */
+    struct XenoCmdTable* cmds;              /* per-command-buffer state, NULL when out of memory */
+    struct XenoRpCache* rp;                 /* dynamic-rendering emulation, NULL when not emulated */
+    struct XenoLoadStore* loadstore;        /* attachment op rewriting, NULL when off */
+    struct XenoBindless* bindless;          /* texture heap for layer passes, NULL when unsupported */
+    struct XenoDescCache* desc;             /* descriptor-set reuse, NULL when off */
+    struct XenoShaderCache* shaders;        /* shader module sharing, NULL when off */
+    XENO_DEVICE_FUNCS(XENO_DISPATCH_FIELD_)
+} XenoDeviceDispatch;
+
+/* ---- lookup (hot path) -------------------------------------------- */
+
+#define XENO_DISPATCH_MAP_BITS 8u
+#define XENO_DISPATCH_MAP_CAPACITY (1u << XENO_DISPATCH_MAP_BITS)
+
+typedef struct XenoDispatchSlot {
+    _Atomic(uintptr_t) key;     /* 0 = never used; keys are never cleared, see xeno_dispatch.c */
+    _Atomic(void*) value;       /* NULL = removed */
+} XenoDispatchSlot;
+
+extern XenoDispatchSlot xeno_dispatch_slots_g[XENO_DISPATCH_MAP_CAPACITY];
+
+static inline uintptr_t xeno_dispatch_key(const void* handle)
+{
+    return (uintptr_t)*(void* const*)handle;
+}
+
+static inline uint32_t xeno_dispatch_hash(uintptr_t key)
+{
+    return (uint32_t)(((uint64_t)key * 0x9E3779B97F4A7C15ull) >> (64u - XENO_DISPATCH_MAP_BITS));
+}
+
+static inline void* xeno_dispatch_map_get(uintptr_t key)
+{
+    uint32_t i = xeno_dispatch_hash(key);
+    for (uint32_t n = 0; n < XENO_DISPATCH_MAP_CAPACITY; ++n) {
+        XenoDispatchSlot* s = &xeno_dispatch_slots_g[i];
+        uintptr_t k = atomic_load_explicit(&s->key, memory_order_acquire);
+        if (k == key) return atomic_load_explicit(&s->value, memory_order_acquire);
+        if (k == 0) return NULL;
+        i = (i + 1u) & (XENO_DISPATCH_MAP_CAPACITY - 1u);
+    }
+    return NULL;
+}
+
+/* Any of VkInstance / VkPhysicalDevice. */
+static inline XenoInstanceDispatch* xeno_instance_dispatch(const void* handle)
+{
+    return handle ? (XenoInstanceDispatch*)xeno_dispatch_map_get(xeno_dispatch_key(handle)) : NULL;
+}
+
+/* Any of VkDevice / VkQueue / VkCommandBuffer. */
+static inline XenoDeviceDispatch* xeno_device_dispatch(const void* handle)
+{
+    return handle ? (XenoDeviceDispatch*)xeno_dispatch_map_get(xeno_dispatch_key(handle)) : NULL;
+}
+
+/* ---- registration (create/destroy time) --------------------------- */
+
+XenoInstanceDispatch* xeno_dispatch_instance_create(VkInstance instance, PFN_vkGetInstanceProcAddr gipa);
+void xeno_dispatch_instance_destroy(VkInstance instance);
+
+XenoDeviceDispatch* xeno_dispatch_device_create(VkDevice device, VkPhysicalDevice physical,
+                                                PFN_vkGetDeviceProcAddr gdpa);
+void xeno_dispatch_device_destroy(VkDevice device);
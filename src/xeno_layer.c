@@ -0,0 +1,1519 @@
+// src/xeno_layer.c
+/*
+  Vulkan loader layer entrypoints.
+
+  vkCreateInstance / vkCreateDevice walk the loader's link info, call down
+  the chain and register a dispatch table for the new object; everything
+  else the layer intercepts finds its table through xeno_dispatch.h.
+  Commands we do not intercept are handed straight to the next layer from
+  vkGet*ProcAddr, so they never pass through this library at all.
+*/
+#include <vulkan/vulkan.h>
+#include <vulkan/vk_layer.h>
+
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "xeno_dispatch.h"
+#include "features_patch.h"
+#include "perf_conf.h"
+#include "autotune.h"
+#include "xeno_mem.h"
+#include "xeno_cmd.h"
+#include "rp_cache.h"
+#include "loadstore_opt.h"
+#include "bindless.h"
+#include "desc_cache.h"
+#include "shader_cache.h"
+#include "drivers/xclipse/vrs.h"
+#include "drivers/xclipse/vrs_content.h"
+#include "drivers/xclipse/async.h"
+#include "xeno_log.h"
+#include "xeno_trace.h"
+
+#define XENO_LAYER_NAME "VK_LAYER_EXYNOSTOOLS_xeno"
+#define XENO_LAYER_EXPORT __attribute__((visibility("default")))
+
+static VkLayerInstanceCreateInfo* find_instance_link(const VkInstanceCreateInfo* ci)
+{
+    VkLayerInstanceCreateInfo* info = (VkLayerInstanceCreateInfo*)ci->pNext;
+    while (info && !(info->sType == VK_STRUCTURE_TYPE_LOADER_INSTANCE_CREATE_INFO &&
+                     info->function == VK_LAYER_LINK_INFO)) {
+        info = (VkLayerInstanceCreateInfo*)info->pNext;
+    }
+    return info;
+}
+
+static VkLayerDeviceCreateInfo* find_device_link(const VkDeviceCreateInfo* ci)
+{
+    VkLayerDeviceCreateInfo* info = (VkLayerDeviceCreateInfo*)ci->pNext;
+    while (info && !(info->sType == VK_STRUCTURE_TYPE_LOADER_DEVICE_CREATE_INFO &&
+                     info->function == VK_LAYER_LINK_INFO)) {
+        info = (VkLayerDeviceCreateInfo*)info->pNext;
+    }
+    return info;
+}
+
+static XenoCapsProcs caps_procs(const XenoInstanceDispatch* inst)
+{
+    XenoCapsProcs p = {
+        inst->EnumerateDeviceExtensionProperties,
+        inst->GetPhysicalDeviceFeatures2,
+        inst->GetPhysicalDeviceProperties,
+    };
+    return p;
+}
+
+/* The driver's own VK_KHR_dynamic_rendering, or Vulkan 1.3. */
+static int driver_dynamic_rendering(const XenoInstanceDispatch* inst, VkPhysicalDevice phys,
+                                    const XenoCapsSnapshot* caps)
+{
+    if (!caps) return 1;    /* nothing was stripped */
+    for (uint32_t e = 0; e < caps->driver_ext_count; ++e) {
+        if (strcmp(caps->exts[e].extensionName, VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME) == 0) return 1;
+    }
+    if (!inst->GetPhysicalDeviceProperties) return 0;
+    VkPhysicalDeviceProperties props;
+    inst->GetPhysicalDeviceProperties(phys, &props);
+    return VK_API_VERSION_MAJOR(props.apiVersion) > 1 || VK_API_VERSION_MINOR(props.apiVersion) >= 3;
+}
+
+/* ---------------------------------------------------------------- */
+/* Instance                                                          */
+/* ---------------------------------------------------------------- */
+
+static VKAPI_ATTR VkResult VKAPI_CALL xeno_CreateInstance(const VkInstanceCreateInfo* pCreateInfo,
+                                                          const VkAllocationCallbacks* pAllocator,
+                                                          VkInstance* pInstance)
+{
+    VkLayerInstanceCreateInfo* link = find_instance_link(pCreateInfo);
+    if (!link || !link->u.pLayerInfo) return VK_ERROR_INITIALIZATION_FAILED;
+
+    PFN_vkGetInstanceProcAddr next_gipa = link->u.pLayerInfo->pfnNextGetInstanceProcAddr;
+    PFN_vkCreateInstance next_create = (PFN_vkCreateInstance)next_gipa(VK_NULL_HANDLE, "vkCreateInstance");
+    if (!next_create) return VK_ERROR_INITIALIZATION_FAILED;
+
+    /* Advance the link for the next layer down. */
+    link->u.pLayerInfo = link->u.pLayerInfo->pNext;
+    VkResult res = next_create(pCreateInfo, pAllocator, pInstance);
+    if (res != VK_SUCCESS) return res;
+
+    const XenoPerfConf* conf = xeno_perf_conf_active();
+    if (conf->shader_cache_dir[0]) xeno_caps_set_cache_dir(conf->shader_cache_dir);
+    if (conf->hot_reload) xeno_perf_conf_watch_start();
+
+    XenoInstanceDispatch* d = xeno_dispatch_instance_create(*pInstance, next_gipa);
+    if (!d) {
+        PFN_vkDestroyInstance destroy = (PFN_vkDestroyInstance)next_gipa(*pInstance, "vkDestroyInstance");
+        if (destroy) destroy(*pInstance, pAllocator);
+        return VK_ERROR_OUT_OF_HOST_MEMORY;
+    }
+    if (pCreateInfo->pApplicationInfo) d->api_version = pCreateInfo->pApplicationInfo->apiVersion;
+    XENO_LOGI("layer: instance %p created", (void*)*pInstance);
+    return VK_SUCCESS;
+}
+
+static VKAPI_ATTR void VKAPI_CALL xeno_DestroyInstance(VkInstance instance, const VkAllocationCallbacks* pAllocator)
+{
+    XenoInstanceDispatch* d = xeno_instance_dispatch(instance);
+    if (!d) return;
+    PFN_vkDestroyInstance destroy = d->DestroyInstance;
+    xeno_dispatch_instance_destroy(instance);
+    if (destroy) destroy(instance, pAllocator);
+}
+
+static VKAPI_ATTR VkResult VKAPI_CALL xeno_EnumerateDeviceExtensionProperties(VkPhysicalDevice physicalDevice,
+                                                                              const char* pLayerName,
+                                                                              uint32_t* pPropertyCount,
+                                                                              VkExtensionProperties* pProperties)
+{
+    if (pLayerName && strcmp(pLayerName, XENO_LAYER_NAME) == 0) {
+        *pPropertyCount = 0;
+        return VK_SUCCESS;
+    }
+    XenoInstanceDispatch* d = xeno_instance_dispatch(physicalDevice);
+    if (!d) return VK_ERROR_INITIALIZATION_FAILED;
+    if (pLayerName) return d->EnumerateDeviceExtensionProperties(physicalDevice, pLayerName, pPropertyCount, pProperties);
+
+    XenoCapsProcs procs = caps_procs(d);
+    return xeno_patch_extensions(physicalDevice, &procs, pLayerName, pPropertyCount, pProperties);
+}
+
+static VKAPI_ATTR void VKAPI_CALL xeno_GetPhysicalDeviceFeatures2(VkPhysicalDevice physicalDevice,
+                                                                  VkPhysicalDeviceFeatures2* pFeatures)
+{
+    XenoInstanceDispatch* d = xeno_instance_dispatch(physicalDevice);
+    if (!d) return;
+    XenoCapsProcs procs = caps_procs(d);
+    xeno_patch_features2(physicalDevice, &procs, pFeatures);
+}
+
+/* ---------------------------------------------------------------- */
+/* Device                                                            */
+/* ---------------------------------------------------------------- */
+
+static VKAPI_ATTR VkResult VKAPI_CALL xeno_CreateDevice(VkPhysicalDevice physicalDevice,
+                                                        const VkDeviceCreateInfo* pCreateInfo,
+                                                        const VkAllocationCallbacks* pAllocator,
+                                                        VkDevice* pDevice)
+{
+    XENO_TRACE_SCOPE("vkCreateDevice");
+    XenoInstanceDispatch* inst = xeno_instance_dispatch(physicalDevice);
+    VkLayerDeviceCreateInfo* link = find_device_link(pCreateInfo);
+    if (!inst || !link || !link->u.pLayerInfo) return VK_ERROR_INITIALIZATION_FAILED;
+
+    PFN_vkGetInstanceProcAddr next_gipa = link->u.pLayerInfo->pfnNextGetInstanceProcAddr;
+    PFN_vkGetDeviceProcAddr next_gdpa = link->u.pLayerInfo->pfnNextGetDeviceProcAddr;
+    PFN_vkCreateDevice next_create = (PFN_vkCreateDevice)next_gipa(inst->instance, "vkCreateDevice");
+    if (!next_create) return VK_ERROR_INITIALIZATION_FAILED;
+
+    /* Virtual extensions are implemented here, not by the driver: strip them
+       before the create info goes down the chain. Two spare slots are kept
+       for the shading-rate extension the adaptive VRS controller needs and
+       descriptor indexing for the texture heap. */
+    XenoCapsProcs procs = caps_procs(inst);
+    const XenoCapsSnapshot* caps = xeno_caps_get(physicalDevice, &procs);
+    VkDeviceCreateInfo ci = *pCreateInfo;
+    const char** names = (const char**)malloc(sizeof(*names) * (ci.enabledExtensionCount + 2u));
+    if (!names) return VK_ERROR_OUT_OF_HOST_MEMORY;
+    uint32_t kept = 0;
+    int has_fsr = 0;
+    for (uint32_t i = 0; i < ci.enabledExtensionCount; ++i) {
+        const char* name = ci.ppEnabledExtensionNames[i];
+        int driver_has = !caps;
+        for (uint32_t e = 0; caps && e < caps->driver_ext_count && !driver_has; ++e) {
+            driver_has = strcmp(caps->exts[e].extensionName, name) == 0;
+        }
+        if (driver_has || !xeno_caps_has_extension(caps, name)) names[kept++] = name;
+        else XENO_LOGD("layer: %s is emulated, not enabling it on the driver", name);
+        has_fsr |= strcmp(name, VK_KHR_FRAGMENT_SHADING_RATE_EXTENSION_NAME) == 0;
+    }
+
+    /* Pipeline shading rates for the adaptive controller, attachment rates
+       for the content pass. If the app already chains the FSR feature struct
+       we only go ahead with what it enabled itself; its structs are const. */
+    const XenoPerfConf* conf = xeno_perf_conf_active();
+    VkPhysicalDeviceFragmentShadingRateFeaturesKHR fsr = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FRAGMENT_SHADING_RATE_FEATURES_KHR,
+        .pipelineFragmentShadingRate = VK_TRUE,
+    };
+    int content = 0;
+    int vrs = (conf->vrs_target_fps > 0 || conf->vrs_content) &&
+              xclipse_vrs_device_supported(inst, physicalDevice, pCreateInfo, &fsr.attachmentFragmentShadingRate);
+    if (vrs) {
+        const VkBaseInStructure* s = (const VkBaseInStructure*)ci.pNext;
+        while (s && s->sType != VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FRAGMENT_SHADING_RATE_FEATURES_KHR) s = s->pNext;
+        if (s) {
+            const VkPhysicalDeviceFragmentShadingRateFeaturesKHR* app = (const VkPhysicalDeviceFragmentShadingRateFeaturesKHR*)s;
+            vrs = app->pipelineFragmentShadingRate == VK_TRUE;
+            fsr.attachmentFragmentShadingRate = app->attachmentFragmentShadingRate;
+        } else {
+            fsr.attachmentFragmentShadingRate &= conf->vrs_content ? VK_TRUE : VK_FALSE;
+            fsr.pNext = (void*)ci.pNext;
+            ci.pNext = &fsr;
+        }
+        content = vrs && conf->vrs_content && fsr.attachmentFragmentShadingRate;
+        if (vrs && !has_fsr) names[kept++] = VK_KHR_FRAGMENT_SHADING_RATE_EXTENSION_NAME;
+    }
+
+    /* The texture heap for layer passes: descriptor indexing features, and
+       the extension when the app's API version does not include it. */
+    VkPhysicalDeviceDescriptorIndexingFeatures indexing;
+    const char* indexing_ext = NULL;
+    uint32_t heap_slots = xeno_bindless_device_supported(inst, physicalDevice, pCreateInfo, &indexing, &indexing_ext);
+    if (indexing.sType) {
+        indexing.pNext = (void*)ci.pNext;
+        ci.pNext = &indexing;
+    }
+    if (indexing_ext) names[kept++] = indexing_ext;
+    ci.enabledExtensionCount = kept;
+    ci.ppEnabledExtensionNames = names;
+
+    link->u.pLayerInfo = link->u.pLayerInfo->pNext;
+    VkResult res = next_create(physicalDevice, &ci, pAllocator, pDevice);
+    free(names);
+    if (res != VK_SUCCESS) {
+        XENO_LOGE("layer: vkCreateDevice failed: %d", res);
+        return res;
+    }
+
+    XenoDeviceDispatch* d = xeno_dispatch_device_create(*pDevice, physicalDevice, next_gdpa);
+    if (!d) {
+        PFN_vkDestroyDevice destroy = (PFN_vkDestroyDevice)next_gdpa(*pDevice, "vkDestroyDevice");
+        if (destroy) destroy(*pDevice, pAllocator);
+        return VK_ERROR_OUT_OF_HOST_MEMORY;
+    }
+    for (const VkLayerDeviceCreateInfo* cb = (const VkLayerDeviceCreateInfo*)pCreateInfo->pNext; cb;
+         cb = (const VkLayerDeviceCreateInfo*)cb->pNext) {
+        if (cb->sType == VK_STRUCTURE_TYPE_LOADER_DEVICE_CREATE_INFO && cb->function == VK_LOADER_DATA_CALLBACK) {
+            d->SetDeviceLoaderData = cb->u.pfnSetDeviceLoaderData;
+        }
+    }
+    xeno_bindless_device_init(d, heap_slots);
+    if (vrs) xclipse_vrs_device_init(d, conf->vrs_target_fps, conf->vrs_max_rate, content);
+    if (conf->async_submit) xclipse_async_device_init(d);
+    xeno_cmd_device_init(d, pCreateInfo);
+    xeno_rp_device_init(d, pCreateInfo, driver_dynamic_rendering(inst, physicalDevice, caps));
+    xeno_loadstore_device_init(d);
+    xeno_desc_device_init(d, pCreateInfo);
+    xeno_shader_device_init(d);
+    xeno_autotune_session_begin();
+    XENO_LOGI("layer: device %p created", (void*)*pDevice);
+    return VK_SUCCESS;
+}
+
+static VKAPI_ATTR void VKAPI_CALL xeno_DestroyDevice(VkDevice device, const VkAllocationCallbacks* pAllocator)
+{
+    XenoDeviceDispatch* d = xeno_device_dispatch(device);
+    if (!d) return;
+    PFN_vkDestroyDevice destroy = d->DestroyDevice;
+    xclipse_async_device_destroy(d);
+    xclipse_vrs_device_destroy(d);
+    xeno_bindless_device_destroy(d);
+    xeno_shader_device_destroy(d);
+    xeno_desc_device_destroy(d);
+    xeno_loadstore_device_destroy(d);
+    xeno_rp_device_destroy(d);
+    xeno_cmd_device_destroy(d);
+    xeno_mem_device_destroy(device);
+    xeno_dispatch_device_destroy(device);
+    if (destroy) destroy(device, pAllocator);
+    xeno_autotune_session_end();
+}
+
+/* ---------------------------------------------------------------- */
+/* Adaptive shading rate (drivers/xclipse/vrs*.c)                    */
+/* ---------------------------------------------------------------- */
+
+static VKAPI_ATTR VkResult VKAPI_CALL xeno_CreateGraphicsPipelines(VkDevice device, VkPipelineCache pipelineCache,
+                                                                   uint32_t createInfoCount,
+                                                                   const VkGraphicsPipelineCreateInfo* pCreateInfos,
+                                                                   const VkAllocationCallbacks* pAllocator,
+                                                                   VkPipeline* pPipelines)
+{
+    XENO_TRACE_SCOPE("vkCreateGraphicsPipelines");
+    XenoDeviceDispatch* d = xeno_device_dispatch(device);
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    VkGraphicsPipelineCreateInfo* patched = xeno_rp_patch_pipelines(d, createInfoCount, pCreateInfos);
+    VkResult res = xclipse_vrs_create_graphics_pipelines(d, pipelineCache, createInfoCount,
+                                                         patched ? patched : pCreateInfos, pAllocator, pPipelines);
+    free(patched);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    xeno_autotune_pipeline_compiled((double)(t1.tv_sec - t0.tv_sec) * 1000.0 + (double)(t1.tv_nsec - t0.tv_nsec) / 1e6);
+    return res;
+}
+
+static VKAPI_ATTR VkResult VKAPI_CALL xeno_BeginCommandBuffer(VkCommandBuffer commandBuffer,
+                                                             const VkCommandBufferBeginInfo* pBeginInfo)
+{
+    XenoDeviceDispatch* d = xeno_device_dispatch(commandBuffer);
+    VkCommandBufferBeginInfo info;
+    VkCommandBufferInheritanceInfo inheritance;
+    if (xeno_rp_begin_command_buffer(d, commandBuffer, pBeginInfo, &info, &inheritance)) pBeginInfo = &info;
+    VkResult res = d->BeginCommandBuffer(commandBuffer, pBeginInfo);
+    if (res == VK_SUCCESS) xeno_cmd_begin(d, commandBuffer, pBeginInfo);
+    /* Secondaries inherit no dynamic state from the primary. */
+    if (res == VK_SUCCESS && (pBeginInfo->flags & VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT)) {
+        xclipse_vrs_apply(d, commandBuffer);
+    }
+    return res;
+}
+
+static VKAPI_ATTR void VKAPI_CALL xeno_CmdBeginRenderPass(VkCommandBuffer commandBuffer,
+                                                          const VkRenderPassBeginInfo* pRenderPassBegin,
+                                                          VkSubpassContents contents)
+{
+    XenoDeviceDispatch* d = xeno_device_dispatch(commandBuffer);
+    VkSubpassBeginInfo sub = { .sType = VK_STRUCTURE_TYPE_SUBPASS_BEGIN_INFO, .contents = contents };
+    VkRenderPassBeginInfo begin;
+    switch (xeno_loadstore_begin_render_pass(d, commandBuffer, pRenderPassBegin, &sub, &begin)) {
+    case XENO_LOADSTORE_FUSED:
+        xclipse_vrs_pass_begin(d, commandBuffer, 0);
+        return;
+    case 1:
+        pRenderPassBegin = &begin;
+        break;
+    }
+    xeno_cmd_pass(d, commandBuffer, 1);
+    xclipse_vrs_pass_begin(d, commandBuffer, 1);
+    d->CmdBeginRenderPass(commandBuffer, pRenderPassBegin, contents);
+}
+
+/* A held end (loadstore_opt.c) is recorded later by xeno_cmd.c; the pass
+   timing query closes inside the instance, which is allowed without
+   multiview. */
+static VKAPI_ATTR void VKAPI_CALL xeno_CmdEndRenderPass(VkCommandBuffer commandBuffer)
+{
+    XenoDeviceDispatch* d = xeno_device_dispatch(commandBuffer);
+    if (xeno_loadstore_end_render_pass(d, commandBuffer, NULL)) {
+        xclipse_vrs_pass_end(d, commandBuffer);
+        return;
+    }
+    d->CmdEndRenderPass(commandBuffer);
+    xclipse_vrs_pass_end(d, commandBuffer);
+    xeno_cmd_pass(d, commandBuffer, 0);
+}
+
+static VKAPI_ATTR void VKAPI_CALL xeno_CmdBeginRenderPass2(VkCommandBuffer commandBuffer,
+                                                           const VkRenderPassBeginInfo* pRenderPassBegin,
+                                                           const VkSubpassBeginInfo* pSubpassBeginInfo)
+{
+    XenoDeviceDispatch* d = xeno_device_dispatch(commandBuffer);
+    VkRenderPassBeginInfo begin;
+    switch (xeno_loadstore_begin_render_pass(d, commandBuffer, pRenderPassBegin, pSubpassBeginInfo, &begin)) {
+    case XENO_LOADSTORE_FUSED:
+        xclipse_vrs_pass_begin(d, commandBuffer, 0);
+        return;
+    case 1:
+        pRenderPassBegin = &begin;
+        break;
+    }
+    xeno_cmd_pass(d, commandBuffer, 1);
+    xclipse_vrs_pass_begin(d, commandBuffer, 1);
+    d->CmdBeginRenderPass2(commandBuffer, pRenderPassBegin, pSubpassBeginInfo);
+}
+
+static VKAPI_ATTR void VKAPI_CALL xeno_CmdEndRenderPass2(VkCommandBuffer commandBuffer,
+                                                         const VkSubpassEndInfo* pSubpassEndInfo)
+{
+    XenoDeviceDispatch* d = xeno_device_dispatch(commandBuffer);
+    if (xeno_loadstore_end_render_pass(d, commandBuffer, pSubpassEndInfo)) {
+        xclipse_vrs_pass_end(d, commandBuffer);
+        return;
+    }
+    d->CmdEndRenderPass2(commandBuffer, pSubpassEndInfo);
+    xclipse_vrs_pass_end(d, commandBuffer);
+    xeno_cmd_pass(d, commandBuffer, 0);
+}
+
+static VKAPI_ATTR void VKAPI_CALL xeno_CmdBeginRendering(VkCommandBuffer commandBuffer,
+                                                         const VkRenderingInfo* pRenderingInfo)
+{
+    XenoDeviceDispatch* d = xeno_device_dispatch(commandBuffer);
+    int timed = !(pRenderingInfo->flags & (VK_RENDERING_SUSPENDING_BIT | VK_RENDERING_RESUMING_BIT));
+    /* Ahead of emulation, which builds its render pass from these ops. */
+    VkRenderingInfo ops;
+    VkRenderingAttachmentInfo attachments[XENO_LOADSTORE_MAX_ATTACHMENTS];
+    if (xeno_loadstore_begin_rendering(d, commandBuffer, pRenderingInfo, &ops, attachments)) pRenderingInfo = &ops;
+    xeno_cmd_pass(d, commandBuffer, 1);
+    xclipse_vrs_pass_begin(d, commandBuffer, timed);
+    if (xeno_rp_begin_rendering(d, commandBuffer, pRenderingInfo)) return;
+    VkRenderingInfo info;
+    VkRenderingFragmentShadingRateAttachmentInfoKHR rate;
+    if (xclipse_vrs_content_attach(d, pRenderingInfo, &info, &rate)) pRenderingInfo = &info;
+    d->CmdBeginRendering(commandBuffer, pRenderingInfo);
+}
+
+static VKAPI_ATTR void VKAPI_CALL xeno_CmdEndRendering(VkCommandBuffer commandBuffer)
+{
+    XenoDeviceDispatch* d = xeno_device_dispatch(commandBuffer);
+    if (!xeno_rp_end_rendering(d, commandBuffer)) d->CmdEndRendering(commandBuffer);
+    xclipse_vrs_pass_end(d, commandBuffer);
+    xeno_cmd_pass(d, commandBuffer, 0);
+}
+
+/* Frame boundary in traces: an instant per present and the time since the
+   previous one, process-wide like the autotuner's frame clock. */
+static void trace_present(void)
+{
+    static _Atomic uint64_t last_ns;
+    if (!xeno_trace_active()) {
+        atomic_store_explicit(&last_ns, 0, memory_order_relaxed);
+        return;
+    }
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    uint64_t now = (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+    uint64_t prev = atomic_exchange_explicit(&last_ns, now, memory_order_relaxed);
+    XENO_TRACE_INSTANT("present");
+    if (prev) XENO_TRACE_COUNTER("frame_time_us", (now - prev) / 1000u);
+}
+
+static VKAPI_ATTR VkResult VKAPI_CALL xeno_QueuePresentKHR(VkQueue queue, const VkPresentInfoKHR* pPresentInfo)
+{
+    XenoDeviceDispatch* d = xeno_device_dispatch(queue);
+    trace_present();
+    xclipse_vrs_frame_end(d);
+    xeno_rp_frame(d);
+    xeno_loadstore_frame(d);
+    xeno_bindless_frame(d);
+    xeno_desc_frame(d);
+    xeno_autotune_frame();
+    if (d->async) return xclipse_async_queue_present(d, queue, pPresentInfo);
+    VkPresentInfoKHR info = *pPresentInfo;
+    xclipse_vrs_content_present(d, queue, &info);
+    return d->QueuePresentKHR(queue, &info);
+}
+
+static VKAPI_ATTR void VKAPI_CALL xeno_GetDeviceQueue(VkDevice device, uint32_t queueFamilyIndex, uint32_t queueIndex,
+                                                      VkQueue* pQueue)
+{
+    XenoDeviceDispatch* d = xeno_device_dispatch(device);
+    d->GetDeviceQueue(device, queueFamilyIndex, queueIndex, pQueue);
+    xclipse_vrs_content_track_queue(d, *pQueue, queueFamilyIndex);
+    xclipse_async_track_queue(d, *pQueue);
+}
+
+static VKAPI_ATTR void VKAPI_CALL xeno_GetDeviceQueue2(VkDevice device, const VkDeviceQueueInfo2* pQueueInfo,
+                                                       VkQueue* pQueue)
+{
+    XenoDeviceDispatch* d = xeno_device_dispatch(device);
+    d->GetDeviceQueue2(device, pQueueInfo, pQueue);
+    xclipse_vrs_content_track_queue(d, *pQueue, pQueueInfo->queueFamilyIndex);
+    xclipse_async_track_queue(d, *pQueue);
+}
+
+static VKAPI_ATTR VkResult VKAPI_CALL xeno_CreateSwapchainKHR(VkDevice device, const VkSwapchainCreateInfoKHR* pCreateInfo,
+                                                              const VkAllocationCallbacks* pAllocator,
+                                                              VkSwapchainKHR* pSwapchain)
+{
+    XenoDeviceDispatch* d = xeno_device_dispatch(device);
+    xclipse_async_drain(d, VK_NULL_HANDLE);   /* queued presents may target oldSwapchain */
+    VkSwapchainCreateInfoKHR ci = *pCreateInfo;
+    xclipse_vrs_content_adjust_swapchain(d, &ci);
+    VkResult res = d->CreateSwapchainKHR(device, &ci, pAllocator, pSwapchain);
+    if (res == VK_SUCCESS) xclipse_vrs_content_swapchain_created(d, *pSwapchain, &ci);
+    return res;
+}
+
+static VKAPI_ATTR void VKAPI_CALL xeno_DestroySwapchainKHR(VkDevice device, VkSwapchainKHR swapchain,
+                                                           const VkAllocationCallbacks* pAllocator)
+{
+    XenoDeviceDispatch* d = xeno_device_dispatch(device);
+    xclipse_async_drain(d, VK_NULL_HANDLE);
+    xclipse_vrs_content_swapchain_destroyed(d, swapchain);
+    d->DestroySwapchainKHR(device, swapchain, pAllocator);
+}
+
+/* ---------------------------------------------------------------- */
+/* Attachments (rp_cache.c, loadstore_opt.c)                        */
+/* ---------------------------------------------------------------- */
+
+/* Dynamic-rendering emulation and load/store-op rewriting both need to
+   know what the views bound as attachments are; the render pass and
+   framebuffer hooks only serve the latter. */
+
+static VKAPI_ATTR VkResult VKAPI_CALL xeno_CreateImage(VkDevice device, const VkImageCreateInfo* pCreateInfo,
+                                                       const VkAllocationCallbacks* pAllocator, VkImage* pImage)
+{
+    XenoDeviceDispatch* d = xeno_device_dispatch(device);
+    VkResult res = d->CreateImage(device, pCreateInfo, pAllocator, pImage);
+    if (res == VK_SUCCESS) {
+        xeno_rp_image_created(d, *pImage, pCreateInfo);
+        xeno_loadstore_image_created(d, *pImage, pCreateInfo);
+    }
+    return res;
+}
+
+static VKAPI_ATTR void VKAPI_CALL xeno_DestroyImage(VkDevice device, VkImage image,
+                                                    const VkAllocationCallbacks* pAllocator)
+{
+    XenoDeviceDispatch* d = xeno_device_dispatch(device);
+    xeno_rp_image_destroyed(d, image);
+    xeno_loadstore_image_destroyed(d, image);
+    d->DestroyImage(device, image, pAllocator);
+}
+
+static VKAPI_ATTR VkResult VKAPI_CALL xeno_CreateImageView(VkDevice device, const VkImageViewCreateInfo* pCreateInfo,
+                                                           const VkAllocationCallbacks* pAllocator, VkImageView* pView)
+{
+    XenoDeviceDispatch* d = xeno_device_dispatch(device);
+    VkResult res = d->CreateImageView(device, pCreateInfo, pAllocator, pView);
+    if (res == VK_SUCCESS) {
+        xeno_rp_view_created(d, *pView, pCreateInfo);
+        xeno_loadstore_view_created(d, *pView, pCreateInfo);
+    }
+    return res;
+}
+
+static VKAPI_ATTR void VKAPI_CALL xeno_DestroyImageView(VkDevice device, VkImageView imageView,
+                                                        const VkAllocationCallbacks* pAllocator)
+{
+    XenoDeviceDispatch* d = xeno_device_dispatch(device);
+    xeno_rp_view_destroyed(d, imageView);   /* its framebuffers go first */
+    xeno_loadstore_view_destroyed(d, imageView);
+    xeno_desc_object_destroyed(d, (uint64_t)imageView);
+    d->DestroyImageView(device, imageView, pAllocator);
+}
+
+static VKAPI_ATTR VkResult VKAPI_CALL xeno_CreateRenderPass(VkDevice device, const VkRenderPassCreateInfo* pCreateInfo,
+                                                            const VkAllocationCallbacks* pAllocator,
+                                                            VkRenderPass* pRenderPass)
+{
+    XenoDeviceDispatch* d = xeno_device_dispatch(device);
+    VkResult res = d->CreateRenderPass(device, pCreateInfo, pAllocator, pRenderPass);
+    if (res == VK_SUCCESS) xeno_loadstore_render_pass_created(d, *pRenderPass, pCreateInfo);
+    return res;
+}
+
+static VKAPI_ATTR VkResult VKAPI_CALL xeno_CreateRenderPass2(VkDevice device, const VkRenderPassCreateInfo2* pCreateInfo,
+                                                             const VkAllocationCallbacks* pAllocator,
+                                                             VkRenderPass* pRenderPass)
+{
+    XenoDeviceDispatch* d = xeno_device_dispatch(device);
+    VkResult res = d->CreateRenderPass2(device, pCreateInfo, pAllocator, pRenderPass);
+    if (res == VK_SUCCESS) xeno_loadstore_render_pass2_created(d, *pRenderPass, pCreateInfo);
+    return res;
+}
+
+static VKAPI_ATTR void VKAPI_CALL xeno_DestroyRenderPass(VkDevice device, VkRenderPass renderPass,
+                                                         const VkAllocationCallbacks* pAllocator)
+{
+    XenoDeviceDispatch* d = xeno_device_dispatch(device);
+    xeno_loadstore_render_pass_destroyed(d, renderPass);    /* with its variants */
+    d->DestroyRenderPass(device, renderPass, pAllocator);
+}
+
+static VKAPI_ATTR VkResult VKAPI_CALL xeno_CreateFramebuffer(VkDevice device, const VkFramebufferCreateInfo* pCreateInfo,
+                                                             const VkAllocationCallbacks* pAllocator,
+                                                             VkFramebuffer* pFramebuffer)
+{
+    XenoDeviceDispatch* d = xeno_device_dispatch(device);
+    VkResult res = d->CreateFramebuffer(device, pCreateInfo, pAllocator, pFramebuffer);
+    if (res == VK_SUCCESS) xeno_loadstore_framebuffer_created(d, *pFramebuffer, pCreateInfo);
+    return res;
+}
+
+static VKAPI_ATTR void VKAPI_CALL xeno_DestroyFramebuffer(VkDevice device, VkFramebuffer framebuffer,
+                                                          const VkAllocationCallbacks* pAllocator)
+{
+    XenoDeviceDispatch* d = xeno_device_dispatch(device);
+    xeno_loadstore_framebuffer_destroyed(d, framebuffer);
+    d->DestroyFramebuffer(device, framebuffer, pAllocator);
+}
+
+/* ---------------------------------------------------------------- */
+/* Shader modules (shader_cache.c, spirv_opt.c)                      */
+/* ---------------------------------------------------------------- */
+
+static VKAPI_ATTR VkResult VKAPI_CALL xeno_CreateShaderModule(VkDevice device, const VkShaderModuleCreateInfo* pCreateInfo,
+                                                              const VkAllocationCallbacks* pAllocator,
+                                                              VkShaderModule* pShaderModule)
+{
+    return xeno_shader_create(xeno_device_dispatch(device), pCreateInfo, pAllocator, pShaderModule);
+}
+
+static VKAPI_ATTR void VKAPI_CALL xeno_DestroyShaderModule(VkDevice device, VkShaderModule shaderModule,
+                                                           const VkAllocationCallbacks* pAllocator)
+{
+    xeno_shader_destroy(xeno_device_dispatch(device), shaderModule, pAllocator);
+}
+
+/* ---------------------------------------------------------------- */
+/* Descriptor sets (desc_cache.c)                                    */
+/* ---------------------------------------------------------------- */
+
+/* Sets whose first writes match contents seen before are never written;
+   binds swap in the layer-owned set with those contents. Destroying
+   anything a descriptor can name retires the contents that name it. */
+
+static VKAPI_ATTR VkResult VKAPI_CALL xeno_CreateDescriptorSetLayout(VkDevice device,
+                                                                     const VkDescriptorSetLayoutCreateInfo* pCreateInfo,
+                                                                     const VkAllocationCallbacks* pAllocator,
+                                                                     VkDescriptorSetLayout* pSetLayout)
+{
+    XenoDeviceDispatch* d = xeno_device_dispatch(device);
+    VkResult res = d->CreateDescriptorSetLayout(device, pCreateInfo, pAllocator, pSetLayout);
+    if (res == VK_SUCCESS) xeno_desc_layout_created(d, *pSetLayout, pCreateInfo);
+    return res;
+}
+
+static VKAPI_ATTR void VKAPI_CALL xeno_DestroyDescriptorSetLayout(VkDevice device, VkDescriptorSetLayout descriptorSetLayout,
+                                                                  const VkAllocationCallbacks* pAllocator)
+{
+    XenoDeviceDispatch* d = xeno_device_dispatch(device);
+    xeno_desc_layout_destroyed(d, descriptorSetLayout);
+    d->DestroyDescriptorSetLayout(device, descriptorSetLayout, pAllocator);
+}
+
+static VKAPI_ATTR VkResult VKAPI_CALL xeno_AllocateDescriptorSets(VkDevice device,
+                                                                  const VkDescriptorSetAllocateInfo* pAllocateInfo,
+                                                                  VkDescriptorSet* pDescriptorSets)
+{
+    XenoDeviceDispatch* d = xeno_device_dispatch(device);
+    VkResult res = d->AllocateDescriptorSets(device, pAllocateInfo, pDescriptorSets);
+    if (res == VK_SUCCESS) xeno_desc_sets_allocated(d, pAllocateInfo, pDescriptorSets);
+    return res;
+}
+
+static VKAPI_ATTR VkResult VKAPI_CALL xeno_FreeDescriptorSets(VkDevice device, VkDescriptorPool descriptorPool,
+                                                              uint32_t descriptorSetCount,
+                                                              const VkDescriptorSet* pDescriptorSets)
+{
+    XenoDeviceDispatch* d = xeno_device_dispatch(device);
+    xeno_desc_sets_freed(d, descriptorSetCount, pDescriptorSets);
+    return d->FreeDescriptorSets(device, descriptorPool, descriptorSetCount, pDescriptorSets);
+}
+
+static VKAPI_ATTR VkResult VKAPI_CALL xeno_ResetDescriptorPool(VkDevice device, VkDescriptorPool descriptorPool,
+                                                               VkDescriptorPoolResetFlags flags)
+{
+    XenoDeviceDispatch* d = xeno_device_dispatch(device);
+    xeno_desc_pool_reset(d, descriptorPool, 0);
+    return d->ResetDescriptorPool(device, descriptorPool, flags);
+}
+
+static VKAPI_ATTR void VKAPI_CALL xeno_DestroyDescriptorPool(VkDevice device, VkDescriptorPool descriptorPool,
+                                                             const VkAllocationCallbacks* pAllocator)
+{
+    XenoDeviceDispatch* d = xeno_device_dispatch(device);
+    xeno_desc_pool_reset(d, descriptorPool, 1);
+    d->DestroyDescriptorPool(device, descriptorPool, pAllocator);
+}
+
+static VKAPI_ATTR void VKAPI_CALL xeno_UpdateDescriptorSets(VkDevice device, uint32_t descriptorWriteCount,
+                                                            const VkWriteDescriptorSet* pDescriptorWrites,
+                                                            uint32_t descriptorCopyCount,
+                                                            const VkCopyDescriptorSet* pDescriptorCopies)
+{
+    xeno_desc_update(xeno_device_dispatch(device), descriptorWriteCount, pDescriptorWrites, descriptorCopyCount,
+                     pDescriptorCopies);
+}
+
+static VKAPI_ATTR VkResult VKAPI_CALL xeno_CreateDescriptorUpdateTemplate(
+    VkDevice device, const VkDescriptorUpdateTemplateCreateInfo* pCreateInfo, const VkAllocationCallbacks* pAllocator,
+    VkDescriptorUpdateTemplate* pDescriptorUpdateTemplate)
+{
+    XenoDeviceDispatch* d = xeno_device_dispatch(device);
+    VkResult res = d->CreateDescriptorUpdateTemplate(device, pCreateInfo, pAllocator, pDescriptorUpdateTemplate);
+    if (res == VK_SUCCESS) xeno_desc_template_created(d, *pDescriptorUpdateTemplate, pCreateInfo);
+    return res;
+}
+
+static VKAPI_ATTR void VKAPI_CALL xeno_DestroyDescriptorUpdateTemplate(VkDevice device,
+                                                                       VkDescriptorUpdateTemplate descriptorUpdateTemplate,
+                                                                       const VkAllocationCallbacks* pAllocator)
+{
+    XenoDeviceDispatch* d = xeno_device_dispatch(device);
+    xeno_desc_template_destroyed(d, descriptorUpdateTemplate);
+    d->DestroyDescriptorUpdateTemplate(device, descriptorUpdateTemplate, pAllocator);
+}
+
+static VKAPI_ATTR void VKAPI_CALL xeno_UpdateDescriptorSetWithTemplate(VkDevice device, VkDescriptorSet descriptorSet,
+                                                                       VkDescriptorUpdateTemplate descriptorUpdateTemplate,
+                                                                       const void* pData)
+{
+    xeno_desc_update_with_template(xeno_device_dispatch(device), descriptorSet, descriptorUpdateTemplate, pData);
+}
+
+static VKAPI_ATTR void VKAPI_CALL xeno_CmdBindDescriptorSets(VkCommandBuffer commandBuffer,
+                                                             VkPipelineBindPoint pipelineBindPoint,
+                                                             VkPipelineLayout layout, uint32_t firstSet,
+                                                             uint32_t descriptorSetCount,
+                                                             const VkDescriptorSet* pDescriptorSets,
+                                                             uint32_t dynamicOffsetCount,
+                                                             const uint32_t* pDynamicOffsets)
+{
+    XenoDeviceDispatch* d = xeno_device_dispatch(commandBuffer);
+    VkDescriptorSet sets[XENO_DESC_MAX_BIND];
+    d->CmdBindDescriptorSets(commandBuffer, pipelineBindPoint, layout, firstSet, descriptorSetCount,
+                             xeno_desc_bind(d, descriptorSetCount, pDescriptorSets, sets), dynamicOffsetCount,
+                             pDynamicOffsets);
+}
+
+static VKAPI_ATTR void VKAPI_CALL xeno_DestroyBuffer(VkDevice device, VkBuffer buffer,
+                                                     const VkAllocationCallbacks* pAllocator)
+{
+    XenoDeviceDispatch* d = xeno_device_dispatch(device);
+    xeno_desc_object_destroyed(d, (uint64_t)buffer);
+    d->DestroyBuffer(device, buffer, pAllocator);
+}
+
+static VKAPI_ATTR void VKAPI_CALL xeno_DestroyBufferView(VkDevice device, VkBufferView bufferView,
+                                                         const VkAllocationCallbacks* pAllocator)
+{
+    XenoDeviceDispatch* d = xeno_device_dispatch(device);
+    xeno_desc_object_destroyed(d, (uint64_t)bufferView);
+    d->DestroyBufferView(device, bufferView, pAllocator);
+}
+
+static VKAPI_ATTR void VKAPI_CALL xeno_DestroySampler(VkDevice device, VkSampler sampler,
+                                                      const VkAllocationCallbacks* pAllocator)
+{
+    XenoDeviceDispatch* d = xeno_device_dispatch(device);
+    xeno_desc_object_destroyed(d, (uint64_t)sampler);
+    d->DestroySampler(device, sampler, pAllocator);
+}
+
+/* ---------------------------------------------------------------- */
+/* Command buffers and barriers (xeno_cmd.c, barrier_opt.c)          */
+/* ---------------------------------------------------------------- */
+
+/* Every command that does work outside a render pass reports it before
+   it is recorded; transfers also name what they touch, so a barrier held
+   back across them (sync_mode=aggressive) goes out before the first one
+   that conflicts. */
+
+static VKAPI_ATTR VkResult VKAPI_CALL xeno_AllocateCommandBuffers(VkDevice device,
+                                                                  const VkCommandBufferAllocateInfo* pAllocateInfo,
+                                                                  VkCommandBuffer* pCommandBuffers)
+{
+    XenoDeviceDispatch* d = xeno_device_dispatch(device);
+    VkResult res = d->AllocateCommandBuffers(device, pAllocateInfo, pCommandBuffers);
+    if (res == VK_SUCCESS) xeno_cmd_allocated(d, pAllocateInfo, pCommandBuffers);
+    return res;
+}
+
+static VKAPI_ATTR void VKAPI_CALL xeno_FreeCommandBuffers(VkDevice device, VkCommandPool commandPool,
+                                                          uint32_t commandBufferCount,
+                                                          const VkCommandBuffer* pCommandBuffers)
+{
+    XenoDeviceDispatch* d = xeno_device_dispatch(device);
+    xeno_cmd_freed(d, commandBufferCount, pCommandBuffers);
+    d->FreeCommandBuffers(device, commandPool, commandBufferCount, pCommandBuffers);
+}
+
+static VKAPI_ATTR void VKAPI_CALL xeno_DestroyCommandPool(VkDevice device, VkCommandPool commandPool,
+                                                          const VkAllocationCallbacks* pAllocator)
+{
+    XenoDeviceDispatch* d = xeno_device_dispatch(device);
+    xeno_cmd_pool_destroyed(d, commandPool);
+    d->DestroyCommandPool(device, commandPool, pAllocator);
+}
+
+static VKAPI_ATTR VkResult VKAPI_CALL xeno_EndCommandBuffer(VkCommandBuffer commandBuffer)
+{
+    XenoDeviceDispatch* d = xeno_device_dispatch(commandBuffer);
+    xeno_cmd_end(d, commandBuffer);
+    return d->EndCommandBuffer(commandBuffer);
+}
+
+static VKAPI_ATTR void VKAPI_CALL xeno_CmdPipelineBarrier(VkCommandBuffer commandBuffer,
+                                                          VkPipelineStageFlags srcStageMask,
+                                                          VkPipelineStageFlags dstStageMask,
+                                                          VkDependencyFlags dependencyFlags,
+                                                          uint32_t memoryBarrierCount,
+                                                          const VkMemoryBarrier* pMemoryBarriers,
+                                                          uint32_t bufferMemoryBarrierCount,
+                                                          const VkBufferMemoryBarrier* pBufferMemoryBarriers,
+                                                          uint32_t imageMemoryBarrierCount,
+                                                          const VkImageMemoryBarrier* pImageMemoryBarriers)
+{
+    XenoDeviceDispatch* d = xeno_device_dispatch(commandBuffer);
+    xeno_cmd_pipeline_barrier(d, commandBuffer, srcStageMask, dstStageMask, dependencyFlags, memoryBarrierCount,
+                              pMemoryBarriers, bufferMemoryBarrierCount, pBufferMemoryBarriers,
+                              imageMemoryBarrierCount, pImageMemoryBarriers);
+}
+
+static VKAPI_ATTR void VKAPI_CALL xeno_CmdPipelineBarrier2(VkCommandBuffer commandBuffer,
+                                                           const VkDependencyInfo* pDependencyInfo)
+{
+    XenoDeviceDispatch* d = xeno_device_dispatch(commandBuffer);
+    xeno_cmd_pipeline_barrier2(d, commandBuffer, pDependencyInfo);
+}
+
+static VKAPI_ATTR void VKAPI_CALL xeno_CmdExecuteCommands(VkCommandBuffer commandBuffer, uint32_t commandBufferCount,
+                                                          const VkCommandBuffer* pCommandBuffers)
+{
+    XenoDeviceDispatch* d = xeno_device_dispatch(commandBuffer);
+    xeno_cmd_opaque(d, commandBuffer);
+    xeno_rp_execute_commands(d, commandBuffer, commandBufferCount, pCommandBuffers);
+    d->CmdExecuteCommands(commandBuffer, commandBufferCount, pCommandBuffers);
+}
+
+/* Events order against everything recorded before them. */
+
+static VKAPI_ATTR void VKAPI_CALL xeno_CmdSetEvent(VkCommandBuffer commandBuffer, VkEvent event,
+                                                   VkPipelineStageFlags stageMask)
+{
+    XenoDeviceDispatch* d = xeno_device_dispatch(commandBuffer);
+    xeno_cmd_flush(d, commandBuffer);
+    d->CmdSetEvent(commandBuffer, event, stageMask);
+}
+
+static VKAPI_ATTR void VKAPI_CALL xeno_CmdSetEvent2(VkCommandBuffer commandBuffer, VkEvent event,
+                                                    const VkDependencyInfo* pDependencyInfo)
+{
+    XenoDeviceDispatch* d = xeno_device_dispatch(commandBuffer);
+    xeno_cmd_flush(d, commandBuffer);
+    d->CmdSetEvent2(commandBuffer, event, pDependencyInfo);
+}
+
+static VKAPI_ATTR void VKAPI_CALL xeno_CmdResetEvent(VkCommandBuffer commandBuffer, VkEvent event,
+                                                     VkPipelineStageFlags stageMask)
+{
+    XenoDeviceDispatch* d = xeno_device_dispatch(commandBuffer);
+    xeno_cmd_flush(d, commandBuffer);
+    d->CmdResetEvent(commandBuffer, event, stageMask);
+}
+
+static VKAPI_ATTR void VKAPI_CALL xeno_CmdResetEvent2(VkCommandBuffer commandBuffer, VkEvent event,
+                                                      VkPipelineStageFlags2 stageMask)
+{
+    XenoDeviceDispatch* d = xeno_device_dispatch(commandBuffer);
+    xeno_cmd_flush(d, commandBuffer);
+    d->CmdResetEvent2(commandBuffer, event, stageMask);
+}
+
+static VKAPI_ATTR void VKAPI_CALL xeno_CmdWaitEvents(VkCommandBuffer commandBuffer, uint32_t eventCount,
+                                                     const VkEvent* pEvents, VkPipelineStageFlags srcStageMask,
+                                                     VkPipelineStageFlags dstStageMask, uint32_t memoryBarrierCount,
+                                                     const VkMemoryBarrier* pMemoryBarriers,
+                                                     uint32_t bufferMemoryBarrierCount,
+                                                     const VkBufferMemoryBarrier* pBufferMemoryBarriers,
+                                                     uint32_t imageMemoryBarrierCount,
+                                                     const VkImageMemoryBarrier* pImageMemoryBarriers)
+{
+    XenoDeviceDispatch* d = xeno_device_dispatch(commandBuffer);
+    xeno_cmd_flush(d, commandBuffer);
+    d->CmdWaitEvents(commandBuffer, eventCount, pEvents, srcStageMask, dstStageMask, memoryBarrierCount,
+                     pMemoryBarriers, bufferMemoryBarrierCount, pBufferMemoryBarriers, imageMemoryBarrierCount,
+                     pImageMemoryBarriers);
+}
+
+static VKAPI_ATTR void VKAPI_CALL xeno_CmdWaitEvents2(VkCommandBuffer commandBuffer, uint32_t eventCount,
+                                                      const VkEvent* pEvents, const VkDependencyInfo* pDependencyInfos)
+{
+    XenoDeviceDispatch* d = xeno_device_dispatch(commandBuffer);
+    xeno_cmd_flush(d, commandBuffer);
+    d->CmdWaitEvents2(commandBuffer, eventCount, pEvents, pDependencyInfos);
+}
+
+/* Compute and ray tracing. */
+
+static VKAPI_ATTR void VKAPI_CALL xeno_CmdDispatch(VkCommandBuffer commandBuffer, uint32_t groupCountX,
+                                                   uint32_t groupCountY, uint32_t groupCountZ)
+{
+    XenoDeviceDispatch* d = xeno_device_dispatch(commandBuffer);
+    xeno_cmd_work(d, commandBuffer, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, NULL, 0);
+    d->CmdDispatch(commandBuffer, groupCountX, groupCountY, groupCountZ);
+}
+
+static VKAPI_ATTR void VKAPI_CALL xeno_CmdDispatchIndirect(VkCommandBuffer commandBuffer, VkBuffer buffer,
+                                                           VkDeviceSize offset)
+{
+    XenoDeviceDispatch* d = xeno_device_dispatch(commandBuffer);
+    xeno_cmd_work(d, commandBuffer, VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+                  NULL, 0);
+    d->CmdDispatchIndirect(commandBuffer, buffer, offset);
+}
+
+static VKAPI_ATTR void VKAPI_CALL xeno_CmdDispatchBase(VkCommandBuffer commandBuffer, uint32_t baseGroupX,
+                                                       uint32_t baseGroupY, uint32_t baseGroupZ, uint32_t groupCountX,
+                                                       uint32_t groupCountY, uint32_t groupCountZ)
+{
+    XenoDeviceDispatch* d = xeno_device_dispatch(commandBuffer);
+    xeno_cmd_work(d, commandBuffer, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, NULL, 0);
+    d->CmdDispatchBase(commandBuffer, baseGroupX, baseGroupY, baseGroupZ, groupCountX, groupCountY, groupCountZ);
+}
+
+static VKAPI_ATTR void VKAPI_CALL xeno_CmdTraceRaysKHR(VkCommandBuffer commandBuffer,
+                                                       const VkStridedDeviceAddressRegionKHR* pRaygenShaderBindingTable,
+                                                       const VkStridedDeviceAddressRegionKHR* pMissShaderBindingTable,
+                                                       const VkStridedDeviceAddressRegionKHR* pHitShaderBindingTable,
+                                                       const VkStridedDeviceAddressRegionKHR* pCallableShaderBindingTable,
+                                                       uint32_t width, uint32_t height, uint32_t depth)
+{
+    XenoDeviceDispatch* d = xeno_device_dispatch(commandBuffer);
+    xeno_cmd_work(d, commandBuffer, VK_PIPELINE_STAGE_2_RAY_TRACING_SHADER_BIT_KHR, NULL, 0);
+    d->CmdTraceRaysKHR(commandBuffer, pRaygenShaderBindingTable, pMissShaderBindingTable, pHitShaderBindingTable,
+                       pCallableShaderBindingTable, width, height, depth);
+}
+
+static VKAPI_ATTR void VKAPI_CALL xeno_CmdTraceRaysIndirectKHR(VkCommandBuffer commandBuffer,
+                                                               const VkStridedDeviceAddressRegionKHR* pRaygenShaderBindingTable,
+                                                               const VkStridedDeviceAddressRegionKHR* pMissShaderBindingTable,
+                                                               const VkStridedDeviceAddressRegionKHR* pHitShaderBindingTable,
+                                                               const VkStridedDeviceAddressRegionKHR* pCallableShaderBindingTable,
+                                                               VkDeviceAddress indirectDeviceAddress)
+{
+    XenoDeviceDispatch* d = xeno_device_dispatch(commandBuffer);
+    xeno_cmd_work(d, commandBuffer, VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_2_RAY_TRACING_SHADER_BIT_KHR,
+                  NULL, 0);
+    d->CmdTraceRaysIndirectKHR(commandBuffer, pRaygenShaderBindingTable, pMissShaderBindingTable,
+                               pHitShaderBindingTable, pCallableShaderBindingTable, indirectDeviceAddress);
+}
+
+static VKAPI_ATTR void VKAPI_CALL xeno_CmdTraceRaysIndirect2KHR(VkCommandBuffer commandBuffer,
+                                                                VkDeviceAddress indirectDeviceAddress)
+{
+    XenoDeviceDispatch* d = xeno_device_dispatch(commandBuffer);
+    xeno_cmd_work(d, commandBuffer, VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_2_RAY_TRACING_SHADER_BIT_KHR,
+                  NULL, 0);
+    d->CmdTraceRaysIndirect2KHR(commandBuffer, indirectDeviceAddress);
+}
+
+static VKAPI_ATTR void VKAPI_CALL xeno_CmdBuildAccelerationStructuresKHR(
+    VkCommandBuffer commandBuffer, uint32_t infoCount, const VkAccelerationStructureBuildGeometryInfoKHR* pInfos,
+    const VkAccelerationStructureBuildRangeInfoKHR* const* ppBuildRangeInfos)
+{
+    XenoDeviceDispatch* d = xeno_device_dispatch(commandBuffer);
+    xeno_cmd_work(d, commandBuffer, VK_PIPELINE_STAGE_2_ACCELERATION_STRUCTURE_BUILD_BIT_KHR, NULL, 0);
+    d->CmdBuildAccelerationStructuresKHR(commandBuffer, infoCount, pInfos, ppBuildRangeInfos);
+}
+
+static VKAPI_ATTR void VKAPI_CALL xeno_CmdBuildAccelerationStructuresIndirectKHR(
+    VkCommandBuffer commandBuffer, uint32_t infoCount, const VkAccelerationStructureBuildGeometryInfoKHR* pInfos,
+    const VkDeviceAddress* pIndirectDeviceAddresses, const uint32_t* pIndirectStrides,
+    const uint32_t* const* ppMaxPrimitiveCounts)
+{
+    XenoDeviceDispatch* d = xeno_device_dispatch(commandBuffer);
+    xeno_cmd_work(d, commandBuffer, VK_PIPELINE_STAGE_2_ACCELERATION_STRUCTURE_BUILD_BIT_KHR, NULL, 0);
+    d->CmdBuildAccelerationStructuresIndirectKHR(commandBuffer, infoCount, pInfos, pIndirectDeviceAddresses,
+                                                 pIndirectStrides, ppMaxPrimitiveCounts);
+}
+
+static VKAPI_ATTR void VKAPI_CALL xeno_CmdCopyAccelerationStructureKHR(VkCommandBuffer commandBuffer,
+                                                                       const VkCopyAccelerationStructureInfoKHR* pInfo)
+{
+    XenoDeviceDispatch* d = xeno_device_dispatch(commandBuffer);
+    xeno_cmd_work(d, commandBuffer, VK_PIPELINE_STAGE_2_ACCELERATION_STRUCTURE_BUILD_BIT_KHR, NULL, 0);
+    d->CmdCopyAccelerationStructureKHR(commandBuffer, pInfo);
+}
+
+static VKAPI_ATTR void VKAPI_CALL xeno_CmdCopyAccelerationStructureToMemoryKHR(
+    VkCommandBuffer commandBuffer, const VkCopyAccelerationStructureToMemoryInfoKHR* pInfo)
+{
+    XenoDeviceDispatch* d = xeno_device_dispatch(commandBuffer);
+    xeno_cmd_work(d, commandBuffer, VK_PIPELINE_STAGE_2_ACCELERATION_STRUCTURE_BUILD_BIT_KHR, NULL, 0);
+    d->CmdCopyAccelerationStructureToMemoryKHR(commandBuffer, pInfo);
+}
+
+static VKAPI_ATTR void VKAPI_CALL xeno_CmdCopyMemoryToAccelerationStructureKHR(
+    VkCommandBuffer commandBuffer, const VkCopyMemoryToAccelerationStructureInfoKHR* pInfo)
+{
+    XenoDeviceDispatch* d = xeno_device_dispatch(commandBuffer);
+    xeno_cmd_work(d, commandBuffer, VK_PIPELINE_STAGE_2_ACCELERATION_STRUCTURE_BUILD_BIT_KHR, NULL, 0);
+    d->CmdCopyMemoryToAccelerationStructureKHR(commandBuffer, pInfo);
+}
+
+static VKAPI_ATTR void VKAPI_CALL xeno_CmdWriteAccelerationStructuresPropertiesKHR(
+    VkCommandBuffer commandBuffer, uint32_t accelerationStructureCount,
+    const VkAccelerationStructureKHR* pAccelerationStructures, VkQueryType queryType, VkQueryPool queryPool,
+    uint32_t firstQuery)
+{
+    XenoDeviceDispatch* d = xeno_device_dispatch(commandBuffer);
+    xeno_cmd_work(d, commandBuffer, VK_PIPELINE_STAGE_2_ACCELERATION_STRUCTURE_BUILD_BIT_KHR, NULL, 0);
+    d->CmdWriteAccelerationStructuresPropertiesKHR(commandBuffer, accelerationStructureCount, pAccelerationStructures,
+                                                   queryType, queryPool, firstQuery);
+}
+
+/* Transfers. Buffer refs cover the regions' span; images are whole. */
+
+static void transfer(XenoDeviceDispatch* d, VkCommandBuffer cmd, const XenoBarrierRef* refs, uint32_t count)
+{
+    xeno_cmd_work(d, cmd, VK_PIPELINE_STAGE_2_TRANSFER_BIT, refs, count);
+}
+
+#define XENO_SPAN(regions, n, field, size_field, lo, hi)                           \
+    do {                                                                           \
+        (lo) = ~(VkDeviceSize)0;                                                   \
+        (hi) = 0;                                                                  \
+        for (uint32_t i_ = 0; i_ < (n); ++i_) {                                    \
+            VkDeviceSize b_ = (regions)[i_].field, e_ = b_ + (regions)[i_].size_field; \
+            if (b_ < (lo)) (lo) = b_;                                              \
+            if (e_ > (hi)) (hi) = e_;                                              \
+        }                                                                          \
+    } while (0)
+
+static void copy_buffer(XenoDeviceDispatch* d, VkCommandBuffer cmd, VkBuffer src, VkBuffer dst,
+                        VkDeviceSize src_lo, VkDeviceSize src_hi, VkDeviceSize dst_lo, VkDeviceSize dst_hi)
+{
+    XenoBarrierRef refs[2] = {
+        xeno_cmd_buffer_ref(src, src_lo, src_hi - src_lo, 0),
+        xeno_cmd_buffer_ref(dst, dst_lo, dst_hi - dst_lo, 1),
+    };
+    transfer(d, cmd, refs, 2);
+}
+
+static void copy_image(XenoDeviceDispatch* d, VkCommandBuffer cmd, VkImage src, VkImage dst)
+{
+    XenoBarrierRef refs[2] = { xeno_cmd_image_ref(src, 0), xeno_cmd_image_ref(dst, 1) };
+    transfer(d, cmd, refs, 2);
+}
+
+static void copy_buffer_image(XenoDeviceDispatch* d, VkCommandBuffer cmd, VkBuffer buffer, VkImage image,
+                              int to_image)
+{
+    XenoBarrierRef refs[2] = {
+        xeno_cmd_buffer_ref(buffer, 0, VK_WHOLE_SIZE, !to_image),
+        xeno_cmd_image_ref(image, to_image),
+    };
+    transfer(d, cmd, refs, 2);
+}
+
+static VKAPI_ATTR void VKAPI_CALL xeno_CmdCopyBuffer(VkCommandBuffer commandBuffer, VkBuffer srcBuffer,
+                                                     VkBuffer dstBuffer, uint32_t regionCount,
+                                                     const VkBufferCopy* pRegions)
+{
+    XenoDeviceDispatch* d = xeno_device_dispatch(commandBuffer);
+    VkDeviceSize slo, shi, dlo, dhi;
+    XENO_SPAN(pRegions, regionCount, srcOffset, size, slo, shi);
+    XENO_SPAN(pRegions, regionCount, dstOffset, size, dlo, dhi);
+    copy_buffer(d, commandBuffer, srcBuffer, dstBuffer, slo, shi, dlo, dhi);
+    d->CmdCopyBuffer(commandBuffer, srcBuffer, dstBuffer, regionCount, pRegions);
+}
+
+static VKAPI_ATTR void VKAPI_CALL xeno_CmdCopyBuffer2(VkCommandBuffer commandBuffer,
+                                                      const VkCopyBufferInfo2* pCopyBufferInfo)
+{
+    XenoDeviceDispatch* d = xeno_device_dispatch(commandBuffer);
+    VkDeviceSize slo, shi, dlo, dhi;
+    XENO_SPAN(pCopyBufferInfo->pRegions, pCopyBufferInfo->regionCount, srcOffset, size, slo, shi);
+    XENO_SPAN(pCopyBufferInfo->pRegions, pCopyBufferInfo->regionCount, dstOffset, size, dlo, dhi);
+    copy_buffer(d, commandBuffer, pCopyBufferInfo->srcBuffer, pCopyBufferInfo->dstBuffer, slo, shi, dlo, dhi);
+    d->CmdCopyBuffer2(commandBuffer, pCopyBufferInfo);
+}
+
+static VKAPI_ATTR void VKAPI_CALL xeno_CmdCopyImage(VkCommandBuffer commandBuffer, VkImage srcImage,
+                                                    VkImageLayout srcImageLayout, VkImage dstImage,
+                                                    VkImageLayout dstImageLayout, uint32_t regionCount,
+                                                    const VkImageCopy* pRegions)
+{
+    XenoDeviceDispatch* d = xeno_device_dispatch(commandBuffer);
+    copy_image(d, commandBuffer, srcImage, dstImage);
+    d->CmdCopyImage(commandBuffer, srcImage, srcImageLayout, dstImage, dstImageLayout, regionCount, pRegions);
+}
+
+static VKAPI_ATTR void VKAPI_CALL xeno_CmdCopyImage2(VkCommandBuffer commandBuffer,
+                                                     const VkCopyImageInfo2* pCopyImageInfo)
+{
+    XenoDeviceDispatch* d = xeno_device_dispatch(commandBuffer);
+    copy_image(d, commandBuffer, pCopyImageInfo->srcImage, pCopyImageInfo->dstImage);
+    d->CmdCopyImage2(commandBuffer, pCopyImageInfo);
+}
+
+static VKAPI_ATTR void VKAPI_CALL xeno_CmdBlitImage(VkCommandBuffer commandBuffer, VkImage srcImage,
+                                                    VkImageLayout srcImageLayout, VkImage dstImage,
+                                                    VkImageLayout dstImageLayout, uint32_t regionCount,
+                                                    const VkImageBlit* pRegions, VkFilter filter)
+{
+    XenoDeviceDispatch* d = xeno_device_dispatch(commandBuffer);
+    copy_image(d, commandBuffer, srcImage, dstImage);
+    d->CmdBlitImage(commandBuffer, srcImage, srcImageLayout, dstImage, dstImageLayout, regionCount, pRegions, filter);
+}
+
+static VKAPI_ATTR void VKAPI_CALL xeno_CmdBlitImage2(VkCommandBuffer commandBuffer,
+                                                     const VkBlitImageInfo2* pBlitImageInfo)
+{
+    XenoDeviceDispatch* d = xeno_device_dispatch(commandBuffer);
+    copy_image(d, commandBuffer, pBlitImageInfo->srcImage, pBlitImageInfo->dstImage);
+    d->CmdBlitImage2(commandBuffer, pBlitImageInfo);
+}
+
+static VKAPI_ATTR void VKAPI_CALL xeno_CmdResolveImage(VkCommandBuffer commandBuffer, VkImage srcImage,
+                                                       VkImageLayout srcImageLayout, VkImage dstImage,
+                                                       VkImageLayout dstImageLayout, uint32_t regionCount,
+                                                       const VkImageResolve* pRegions)
+{
+    XenoDeviceDispatch* d = xeno_device_dispatch(commandBuffer);
+    copy_image(d, commandBuffer, srcImage, dstImage);
+    d->CmdResolveImage(commandBuffer, srcImage, srcImageLayout, dstImage, dstImageLayout, regionCount, pRegions);
+}
+
+static VKAPI_ATTR void VKAPI_CALL xeno_CmdResolveImage2(VkCommandBuffer commandBuffer,
+                                                        const VkResolveImageInfo2* pResolveImageInfo)
+{
+    XenoDeviceDispatch* d = xeno_device_dispatch(commandBuffer);
+    copy_image(d, commandBuffer, pResolveImageInfo->srcImage, pResolveImageInfo->dstImage);
+    d->CmdResolveImage2(commandBuffer, pResolveImageInfo);
+}
+
+static VKAPI_ATTR void VKAPI_CALL xeno_CmdCopyBufferToImage(VkCommandBuffer commandBuffer, VkBuffer srcBuffer,
+                                                            VkImage dstImage, VkImageLayout dstImageLayout,
+                                                            uint32_t regionCount, const VkBufferImageCopy* pRegions)
+{
+    XenoDeviceDispatch* d = xeno_device_dispatch(commandBuffer);
+    copy_buffer_image(d, commandBuffer, srcBuffer, dstImage, 1);
+    d->CmdCopyBufferToImage(commandBuffer, srcBuffer, dstImage, dstImageLayout, regionCount, pRegions);
+}
+
+static VKAPI_ATTR void VKAPI_CALL xeno_CmdCopyBufferToImage2(VkCommandBuffer commandBuffer,
+                                                             const VkCopyBufferToImageInfo2* pCopyBufferToImageInfo)
+{
+    XenoDeviceDispatch* d = xeno_device_dispatch(commandBuffer);
+    copy_buffer_image(d, commandBuffer, pCopyBufferToImageInfo->srcBuffer, pCopyBufferToImageInfo->dstImage, 1);
+    d->CmdCopyBufferToImage2(commandBuffer, pCopyBufferToImageInfo);
+}
+
+static VKAPI_ATTR void VKAPI_CALL xeno_CmdCopyImageToBuffer(VkCommandBuffer commandBuffer, VkImage srcImage,
+                                                            VkImageLayout srcImageLayout, VkBuffer dstBuffer,
+                                                            uint32_t regionCount, const VkBufferImageCopy* pRegions)
+{
+    XenoDeviceDispatch* d = xeno_device_dispatch(commandBuffer);
+    copy_buffer_image(d, commandBuffer, dstBuffer, srcImage, 0);
+    d->CmdCopyImageToBuffer(commandBuffer, srcImage, srcImageLayout, dstBuffer, regionCount, pRegions);
+}
+
+static VKAPI_ATTR void VKAPI_CALL xeno_CmdCopyImageToBuffer2(VkCommandBuffer commandBuffer,
+                                                             const VkCopyImageToBufferInfo2* pCopyImageToBufferInfo)
+{
+    XenoDeviceDispatch* d = xeno_device_dispatch(commandBuffer);
+    copy_buffer_image(d, commandBuffer, pCopyImageToBufferInfo->dstBuffer, pCopyImageToBufferInfo->srcImage, 0);
+    d->CmdCopyImageToBuffer2(commandBuffer, pCopyImageToBufferInfo);
+}
+
+static VKAPI_ATTR void VKAPI_CALL xeno_CmdFillBuffer(VkCommandBuffer commandBuffer, VkBuffer dstBuffer,
+                                                     VkDeviceSize dstOffset, VkDeviceSize size, uint32_t data)
+{
+    XenoDeviceDispatch* d = xeno_device_dispatch(commandBuffer);
+    XenoBarrierRef ref = xeno_cmd_buffer_ref(dstBuffer, dstOffset, size, 1);
+    transfer(d, commandBuffer, &ref, 1);
+    d->CmdFillBuffer(commandBuffer, dstBuffer, dstOffset, size, data);
+}
+
+static VKAPI_ATTR void VKAPI_CALL xeno_CmdUpdateBuffer(VkCommandBuffer commandBuffer, VkBuffer dstBuffer,
+                                                       VkDeviceSize dstOffset, VkDeviceSize dataSize,
+                                                       const void* pData)
+{
+    XenoDeviceDispatch* d = xeno_device_dispatch(commandBuffer);
+    XenoBarrierRef ref = xeno_cmd_buffer_ref(dstBuffer, dstOffset, dataSize, 1);
+    transfer(d, commandBuffer, &ref, 1);
+    d->CmdUpdateBuffer(commandBuffer, dstBuffer, dstOffset, dataSize, pData);
+}
+
+static VKAPI_ATTR void VKAPI_CALL xeno_CmdClearColorImage(VkCommandBuffer commandBuffer, VkImage image,
+                                                          VkImageLayout imageLayout, const VkClearColorValue* pColor,
+                                                          uint32_t rangeCount, const VkImageSubresourceRange* pRanges)
+{
+    XenoDeviceDispatch* d = xeno_device_dispatch(commandBuffer);
+    XenoBarrierRef ref = xeno_cmd_image_ref(image, 1);
+    transfer(d, commandBuffer, &ref, 1);
+    d->CmdClearColorImage(commandBuffer, image, imageLayout, pColor, rangeCount, pRanges);
+}
+
+static VKAPI_ATTR void VKAPI_CALL xeno_CmdClearDepthStencilImage(VkCommandBuffer commandBuffer, VkImage image,
+                                                                 VkImageLayout imageLayout,
+                                                                 const VkClearDepthStencilValue* pDepthStencil,
+                                                                 uint32_t rangeCount,
+                                                                 const VkImageSubresourceRange* pRanges)
+{
+    XenoDeviceDispatch* d = xeno_device_dispatch(commandBuffer);
+    XenoBarrierRef ref = xeno_cmd_image_ref(image, 1);
+    transfer(d, commandBuffer, &ref, 1);
+    d->CmdClearDepthStencilImage(commandBuffer, image, imageLayout, pDepthStencil, rangeCount, pRanges);
+}
+
+static VKAPI_ATTR void VKAPI_CALL xeno_CmdCopyQueryPoolResults(VkCommandBuffer commandBuffer, VkQueryPool queryPool,
+                                                               uint32_t firstQuery, uint32_t queryCount,
+                                                               VkBuffer dstBuffer, VkDeviceSize dstOffset,
+                                                               VkDeviceSize stride, VkQueryResultFlags flags)
+{
+    XenoDeviceDispatch* d = xeno_device_dispatch(commandBuffer);
+    /* The last query's results may be wider than the stride: 64-bit plus availability. */
+    XenoBarrierRef ref = xeno_cmd_buffer_ref(dstBuffer, dstOffset, stride * queryCount + 16u, 1);
+    transfer(d, commandBuffer, &ref, 1);
+    d->CmdCopyQueryPoolResults(commandBuffer, queryPool, firstQuery, queryCount, dstBuffer, dstOffset, stride, flags);
+}
+
+/* Queries and conditional rendering bracket what the app recorded between
+   its render passes, so a held render pass end goes out first. */
+
+static VKAPI_ATTR void VKAPI_CALL xeno_CmdResetQueryPool(VkCommandBuffer commandBuffer, VkQueryPool queryPool,
+                                                         uint32_t firstQuery, uint32_t queryCount)
+{
+    XenoDeviceDispatch* d = xeno_device_dispatch(commandBuffer);
+    xeno_cmd_release(d, commandBuffer);
+    d->CmdResetQueryPool(commandBuffer, queryPool, firstQuery, queryCount);
+}
+
+static VKAPI_ATTR void VKAPI_CALL xeno_CmdBeginQuery(VkCommandBuffer commandBuffer, VkQueryPool queryPool,
+                                                     uint32_t query, VkQueryControlFlags flags)
+{
+    XenoDeviceDispatch* d = xeno_device_dispatch(commandBuffer);
+    xeno_cmd_release(d, commandBuffer);
+    d->CmdBeginQuery(commandBuffer, queryPool, query, flags);
+}
+
+static VKAPI_ATTR void VKAPI_CALL xeno_CmdEndQuery(VkCommandBuffer commandBuffer, VkQueryPool queryPool,
+                                                   uint32_t query)
+{
+    XenoDeviceDispatch* d = xeno_device_dispatch(commandBuffer);
+    xeno_cmd_release(d, commandBuffer);
+    d->CmdEndQuery(commandBuffer, queryPool, query);
+}
+
+static VKAPI_ATTR void VKAPI_CALL xeno_CmdWriteTimestamp(VkCommandBuffer commandBuffer,
+                                                         VkPipelineStageFlagBits pipelineStage,
+                                                         VkQueryPool queryPool, uint32_t query)
+{
+    XenoDeviceDispatch* d = xeno_device_dispatch(commandBuffer);
+    xeno_cmd_release(d, commandBuffer);
+    d->CmdWriteTimestamp(commandBuffer, pipelineStage, queryPool, query);
+}
+
+static VKAPI_ATTR void VKAPI_CALL xeno_CmdWriteTimestamp2(VkCommandBuffer commandBuffer, VkPipelineStageFlags2 stage,
+                                                          VkQueryPool queryPool, uint32_t query)
+{
+    XenoDeviceDispatch* d = xeno_device_dispatch(commandBuffer);
+    xeno_cmd_release(d, commandBuffer);
+    d->CmdWriteTimestamp2(commandBuffer, stage, queryPool, query);
+}
+
+static VKAPI_ATTR void VKAPI_CALL xeno_CmdBeginConditionalRenderingEXT(
+    VkCommandBuffer commandBuffer, const VkConditionalRenderingBeginInfoEXT* pConditionalRenderingBegin)
+{
+    XenoDeviceDispatch* d = xeno_device_dispatch(commandBuffer);
+    xeno_cmd_release(d, commandBuffer);
+    d->CmdBeginConditionalRenderingEXT(commandBuffer, pConditionalRenderingBegin);
+}
+
+static VKAPI_ATTR void VKAPI_CALL xeno_CmdEndConditionalRenderingEXT(VkCommandBuffer commandBuffer)
+{
+    XenoDeviceDispatch* d = xeno_device_dispatch(commandBuffer);
+    xeno_cmd_release(d, commandBuffer);
+    d->CmdEndConditionalRenderingEXT(commandBuffer);
+}
+
+/* ---------------------------------------------------------------- */
+/* Queue submission (drivers/xclipse/async.c)                        */
+/* ---------------------------------------------------------------- */
+
+/* Everything below that is not a plain submit/present drains the submit
+   workers first, so the driver sees the queue in the order the app used it. */
+
+static VKAPI_ATTR VkResult VKAPI_CALL xeno_QueueSubmit(VkQueue queue, uint32_t submitCount, const VkSubmitInfo* pSubmits,
+                                                       VkFence fence)
+{
+    XenoDeviceDispatch* d = xeno_device_dispatch(queue);
+    xeno_rp_submitted(d, submitCount, pSubmits);
+    if (d->async) return xclipse_async_queue_submit(d, queue, submitCount, pSubmits, fence);
+    return d->QueueSubmit(queue, submitCount, pSubmits, fence);
+}
+
+static VKAPI_ATTR VkResult VKAPI_CALL xeno_QueueSubmit2(VkQueue queue, uint32_t submitCount, const VkSubmitInfo2* pSubmits,
+                                                        VkFence fence)
+{
+    XenoDeviceDispatch* d = xeno_device_dispatch(queue);
+    xeno_rp_submitted2(d, submitCount, pSubmits);
+    xclipse_async_drain(d, queue);
+    return d->QueueSubmit2(queue, submitCount, pSubmits, fence);
+}
+
+static VKAPI_ATTR VkResult VKAPI_CALL xeno_QueueBindSparse(VkQueue queue, uint32_t bindInfoCount,
+                                                           const VkBindSparseInfo* pBindInfo, VkFence fence)
+{
+    XenoDeviceDispatch* d = xeno_device_dispatch(queue);
+    xclipse_async_drain(d, queue);
+    return d->QueueBindSparse(queue, bindInfoCount, pBindInfo, fence);
+}
+
+static VKAPI_ATTR VkResult VKAPI_CALL xeno_QueueWaitIdle(VkQueue queue)
+{
+    XenoDeviceDispatch* d = xeno_device_dispatch(queue);
+    xclipse_async_drain(d, queue);
+    return d->QueueWaitIdle(queue);
+}
+
+static VKAPI_ATTR VkResult VKAPI_CALL xeno_DeviceWaitIdle(VkDevice device)
+{
+    XenoDeviceDispatch* d = xeno_device_dispatch(device);
+    xclipse_async_drain(d, VK_NULL_HANDLE);
+    return d->DeviceWaitIdle(device);
+}
+
+static VKAPI_ATTR VkResult VKAPI_CALL xeno_WaitForFences(VkDevice device, uint32_t fenceCount, const VkFence* pFences,
+                                                         VkBool32 waitAll, uint64_t timeout)
+{
+    XenoDeviceDispatch* d = xeno_device_dispatch(device);
+    /* A poll may see a still-queued fence as unsignalled, which is what it is. */
+    if (timeout) xclipse_async_drain(d, VK_NULL_HANDLE);
+    return d->WaitForFences(device, fenceCount, pFences, waitAll, timeout);
+}
+
+/* ---------------------------------------------------------------- */
+/* Proc addr                                                         */
+/* ---------------------------------------------------------------- */
+
+/* A hook is handed out only when the chain below has the entrypoint too,
+   so apps do not take a hook for an extension they did not get, and hooks
+   never call a NULL next pointer. emulated, when set, says the layer
+   implements the entrypoint on this device without the driver. */
+typedef struct XenoLayerHook {
+    const char* name;
+    PFN_vkVoidFunction fn;
+    int (*emulated)(const XenoDeviceDispatch* d);
+} XenoLayerHook;
+
+#define XENO_HOOK(name) { "vk" #name, (PFN_vkVoidFunction)xeno_##name, NULL }
+#define XENO_HOOK_KHR(name) { "vk" #name "KHR", (PFN_vkVoidFunction)xeno_##name, NULL }
+
+static int rendering_emulated(const XenoDeviceDispatch* d)
+{
+    return d->rp != NULL;
+}
+
+static const XenoLayerHook k_device_hooks[] = {
+    XENO_HOOK(DestroyDevice),
+    XENO_HOOK(CreateGraphicsPipelines),
+    XENO_HOOK(CreateImage),
+    XENO_HOOK(DestroyImage),
+    XENO_HOOK(CreateImageView),
+    XENO_HOOK(DestroyImageView),
+    XENO_HOOK(CreateRenderPass),
+    XENO_HOOK(CreateRenderPass2),
+    XENO_HOOK_KHR(CreateRenderPass2),
+    XENO_HOOK(DestroyRenderPass),
+    XENO_HOOK(CreateFramebuffer),
+    XENO_HOOK(DestroyFramebuffer),
+    XENO_HOOK(CreateShaderModule),
+    XENO_HOOK(DestroyShaderModule),
+    XENO_HOOK(CreateDescriptorSetLayout),
+    XENO_HOOK(DestroyDescriptorSetLayout),
+    XENO_HOOK(AllocateDescriptorSets),
+    XENO_HOOK(FreeDescriptorSets),
+    XENO_HOOK(ResetDescriptorPool),
+    XENO_HOOK(DestroyDescriptorPool),
+    XENO_HOOK(UpdateDescriptorSets),
+    XENO_HOOK(CreateDescriptorUpdateTemplate),
+    XENO_HOOK_KHR(CreateDescriptorUpdateTemplate),
+    XENO_HOOK(DestroyDescriptorUpdateTemplate),
+    XENO_HOOK_KHR(DestroyDescriptorUpdateTemplate),
+    XENO_HOOK(UpdateDescriptorSetWithTemplate),
+    XENO_HOOK_KHR(UpdateDescriptorSetWithTemplate),
+    XENO_HOOK(CmdBindDescriptorSets),
+    XENO_HOOK(DestroyBuffer),
+    XENO_HOOK(DestroyBufferView),
+    XENO_HOOK(DestroySampler),
+    XENO_HOOK(BeginCommandBuffer),
+    XENO_HOOK(EndCommandBuffer),
+    XENO_HOOK(AllocateCommandBuffers),
+    XENO_HOOK(FreeCommandBuffers),
+    XENO_HOOK(DestroyCommandPool),
+    XENO_HOOK(CmdPipelineBarrier),
+    XENO_HOOK(CmdPipelineBarrier2),
+    XENO_HOOK_KHR(CmdPipelineBarrier2),
+    XENO_HOOK(CmdExecuteCommands),
+    XENO_HOOK(CmdSetEvent),
+    XENO_HOOK(CmdSetEvent2),
+    XENO_HOOK_KHR(CmdSetEvent2),
+    XENO_HOOK(CmdResetEvent),
+    XENO_HOOK(CmdResetEvent2),
+    XENO_HOOK_KHR(CmdResetEvent2),
+    XENO_HOOK(CmdWaitEvents),
+    XENO_HOOK(CmdWaitEvents2),
+    XENO_HOOK_KHR(CmdWaitEvents2),
+    XENO_HOOK(CmdDispatch),
+    XENO_HOOK(CmdDispatchIndirect),
+    XENO_HOOK(CmdDispatchBase),
+    XENO_HOOK_KHR(CmdDispatchBase),
+    XENO_HOOK(CmdTraceRaysKHR),
+    XENO_HOOK(CmdTraceRaysIndirectKHR),
+    XENO_HOOK(CmdTraceRaysIndirect2KHR),
+    XENO_HOOK(CmdBuildAccelerationStructuresKHR),
+    XENO_HOOK(CmdBuildAccelerationStructuresIndirectKHR),
+    XENO_HOOK(CmdCopyAccelerationStructureKHR),
+    XENO_HOOK(CmdCopyAccelerationStructureToMemoryKHR),
+    XENO_HOOK(CmdCopyMemoryToAccelerationStructureKHR),
+    XENO_HOOK(CmdWriteAccelerationStructuresPropertiesKHR),
+    XENO_HOOK(CmdCopyBuffer),
+    XENO_HOOK(CmdCopyBuffer2),
+    XENO_HOOK_KHR(CmdCopyBuffer2),
+    XENO_HOOK(CmdCopyImage),
+    XENO_HOOK(CmdCopyImage2),
+    XENO_HOOK_KHR(CmdCopyImage2),
+    XENO_HOOK(CmdBlitImage),
+    XENO_HOOK(CmdBlitImage2),
+    XENO_HOOK_KHR(CmdBlitImage2),
+    XENO_HOOK(CmdResolveImage),
+    XENO_HOOK(CmdResolveImage2),
+    XENO_HOOK_KHR(CmdResolveImage2),
+    XENO_HOOK(CmdCopyBufferToImage),
+    XENO_HOOK(CmdCopyBufferToImage2),
+    XENO_HOOK_KHR(CmdCopyBufferToImage2),
+    XENO_HOOK(CmdCopyImageToBuffer),
+    XENO_HOOK(CmdCopyImageToBuffer2),
+    XENO_HOOK_KHR(CmdCopyImageToBuffer2),
+    XENO_HOOK(CmdFillBuffer),
+    XENO_HOOK(CmdUpdateBuffer),
+    XENO_HOOK(CmdClearColorImage),
+    XENO_HOOK(CmdClearDepthStencilImage),
+    XENO_HOOK(CmdCopyQueryPoolResults),
+    XENO_HOOK(CmdResetQueryPool),
+    XENO_HOOK(CmdBeginQuery),
+    XENO_HOOK(CmdEndQuery),
+    XENO_HOOK(CmdWriteTimestamp),
+    XENO_HOOK(CmdWriteTimestamp2),
+    XENO_HOOK_KHR(CmdWriteTimestamp2),
+    XENO_HOOK(CmdBeginConditionalRenderingEXT),
+    XENO_HOOK(CmdEndConditionalRenderingEXT),
+    XENO_HOOK(CmdBeginRenderPass),
+    XENO_HOOK(CmdEndRenderPass),
+    XENO_HOOK(CmdBeginRenderPass2),
+    XENO_HOOK_KHR(CmdBeginRenderPass2),
+    XENO_HOOK(CmdEndRenderPass2),
+    XENO_HOOK_KHR(CmdEndRenderPass2),
+    { "vkCmdBeginRendering", (PFN_vkVoidFunction)xeno_CmdBeginRendering, rendering_emulated },
+    { "vkCmdBeginRenderingKHR", (PFN_vkVoidFunction)xeno_CmdBeginRendering, rendering_emulated },
+    { "vkCmdEndRendering", (PFN_vkVoidFunction)xeno_CmdEndRendering, rendering_emulated },
+    { "vkCmdEndRenderingKHR", (PFN_vkVoidFunction)xeno_CmdEndRendering, rendering_emulated },
+    XENO_HOOK(QueuePresentKHR),
+    XENO_HOOK(QueueSubmit),
+    XENO_HOOK(QueueSubmit2),
+    XENO_HOOK_KHR(QueueSubmit2),
+    XENO_HOOK(QueueBindSparse),
+    XENO_HOOK(QueueWaitIdle),
+    XENO_HOOK(DeviceWaitIdle),
+    XENO_HOOK(WaitForFences),
+    XENO_HOOK(GetDeviceQueue),
+    XENO_HOOK(GetDeviceQueue2),
+    XENO_HOOK(CreateSwapchainKHR),
+    XENO_HOOK(DestroySwapchainKHR),
+};
+
+static const XenoLayerHook k_instance_hooks[] = {
+    XENO_HOOK(CreateInstance),
+    XENO_HOOK(DestroyInstance),
+    XENO_HOOK(EnumerateDeviceExtensionProperties),
+    XENO_HOOK(GetPhysicalDeviceFeatures2),
+    XENO_HOOK_KHR(GetPhysicalDeviceFeatures2),
+    XENO_HOOK(CreateDevice),
+};
+
+static const XenoLayerHook* find_hook(const XenoLayerHook* hooks, size_t count, const char* name)
+{
+    for (size_t i = 0; i < count; ++i) {
+        if (strcmp(hooks[i].name, name) == 0) return &hooks[i];
+    }
+    return NULL;
+}
+
+XENO_LAYER_EXPORT VKAPI_ATTR PFN_vkVoidFunction VKAPI_CALL xeno_GetDeviceProcAddr(VkDevice device, const char* pName);
+
+XENO_LAYER_EXPORT VKAPI_ATTR PFN_vkVoidFunction VKAPI_CALL xeno_GetInstanceProcAddr(VkInstance instance, const char* pName)
+{
+    if (!pName) return NULL;
+    if (strcmp(pName, "vkGetInstanceProcAddr") == 0) return (PFN_vkVoidFunction)xeno_GetInstanceProcAddr;
+    if (strcmp(pName, "vkGetDeviceProcAddr") == 0) return (PFN_vkVoidFunction)xeno_GetDeviceProcAddr;
+
+    const XenoLayerHook* hook = find_hook(k_instance_hooks, sizeof(k_instance_hooks) / sizeof(k_instance_hooks[0]), pName);
+    if (!hook) hook = find_hook(k_device_hooks, sizeof(k_device_hooks) / sizeof(k_device_hooks[0]), pName);
+
+    /* Without an instance (vkCreateInstance) there is no chain to ask yet;
+       which device an emulated entrypoint is for is not known here. */
+    XenoInstanceDispatch* d = xeno_instance_dispatch(instance);
+    if (!d) return hook ? hook->fn : NULL;
+    PFN_vkVoidFunction next = d->GetInstanceProcAddr(instance, pName);
+    if (hook && (next || hook->emulated)) return hook->fn;
+    return next;
+}
+
+XENO_LAYER_EXPORT VKAPI_ATTR PFN_vkVoidFunction VKAPI_CALL xeno_GetDeviceProcAddr(VkDevice device, const char* pName)
+{
+    if (!pName) return NULL;
+    if (strcmp(pName, "vkGetDeviceProcAddr") == 0) return (PFN_vkVoidFunction)xeno_GetDeviceProcAddr;
+
+    XenoDeviceDispatch* d = xeno_device_dispatch(device);
+    if (!d) return NULL;
+    /* The dispatch table resolved the same name (or its core twin), so a
+       non-NULL answer here means the hook's next pointer is set. */
+    PFN_vkVoidFunction next = d->GetDeviceProcAddr(device, pName);
+    const XenoLayerHook* hook = find_hook(k_device_hooks, sizeof(k_device_hooks) / sizeof(k_device_hooks[0]), pName);
+    if (hook && (next || (hook->emulated && hook->emulated(d)))) return hook->fn;
+    return next;
+}
+
+XENO_LAYER_EXPORT VKAPI_ATTR VkResult VKAPI_CALL vkNegotiateLoaderLayerInterfaceVersion(VkNegotiateLayerInterface* pVersionStruct)
+{
+    if (!pVersionStruct || pVersionStruct->sType != LAYER_NEGOTIATE_INTERFACE_STRUCT) {
+        return VK_ERROR_INITIALIZATION_FAILED;
+    }
+    if (pVersionStruct->loaderLayerInterfaceVersion < 2) return VK_ERROR_INITIALIZATION_FAILED;
+    if (pVersionStruct->loaderLayerInterfaceVersion > 2) pVersionStruct->loaderLayerInterfaceVersion = 2;
+    pVersionStruct->pfnGetInstanceProcAddr = xeno_GetInstanceProcAddr;
+    pVersionStruct->pfnGetDeviceProcAddr = xeno_GetDeviceProcAddr;
+    pVersionStruct->pfnGetPhysicalDeviceProcAddr = NULL;
+    return VK_SUCCESS;
+}
@@ -1,4 +1,5 @@
 #include <stdio.h>
+#include "xeno_log.h"
 
 static FILE* g_log_stream = NULL;
 
@@ -8,5 +9,5 @@ FILE* xeno_log_stream(void) {
 }
 
 int xeno_log_enabled_debug(void) {
-    return 1; /* enable debug by default */
+    return XENO_LOG_MIN_LEVEL <= XENO_LOG_LEVEL_DEBUG && xeno_log_level_enabled(XENO_LOG_LEVEL_DEBUG);
 }
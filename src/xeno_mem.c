@@ -0,0 +1,709 @@
+// src/xeno_mem.c
+/*
+  Device-memory sub-allocator (see include/xeno_mem.h).
+
+  Blocks are carved up with TLSF: free ranges are binned by a first level
+  (the power of two of their size) and a second level (XENO_TLSF_SL linear
+  steps inside it), and two bitmaps find a bin with a range of at least the
+  requested size in constant time. Range bookkeeping is a node array in
+  host memory per block, since device memory is not host-addressable.
+  Every size and offset is a multiple of XENO_MEM_GRANULE.
+
+  Pools start with a small block and double the size of each new one up to
+  XENO_MEM_MAX_BLOCK, so a device that only needs a few buffers does not
+  reserve tens of megabytes. A pool keeps its last empty block around.
+*/
+#include "xeno_mem.h"
+#include "xeno_dispatch.h"
+#include "xeno_log.h"
+#include "xeno_trace.h"
+
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#define XENO_TLSF_SL_LOG2 4u
+#define XENO_TLSF_SL (1u << XENO_TLSF_SL_LOG2)
+#define XENO_TLSF_FL 64u
+#define XENO_MEM_GRANULE 64u
+#define XENO_MEM_FIRST_BLOCK (2ull << 20)
+#define XENO_MEM_MAX_BLOCK (32ull << 20)
+#define XENO_MEM_LINEAR_PAGE (1ull << 20)
+#define XENO_MEM_NONE UINT32_MAX
+#define XENO_MEM_KINDS 3u
+
+typedef struct XenoTlsfNode {
+    VkDeviceSize offset;
+    VkDeviceSize size;
+    uint32_t prev_phys;
+    uint32_t next_phys;
+    uint32_t prev_free;
+    uint32_t next_free;         /* also chains recycled nodes */
+    int free;
+} XenoTlsfNode;
+
+struct XenoMemPool;
+
+typedef struct XenoMemBlock {
+    struct XenoMemPool* pool;
+    struct XenoMemBlock* next;
+    VkDeviceMemory memory;
+    VkDeviceSize size;
+    VkDeviceSize used;
+    uint32_t live;
+    char* mapped;
+    XenoTlsfNode* nodes;
+    uint32_t node_count;
+    uint32_t node_cap;
+    uint32_t recycled;
+    uint64_t fl_bitmap;
+    uint32_t sl_bitmap[XENO_TLSF_FL];
+    uint32_t heads[XENO_TLSF_FL][XENO_TLSF_SL];
+} XenoMemBlock;
+
+typedef struct XenoMemPool {
+    uint32_t type;
+    VkMemoryAllocateFlags flags;
+    XenoMemBlock* blocks;
+    VkDeviceSize next_block_size;
+} XenoMemPool;
+
+struct XenoMemAllocator {
+    XenoDeviceDispatch* d;
+    pthread_mutex_t mtx;
+    VkPhysicalDeviceMemoryProperties props;
+    VkDeviceSize granularity;   /* bufferImageGranularity */
+    VkDeviceSize atom;          /* nonCoherentAtomSize */
+    XenoMemPool pools[VK_MAX_MEMORY_TYPES][XENO_MEM_KINDS];
+    uint32_t blocks;
+    uint32_t dedicated;
+    uint32_t sub_allocations;
+    VkDeviceSize reserved;
+    VkDeviceSize used;
+};
+
+static pthread_mutex_t g_mem_create_mtx = PTHREAD_MUTEX_INITIALIZER;
+
+static VkDeviceSize align_up(VkDeviceSize v, VkDeviceSize a)
+{
+    return (v + a - 1u) / a * a;
+}
+
+static uint32_t msb64(uint64_t v)
+{
+    return 63u - (uint32_t)__builtin_clzll(v);
+}
+
+/* ---- TLSF ---------------------------------------------------------- */
+
+static void tlsf_mapping(VkDeviceSize size, uint32_t* fl, uint32_t* sl)
+{
+    *fl = msb64(size);
+    *sl = (uint32_t)(size >> (*fl - XENO_TLSF_SL_LOG2)) ^ XENO_TLSF_SL;
+}
+
+static void tlsf_insert(XenoMemBlock* b, uint32_t idx)
+{
+    XenoTlsfNode* n = &b->nodes[idx];
+    uint32_t fl, sl;
+    tlsf_mapping(n->size, &fl, &sl);
+    n->free = 1;
+    n->prev_free = XENO_MEM_NONE;
+    n->next_free = b->heads[fl][sl];
+    if (n->next_free != XENO_MEM_NONE) b->nodes[n->next_free].prev_free = idx;
+    b->heads[fl][sl] = idx;
+    b->fl_bitmap |= 1ull << fl;
+    b->sl_bitmap[fl] |= 1u << sl;
+}
+
+static void tlsf_remove(XenoMemBlock* b, uint32_t idx)
+{
+    XenoTlsfNode* n = &b->nodes[idx];
+    uint32_t fl, sl;
+    tlsf_mapping(n->size, &fl, &sl);
+    if (n->prev_free != XENO_MEM_NONE) b->nodes[n->prev_free].next_free = n->next_free;
+    if (n->next_free != XENO_MEM_NONE) b->nodes[n->next_free].prev_free = n->prev_free;
+    if (b->heads[fl][sl] == idx) {
+        b->heads[fl][sl] = n->next_free;
+        if (n->next_free == XENO_MEM_NONE) {
+            b->sl_bitmap[fl] &= ~(1u << sl);
+            if (!b->sl_bitmap[fl]) b->fl_bitmap &= ~(1ull << fl);
+        }
+    }
+    n->free = 0;
+}
+
+/* A free node of at least `size`, rounded up to the next bin so any node
+   in the bin found fits. */
+static uint32_t tlsf_find(const XenoMemBlock* b, VkDeviceSize size)
+{
+    VkDeviceSize rounded = size + ((1ull << (msb64(size) - XENO_TLSF_SL_LOG2)) - 1u);
+    uint32_t fl, sl;
+    tlsf_mapping(rounded, &fl, &sl);
+    uint32_t sl_map = b->sl_bitmap[fl] & (~0u << sl);
+    if (!sl_map) {
+        uint64_t fl_map = fl + 1u < XENO_TLSF_FL ? b->fl_bitmap & (~0ull << (fl + 1u)) : 0;
+        if (!fl_map) return XENO_MEM_NONE;
+        fl = (uint32_t)__builtin_ctzll(fl_map);
+        sl_map = b->sl_bitmap[fl];
+    }
+    sl = (uint32_t)__builtin_ctz(sl_map);
+    return b->heads[fl][sl];
+}
+
+/* Makes sure two nodes can be taken without failing mid-split. */
+static int node_reserve(XenoMemBlock* b)
+{
+    if (b->node_cap - b->node_count >= 2u) return 1;
+    uint32_t cap = b->node_cap ? b->node_cap * 2u : 64u;
+    XenoTlsfNode* nodes = (XenoTlsfNode*)realloc(b->nodes, sizeof(*nodes) * cap);
+    if (!nodes) return 0;
+    b->nodes = nodes;
+    b->node_cap = cap;
+    return 1;
+}
+
+static uint32_t node_new(XenoMemBlock* b)
+{
+    if (b->recycled != XENO_MEM_NONE) {
+        uint32_t idx = b->recycled;
+        b->recycled = b->nodes[idx].next_free;
+        return idx;
+    }
+    return b->node_count++;
+}
+
+static void node_release(XenoMemBlock* b, uint32_t idx)
+{
+    b->nodes[idx].next_free = b->recycled;
+    b->recycled = idx;
+}
+
+static int block_alloc(XenoMemBlock* b, VkDeviceSize size, VkDeviceSize align, VkDeviceSize* out_offset, uint32_t* out_node)
+{
+    uint32_t idx = tlsf_find(b, size + (align - XENO_MEM_GRANULE));
+    if (idx == XENO_MEM_NONE || !node_reserve(b)) return 0;
+    tlsf_remove(b, idx);
+
+    VkDeviceSize start = b->nodes[idx].offset;
+    VkDeviceSize pad = align_up(start, align) - start;
+    if (pad) {
+        /* Leading padding stays free; its physical predecessor is in use. */
+        uint32_t p = node_new(b);
+        XenoTlsfNode* n = &b->nodes[idx];
+        b->nodes[p] = (XenoTlsfNode){ start, pad, n->prev_phys, idx, XENO_MEM_NONE, XENO_MEM_NONE, 0 };
+        if (n->prev_phys != XENO_MEM_NONE) b->nodes[n->prev_phys].next_phys = p;
+        n->prev_phys = p;
+        n->offset += pad;
+        n->size -= pad;
+        tlsf_insert(b, p);
+    }
+    VkDeviceSize rest = b->nodes[idx].size - size;
+    if (rest) {
+        uint32_t t = node_new(b);
+        XenoTlsfNode* n = &b->nodes[idx];
+        b->nodes[t] = (XenoTlsfNode){ n->offset + size, rest, idx, n->next_phys, XENO_MEM_NONE, XENO_MEM_NONE, 0 };
+        if (n->next_phys != XENO_MEM_NONE) b->nodes[n->next_phys].prev_phys = t;
+        n->next_phys = t;
+        n->size = size;
+        tlsf_insert(b, t);
+    }
+    b->used += size;
+    b->live++;
+    *out_offset = b->nodes[idx].offset;
+    *out_node = idx;
+    return 1;
+}
+
+static void block_free(XenoMemBlock* b, uint32_t idx)
+{
+    XenoTlsfNode* n = &b->nodes[idx];
+    b->used -= n->size;
+    b->live--;
+    uint32_t next = n->next_phys;
+    if (next != XENO_MEM_NONE && b->nodes[next].free) {
+        tlsf_remove(b, next);
+        n->size += b->nodes[next].size;
+        n->next_phys = b->nodes[next].next_phys;
+        if (n->next_phys != XENO_MEM_NONE) b->nodes[n->next_phys].prev_phys = idx;
+        node_release(b, next);
+    }
+    uint32_t prev = n->prev_phys;
+    if (prev != XENO_MEM_NONE && b->nodes[prev].free) {
+        tlsf_remove(b, prev);
+        b->nodes[prev].size += n->size;
+        b->nodes[prev].next_phys = n->next_phys;
+        if (n->next_phys != XENO_MEM_NONE) b->nodes[n->next_phys].prev_phys = prev;
+        node_release(b, idx);
+        idx = prev;
+    }
+    tlsf_insert(b, idx);
+}
+
+static VkDeviceSize block_largest_free(const XenoMemBlock* b)
+{
+    if (!b->fl_bitmap) return 0;
+    uint32_t fl = msb64(b->fl_bitmap);
+    uint32_t sl = 31u - (uint32_t)__builtin_clz(b->sl_bitmap[fl]);
+    VkDeviceSize best = 0;
+    for (uint32_t i = b->heads[fl][sl]; i != XENO_MEM_NONE; i = b->nodes[i].next_free) {
+        if (b->nodes[i].size > best) best = b->nodes[i].size;
+    }
+    return best;
+}
+
+/* ---- blocks and pools ---------------------------------------------- */
+
+static int type_host_visible(const XenoMemAllocator* m, uint32_t type)
+{
+    return (m->props.memoryTypes[type].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) != 0;
+}
+
+static int type_coherent(const XenoMemAllocator* m, uint32_t type)
+{
+    return (m->props.memoryTypes[type].propertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != 0;
+}
+
+static VkResult device_alloc(XenoMemAllocator* m, uint32_t type, VkMemoryAllocateFlags flags, VkDeviceSize size,
+                             VkDeviceMemory* memory, void** mapped)
+{
+    XenoDeviceDispatch* d = m->d;
+    XENO_TRACE_SCOPE("vkAllocateMemory");
+    VkMemoryAllocateFlagsInfo fi = { .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_FLAGS_INFO, .flags = flags };
+    VkMemoryAllocateInfo mai = {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+        .pNext = flags ? &fi : NULL,
+        .allocationSize = size,
+        .memoryTypeIndex = type,
+    };
+    VkResult r = d->AllocateMemory(d->device, &mai, NULL, memory);
+    if (r != VK_SUCCESS) return r;
+    *mapped = NULL;
+    if (type_host_visible(m, type)) {
+        r = d->MapMemory(d->device, *memory, 0, VK_WHOLE_SIZE, 0, mapped);
+        if (r != VK_SUCCESS) {
+            d->FreeMemory(d->device, *memory, NULL);
+            return r;
+        }
+    }
+    m->reserved += size;
+    XENO_TRACE_COUNTER("mem.reserved_kb", m->reserved >> 10);
+    return VK_SUCCESS;
+}
+
+static void device_free(XenoMemAllocator* m, VkDeviceMemory memory, VkDeviceSize size)
+{
+    /* Freeing implicitly unmaps. */
+    m->d->FreeMemory(m->d->device, memory, NULL);
+    m->reserved -= size;
+    XENO_TRACE_COUNTER("mem.reserved_kb", m->reserved >> 10);
+}
+
+static XenoMemBlock* block_create(XenoMemAllocator* m, XenoMemPool* p, VkDeviceSize size)
+{
+    XenoMemBlock* b = (XenoMemBlock*)calloc(1, sizeof(*b));
+    if (!b) return NULL;
+    memset(b->heads, 0xff, sizeof(b->heads));
+    b->recycled = XENO_MEM_NONE;
+    void* mapped = NULL;
+    if (!node_reserve(b) || device_alloc(m, p->type, p->flags, size, &b->memory, &mapped) != VK_SUCCESS) {
+        free(b->nodes);
+        free(b);
+        return NULL;
+    }
+    b->pool = p;
+    b->size = size;
+    b->mapped = (char*)mapped;
+    uint32_t root = node_new(b);
+    b->nodes[root] = (XenoTlsfNode){ 0, size, XENO_MEM_NONE, XENO_MEM_NONE, XENO_MEM_NONE, XENO_MEM_NONE, 0 };
+    tlsf_insert(b, root);
+    b->next = p->blocks;
+    p->blocks = b;
+    m->blocks++;
+    XENO_LOGD("mem: new %llu KiB block for memory type %u", (unsigned long long)(size >> 10), p->type);
+    return b;
+}
+
+static void block_destroy(XenoMemAllocator* m, XenoMemBlock* b)
+{
+    XenoMemPool* p = b->pool;
+    for (XenoMemBlock** it = &p->blocks; *it; it = &(*it)->next) {
+        if (*it == b) { *it = b->next; break; }
+    }
+    device_free(m, b->memory, b->size);
+    m->blocks--;
+    free(b->nodes);
+    free(b);
+}
+
+static VkResult pool_alloc(XenoMemAllocator* m, XenoMemPool* p, VkDeviceSize size, VkDeviceSize align, XenoMemAlloc* out)
+{
+    VkDeviceSize offset;
+    uint32_t node;
+    XenoMemBlock* b = p->blocks;
+    while (b && !block_alloc(b, size, align, &offset, &node)) b = b->next;
+    if (!b) {
+        VkDeviceSize bs = p->next_block_size ? p->next_block_size : XENO_MEM_FIRST_BLOCK;
+        while (bs < size + align) bs *= 2u;
+        b = block_create(m, p, bs);
+        if (!b) return VK_ERROR_OUT_OF_DEVICE_MEMORY;
+        p->next_block_size = bs * 2u < XENO_MEM_MAX_BLOCK ? bs * 2u : XENO_MEM_MAX_BLOCK;
+        if (!block_alloc(b, size, align, &offset, &node)) return VK_ERROR_OUT_OF_HOST_MEMORY;
+    }
+    out->memory = b->memory;
+    out->offset = offset;
+    out->size = size;
+    out->mapped = b->mapped ? b->mapped + offset : NULL;
+    out->type = p->type;
+    out->block = b;
+    out->node = node;
+    return VK_SUCCESS;
+}
+
+static uint32_t pick_type(const XenoMemAllocator* m, uint32_t bits, VkMemoryPropertyFlags required,
+                          VkMemoryPropertyFlags preferred)
+{
+    uint32_t best = XENO_MEM_NONE;
+    int best_score = -1000;
+    for (uint32_t i = 0; i < m->props.memoryTypeCount; ++i) {
+        VkMemoryPropertyFlags flags = m->props.memoryTypes[i].propertyFlags;
+        if (!(bits & (1u << i)) || (flags & required) != required) continue;
+        /* Preferred flags first, then as few unasked-for flags as possible. */
+        int score = 8 * __builtin_popcount(flags & preferred) - __builtin_popcount(flags & ~(required | preferred));
+        if (score > best_score) {
+            best = i;
+            best_score = score;
+        }
+    }
+    return best;
+}
+
+/* ---- public -------------------------------------------------------- */
+
+XenoMemAllocator* xeno_mem_allocator(VkDevice device)
+{
+    XenoDeviceDispatch* d = xeno_device_dispatch(device);
+    if (!d) return NULL;
+    XenoMemAllocator* m = atomic_load_explicit(&d->mem, memory_order_acquire);
+    if (m) return m;
+
+    pthread_mutex_lock(&g_mem_create_mtx);
+    m = atomic_load_explicit(&d->mem, memory_order_acquire);
+    if (!m && d->instance) {
+        m = (XenoMemAllocator*)calloc(1, sizeof(*m));
+        if (m) {
+            VkPhysicalDeviceProperties props;
+            d->instance->GetPhysicalDeviceMemoryProperties(d->physical, &m->props);
+            d->instance->GetPhysicalDeviceProperties(d->physical, &props);
+            m->d = d;
+            m->granularity = props.limits.bufferImageGranularity;
+            m->atom = props.limits.nonCoherentAtomSize ? props.limits.nonCoherentAtomSize : 1u;
+            for (uint32_t t = 0; t < VK_MAX_MEMORY_TYPES; ++t) {
+                for (uint32_t k = 0; k < XENO_MEM_KINDS; ++k) m->pools[t][k].type = t;
+                m->pools[t][XENO_MEM_KIND_ADDRESS].flags = VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT;
+            }
+            pthread_mutex_init(&m->mtx, NULL);
+            atomic_store_explicit(&d->mem, m, memory_order_release);
+        }
+    } else if (!m) {
+        XENO_LOGW("mem: device %p has no instance dispatch, allocator unavailable", (void*)device);
+    }
+    pthread_mutex_unlock(&g_mem_create_mtx);
+    return m;
+}
+
+void xeno_mem_device_destroy(VkDevice device)
+{
+    XenoDeviceDispatch* d = xeno_device_dispatch(device);
+    XenoMemAllocator* m = d ? atomic_exchange(&d->mem, NULL) : NULL;
+    if (!m) return;
+    if (m->sub_allocations || m->dedicated) {
+        XENO_LOGW("mem: %u sub-allocations and %u dedicated allocations still live at device destroy",
+                  m->sub_allocations, m->dedicated);
+    }
+    XENO_LOGI("mem: released %u blocks (%llu KiB)", m->blocks, (unsigned long long)(m->reserved >> 10));
+    for (uint32_t t = 0; t < VK_MAX_MEMORY_TYPES; ++t) {
+        for (uint32_t k = 0; k < XENO_MEM_KINDS; ++k) {
+            while (m->pools[t][k].blocks) block_destroy(m, m->pools[t][k].blocks);
+        }
+    }
+    pthread_mutex_destroy(&m->mtx);
+    free(m);
+}
+
+VkResult xeno_mem_alloc(XenoMemAllocator* mem, const VkMemoryRequirements* req,
+                        VkMemoryPropertyFlags required, VkMemoryPropertyFlags preferred,
+                        XenoMemKind kind, XenoMemAlloc* out)
+{
+    memset(out, 0, sizeof(*out));
+    if (!mem || !req->size) return VK_ERROR_INITIALIZATION_FAILED;
+    uint32_t type = pick_type(mem, req->memoryTypeBits, required, preferred);
+    if (type == XENO_MEM_NONE) {
+        XENO_LOGE("mem: no memory type with flags 0x%x in mask 0x%x", required, req->memoryTypeBits);
+        return VK_ERROR_OUT_OF_DEVICE_MEMORY;
+    }
+
+    VkDeviceSize align = req->alignment > XENO_MEM_GRANULE ? req->alignment : XENO_MEM_GRANULE;
+    VkDeviceSize size = req->size;
+    if (type_host_visible(mem, type) && !type_coherent(mem, type)) {
+        /* Flushes of one allocation must not touch a neighbour's atoms. */
+        if (mem->atom > align) align = mem->atom;
+        size = align_up(size, mem->atom);
+    }
+    size = align_up(size, XENO_MEM_GRANULE);
+
+    pthread_mutex_lock(&mem->mtx);
+    VkResult r;
+    if (size >= XENO_MEM_MAX_BLOCK / 2u) {
+        void* mapped = NULL;
+        r = device_alloc(mem, type, kind == XENO_MEM_KIND_ADDRESS ? VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT : 0,
+                         req->size, &out->memory, &mapped);
+        if (r == VK_SUCCESS) {
+            out->size = req->size;
+            out->mapped = mapped;
+            out->type = type;
+            mem->dedicated++;
+        }
+    } else {
+        /* Keep buffers and optimal images apart when the device cares;
+           device-address blocks are always separate. */
+        uint32_t k = kind == XENO_MEM_KIND_ADDRESS ? kind : mem->granularity > 1u ? kind : XENO_MEM_KIND_LINEAR;
+        XenoMemPool* p = &mem->pools[type][k];
+        r = pool_alloc(mem, p, size, align, out);
+        if (r == VK_SUCCESS) mem->sub_allocations++;
+    }
+    if (r == VK_SUCCESS) {
+        mem->used += out->size;
+        XENO_TRACE_COUNTER("mem.used_kb", mem->used >> 10);
+    }
+    pthread_mutex_unlock(&mem->mtx);
+    if (r != VK_SUCCESS) XENO_LOGE("mem: allocation of %llu bytes failed: %d", (unsigned long long)req->size, r);
+    return r;
+}
+
+void xeno_mem_free(XenoMemAllocator* mem, XenoMemAlloc* alloc)
+{
+    if (!mem || !alloc->memory) return;
+    pthread_mutex_lock(&mem->mtx);
+    mem->used -= alloc->size;
+    XenoMemBlock* b = (XenoMemBlock*)alloc->block;
+    if (!b) {
+        device_free(mem, alloc->memory, alloc->size);
+        mem->dedicated--;
+    } else {
+        block_free(b, alloc->node);
+        mem->sub_allocations--;
+        /* Return an empty block unless it is the pool's last one. */
+        if (!b->live && (b->pool->blocks != b || b->next)) block_destroy(mem, b);
+    }
+    XENO_TRACE_COUNTER("mem.used_kb", mem->used >> 10);
+    pthread_mutex_unlock(&mem->mtx);
+    memset(alloc, 0, sizeof(*alloc));
+}
+
+VkResult xeno_mem_create_buffer(XenoMemAllocator* mem, VkDeviceSize size, VkBufferUsageFlags usage,
+                                VkMemoryPropertyFlags required, VkMemoryPropertyFlags preferred,
+                                VkBuffer* out_buffer, XenoMemAlloc* out_alloc)
+{
+    if (!mem) return VK_ERROR_INITIALIZATION_FAILED;
+    XenoDeviceDispatch* d = mem->d;
+    VkBufferCreateInfo bci = {
+        .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+        .size = size,
+        .usage = usage,
+        .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+    };
+    VkResult r = d->CreateBuffer(d->device, &bci, NULL, out_buffer);
+    if (r != VK_SUCCESS) return r;
+
+    VkMemoryRequirements req;
+    d->GetBufferMemoryRequirements(d->device, *out_buffer, &req);
+    XenoMemKind kind = (usage & VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT) ? XENO_MEM_KIND_ADDRESS : XENO_MEM_KIND_LINEAR;
+    r = xeno_mem_alloc(mem, &req, required, preferred, kind, out_alloc);
+    if (r == VK_SUCCESS) r = d->BindBufferMemory(d->device, *out_buffer, out_alloc->memory, out_alloc->offset);
+    if (r != VK_SUCCESS) {
+        xeno_mem_free(mem, out_alloc);
+        d->DestroyBuffer(d->device, *out_buffer, NULL);
+        *out_buffer = VK_NULL_HANDLE;
+    }
+    return r;
+}
+
+void xeno_mem_destroy_buffer(XenoMemAllocator* mem, VkBuffer buffer, XenoMemAlloc* alloc)
+{
+    if (!mem) return;
+    if (buffer) mem->d->DestroyBuffer(mem->d->device, buffer, NULL);
+    xeno_mem_free(mem, alloc);
+}
+
+VkResult xeno_mem_create_image(XenoMemAllocator* mem, const VkImageCreateInfo* ci,
+                               VkMemoryPropertyFlags required, VkImage* out_image, XenoMemAlloc* out_alloc)
+{
+    if (!mem) return VK_ERROR_INITIALIZATION_FAILED;
+    XenoDeviceDispatch* d = mem->d;
+    VkResult r = d->CreateImage(d->device, ci, NULL, out_image);
+    if (r != VK_SUCCESS) return r;
+
+    VkMemoryRequirements req;
+    d->GetImageMemoryRequirements(d->device, *out_image, &req);
+    XenoMemKind kind = ci->tiling == VK_IMAGE_TILING_OPTIMAL ? XENO_MEM_KIND_OPTIMAL : XENO_MEM_KIND_LINEAR;
+    r = xeno_mem_alloc(mem, &req, required, 0, kind, out_alloc);
+    if (r == VK_SUCCESS) r = d->BindImageMemory(d->device, *out_image, out_alloc->memory, out_alloc->offset);
+    if (r != VK_SUCCESS) {
+        xeno_mem_free(mem, out_alloc);
+        d->DestroyImage(d->device, *out_image, NULL);
+        *out_image = VK_NULL_HANDLE;
+    }
+    return r;
+}
+
+void xeno_mem_destroy_image(XenoMemAllocator* mem, VkImage image, XenoMemAlloc* alloc)
+{
+    if (!mem) return;
+    if (image) mem->d->DestroyImage(mem->d->device, image, NULL);
+    xeno_mem_free(mem, alloc);
+}
+
+VkResult xeno_mem_flush(XenoMemAllocator* mem, const XenoMemAlloc* alloc, VkDeviceSize offset, VkDeviceSize size)
+{
+    if (!mem || !alloc->mapped || type_coherent(mem, alloc->type)) return VK_SUCCESS;
+    VkDeviceSize end = size == VK_WHOLE_SIZE ? alloc->size : offset + size;
+    VkMappedMemoryRange range = {
+        .sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE,
+        .memory = alloc->memory,
+        .offset = (alloc->offset + offset) / mem->atom * mem->atom,
+    };
+    end = align_up(alloc->offset + end, mem->atom);
+    /* Sub-allocations are atom-aligned inside atom-multiple blocks; only a
+       dedicated allocation can end mid-atom. */
+    range.size = (!alloc->block && end > alloc->size) ? VK_WHOLE_SIZE : end - range.offset;
+    return mem->d->FlushMappedMemoryRanges(mem->d->device, 1, &range);
+}
+
+void xeno_mem_get_stats(XenoMemAllocator* mem, XenoMemStats* out)
+{
+    memset(out, 0, sizeof(*out));
+    if (!mem) return;
+    pthread_mutex_lock(&mem->mtx);
+    out->device_allocations = mem->blocks + mem->dedicated;
+    out->sub_allocations = mem->sub_allocations;
+    out->reserved_bytes = mem->reserved;
+    out->used_bytes = mem->used;
+    for (uint32_t t = 0; t < VK_MAX_MEMORY_TYPES; ++t) {
+        for (uint32_t k = 0; k < XENO_MEM_KINDS; ++k) {
+            for (const XenoMemBlock* b = mem->pools[t][k].blocks; b; b = b->next) {
+                VkDeviceSize f = block_largest_free(b);
+                if (f > out->largest_free) out->largest_free = f;
+            }
+        }
+    }
+    pthread_mutex_unlock(&mem->mtx);
+}
+
+/* ---- linear arenas ------------------------------------------------- */
+
+typedef struct XenoMemPage {
+    VkBuffer buffer;
+    XenoMemAlloc alloc;
+} XenoMemPage;
+
+struct XenoMemLinear {
+    XenoMemAllocator* mem;
+    VkBufferUsageFlags usage;
+    VkDeviceSize page_size;
+    XenoMemPage* pages;         /* page_size pages, kept across resets */
+    uint32_t page_count;
+    uint32_t page_cap;
+    XenoMemPage* big;           /* oversized requests, released at reset */
+    uint32_t big_count;
+    uint32_t big_cap;
+    uint32_t current;
+    VkDeviceSize head;
+};
+
+static VkResult page_push(XenoMemLinear* a, XenoMemPage** pages, uint32_t* count, uint32_t* cap, VkDeviceSize size)
+{
+    if (*count == *cap) {
+        uint32_t n = *cap ? *cap * 2u : 4u;
+        XenoMemPage* p = (XenoMemPage*)realloc(*pages, sizeof(*p) * n);
+        if (!p) return VK_ERROR_OUT_OF_HOST_MEMORY;
+        *pages = p;
+        *cap = n;
+    }
+    XenoMemPage* page = &(*pages)[*count];
+    VkResult r = xeno_mem_create_buffer(a->mem, size, a->usage, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+                                        VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &page->buffer, &page->alloc);
+    if (r == VK_SUCCESS) (*count)++;
+    return r;
+}
+
+XenoMemLinear* xeno_mem_linear_create(XenoMemAllocator* mem, VkBufferUsageFlags usage, VkDeviceSize page_size)
+{
+    if (!mem) return NULL;
+    XenoMemLinear* a = (XenoMemLinear*)calloc(1, sizeof(*a));
+    if (!a) return NULL;
+    a->mem = mem;
+    a->usage = usage;
+    a->page_size = page_size ? page_size : XENO_MEM_LINEAR_PAGE;
+    return a;
+}
+
+static void release_big(XenoMemLinear* a)
+{
+    for (uint32_t i = 0; i < a->big_count; ++i) xeno_mem_destroy_buffer(a->mem, a->big[i].buffer, &a->big[i].alloc);
+    a->big_count = 0;
+}
+
+void xeno_mem_linear_destroy(XenoMemLinear* a)
+{
+    if (!a) return;
+    release_big(a);
+    for (uint32_t i = 0; i < a->page_count; ++i) xeno_mem_destroy_buffer(a->mem, a->pages[i].buffer, &a->pages[i].alloc);
+    free(a->pages);
+    free(a->big);
+    free(a);
+}
+
+VkResult xeno_mem_linear_alloc(XenoMemLinear* a, VkDeviceSize size, VkDeviceSize align, XenoMemSlice* out)
+{
+    if (!align) align = 1u;
+    if (size > a->page_size) {
+        VkResult r = page_push(a, &a->big, &a->big_count, &a->big_cap, size);
+        if (r != VK_SUCCESS) return r;
+        const XenoMemPage* p = &a->big[a->big_count - 1u];
+        *out = (XenoMemSlice){ p->buffer, 0, p->alloc.mapped };
+        return VK_SUCCESS;
+    }
+    for (;;) {
+        if (a->current == a->page_count) {
+            VkResult r = page_push(a, &a->pages, &a->page_count, &a->page_cap, a->page_size);
+            if (r != VK_SUCCESS) return r;
+            a->head = 0;
+        }
+        VkDeviceSize offset = align_up(a->head, align);
+        if (offset + size <= a->page_size) {
+            const XenoMemPage* p = &a->pages[a->current];
+            a->head = offset + size;
+            *out = (XenoMemSlice){ p->buffer, offset, (char*)p->alloc.mapped + offset };
+            return VK_SUCCESS;
+        }
+        a->current++;
+        a->head = 0;
+    }
+}
+
+void xeno_mem_linear_flush(XenoMemLinear* a)
+{
+    for (uint32_t i = 0; i < a->page_count && i <= a->current; ++i) {
+        xeno_mem_flush(a->mem, &a->pages[i].alloc, 0, i < a->current ? VK_WHOLE_SIZE : a->head);
+    }
+    for (uint32_t i = 0; i < a->big_count; ++i) xeno_mem_flush(a->mem, &a->big[i].alloc, 0, VK_WHOLE_SIZE);
+}
+
+void xeno_mem_linear_reset(XenoMemLinear* a)
+{
+    release_big(a);
+    a->current = 0;
+    a->head = 0;
+}
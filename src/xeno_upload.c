@@ -0,0 +1,344 @@
+// src/xeno_upload.c
+#include "xeno_upload.h"
+#include "xeno_mem.h"
+#include "xeno_dispatch.h"
+#include "xeno_log.h"
+#include "xeno_trace.h"
+#include "perf_conf.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define XENO_UPLOAD_SLOTS 3u
+#define XENO_UPLOAD_WINDOW 16u
+#define XENO_UPLOAD_MIN_PAGE (64ull << 10)
+#define XENO_UPLOAD_MAX_PAGE (16ull << 20)
+#define XENO_UPLOAD_ALIGN 16u
+
+typedef struct XenoUploadRegion {
+    VkBuffer src;
+    VkBuffer dst;
+    VkBufferCopy copy;
+    uint32_t seq;               /* write order, kept for overlapping writes */
+} XenoUploadRegion;
+
+typedef struct XenoUploadSlot {
+    XenoMemLinear* arena;
+    VkDeviceSize page_size;
+    VkCommandBuffer cmd;
+    VkFence fence;
+    int submitted;
+} XenoUploadSlot;
+
+struct XenoUploader {
+    XenoDeviceDispatch* d;
+    XenoMemAllocator* mem;
+    VkCommandPool pool;
+    XenoUploadSlot slots[XENO_UPLOAD_SLOTS];
+    uint32_t cur;
+
+    XenoUploadRegion* regions;
+    uint32_t region_count;
+    uint32_t region_cap;
+    VkBufferCopy* copies;       /* scratch for one vkCmdCopyBuffer */
+    uint32_t copy_cap;
+    VkDeviceSize pending_bytes;
+
+    VkDeviceSize window[XENO_UPLOAD_WINDOW];
+    uint32_t window_pos;
+    VkDeviceSize target_page;
+    VkDeviceSize min_page;      /* upload_page_kb floor */
+};
+
+static VkDeviceSize pow2_at_least(VkDeviceSize v)
+{
+    VkDeviceSize p = XENO_UPLOAD_MIN_PAGE;
+    while (p < v && p < XENO_UPLOAD_MAX_PAGE) p *= 2u;
+    return p;
+}
+
+static void slot_wait(XenoUploader* up, XenoUploadSlot* s)
+{
+    if (!s->submitted) return;
+    XenoDeviceDispatch* d = up->d;
+    d->WaitForFences(d->device, 1, &s->fence, VK_TRUE, UINT64_MAX);
+    d->ResetFences(d->device, 1, &s->fence);
+    s->submitted = 0;
+}
+
+/* Makes s usable for new writes: waits for its last flush and, if the
+   window asks for a different page size, swaps the arena. */
+static VkResult slot_acquire(XenoUploader* up, XenoUploadSlot* s)
+{
+    slot_wait(up, s);
+    /* Only resize on a factor of 4 so the size does not flap. */
+    if (s->arena && (up->target_page >= s->page_size * 4u || up->target_page * 4u <= s->page_size)) {
+        xeno_mem_linear_destroy(s->arena);
+        s->arena = NULL;
+    }
+    if (s->arena) {
+        xeno_mem_linear_reset(s->arena);
+        return VK_SUCCESS;
+    }
+    s->page_size = up->target_page;
+    s->arena = xeno_mem_linear_create(up->mem, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, s->page_size);
+    return s->arena ? VK_SUCCESS : VK_ERROR_OUT_OF_HOST_MEMORY;
+}
+
+XenoUploader* xeno_upload_create(VkDevice device, uint32_t queue_family)
+{
+    XenoDeviceDispatch* d = xeno_device_dispatch(device);
+    XenoMemAllocator* mem = xeno_mem_allocator(device);
+    if (!d || !mem) return NULL;
+    XenoUploader* up = (XenoUploader*)calloc(1, sizeof(*up));
+    if (!up) return NULL;
+    up->d = d;
+    up->mem = mem;
+    int page_kb = xeno_perf_conf_active()->upload_page_kb;
+    up->min_page = pow2_at_least(page_kb > 0 ? (VkDeviceSize)page_kb << 10 : 0);
+    up->target_page = up->min_page;
+
+    VkCommandPoolCreateInfo pci = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+        .flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT | VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,
+        .queueFamilyIndex = queue_family,
+    };
+    VkResult r = d->CreateCommandPool(d->device, &pci, NULL, &up->pool);
+    VkCommandBufferAllocateInfo cai = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+        .commandPool = up->pool, .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY, .commandBufferCount = 1,
+    };
+    VkFenceCreateInfo fci = { .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO };
+    for (uint32_t i = 0; i < XENO_UPLOAD_SLOTS && r == VK_SUCCESS; ++i) {
+        XenoUploadSlot* s = &up->slots[i];
+        r = d->AllocateCommandBuffers(d->device, &cai, &s->cmd);
+        if (r == VK_SUCCESS) {
+            if (d->SetDeviceLoaderData) r = d->SetDeviceLoaderData(d->device, s->cmd);
+            else *(void**)s->cmd = *(void**)d->device;
+        }
+        if (r == VK_SUCCESS) r = d->CreateFence(d->device, &fci, NULL, &s->fence);
+    }
+    if (r == VK_SUCCESS) r = slot_acquire(up, &up->slots[0]);
+    if (r != VK_SUCCESS) {
+        XENO_LOGE("upload: setup failed: %d", r);
+        xeno_upload_destroy(up);
+        return NULL;
+    }
+    return up;
+}
+
+void xeno_upload_destroy(XenoUploader* up)
+{
+    if (!up) return;
+    XenoDeviceDispatch* d = up->d;
+    for (uint32_t i = 0; i < XENO_UPLOAD_SLOTS; ++i) {
+        XenoUploadSlot* s = &up->slots[i];
+        slot_wait(up, s);
+        xeno_mem_linear_destroy(s->arena);
+        if (s->fence) d->DestroyFence(d->device, s->fence, NULL);
+    }
+    /* Destroying the pool frees its command buffers. */
+    if (up->pool) d->DestroyCommandPool(d->device, up->pool, NULL);
+    free(up->regions);
+    free(up->copies);
+    free(up);
+}
+
+void* xeno_upload_map(XenoUploader* up, VkBuffer dst, VkDeviceSize dst_offset, VkDeviceSize size)
+{
+    if (!size || !dst) return NULL;
+    if (up->region_count == up->region_cap) {
+        uint32_t cap = up->region_cap ? up->region_cap * 2u : 64u;
+        XenoUploadRegion* regions = (XenoUploadRegion*)realloc(up->regions, sizeof(*regions) * cap);
+        if (!regions) return NULL;
+        up->regions = regions;
+        up->region_cap = cap;
+    }
+    XenoMemSlice slice;
+    if (xeno_mem_linear_alloc(up->slots[up->cur].arena, size, XENO_UPLOAD_ALIGN, &slice) != VK_SUCCESS) return NULL;
+    up->regions[up->region_count] = (XenoUploadRegion){
+        .src = slice.buffer, .dst = dst,
+        .copy = { .srcOffset = slice.offset, .dstOffset = dst_offset, .size = size },
+        .seq = up->region_count,
+    };
+    up->region_count++;
+    up->pending_bytes += size;
+    return slice.mapped;
+}
+
+VkResult xeno_upload_write(XenoUploader* up, VkBuffer dst, VkDeviceSize dst_offset,
+                           const void* data, VkDeviceSize size)
+{
+    void* p = xeno_upload_map(up, dst, dst_offset, size);
+    if (!p) return VK_ERROR_OUT_OF_DEVICE_MEMORY;
+    memcpy(p, data, (size_t)size);
+    return VK_SUCCESS;
+}
+
+static int region_cmp(const void* a, const void* b)
+{
+    const XenoUploadRegion* x = (const XenoUploadRegion*)a;
+    const XenoUploadRegion* y = (const XenoUploadRegion*)b;
+    if (x->dst != y->dst) return (uintptr_t)x->dst < (uintptr_t)y->dst ? -1 : 1;
+    return x->seq < y->seq ? -1 : 1;
+}
+
+static int overlaps(const VkBufferCopy* copies, uint32_t n, VkDeviceSize lo, VkDeviceSize hi,
+                    const VkBufferCopy* c)
+{
+    if (c->dstOffset >= hi || c->dstOffset + c->size <= lo) return 0;
+    for (uint32_t i = 0; i < n; ++i) {
+        if (c->dstOffset < copies[i].dstOffset + copies[i].size && copies[i].dstOffset < c->dstOffset + c->size) return 1;
+    }
+    return 0;
+}
+
+static void barrier(XenoDeviceDispatch* d, VkCommandBuffer cmd, VkPipelineStageFlags src_stage, VkAccessFlags src,
+                    VkPipelineStageFlags dst_stage, VkAccessFlags dst)
+{
+    VkMemoryBarrier mb = { .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER, .srcAccessMask = src, .dstAccessMask = dst };
+    d->CmdPipelineBarrier(cmd, src_stage, dst_stage, 0, 1, &mb, 0, NULL, 0, NULL);
+}
+
+/* What the calls recorded so far wrote to one destination. */
+typedef struct XenoUploadWritten {
+    VkBuffer dst;
+    VkDeviceSize lo, hi;
+} XenoUploadWritten;
+
+/* Separate copy calls are no more ordered than the regions of one, so a
+   run overlapping what earlier calls wrote to its destination waits for
+   them. Returns 1 if that took a barrier. */
+static uint32_t record_run(XenoUploader* up, VkCommandBuffer cmd, const XenoUploadRegion* r, uint32_t n,
+                           VkDeviceSize lo, VkDeviceSize hi, XenoUploadWritten* written)
+{
+    XenoDeviceDispatch* d = up->d;
+    uint32_t waited = 0;
+    if (written->dst != r->dst) {
+        *written = (XenoUploadWritten){ r->dst, lo, hi };
+    } else {
+        if (lo < written->hi && written->lo < hi) {
+            barrier(d, cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                    VK_ACCESS_TRANSFER_WRITE_BIT);
+            waited = 1;
+        }
+        if (lo < written->lo) written->lo = lo;
+        if (hi > written->hi) written->hi = hi;
+    }
+    d->CmdCopyBuffer(cmd, r->src, r->dst, n, up->copies);
+    return waited;
+}
+
+/* Regions are grouped per destination in write order. A run sharing one
+   staging buffer becomes one vkCmdCopyBuffer; a write that overlaps an
+   earlier one of the run starts a new call, since regions of a single
+   copy have no defined order, and record_run puts a barrier in front of
+   it so the last write wins. */
+static uint32_t record_copies(XenoUploader* up, VkCommandBuffer cmd, uint32_t* barriers)
+{
+    qsort(up->regions, up->region_count, sizeof(*up->regions), region_cmp);
+    XenoUploadWritten written = { VK_NULL_HANDLE, 0, 0 };
+    uint32_t calls = 0;
+    uint32_t n = 0;
+    VkDeviceSize lo = 0, hi = 0;
+    for (uint32_t i = 0; i < up->region_count; ++i) {
+        const XenoUploadRegion* r = &up->regions[i];
+        const VkBufferCopy* c = &r->copy;
+        if (n && (r->src != up->regions[i - 1u].src || r->dst != up->regions[i - 1u].dst ||
+                  overlaps(up->copies, n, lo, hi, c))) {
+            *barriers += record_run(up, cmd, &up->regions[i - 1u], n, lo, hi, &written);
+            calls++;
+            n = 0;
+        }
+        if (!n) {
+            lo = c->dstOffset;
+            hi = c->dstOffset + c->size;
+        } else {
+            if (c->dstOffset < lo) lo = c->dstOffset;
+            if (c->dstOffset + c->size > hi) hi = c->dstOffset + c->size;
+        }
+        VkBufferCopy* last = n ? &up->copies[n - 1u] : NULL;
+        if (last && last->srcOffset + last->size == c->srcOffset && last->dstOffset + last->size == c->dstOffset) {
+            last->size += c->size;
+        } else {
+            up->copies[n++] = *c;
+        }
+    }
+    if (n) {
+        *barriers += record_run(up, cmd, &up->regions[up->region_count - 1u], n, lo, hi, &written);
+        calls++;
+    }
+    return calls;
+}
+
+VkResult xeno_upload_flush(XenoUploader* up, VkQueue queue)
+{
+    if (!up->region_count) return VK_SUCCESS;
+    XENO_TRACE_SCOPE("upload.flush");
+    XenoDeviceDispatch* d = up->d;
+    XenoUploadSlot* s = &up->slots[up->cur];
+
+    if (up->copy_cap < up->region_count) {
+        VkBufferCopy* copies = (VkBufferCopy*)realloc(up->copies, sizeof(*copies) * up->region_cap);
+        if (!copies) return VK_ERROR_OUT_OF_HOST_MEMORY;
+        up->copies = copies;
+        up->copy_cap = up->region_cap;
+    }
+    xeno_mem_linear_flush(s->arena);
+
+    VkCommandBufferBeginInfo bi = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+        .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+    };
+    VkResult r = d->BeginCommandBuffer(s->cmd, &bi);
+    if (r != VK_SUCCESS) return r;
+    /* Destinations are rewritten in place: work submitted earlier on the
+       queue may still be reading them. */
+    barrier(d, s->cmd, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT,
+            VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT);
+    uint32_t barriers = 0;
+    uint32_t calls = record_copies(up, s->cmd, &barriers);
+    /* Destinations can be read by anything that follows on the queue. */
+    barrier(d, s->cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+            VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT);
+    r = d->EndCommandBuffer(s->cmd);
+    if (r != VK_SUCCESS) return r;
+
+    VkSubmitInfo si = {
+        .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+        .commandBufferCount = 1,
+        .pCommandBuffers = &s->cmd,
+    };
+    r = d->QueueSubmit(queue, 1, &si, s->fence);
+    if (r != VK_SUCCESS) {
+        XENO_LOGE("upload: submit failed: %d", r);
+        return r;
+    }
+    s->submitted = 1;
+    XENO_TRACE_COUNTER("upload.bytes", up->pending_bytes);
+    XENO_TRACE_COUNTER("upload.copy_calls", calls);
+    XENO_LOGD_RL(1, "upload: %u writes, %llu bytes in %u copy calls, %u overlap barriers", up->region_count,
+                 (unsigned long long)up->pending_bytes, calls, barriers);
+
+    up->window[up->window_pos++ % XENO_UPLOAD_WINDOW] = up->pending_bytes;
+    VkDeviceSize peak = 0;
+    for (uint32_t i = 0; i < XENO_UPLOAD_WINDOW; ++i) {
+        if (up->window[i] > peak) peak = up->window[i];
+    }
+    up->target_page = pow2_at_least(peak > up->min_page ? peak : up->min_page);
+    up->region_count = 0;
+    up->pending_bytes = 0;
+
+    up->cur = (up->cur + 1u) % XENO_UPLOAD_SLOTS;
+    return slot_acquire(up, &up->slots[up->cur]);
+}
+
+void xeno_upload_wait(XenoUploader* up)
+{
+    for (uint32_t i = 0; i < XENO_UPLOAD_SLOTS; ++i) slot_wait(up, &up->slots[i]);
+}
+
+VkDeviceSize xeno_upload_staging_size(const XenoUploader* up)
+{
+    return up->target_page;
+}
@@ -3,32 +3,43 @@
 #include "xeno_wrapper.h"
 #include "xeno_log.h"
 #include "xeno_bc.h"
-
-/* If loader originals exist, declare them extern here. They may be NULL. */
-extern PFN_vkCreateDevice vkCreateDevice_original;
-extern PFN_vkCmdBeginRenderPass vkCmdBeginRenderPass_original;
+#include "xeno_trace.h"
+#include "xeno_dispatch.h"
+#include "xeno_cmd.h"
+#include "loadstore_opt.h"
 
 VkResult xeno_wrapper_create_device(VkPhysicalDevice physicalDevice,
                                     const VkDeviceCreateInfo *pCreateInfo,
                                     const VkAllocationCallbacks *pAllocator,
                                     VkDevice *pDevice)
 {
-    if (!vkCreateDevice_original) {
-        XENO_LOGE("xeno_wrapper_create_device: vkCreateDevice_original not available");
+    XENO_TRACE_SCOPE("vkCreateDevice");
+    const XenoInstanceDispatch *inst = xeno_instance_dispatch(physicalDevice);
+    if (!inst || !inst->CreateDevice || !inst->GetDeviceProcAddr) {
+        XENO_LOGE("xeno_wrapper_create_device: no instance dispatch for physical device %p", (void*)physicalDevice);
         return VK_ERROR_INITIALIZATION_FAILED;
     }
 
-    VkResult res = vkCreateDevice_original(physicalDevice, pCreateInfo, pAllocator, pDevice);
+    VkResult res = inst->CreateDevice(physicalDevice, pCreateInfo, pAllocator, pDevice);
     if (res != VK_SUCCESS) {
-        XENO_LOGE("xeno_wrapper_create_device: vkCreateDevice_original failed: %d", res);
+        XENO_LOGE("xeno_wrapper_create_device: vkCreateDevice failed: %d", res);
         return res;
     }
 
+    const XenoDeviceDispatch *dev = xeno_dispatch_device_create(*pDevice, physicalDevice, inst->GetDeviceProcAddr);
+    if (!dev) {
+        XENO_LOGE("xeno_wrapper_create_device: cannot register device dispatch");
+        PFN_vkDestroyDevice destroy = (PFN_vkDestroyDevice)inst->GetDeviceProcAddr(*pDevice, "vkDestroyDevice");
+        if (destroy) destroy(*pDevice, pAllocator);
+        *pDevice = VK_NULL_HANDLE;
+        return VK_ERROR_OUT_OF_HOST_MEMORY;
+    }
+
     struct XenoBCContext *bc_ctx = NULL;
     VkQueue queue = VK_NULL_HANDLE;
 
     if (pCreateInfo && pCreateInfo->queueCreateInfoCount > 0 && pCreateInfo->pQueueCreateInfos) {
-        vkGetDeviceQueue(*pDevice, 0u, 0u, &queue);
+        dev->GetDeviceQueue(*pDevice, 0u, 0u, &queue);
     }
 
     res = xeno_bc_create_context(*pDevice, physicalDevice, queue, &bc_ctx);
@@ -46,10 +57,17 @@ void xeno_wrapper_begin_render(VkCommandBuffer commandBuffer,
                                const VkRenderPassBeginInfo *pRenderPassBeginInfo,
                                VkSubpassContents contents)
 {
-    if (vkCmdBeginRenderPass_original) {
-        vkCmdBeginRenderPass_original(commandBuffer, pRenderPassBeginInfo, contents);
+    XenoDeviceDispatch *d = xeno_device_dispatch(commandBuffer);
+    if (d && d->CmdBeginRenderPass) {
+        VkSubpassBeginInfo sub = { .sType = VK_STRUCTURE_TYPE_SUBPASS_BEGIN_INFO, .contents = contents };
+        VkRenderPassBeginInfo begin;
+        int ops = xeno_loadstore_begin_render_pass(d, commandBuffer, pRenderPassBeginInfo, &sub, &begin);
+        if (ops == XENO_LOADSTORE_FUSED) return;    /* continues the pass the app just ended */
+        if (ops) pRenderPassBeginInfo = &begin;
+        xeno_cmd_pass(d, commandBuffer, 1);
+        d->CmdBeginRenderPass(commandBuffer, pRenderPassBeginInfo, contents);
     } else {
-        XENO_LOGW("xeno_wrapper_begin_render: original vkCmdBeginRenderPass not available");
+        XENO_LOGW("xeno_wrapper_begin_render: vkCmdBeginRenderPass not available");
     }
 }
 
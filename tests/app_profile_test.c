@@ -0,0 +1,148 @@
+// tests/app_profile_test.c
+// Compiles a profile directory into profiles.db and looks games up in it.
+// Build: cc -I src -I include tests/app_profile_test.c src/app_profile.c -lpthread -o app_profile_test
+#include "app_profile.h"
+#include <assert.h>
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define GAMES 300
+
+static char g_root[64];
+static char g_cache[128];
+static char g_db[192];
+
+/* perf_conf.c is not linked: the cache dir comes from here and no key is a
+   perf_conf setting. */
+void xeno_perf_conf_defaults(XenoPerfConf* cfg) {
+  memset(cfg, 0, sizeof(*cfg));
+  snprintf(cfg->shader_cache_dir, sizeof(cfg->shader_cache_dir), "%s", g_cache);
+}
+
+int xeno_perf_conf_set(XenoPerfConf* cfg, const char* key, const char* val) {
+  (void)cfg; (void)key; (void)val;
+  return 0;
+}
+
+static void write_profile(const char* stem, const char* body) {
+  char path[256];
+  snprintf(path, sizeof(path), "%s/profiles/%s.conf", g_root, stem);
+  FILE* f = fopen(path, "w");
+  assert(f);
+  fputs(body, f);
+  fclose(f);
+}
+
+/* Every game by its file name (any case, any path, with or without .exe)
+   and by its exe= alias; names between and around them must miss. */
+static int lookups_hold(int with_late) {
+  char name[64];
+  for (int i = 0; i < GAMES; ++i) {
+    snprintf(name, sizeof(name), i & 1 ? "C:\\Games\\GAME%03d.EXE" : "/opt/game%03d", i);
+    if (!app_profile_detect(name)) return 0;
+    snprintf(name, sizeof(name), "Alias%03d.exe", i);
+    if (!app_profile_detect(name)) return 0;
+    snprintf(name, sizeof(name), "game%03da", i);
+    if (app_profile_detect(name)) return 0;
+  }
+  if (app_profile_detect("game300") || app_profile_detect("") || app_profile_detect("profiles")) return 0;
+  return app_profile_detect("late.exe") == with_late;
+}
+
+/* Profiles are matched once per process, so each launch is a child. */
+static int launch(int with_late) {
+  pid_t pid = fork();
+  assert(pid >= 0);
+  if (pid == 0) _exit(lookups_hold(with_late) ? 0 : 1);
+  int status = 0;
+  waitpid(pid, &status, 0);
+  return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+static ino_t db_inode(void) {
+  struct stat st;
+  assert(stat(g_db, &st) == 0 && st.st_size > 0);
+  return st.st_ino;
+}
+
+static int leftover_tmp_files(void) {
+  int n = 0;
+  DIR* d = opendir(g_cache);
+  assert(d);
+  for (struct dirent* e; (e = readdir(d));) {
+    size_t len = strlen(e->d_name);
+    n += len > 4 && strcmp(e->d_name + len - 4, ".tmp") == 0;
+  }
+  closedir(d);
+  return n;
+}
+
+static void corrupt_byte(long from_end) {
+  FILE* f = fopen(g_db, "r+b");
+  assert(f);
+  fseek(f, -from_end, SEEK_END);
+  int c = fgetc(f);
+  fseek(f, -from_end, SEEK_END);
+  fputc(c ^ 0x20, f);
+  fclose(f);
+}
+
+int main(void) {
+  snprintf(g_root, sizeof(g_root), "/tmp/app_profile_test.XXXXXX");
+  assert(mkdtemp(g_root));
+  snprintf(g_cache, sizeof(g_cache), "%s/cache", g_root);
+  snprintf(g_db, sizeof(g_db), "%s/profiles.db", g_cache);
+  char dir[128];
+  snprintf(dir, sizeof(dir), "%s/profiles", g_root);
+  assert(mkdir(dir, 0755) == 0 && mkdir(g_cache, 0755) == 0);
+  setenv("EXYNOSTOOLS_PROFILE_DIR", dir, 1);
+  unsetenv("EXYNOSTOOLS_APP_PROFILE");
+
+  char stem[32], body[64];
+  for (int i = 0; i < GAMES; ++i) {
+    snprintf(stem, sizeof(stem), "game%03d", i);
+    snprintf(body, sizeof(body), "exe=Alias%03d.exe\nDXVK_HUD=fps\n", i);
+    write_profile(stem, body);
+  }
+  write_profile(".hidden", "exe=late.exe\n");
+
+  /* First launch compiles the database and publishes it by rename. */
+  assert(launch(0));
+  ino_t ino = db_inode();
+  assert(leftover_tmp_files() == 0);
+
+  /* Unchanged directory: the file is mapped as is. */
+  assert(launch(0));
+  assert(db_inode() == ino);
+
+  /* A flipped string byte fails the checksum; the rebuild replaces the file. */
+  corrupt_byte(3);
+  assert(launch(0));
+  assert(db_inode() != ino);
+  ino = db_inode();
+  assert(launch(0) && db_inode() == ino);
+
+  /* So does a truncated file. */
+  struct stat st;
+  assert(stat(g_db, &st) == 0);
+  assert(truncate(g_db, st.st_size / 2) == 0);
+  assert(launch(0));
+  assert(db_inode() != ino);
+  ino = db_inode();
+
+  /* A new profile changes the directory stamp. */
+  write_profile("late", "sync_mode=safe\n");
+  assert(launch(1));
+  assert(db_inode() != ino && leftover_tmp_files() == 0);
+
+  char cmd[128];
+  snprintf(cmd, sizeof(cmd), "rm -rf %s", g_root);
+  assert(system(cmd) == 0);
+  printf("app_profile_test: ok\n");
+  return 0;
+}
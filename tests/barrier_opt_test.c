@@ -0,0 +1,354 @@
+// tests/barrier_opt_test.c
+// Replays recorded barrier streams through the relaxation engine.
+// Build: cc -I src tests/barrier_opt_test.c src/barrier_opt.c -o barrier_opt_test
+#include "barrier_opt.h"
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+#define ALL VK_PIPELINE_STAGE_ALL_COMMANDS_BIT
+#define MW VK_ACCESS_MEMORY_WRITE_BIT
+#define MRW (VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT)
+
+/* What reached the driver: one entry per barrier call or work command. */
+typedef struct {
+  char kind;  /* 'B' barrier, 'W' work */
+  uint32_t mem, buf, img;
+  VkPipelineStageFlags2 src, dst;
+  VkAccessFlags2 src_access;
+  VkPipelineStageFlags2 dst0;        /* first memory barrier's destination */
+  VkImageLayout old0, new0;          /* first image barrier's transition */
+} Event;
+
+typedef struct {
+  Event ev[64];
+  int n;
+} Log;
+
+static void on_emit(void* user, const XenoBarrierBatch* b) {
+  Log* log = (Log*)user;
+  Event* e = &log->ev[log->n++];
+  memset(e, 0, sizeof(*e));
+  e->kind = 'B';
+  e->mem = b->mem_count;
+  e->buf = b->buf_count;
+  e->img = b->img_count;
+  if (b->mem_count) e->dst0 = b->mem[0].dstStageMask;
+  if (b->img_count) {
+    e->old0 = b->img[0].oldLayout;
+    e->new0 = b->img[0].newLayout;
+  }
+  for (uint32_t i = 0; i < b->mem_count; ++i) {
+    e->src |= b->mem[i].srcStageMask;
+    e->dst |= b->mem[i].dstStageMask;
+    e->src_access |= b->mem[i].srcAccessMask;
+  }
+  for (uint32_t i = 0; i < b->img_count; ++i) {
+    e->src |= b->img[i].srcStageMask;
+    e->dst |= b->img[i].dstStageMask;
+    e->src_access |= b->img[i].srcAccessMask;
+  }
+}
+
+static void full_barrier(XenoBarrierTracker* t) {
+  VkMemoryBarrier mb = { VK_STRUCTURE_TYPE_MEMORY_BARRIER, NULL, MW, MRW };
+  assert(xeno_barrier_load1(t, ALL, ALL, 0, 1, &mb, 0, NULL, 0, NULL));
+  xeno_barrier_record(t);
+}
+
+static void barrier(XenoBarrierTracker* t, VkPipelineStageFlags src, VkAccessFlags sa, VkPipelineStageFlags dst,
+                    VkAccessFlags da) {
+  VkMemoryBarrier mb = { VK_STRUCTURE_TYPE_MEMORY_BARRIER, NULL, sa, da };
+  assert(xeno_barrier_load1(t, src, dst, 0, 1, &mb, 0, NULL, 0, NULL));
+  xeno_barrier_record(t);
+}
+
+static VkImageMemoryBarrier image(uint64_t handle, VkImageLayout from, VkImageLayout to) {
+  VkImageMemoryBarrier ib;
+  memset(&ib, 0, sizeof(ib));
+  ib.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+  ib.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+  ib.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+  ib.oldLayout = from;
+  ib.newLayout = to;
+  ib.srcQueueFamilyIndex = ib.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  ib.image = (VkImage)(uintptr_t)handle;
+  ib.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+  ib.subresourceRange.levelCount = ib.subresourceRange.layerCount = 1;
+  return ib;
+}
+
+static void work(XenoBarrierTracker* t, Log* log, VkPipelineStageFlags2 stages) {
+  xeno_barrier_work(t, stages, NULL, 0);
+  log->ev[log->n++] = (Event){ .kind = 'W' };
+}
+
+static void copy(XenoBarrierTracker* t, Log* log, uint64_t src, uint64_t dst) {
+  XenoBarrierRef refs[2] = { { src, 0, 256, 0 }, { dst, 0, 256, 1 } };
+  xeno_barrier_work(t, VK_PIPELINE_STAGE_2_TRANSFER_BIT, refs, 2);
+  log->ev[log->n++] = (Event){ .kind = 'W' };
+}
+
+static const char* pattern(const Log* log) {
+  static char s[65];
+  for (int i = 0; i < log->n; ++i) s[i] = log->ev[i].kind;
+  s[log->n] = 0;
+  return s;
+}
+
+int main(void) {
+  XenoBarrierTracker t;
+  Log log;
+
+  /* SAFE: everything goes through as recorded. */
+  memset(&log, 0, sizeof(log));
+  xeno_barrier_tracker_init(&t, on_emit, &log);
+  xeno_barrier_begin(&t, XENO_BARRIER_SAFE, 0, 1);
+  full_barrier(&t);
+  full_barrier(&t);
+  assert(log.n == 2 && log.ev[1].src == ALL);
+
+  /* BALANCED: same-layout image barriers fold into the global barrier;
+     the layout transition stays an image barrier. */
+  memset(&log, 0, sizeof(log));
+  xeno_barrier_begin(&t, XENO_BARRIER_BALANCED, 0, 1);
+  VkImageMemoryBarrier ibs[4] = {
+    image(1, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_GENERAL),
+    image(2, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_GENERAL),
+    image(3, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL),
+    image(4, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_GENERAL),
+  };
+  assert(xeno_barrier_load1(&t, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0,
+                            NULL, 0, NULL, 4, ibs));
+  xeno_barrier_record(&t);
+  xeno_barrier_flush(&t);
+  assert(log.n == 1 && log.ev[0].mem == 1 && log.ev[0].img == 1);
+  assert(t.stats.folded == 3);
+
+  /* BALANCED: a repeat with no work in between is dropped, a narrower one
+     too; a broader one is coalesced with it and one after work is not. */
+  memset(&log, 0, sizeof(log));
+  xeno_barrier_begin(&t, XENO_BARRIER_BALANCED, 0, 1);
+  full_barrier(&t);
+  full_barrier(&t);
+  barrier(&t, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+          VK_ACCESS_SHADER_READ_BIT);
+  xeno_barrier_flush(&t);
+  assert(log.n == 1 && t.stats.dropped == 2);
+  work(&t, &log, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT);
+  barrier(&t, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+          VK_ACCESS_SHADER_READ_BIT);
+  full_barrier(&t);
+  xeno_barrier_flush(&t);
+  assert(!strcmp(pattern(&log), "BWB") && t.stats.coalesced == 1);
+  /* Balanced never narrows; the compute -> fragment barrier now also
+     reaches everything the full barrier chained it to. */
+  assert(log.ev[2].mem == 2 && log.ev[2].src == (ALL | VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT));
+  assert(log.ev[2].dst0 == (VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT | ALL));
+
+  /* AGGRESSIVE: the first barrier of a recording is left alone (earlier
+     submissions are unknown); after it, ALL_COMMANDS narrows to the stages
+     that ran. */
+  memset(&log, 0, sizeof(log));
+  xeno_barrier_begin(&t, XENO_BARRIER_AGGRESSIVE, 0, 1);
+  full_barrier(&t);
+  work(&t, &log, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT);
+  full_barrier(&t);
+  xeno_barrier_flush(&t);
+  assert(!strcmp(pattern(&log), "BWB"));
+  assert(log.ev[0].src == ALL);
+  assert(log.ev[2].src == VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT && log.ev[2].dst == ALL);
+  assert(log.ev[2].src_access == MW);
+  /* A repeat is still recognized after the first one was narrowed. */
+  full_barrier(&t);
+  xeno_barrier_flush(&t);
+  assert(log.n == 3);
+
+  /* AGGRESSIVE: chains survive narrowing. compute -> (C->F) -> transfer ->
+     (ALL->T): the compute work reaches the transfer only through the first
+     barrier's fragment scope, so a graphics stage must stay. */
+  memset(&log, 0, sizeof(log));
+  xeno_barrier_begin(&t, XENO_BARRIER_AGGRESSIVE, 0, 1);
+  full_barrier(&t);
+  work(&t, &log, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT);
+  barrier(&t, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+          VK_ACCESS_SHADER_READ_BIT);
+  work(&t, &log, VK_PIPELINE_STAGE_2_TRANSFER_BIT);
+  barrier(&t, ALL, MW, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT);
+  xeno_barrier_flush(&t);
+  assert(!strcmp(pattern(&log), "BWBWB"));
+  assert(log.ev[4].src == (VK_PIPELINE_STAGE_2_TRANSFER_BIT | VK_PIPELINE_STAGE_2_ALL_GRAPHICS_BIT));
+
+  /* AGGRESSIVE: a layout transition after a render pass waits on graphics
+     only, and its access mask keeps what graphics can write. */
+  memset(&log, 0, sizeof(log));
+  xeno_barrier_begin(&t, XENO_BARRIER_AGGRESSIVE, 0, 1);
+  full_barrier(&t);
+  xeno_barrier_pass(&t, 1);
+  barrier(&t, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+          VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_INPUT_ATTACHMENT_READ_BIT);  /* self-dependency */
+  xeno_barrier_pass(&t, 0);
+  VkImageMemoryBarrier rt = image(9, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+  rt.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+  assert(xeno_barrier_load1(&t, ALL, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, NULL, 0, NULL, 1, &rt));
+  xeno_barrier_record(&t);
+  xeno_barrier_flush(&t);
+  assert(log.n == 3 && log.ev[1].src == VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT);
+  assert(log.ev[2].img == 1 && log.ev[2].src == VK_PIPELINE_STAGE_2_ALL_GRAPHICS_BIT);
+  assert(log.ev[2].src_access == VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT);
+
+  /* AGGRESSIVE: "copy, full barrier" runs on unrelated resources collapse
+     into one barrier in front of the next non-transfer work. */
+  memset(&log, 0, sizeof(log));
+  xeno_barrier_begin(&t, XENO_BARRIER_AGGRESSIVE, 0, 1);
+  full_barrier(&t);
+  copy(&t, &log, 100, 101);
+  full_barrier(&t);
+  copy(&t, &log, 100, 102);
+  full_barrier(&t);
+  copy(&t, &log, 100, 103);
+  full_barrier(&t);
+  work(&t, &log, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT);
+  assert(!strcmp(pattern(&log), "BWWWBW"));
+  assert(log.ev[4].src == VK_PIPELINE_STAGE_2_TRANSFER_BIT);
+  assert(t.stats.deferred == 2);
+
+  /* ...but a copy that reads what an earlier copy wrote gets the barrier. */
+  memset(&log, 0, sizeof(log));
+  xeno_barrier_begin(&t, XENO_BARRIER_AGGRESSIVE, 0, 1);
+  full_barrier(&t);
+  copy(&t, &log, 100, 101);
+  full_barrier(&t);
+  copy(&t, &log, 100, 102);
+  full_barrier(&t);
+  copy(&t, &log, 101, 104);
+  xeno_barrier_flush(&t);
+  assert(!strcmp(pattern(&log), "BWWBW"));
+
+  /* ...and transfers after compute work are not eligible at all. */
+  memset(&log, 0, sizeof(log));
+  xeno_barrier_begin(&t, XENO_BARRIER_AGGRESSIVE, 0, 1);
+  full_barrier(&t);
+  work(&t, &log, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT);
+  copy(&t, &log, 100, 101);
+  full_barrier(&t);
+  copy(&t, &log, 100, 102);
+  xeno_barrier_flush(&t);
+  assert(!strcmp(pattern(&log), "BWWBW"));
+
+  /* Secondary command buffers hide their work: back to leaving barriers alone. */
+  memset(&log, 0, sizeof(log));
+  xeno_barrier_begin(&t, XENO_BARRIER_AGGRESSIVE, 0, 1);
+  full_barrier(&t);
+  work(&t, &log, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT);
+  xeno_barrier_opaque(&t);
+  full_barrier(&t);
+  work(&t, &log, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT);
+  full_barrier(&t);
+  xeno_barrier_flush(&t);
+  assert(!strcmp(pattern(&log), "BWBWB"));
+  assert(log.ev[2].src == ALL && log.ev[4].src == VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT);
+
+  /* Barriers with extension structures are recorded as given. */
+  memset(&log, 0, sizeof(log));
+  xeno_barrier_begin(&t, XENO_BARRIER_AGGRESSIVE, 0, 1);
+  full_barrier(&t);
+  int ext = 0;
+  VkImageMemoryBarrier chained[2] = {
+    image(1, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_GENERAL),
+    image(2, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_GENERAL),
+  };
+  chained[0].pNext = &ext;
+  assert(xeno_barrier_load1(&t, ALL, ALL, 0, 0, NULL, 0, NULL, 2, chained));
+  xeno_barrier_record(&t);
+  assert(log.n == 2 && log.ev[1].img == 2 && log.ev[1].src == ALL);
+
+  /* Synchronization2 input stays sync2 and keeps per-barrier masks. */
+  memset(&log, 0, sizeof(log));
+  xeno_barrier_begin(&t, XENO_BARRIER_AGGRESSIVE, 0, 1);
+  full_barrier(&t);
+  work(&t, &log, VK_PIPELINE_STAGE_2_TRANSFER_BIT);
+  VkMemoryBarrier2 m2[2] = {
+    { VK_STRUCTURE_TYPE_MEMORY_BARRIER_2, NULL, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, VK_ACCESS_2_MEMORY_WRITE_BIT,
+      VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_READ_BIT },
+    { VK_STRUCTURE_TYPE_MEMORY_BARRIER_2, NULL, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, VK_ACCESS_2_MEMORY_WRITE_BIT,
+      VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_UNIFORM_READ_BIT },
+  };
+  VkDependencyInfo dep;
+  memset(&dep, 0, sizeof(dep));
+  dep.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+  dep.memoryBarrierCount = 2;
+  dep.pMemoryBarriers = m2;
+  assert(xeno_barrier_load2(&t, &dep));
+  xeno_barrier_record(&t);
+  xeno_barrier_flush(&t);
+  assert(log.n == 3 && log.ev[2].mem == 1 && log.ev[2].src == VK_PIPELINE_STAGE_2_TRANSFER_BIT);
+
+  /* Consecutive calls go out as one in front of the next work; a
+     transition that continues an earlier one on the same range merges
+     into it. */
+  memset(&log, 0, sizeof(log));
+  memset(&t.stats, 0, sizeof(t.stats));
+  xeno_barrier_begin(&t, XENO_BARRIER_BALANCED, 0, 1);
+  VkImageMemoryBarrier to_src = image(5, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
+  VkImageMemoryBarrier to_read = image(5, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+  assert(xeno_barrier_load1(&t, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, NULL, 0,
+                            NULL, 1, &to_src));
+  xeno_barrier_record(&t);
+  assert(xeno_barrier_load1(&t, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, NULL, 0,
+                            NULL, 1, &to_read));
+  xeno_barrier_record(&t);
+  barrier(&t, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT,
+          VK_ACCESS_INDIRECT_COMMAND_READ_BIT);
+  assert(log.n == 0);
+  work(&t, &log, VK_PIPELINE_STAGE_2_ALL_GRAPHICS_BIT);
+  assert(!strcmp(pattern(&log), "BW"));
+  assert(log.ev[0].img == 1 && log.ev[0].mem == 1);
+  assert(log.ev[0].old0 == VK_IMAGE_LAYOUT_GENERAL && log.ev[0].new0 == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+  assert(t.stats.coalesced == 2 && t.stats.deduped == 1);
+
+  /* A second change to the same image over a different range cannot share
+     the call: the two transitions would be unordered. */
+  memset(&log, 0, sizeof(log));
+  xeno_barrier_begin(&t, XENO_BARRIER_BALANCED, 0, 1);
+  VkImageMemoryBarrier mip0 = image(6, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
+  VkImageMemoryBarrier mip1 = image(6, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
+  mip0.subresourceRange.levelCount = 2;
+  assert(xeno_barrier_load1(&t, ALL, ALL, 0, 0, NULL, 0, NULL, 1, &mip0));
+  xeno_barrier_record(&t);
+  assert(xeno_barrier_load1(&t, ALL, ALL, 0, 0, NULL, 0, NULL, 1, &mip1));
+  xeno_barrier_record(&t);
+  xeno_barrier_flush(&t);
+  assert(!strcmp(pattern(&log), "BB"));
+
+  /* A call is only redundant when what it chains with in the last one
+     already reaches its destination: compute -> transfer and transfer ->
+     fragment in one call order no compute work before fragment shading. */
+  VkMemoryBarrier2 split[2] = {
+    { VK_STRUCTURE_TYPE_MEMORY_BARRIER_2, NULL, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_WRITE_BIT,
+      VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_READ_BIT },
+    { VK_STRUCTURE_TYPE_MEMORY_BARRIER_2, NULL, VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT,
+      VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT, VK_ACCESS_2_SHADER_READ_BIT },
+  };
+  dep.memoryBarrierCount = 2;
+  dep.pMemoryBarriers = split;
+  for (int coalesce = 0; coalesce < 2; ++coalesce) {
+    memset(&log, 0, sizeof(log));
+    xeno_barrier_begin(&t, XENO_BARRIER_BALANCED, 0, coalesce);
+    assert(xeno_barrier_load2(&t, &dep));
+    xeno_barrier_record(&t);
+    barrier(&t, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+            VK_ACCESS_SHADER_READ_BIT);
+    xeno_barrier_flush(&t);
+    if (!coalesce) {
+      assert(!strcmp(pattern(&log), "BB"));
+    } else {
+      assert(!strcmp(pattern(&log), "B"));
+      assert(log.ev[0].dst0 == (VK_PIPELINE_STAGE_2_TRANSFER_BIT | VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT));
+    }
+  }
+
+  xeno_barrier_tracker_free(&t);
+  printf("barrier_opt_test: ok\n");
+  return 0;
+}
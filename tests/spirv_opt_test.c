@@ -0,0 +1,140 @@
+// tests/spirv_opt_test.c
+// Runs the fragment precision pass over hand-assembled modules.
+// Build: cc -I src -I include tests/spirv_opt_test.c src/spirv_opt.c src/spirv.c -o spirv_opt_test
+#include "spirv.h"
+#include "spirv_opt.h"
+#include "perf_conf.h"
+#include "xeno_wrapper.h"
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* The pass alone needs no configuration; the cache wrapper is not run. */
+const XenoPerfConf* xeno_perf_conf_active(void) {
+  static XenoPerfConf conf;
+  return &conf;
+}
+
+#define OP(len, op) ((uint32_t)(len) << 16 | (op))
+
+enum {
+  GLSL = 1, MAIN, OUT, UV, DEPTH, VOID, FN, FLOAT, V4, V2, POUT4, POUTF, PIN2, PFN, HALF,
+  LABEL, TMP, A, X, Y, XY, S, COL, D, BOUND
+};
+
+/* out = vec4(uv.x * uv.y + 0.5); gl_FragDepth = uv.x * 0.5; plus an
+   unused local and a name. */
+static const uint32_t k_frag[] = {
+  XENO_SPIRV_MAGIC, 0x00010000, 0, BOUND, 0,
+  OP(2, 17), 1,                                             /* OpCapability Shader */
+  OP(6, 11), GLSL, 0x4c534c47, 0x6474732e, 0x3035342e, 0,   /* OpExtInstImport "GLSL.std.450" */
+  OP(3, 14), 0, 1,                                          /* OpMemoryModel Logical GLSL450 */
+  OP(8, 15), 4, MAIN, 0x6e69616d, 0, OUT, UV, DEPTH,        /* OpEntryPoint Fragment */
+  OP(3, 16), MAIN, 7,                                       /* OpExecutionMode OriginUpperLeft */
+  OP(4, 5), MAIN, 0x6e69616d, 0,                            /* OpName */
+  OP(4, 71), OUT, 30, 0,                                    /* Location 0 */
+  OP(4, 71), DEPTH, 11, 22,                                 /* BuiltIn FragDepth */
+  OP(2, 19), VOID,
+  OP(3, 33), FN, VOID,
+  OP(3, 22), FLOAT, 32,
+  OP(4, 23), V4, FLOAT, 4,
+  OP(4, 23), V2, FLOAT, 2,
+  OP(4, 32), POUT4, 3, V4,
+  OP(4, 32), POUTF, 3, FLOAT,
+  OP(4, 32), PIN2, 1, V2,
+  OP(4, 32), PFN, 7, FLOAT,
+  OP(4, 59), POUT4, OUT, 3,
+  OP(4, 59), POUTF, DEPTH, 3,
+  OP(4, 59), PIN2, UV, 1,
+  OP(4, 43), FLOAT, HALF, 0x3f000000,
+  OP(5, 54), VOID, MAIN, 0, FN,
+  OP(2, 248), LABEL,
+  OP(4, 59), PFN, TMP, 7,
+  OP(4, 61), V2, A, UV,
+  OP(5, 81), FLOAT, X, A, 0,
+  OP(5, 81), FLOAT, Y, A, 1,
+  OP(5, 133), FLOAT, XY, X, Y,
+  OP(5, 129), FLOAT, S, XY, HALF,
+  OP(7, 80), V4, COL, S, S, S, S,
+  OP(3, 62), OUT, COL,
+  OP(5, 133), FLOAT, D, X, HALF,
+  OP(3, 62), DEPTH, D,
+  OP(1, 253),
+  OP(1, 56),
+};
+
+static int relaxed(const uint32_t* words, size_t bytes, uint32_t id) {
+  XenoSpirvModule m;
+  assert(xeno_spirv_parse(words, bytes, &m));
+  for (uint32_t at = XENO_SPIRV_HEADER_WORDS; at < m.word_count; at += xeno_spirv_length(&m, at)) {
+    const uint32_t* w = &words[at];
+    if (w[0] == OP(3, XENO_SPV_OP_DECORATE) && w[1] == id && w[2] == XENO_SPV_DECORATION_RELAXED_PRECISION) return 1;
+  }
+  return 0;
+}
+
+static int has_op(const uint32_t* words, size_t bytes, uint32_t op, uint32_t id) {
+  XenoSpirvModule m;
+  assert(xeno_spirv_parse(words, bytes, &m));
+  for (uint32_t at = XENO_SPIRV_HEADER_WORDS; at < m.word_count; at += xeno_spirv_length(&m, at)) {
+    if (xeno_spirv_opcode(&m, at) == op && (!id || words[at + 2] == id)) return 1;
+  }
+  return 0;
+}
+
+static void test_parse(void) {
+  XenoSpirvModule m;
+  assert(xeno_spirv_parse(k_frag, sizeof(k_frag), &m));
+  assert(m.bound == BOUND && m.stages == 1u << XENO_SPV_MODEL_FRAGMENT);
+  assert(m.first_function < m.word_count && k_frag[m.first_function] == OP(5, 54));
+  assert(xeno_wrapper_validate_spirv(k_frag, sizeof(k_frag)) == VK_SUCCESS);
+
+  /* An instruction running past the end, a bad magic, a ragged size. */
+  uint32_t bad[sizeof(k_frag) / 4];
+  memcpy(bad, k_frag, sizeof(bad));
+  bad[sizeof(bad) / 4 - 1] = OP(2, 56);
+  assert(!xeno_spirv_parse(bad, sizeof(bad), &m));
+  assert(xeno_wrapper_validate_spirv(bad, sizeof(bad)) == VK_ERROR_INVALID_SHADER_NV);
+  memcpy(bad, k_frag, sizeof(bad));
+  bad[0] = 0x03022307;
+  assert(!xeno_spirv_parse(bad, sizeof(bad), &m));
+  assert(!xeno_spirv_parse(k_frag, sizeof(k_frag) - 2, &m));
+}
+
+static void test_relax(void) {
+  size_t bytes = 0;
+  XenoSpirvOptStats stats;
+  uint32_t* out = xeno_spirv_relax(k_frag, sizeof(k_frag), &bytes, &stats);
+  assert(out);
+  printf("relaxed %u, stripped %u\n", stats.relaxed, stats.stripped);
+
+  /* Only what reaches the color output; x also feeds the depth. */
+  assert(stats.relaxed == 4 && stats.stripped == 2);
+  assert(relaxed(out, bytes, Y) && relaxed(out, bytes, XY) && relaxed(out, bytes, S) && relaxed(out, bytes, COL));
+  assert(!relaxed(out, bytes, X) && !relaxed(out, bytes, D) && !relaxed(out, bytes, A));
+  assert(!has_op(out, bytes, XENO_SPV_OP_NAME, 0));
+  assert(!has_op(out, bytes, XENO_SPV_OP_VARIABLE, TMP) && has_op(out, bytes, XENO_SPV_OP_VARIABLE, OUT));
+  assert(bytes == sizeof(k_frag) + 4 * (3 * 4 - 4 - 4));
+
+  /* Nothing left to do the second time. */
+  size_t again = 0;
+  assert(!xeno_spirv_relax(out, bytes, &again, &stats));
+  free(out);
+}
+
+static void test_other_stages(void) {
+  uint32_t vert[sizeof(k_frag) / 4];
+  memcpy(vert, k_frag, sizeof(vert));
+  vert[5 + 2 + 6 + 3 + 1] = 0;    /* OpEntryPoint Vertex */
+  size_t bytes = 0;
+  assert(!xeno_spirv_relax(vert, sizeof(vert), &bytes, NULL));
+}
+
+int main(void) {
+  test_parse();
+  test_relax();
+  test_other_stages();
+  puts("spirv_opt_test: ok");
+  return 0;
+}
@@ -0,0 +1,83 @@
+// tests/vrs_controller_test.c
+// Drives the shading-rate controller with a simulated GPU timing trace.
+// Build: cc -I src/drivers/xclipse tests/vrs_controller_test.c src/drivers/xclipse/vrs_controller.c -o vrs_controller_test
+#include "vrs_controller.h"
+#include <assert.h>
+#include <stdio.h>
+
+/* Simulated frame: fixed cost plus a fragment cost that scales with shaded pixels. */
+static float sim_frame_ms(float fixed_ms, float fragment_ms, int level, unsigned* seed) {
+  uint32_t w, h;
+  xeno_vrs_level_size(level, &w, &h);
+  *seed = *seed * 1664525u + 1013904223u;
+  float jitter = ((float)((*seed >> 8) % 2001u) - 1000.0f) / 1000.0f;  /* +-1 */
+  return fixed_ms + fragment_ms / (float)(w * h) + jitter * 0.8f;
+}
+
+typedef struct { int final_level; int changes; int changes_tail; } RunResult;
+
+static RunResult run(XenoVrsController* c, float fixed_ms, float fragment_ms, int frames) {
+  RunResult r = { c->level, 0, 0 };
+  unsigned seed = 1234u;
+  int prev = c->level;
+  for (int f = 0; f < frames; ++f) {
+    int lvl = xeno_vrs_controller_update(c, sim_frame_ms(fixed_ms, fragment_ms, prev, &seed));
+    if (lvl != prev) {
+      r.changes++;
+      if (f >= frames / 2) r.changes_tail++;
+    }
+    prev = lvl;
+  }
+  r.final_level = prev;
+  return r;
+}
+
+int main(void) {
+  XenoVrsControllerConfig cfg;
+  XenoVrsController c;
+
+  /* Light scene at 60 fps stays at full rate. */
+  xeno_vrs_controller_config_defaults(&cfg, 60, 4);
+  xeno_vrs_controller_init(&c, &cfg);
+  RunResult r = run(&c, 4.0f, 8.0f, 600);
+  assert(r.final_level == 0 && r.changes == 0);
+
+  /* Heavy scene (~26 ms at 1x1) coarsens until it fits, then holds steady. */
+  xeno_vrs_controller_init(&c, &cfg);
+  r = run(&c, 4.0f, 22.0f, 600);
+  uint32_t w, h;
+  xeno_vrs_level_size(r.final_level, &w, &h);
+  assert(r.final_level > 0);
+  assert(4.0f + 22.0f / (float)(w * h) <= cfg.target_frame_ms * (1.0f + cfg.coarsen_margin));
+  assert(r.changes_tail == 0);
+
+  /* Load drops again: back to full rate without ping-ponging. */
+  r = run(&c, 4.0f, 6.0f, 600);
+  assert(r.final_level == 0 && r.changes_tail == 0);
+
+  /* Borderline load sits in the dead band instead of oscillating. */
+  xeno_vrs_controller_init(&c, &cfg);
+  r = run(&c, 4.0f, 12.0f, 1200);
+  assert(r.changes <= 2 && r.changes_tail == 0);
+
+  /* max_rate=2 never goes past 2x2. */
+  xeno_vrs_controller_config_defaults(&cfg, 60, 2);
+  xeno_vrs_controller_init(&c, &cfg);
+  r = run(&c, 4.0f, 80.0f, 600);
+  assert(r.final_level == 2);
+
+  /* Disabled controller. */
+  xeno_vrs_controller_config_defaults(&cfg, 0, 4);
+  xeno_vrs_controller_init(&c, &cfg);
+  r = run(&c, 4.0f, 80.0f, 100);
+  assert(r.final_level == 0 && r.changes == 0);
+
+  /* Invalid samples are ignored. */
+  xeno_vrs_controller_config_defaults(&cfg, 60, 4);
+  xeno_vrs_controller_init(&c, &cfg);
+  for (int i = 0; i < 100; ++i) assert(xeno_vrs_controller_update(&c, 0.0f) == 0);
+  assert(c.samples == 0);
+
+  printf("vrs_controller_test: OK\n");
+  return 0;
+}
@@ -0,0 +1,243 @@
+// tests/xeno_mem_test.c
+// Runs the device-memory sub-allocator against a fake device.
+// Build: cc -DXENO_TRACE_DISABLED -I src -I include tests/xeno_mem_test.c src/xeno_mem.c -lpthread -o xeno_mem_test
+#include "xeno_mem.h"
+#include "xeno_dispatch.h"
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define KB(n) ((VkDeviceSize)(n) << 10)
+#define MB(n) ((VkDeviceSize)(n) << 20)
+
+enum { TYPE_DEVICE = 0, TYPE_CACHED = 1, TYPE_COHERENT = 2 };
+
+/* The layer's dispatch map, normally defined by xeno_dispatch.c. */
+XenoDispatchSlot xeno_dispatch_slots_g[XENO_DISPATCH_MAP_CAPACITY];
+
+typedef struct {
+  VkDeviceSize size;
+  void* host;
+} FakeMemory;
+
+static VkPhysicalDeviceMemoryProperties g_mem_props;
+static VkPhysicalDeviceProperties g_props;
+static int g_live;                      /* VkDeviceMemory objects */
+static VkDeviceSize g_last_size;
+static VkMemoryAllocateFlags g_last_flags;
+static int g_flushes;
+static VkMappedMemoryRange g_flushed;
+
+static VKAPI_ATTR void VKAPI_CALL fake_memory_properties(VkPhysicalDevice physical,
+                                                         VkPhysicalDeviceMemoryProperties* out) {
+  (void)physical;
+  *out = g_mem_props;
+}
+
+static VKAPI_ATTR void VKAPI_CALL fake_properties(VkPhysicalDevice physical, VkPhysicalDeviceProperties* out) {
+  (void)physical;
+  *out = g_props;
+}
+
+static VKAPI_ATTR VkResult VKAPI_CALL fake_allocate(VkDevice device, const VkMemoryAllocateInfo* info,
+                                                    const VkAllocationCallbacks* alloc, VkDeviceMemory* out) {
+  (void)device; (void)alloc;
+  FakeMemory* m = (FakeMemory*)calloc(1, sizeof(*m));
+  m->size = info->allocationSize;
+  g_last_size = info->allocationSize;
+  g_last_flags = 0;
+  for (const VkBaseInStructure* s = (const VkBaseInStructure*)info->pNext; s; s = s->pNext) {
+    if (s->sType == VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_FLAGS_INFO) g_last_flags = ((const VkMemoryAllocateFlagsInfo*)s)->flags;
+  }
+  g_live++;
+  *out = (VkDeviceMemory)(uintptr_t)m;
+  return VK_SUCCESS;
+}
+
+static VKAPI_ATTR void VKAPI_CALL fake_free(VkDevice device, VkDeviceMemory memory, const VkAllocationCallbacks* alloc) {
+  (void)device; (void)alloc;
+  FakeMemory* m = (FakeMemory*)(uintptr_t)memory;
+  free(m->host);
+  free(m);
+  g_live--;
+}
+
+static VKAPI_ATTR VkResult VKAPI_CALL fake_map(VkDevice device, VkDeviceMemory memory, VkDeviceSize offset,
+                                               VkDeviceSize size, VkMemoryMapFlags flags, void** out) {
+  (void)device; (void)offset; (void)size; (void)flags;
+  FakeMemory* m = (FakeMemory*)(uintptr_t)memory;
+  m->host = malloc((size_t)m->size);
+  *out = m->host;
+  return VK_SUCCESS;
+}
+
+static VKAPI_ATTR VkResult VKAPI_CALL fake_flush(VkDevice device, uint32_t count, const VkMappedMemoryRange* ranges) {
+  (void)device;
+  assert(count == 1);
+  g_flushes++;
+  g_flushed = ranges[0];
+  return VK_SUCCESS;
+}
+
+static XenoInstanceDispatch g_instance;
+static XenoDeviceDispatch g_device;
+static void* g_device_handle[1] = { (void*)(uintptr_t)0x5eed0000u };   /* first word is the loader key */
+
+/* A fresh allocator on a device with these limits. */
+static XenoMemAllocator* open_device(VkDeviceSize granularity, VkDeviceSize atom) {
+  VkDevice dev = (VkDevice)(void*)g_device_handle;
+  xeno_mem_device_destroy(dev);
+  assert(g_live == 0);
+
+  memset(&g_mem_props, 0, sizeof(g_mem_props));
+  g_mem_props.memoryTypeCount = 3;
+  g_mem_props.memoryTypes[TYPE_DEVICE].propertyFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+  g_mem_props.memoryTypes[TYPE_CACHED].propertyFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
+  g_mem_props.memoryTypes[TYPE_COHERENT].propertyFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+  g_mem_props.memoryHeapCount = 1;
+  g_mem_props.memoryHeaps[0].size = MB(1024);
+  memset(&g_props, 0, sizeof(g_props));
+  g_props.limits.bufferImageGranularity = granularity;
+  g_props.limits.nonCoherentAtomSize = atom;
+
+  g_instance.GetPhysicalDeviceMemoryProperties = fake_memory_properties;
+  g_instance.GetPhysicalDeviceProperties = fake_properties;
+  g_device.device = dev;
+  g_device.instance = &g_instance;
+  g_device.AllocateMemory = fake_allocate;
+  g_device.FreeMemory = fake_free;
+  g_device.MapMemory = fake_map;
+  g_device.FlushMappedMemoryRanges = fake_flush;
+
+  uintptr_t key = xeno_dispatch_key(dev);
+  XenoDispatchSlot* s = &xeno_dispatch_slots_g[xeno_dispatch_hash(key)];
+  atomic_store(&s->key, key);
+  atomic_store(&s->value, (void*)&g_device);
+  return xeno_mem_allocator(dev);
+}
+
+static XenoMemAlloc alloc(XenoMemAllocator* m, VkDeviceSize size, VkDeviceSize align, uint32_t type, XenoMemKind kind) {
+  VkMemoryRequirements req = { size, align, 1u << type };
+  XenoMemAlloc a;
+  VkResult r = xeno_mem_alloc(m, &req, 0, 0, kind, &a);
+  assert(r == VK_SUCCESS);
+  (void)r;
+  return a;
+}
+
+static XenoMemStats stats(XenoMemAllocator* m) {
+  XenoMemStats s;
+  xeno_mem_get_stats(m, &s);
+  return s;
+}
+
+int main(void) {
+  /* Splits run front to back inside the first 2 MiB block. */
+  XenoMemAllocator* m = open_device(1, 64);
+  assert(m);
+  XenoMemAlloc a = alloc(m, KB(256), 256, TYPE_DEVICE, XENO_MEM_KIND_LINEAR);
+  XenoMemAlloc b = alloc(m, KB(256), 256, TYPE_DEVICE, XENO_MEM_KIND_LINEAR);
+  XenoMemAlloc c = alloc(m, KB(256), 256, TYPE_DEVICE, XENO_MEM_KIND_LINEAR);
+  assert(g_live == 1 && g_last_size == MB(2));
+  assert(a.memory == b.memory && b.memory == c.memory && a.block && !a.mapped);
+  assert(a.offset == 0 && b.offset == KB(256) && c.offset == KB(512));
+  assert(stats(m).sub_allocations == 3 && stats(m).used_bytes == KB(768));
+
+  /* Freeing two neighbours merges them: a request for both (with no
+     alignment slack to search for) fits at 0. */
+  xeno_mem_free(m, &b);
+  assert(!b.memory);
+  xeno_mem_free(m, &a);
+  assert(stats(m).largest_free == MB(2) - KB(768));
+  XenoMemAlloc d = alloc(m, KB(512), 64, TYPE_DEVICE, XENO_MEM_KIND_LINEAR);
+  assert(d.offset == 0 && d.memory == c.memory);
+  xeno_mem_free(m, &d);
+  xeno_mem_free(m, &c);
+  XenoMemStats st = stats(m);
+  assert(st.sub_allocations == 0 && st.used_bytes == 0 && st.largest_free == MB(2));
+  assert(st.device_allocations == 1 && g_live == 1);   /* the pool keeps its last block */
+
+  /* Alignment padding stays free and merges back. */
+  a = alloc(m, 100, 4096, TYPE_DEVICE, XENO_MEM_KIND_LINEAR);
+  b = alloc(m, 100, 4096, TYPE_DEVICE, XENO_MEM_KIND_LINEAR);
+  assert(a.offset == 0 && a.size == 128 && b.offset == 4096);
+  xeno_mem_free(m, &a);
+  xeno_mem_free(m, &b);
+  assert(stats(m).largest_free == MB(2));
+
+  /* A full pool grows by a doubled block; empty blocks other than the
+     pool's last one go back to the driver. */
+  a = alloc(m, MB(1), 64, TYPE_DEVICE, XENO_MEM_KIND_LINEAR);
+  b = alloc(m, MB(1), 64, TYPE_DEVICE, XENO_MEM_KIND_LINEAR);
+  c = alloc(m, MB(1), 64, TYPE_DEVICE, XENO_MEM_KIND_LINEAR);
+  assert(g_live == 2 && g_last_size == MB(4) && c.memory != a.memory);
+  xeno_mem_free(m, &a);
+  xeno_mem_free(m, &b);
+  assert(g_live == 1);
+  xeno_mem_free(m, &c);
+  assert(g_live == 1);
+
+  /* Dedicated allocations from half a maximum block (16 MiB) up, sized exactly. */
+  a = alloc(m, MB(16) - 64, 64, TYPE_DEVICE, XENO_MEM_KIND_LINEAR);
+  assert(a.block);
+  b = alloc(m, MB(16), 64, TYPE_DEVICE, XENO_MEM_KIND_LINEAR);
+  assert(!b.block && b.offset == 0 && g_last_size == MB(16));
+  c = alloc(m, MB(16) + 1, 64, TYPE_DEVICE, XENO_MEM_KIND_ADDRESS);
+  assert(!c.block && c.size == MB(16) + 1 && g_last_size == MB(16) + 1);
+  assert(g_last_flags == VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT);
+  int live = g_live;
+  xeno_mem_free(m, &b);
+  xeno_mem_free(m, &c);
+  assert(g_live == live - 2);
+  xeno_mem_free(m, &a);
+
+  /* bufferImageGranularity > 1: buffers and optimal images never share a
+     block; device-address buffers always get their own. */
+  m = open_device(1024, 64);
+  a = alloc(m, KB(4), 64, TYPE_DEVICE, XENO_MEM_KIND_LINEAR);
+  b = alloc(m, KB(4), 64, TYPE_DEVICE, XENO_MEM_KIND_OPTIMAL);
+  c = alloc(m, KB(4), 64, TYPE_DEVICE, XENO_MEM_KIND_ADDRESS);
+  assert(a.memory != b.memory && a.memory != c.memory && b.memory != c.memory && g_live == 3);
+  assert(g_last_flags == VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT);
+  xeno_mem_free(m, &a);
+  xeno_mem_free(m, &b);
+  xeno_mem_free(m, &c);
+
+  m = open_device(1, 64);
+  a = alloc(m, KB(4), 64, TYPE_DEVICE, XENO_MEM_KIND_LINEAR);
+  b = alloc(m, KB(4), 64, TYPE_DEVICE, XENO_MEM_KIND_OPTIMAL);
+  c = alloc(m, KB(4), 64, TYPE_DEVICE, XENO_MEM_KIND_ADDRESS);
+  assert(a.memory == b.memory && a.memory != c.memory && g_live == 2);
+  xeno_mem_free(m, &a);
+  xeno_mem_free(m, &b);
+  xeno_mem_free(m, &c);
+
+  /* Non-coherent memory: allocations cover whole nonCoherentAtomSize atoms,
+     so a flush never reaches into a neighbour. */
+  m = open_device(1, 256);
+  a = alloc(m, 100, 16, TYPE_CACHED, XENO_MEM_KIND_LINEAR);
+  b = alloc(m, 100, 16, TYPE_CACHED, XENO_MEM_KIND_LINEAR);
+  assert(a.type == TYPE_CACHED && a.mapped && (char*)b.mapped - (char*)a.mapped == (ptrdiff_t)(b.offset - a.offset));
+  assert(a.offset % 256 == 0 && a.size == 256 && b.offset % 256 == 0 && b.offset >= a.offset + 256);
+  assert(xeno_mem_flush(m, &b, 10, 20) == VK_SUCCESS);
+  assert(g_flushes == 1 && g_flushed.memory == b.memory);
+  assert(g_flushed.offset == b.offset && g_flushed.size == 256);
+  assert(xeno_mem_flush(m, &b, 0, VK_WHOLE_SIZE) == VK_SUCCESS);
+  assert(g_flushes == 2 && g_flushed.offset == b.offset && g_flushed.size == 256);
+  xeno_mem_free(m, &a);
+  xeno_mem_free(m, &b);
+
+  /* Coherent memory keeps the granule and never flushes. */
+  a = alloc(m, 100, 16, TYPE_COHERENT, XENO_MEM_KIND_LINEAR);
+  b = alloc(m, 100, 16, TYPE_COHERENT, XENO_MEM_KIND_LINEAR);
+  assert(a.size == 128 && b.offset == 128);
+  assert(xeno_mem_flush(m, &b, 0, VK_WHOLE_SIZE) == VK_SUCCESS && g_flushes == 2);
+  xeno_mem_free(m, &a);
+  xeno_mem_free(m, &b);
+
+  xeno_mem_device_destroy((VkDevice)(void*)g_device_handle);
+  assert(g_live == 0);
+  printf("xeno_mem_test: ok\n");
+  return 0;
+}